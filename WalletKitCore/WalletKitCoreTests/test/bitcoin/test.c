@@ -42,6 +42,9 @@
 #include "dogecoin/BRDogecoinParams.h"
 
 #include "bitcoin/BRBitcoinBloomFilter.h"
+#include "bitcoin/BRBitcoinBlockFilter.h"
+#include "bitcoin/BRBitcoinBlockWindows.h"
+#include "bitcoin/BRBitcoinHeaderStore.h"
 #include "bitcoin/BRBitcoinMerkleBlock.h"
 #include "bitcoin/BRBitcoinWallet.h"
 #include "bitcoin/BRBitcoinPeer.h"
@@ -58,6 +61,7 @@
 #include <inttypes.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <pthread.h>
@@ -370,6 +374,53 @@ int BRBase58Tests()
     if (l5 != 21 || memcmp(s, b5, l5) != 0)
         r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58CheckDecode() test 5\n", __func__);
 
+    // the ripple alphabet, including an all zero value
+    
+    const char *xrp = "rpshnaf39wBUDNEGHJKLM4PQRST7VWXYZ2bcdeCg65jkm8oFqi1tuvAxyz";
+    char s6[BRBase58EncodeEx(NULL, 0, (uint8_t *)s, 21, xrp)];
+    uint8_t b6[21];
+    
+    BRBase58EncodeEx(s6, sizeof(s6), (uint8_t *)s, 21, xrp);
+    if (strcmp(s6, "4Q9S5q6opyAWjgt3sfGS98XeNxg4") != 0 || BRBase58DecodeEx(b6, sizeof(b6), s6, xrp) != 21 ||
+        memcmp(s, b6, 21) != 0) r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58EncodeEx() test 1\n", __func__);
+
+    if (BRBase58DecodeEx(b6, sizeof(b6), "rrrr", xrp) != 4 || memcmp(b6, "\0\0\0\0", 4) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58DecodeEx() test 1\n", __func__);
+
+    if (BRBase58DecodeEx(b6, sizeof(b6), "r0", xrp) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58DecodeEx() test 2\n", __func__);
+
+    // batch encode and validate
+    
+    uint8_t data[100*21], out[100*21];
+    char strs[100][36];
+    const char *ptrs[100];
+    size_t lens[100];
+
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (i % 21 < (i/21) % 4) ? 0 : (uint8_t)(i*131 + 17);
+
+    if (BRBase58CheckEncodeBatch(strs[0], sizeof(*strs), data, 21, 100) != 100)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58CheckEncodeBatch() test 1\n", __func__);
+
+    for (size_t i = 0; i < 100; i++) {
+        char str[36];
+
+        BRBase58CheckEncode(str, sizeof(str), &data[i*21], 21);
+        if (strcmp(str, strs[i]) != 0) r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58CheckEncodeBatch() test 2\n", __func__);
+        ptrs[i] = strs[i];
+    }
+
+    strs[42][5] = (strs[42][5] == 'z') ? 'y' : 'z'; // bad checksum
+    
+    if (BRBase58CheckDecodeBatch(out, 21, lens, ptrs, 100) != 99 || lens[42] != 0 || lens[41] != 21 ||
+        memcmp(out, data, 42*21) != 0) r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58CheckDecodeBatch() test 1\n", __func__);
+
+    if (BRBase58CheckDecodeBatch(NULL, 20, lens, ptrs, 100) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58CheckDecodeBatch() test 2\n", __func__);
+
+    if (BRBase58CheckEncodeBatch(strs[0], 20, data, 21, 100) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRBase58CheckEncodeBatch() test 3\n", __func__);
+
     return r;
 }
 
@@ -743,6 +794,9 @@ int BRDogecoinAuxPowTests()
     return r;
 }
 
+// double-sha-256 batch with the given implementation, 0 for scalar, 1 for sse2 and 2 for avx2, returns the one used
+extern int _BRSHA256_2BatchImpl(void *md32s, const void *data[], const size_t dataLen[], size_t count, int impl);
+
 int BRHashTests()
 {
     // test sha1
@@ -995,6 +1049,27 @@ int BRHashTests()
 
     if (BRSip64(k, d,15) != 0xa129ca6149be45e5) r = 0, fprintf(stderr, "***FAILED*** %s: BRSip64() test 4\n", __func__);
 
+    // test double-sha-256 batch, messages of every length across one to three blocks, in lanes that finish at
+    // different times
+
+    uint8_t msgs[256], mds[130*32];
+    const void *ptrs[130];
+    size_t lens[130];
+
+    for (size_t i = 0; i < sizeof(msgs); i++) msgs[i] = (uint8_t)(i*7 + 1);
+    for (size_t i = 0; i < 130; i++) ptrs[i] = &msgs[i % 61], lens[i] = (i*37) % 190;
+    ptrs[3] = NULL, lens[3] = 0;
+
+    for (int impl = 0; impl < 3; impl++) {
+        if (_BRSHA256_2BatchImpl(mds, ptrs, lens, 130, impl) != impl) break;
+
+        for (size_t i = 0; i < 130; i++) {
+            BRSHA256_2(md, ptrs[i], lens[i]);
+            if (memcmp(md, &mds[i*32], 32) != 0)
+                r = 0, fprintf(stderr, "***FAILED*** %s: BRSHA256_2Batch() impl %d test %zu\n", __func__, impl, i);
+        }
+    }
+
     if (! r) fprintf(stderr, "\n                                    ");
     return r;
 }
@@ -1294,6 +1369,10 @@ int BRDrbgTests()
     return r;
 }
 
+// chacha20 with the given implementation, 0 for scalar, 1 for sse2 and 2 for avx2, returns the one used
+extern int _BRChacha20Impl(void *out, const void *key32, const void *iv8, const void *data, size_t dataLen,
+                           uint64_t counter, int impl);
+
 int BRChachaTests()
 {
     int r = 1;
@@ -1384,6 +1463,24 @@ int BRChachaTests()
     if (memcmp(msg3, out3, sizeof(out3)) != 0)
         r = 0, fprintf(stderr, "***FAILED*** %s: BRChacha20() de-cipher test 3\n", __func__);
 
+    // each implementation the cpu supports, including a block counter that carries into its high word mid-stream
+    uint8_t data[1500], ref[sizeof(data)], out4[sizeof(data)];
+
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = i*7 + 3;
+    _BRChacha20Impl(ref, key3, iv3, data, sizeof(data), 0xfffffff9, 0);
+
+    for (int impl = 0; impl < 3; impl++) {
+        if (_BRChacha20Impl(out2, key2, iv2, msg2, sizeof(msg2) - 1, 1, impl) != impl) break;
+        if (memcmp(cipher2, out2, sizeof(out2)) != 0)
+            r = 0, fprintf(stderr, "***FAILED*** %s: BRChacha20() impl %d cipher test 2\n", __func__, impl);
+
+        for (size_t len = 0; len <= sizeof(data); len += 97) {
+            _BRChacha20Impl(out4, key3, iv3, data, len, 0xfffffff9, impl);
+            if (memcmp(ref, out4, len) != 0)
+                r = 0, fprintf(stderr, "***FAILED*** %s: BRChacha20() impl %d length %zu test\n", __func__, impl, len);
+        }
+    }
+
     return r;
 }
 
@@ -1445,6 +1542,9 @@ int BRAuthEncryptTests()
     return r;
 }
 
+// expands key with the given implementation, 0 for constant time, 1 for aes-ni and 2 for vaes, returns the one used
+extern int _BRAESKeyInitImpl(BRAESKey *key, const void *key16, size_t keyLen, int impl);
+
 int BRAesTests()
 {
     int r = 1;
@@ -1504,7 +1604,105 @@ int BRAesTests()
 
     BRAESCTR(buf, &key3, 32, iv, in3, 64);
     if (memcmp(buf, plain, 64) != 0) r = 0, fprintf(stderr, "\n***FAILED*** %s: BRAESCTR() test 3", __func__);
-    
+
+    // the same vectors, along with FIPS-197 appendix C, against each implementation the cpu supports
+    const UInt256 *keys[] = { &key1, &key2, &key3 };
+    const char *ciphers[] = { cipher1, cipher2, cipher3 }, *ins[] = { in1, in2, in3 };
+    const char fipsCiphers[][16] = {
+        "\x69\xc4\xe0\xd8\x6a\x7b\x04\x30\xd8\xcd\xb7\x80\x70\xb4\xc5\x5a",
+        "\xdd\xa9\x7c\xa4\x86\x4c\xdf\xe0\x6e\xaf\x70\xa0\xec\x0d\x71\x91",
+        "\x8e\xa2\xb7\xca\x51\x67\x45\xbf\xea\xfc\x49\x90\x4b\x49\x60\x89"
+    };
+    uint8_t fipsKey[32], fipsPlain[16], data[1000], out[1000], ref[1000];
+    BRAESKey k;
+
+    for (size_t i = 0; i < sizeof(fipsKey); i++) fipsKey[i] = i;
+    for (size_t i = 0; i < sizeof(fipsPlain); i++) fipsPlain[i] = i*0x11;
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = i*7 + 3;
+
+    for (int impl = 0; impl < 3; impl++) {
+        for (int i = 0; i < 3; i++) {
+            if (_BRAESKeyInitImpl(&k, keys[i], 16 + i*8, impl) != impl) break;
+
+            BRAESKeyECBEncrypt(&k, buf, plain, 1);
+            if (memcmp(buf, ciphers[i], 16) != 0)
+                r = 0, fprintf(stderr, "\n***FAILED*** %s: BRAESKeyECBEncrypt() impl %d test %d", __func__, impl, i + 1);
+
+            BRAESKeyECBDecrypt(&k, buf, buf, 1);
+            if (memcmp(buf, plain, 16) != 0)
+                r = 0, fprintf(stderr, "\n***FAILED*** %s: BRAESKeyECBDecrypt() impl %d test %d", __func__, impl, i + 1);
+
+            BRAESKeyCTR(&k, buf, iv, ins[i], 64);
+            if (memcmp(buf, plain, 64) != 0)
+                r = 0, fprintf(stderr, "\n***FAILED*** %s: BRAESKeyCTR() impl %d test %d", __func__, impl, i + 1);
+
+            _BRAESKeyInitImpl(&k, fipsKey, 16 + i*8, impl);
+            BRAESKeyECBEncrypt(&k, buf, fipsPlain, 1);
+            if (memcmp(buf, fipsCiphers[i], 16) != 0)
+                r = 0, fprintf(stderr, "\n***FAILED*** %s: BRAESKeyECBEncrypt() impl %d fips test %d", __func__, impl, i + 1);
+
+            // long inputs go through the pipelined paths, compare them against the constant time implementation
+            _BRAESKeyInitImpl(&k, fipsKey, 16 + i*8, 0);
+            BRAESKeyECBEncrypt(&k, ref, data, sizeof(data)/16);
+            _BRAESKeyInitImpl(&k, fipsKey, 16 + i*8, impl);
+            BRAESKeyECBEncrypt(&k, out, data, sizeof(data)/16);
+            if (memcmp(out, ref, sizeof(data)/16*16) != 0)
+                r = 0, fprintf(stderr, "\n***FAILED*** %s: BRAESKeyECBEncrypt() impl %d long test %d", __func__, impl, i + 1);
+
+            BRAESKeyECBDecrypt(&k, out, out, sizeof(data)/16);
+            if (memcmp(out, data, sizeof(data)/16*16) != 0)
+                r = 0, fprintf(stderr, "\n***FAILED*** %s: BRAESKeyECBDecrypt() impl %d long test %d", __func__, impl, i + 1);
+
+            BRAESKeyCTR(&k, out, fipsPlain, data, sizeof(data));
+            BRAESKeyCTR(&k, out, fipsPlain, out, sizeof(data));
+            if (memcmp(out, data, sizeof(data)) != 0)
+                r = 0, fprintf(stderr, "\n***FAILED*** %s: BRAESKeyCTR() impl %d long test %d", __func__, impl, i + 1);
+
+            BRAESKeyClean(&k);
+        }
+    }
+
+    if (! r) fprintf(stderr, "\n                                    ");
+    return r;
+}
+
+// scrypt with at most threadCount threads, with sse2 salsa20/8 if simd is true and available
+extern void _BRScryptImpl(void *dk, size_t dkLen, const void *pw, size_t pwLen, const void *salt, size_t saltLen,
+                          unsigned n, unsigned r, unsigned p, unsigned threadCount, int simd);
+
+int BRScryptTests()
+{
+    int r = 1;
+    uint8_t dk[64];
+    
+    // https://tools.ietf.org/html/rfc7914#section-12
+    const char dk1[] = "\x77\xd6\x57\x62\x38\x65\x7b\x20\x3b\x19\xca\x42\xc1\x8a\x04\x97\xf1\x6b\x48\x44\xe3\x07\x4a"
+    "\xe8\xdf\xdf\xfa\x3f\xed\xe2\x14\x42\xfc\xd0\x06\x9d\xed\x09\x48\xf8\x32\x6a\x75\x3a\x0f\xc8\x1f\x17\xe8\xd3"
+    "\xe0\xfb\x2e\x0d\x36\x28\xcf\x35\xe2\x0c\x38\xd1\x89\x06";
+    
+    BRScrypt(dk, sizeof(dk), "", 0, "", 0, 16, 1, 1);
+    if (memcmp(dk, dk1, sizeof(dk)) != 0) r = 0, fprintf(stderr, "\n***FAILED*** %s: BRScrypt() test 1", __func__);
+
+    const char dk2[] = "\xfd\xba\xbe\x1c\x9d\x34\x72\x00\x78\x56\xe7\x19\x0d\x01\xe9\xfe\x7c\x6a\xd7\xcb\xc8\x23\x78"
+    "\x30\xe7\x73\x76\x63\x4b\x37\x31\x62\x2e\xaf\x30\xd9\x2e\x22\xa3\x88\x6f\xf1\x09\x27\x9d\x98\x30\xda\xc7\x27"
+    "\xaf\xb9\x4a\x83\xee\x6d\x83\x60\xcb\xdf\xa2\xcc\x06\x40";
+
+    // the p = 16 lanes split unevenly over three threads, and over one, with and without simd
+    for (int simd = 0; simd < 2; simd++) {
+        for (unsigned threads = 1; threads <= 3; threads += 2) {
+            _BRScryptImpl(dk, sizeof(dk), "password", 8, "NaCl", 4, 1024, 8, 16, threads, simd);
+            if (memcmp(dk, dk2, sizeof(dk)) != 0)
+                r = 0, fprintf(stderr, "\n***FAILED*** %s: BRScrypt() test 2, %u threads, simd %d", __func__, threads, simd);
+        }
+    }
+
+    const char dk3[] = "\x70\x23\xbd\xcb\x3a\xfd\x73\x48\x46\x1c\x06\xcd\x81\xfd\x38\xeb\xfd\xa8\xfb\xba\x90\x4f\x8e"
+    "\x3e\xa9\xb5\x43\xf6\x54\x5d\xa1\xf2\xd5\x43\x29\x55\x61\x3f\x0f\xcf\x62\xd4\x97\x05\x24\x2a\x9a\xf9\xe6\x1e"
+    "\x85\xdc\x0d\x65\x1e\x40\xdf\xcf\x01\x7b\x45\x57\x58\x87";
+
+    BRScryptThreads(dk, sizeof(dk), "pleaseletmein", 13, "SodiumChloride", 14, 16384, 8, 1, 4);
+    if (memcmp(dk, dk3, sizeof(dk)) != 0) r = 0, fprintf(stderr, "\n***FAILED*** %s: BRScrypt() test 3", __func__);
+
     if (! r) fprintf(stderr, "\n                                    ");
     return r;
 }
@@ -2070,6 +2268,28 @@ int BRBIP38KeyTests()
     if (BRBIP38KeySetKey(&key, "6PRW5o9FLp4gJDDVqJQKJFTpMvdsSGJxMYHtHaQBF3ooa8mwD69bapcDQn", "foobar", btcMainNetParams->addrParams))
         r = 0, fprintf(stderr, "***FAILED*** %s: BRKeySetBIP38Key() test 10\n", __func__);
 
+    // batch decryption, with one EC multiplied key and one key that doesn't match the passphrase
+    const char *bip38Keys[] = { "6PRVWUbkzzsbcVac2qwfssoUJAN1Xhrg6bNk8J7Nzm5H7kxEbn2Nh2ZoGg",
+                                "6PYNKZ1EAgYgmQfmNVamxyXVWHzK5s6DGhwP4J5o44cvXdoY7sRzhtpUeo",
+                                "6PRNFFkZc2NZ6dJqFfhRoFNMR9Lnyj7dYGrzdgXXVMXcxoKTePPX1dWByq",
+                                "6PfQu77ygVyJLZjfvMLyhLMQbYnu5uguoJJ4kMCLqWwPEdfpwANVS76gTX" },
+               *privKeys[] = { "5KN7MzqK5wt2TP1fQCYyHBtDrXdJuXbUzm4A9rKAteGu3Qi5CVR",
+                               "L44B5gGEpqEDRS9vVPz7QT35jcBG2r3CZwSwQ4fCewXAhAhqGVpP",
+                               NULL,
+                               "5K4caxezwjGCGfnoPTZ8tMcJBLB7Jvyjv4xxeacadhq8nLisLR2" };
+    BRKey keys[4];
+    int results[4];
+
+    if (BRBIP38KeySetKeys(keys, bip38Keys, 4, "TestingOneTwoThree", btcMainNetParams->addrParams, results) != 3)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRBIP38KeySetKeys() test 1\n", __func__);
+
+    for (size_t i = 0; i < 4; i++) {
+        if (results[i] != (privKeys[i] != NULL) ||
+            (privKeys[i] && (! BRKeyPrivKey(&keys[i], privKey, sizeof(privKey), btcMainNetParams->addrParams) ||
+                             strncmp(privKey, privKeys[i], sizeof(privKey)) != 0)))
+            r = 0, fprintf(stderr, "***FAILED*** %s: BRBIP38KeySetKeys() test 1, key %zu\n", __func__, i);
+    }
+
     printf("                                    ");
     return r;
 }
@@ -2737,6 +2957,27 @@ static void walletTxDeleted(void *info, UInt256 txHash, int notifyUser, int reco
 // TODO: test tx ordering for multiple tx with same block height
 // TODO: port all applicable tests from bitcoinj and bitcoincore
 
+// true if every wallet transaction is ordered after those of its parents that are at the same height
+static int _btcWalletTxOrdered(BRBitcoinWallet *wallet)
+{
+    size_t count = btcWalletTransactions(wallet, NULL, 0);
+    BRBitcoinTransaction *txs[count + 1];
+
+    count = btcWalletTransactions(wallet, txs, count);
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = i + 1; j < count; j++) {
+            if (txs[j]->blockHeight != txs[i]->blockHeight) continue;
+
+            for (size_t n = 0; n < txs[i]->inCount; n++) {
+                if (UInt256Eq(txs[i]->inputs[n].txHash, txs[j]->txHash)) return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
 int btcWalletTests()
 {
     int r = 1;
@@ -2823,7 +3064,39 @@ int btcWalletTests()
 
     if (btcWalletAllAddrs(w, NULL, 0) != SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + SEQUENCE_GAP_LIMIT_INTERNAL_EXTENDED + 1)
         r = 0, fprintf(stderr, "***FAILED*** %s: btcWalletAllAddrs() test\n", __func__);
-    
+
+    size_t externalCount = btcWalletChainAddrs(w, NULL, 0, SEQUENCE_EXTERNAL_CHAIN, 0);
+    BRAddress chainAddrs[2];
+
+    if (externalCount != SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + 1 ||
+        btcWalletChainAddrs(w, NULL, 0, SEQUENCE_EXTERNAL_CHAIN, externalCount) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcWalletChainAddrs() test 1\n", __func__);
+
+    btcWalletUnusedAddrs(w, NULL, SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + 2, SEQUENCE_EXTERNAL_CHAIN);
+
+    if (btcWalletChainAddrs(w, chainAddrs, 2, SEQUENCE_EXTERNAL_CHAIN, externalCount) != 2 ||
+        ! btcWalletContainsAddress(w, chainAddrs[0].s) || ! btcWalletContainsAddress(w, chainAddrs[1].s) ||
+        BRAddressEq(&chainAddrs[0], &chainAddrs[1]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcWalletChainAddrs() test 2\n", __func__);
+
+    // outputs paying a wallet key by pay-to-witness-pubkey-hash or pay-to-pubkey-hash are recognized, but not a
+    // pay-to-script-hash that happens to use the same hash
+    uint8_t pkhScript[25] = { OP_DUP, OP_HASH160, 20 }, shScript[23] = { OP_HASH160, 20 };
+    BRBitcoinTransaction *t = btcTransactionNew();
+
+    BRAddressHash160(&pkhScript[3], btcMainNetParams->addrParams, recvAddr.s);
+    pkhScript[23] = OP_EQUALVERIFY, pkhScript[24] = OP_CHECKSIG;
+    memcpy(&shScript[2], &pkhScript[3], 20);
+    shScript[22] = OP_EQUAL;
+    btcTransactionAddInput(t, inHash, 2, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+    btcTransactionAddOutput(t, 1, outScript, outScriptLen);
+    btcTransactionAddOutput(t, 2, pkhScript, sizeof(pkhScript));
+    btcTransactionAddOutput(t, 4, shScript, sizeof(shScript));
+    if (btcWalletAmountReceivedFromTx(w, t) != 3 || ! btcWalletContainsTransaction(w, t))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcWalletAmountReceivedFromTx() test\n", __func__);
+
+    btcTransactionFree(t);
+
     UInt256 hash = tx->txHash;
 
     tx = btcWalletCreateTransaction(w, SATOSHIS*2, addr.s);
@@ -2902,6 +3175,51 @@ int btcWalletTests()
 
     if (tx) btcTransactionFree(tx);
     btcWalletFree(w);
+
+    // a chain of transactions at the same height is ordered parent first, however it's registered and updated, even
+    // with an unrelated transaction at that height registered between the children and their parent
+    BRBitcoinTransaction *chain[3], *unrelated;
+    UInt256 chainHashes[4];
+    BRKey recvKey;
+
+    BRBIP32PrivKey(&recvKey, &seed, sizeof(seed), SEQUENCE_EXTERNAL_CHAIN, 0);
+    w = btcWalletNew(btcMainNetParams->addrParams, NULL, 0, mpk);
+
+    for (int i = 0; i < 3; i++) {
+        chain[i] = btcTransactionNew();
+        if (i == 0) btcTransactionAddInput(chain[i], inHash, 3, SATOSHIS, inScript, inScriptLen, NULL, 0, NULL, 0,
+                                           TXIN_SEQUENCE);
+        else btcTransactionAddInput(chain[i], chain[i - 1]->txHash, 0, SATOSHIS >> (i - 1), outScript, outScriptLen,
+                                    NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        btcTransactionAddOutput(chain[i], SATOSHIS >> i, outScript, outScriptLen);
+        btcTransactionSign(chain[i], 0, (i == 0) ? &k : &recvKey, 1);
+        chainHashes[2 - i] = chain[i]->txHash;
+    }
+
+    unrelated = btcTransactionNew();
+    btcTransactionAddInput(unrelated, inHash, 4, SATOSHIS, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+    btcTransactionAddOutput(unrelated, SATOSHIS, outScript, outScriptLen);
+    btcTransactionSign(unrelated, 0, &k, 1);
+    chainHashes[3] = unrelated->txHash;
+
+    for (int i = 2; i >= 0; i--) {
+        if (i == 0) btcWalletRegisterTransaction(w, unrelated);
+        btcWalletRegisterTransaction(w, chain[i]);
+        if (! _btcWalletTxOrdered(w))
+            r = 0, fprintf(stderr, "***FAILED*** %s: btcWalletRegisterTransaction() order test %d\n", __func__, 2 - i);
+    }
+
+    btcWalletUpdateTransactions(w, chainHashes, 4, 100, 1);
+    if (btcWalletTransactions(w, NULL, 0) != 4 || chain[0]->blockHeight != 100 || chain[2]->blockHeight != 100 ||
+        ! _btcWalletTxOrdered(w))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcWalletUpdateTransactions() order test\n", __func__);
+
+    btcWalletSetTxUnconfirmedAfter(w, 99);
+    if (btcWalletTransactions(w, NULL, 0) != 4 || chain[0]->blockHeight != TX_UNCONFIRMED ||
+        chain[2]->blockHeight != TX_UNCONFIRMED || ! _btcWalletTxOrdered(w))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcWalletSetTxUnconfirmedAfter() order test\n", __func__);
+
+    btcWalletFree(w);
     
     amt = btcBitcoinAmount(50000, 50000);
     if (amt != SATOSHIS) r = 0, fprintf(stderr, "***FAILED*** %s: BRBitcoinAmount() test 1\n", __func__);
@@ -2918,6 +3236,172 @@ int btcWalletTests()
     return r;
 }
 
+typedef struct {
+    BRBitcoinWallet *wallet;
+    const char *addr;
+    volatile int *done;
+    size_t queries;
+} _BRTestWalletReader;
+
+static void *_btcTestWalletReader(void *info)
+{
+    _BRTestWalletReader *reader = info;
+    BRBitcoinTransaction *txs[16];
+    BRBitcoinUTXO utxos[16];
+    size_t n;
+
+    while (! *reader->done) {
+        btcWalletBalance(reader->wallet);
+        btcWalletUTXOs(reader->wallet, utxos, 16);
+        n = btcWalletTransactions(reader->wallet, txs, 16);
+        btcWalletContainsAddress(reader->wallet, reader->addr);
+        if (n > 0) btcWalletAmountReceivedFromTx(reader->wallet, txs[n - 1]);
+        reader->queries += 5;
+    }
+
+    return NULL;
+}
+
+// reports how fast one thread can register transactions while readerCount threads query the wallet, and how many
+// queries the readers complete in the meantime
+extern void runPerfTestsWalletContention (int count, int readerCount)
+{
+    const BRBitcoinChainParams *params = btcChainParams(true);
+    const char *phrase = "a random seed";
+    UInt512 seed;
+    UInt256 secret = uint256("0000000000000000000000000000000000000000000000000000000000000001"), inHash;
+    BRKey k;
+    BRAddress addr;
+    BRBitcoinTransaction **txs = calloc(count, sizeof(*txs));
+    _BRTestWalletReader readers[readerCount];
+    pthread_t threads[readerCount];
+    volatile int done = 0;
+    struct timeval t0, t1;
+    size_t queries = 0;
+
+    BRBIP39DeriveKey(&seed, phrase, NULL);
+    BRMasterPubKey mpk = BRBIP32MasterPubKey(&seed, sizeof(seed));
+    BRBitcoinWallet *w = btcWalletNew(params->addrParams, NULL, 0, mpk);
+    BRAddress recvAddr = btcWalletReceiveAddress(w);
+
+    BRKeySetSecret(&k, &secret, 1);
+    BRKeyAddress(&k, addr.s, sizeof(addr), params->addrParams);
+
+    uint8_t inScript[BRAddressScriptPubKey(NULL, 0, params->addrParams, addr.s)];
+    size_t inScriptLen = BRAddressScriptPubKey(inScript, sizeof(inScript), params->addrParams, addr.s);
+    uint8_t outScript[BRAddressScriptPubKey(NULL, 0, params->addrParams, recvAddr.s)];
+    size_t outScriptLen = BRAddressScriptPubKey(outScript, sizeof(outScript), params->addrParams, recvAddr.s);
+
+    // sign everything up front so only wallet work is timed
+    for (int i = 0; i < count; i++) {
+        inHash = UINT256_ZERO;
+        UInt32SetLE(inHash.u8, (uint32_t)i + 1);
+        txs[i] = btcTransactionNew();
+        btcTransactionAddInput(txs[i], inHash, 0, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        btcTransactionAddOutput(txs[i], SATOSHIS/100 + i, outScript, outScriptLen);
+        btcTransactionSign(txs[i], 0, &k, 1);
+    }
+
+    for (int i = 0; i < readerCount; i++) {
+        readers[i] = (_BRTestWalletReader) { w, recvAddr.s, &done, 0 };
+        pthread_create(&threads[i], NULL, _btcTestWalletReader, &readers[i]);
+    }
+
+    gettimeofday(&t0, NULL);
+    for (int i = 0; i < count; i++) btcWalletRegisterTransaction(w, txs[i]);
+    gettimeofday(&t1, NULL);
+    done = 1;
+
+    for (int i = 0; i < readerCount; i++) {
+        pthread_join(threads[i], NULL);
+        queries += readers[i].queries;
+    }
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0;
+
+    printf("wallet with %d readers: register %.0f tx/s, queries %.0f/s\n", readerCount, count/elapsed,
+           queries/elapsed);
+    btcWalletFree(w);
+    free(txs);
+}
+
+// reports how fast the wallet orders a chain of length unconfirmed transactions, each spending the previous two,
+// registered parent first, child first, and loaded all at once in shuffled order
+extern void runPerfTestsWalletTxChain (int length)
+{
+    const BRBitcoinChainParams *params = btcChainParams(true);
+    const char *phrase = "a random seed";
+    UInt512 seed;
+    UInt256 inHash = UINT256_ZERO;
+    BRKey k;
+    BRBitcoinTransaction **txs = calloc(length, sizeof(*txs)), **copies = calloc(length, sizeof(*copies));
+    BRBitcoinWallet *w;
+    struct timeval t0, t1;
+    double elapsed;
+    int ok;
+
+    BRBIP39DeriveKey(&seed, phrase, NULL);
+    BRMasterPubKey mpk = BRBIP32MasterPubKey(&seed, sizeof(seed));
+    BRBIP32PrivKey(&k, &seed, sizeof(seed), SEQUENCE_EXTERNAL_CHAIN, 0);
+    w = btcWalletNew(params->addrParams, NULL, 0, mpk);
+    BRAddress recvAddr = btcWalletReceiveAddress(w);
+    btcWalletFree(w);
+
+    uint8_t script[BRAddressScriptPubKey(NULL, 0, params->addrParams, recvAddr.s)];
+    size_t scriptLen = BRAddressScriptPubKey(script, sizeof(script), params->addrParams, recvAddr.s);
+
+    // sign everything up front so only wallet work is timed
+    UInt32SetLE(inHash.u8, 1);
+
+    for (int i = 0; i < length; i++) {
+        txs[i] = btcTransactionNew();
+        btcTransactionAddInput(txs[i], (i > 0) ? txs[i - 1]->txHash : inHash, 0, SATOSHIS, script, scriptLen,
+                               NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        if (i > 1) btcTransactionAddInput(txs[i], txs[i - 2]->txHash, 1, SATOSHIS/4, script, scriptLen,
+                                          NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        btcTransactionAddOutput(txs[i], SATOSHIS/2, script, scriptLen);
+        btcTransactionAddOutput(txs[i], SATOSHIS/4, script, scriptLen);
+        btcTransactionSign(txs[i], 0, &k, 1);
+    }
+
+    for (int pass = 0; pass < 3; pass++) {
+        for (int i = 0; i < length; i++) copies[i] = btcTransactionCopy(txs[(pass == 1) ? length - 1 - i : i]);
+
+        for (int i = length - 1; pass == 2 && i > 0; i--) { // shuffle for the bulk load
+            int j = BRRand(i + 1);
+            BRBitcoinTransaction *tx = copies[i];
+
+            copies[i] = copies[j];
+            copies[j] = tx;
+        }
+
+        gettimeofday(&t0, NULL);
+
+        if (pass < 2) {
+            w = btcWalletNew(params->addrParams, NULL, 0, mpk);
+            for (int i = 0; i < length; i++) btcWalletRegisterTransaction(w, copies[i]);
+        }
+        else w = btcWalletNew(params->addrParams, copies, length, mpk);
+
+        gettimeofday(&t1, NULL);
+        elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0;
+
+        BRBitcoinTransaction *sorted[length];
+        size_t count = btcWalletTransactions(w, sorted, length);
+
+        // the last transaction in the chain spends every other one, so it must be last and the balance its outputs
+        ok = (count == length && btcTransactionEq(sorted[count - 1], txs[length - 1]) &&
+              btcWalletBalance(w) == SATOSHIS/2 + SATOSHIS/4 + ((length > 1) ? SATOSHIS/4 : 0));
+        printf("wallet tx chain of %d, %s: %.3f s%s\n", length,
+               (pass == 0) ? "parent first" : (pass == 1) ? "child first" : "bulk load", elapsed, (ok) ? "" : " (unordered)");
+        btcWalletFree(w);
+    }
+
+    for (int i = 0; i < length; i++) btcTransactionFree(txs[i]);
+    free(copies);
+    free(txs);
+}
+
 int btcBloomFilterTests()
 {
     int r = 1;
@@ -2993,6 +3477,108 @@ int btcBloomFilterTests()
     return r;
 }
 
+void btcPeerAcceptMessageTest(BRBitcoinPeer *peer, const uint8_t *msg, size_t len, const char *type);
+
+static size_t _relayedFilterCount = 0;
+
+static void _testRelayedFilter(void *info, BRBitcoinBlockFilter *filter)
+{
+    _relayedFilterCount++;
+    btcBlockFilterFree(filter);
+}
+
+int btcBlockFilterTests()
+{
+    int r = 1;
+    const uint8_t script[] = // testnet genesis block coinbase output script
+        "\x41\x04\x67\x8a\xfd\xb0\xfe\x55\x48\x27\x19\x67\xf1\xa6\x71\x30\xb7\x10\x5c\xd6\xa8\x28\xe0\x39"
+        "\x09\xa6\x79\x62\xe0\xea\x1f\x61\xde\xb6\x49\xf6\xbc\x3f\x4c\xef\x38\xc4\xf3\x55\x04\xe5\x1e\xc1"
+        "\x12\xde\x5c\x38\x4d\xf7\xba\x0b\x8d\x57\x8a\x4c\x70\x2b\x6b\xf1\x1d\x5f\xac";
+    uint8_t buf[64], msg[1 + sizeof(UInt256) + 1 + sizeof(buf)];
+    const uint8_t *items[100];
+    size_t len, lens[100];
+    int matched[300];
+
+    // BIP158 test vector, basic filter for testnet genesis block
+    items[0] = script, lens[0] = sizeof(script) - 1;
+
+    UInt256 blockHash = UInt256Reverse(uint256("000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943"));
+    BRBitcoinBlockFilter *f = btcBlockFilterNew(blockHash, items, lens, 1), *f2;
+
+    len = btcBlockFilterSerialize(f, buf, sizeof(buf));
+    if (len != 4 || memcmp(buf, "\x01\x9d\xfc\xa8", 4) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockFilterSerialize() test\n", __func__);
+
+    if (! UInt256Eq(btcBlockFilterHeader(btcBlockFilterHash(f), UINT256_ZERO),
+                    UInt256Reverse(uint256("21584579b7eb08997773e5aeff3a7f932700042d0ed2a6129012b7d7ae81b750"))))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockFilterHeader() test\n", __func__);
+
+    if (! btcBlockFilterMatchAny(f, items, lens, 1))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockFilterMatchAny() test 1\n", __func__);
+
+    f2 = btcBlockFilterParse(blockHash, buf, len);
+
+    if (! f2 || f2->n != f->n || f2->dataLen != f->dataLen || memcmp(f2->data, f->data, f->dataLen) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockFilterParse() test\n", __func__);
+
+    if (f2) btcBlockFilterFree(f2);
+    f2 = btcBlockFilterParse(blockHash, (const uint8_t *)"\xfd\x00", 2); // truncated varint
+
+    if (f2) r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockFilterParse() truncated test\n", __func__);
+    if (f2) btcBlockFilterFree(f2);
+    btcBlockFilterFree(f);
+
+    // filters for 300 blocks, each containing 100 distinct scripts, with a wallet script only in every 100th block
+    UInt256 scripts[100];
+    BRBitcoinBlockFilter *filters[300];
+    size_t matchCount = 0;
+
+    for (size_t i = 0; i < 300; i++) {
+        for (size_t j = 0; j < 100; j++) {
+            scripts[j] = UINT256_ZERO;
+            UInt32SetLE(&scripts[j].u8[0], (uint32_t)(i*100 + j + 1));
+            items[j] = scripts[j].u8, lens[j] = sizeof(UInt256);
+        }
+
+        blockHash = UINT256_ZERO;
+        UInt32SetLE(blockHash.u8, (uint32_t)i);
+        filters[i] = btcBlockFilterNew(blockHash, items, lens, ((i % 100) == 0) ? 100 : 99);
+    }
+
+    for (size_t j = 0; j < 3; j++) { // the wallet scripts are the last item of blocks 0, 100 and 200
+        scripts[j] = UINT256_ZERO;
+        UInt32SetLE(&scripts[j].u8[0], (uint32_t)(j*100*100 + 100));
+        items[j] = scripts[j].u8, lens[j] = sizeof(UInt256);
+    }
+
+    if (btcBlockFilterMatchAny(filters[1], items, lens, 3))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockFilterMatchAny() test 2\n", __func__);
+
+    matchCount = btcBlockFilterMatchAnyBatch(filters, 300, items, lens, 3, matched);
+
+    // with 100 items per filter and a 1/784931 false positive rate per item, a false positive here is very unlikely
+    if (matchCount != 3 || ! matched[0] || ! matched[100] || ! matched[200])
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockFilterMatchAnyBatch() test\n", __func__);
+
+    for (size_t i = 0; i < 300; i++) btcBlockFilterFree(filters[i]);
+
+    // cfilter message
+    BRBitcoinPeer *p = btcPeerNew(btcChainParams(true)->magicNumber);
+
+    btcPeerSetCompactFilterCallbacks(p, NULL, _testRelayedFilter, NULL);
+    msg[0] = BLOCK_FILTER_TYPE_BASIC;
+    UInt256Set(&msg[1], blockHash);
+    msg[1 + sizeof(UInt256)] = (uint8_t)len;
+    memcpy(&msg[1 + sizeof(UInt256) + 1], buf, len);
+    btcPeerAcceptMessageTest(p, msg, 1 + sizeof(UInt256) + 1 + len, MSG_CFILTER);
+
+    if (_relayedFilterCount != 1)
+        r = 0, fprintf(stderr, "***FAILED*** %s: cfilter message test\n", __func__);
+
+    btcPeerFree(p);
+    return r;
+}
+
 // true if block and otherBlock have equal data (in their respective structures).
 static int btcMerkleBlockEqual (const BRBitcoinMerkleBlock *block1, const BRBitcoinMerkleBlock *block2) {
     return 0 == memcmp(&block1->blockHash, &block2->blockHash, sizeof(UInt256))
@@ -3010,6 +3596,122 @@ static int btcMerkleBlockEqual (const BRBitcoinMerkleBlock *block1, const BRBitc
            && block1->height == block2->height;
 }
 
+// writes count serialized headers, as they would appear in a "headers" message, for a chain of blocks mined at the
+// minimum regtest difficulty, and returns the number of bytes written
+static size_t btcTestHeadersStream(uint8_t *buf, size_t count, uint32_t timestamp)
+{
+    UInt256 prevBlock = UINT256_ZERO, hash;
+    size_t i, off = 0;
+
+    for (i = 0; i < count; i++, off += 81) {
+        UInt32SetLE(&buf[off], 0x20000000); // version
+        UInt256Set(&buf[off + 4], prevBlock);
+        BRSHA256(&buf[off + 36], &i, sizeof(i)); // merkle root
+        UInt32SetLE(&buf[off + 68], timestamp + (uint32_t)i*600);
+        UInt32SetLE(&buf[off + 72], 0x207fffff); // target
+        buf[off + 80] = 0; // tx count
+
+        for (uint32_t nonce = 0;; nonce++) { // about half of all hashes meet the target
+            UInt32SetLE(&buf[off + 76], nonce);
+            BRSHA256_2(&hash, &buf[off], 80);
+            if (hash.u8[31] < 0x7f) break;
+        }
+
+        prevBlock = hash;
+    }
+
+    return off;
+}
+
+// walks the partial merkle tree iteratively, or with the original recursive walks if recursive is true
+extern size_t _btcMerkleBlockWalkImpl(const BRBitcoinMerkleBlock *block, UInt256 *merkleRoot, UInt256 *txHashes,
+                                      size_t hashesCount, int recursive);
+
+static uint32_t btcTestMerkleWidth(uint32_t totalTx, uint32_t height)
+{
+    return (totalTx + (1u << height) - 1) >> height;
+}
+
+// merkle tree node at the given height and position, with the last node of an odd row paired with itself
+static UInt256 btcTestMerkleHash(const UInt256 txHashes[], uint32_t totalTx, uint32_t height, uint32_t pos)
+{
+    UInt256 hashes[2], md;
+
+    if (height == 0) return txHashes[pos];
+    hashes[0] = btcTestMerkleHash(txHashes, totalTx, height - 1, pos*2);
+    hashes[1] = (pos*2 + 1 < btcTestMerkleWidth(totalTx, height - 1)) ?
+                btcTestMerkleHash(txHashes, totalTx, height - 1, pos*2 + 1) : hashes[0];
+    BRSHA256_2(&md, hashes, sizeof(hashes));
+    return md;
+}
+
+// appends the bip37 partial merkle branch for the matched tx to hashes and flags
+static void btcTestMerkleBranch(const UInt256 txHashes[], const uint8_t matched[], uint32_t totalTx, uint32_t height,
+                                uint32_t pos, UInt256 hashes[], size_t *hashesCount, uint8_t flags[], size_t *flagIdx)
+{
+    uint8_t flag = 0;
+
+    for (uint32_t i = pos << height; i < ((pos + 1) << height) && i < totalTx; i++) flag |= matched[i];
+    if (flag) flags[*flagIdx/8] |= (1 << (*flagIdx % 8));
+    (*flagIdx)++;
+
+    if (height == 0 || ! flag) hashes[(*hashesCount)++] = btcTestMerkleHash(txHashes, totalTx, height, pos);
+    else {
+        btcTestMerkleBranch(txHashes, matched, totalTx, height - 1, pos*2, hashes, hashesCount, flags, flagIdx);
+
+        if (pos*2 + 1 < btcTestMerkleWidth(totalTx, height - 1)) {
+            btcTestMerkleBranch(txHashes, matched, totalTx, height - 1, pos*2 + 1, hashes, hashesCount, flags, flagIdx);
+        }
+    }
+}
+
+// merkleblock of totalTx random tx filtered to include about one in every 'every' of them, or every tx if every is 1
+static BRBitcoinMerkleBlock *btcTestMerkleBlock(uint32_t totalTx, uint32_t every)
+{
+    BRBitcoinMerkleBlock *block = btcMerkleBlockNew();
+    UInt256 *txHashes = calloc(totalTx, sizeof(*txHashes)), *hashes = calloc(totalTx*2, sizeof(*hashes));
+    uint8_t *matched = calloc(totalTx, sizeof(*matched)), *flags = calloc(totalTx/2 + 1, sizeof(*flags));
+    size_t hashesCount = 0, flagIdx = 0;
+    uint32_t height = 0;
+
+    for (uint32_t i = 0; i < totalTx; i++) {
+        for (size_t j = 0; j < sizeof(UInt256); j++) txHashes[i].u8[j] = (uint8_t)BRRand(256);
+        matched[i] = (BRRand(every) == 0);
+    }
+
+    while (btcTestMerkleWidth(totalTx, height) > 1) height++;
+    btcTestMerkleBranch(txHashes, matched, totalTx, height, 0, hashes, &hashesCount, flags, &flagIdx);
+    block->merkleRoot = btcTestMerkleHash(txHashes, totalTx, height, 0);
+    block->timestamp = 1231006505;
+    block->target = 0x1d00ffff;
+    block->totalTx = totalTx;
+    block->hashesCount = hashesCount;
+    block->flagsLen = (flagIdx + 7)/8;
+    btcMerkleBlockSetTxHashes(block, hashes, hashesCount, flags, block->flagsLen);
+    free(flags);
+    free(matched);
+    free(hashes);
+    free(txHashes);
+    return block;
+}
+
+// true if the iterative and recursive walks of the partial merkle tree agree on the root and matched tx hashes
+static int btcTestMerkleWalksMatch(const BRBitcoinMerkleBlock *block)
+{
+    size_t count = _btcMerkleBlockWalkImpl(block, NULL, NULL, 0, 1);
+    UInt256 root[2], txHashes[2][count + 1];
+    int r = 1;
+
+    for (int i = 0; i < 2; i++) {
+        root[i] = UINT256_ZERO;
+        if (_btcMerkleBlockWalkImpl(block, &root[i], txHashes[i], count + 1, i) != count) r = 0;
+        if (_btcMerkleBlockWalkImpl(block, NULL, txHashes[i], count/2, i) != count/2) r = 0;
+    }
+
+    if (! UInt256Eq(root[0], root[1]) || memcmp(txHashes[0], txHashes[1], count*sizeof(UInt256)) != 0) r = 0;
+    return r;
+}
+
 int btcMerkleBlockTests()
 {
     int r = 1;
@@ -3064,12 +3766,102 @@ int btcMerkleBlockTests()
     
     if (! UInt256Eq(txHashes[3], uint256("c9ab658448c10b6921b7a4ce3021eb22ed6bb6a7fde1e5bcc4b1db6615c6abc5")))
         r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockTxHashes() test 4\n", __func__);
+
+    // the matched tx hashes come out of the same walk that checks the merkle root, up to the buffer size
+    UInt256 validHashes[4];
+    size_t validCount = 4;
+
+    if (! btcMerkleBlockIsValidWithTxHashes(b, (uint32_t)time(NULL), validHashes, &validCount) || validCount != 4 ||
+        memcmp(validHashes, txHashes, sizeof(validHashes)) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockIsValidWithTxHashes() test 1\n", __func__);
+
+    validCount = 2;
+    validHashes[2] = UINT256_ZERO;
+
+    if (! btcMerkleBlockIsValidWithTxHashes(b, (uint32_t)time(NULL), validHashes, &validCount) || validCount != 4 ||
+        ! UInt256Eq(validHashes[1], txHashes[1]) || ! UInt256IsZero(validHashes[2]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockIsValidWithTxHashes() test 2\n", __func__);
     
-    // TODO: test a block with an odd number of tree rows both at the tx level and merkle node level
+    uint8_t headers[1000*81];
+    BRBitcoinMerkleBlock *blocks[1000];
+    uint32_t now = (uint32_t)time(NULL);
+    size_t i, n, len = btcTestHeadersStream(headers, 1000, now - 1000*600);
+    UInt256 hash;
+
+    n = btcMerkleBlockParseHeaders(headers, len, 1000, now, btcMerkleBlockVerifyProofOfWork, blocks);
+    if (n != 1000) r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 1\n", __func__);
+
+    for (i = 1; i < n; i++) {
+        if (! UInt256Eq(blocks[i]->prevBlock, blocks[i - 1]->blockHash) ||
+            blocks[i]->nonce != UInt32GetLE(&headers[i*81 + 76]))
+            r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 2\n", __func__);
+    }
+
+    for (i = 0; i < n; i++) btcMerkleBlockFree(blocks[i]);
+
+    // the same headers hashed with scrypt, as litecoin does, stop at the first one that doesn't meet its target
+    n = btcMerkleBlockParseHeaders(headers, len, 1000, now, ltcChainParams(true)->verifyProofOfWork, blocks);
+    if (n == 1000) r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 3\n", __func__);
+
+    for (i = 0; i < n; i++) {
+        if (! ltcChainParams(true)->verifyProofOfWork(blocks[i]))
+            r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 4\n", __func__);
+        btcMerkleBlockFree(blocks[i]);
+    }
+
+    blocks[0] = (n < 1000) ? btcMerkleBlockParse(&headers[n*81], 81) : NULL;
+    if (! blocks[0] || ltcChainParams(true)->verifyProofOfWork(blocks[0]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 5\n", __func__);
+    if (blocks[0]) btcMerkleBlockFree(blocks[0]);
+
+    do { // header 700 fails SHA256d proof-of-work
+        UInt32SetLE(&headers[700*81 + 76], UInt32GetLE(&headers[700*81 + 76]) + 1);
+        BRSHA256_2(&hash, &headers[700*81], 80);
+    } while (hash.u8[31] < 0x80);
+
+    n = btcMerkleBlockParseHeaders(headers, len, 1000, now, btcMerkleBlockVerifyProofOfWork, blocks);
+    if (n != 700) r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 6\n", __func__);
+    for (i = 0; i < n; i++) btcMerkleBlockFree(blocks[i]);
+
+    n = btcMerkleBlockParseHeaders(headers, len, 1000, now, NULL, blocks); // proof-of-work not checked
+    if (n != 1000 || btcMerkleBlockVerifyProofOfWork(blocks[700]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 7\n", __func__);
+    for (i = 0; i < n; i++) btcMerkleBlockFree(blocks[i]);
+
+    UInt32SetLE(&headers[600*81 + 68], now + BLOCK_MAX_TIME_DRIFT + 1); // header 600 is too far in the future
+    n = btcMerkleBlockParseHeaders(headers, len, 1000, now, btcMerkleBlockVerifyProofOfWork, blocks);
+    if (n != 600) r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 8\n", __func__);
+    for (i = 0; i < n; i++) btcMerkleBlockFree(blocks[i]);
+
+    n = btcMerkleBlockParseHeaders(headers, 599*81 + 40, 1000, now, btcMerkleBlockVerifyProofOfWork, // truncated
+                                   blocks);
+    if (n != 599) r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockParseHeaders() test 9\n", __func__);
+    for (i = 0; i < n; i++) btcMerkleBlockFree(blocks[i]);
 
     // TODO: XXX test btcMerkleBlockVerifyDifficulty()
-    
-    // TODO: test (CVE-2012-2459) vulnerability
+
+    for (i = 0; i < 300; i++) { // trees with odd rows at every level, from one tx to more than the walk keeps in nodes
+        BRBitcoinMerkleBlock *m = btcTestMerkleBlock(1 + (uint32_t)BRRand((i % 10 == 0) ? 3000 : 300),
+                                                     1 + (uint32_t)BRRand(i % 40 + 1));
+
+        if (! btcMerkleBlockIsValid(m, now) || ! btcTestMerkleWalksMatch(m))
+            r = 0, fprintf(stderr, "***FAILED*** %s: btcMerkleBlockIsValid() walk test %zu\n", __func__, i);
+
+        if (m->hashesCount > 1) { // duplicating the last hash mimics an odd row (CVE-2012-2459)
+            m->hashes[m->hashesCount - 1] = m->hashes[m->hashesCount - 2];
+
+            if (btcMerkleBlockIsValid(m, now) || ! btcTestMerkleWalksMatch(m))
+                r = 0, fprintf(stderr, "***FAILED*** %s: CVE-2012-2459 walk test %zu\n", __func__, i);
+        }
+
+        m->hashesCount = BRRand((uint32_t)m->hashesCount + 1); // truncated, with garbage flags
+        for (n = 0; n < m->flagsLen; n++) m->flags[n] = (uint8_t)BRRand(256);
+
+        if (! btcTestMerkleWalksMatch(m))
+            r = 0, fprintf(stderr, "***FAILED*** %s: garbage walk test %zu\n", __func__, i);
+
+        btcMerkleBlockFree(m);
+    }
 
     BRBitcoinMerkleBlock *c = btcMerkleBlockCopy(b);
 
@@ -3098,6 +3890,444 @@ int btcMerkleBlockTests()
     return r;
 }
 
+// reports headers per second parsed and checked one at a time, as headers messages used to be, and in a batch
+extern void runPerfTestsHeaders (int repeat)
+{
+    size_t i, count = 2000, len;
+    uint8_t *buf = malloc(count*81);
+    BRBitcoinMerkleBlock *block, **blocks = malloc(count*sizeof(*blocks));
+    uint32_t now = (uint32_t)time(NULL);
+    struct timeval t0, t1, t2;
+    int n;
+
+    len = btcTestHeadersStream(buf, count, now - (uint32_t)count*600);
+    gettimeofday(&t0, NULL);
+
+    for (n = 0; n < repeat; n++) {
+        for (i = 0; i < count; i++) {
+            block = btcMerkleBlockParse(&buf[i*81], len - i*81);
+            if (btcMerkleBlockIsValid(block, now)) btcMerkleBlockVerifyProofOfWork(block);
+            btcMerkleBlockFree(block);
+        }
+    }
+
+    gettimeofday(&t1, NULL);
+
+    for (n = 0; n < repeat; n++) {
+        count = btcMerkleBlockParseHeaders(buf, len, count, now, btcMerkleBlockVerifyProofOfWork, blocks);
+        for (i = 0; i < count; i++) btcMerkleBlockFree(blocks[i]);
+    }
+
+    gettimeofday(&t2, NULL);
+    printf("headers: %.0f/s one at a time, %.0f/s batched\n",
+           count*repeat/((t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0),
+           count*repeat/((t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)/1000000.0));
+    free(blocks);
+    free(buf);
+}
+
+// reports merkleblocks per second checked against their merkle root with the matched tx hashes extracted, for blocks of
+// 2500 tx with a few to a few dozen matches, using the recursive merkle tree walks and then the iterative one
+extern void runPerfTestsMerkle (int repeat)
+{
+    const uint32_t every[] = { 2500, 600, 150, 40 };
+    UInt256 root, txHashes[2500];
+    struct timeval t0, t1, t2;
+
+    for (size_t i = 0; i < sizeof(every)/sizeof(*every); i++) {
+        BRBitcoinMerkleBlock *block = btcTestMerkleBlock(2500, every[i]);
+        size_t len = btcMerkleBlockSerialize(block, NULL, 0), count;
+        uint8_t *msg = malloc(len);
+
+        btcMerkleBlockSerialize(block, msg, len); // check blocks parsed from merkleblock messages, as peers relay them
+        btcMerkleBlockFree(block);
+        block = btcMerkleBlockParse(msg, len);
+        count = btcMerkleBlockTxHashes(block, NULL, 0);
+        gettimeofday(&t0, NULL);
+        for (int n = 0; n < repeat; n++) _btcMerkleBlockWalkImpl(block, &root, txHashes, count, 1);
+        gettimeofday(&t1, NULL);
+        for (int n = 0; n < repeat; n++) _btcMerkleBlockWalkImpl(block, &root, txHashes, count, 0);
+        gettimeofday(&t2, NULL);
+        printf("merkleblocks, %zu of 2500 tx matched: %.0f/s recursive, %.0f/s iterative\n", count,
+               repeat/((t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0),
+               repeat/((t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)/1000000.0));
+        btcMerkleBlockFree(block);
+        free(msg);
+    }
+}
+
+// reports the time to decrypt one BIP38 key, and per key when decrypting count of them at once
+extern void runPerfTestsBIP38 (int count)
+{
+    const BRBitcoinChainParams *params = btcChainParams(true);
+    const char *bip38Keys[count];
+    BRKey key, keys[count];
+    struct timeval t0, t1, t2;
+
+    for (int i = 0; i < count; i++) bip38Keys[i] = "6PRVWUbkzzsbcVac2qwfssoUJAN1Xhrg6bNk8J7Nzm5H7kxEbn2Nh2ZoGg";
+    gettimeofday(&t0, NULL);
+    BRBIP38KeySetKey(&key, bip38Keys[0], "TestingOneTwoThree", params->addrParams);
+    gettimeofday(&t1, NULL);
+    BRBIP38KeySetKeys(keys, bip38Keys, count, "TestingOneTwoThree", params->addrParams, NULL);
+    gettimeofday(&t2, NULL);
+    printf("bip38: %.3fs single key, %.3fs per key in a batch of %d\n",
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0,
+           ((t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)/1000000.0)/count, count);
+}
+
+// cpu time stamp counter on x86, nanoseconds elsewhere
+static uint64_t _testCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+#endif
+}
+
+// reports chacha20 cycles per byte for each implementation the cpu supports, along with poly1305 and the aead
+extern void runPerfTestsChacha20 (int repeat)
+{
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    size_t len = 1 << 16;
+    uint8_t *buf = calloc(1, len + 16), key[32] = { 0 }, nonce[12] = { 0 }, mac[16];
+    uint64_t c0, c1;
+    int n;
+
+    for (int impl = 0; impl < 3; impl++) {
+        c0 = _testCycles();
+        for (n = 0; n < repeat; n++) {
+            if (_BRChacha20Impl(buf, key, &nonce[4], buf, len, 0, impl) != impl) break;
+        }
+        c1 = _testCycles();
+        if (n == repeat) printf("chacha20 %s: %.2f cycles/byte\n", names[impl], (double)(c1 - c0)/len/repeat);
+    }
+
+    c0 = _testCycles();
+    for (n = 0; n < repeat; n++) BRPoly1305(mac, key, buf, len);
+    c1 = _testCycles();
+    printf("poly1305: %.2f cycles/byte\n", (double)(c1 - c0)/len/repeat);
+
+    c0 = _testCycles();
+    for (n = 0; n < repeat; n++) BRChacha20Poly1305AEADEncrypt(buf, len + 16, key, nonce, buf, len, NULL, 0);
+    c1 = _testCycles();
+    printf("chacha20-poly1305: %.2f cycles/byte\n", (double)(c1 - c0)/len/repeat);
+    free(buf);
+}
+
+// reports base58check encode and decode rates for 21 byte address payloads, one at a time and batched, along with
+// double-sha-256 batch rates for each implementation the cpu supports
+extern void runPerfTestsBase58 (int repeat)
+{
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    size_t count = 1000, lens[1000];
+    uint8_t *data = calloc(count, 21), *mds = calloc(count, 32);
+    char (*strs)[36] = calloc(count, sizeof(*strs));
+    const char **ptrs = calloc(count, sizeof(*ptrs));
+    const void **msgs = calloc(count, sizeof(*msgs));
+    struct timeval t0, t1;
+    int n;
+
+    for (size_t i = 0; i < count*21; i++) data[i] = (uint8_t)(i*131 + 17);
+    for (size_t i = 0; i < count; i++) ptrs[i] = strs[i], msgs[i] = &data[i*21], lens[i] = 21;
+
+    gettimeofday(&t0, NULL);
+    for (n = 0; n < repeat; n++) {
+        for (size_t i = 0; i < count; i++) BRBase58CheckEncode(strs[i], sizeof(*strs), &data[i*21], 21);
+    }
+    gettimeofday(&t1, NULL);
+    printf("base58check encode: %.0f/s\n", count*repeat/((t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0));
+
+    gettimeofday(&t0, NULL);
+    for (n = 0; n < repeat; n++) BRBase58CheckEncodeBatch(strs[0], sizeof(*strs), data, 21, count);
+    gettimeofday(&t1, NULL);
+    printf("base58check encode batch: %.0f/s\n",
+           count*repeat/((t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0));
+
+    gettimeofday(&t0, NULL);
+    for (n = 0; n < repeat; n++) {
+        for (size_t i = 0; i < count; i++) BRBase58CheckDecode(&data[i*21], 21, strs[i]);
+    }
+    gettimeofday(&t1, NULL);
+    printf("base58check decode: %.0f/s\n", count*repeat/((t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0));
+
+    gettimeofday(&t0, NULL);
+    for (n = 0; n < repeat; n++) BRBase58CheckDecodeBatch(data, 21, lens, ptrs, count);
+    gettimeofday(&t1, NULL);
+    printf("base58check decode batch: %.0f/s\n",
+           count*repeat/((t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0));
+
+    for (int impl = 0; impl < 3; impl++) {
+        gettimeofday(&t0, NULL);
+        for (n = 0; n < repeat; n++) {
+            if (_BRSHA256_2BatchImpl(mds, msgs, lens, count, impl) != impl) break;
+        }
+        gettimeofday(&t1, NULL);
+        if (n == repeat) printf("double-sha-256 batch %s: %.0f/s\n", names[impl],
+                                count*repeat/((t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0));
+    }
+
+    free(msgs);
+    free(ptrs);
+    free(strs);
+    free(mds);
+    free(data);
+}
+
+// reports aes-ctr and aes-ecb throughput for each implementation the cpu supports
+extern void runPerfTestsAES (int repeat)
+{
+    static const char *names[] = { "constant time", "aes-ni", "vaes" };
+    size_t len = 1 << 20;
+    uint8_t *buf = calloc(1, len), key[32] = { 0 }, iv[16] = { 0 };
+    struct timeval t0, t1, t2;
+    BRAESKey k;
+    int n;
+
+    for (int impl = 0; impl < 3; impl++) {
+        if (_BRAESKeyInitImpl(&k, key, sizeof(key), impl) != impl) continue;
+        gettimeofday(&t0, NULL);
+        for (n = 0; n < repeat; n++) BRAESKeyCTR(&k, buf, iv, buf, len);
+        gettimeofday(&t1, NULL);
+        for (n = 0; n < repeat; n++) BRAESKeyECBDecrypt(&k, buf, buf, len/16);
+        gettimeofday(&t2, NULL);
+        printf("aes-256 %s: ctr %.3f GB/s, ecb decrypt %.3f GB/s\n", names[impl],
+               len*repeat/((t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec)/1000000.0)/1e9,
+               len*repeat/((t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec)/1000000.0)/1e9);
+        BRAESKeyClean(&k);
+    }
+
+    free(buf);
+}
+
+static BRBitcoinMerkleBlock *_btcTestHeaderStoreBlock(uint32_t height, uint32_t fork)
+{
+    BRBitcoinMerkleBlock *block = btcMerkleBlockNew();
+
+    block->version = 0x20000000;
+    UInt32SetLE(block->prevBlock.u8, height - 1);
+    UInt32SetLE(&block->prevBlock.u8[4], fork);
+    UInt32SetLE(block->merkleRoot.u8, height*7);
+    block->timestamp = 1500000000 + height*600;
+    block->target = 0x1d00ffff;
+    block->nonce = height ^ fork;
+    UInt32SetLE(block->blockHash.u8, height);
+    UInt32SetLE(&block->blockHash.u8[4], fork);
+    block->height = height;
+    return block;
+}
+
+static int _btcTestHeaderStoreBlockEq(const BRBitcoinMerkleBlock *b1, const BRBitcoinMerkleBlock *b2)
+{
+    return (b1 && b2 && UInt256Eq(b1->blockHash, b2->blockHash) && b1->version == b2->version &&
+            UInt256Eq(b1->prevBlock, b2->prevBlock) && UInt256Eq(b1->merkleRoot, b2->merkleRoot) &&
+            b1->timestamp == b2->timestamp && b1->target == b2->target && b1->nonce == b2->nonce &&
+            b1->height == b2->height);
+}
+
+int btcHeaderStoreTests()
+{
+    int r = 1;
+    const char *dir = getenv("TMPDIR");
+    char path[1024];
+    BRBitcoinMerkleBlock *blocks[20], *loaded[20], *b;
+    BRBitcoinHeaderStore *store;
+    size_t i, n;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/btcHeaderStoreTests-%d", (dir && *dir) ? dir : "/tmp", (int)getpid());
+    btcHeaderStoreWipe(path);
+    for (i = 0; i < 20; i++) blocks[i] = _btcTestHeaderStoreBlock(100 + (uint32_t)i, 0);
+
+    store = btcHeaderStoreOpen(path);
+    if (! store) return fprintf(stderr, "***FAILED*** %s: btcHeaderStoreOpen() test 1\n", __func__), 0;
+
+    if (btcHeaderStoreTipHeight(store) != BLOCK_UNKNOWN_HEIGHT || btcHeaderStoreLoad(store, 0, NULL, 0) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreOpen() test 2\n", __func__);
+
+    if (! btcHeaderStoreSaveBlocks(store, blocks, 10) || btcHeaderStoreTipHeight(store) != 109)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreSaveBlocks() test\n", __func__);
+
+    if (! btcHeaderStoreSaveBlocks(store, NULL, 0) || btcHeaderStoreTipHeight(store) != 109)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreSaveBlocks() empty test\n", __func__);
+
+    b = btcHeaderStoreGet(store, 105);
+    if (! _btcTestHeaderStoreBlockEq(b, blocks[5]) || btcHeaderStoreGet(store, 99) || btcHeaderStoreGet(store, 110))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreGet() test\n", __func__);
+    if (b) btcMerkleBlockFree(b);
+
+    // reopen, with a partially written record at the end of the file
+    btcHeaderStoreClose(store);
+    f = fopen(path, "ab");
+    if (f) fwrite("partial", 1, 7, f), fclose(f);
+    store = btcHeaderStoreOpen(path);
+    if (! store) return fprintf(stderr, "***FAILED*** %s: btcHeaderStoreOpen() test 3\n", __func__), 0;
+
+    n = btcHeaderStoreLoad(store, 0, loaded, 20);
+    if (n != 10 || btcHeaderStoreLoad(store, 0, NULL, 0) != 10 || btcHeaderStoreLoad(store, 108, NULL, 0) != 2)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreLoad() test 1\n", __func__);
+
+    for (i = 0; i < n; i++) {
+        if (! _btcTestHeaderStoreBlockEq(loaded[i], blocks[i]))
+            r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreLoad() test 2\n", __func__);
+        btcMerkleBlockFree(loaded[i]);
+    }
+
+    // a different block at a held height drops everything above it
+    b = _btcTestHeaderStoreBlock(105, 1);
+    if (! btcHeaderStoreSave(store, b) || btcHeaderStoreTipHeight(store) != 105 || btcHeaderStoreGet(store, 106))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreSave() test 1\n", __func__);
+    btcMerkleBlockFree(b);
+
+    // replacing from the same first height only rewrites what changed
+    if (! btcHeaderStoreReplace(store, blocks, 13) || btcHeaderStoreTipHeight(store) != 112 ||
+        btcHeaderStoreLoad(store, 0, NULL, 0) != 13)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreReplace() test 1\n", __func__);
+
+    b = btcHeaderStoreGet(store, 105);
+    if (! _btcTestHeaderStoreBlockEq(b, blocks[5]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreReplace() test 2\n", __func__);
+    if (b) btcMerkleBlockFree(b);
+
+    // a block below the first one moves the existing records
+    b = _btcTestHeaderStoreBlock(50, 0);
+    if (! btcHeaderStoreSave(store, b) || btcHeaderStoreLoad(store, 0, NULL, 0) != 14 ||
+        btcHeaderStoreLoad(store, 51, NULL, 0) != 13)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreSave() test 2\n", __func__);
+    btcMerkleBlockFree(b);
+
+    b = btcHeaderStoreGet(store, 112);
+    if (! _btcTestHeaderStoreBlockEq(b, blocks[12]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreSave() test 3\n", __func__);
+    if (b) btcMerkleBlockFree(b);
+
+    // replacing from a different first height drops everything else
+    if (! btcHeaderStoreReplace(store, &blocks[10], 10) || btcHeaderStoreLoad(store, 0, NULL, 0) != 10 ||
+        btcHeaderStoreGet(store, 50) || btcHeaderStoreGet(store, 109) || btcHeaderStoreTipHeight(store) != 119)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreReplace() test 3\n", __func__);
+
+    if (! btcHeaderStoreTruncate(store, 115) || btcHeaderStoreTipHeight(store) != 114 ||
+        btcHeaderStoreLoad(store, 0, NULL, 0) != 5)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreTruncate() test\n", __func__);
+
+    if (! btcHeaderStoreReplace(store, NULL, 0) || btcHeaderStoreLoad(store, 0, NULL, 0) != 0 ||
+        btcHeaderStoreTipHeight(store) != BLOCK_UNKNOWN_HEIGHT)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreReplace() empty test\n", __func__);
+
+    btcHeaderStoreClose(store);
+    for (i = 0; i < 20; i++) btcMerkleBlockFree(blocks[i]);
+
+    if (btcHeaderStoreWipe(path) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcHeaderStoreWipe() test\n", __func__);
+
+    return r;
+}
+
+static size_t _windowRequestCount = 0, _windowRequestHashCount = 0;
+static BRBitcoinPeer *_windowRequestPeer = NULL;
+static UInt256 _windowRequestHash;
+
+static void _testWindowRequest(void *info, BRBitcoinPeer *peer, const UInt256 blockHashes[], size_t count)
+{
+    _windowRequestCount++;
+    _windowRequestPeer = peer;
+    _windowRequestHash = blockHashes[0];
+    _windowRequestHashCount = count;
+}
+
+int btcBlockWindowsTests()
+{
+    int r = 1;
+    BRBitcoinBlockWindows windows;
+    BRBitcoinPeer *a = btcPeerNew(0), *b = btcPeerNew(0), *c = btcPeerNew(0), *peers[3], *stalled[3];
+    UInt256 hashes[250];
+    size_t i;
+
+    for (i = 0; i < 250; i++) hashes[i] = UINT256_ZERO, hashes[i].u32[0] = (uint32_t)i + 1;
+    btcBlockWindowsInit(&windows);
+    btcBlockWindowsQueue(&windows, hashes, 250);
+
+    // queued hashes are handed out in order to each peer without a window
+    peers[0] = a, peers[1] = b;
+
+    if (btcBlockWindowsAssign(&windows, peers, 2, 0.0, NULL, _testWindowRequest) != 2 || _windowRequestCount != 2 ||
+        _windowRequestPeer != b || _windowRequestHashCount != BLOCK_WINDOW_SIZE ||
+        ! UInt256Eq(_windowRequestHash, hashes[100]) || array_count(windows.queue) != 50)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsAssign() test\n", __func__);
+
+    if (btcBlockWindowsAssign(&windows, peers, 2, 0.0, NULL, _testWindowRequest) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsAssign() busy peers test\n", __func__);
+
+    // a completed window is removed and sets its peer's download rate
+    for (i = 0; i < 100; i++) btcBlockWindowsBlockReceived(&windows, a, hashes[i], 10.0);
+
+    if (array_count(windows.windows) != 1 || btcBlockWindowsPeerRate(&windows, a) != 10.0 ||
+        btcBlockWindowsBlockReceived(&windows, a, hashes[0], 10.0))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsBlockReceived() test\n", __func__);
+
+    peers[0] = b, peers[1] = a;
+    btcBlockWindowsSortPeers(&windows, peers, 2);
+
+    if (peers[0] != a || peers[1] != b)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsSortPeers() test\n", __func__);
+
+    if (btcBlockWindowsAssign(&windows, peers, 2, 10.0, NULL, _testWindowRequest) != 1 || _windowRequestPeer != a ||
+        _windowRequestHashCount != 50 || array_count(windows.queue) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsAssign() partial window test\n", __func__);
+
+    // once the queue is empty, an idle peer takes the second half of the largest window
+    for (i = 100; i < 110; i++) btcBlockWindowsBlockReceived(&windows, b, hashes[i], 11.0);
+    peers[0] = c;
+
+    if (btcBlockWindowsAssign(&windows, peers, 1, 11.0, NULL, _testWindowRequest) != 1 || _windowRequestPeer != c ||
+        _windowRequestHashCount != 45 || ! UInt256Eq(_windowRequestHash, hashes[155]) ||
+        windows.windows[0].peer != b || windows.windows[0].count != 55 || windows.windows[0].received != 10)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsAssign() take half test\n", __func__);
+
+    if (! btcBlockWindowsBlockReceived(&windows, c, hashes[199], 11.0) ||
+        btcBlockWindowsBlockReceived(&windows, c, hashes[199], 11.0))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsAssign() take half duplicate test\n", __func__);
+
+    // the original peer's copy of a taken block is dropped from the window without counting as received
+    if (! btcBlockWindowsBlockReceived(&windows, b, hashes[198], 11.0) || windows.windows[2].peer != c ||
+        windows.windows[2].count != 44 || windows.windows[2].received != 1 || windows.windows[0].received != 10)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsBlockReceived() taken block test\n", __func__);
+
+    // windows of stalled and missing peers are requeued in order
+    btcBlockWindowsBlockReceived(&windows, a, hashes[200], 20.0);
+    peers[0] = a, peers[1] = b;
+
+    if (btcBlockWindowsRequeueStalled(&windows, peers, 2, 10.0 + 1.5 + BLOCK_WINDOW_TIMEOUT, stalled, 3) != 2 ||
+        stalled[0] != c || stalled[1] != b || array_count(windows.windows) != 1 || array_count(windows.queue) != 88 ||
+        ! UInt256Eq(windows.queue[0], hashes[110]) || ! UInt256Eq(windows.queue[87], hashes[197]) ||
+        btcBlockWindowsPeerRate(&windows, a) != 10.0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsRequeueStalled() test\n", __func__);
+
+    // a removed peer's unreceived blocks go back to the front of the queue and its rate is forgotten
+    if (btcBlockWindowsRemovePeer(&windows, a) != 1 || array_count(windows.windows) != 0 ||
+        array_count(windows.queue) != 137 || ! UInt256Eq(windows.queue[0], hashes[201]) ||
+        ! UInt256Eq(windows.queue[49], hashes[110]) || btcBlockWindowsPeerRate(&windows, a) != 0.0 ||
+        btcBlockWindowsRemovePeer(&windows, a) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsRemovePeer() test\n", __func__);
+
+    if (! btcBlockWindowsActive(&windows))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsActive() test\n", __func__);
+
+    btcBlockWindowsClear(&windows);
+
+    if (btcBlockWindowsActive(&windows))
+        r = 0, fprintf(stderr, "***FAILED*** %s: btcBlockWindowsClear() test\n", __func__);
+
+    btcBlockWindowsFree(&windows);
+    btcPeerFree(a);
+    btcPeerFree(b);
+    btcPeerFree(c);
+    return r;
+}
+
 int btcPaymentProtocolTests()
 {
     int r = 1;
@@ -3534,7 +4764,33 @@ int btcPaymentProtocolEncryptionTests()
     return r;
 }
 
-void btcPeerAcceptMessageTest(BRBitcoinPeer *peer, const uint8_t *msg, size_t len, const char *type);
+static size_t _hasTxCount = 0;
+
+static void _testHasTx(void *info, UInt256 txHash)
+{
+    _hasTxCount++;
+}
+
+// accepts an inv message for tx hashes first through first + count - 1, and returns how many the peer already knew
+static size_t _testInvTxHashes(BRBitcoinPeer *p, uint32_t first, size_t count)
+{
+    size_t off = 0, hasTxCount = _hasTxCount;
+    uint8_t *msg = malloc(BRVarIntSize(count) + 36*count);
+    UInt256 hash = UINT256_ZERO;
+
+    off += BRVarIntSet(msg, BRVarIntSize(count), count);
+
+    for (uint32_t i = first; i < first + count; i++) {
+        hash.u32[0] = i;
+        UInt32SetLE(&msg[off], 1); // inv_tx
+        UInt256Set(&msg[off + sizeof(uint32_t)], hash);
+        off += 36;
+    }
+
+    btcPeerAcceptMessageTest(p, msg, off, "inv");
+    free(msg);
+    return _hasTxCount - hasTxCount;
+}
 
 int btcPeerTests()
 {
@@ -3544,8 +4800,395 @@ int btcPeerTests()
 
     BRBitcoinPeer *p = btcPeerNew(btcMainNetParams->magicNumber);
     const char msg[] = "my message";
+    UInt256 hashes[10] = { UINT256_ZERO };
     
     btcPeerAcceptMessageTest(p, (const uint8_t *)msg, sizeof(msg) - 1, "inv");
+
+    // known tx hashes
+    btcPeerSetCallbacks(p, NULL, NULL, NULL, NULL, NULL, _testHasTx, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+    for (uint32_t i = 0; i < 10; i++) hashes[i].u32[0] = i;
+    btcPeerSendMempool(p, hashes, 10, NULL, NULL);
+
+    if (_testInvTxHashes(p, 0, 20) != 10)
+        r = 0, fprintf(stderr, "***FAILED*** %s: known tx hashes test\n", __func__);
+
+    if (_testInvTxHashes(p, 0, 20) != 20)
+        r = 0, fprintf(stderr, "***FAILED*** %s: known tx hashes inv test\n", __func__);
+
+    // the oldest hashes roll off once 50000 newer ones are known, but the newest are all kept
+    for (uint32_t i = 20; i < 60020; i += 10000) _testInvTxHashes(p, i, 10000);
+
+    if (_testInvTxHashes(p, 0, 10) != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: known tx hashes rolling test\n", __func__);
+
+    if (_testInvTxHashes(p, 10030, 10000) != 10000)
+        r = 0, fprintf(stderr, "***FAILED*** %s: known tx hashes rolling test 2\n", __func__);
+
+    btcPeerFree(p);
+    return r;
+}
+
+void btcPeerManagerTrimBlocksTest(BRBitcoinPeerManager *manager);
+const BRBitcoinMerkleBlock *btcPeerManagerPrevBlockTest(BRBitcoinPeerManager *manager,
+                                                        const BRBitcoinMerkleBlock *block);
+const BRBitcoinMerkleBlock *btcPeerManagerLookupBlockTest(BRBitcoinPeerManager *manager, uint32_t blockNumber);
+size_t btcPeerManagerBlockLocatorsTest(BRBitcoinPeerManager *manager, UInt256 locators[], size_t locatorsCount);
+
+#define TEST_CHAIN_HEIGHT 3000
+
+static BRBitcoinMerkleBlock *_testSavedBlocks[TEST_CHAIN_HEIGHT];
+static size_t _testSavedCount = 0, _testLoadedCount = 0;
+
+static void _testSaveBlocks(void *info, int replace, BRBitcoinMerkleBlock *blocks[], size_t blocksCount)
+{
+    for (size_t i = 0; i < blocksCount; i++) {
+        if (_testSavedBlocks[blocks[i]->height]) btcMerkleBlockFree(_testSavedBlocks[blocks[i]->height]);
+        _testSavedBlocks[blocks[i]->height] = btcMerkleBlockCopy(blocks[i]);
+    }
+
+    _testSavedCount += blocksCount;
+}
+
+static BRBitcoinMerkleBlock *_testLoadBlock(void *info, uint32_t height)
+{
+    _testLoadedCount++;
+    if (height >= TEST_CHAIN_HEIGHT || ! _testSavedBlocks[height]) return NULL;
+    return btcMerkleBlockCopy(_testSavedBlocks[height]);
+}
+
+int btcPeerManagerTests()
+{
+    int r = 1;
+    const BRBitcoinChainParams *params = btcChainParams(false); // no difficulty checks
+    uint8_t *headers = malloc(TEST_CHAIN_HEIGHT*81);
+    BRBitcoinMerkleBlock *blocks[TEST_CHAIN_HEIGHT], *window[TEST_CHAIN_HEIGHT];
+    const BRBitcoinMerkleBlock *b;
+    UInt256 hashes[TEST_CHAIN_HEIGHT], locators[64];
+    uint32_t now = (uint32_t)time(NULL), i;
+    size_t n, count, len = btcTestHeadersStream(headers, TEST_CHAIN_HEIGHT, now - TEST_CHAIN_HEIGHT*600);
+    UInt512 seed = UINT512_ZERO;
+    BRBitcoinWallet *w = btcWalletNew(params->addrParams, NULL, 0, BRBIP32MasterPubKey(&seed, sizeof(seed)));
+    BRBitcoinPeerManager *manager;
+
+    n = btcMerkleBlockParseHeaders(headers, len, TEST_CHAIN_HEIGHT, now, NULL, blocks);
+    if (n != TEST_CHAIN_HEIGHT) r = 0, fprintf(stderr, "***FAILED*** %s: resident blocks setup\n", __func__);
+
+    for (i = 0; i < n; i++) { // the whole chain is already saved, as in a header store
+        blocks[i]->height = i;
+        hashes[i] = blocks[i]->blockHash;
+        window[i] = btcMerkleBlockCopy(blocks[i]);
+        _testSavedBlocks[i] = btcMerkleBlockCopy(blocks[i]);
+    }
+
+    manager = btcPeerManagerNew(params, w, now, blocks, n, NULL, 0);
+    btcPeerManagerSetCallbacks(manager, NULL, NULL, NULL, NULL, _testSaveBlocks, NULL, NULL, NULL);
+    btcPeerManagerSetResidentBlocks(manager, 200, _testLoadBlock);
+
+    // trim, keeping the most recent 200 blocks and the transitions at 0 and 2016
+    btcPeerManagerTrimBlocksTest(manager);
+
+    if (_testSavedCount != TEST_CHAIN_HEIGHT - 202 || btcPeerManagerLastBlockHeight(manager) != 2999)
+        r = 0, fprintf(stderr, "***FAILED*** %s: trim blocks test\n", __func__);
+
+    // locators step back through the trimmed blocks by height, without paging them in
+    _testLoadedCount = 0;
+    count = btcPeerManagerBlockLocatorsTest(manager, locators, 64);
+
+    for (n = 0, i = 0, len = 1; n < count && i < TEST_CHAIN_HEIGHT; n++) {
+        if (! UInt256Eq(locators[n], hashes[TEST_CHAIN_HEIGHT - 1 - i])) break;
+        if (n + 1 >= 10) len *= 2;
+        i += len;
+    }
+
+    if (i < TEST_CHAIN_HEIGHT || _testLoadedCount == 0) // followed by checkpoints older than the last one
+        r = 0, fprintf(stderr, "***FAILED*** %s: block locators test\n", __func__);
+
+    // page a trimmed block back in, once
+    _testLoadedCount = 0;
+    b = btcPeerManagerPrevBlockTest(manager, _testSavedBlocks[2500]);
+    if (! b || ! UInt256Eq(b->blockHash, hashes[2499]) || _testLoadedCount != 1)
+        r = 0, fprintf(stderr, "***FAILED*** %s: page in block test\n", __func__);
+
+    b = btcPeerManagerPrevBlockTest(manager, _testSavedBlocks[2500]);
+    if (! b || ! UInt256Eq(b->blockHash, hashes[2499]) || _testLoadedCount != 1)
+        r = 0, fprintf(stderr, "***FAILED*** %s: page in block test 2\n", __func__);
+
+    // a block from some other chain saved at that height isn't linked in
+    _testSavedBlocks[1499]->nonce++;
+    _testSavedBlocks[1499]->blockHash.u8[0] ^= 1;
+    if (btcPeerManagerPrevBlockTest(manager, _testSavedBlocks[1500]) || _testLoadedCount != 2)
+        r = 0, fprintf(stderr, "***FAILED*** %s: other chain block test\n", __func__);
+    if (btcPeerManagerLookupBlockTest(manager, 1000))
+        r = 0, fprintf(stderr, "***FAILED*** %s: other chain block test 2\n", __func__);
+    _testSavedBlocks[1499]->nonce--;
+    _testSavedBlocks[1499]->blockHash.u8[0] ^= 1;
+
+    // rescan from a block number in the trimmed range
+    b = btcPeerManagerLookupBlockTest(manager, 1000);
+    if (! b || ! UInt256Eq(b->blockHash, hashes[1000]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: rescan from block number test\n", __func__);
+
+    // blocks paged in are trimmed again
+    _testSavedCount = _testLoadedCount = 0;
+    btcPeerManagerTrimBlocksTest(manager);
+    b = btcPeerManagerPrevBlockTest(manager, _testSavedBlocks[1001]);
+    if (_testSavedCount != 1799 || ! b || ! UInt256Eq(b->blockHash, hashes[1000]) || _testLoadedCount != 1)
+        r = 0, fprintf(stderr, "***FAILED*** %s: trim paged blocks test\n", __func__);
+
+    btcPeerManagerFree(manager);
+
+    // a manager started from only the recent blocks and the older transitions, as loaded from a header store
+    for (i = 0, n = 0; i < TEST_CHAIN_HEIGHT; i++) {
+        if (i >= 2800 || (i % BLOCK_DIFFICULTY_INTERVAL) == 0) window[n++] = window[i];
+        else btcMerkleBlockFree(window[i]);
+    }
+
+    manager = btcPeerManagerNew(params, w, now, window, n, NULL, 0);
+    btcPeerManagerSetResidentBlocks(manager, 200, _testLoadBlock);
+    _testLoadedCount = 0;
+    b = btcPeerManagerPrevBlockTest(manager, _testSavedBlocks[2017]);
+
+    if (btcPeerManagerLastBlockHeight(manager) != 2999 || ! b || ! UInt256Eq(b->blockHash, hashes[2016]) ||
+        _testLoadedCount != 0)
+        r = 0, fprintf(stderr, "***FAILED*** %s: resident blocks load test\n", __func__);
+
+    b = btcPeerManagerPrevBlockTest(manager, window[2]); // the first of the recent blocks
+    if (! b || ! UInt256Eq(b->blockHash, hashes[2799]) || _testLoadedCount != 1)
+        r = 0, fprintf(stderr, "***FAILED*** %s: resident blocks load test 2\n", __func__);
+
+    btcPeerManagerFree(manager);
+    btcWalletFree(w);
+    for (i = 0; i < TEST_CHAIN_HEIGHT; i++) if (_testSavedBlocks[i]) btcMerkleBlockFree(_testSavedBlocks[i]);
+    memset(_testSavedBlocks, 0, sizeof(_testSavedBlocks));
+    free(headers);
+    return r;
+}
+
+BRBitcoinPeer *btcPeerManagerAddPeerTest(BRBitcoinPeerManager *manager, const BRBitcoinPeer *peer);
+void btcPeerConnectedTest(BRBitcoinPeer *peer, uint32_t version, uint32_t lastblock);
+void btcPeerThreadCleanupTest(BRBitcoinPeer *peer);
+
+#define TEST_FILTER_BASE   20 // blocks the peer manager starts with, the rest are relayed as headers and scanned
+#define TEST_FILTER_HEIGHT 30
+
+// a signed looking tx paying addr, serialized to buf, returns its length
+static size_t _testFilterTx(uint8_t *buf, size_t bufLen, const char *addr, UInt256 *txHash)
+{
+    BRBitcoinTransaction *tx = btcTransactionNew();
+    uint8_t script[64], sig[] = { OP_1 };
+    size_t len = BRAddressScriptPubKey(script, sizeof(script), btcChainParams(false)->addrParams, addr);
+
+    btcTransactionAddInput(tx, UINT256_ZERO, 0, 0, NULL, 0, sig, sizeof(sig), NULL, 0, TXIN_SEQUENCE);
+    btcTransactionAddOutput(tx, 100000, script, len);
+    len = btcTransactionSerialize(tx, buf, bufLen);
+    btcTransactionFree(tx);
+    tx = btcTransactionParse(buf, len);
+    *txHash = tx->txHash;
+    btcTransactionFree(tx);
+    return len;
+}
+
+// feeds a cfheaders message for the scanned blocks to peer, with the filter hash at index bad changed if < count
+static void _testFilterHeaders(BRBitcoinPeer *peer, const UInt256 blockHashes[], const UInt256 filterHashes[],
+                               size_t count, size_t bad)
+{
+    uint8_t msg[1 + sizeof(UInt256)*2 + 1 + sizeof(UInt256)*count];
+    size_t off = 0;
+
+    msg[off++] = BLOCK_FILTER_TYPE_BASIC;
+    UInt256Set(&msg[off], blockHashes[TEST_FILTER_HEIGHT - 1]);
+    off += sizeof(UInt256);
+    UInt256Set(&msg[off], UINT256_ZERO);
+    off += sizeof(UInt256);
+    msg[off++] = (uint8_t)count;
+
+    for (size_t i = 0; i < count; i++, off += sizeof(UInt256)) {
+        UInt256Set(&msg[off], filterHashes[i]);
+        if (i == bad) msg[off] ^= 1;
+    }
+
+    btcPeerAcceptMessageTest(peer, msg, off, MSG_CFHEADERS);
+}
+
+// feeds cfilter messages for the scanned blocks to peer
+static void _testFilters(BRBitcoinPeer *peer, const UInt256 blockHashes[], BRBitcoinBlockFilter *filters[])
+{
+    for (size_t i = TEST_FILTER_BASE; i < TEST_FILTER_HEIGHT; i++) {
+        size_t len = btcBlockFilterSerialize(filters[i - TEST_FILTER_BASE], NULL, 0);
+        uint8_t msg[1 + sizeof(UInt256) + 1 + len];
+
+        msg[0] = BLOCK_FILTER_TYPE_BASIC;
+        UInt256Set(&msg[1], blockHashes[i]);
+        msg[1 + sizeof(UInt256)] = (uint8_t)len;
+        btcBlockFilterSerialize(filters[i - TEST_FILTER_BASE], &msg[1 + sizeof(UInt256) + 1], len);
+        btcPeerAcceptMessageTest(peer, msg, sizeof(msg), MSG_CFILTER);
+    }
+}
+
+// feeds a block message with the given header and a single tx to peer
+static void _testFullBlock(BRBitcoinPeer *peer, const uint8_t *header, const uint8_t *tx, size_t txLen)
+{
+    uint8_t msg[80 + 1 + txLen];
+
+    memcpy(msg, header, 80);
+    msg[80] = 1;
+    memcpy(&msg[81], tx, txLen);
+    btcPeerAcceptMessageTest(peer, msg, sizeof(msg), MSG_BLOCK);
+}
+
+// a peer manager syncing with compact filters from two stand-in peers, the first of which is the download peer
+static BRBitcoinPeerManager *_testFilterSyncStart(BRBitcoinWallet *w, const uint8_t *headers, uint32_t now,
+                                                  BRBitcoinPeer *peers[], size_t peersCount)
+{
+    const BRBitcoinChainParams *params = btcChainParams(false); // no difficulty checks
+    BRBitcoinMerkleBlock *blocks[TEST_FILTER_BASE];
+    BRBitcoinPeer peer = { UINT128_ZERO, 18333, SERVICES_NODE_NETWORK | SERVICES_NODE_BLOOM | SERVICES_NODE_WITNESS |
+                           SERVICES_NODE_COMPACT_FILTERS, now, 0 };
+    BRBitcoinPeerManager *manager;
+    uint8_t msg[1 + (TEST_FILTER_HEIGHT - TEST_FILTER_BASE)*81];
+    size_t i, n = btcMerkleBlockParseHeaders(headers, TEST_FILTER_BASE*81, TEST_FILTER_BASE, now, NULL, blocks);
+
+    for (i = 0; i < n; i++) blocks[i]->height = (uint32_t)i;
+    manager = btcPeerManagerNew(params, w, now - 2*24*60*60, blocks, n, NULL, 0);
+    btcPeerManagerSetCompactFilterSync(manager, 1);
+
+    for (i = 0; i < peersCount; i++) {
+        peer.address = ((UInt128) { .u8 = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 127, 0, 0, (uint8_t)(i + 1) } });
+        peers[i] = btcPeerManagerAddPeerTest(manager, &peer);
+        btcPeerConnectedTest(peers[i], 70015, TEST_FILTER_HEIGHT - 1);
+    }
+
+    // the rest of the chain, as headers
+    msg[0] = TEST_FILTER_HEIGHT - TEST_FILTER_BASE;
+    memcpy(&msg[1], &headers[TEST_FILTER_BASE*81], sizeof(msg) - 1);
+    btcPeerAcceptMessageTest(peers[0], msg, sizeof(msg), MSG_HEADERS);
+    return manager;
+}
+
+static void _testFilterSyncDone(BRBitcoinPeerManager *manager, BRBitcoinPeer *peers[], size_t peersCount)
+{
+    for (size_t i = 0; i < peersCount; i++) btcPeerThreadCleanupTest(peers[i]);
+    btcPeerManagerFree(manager);
+}
+
+int btcPeerManagerFilterSyncTests()
+{
+    int r = 1;
+    uint8_t headers[TEST_FILTER_HEIGHT*81], tx[2][128];
+    uint32_t now = (uint32_t)time(NULL);
+    size_t i, txLen[2];
+    UInt512 seed = UINT512_ZERO;
+    BRMasterPubKey mpk = BRBIP32MasterPubKey(&seed, sizeof(seed));
+    BRBitcoinWallet *w = btcWalletNew(btcChainParams(false)->addrParams, NULL, 0, mpk);
+    BRAddress addrs[SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + 1];
+    UInt256 txHash[2], blockHashes[TEST_FILTER_HEIGHT], filterHashes[TEST_FILTER_HEIGHT - TEST_FILTER_BASE];
+    BRBitcoinBlockFilter *filters[TEST_FILTER_HEIGHT - TEST_FILTER_BASE];
+    BRBitcoinPeer *peers[2];
+    BRBitcoinPeerManager *manager;
+    const BRBitcoinTransaction *t;
+
+    // tx A in block 22 pays the last address the wallet starts with, tx B in block 26 pays the next one, which the
+    // wallet only generates once it sees tx A, so block 26 is matched on the rematch that follows block 22
+    btcWalletUnusedAddrs(w, addrs, SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + 1, SEQUENCE_EXTERNAL_CHAIN);
+    btcWalletFree(w);
+    txLen[0] = _testFilterTx(tx[0], sizeof(tx[0]), addrs[SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED - 1].s, &txHash[0]);
+    txLen[1] = _testFilterTx(tx[1], sizeof(tx[1]), addrs[SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED].s, &txHash[1]);
+    btcTestHeadersStream(headers, TEST_FILTER_HEIGHT, now - TEST_FILTER_HEIGHT*600);
+    UInt256Set(&headers[22*81 + 36], txHash[0]);
+    UInt256Set(&headers[26*81 + 36], txHash[1]);
+
+    for (i = 0; i < TEST_FILTER_HEIGHT; i++) { // relink and re-mine the chain past the changed merkle roots
+        if (i > 0) UInt256Set(&headers[i*81 + 4], blockHashes[i - 1]);
+
+        for (uint32_t nonce = 0;; nonce++) {
+            UInt32SetLE(&headers[i*81 + 76], nonce);
+            BRSHA256_2(&blockHashes[i], &headers[i*81], 80);
+            if (blockHashes[i].u8[31] < 0x7f) break;
+        }
+    }
+
+    for (i = TEST_FILTER_BASE; i < TEST_FILTER_HEIGHT; i++) {
+        uint8_t script[64];
+        const uint8_t *items[] = { script };
+        size_t lens[] = { 0 };
+        const char *addr = (i == 22) ? addrs[SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED - 1].s :
+                           (i == 26) ? addrs[SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED].s : NULL;
+
+        if (addr) lens[0] = BRAddressScriptPubKey(script, sizeof(script), btcChainParams(false)->addrParams, addr);
+        filters[i - TEST_FILTER_BASE] = btcBlockFilterNew(blockHashes[i], items, lens, (addr) ? 1 : 0);
+        filterHashes[i - TEST_FILTER_BASE] = btcBlockFilterHash(filters[i - TEST_FILTER_BASE]);
+    }
+
+    // headers, then cfheaders from both peers, then cfilters, matched blocks in full, and the rematch
+    w = btcWalletNew(btcChainParams(false)->addrParams, NULL, 0, mpk);
+    manager = _testFilterSyncStart(w, headers, now, peers, 2);
+
+    if (btcPeerManagerLastBlockHeight(manager) != TEST_FILTER_HEIGHT - 1)
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync headers test\n", __func__);
+
+    _testFilterHeaders(peers[0], blockHashes, filterHashes, TEST_FILTER_HEIGHT - TEST_FILTER_BASE, SIZE_MAX);
+    _testFilters(peers[0], blockHashes, filters); // filters aren't accepted until the second peer agrees
+    _testFilterHeaders(peers[1], blockHashes, filterHashes, TEST_FILTER_HEIGHT - TEST_FILTER_BASE, SIZE_MAX);
+    _testFullBlock(peers[0], &headers[22*81], tx[0], txLen[0]);
+
+    if (btcWalletTransactionForHash(w, txHash[0]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync cross-check test\n", __func__);
+
+    _testFilters(peers[0], blockHashes, filters);
+    _testFullBlock(peers[0], &headers[26*81], tx[1], txLen[1]); // not matched yet
+
+    if (btcWalletTransactionForHash(w, txHash[1]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync unmatched block test\n", __func__);
+
+    _testFullBlock(peers[0], &headers[22*81], tx[0], txLen[0]);
+    t = btcWalletTransactionForHash(w, txHash[0]);
+
+    if (! t || t->blockHeight != 22)
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync matched block test\n", __func__);
+
+    _testFullBlock(peers[0], &headers[26*81], tx[1], txLen[1]); // matched once tx A used up an address
+    t = btcWalletTransactionForHash(w, txHash[1]);
+
+    if (! t || t->blockHeight != 26 || btcWalletBalance(w) != 200000)
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync rematch test\n", __func__);
+
+    if (btcPeerManagerSyncProgress(manager, 0) != 1.0 || btcPeerManagerLastBlockHeight(manager) != 29)
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync done test\n", __func__);
+
+    _testFilterSyncDone(manager, peers, 2);
+    btcWalletFree(w);
+
+    // the second peer's filter headers don't match, so the scan rewinds to finish with a bloom filter
+    w = btcWalletNew(btcChainParams(false)->addrParams, NULL, 0, mpk);
+    manager = _testFilterSyncStart(w, headers, now, peers, 2);
+    _testFilterHeaders(peers[0], blockHashes, filterHashes, TEST_FILTER_HEIGHT - TEST_FILTER_BASE, SIZE_MAX);
+    _testFilterHeaders(peers[1], blockHashes, filterHashes, TEST_FILTER_HEIGHT - TEST_FILTER_BASE, 3);
+
+    if (btcPeerManagerLastBlockHeight(manager) != TEST_FILTER_BASE - 1)
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync bad filter header rewind test\n", __func__);
+
+    _testFilters(peers[0], blockHashes, filters);
+    _testFullBlock(peers[0], &headers[22*81], tx[0], txLen[0]);
+
+    if (btcWalletTransactionForHash(w, txHash[0]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync bad filter header rewind test 2\n", __func__);
+
+    _testFilterSyncDone(manager, peers, 2);
+    btcWalletFree(w);
+
+    // with no other peer serving compact filters, the download peer's filter headers are trusted
+    w = btcWalletNew(btcChainParams(false)->addrParams, NULL, 0, mpk);
+    manager = _testFilterSyncStart(w, headers, now, peers, 1);
+    _testFilterHeaders(peers[0], blockHashes, filterHashes, TEST_FILTER_HEIGHT - TEST_FILTER_BASE, SIZE_MAX);
+    _testFilters(peers[0], blockHashes, filters);
+    _testFullBlock(peers[0], &headers[22*81], tx[0], txLen[0]);
+
+    if (! btcWalletTransactionForHash(w, txHash[0]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: filter sync single peer test\n", __func__);
+
+    _testFilterSyncDone(manager, peers, 1);
+    btcWalletFree(w);
+    for (i = 0; i < TEST_FILTER_HEIGHT - TEST_FILTER_BASE; i++) btcBlockFilterFree(filters[i]);
     return r;
 }
 
@@ -3581,6 +5224,8 @@ int BRRunTests()
     printf("%s\n", (BRAuthEncryptTests()) ? "success" : (fail++, "***FAIL***"));
     printf("BRAesTests...                       ");
     printf("%s\n", (BRAesTests()) ? "success" : (fail++, "***FAIL***"));
+    printf("BRScryptTests...                    ");
+    printf("%s\n", (BRScryptTests()) ? "success" : (fail++, "***FAIL***"));
     printf("BRKeyTests...                       ");
     printf("%s\n", (BRKeyTests()) ? "success" : (fail++, "***FAIL***"));
     printf("BRBIP38KeyTests...                  ");
@@ -3603,12 +5248,24 @@ int BRRunTests()
     printf("%s\n", (btcWalletTests()) ? "success" : (fail++, "***FAIL***"));
     printf("btcBloomFilterTests...              ");
     printf("%s\n", (btcBloomFilterTests()) ? "success" : (fail++, "***FAIL***"));
+    printf("btcBlockFilterTests...              ");
+    printf("%s\n", (btcBlockFilterTests()) ? "success" : (fail++, "***FAIL***"));
     printf("btcMerkleBlockTests...              ");
     printf("%s\n", (btcMerkleBlockTests()) ? "success" : (fail++, "***FAIL***"));
+    printf("btcHeaderStoreTests...              ");
+    printf("%s\n", (btcHeaderStoreTests()) ? "success" : (fail++, "***FAIL***"));
+    printf("btcBlockWindowsTests...             ");
+    printf("%s\n", (btcBlockWindowsTests()) ? "success" : (fail++, "***FAIL***"));
     printf("btcPaymentProtocolTests...          ");
     printf("%s\n", (btcPaymentProtocolTests()) ? "success" : (fail++, "***FAIL***"));
     printf("btcPaymentProtocolEncryptionTests...");
     printf("%s\n", (btcPaymentProtocolEncryptionTests()) ? "success" : (fail++, "***FAIL***"));
+    printf("btcPeerTests...                     ");
+    printf("%s\n", (btcPeerTests()) ? "success" : (fail++, "***FAIL***"));
+    printf("btcPeerManagerTests...              ");
+    printf("%s\n", (btcPeerManagerTests()) ? "success" : (fail++, "***FAIL***"));
+    printf("btcPeerManagerFilterSyncTests...    ");
+    printf("%s\n", (btcPeerManagerFilterSyncTests()) ? "success" : (fail++, "***FAIL***"));
     printf("\n");
     
     if (fail > 0) printf("%d TEST FUNCTION(S) ***FAILED***\n", fail);
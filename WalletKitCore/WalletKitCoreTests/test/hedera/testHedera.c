@@ -23,6 +23,7 @@
 #include "support/BRKey.h"
 
 #include "hedera/BRHederaTransaction.h"
+#include "ed25519/ed25519.h"
 #include "hedera/BRHederaAccount.h"
 
 static int debug_log = 0;
@@ -98,6 +99,15 @@ struct account_info accounts[] = {
     {"choose", "0.0.114009", "choose color rich dose toss winter dutch cannon over air cash market",
         "372c41776cbdb5cacc7c41ec75b17ad9bd3f242f5c4ab13a1bbeef274d454404" },
     {"node3", "0.0.3", "", ""},
+    {"node4", "0.0.4", "", ""},
+    {"node5", "0.0.5", "", ""},
+    {"node6", "0.0.6", "", ""},
+    {"node7", "0.0.7", "", ""},
+    {"node8", "0.0.8", "", ""},
+    {"node9", "0.0.9", "", ""},
+    {"node10", "0.0.10", "", ""},
+    {"node11", "0.0.11", "", ""},
+    {"node12", "0.0.12", "", ""},
     {"node2", "0.0.2", "", ""},
     {"42725", "0.0.42725", "", ""}, // Carl's BRD Hedera account
     {"38230", "0.0.38230", "inmate flip alley wear offer often piece magnet surge toddler submit right radio absent pear floor belt raven price stove replace reduce plate home", "b63b3815f453cf697b53b290b1d78e88c725d39bde52c34c79fb5b4c93894673"},
@@ -542,6 +552,86 @@ static void serialize_tests() {
     hederaTransactionFree(tx2);
 }
 
+// From BRHederaTransaction
+extern BRHederaTransactionHash hederaTransactionGetHashAtIndex (BRHederaTransaction transaction, int index);
+
+static void multipleSerializationTests() {
+    // The serialization for each node must match signing for that node alone
+    BRHederaTransaction txAll = createSignedTransaction("37664", "38230", NULL, 5000000, 1571928073, 500, 500000, "All nodes");
+    size_t txAllSize = 0;
+    uint8_t * txAllBytes = hederaTransactionSerialize(txAll, &txAllSize);
+
+    assert(txAllSize > 3);
+    assert(1 == txAllBytes[0]);
+    assert(HEDERA_NODE_COUNT == UInt16GetBE(&txAllBytes[1]));
+
+    size_t offset = 3;
+    for (int i = 0; i < HEDERA_NODE_COUNT; i++) {
+        char nodeName[16];
+        sprintf(nodeName, "node%d", HEDERA_NODE_START + i);
+        BRHederaTransaction txNode = createSignedTransaction("37664", "38230", nodeName, 5000000, 1571928073, 500, 500000, "All nodes");
+        size_t txNodeSize = 0;
+        uint8_t * txNodeBytes = hederaTransactionSerialize(txNode, &txNodeSize);
+
+        // A single node serialization is prefixed with the node account id
+        txNodeSize -= HEDERA_ADDRESS_SERIALIZED_SIZE;
+        assert(offset + 6 + txNodeSize <= txAllSize);
+        assert(HEDERA_NODE_START + i == UInt16GetBE(&txAllBytes[offset]));
+        assert(txNodeSize == UInt32GetBE(&txAllBytes[offset + 2]));
+        assert(0 == memcmp(&txAllBytes[offset + 6], &txNodeBytes[HEDERA_ADDRESS_SERIALIZED_SIZE], txNodeSize));
+
+        BRHederaTransactionHash hash = hederaTransactionGetHash(txNode);
+        BRHederaTransactionHash hashAtIndex = hederaTransactionGetHashAtIndex(txAll, i);
+        assert(0 == memcmp(hash.bytes, hashAtIndex.bytes, sizeof(hash.bytes)));
+        offset += 6 + txNodeSize;
+
+        free(txNodeBytes);
+        hederaTransactionFree(txNode);
+    }
+    assert(offset == txAllSize);
+
+    free(txAllBytes);
+    hederaTransactionFree(txAll);
+}
+
+// Items for the ed25519 batch tests; more than one batch, with messages of different lengths
+#define ED25519_TEST_COUNT 100
+
+static void ed25519TestItems (uint8_t *seeds, uint8_t *messageBytes, const unsigned char **messages, size_t *messageLens) {
+    for (size_t i = 0; i < ED25519_TEST_COUNT; i++) {
+        BRSHA256 (&seeds[i * 32], &i, sizeof(i));
+        BRSHA256 (&messageBytes[i * 64], &seeds[i * 32], 32);
+        BRSHA256 (&messageBytes[i * 64 + 32], &messageBytes[i * 64], 32);
+        messages[i] = &messageBytes[i * 64];
+        messageLens[i] = i % 65;
+    }
+}
+
+static void ed25519BatchTests() {
+    uint8_t seeds[ED25519_TEST_COUNT * 32], messageBytes[ED25519_TEST_COUNT * 64];
+    const unsigned char *messages[ED25519_TEST_COUNT];
+    size_t messageLens[ED25519_TEST_COUNT];
+    ed25519TestItems (seeds, messageBytes, messages, messageLens);
+
+    uint8_t publicKey[32], privateKey[64];
+    ed25519_create_keypair (publicKey, privateKey, seeds);
+
+    // Signatures match ed25519_sign, and verify
+    uint8_t signatures[ED25519_TEST_COUNT * 64];
+    ed25519_sign_batch (signatures, messages, messageLens, ED25519_TEST_COUNT, publicKey, privateKey);
+    for (size_t i = 0; i < ED25519_TEST_COUNT; i++) {
+        uint8_t signature[64];
+        ed25519_sign (signature, messages[i], messageLens[i], publicKey, privateKey);
+        assert (0 == memcmp (signature, &signatures[i * 64], 64));
+        assert (1 == ed25519_verify (&signatures[i * 64], messages[i], messageLens[i], publicKey));
+    }
+
+    // An empty batch writes nothing
+    memset (signatures, 0xff, 64);
+    ed25519_sign_batch (signatures, messages, messageLens, 0, publicKey, privateKey);
+    for (size_t i = 0; i < 64; i++) assert (0xff == signatures[i]);
+}
+
 static void address_tests() {
     addressEqualTests();
     addressValueTests();
@@ -589,6 +679,8 @@ static void transaction_tests() {
     create_new_transactions();
     transaction_value_test("patient", "choose", "node3", 10000000, 25, 4, 500000);
     serialize_tests();
+    multipleSerializationTests();
+    ed25519BatchTests();
     //create_real_transactions();
 }
 
@@ -624,3 +716,61 @@ runHederaTest (void /* ... */) {
     transaction_tests();
     txIDTests();
 }
+
+// reports the latency of signing a transfer for all the nodes
+extern void
+runPerfTestsHedera (int repeat) {
+    struct account_info source_account = find_account ("patient");
+    UInt512 seed = UINT512_ZERO;
+    BRBIP39DeriveKey(seed.u8, source_account.paper_key, NULL); // no passphrase
+    BRHederaAccount account = hederaAccountCreateWithSeed(seed);
+    BRKey publicKey = hederaAccountGetPublicKey(account);
+
+    BRHederaAddress sourceAddress = hederaAccountGetAddress(account);
+    BRHederaAddress targetAddress = hederaAddressCreateFromString (find_account ("choose").account_string, true);
+    BRHederaFeeBasis feeBasis = (BRHederaFeeBasis) { 500000, 1 };
+    BRHederaTransaction transaction = hederaTransactionCreateNew(sourceAddress, targetAddress, 10000000, feeBasis, NULL);
+
+    struct timeval t0, t1;
+    gettimeofday(&t0, NULL);
+    for (int n = 0; n < repeat; n++)
+        hederaTransactionSignTransaction (transaction, publicKey, seed, NULL);
+    gettimeofday(&t1, NULL);
+
+    printf("hedera: %.3f ms to sign a transfer for %d nodes\n",
+           ((t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_usec - t0.tv_usec) / 1000.0) / repeat, HEDERA_NODE_COUNT);
+
+    hederaTransactionFree (transaction);
+    hederaAddressFree (sourceAddress);
+    hederaAddressFree (targetAddress);
+    hederaAccountFree (account);
+}
+
+// reports ed25519 signatures per second, one at a time and in batches
+extern void
+runPerfTestsEd25519 (int repeat) {
+    uint8_t seeds[ED25519_TEST_COUNT * 32], messageBytes[ED25519_TEST_COUNT * 64];
+    const unsigned char *messages[ED25519_TEST_COUNT];
+    size_t messageLens[ED25519_TEST_COUNT];
+    uint8_t publicKey[32], privateKey[64], signatures[ED25519_TEST_COUNT * 64];
+    struct timeval t[3];
+    size_t count = (size_t) repeat * ED25519_TEST_COUNT;
+
+    ed25519TestItems (seeds, messageBytes, messages, messageLens);
+    ed25519_create_keypair (publicKey, privateKey, seeds);
+
+    gettimeofday (&t[0], NULL);
+    for (int n = 0; n < repeat; n++)
+        for (size_t i = 0; i < ED25519_TEST_COUNT; i++)
+            ed25519_sign (&signatures[i * 64], messages[i], messageLens[i], publicKey, privateKey);
+    gettimeofday (&t[1], NULL);
+    for (int n = 0; n < repeat; n++)
+        ed25519_sign_batch (signatures, messages, messageLens, ED25519_TEST_COUNT, publicKey, privateKey);
+    gettimeofday (&t[2], NULL);
+
+    double seconds[2];
+    for (int i = 0; i < 2; i++)
+        seconds[i] = (t[i + 1].tv_sec - t[i].tv_sec) + (t[i + 1].tv_usec - t[i].tv_usec) / 1000000.0;
+
+    printf("ed25519: sign %.0f/s, batched %.0f/s\n", count / seconds[0], count / seconds[1]);
+}
@@ -70,6 +70,30 @@ runTests (int reallySend);
 extern void
 runPerfTestsCoder (int repeat, int many);
 
+extern void
+runPerfTestsHeaders (int repeat);
+
+extern void
+runPerfTestsMerkle (int repeat);
+
+extern void
+runPerfTestsWalletContention (int count, int readerCount);
+
+extern void
+runPerfTestsWalletTxChain (int length);
+
+extern void
+runPerfTestsAES (int repeat);
+
+extern void
+runPerfTestsChacha20 (int repeat);
+
+extern void
+runPerfTestsBase58 (int repeat);
+
+extern void
+runPerfTestsBIP38 (int count);
+
 // Bitcoin
 typedef enum {
     BITCOIN_CHAIN_BTC,
@@ -117,6 +141,15 @@ extern void BRRandInit (void);
 // testWalletKit.c
 extern void runWalletKitTests (void);
 
+extern void
+runPerfTestsTransfersJSON (int repeat, size_t transactionsCount);
+
+extern void
+runPerfTestsPigeon (size_t messagesCount);
+
+extern void
+runPerfTestsWalletSweeper (size_t keysCount);
+
 extern WKBoolean
 runWalletKitTestsWithAccountAndNetwork (WKAccount account,
                                         WKNetwork network,
@@ -130,6 +163,12 @@ runRippleTest (void /* ... */);
 extern void
 runHederaTest (void);
 
+extern void
+runPerfTestsHedera (int repeat);
+
+extern void
+runPerfTestsEd25519 (int repeat);
+
 // Tezos
 extern void
 runTezosTest (void);
@@ -14,18 +14,26 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 #include "WKAmount.h"
+#include "WKCipher.h"
 #include "WKWallet.h"
+#include "walletkit/WKBaseP.h"
+#include "walletkit/WKClientP.h"
+#include "walletkit/WKKeyP.h"
 #include "walletkit/WKNetworkP.h"
 #include "walletkit/WKTransferP.h"
 #include "walletkit/WKWalletP.h"
 #include "walletkit/WKWalletManagerP.h"
+#include "walletkit/WKWalletSweeperP.h"
 #include "walletkit/WKSystemP.h"
 
 #include "support/BRBIP32Sequence.h"
 #include "support/BRBIP39Mnemonic.h"
+#include "support/BRKeyECIES.h"
 #include "support/util/BRHex.h"
 #include "bitcoin/BRBitcoinChainParams.h"
 #include "bitcoin/BRBitcoinWallet.h"
@@ -302,10 +310,693 @@ transferTestsAddress (void) {
     wkCurrencyGive(btc);
 }
 
+// A confirmed transaction spending `spentHash:spentIndex` and paying `amount` to each of `addrs`.
+static BRBitcoinTransaction *
+transferTestsRecoverCreateTransaction (BRAddressParams addrParams,
+                                       UInt256 spentHash,
+                                       uint32_t spentIndex,
+                                       const BRAddress *addrs,
+                                       size_t addrsCount,
+                                       uint64_t amount,
+                                       uint32_t blockHeight) {
+    BRBitcoinTransaction *transaction = btcTransactionNew ();
+    btcTransactionAddInput (transaction, spentHash, spentIndex, 0, NULL, 0, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+
+    for (size_t index = 0; index < addrsCount; index++) {
+        uint8_t script[40];
+        size_t  scriptLength = BRAddressScriptPubKey (script, sizeof (script), addrParams, addrs[index].s);
+        assert (0 != scriptLength);
+        btcTransactionAddOutput (transaction, amount, script, scriptLength);
+    }
+
+    // Round trip through the serialization to fill in the `txHash`
+    size_t   bytesCount = btcTransactionSerialize (transaction, NULL, 0);
+    uint8_t *bytes      = malloc (bytesCount);
+    btcTransactionSerialize (transaction, bytes, bytesCount);
+    btcTransactionFree (transaction);
+
+    transaction = btcTransactionParse (bytes, bytesCount);
+    transaction->blockHeight = blockHeight;
+    transaction->timestamp   = 1600000000;
+    free (bytes);
+
+    return transaction;
+}
+
+static int
+transferTestsRecoverHasTransfer (BRArrayOf(WKTransfer) transfers,
+                                 WKTransfer transfer) {
+    for (size_t index = 0; index < array_count (transfers); index++)
+        if (transfer == transfers[index]) return 1;
+    return 0;
+}
+
+// True if the wallet's transfer for `tid` is still `transfer`
+static int
+transferTestsRecoverIsTransfer (WKWallet wallet,
+                                BRBitcoinTransaction *tid,
+                                WKTransfer transfer) {
+    WKTransfer walletTransfer = wkWalletFindTransferAsBTC (wallet, tid);
+    wkTransferGive (walletTransfer);
+    return transfer == walletTransfer;
+}
+
+// Register `tid` as recovering a transaction bundle does and replace the affected transfers whose
+// amounts changed.  Every transfer whose amounts changed must be among the affected ones; returns
+// the number replaced.
+static size_t
+transferTestsRecover (WKWallet wallet,
+                      WKUnit unit,
+                      OwnershipGiven BRBitcoinTransaction *tid) {
+    BRBitcoinWallet *wid = wkWalletAsBTC (wallet);
+
+    btcWalletRegisterTransaction (wid, tid);
+    assert (tid == btcWalletTransactionForHash (wid, tid->txHash));
+
+    WKTransferListener listener = { NULL };
+    WKTransfer transfer = wkTransferCreateAsBTC (listener, unit, unit, wid, btcTransactionCopy (tid), WK_NETWORK_TYPE_BTC);
+    wkWalletAddTransfer (wallet, transfer);
+    wkTransferGive (transfer);
+
+    BRArrayOf(WKTransfer) affected = wkWalletGetTransfersAffectedAsBTC (wallet, tid);
+
+    size_t transfersCount;
+    WKTransfer *transfers = wkWalletGetTransfers (wallet, &transfersCount);
+    for (size_t index = 0; index < transfersCount; index++) {
+        if (WK_TRUE == wkTransferChangedAmountBTC (transfers[index], wid))
+            assert (transferTestsRecoverHasTransfer (affected, transfers[index]));
+        wkTransferGive (transfers[index]);
+    }
+    free (transfers);
+
+    size_t replaced = 0;
+    for (size_t index = 0; index < array_count (affected); index++) {
+        WKTransfer oldTransfer = affected[index];
+        if (WK_TRUE == wkTransferChangedAmountBTC (oldTransfer, wid)) {
+            WKTransfer newTransfer = wkTransferCreateAsBTC (listener, unit, unit, wid,
+                                                            btcTransactionCopy (wkTransferAsBTC (oldTransfer)),
+                                                            WK_NETWORK_TYPE_BTC);
+            wkWalletReplaceTransfer (wallet, oldTransfer, newTransfer);
+            replaced++;
+        }
+    }
+    array_free_all (affected, wkTransferGive);
+
+    return replaced;
+}
+
+static void
+transferTestsRecoverOutOfOrder (void) {
+    WKCurrency btc = wkCurrencyCreate ("BitcoinUIDS",
+                                       "Bitcoin",
+                                       "BTC",
+                                       "native",
+                                       NULL);
+
+    WKUnit sat = wkUnitCreateAsBase (btc,
+                                     "SatoshiUIDS",
+                                     "Satoshi",
+                                     "SAT");
+
+    BRMasterPubKey mpk = transferTestsGetMPK();
+    BRAddressParams addrParams = btcChainParams(false)->addrParams;
+
+    // The external and internal addresses in chain order, from a wallet that hasn't used any; the
+    // wallet under test generates the first SEQUENCE_GAP_LIMIT_{EXTERNAL,INTERNAL}_EXTENDED.
+    BRBitcoinWallet *widAddrs = btcWalletNew (addrParams, NULL, 0, mpk);
+    BRAddress external[SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + SEQUENCE_GAP_LIMIT_EXTERNAL];
+    BRAddress internal[2];
+    btcWalletUnusedAddrs (widAddrs, external, SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + SEQUENCE_GAP_LIMIT_EXTERNAL, SEQUENCE_EXTERNAL_CHAIN);
+    btcWalletUnusedAddrs (widAddrs, internal, 2, SEQUENCE_INTERNAL_CHAIN);
+    btcWalletFree (widAddrs);
+
+    BRAddress foreign;
+    BRAddressFromHash160 (foreign.s, sizeof (foreign.s), addrParams, &UINT160_ZERO);
+
+    BRBitcoinWallet *wid = btcWalletNew (addrParams, NULL, 0, mpk);
+    btcWalletSetCallbacks (wid, NULL, NULL, NULL, NULL, NULL);
+
+    WKWalletListener listener = { NULL };
+    WKWallet wallet = wkWalletCreateAsBTC (WK_NETWORK_TYPE_BTC, listener, sat, sat, wid);
+
+    UInt256 fundingHash = UINT256_ZERO;
+    fundingHash.u8[0] = 1;
+
+    // `txA` funds external[0]; `txB` spends it, with change to internal[0]
+    BRBitcoinTransaction *txA = transferTestsRecoverCreateTransaction (addrParams, fundingHash, 0, &external[0], 1, 100000, 100);
+    BRBitcoinTransaction *txB = transferTestsRecoverCreateTransaction (addrParams, txA->txHash, 0, &internal[0], 1, 90000, 101);
+
+    // `txC` pays an address in the wallet and one beyond its gap; `txD` spends the latter, with
+    // change to internal[1]; `txE` pays the last address in the gap which generates the former.
+    size_t beyond = SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + SEQUENCE_GAP_LIMIT_EXTERNAL - 1;
+    size_t last   = SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED - 1;
+
+    BRAddress addrsC[] = { external[1], external[beyond] };
+    BRBitcoinTransaction *txC = transferTestsRecoverCreateTransaction (addrParams, fundingHash, 1, addrsC, 2, 50000, 102);
+    BRBitcoinTransaction *txD = transferTestsRecoverCreateTransaction (addrParams, txC->txHash, 1, &internal[1], 1, 40000, 103);
+    BRBitcoinTransaction *txE = transferTestsRecoverCreateTransaction (addrParams, fundingHash, 2, &external[last], 1, 20000, 104);
+
+    assert (!btcWalletContainsAddress (wid, external[beyond].s));
+
+    // Spenders first; neither the outputs they spend nor the address `txD` spends from are known.
+    // Registering `txC` funds the output `txD` spends, which gives `txD` a fee.
+    assert (0 == transferTestsRecover (wallet, sat, txB));
+    assert (0 == transferTestsRecover (wallet, sat, txD));
+    assert (1 == transferTestsRecover (wallet, sat, txC));
+
+    WKTransfer transferB = wkWalletFindTransferAsBTC (wallet, txB);
+    WKTransfer transferC = wkWalletFindTransferAsBTC (wallet, txC);
+    WKTransfer transferD = wkWalletFindTransferAsBTC (wallet, txD);
+
+    // `txA` funds the output `txB` spends; only `txB` changes.
+    assert (1 == transferTestsRecover (wallet, sat, txA));
+    assert (!transferTestsRecoverIsTransfer (wallet, txB, transferB));
+    assert ( transferTestsRecoverIsTransfer (wallet, txC, transferC));
+    assert ( transferTestsRecoverIsTransfer (wallet, txD, transferD));
+
+    // `txE` extends the gap past the second `txC` output; `txC` receives it and `txD` spends it.
+    assert (2 == transferTestsRecover (wallet, sat, txE));
+    assert (btcWalletContainsAddress (wid, external[beyond].s));
+    assert (!transferTestsRecoverIsTransfer (wallet, txC, transferC));
+    assert (!transferTestsRecoverIsTransfer (wallet, txD, transferD));
+
+    wkTransferGive (transferD);
+    wkTransferGive (transferC);
+    wkTransferGive (transferB);
+
+    // A transaction the wallet has no part in changes nothing
+    BRBitcoinTransaction *txF = transferTestsRecoverCreateTransaction (addrParams, fundingHash, 3, &foreign, 1, 10000, 105);
+    btcWalletRegisterTransaction (wid, txF);
+    BRArrayOf(WKTransfer) affected = wkWalletGetTransfersAffectedAsBTC (wallet, txF);
+    assert (0 == array_count (affected));
+    array_free (affected);
+    if (NULL == btcWalletTransactionForHash (wid, txF->txHash)) btcTransactionFree (txF);
+
+    // Every transfer's cached amounts are current
+    size_t transfersCount;
+    WKTransfer *transfers = wkWalletGetTransfers (wallet, &transfersCount);
+    assert (5 == transfersCount);
+    for (size_t index = 0; index < transfersCount; index++) {
+        assert (WK_FALSE == wkTransferChangedAmountBTC (transfers[index], wid));
+        wkTransferGive (transfers[index]);
+    }
+    free (transfers);
+
+    wkWalletGive (wallet);
+    btcWalletFree (wid);
+    wkUnitGive(sat);
+    wkCurrencyGive(btc);
+}
+
 static void
 runWalletKitTransferTests (void) {
     transferTestsBalance();
     transferTestsAddress();
+    transferTestsRecoverOutOfOrder();
+}
+
+///
+/// Mark: String Intern Tests
+///
+
+static void
+runWalletKitStringInternTests (void) {
+    size_t count = wkStringInternCount ();
+
+    char buffer[] = "testWalletKit:intern";
+    const char *s1 = wkStringIntern ("testWalletKit:intern");
+    const char *s2 = wkStringIntern (buffer);
+
+    assert (s1 == s2 && s1 != buffer);
+    assert (0 == strcmp (s1, buffer));
+    assert (count + 1 == wkStringInternCount ());
+
+    const char *s3 = wkStringIntern ("testWalletKit:intern:other");
+    assert (s1 != s3);
+    assert (count + 2 == wkStringInternCount ());
+
+    wkStringInternGive (s3);
+    assert (count + 1 == wkStringInternCount ());
+
+    assert (s1 == wkStringInternTake (s1));
+
+    wkStringInternGive (s1);
+    wkStringInternGive (s1);
+    wkStringInternGive (s2);
+    assert (count == wkStringInternCount ());
+
+    assert (NULL == wkStringIntern (NULL));
+    wkStringInternGive (NULL);
+}
+
+///
+/// Mark: WKCipher Tests
+///
+
+static WKKey
+cipherTestsKey (uint8_t seed) {
+    WKSecret secret = { { 0 } };
+    secret.data[31] = seed;
+    secret.data[0]  = 0x5a;
+    return wkKeyCreateFromSecret (secret);
+}
+
+#define CIPHER_TESTS_BATCH      (8)
+
+static void
+cipherTestsPigeon (void) {
+    WKKey alice = cipherTestsKey (1);
+    WKKey bob   = cipherTestsKey (2);
+    uint8_t nonce[12] = { 0 };
+    const uint8_t message[] = "The cache must not change a single byte.";
+
+    // A cached shared key encrypts exactly as the uncached derivation does
+    uint8_t expected[sizeof (message) + 16], ciphertext[sizeof (message) + 16], plaintext[sizeof (message)];
+    assert (sizeof (expected) == BRKeyPigeonEncrypt (wkKeyGetCore (alice), expected, sizeof (expected),
+                                                     wkKeyGetCore (bob), nonce, message, sizeof (message)));
+
+    WKCipher encrypter = wkCipherCreateForPigeon (alice, bob, nonce, sizeof (nonce));
+    WKCipher decrypter = wkCipherCreateForPigeon (bob, alice, nonce, sizeof (nonce));
+    assert (sizeof (ciphertext) == wkCipherEncryptLength (encrypter, message, sizeof (message)));
+    assert (wkCipherEncrypt (encrypter, ciphertext, sizeof (ciphertext), message, sizeof (message)));
+    assert (0 == memcmp (expected, ciphertext, sizeof (expected)));
+    assert (wkCipherDecrypt (decrypter, plaintext, sizeof (plaintext), ciphertext, sizeof (ciphertext)));
+    assert (0 == memcmp (message, plaintext, sizeof (message)));
+    wkCipherGive (decrypter);
+
+    // Evict alice and bob's entries, then clear the cache; the shared key is rederived each time
+    for (uint8_t seed = 3; seed < 3 + 2 * 16; seed++) {
+        WKKey other = cipherTestsKey (seed);
+        wkCipherGive (wkCipherCreateForPigeon (alice, other, nonce, sizeof (nonce)));
+        wkKeyGive (other);
+    }
+    decrypter = wkCipherCreateForPigeon (bob, alice, nonce, sizeof (nonce));
+    assert (wkCipherDecrypt (decrypter, plaintext, sizeof (plaintext), expected, sizeof (expected)));
+    wkCipherGive (decrypter);
+
+    wkCipherPigeonCacheClear ();
+    decrypter = wkCipherCreateForPigeon (bob, alice, nonce, sizeof (nonce));
+    assert (wkCipherDecrypt (decrypter, plaintext, sizeof (plaintext), expected, sizeof (expected)));
+
+    // Batches match one cipher per nonce
+    uint8_t nonces[12 * CIPHER_TESTS_BATCH] = { 0 };
+    uint8_t batchCiphertexts[CIPHER_TESTS_BATCH][sizeof (message) + 16], batchPlaintexts[CIPHER_TESTS_BATCH][sizeof (message)];
+    uint8_t *ciphertexts[CIPHER_TESTS_BATCH], *plaintexts[CIPHER_TESTS_BATCH];
+    const uint8_t *messages[CIPHER_TESTS_BATCH];
+    size_t ciphertextLens[CIPHER_TESTS_BATCH], plaintextLens[CIPHER_TESTS_BATCH];
+
+    for (size_t index = 0; index < CIPHER_TESTS_BATCH; index++) {
+        nonces[12 * index + 11] = (uint8_t) index;
+        messages[index]       = message;
+        plaintextLens[index]  = sizeof (message) - index;   // vary the lengths, from the same bytes
+        ciphertexts[index]    = batchCiphertexts[index];
+        ciphertextLens[index] = plaintextLens[index] + 16;
+        plaintexts[index]     = batchPlaintexts[index];
+    }
+
+    assert (wkCipherEncryptBatch (encrypter, nonces, ciphertexts, ciphertextLens, messages, plaintextLens, CIPHER_TESTS_BATCH));
+
+    for (size_t index = 0; index < CIPHER_TESTS_BATCH; index++) {
+        WKCipher cipher = wkCipherCreateForPigeon (alice, bob, &nonces[12 * index], 12);
+        assert (wkCipherEncrypt (cipher, expected, ciphertextLens[index], message, plaintextLens[index]));
+        assert (0 == memcmp (expected, ciphertexts[index], ciphertextLens[index]));
+        wkCipherGive (cipher);
+    }
+
+    assert (wkCipherDecryptBatch (decrypter, nonces, plaintexts, plaintextLens,
+                                  (const uint8_t **) ciphertexts, ciphertextLens, CIPHER_TESTS_BATCH));
+    for (size_t index = 0; index < CIPHER_TESTS_BATCH; index++)
+        assert (0 == memcmp (message, plaintexts[index], plaintextLens[index]));
+
+    // Any forged payload fails the batch
+    ciphertexts[CIPHER_TESTS_BATCH - 1][0] ^= 0x01;
+    assert (!wkCipherDecryptBatch (decrypter, nonces, plaintexts, plaintextLens,
+                                   (const uint8_t **) ciphertexts, ciphertextLens, CIPHER_TESTS_BATCH));
+
+    wkCipherGive (decrypter);
+    wkCipherGive (encrypter);
+    wkKeyGive (bob);
+    wkKeyGive (alice);
+}
+
+static void
+runWalletKitCipherTests (void) {
+    cipherTestsPigeon ();
+}
+
+// Encrypt `messagesCount` 256 byte messages for one paired device: deriving the shared key for
+// each, through a Pigeon cipher per message, and as a single batch.
+extern void
+runPerfTestsPigeon (size_t messagesCount) {
+    WKKey privKey = cipherTestsKey (1);
+    WKKey pubKey  = cipherTestsKey (2);
+    uint8_t message[256] = { 0 }, *ciphertexts = malloc (messagesCount * (sizeof (message) + 16));
+    uint8_t *nonces = calloc (messagesCount, 12);
+    uint8_t **outputs = calloc (messagesCount, sizeof (uint8_t *));
+    const uint8_t **inputs = calloc (messagesCount, sizeof (uint8_t *));
+    size_t *outputLens = calloc (messagesCount, sizeof (size_t)), *inputLens = calloc (messagesCount, sizeof (size_t));
+
+    for (size_t index = 0; index < messagesCount; index++) {
+        UInt64SetLE (&nonces[12 * index + 4], index);
+        outputs[index]    = &ciphertexts[index * (sizeof (message) + 16)];
+        outputLens[index] = sizeof (message) + 16;
+        inputs[index]     = message;
+        inputLens[index]  = sizeof (message);
+    }
+
+    struct timespec beg, mid1, mid2, end;
+    clock_gettime (CLOCK_MONOTONIC, &beg);
+    for (size_t index = 0; index < messagesCount; index++)
+        BRKeyPigeonEncrypt (wkKeyGetCore (privKey), outputs[index], outputLens[index],
+                            wkKeyGetCore (pubKey), &nonces[12 * index], message, sizeof (message));
+    clock_gettime (CLOCK_MONOTONIC, &mid1);
+
+    for (size_t index = 0; index < messagesCount; index++) {
+        WKCipher cipher = wkCipherCreateForPigeon (privKey, pubKey, &nonces[12 * index], 12);
+        wkCipherEncrypt (cipher, outputs[index], outputLens[index], message, sizeof (message));
+        wkCipherGive (cipher);
+    }
+    clock_gettime (CLOCK_MONOTONIC, &mid2);
+
+    WKCipher cipher = wkCipherCreateForPigeon (privKey, pubKey, nonces, 12);
+    wkCipherEncryptBatch (cipher, nonces, outputs, outputLens, inputs, inputLens, messagesCount);
+    wkCipherGive (cipher);
+    clock_gettime (CLOCK_MONOTONIC, &end);
+
+    printf ("pigeon: %zu messages: %.2f us/message uncached, %.2f us/message cached, %.2f us/message batched\n",
+            messagesCount,
+            1e6 * ((mid1.tv_sec - beg.tv_sec)  + (mid1.tv_nsec - beg.tv_nsec)  / 1e9) / messagesCount,
+            1e6 * ((mid2.tv_sec - mid1.tv_sec) + (mid2.tv_nsec - mid1.tv_nsec) / 1e9) / messagesCount,
+            1e6 * ((end.tv_sec  - mid2.tv_sec) + (end.tv_nsec  - mid2.tv_nsec) / 1e9) / messagesCount);
+
+    free (inputLens); free (outputLens); free (inputs); free (outputs); free (nonces); free (ciphertexts);
+    wkKeyGive (pubKey);
+    wkKeyGive (privKey);
+}
+
+///
+/// Mark: WKClient Bundle Tests
+///
+
+static void
+clientBundleTestsTransfer (void) {
+    const char *keys[] = { "DestinationTag", "memo" };
+    const char *vals[] = { "12345", "" };
+
+    WKClientTransferBundle bundle =
+    wkClientTransferBundleCreate (WK_TRANSFER_STATE_INCLUDED,
+                                  "0x4f1b4c58c5b0f2f7d0a3fd2e1b6ec6c8c2e3d0bd4d1d2f1e0a9b8c7d6e5f4a3b",
+                                  "0x4f1b4c58c5b0f2f7d0a3fd2e1b6ec6c8c2e3d0bd4d1d2f1e0a9b8c7d6e5f4a3b",
+                                  "ethereum-mainnet:0x4f1b4c58c5b0f2f7d0a3fd2e1b6ec6c8c2e3d0bd4d1d2f1e0a9b8c7d6e5f4a3b:3",
+                                  "0x8fb0ce1bbbd54da1a8d3ef3fd9ab2b1bd4de1e2c",
+                                  "1BvBMSEYstWetqTFn5Au4m4GFg7xJaNVN2",
+                                  "123456789012345678901234567890",
+                                  "ethereum-mainnet:__native__",
+                                  "007",                   // not canonical; kept as text
+                                  3,
+                                  1600000000,
+                                  12000000,
+                                  14,
+                                  27,
+                                  "000000000000000000052a3b2c5d1f7a8f9e1d2c3b4a5968778695a4b3c2d1e0",
+                                  2, keys, vals);
+
+    size_t   bytesCount;
+    uint8_t *bytes = wkClientTransferBundleSerialize (bundle, &bytesCount);
+
+    WKClientTransferBundle decoded = wkClientTransferBundleDeserialize (bytes, bytesCount);
+    assert (NULL != decoded);
+
+    assert (bundle->uids == decoded->uids);     // interned
+    assert (0 == strcmp (bundle->hash,       decoded->hash));
+    assert (0 == strcmp (bundle->identifier, decoded->identifier));
+    assert (0 == strcmp (bundle->uids,       decoded->uids));
+    assert (0 == strcmp (bundle->from,       decoded->from));
+    assert (0 == strcmp (bundle->to,         decoded->to));
+    assert (0 == strcmp (bundle->amount,     decoded->amount));
+    assert (0 == strcmp (bundle->currency,   decoded->currency));
+    assert (0 == strcmp (bundle->fee,        decoded->fee));
+    assert (0 == strcmp (bundle->blockHash,  decoded->blockHash));
+    assert (bundle->status                == decoded->status);
+    assert (bundle->transferIndex         == decoded->transferIndex);
+    assert (bundle->blockTimestamp        == decoded->blockTimestamp);
+    assert (bundle->blockNumber           == decoded->blockNumber);
+    assert (bundle->blockConfirmations    == decoded->blockConfirmations);
+    assert (bundle->blockTransactionIndex == decoded->blockTransactionIndex);
+    assert (2 == decoded->attributesCount);
+    assert (0 == strcmp ("DestinationTag", decoded->attributeKeys[0]));
+    assert (0 == strcmp ("",               decoded->attributeVals[1]));
+
+    // Every truncation is rejected
+    for (size_t count = 0; count < bytesCount; count++)
+        assert (NULL == wkClientTransferBundleDeserialize (bytes, count));
+
+    wkClientTransferBundleRelease (decoded);
+    free (bytes);
+
+    // A NULL fee survives
+    free (bundle->fee);
+    bundle->fee = NULL;
+    bytes   = wkClientTransferBundleSerialize (bundle, &bytesCount);
+    decoded = wkClientTransferBundleDeserialize (bytes, bytesCount);
+    assert (NULL != decoded && NULL == decoded->fee);
+
+    wkClientTransferBundleRelease (decoded);
+    wkClientTransferBundleRelease (bundle);
+    free (bytes);
+}
+
+static void
+clientBundleTestsTransaction (void) {
+    uint8_t transaction[] = { 0x01, 0x00, 0x00, 0x00, 0xff, 0xfe };
+
+    WKClientTransactionBundle bundle =
+    wkClientTransactionBundleCreate (WK_TRANSFER_STATE_INCLUDED,
+                                     transaction, sizeof (transaction),
+                                     1600000000,
+                                     BLOCK_HEIGHT_UNBOUND);
+
+    size_t   bytesCount;
+    uint8_t *bytes = wkClientTransactionBundleSerialize (bundle, &bytesCount);
+
+    WKClientTransactionBundle decoded = wkClientTransactionBundleDeserialize (bytes, bytesCount);
+    assert (NULL != decoded);
+    assert (wkClientTransactionBundleIsEqual (bundle, decoded));
+
+    for (size_t count = 0; count < bytesCount; count++)
+        assert (NULL == wkClientTransactionBundleDeserialize (bytes, count));
+
+    wkClientTransactionBundleRelease (decoded);
+    wkClientTransactionBundleRelease (bundle);
+    free (bytes);
+}
+
+// A `GET /transactions` response: a transfer with a merged fee, a transfer not involving the
+// address and a transaction with only a fee, which is paid by an 'unknown' transfer.
+static const char *clientBundleTestsTransferJSONPayload =
+"{\"_embedded\":{\"transactions\":["
+ "{\"transaction_id\":\"ethereum-mainnet:0xaa\",\"identifier\":\"0xaa\",\"hash\":\"0xaa\",\"blockchain_id\":\"ethereum-mainnet\","
+  "\"timestamp\":\"2019-06-06T17:17:41.000+0000\",\"block_height\":7900000,\"block_hash\":\"0xbb\",\"index\":12,"
+  "\"confirmations\":99,\"status\":\"confirmed\",\"size\":120,"
+  "\"fee\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"21000\"},"
+  "\"meta\":{\"memo\":\"caf\\u00e9\\n\\\"quoted\\\" \\ud83d\\ude00\",\"nonce\":\"7\"},"
+  "\"_embedded\":{\"transfers\":["
+   "{\"transfer_id\":\"ethereum-mainnet:0xaa:0\",\"blockchain_id\":\"ethereum-mainnet\",\"from_address\":\"0xa1\","
+    "\"to_address\":\"0xb2\",\"index\":0,\"amount\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"1000\"},"
+    "\"meta\":{\"nonce\":\"8\"},\"transaction_id\":\"ethereum-mainnet:0xaa\"},"
+   "{\"transfer_id\":\"ethereum-mainnet:0xaa:1\",\"blockchain_id\":\"ethereum-mainnet\",\"from_address\":\"0xa1\","
+    "\"to_address\":\"__fee__\",\"index\":1,\"amount\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"21000\"},"
+    "\"transaction_id\":\"ethereum-mainnet:0xaa\"},"
+   "{\"transfer_id\":\"ethereum-mainnet:0xaa:2\",\"blockchain_id\":\"ethereum-mainnet\",\"from_address\":\"0xc3\","
+    "\"to_address\":\"0xd4\",\"index\":2,\"amount\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"5\"},"
+    "\"transaction_id\":\"ethereum-mainnet:0xaa\"}"
+  "]}},"
+ "{\"transaction_id\":\"ethereum-mainnet:0xcc\",\"identifier\":\"0xcc\",\"hash\":\"0xcc\",\"blockchain_id\":\"ethereum-mainnet\","
+  "\"timestamp\":null,\"block_height\":null,\"status\":\"submitted\",\"size\":120,"
+  "\"_embedded\":{\"transfers\":["
+   "{\"transfer_id\":\"ethereum-mainnet:0xcc:0\",\"blockchain_id\":\"ethereum-mainnet\",\"from_address\":\"0xa1\","
+    "\"to_address\":\"__fee__\",\"index\":0,\"amount\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"42\"},"
+    "\"transaction_id\":\"ethereum-mainnet:0xcc\"}"
+  "]}}"
+"]},\"_links\":{\"self\":{\"href\":\"https://api.blockset.com/transactions\"}}}";
+
+static void
+clientBundleTestsTransferJSON (void) {
+    const char *addresses[] = { "0xA1" };
+    const uint8_t *payload  = (const uint8_t *) clientBundleTestsTransferJSONPayload;
+    size_t payloadCount     = strlen (clientBundleTestsTransferJSONPayload);
+
+    BRArrayOf(WKClientTransferBundle) bundles;
+    array_new (bundles, 10);
+
+    assert (wkClientTransferBundlesCreateFromJSON (payload, payloadCount, addresses, 1, &bundles));
+    assert (2 == array_count (bundles));
+
+    WKClientTransferBundle bundle = bundles[0];
+    assert (WK_TRANSFER_STATE_INCLUDED == bundle->status);
+    assert (0 == strcmp ("0xaa",                        bundle->hash));
+    assert (0 == strcmp ("ethereum-mainnet:0xaa:0",     bundle->uids));
+    assert (0 == strcmp ("0xa1",                        bundle->from));
+    assert (0 == strcmp ("0xb2",                        bundle->to));
+    assert (0 == strcmp ("1000",                        bundle->amount));
+    assert (0 == strcmp ("ethereum-mainnet:__native__", bundle->currency));
+    assert (0 == strcmp ("21000",                       bundle->fee));
+    assert (0 == strcmp ("0xbb",                        bundle->blockHash));
+    assert (0       == bundle->transferIndex);
+    assert (1559841461 == bundle->blockTimestamp);
+    assert (7900000 == bundle->blockNumber);
+    assert (99      == bundle->blockConfirmations);
+    assert (12      == bundle->blockTransactionIndex);
+    assert (2       == bundle->attributesCount);
+    assert (0 == strcmp ("memo",  bundle->attributeKeys[0]));
+    assert (0 == strcmp ("caf\xc3\xa9\n\"quoted\" \xf0\x9f\x98\x80", bundle->attributeVals[0]));
+    assert (0 == strcmp ("nonce", bundle->attributeKeys[1]));
+    assert (0 == strcmp ("8",     bundle->attributeVals[1]));   // the transfer's meta wins
+
+    bundle = bundles[1];
+    assert (WK_TRANSFER_STATE_SUBMITTED == bundle->status);
+    assert (0 == strcmp ("ethereum-mainnet:0xcc:0", bundle->uids));
+    assert (0 == strcmp ("unknown", bundle->to));
+    assert (0 == strcmp ("0",       bundle->amount));
+    assert (0 == strcmp ("42",      bundle->fee));
+    assert (NULL == bundle->blockHash);
+    assert (NO_WK_TIMESTAMP      == bundle->blockTimestamp);
+    assert (BLOCK_HEIGHT_UNBOUND == bundle->blockNumber);
+    assert (0 == bundle->attributesCount);
+
+    array_free_all (bundles, wkClientTransferBundleRelease);
+    array_new (bundles, 10);
+
+    // More attributes than the attribute arrays initially hold, with the transfer's meta replacing
+    // one of the transaction's and adding more
+    char manyAttributes[1024] =
+    "[{\"transaction_id\":\"ethereum-mainnet:0xee\",\"identifier\":\"0xee\",\"hash\":\"0xee\",\"blockchain_id\":\"ethereum-mainnet\","
+    "\"timestamp\":null,\"block_height\":null,\"status\":\"submitted\",\"meta\":{";
+    for (size_t index = 0; index < 12; index++)
+        snprintf (&manyAttributes[strlen (manyAttributes)], sizeof (manyAttributes) - strlen (manyAttributes),
+                  "%s\"k%02zu\":\"%zu\"", (0 == index ? "" : ","), index, index);
+    strncat (manyAttributes,
+             "},\"_embedded\":{\"transfers\":["
+             "{\"transfer_id\":\"ethereum-mainnet:0xee:0\",\"blockchain_id\":\"ethereum-mainnet\",\"from_address\":\"0xa1\","
+             "\"to_address\":\"0xb2\",\"index\":0,\"amount\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"1\"},"
+             "\"meta\":{\"k11\":\"t\",\"t0\":\"0\",\"t1\":\"1\"},\"transaction_id\":\"ethereum-mainnet:0xee\"}"
+             "]}}]",
+             sizeof (manyAttributes) - strlen (manyAttributes) - 1);
+
+    assert (wkClientTransferBundlesCreateFromJSON ((const uint8_t *) manyAttributes, strlen (manyAttributes), addresses, 1, &bundles));
+    assert (1  == array_count (bundles));
+    assert (14 == bundles[0]->attributesCount);
+    for (size_t index = 0; index < 12; index++) {
+        char key[4], val[3];
+        snprintf (key, sizeof (key), "k%02zu", index);
+        snprintf (val, sizeof (val), "%zu",    index);
+        assert (0 == strcmp (key, bundles[0]->attributeKeys[index]));
+        assert (0 == strcmp (11 == index ? "t" : val, bundles[0]->attributeVals[index]));
+    }
+    assert (0 == strcmp ("t0", bundles[0]->attributeKeys[12]) && 0 == strcmp ("0", bundles[0]->attributeVals[12]));
+    assert (0 == strcmp ("t1", bundles[0]->attributeKeys[13]) && 0 == strcmp ("1", bundles[0]->attributeVals[13]));
+
+    array_free_all (bundles, wkClientTransferBundleRelease);
+    array_new (bundles, 10);
+
+    // Bare arrays and empty responses
+    assert (wkClientTransferBundlesCreateFromJSON ((const uint8_t *) " [ ] ", 5, addresses, 1, &bundles));
+    assert (wkClientTransferBundlesCreateFromJSON ((const uint8_t *) "{\"_links\":{}}", 13, addresses, 1, &bundles));
+    assert (0 == array_count (bundles));
+
+    // Every truncation is rejected, as are trailing values and unknown states
+    for (size_t count = 0; count < payloadCount; count++) {
+        assert (!wkClientTransferBundlesCreateFromJSON (payload, count, addresses, 1, &bundles));
+        assert (0 == array_count (bundles));
+    }
+    assert (!wkClientTransferBundlesCreateFromJSON ((const uint8_t *) "[] []",  5, addresses, 1, &bundles));
+    assert (!wkClientTransferBundlesCreateFromJSON ((const uint8_t *) "[{\"hash\":\"0\",\"identifier\":\"0\",\"status\":\"lost\"}]", 46, addresses, 1, &bundles));
+    assert (!wkClientTransferBundlesCreateFromJSON ((const uint8_t *) "[\"\\ud83d\"]", 10, addresses, 1, &bundles));
+    assert (!wkClientTransferBundlesCreateFromJSON ((const uint8_t *) "[01]",   4, addresses, 1, &bundles));
+
+    // Fuzz: random byte changes are either parsed or rejected without any bundles
+    uint8_t *fuzzed = malloc (payloadCount);
+    srand (0x4a534f4e);
+    for (size_t trial = 0; trial < 20000; trial++) {
+        memcpy (fuzzed, payload, payloadCount);
+        for (size_t changes = 1 + (size_t) rand() % 4; changes > 0; changes--)
+            fuzzed[(size_t) rand() % payloadCount] = (uint8_t) (0 == rand() % 2 ? rand() : "\"\\{}[],:0u"[rand() % 10]);
+
+        if (wkClientTransferBundlesCreateFromJSON (fuzzed, payloadCount, addresses, 1, &bundles))
+            for (size_t index = 0; index < array_count (bundles); index++)
+                assert (NULL != bundles[index]->uids && NULL != bundles[index]->amount);
+        else assert (0 == array_count (bundles));
+
+        for (size_t index = 0; index < array_count (bundles); index++)
+            wkClientTransferBundleRelease (bundles[index]);
+        array_clear (bundles);
+    }
+    free (fuzzed);
+
+    array_free (bundles);
+}
+
+static void
+runWalletKitClientBundleTests (void) {
+    clientBundleTestsTransfer ();
+    clientBundleTestsTransaction ();
+    clientBundleTestsTransferJSON ();
+}
+
+// Parse a corpus of `GET /transactions` responses, each of `transactionsCount` transactions with
+// a transfer, a fee and an unrelated transfer, into transfer bundles.
+extern void
+runPerfTestsTransfersJSON (int repeat, size_t transactionsCount) {
+    const char *addresses[] = { "0x8fb0ce1bbbd54da1a8d3ef3fd9ab2b1bd4de1e2c" };
+    size_t capacity = 2048 * (transactionsCount + 1), count = 0;
+    char *corpus = malloc (capacity);
+
+    count += (size_t) snprintf (&corpus[count], capacity - count, "{\"_embedded\":{\"transactions\":[");
+    for (size_t index = 0; index < transactionsCount; index++)
+        count += (size_t) snprintf (&corpus[count], capacity - count,
+                                    "%s{\"transaction_id\":\"ethereum-mainnet:0x%064zx\",\"identifier\":\"0x%064zx\",\"hash\":\"0x%064zx\","
+                                    "\"blockchain_id\":\"ethereum-mainnet\",\"timestamp\":\"2020-09-13T12:26:40.000+0000\","
+                                    "\"block_height\":%zu,\"block_hash\":\"0x%064zx\",\"index\":%zu,\"confirmations\":6,"
+                                    "\"status\":\"confirmed\",\"size\":120,\"meta\":{\"nonce\":\"%zu\"},\"_embedded\":{\"transfers\":["
+                                    "{\"transfer_id\":\"ethereum-mainnet:0x%064zx:0\",\"blockchain_id\":\"ethereum-mainnet\","
+                                    "\"from_address\":\"%s\",\"to_address\":\"0x1bd4de1e2c8fb0ce1bbbd54da1a8d3ef3fd9ab2b\",\"index\":0,"
+                                    "\"amount\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"%zu000000000\"},"
+                                    "\"transaction_id\":\"ethereum-mainnet:0x%064zx\"},"
+                                    "{\"transfer_id\":\"ethereum-mainnet:0x%064zx:1\",\"blockchain_id\":\"ethereum-mainnet\","
+                                    "\"from_address\":\"%s\",\"to_address\":\"__fee__\",\"index\":1,"
+                                    "\"amount\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"21000000000000\"},"
+                                    "\"transaction_id\":\"ethereum-mainnet:0x%064zx\"},"
+                                    "{\"transfer_id\":\"ethereum-mainnet:0x%064zx:2\",\"blockchain_id\":\"ethereum-mainnet\","
+                                    "\"from_address\":\"0xd54da1a8d3ef3fd9ab2b1bd4de1e2c8fb0ce1bbb\",\"to_address\":\"0x3ef3fd9ab2b1bd4de1e2c8fb0ce1bbbd54da1a8d\",\"index\":2,"
+                                    "\"amount\":{\"currency_id\":\"ethereum-mainnet:__native__\",\"amount\":\"1\"},"
+                                    "\"transaction_id\":\"ethereum-mainnet:0x%064zx\"}]}}",
+                                    (0 == index ? "" : ","), index, index, index, 10000000 + index, index, index % 200, index,
+                                    index, addresses[0], index, index, index, addresses[0], index, index, index);
+    count += (size_t) snprintf (&corpus[count], capacity - count, "]}}");
+
+    BRArrayOf(WKClientTransferBundle) bundles;
+    array_new (bundles, transactionsCount);
+
+    struct timespec beg, end;
+    clock_gettime (CLOCK_MONOTONIC, &beg);
+    for (int index = 0; index < repeat; index++) {
+        bool success = wkClientTransferBundlesCreateFromJSON ((const uint8_t *) corpus, count, addresses, 1, &bundles);
+        assert (success && transactionsCount == array_count (bundles));
+        for (size_t bundle = 0; bundle < array_count (bundles); bundle++)
+            wkClientTransferBundleRelease (bundles[bundle]);
+        array_clear (bundles);
+    }
+    clock_gettime (CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - beg.tv_sec) + (end.tv_nsec - beg.tv_nsec) / 1e9;
+    printf ("transfers JSON: %zu transactions, %zu bytes: %.3f ms per response, %.1f MB/s, %.0f transfers/s\n",
+            transactionsCount, count,
+            1e3 * seconds / repeat,
+            (double) count * repeat / seconds / 1e6,
+            (double) transactionsCount * repeat / seconds);
+
+    array_free (bundles);
+    free (corpus);
 }
 
 ///
@@ -1503,6 +2194,857 @@ runWalletKitWalletManagerLifecycleWithSetModeTest (WKAccount account,
     return success;
 }
 
+///
+/// Mark: Paged Sync Tests
+///
+
+#define CWM_PAGED_SYNC_PAGE_COUNT       (50)
+#define CWM_PAGED_SYNC_AMOUNT           (10000)
+
+// A stand-in client that announces every transactions request's results as
+// CWM_PAGED_SYNC_PAGE_COUNT pages.  Each page of the first request holds one transaction paying
+// the request's first address, at a block height that advances evenly from the request's
+// `begBlockNumber` to the client's `blockNumber`; the pages of later requests, for the addresses
+// the wallet adds once those are recovered, are empty.
+
+typedef struct {
+    WKBlockNumber blockNumber;
+    BRAddressParams addrParams;
+    size_t requests;
+    size_t transactions;
+} CWMPagedClientState;
+
+static void
+_CWMPagedGetBlockNumberCallback (WKClientContext context,
+                                 OwnershipGiven WKWalletManager manager,
+                                 OwnershipGiven WKClientCallbackState callbackState) {
+    CWMPagedClientState *client = (CWMPagedClientState *) context;
+    wkClientAnnounceBlockNumber (manager, callbackState, WK_TRUE, client->blockNumber, NULL);
+    wkWalletManagerGive (manager);
+}
+
+// A bundle for a transaction paying `amount` to `address`, in `blockNumber`, spending an output
+// of a transaction unique to `serial`.
+static WKClientTransactionBundle
+_CWMTransactionBundleCreatePaying (BRAddressParams addrParams,
+                                   uint32_t serial,
+                                   const char *address,
+                                   uint64_t amount,
+                                   WKBlockNumber blockNumber) {
+    UInt256 spentHash = UINT256_ZERO;
+    UInt32SetLE (spentHash.u8, serial);
+    uint8_t signature[] = { OP_0 };
+
+    BRBitcoinTxOutput output = BR_TX_OUTPUT_NONE;
+    btcTxOutputSetAddress (&output, addrParams, address);
+
+    BRBitcoinTransaction *transaction = btcTransactionNew ();
+    btcTransactionAddInput (transaction, spentHash, 0, 0, NULL, 0, signature, sizeof (signature), NULL, 0, TXIN_SEQUENCE);
+    btcTransactionAddOutput (transaction, amount, output.script, output.scriptLen);
+    btcTxOutputSetAddress (&output, addrParams, NULL);
+
+    size_t   bytesCount = btcTransactionSerialize (transaction, NULL, 0);
+    uint8_t *bytes      = malloc (bytesCount);
+    btcTransactionSerialize (transaction, bytes, bytesCount);
+    btcTransactionFree (transaction);
+
+    WKClientTransactionBundle bundle =
+    wkClientTransactionBundleCreate (WK_TRANSFER_STATE_INCLUDED, bytes, bytesCount, 1600000000, blockNumber);
+
+    free (bytes);
+    return bundle;
+}
+
+static void
+_CWMPagedGetTransactionsCallback (WKClientContext context,
+                                  OwnershipGiven WKWalletManager manager,
+                                  OwnershipGiven WKClientCallbackState callbackState,
+                                  OwnershipKept const char **addresses,
+                                  size_t addressCount,
+                                  uint64_t begBlockNumber,
+                                  uint64_t endBlockNumber) {
+    CWMPagedClientState *client = (CWMPagedClientState *) context;
+    bool needTransactions = (0 == client->requests++ && addressCount > 0);
+
+    for (size_t page = 1; page <= CWM_PAGED_SYNC_PAGE_COUNT; page++) {
+        WKClientTransactionBundle bundle = NULL;
+
+        if (needTransactions)
+            bundle = _CWMTransactionBundleCreatePaying (client->addrParams,
+                                                        (uint32_t) ++client->transactions,
+                                                        addresses[0],
+                                                        CWM_PAGED_SYNC_AMOUNT,
+                                                        begBlockNumber + page * (client->blockNumber - begBlockNumber) / CWM_PAGED_SYNC_PAGE_COUNT);
+
+        wkClientAnnounceTransactionsPage (manager, callbackState, WK_TRUE,
+                                          AS_WK_BOOLEAN (page < CWM_PAGED_SYNC_PAGE_COUNT),
+                                          &bundle, (NULL == bundle ? 0 : 1));
+    }
+    wkWalletManagerGive (manager);
+}
+
+// Only the manager's events are recorded; the recovered transfers are checked in the wallet.
+
+static void
+_CWMPagedWalletCallback (WKListenerContext context,
+                         WKWalletManager manager,
+                         WKWallet wallet,
+                         WKWalletEvent event) {
+}
+
+static void
+_CWMPagedTransferCallback (WKListenerContext context,
+                           WKWalletManager manager,
+                           WKWallet wallet,
+                           WKTransfer transfer,
+                           WKTransferEvent event) {
+}
+
+static int
+runWalletKitWalletManagerPagedSyncTest (WKAccount account,
+                                        WKNetwork network,
+                                        WKAddressScheme scheme,
+                                        const char *storagePath) {
+    int success = 1;
+
+    // HACK: Managers set the height; we need to be able to restore it between tests
+    WKBlockNumber originalNetworkHeight = wkNetworkGetHeight (network);
+
+    printf("Testing WKWalletManager paged sync for network=\"%s (%s)\" and path=\"%s\"...\n",
+           wkNetworkGetName (network),
+           wkNetworkIsMainnet (network) ? "mainnet" : "testnet",
+           storagePath);
+
+    // Test setup
+    CWMEventRecordingState state = {0};
+    CWMEventRecordingStateNewDefault (&state);
+
+    // Far enough beyond the network's height that the sync is a full sync, with events
+    CWMPagedClientState clientState = {
+        originalNetworkHeight + 1000000,
+        wkNetworkAsBTC (network)->addrParams,
+        0,
+        0
+    };
+
+    WKListener listener = wkListenerCreate (&state,
+                                            _CWMEventRecordingSystemCallback,
+                                            _CWMEventRecordingNetworkCallback,
+                                            _CWMEventRecordingManagerCallback,
+                                            _CWMPagedWalletCallback,
+                                            _CWMPagedTransferCallback);
+
+    WKClient client = (WKClient) {
+        &clientState,
+        _CWMPagedGetBlockNumberCallback,
+        _CWMPagedGetTransactionsCallback,
+        _CWMNopGetTransfersCallback,
+        _CWMNopSubmitTransactionCallback,
+        _CWMNopEstimateTransactionFeeCallback
+    };
+
+    WKSystem system = wkSystemCreate (client, listener, account, storagePath, wkNetworkIsMainnet(network));
+
+    WKWalletManager manager = wkWalletManagerCreate (wkListenerCreateWalletManagerListener (listener, system),
+                                                     client,
+                                                     account,
+                                                     network,
+                                                     WK_SYNC_MODE_API_ONLY,
+                                                     scheme,
+                                                     storagePath);
+    WKWallet wallet = wkWalletManagerGetWallet (manager);
+
+    // connect, sync through every page, disconnect
+    wkWalletManagerConnect (manager, NULL);
+    sleep(2);
+    wkWalletManagerDisconnect (manager);
+    sleep(1);
+    wkWalletManagerStop (manager);
+
+    // Verification; every page's transaction is recovered
+    size_t transfersCount = 0;
+    WKTransfer *transfers = wkWalletGetTransfers (wallet, &transfersCount);
+    for (size_t index = 0; index < transfersCount; index++) wkTransferGive (transfers[index]);
+    free (transfers);
+
+    WKBoolean overflow;
+    WKAmount balance = wkWalletGetBalance (wallet);
+    uint64_t balanceValue = wkAmountGetIntegerRaw (balance, &overflow);
+    wkAmountGive (balance);
+
+    if (0 == clientState.requests ||
+        CWM_PAGED_SYNC_PAGE_COUNT != transfersCount ||
+        CWM_PAGED_SYNC_PAGE_COUNT * CWM_PAGED_SYNC_AMOUNT != balanceValue) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: %zu transfers, balance %"PRIu64", for %zu requests\n", __func__, __LINE__, transfersCount, balanceValue, clientState.requests);
+    }
+
+    // The sync reports its progress as pages are recovered, from 0 to 100 and then 100 again as it
+    // stops.  Pages are recovered only once no request can still announce a lower block; once the
+    // first page's transaction adds addresses to the wallet, the request for those holds the later
+    // pages until it completes, so the steps need not be even.
+    pthread_mutex_lock (&state.lock);
+    size_t progressCount = 0;
+    WKSyncPercentComplete progress = AS_WK_SYNC_PERCENT_COMPLETE (0);
+    for (size_t index = 0; index < array_count (state.events); index++) {
+        CWMEvent *event = state.events[index];
+        if (SYNC_EVENT_WALLET_MANAGER_TYPE != event->type ||
+            WK_WALLET_MANAGER_EVENT_SYNC_CONTINUES != event->u.m.event.type) continue;
+
+        WKSyncPercentComplete percent = event->u.m.event.u.syncContinues.percentComplete;
+
+        if (percent < progress || (0 == progressCount && fabsf (percent) > 0.01f)) {
+            success = 0;
+            fprintf(stderr, "***FAILED*** %s:%d: progress %zu is %.2f%%, after %.2f%%\n", __func__, __LINE__, progressCount, percent, progress);
+        }
+        progress = percent;
+        progressCount++;
+    }
+    pthread_mutex_unlock (&state.lock);
+
+    if (progressCount < 3 || fabsf (progress - AS_WK_SYNC_PERCENT_COMPLETE (100)) > 0.01f) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: %zu progress events, ending at %.2f%%\n", __func__, __LINE__, progressCount, progress);
+    }
+
+    if (success) {
+        success = CWMEventRecordingVerifyEventSequence(&state,
+                                                       WK_FALSE,
+                                                       (CWMEvent []) {
+            // wkWalletManagerCreate()
+            CWMEventForWalletManagerType         (WK_WALLET_MANAGER_EVENT_CREATED),
+            CWMEventForWalletManagerWalletType   (WK_WALLET_MANAGER_EVENT_WALLET_ADDED,
+                                                  wallet),
+            // wkWalletManagerConnect()
+            CWMEventForWalletManagerStateType    (WK_WALLET_MANAGER_EVENT_CHANGED,
+                                                  wkWalletManagerStateInit (WK_WALLET_MANAGER_STATE_CREATED),
+                                                  wkWalletManagerStateInit (WK_WALLET_MANAGER_STATE_CONNECTED)),
+            CWMEventForWalletManagerType         (WK_WALLET_MANAGER_EVENT_SYNC_STARTED),
+            CWMEventForWalletManagerStateType    (WK_WALLET_MANAGER_EVENT_CHANGED,
+                                                  wkWalletManagerStateInit (WK_WALLET_MANAGER_STATE_CONNECTED),
+                                                  wkWalletManagerStateInit (WK_WALLET_MANAGER_STATE_SYNCING)),
+            // the last page
+            CWMEventForWalletManagerType         (WK_WALLET_MANAGER_EVENT_SYNC_STOPPED),
+            CWMEventForWalletManagerStateType    (WK_WALLET_MANAGER_EVENT_CHANGED,
+                                                  wkWalletManagerStateInit (WK_WALLET_MANAGER_STATE_SYNCING),
+                                                  wkWalletManagerStateInit (WK_WALLET_MANAGER_STATE_CONNECTED)),
+        },
+                                                       7,
+                                                       (CWMEvent []) {
+            CWMEventForWalletManagerType (WK_WALLET_MANAGER_EVENT_SYNC_STARTED),
+            CWMEventForWalletManagerType (WK_WALLET_MANAGER_EVENT_SYNC_CONTINUES),
+            CWMEventForWalletManagerType (WK_WALLET_MANAGER_EVENT_BLOCK_HEIGHT_UPDATED),
+        },
+                                                       3);
+        if (!success) {
+            fprintf(stderr, "***FAILED*** %s:%d: BRRunTestWalletManagerSyncTestVerifyEventSequence failed\n", __func__, __LINE__);
+        }
+    }
+
+    // Test teardown; the recovered transactions were saved, so are wiped before the next test
+    wkNetworkSetHeight (network, originalNetworkHeight);
+    wkWalletGive (wallet);
+    wkWalletManagerGive (manager);
+    wkWalletManagerWipe (network, storagePath);
+    CWMEventRecordingStateFree (&state);
+
+    return success;
+}
+
+// A stand-in client that knows of CWM_PIPELINED_SYNC_PAYMENT_COUNT payments to the wallet's
+// receive addresses.  Each transactions request is answered from a thread of its own, after a
+// latency, with a page for each payment to the request's addresses, in block order.  The
+// requests holding the lower blocks are answered last, so bundles arrive interleaved and out of
+// block order.  Each payment after the first two is to an address beyond the gap of unused
+// addresses that follows the earlier payments; it is found only if the recovery of those
+// requests the next gap window.
+
+#define CWM_PIPELINED_SYNC_LATENCY_MS       (20)
+#define CWM_PIPELINED_SYNC_CHUNK_SIZE       (20)
+#define CWM_PIPELINED_SYNC_IN_FLIGHT_LIMIT  (4)
+#define CWM_PIPELINED_SYNC_ADDRESS_COUNT    (400)
+#define CWM_PIPELINED_SYNC_AMOUNT           (10000)
+
+static const struct {
+    uint32_t index;                     // the receive address paid
+    WKBlockNumber blockOffset;          // the payment's block, past the sync's `begBlockNumber`
+} CWMPipelinedPayments[] = {
+    {  30, 100 },
+    {  10, 200 },
+    { 120, 300 },                       // in the window past 30
+    { 135, 400 },
+    { 240, 500 },                       // in the window past 135
+};
+
+#define CWM_PIPELINED_SYNC_PAYMENT_COUNT    (sizeof (CWMPipelinedPayments) / sizeof (CWMPipelinedPayments[0]))
+#define CWM_PIPELINED_SYNC_LAST_INDEX       (240 + SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED)
+
+typedef struct {
+    WKBlockNumber blockNumber;
+    BRAddressParams addrParams;
+    BRAddress addresses[CWM_PIPELINED_SYNC_ADDRESS_COUNT];          // receive addresses, by index
+    BRAddress legacyAddresses[CWM_PIPELINED_SYNC_ADDRESS_COUNT];
+    bool requested[CWM_PIPELINED_SYNC_ADDRESS_COUNT];
+    size_t requests;
+    size_t maxAddressCount;
+    size_t inFlight;
+    size_t maxInFlight;
+    pthread_mutex_t lock;
+} CWMPipelinedClientState;
+
+typedef struct {
+    CWMPipelinedClientState *client;
+    WKWalletManager manager;
+    WKClientCallbackState callbackState;
+    WKBlockNumber begBlockNumber;
+    size_t paymentsCount;
+    size_t payments[CWM_PIPELINED_SYNC_PAYMENT_COUNT];              // in block order
+} CWMPipelinedRequest;
+
+static void *
+_CWMPipelinedAnnounceThread (void *context) {
+    CWMPipelinedRequest *request = (CWMPipelinedRequest *) context;
+    CWMPipelinedClientState *client = request->client;
+
+    // The lower the request's first block, the later it is answered
+    WKBlockNumber blockOffset = (request->paymentsCount > 0
+                                 ? CWMPipelinedPayments[request->payments[0]].blockOffset
+                                 : 600);
+    usleep ((useconds_t) (1000 * CWM_PIPELINED_SYNC_LATENCY_MS * (7 - blockOffset / 100)));
+
+    size_t pagesCount = MAX (request->paymentsCount, 1);
+    for (size_t page = 0; page < pagesCount; page++) {
+        WKClientTransactionBundle bundle = NULL;
+
+        if (page < request->paymentsCount) {
+            size_t payment = request->payments[page];
+            bundle = _CWMTransactionBundleCreatePaying (client->addrParams,
+                                                        (uint32_t) (1 + payment),
+                                                        client->addresses[CWMPipelinedPayments[payment].index].s,
+                                                        CWM_PIPELINED_SYNC_AMOUNT,
+                                                        request->begBlockNumber + CWMPipelinedPayments[payment].blockOffset);
+        }
+
+        if (page + 1 == pagesCount) {
+            pthread_mutex_lock (&client->lock);
+            client->inFlight--;
+            pthread_mutex_unlock (&client->lock);
+        }
+        else usleep (1000 * CWM_PIPELINED_SYNC_LATENCY_MS);
+
+        wkClientAnnounceTransactionsPage (request->manager, request->callbackState, WK_TRUE,
+                                          AS_WK_BOOLEAN (page + 1 < pagesCount),
+                                          &bundle, (NULL == bundle ? 0 : 1));
+    }
+
+    wkWalletManagerGive (request->manager);
+    free (request);
+    return NULL;
+}
+
+static void
+_CWMPipelinedGetBlockNumberCallback (WKClientContext context,
+                                     OwnershipGiven WKWalletManager manager,
+                                     OwnershipGiven WKClientCallbackState callbackState) {
+    CWMPipelinedClientState *client = (CWMPipelinedClientState *) context;
+    wkClientAnnounceBlockNumber (manager, callbackState, WK_TRUE, client->blockNumber, NULL);
+    wkWalletManagerGive (manager);
+}
+
+static void
+_CWMPipelinedGetTransactionsCallback (WKClientContext context,
+                                      OwnershipGiven WKWalletManager manager,
+                                      OwnershipGiven WKClientCallbackState callbackState,
+                                      OwnershipKept const char **addresses,
+                                      size_t addressCount,
+                                      uint64_t begBlockNumber,
+                                      uint64_t endBlockNumber) {
+    CWMPipelinedClientState *client = (CWMPipelinedClientState *) context;
+
+    CWMPipelinedRequest *request = calloc (1, sizeof (CWMPipelinedRequest));
+    *request = (CWMPipelinedRequest) { client, manager, callbackState, begBlockNumber };
+
+    pthread_mutex_lock (&client->lock);
+    client->requests++;
+    client->maxAddressCount = MAX (client->maxAddressCount, addressCount);
+    client->inFlight++;
+    client->maxInFlight     = MAX (client->maxInFlight, client->inFlight);
+
+    // Note the receive addresses requested; the payments to them, as listed, are in block order
+    for (size_t index = 0; index < CWM_PIPELINED_SYNC_ADDRESS_COUNT; index++)
+        for (size_t address = 0; address < addressCount; address++)
+            if (0 == strcmp (addresses[address], client->addresses[index].s) ||
+                0 == strcmp (addresses[address], client->legacyAddresses[index].s)) {
+                client->requested[index] = true;
+
+                for (size_t payment = 0; payment < CWM_PIPELINED_SYNC_PAYMENT_COUNT; payment++)
+                    if (index == CWMPipelinedPayments[payment].index) {
+                        size_t insert = request->paymentsCount++;
+                        for (; insert > 0 && payment < request->payments[insert - 1]; insert--)
+                            request->payments[insert] = request->payments[insert - 1];
+                        request->payments[insert] = payment;
+                    }
+                break;
+            }
+    pthread_mutex_unlock (&client->lock);
+
+    pthread_t thread;
+    pthread_create (&thread, NULL, _CWMPipelinedAnnounceThread, request);
+    pthread_detach (thread);
+}
+
+static int
+runWalletKitWalletManagerPipelinedSyncTest (WKAccount account,
+                                            WKNetwork network,
+                                            WKAddressScheme scheme,
+                                            const char *storagePath) {
+    int success = 1;
+
+    // HACK: Managers set the height; we need to be able to restore it between tests
+    WKBlockNumber originalNetworkHeight = wkNetworkGetHeight (network);
+
+    printf("Testing WKWalletManager pipelined sync for network=\"%s (%s)\" and path=\"%s\"...\n",
+           wkNetworkGetName (network),
+           wkNetworkIsMainnet (network) ? "mainnet" : "testnet",
+           storagePath);
+
+    // Test setup
+    CWMEventRecordingState state = {0};
+    CWMEventRecordingStateNew (&state, WK_TRUE);
+
+    // Far enough beyond the network's height that the sync is a full sync, with events
+    CWMPipelinedClientState *clientState = calloc (1, sizeof (CWMPipelinedClientState));
+    clientState->blockNumber = originalNetworkHeight + 1000000;
+    clientState->addrParams  = wkNetworkAsBTC (network)->addrParams;
+    pthread_mutex_init (&clientState->lock, NULL);
+
+    // The wallet's receive addresses, from a wallet of its own
+    BRBitcoinWallet *wid = btcWalletNew (clientState->addrParams, NULL, 0,
+                                         *((BRMasterPubKey *) wkAccountAs (account, WK_NETWORK_TYPE_BTC)));
+    btcWalletUnusedAddrs (wid, NULL, CWM_PIPELINED_SYNC_ADDRESS_COUNT, SEQUENCE_EXTERNAL_CHAIN);
+    btcWalletChainAddrs  (wid, clientState->addresses, CWM_PIPELINED_SYNC_ADDRESS_COUNT, SEQUENCE_EXTERNAL_CHAIN, 0);
+    for (size_t index = 0; index < CWM_PIPELINED_SYNC_ADDRESS_COUNT; index++)
+        clientState->legacyAddresses[index] = btcWalletAddressToLegacy (wid, &clientState->addresses[index]);
+    btcWalletFree (wid);
+
+    WKListener listener = wkListenerCreate (&state,
+                                            _CWMEventRecordingSystemCallback,
+                                            _CWMEventRecordingNetworkCallback,
+                                            _CWMEventRecordingManagerCallback,
+                                            _CWMEventRecordingWalletCallback,
+                                            _CWMEventRecordingTransferCallback);
+
+    WKClient client = (WKClient) {
+        clientState,
+        _CWMPipelinedGetBlockNumberCallback,
+        _CWMPipelinedGetTransactionsCallback,
+        _CWMNopGetTransfersCallback,
+        _CWMNopSubmitTransactionCallback,
+        _CWMNopEstimateTransactionFeeCallback
+    };
+
+    WKSystem system = wkSystemCreate (client, listener, account, storagePath, wkNetworkIsMainnet(network));
+
+    WKWalletManager manager = wkWalletManagerCreate (wkListenerCreateWalletManagerListener (listener, system),
+                                                     client,
+                                                     account,
+                                                     network,
+                                                     WK_SYNC_MODE_API_ONLY,
+                                                     scheme,
+                                                     storagePath);
+    wkClientQRYManagerSetRecoveryLimits (manager->qryManager,
+                                         CWM_PIPELINED_SYNC_CHUNK_SIZE,
+                                         CWM_PIPELINED_SYNC_IN_FLIGHT_LIMIT);
+
+    // connect; wait for the sync to stop, with every payment recovered, then for the client to
+    // answer any requests left; disconnect
+    struct timeval start;
+    gettimeofday (&start, NULL);
+
+    wkWalletManagerConnect (manager, NULL);
+
+    BRArrayOf(WKTransfer) recovered;
+    array_new (recovered, CWM_PIPELINED_SYNC_PAYMENT_COUNT);
+
+    bool stopped = false;
+    for (size_t wait = 0; wait < 1000 && (!stopped || array_count (recovered) < CWM_PIPELINED_SYNC_PAYMENT_COUNT); wait++) {
+        usleep (10000);
+
+        pthread_mutex_lock (&state.lock);
+        array_clear (recovered);
+        for (size_t index = 0; index < array_count (state.events); index++) {
+            CWMEvent *event = state.events[index];
+            if (SYNC_EVENT_WALLET_MANAGER_TYPE == event->type &&
+                WK_WALLET_MANAGER_EVENT_SYNC_STOPPED == event->u.m.event.type)
+                stopped = true;
+            if (SYNC_EVENT_TXN_TYPE == event->type &&
+                WK_TRANSFER_EVENT_CREATED == event->u.t.event.type)
+                array_add (recovered, event->u.t.transfer);
+        }
+        pthread_mutex_unlock (&state.lock);
+    }
+
+    struct timeval end;
+    gettimeofday (&end, NULL);
+
+    for (size_t wait = 0; wait < 100; wait++) {
+        pthread_mutex_lock (&clientState->lock);
+        size_t inFlight = clientState->inFlight;
+        pthread_mutex_unlock (&clientState->lock);
+
+        if (0 == inFlight) break;
+        usleep (10000);
+    }
+
+    wkWalletManagerDisconnect (manager);
+    wkWalletManagerStop (manager);
+
+    pthread_mutex_lock (&clientState->lock);
+    printf("    %zu requests, at most %zu in flight, synced in %.2f s\n",
+           clientState->requests, clientState->maxInFlight,
+           ((double) (end.tv_sec  - start.tv_sec) +
+            (double) (end.tv_usec - start.tv_usec) / 1000000.0));
+
+    // Verification; every payment is recovered, lowest block first, though the later ones are
+    // found only in the windows requested once the earlier ones were recovered
+    if (!stopped || CWM_PIPELINED_SYNC_PAYMENT_COUNT != array_count (recovered)) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: %zu of %zu payments recovered, sync %s\n", __func__, __LINE__,
+                array_count (recovered), CWM_PIPELINED_SYNC_PAYMENT_COUNT, (stopped ? "stopped" : "running"));
+    }
+
+    WKBlockNumber recoveredBlockNumber = 0;
+    for (size_t index = 0; index < array_count (recovered); index++) {
+        WKBlockNumber blockNumber = 0;
+        WKTransferState transferState = wkTransferGetState (recovered[index]);
+        wkTransferStateExtractIncluded (transferState, &blockNumber, NULL, NULL, NULL, NULL, NULL);
+        wkTransferStateGive (transferState);
+
+        if (blockNumber <= recoveredBlockNumber) {
+            success = 0;
+            fprintf(stderr, "***FAILED*** %s:%d: payment %zu recovered in block %"PRIu64", after %"PRIu64"\n", __func__, __LINE__,
+                    index, blockNumber, recoveredBlockNumber);
+        }
+        recoveredBlockNumber = blockNumber;
+    }
+
+    // The gap window past the last payment was requested, speculatively, and nothing beyond it
+    for (size_t index = 0; index < CWM_PIPELINED_SYNC_ADDRESS_COUNT; index++)
+        if (clientState->requested[index] != (index <= CWM_PIPELINED_SYNC_LAST_INDEX)) {
+            success = 0;
+            fprintf(stderr, "***FAILED*** %s:%d: receive address %zu %srequested\n", __func__, __LINE__,
+                    index, (clientState->requested[index] ? "" : "not "));
+            break;
+        }
+
+    // The recovery kept exactly the in-flight limit of requests outstanding, each no larger than a
+    // chunk, and every request was answered
+    if (clientState->maxInFlight != CWM_PIPELINED_SYNC_IN_FLIGHT_LIMIT) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: %zu requests in flight, expected %d\n", __func__, __LINE__, clientState->maxInFlight, CWM_PIPELINED_SYNC_IN_FLIGHT_LIMIT);
+    }
+
+    if (clientState->maxAddressCount > CWM_PIPELINED_SYNC_CHUNK_SIZE) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: %zu addresses in one request\n", __func__, __LINE__, clientState->maxAddressCount);
+    }
+
+    if (0 != clientState->inFlight) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: %zu requests unanswered\n", __func__, __LINE__, clientState->inFlight);
+    }
+    pthread_mutex_unlock (&clientState->lock);
+
+    // Test teardown; the recovered transactions were saved, so are wiped before the next test
+    array_free (recovered);
+    wkNetworkSetHeight (network, originalNetworkHeight);
+    wkWalletManagerGive (manager);
+    wkWalletManagerWipe (network, storagePath);
+    CWMEventRecordingStateFree (&state);
+    pthread_mutex_destroy (&clientState->lock);
+    free (clientState);
+
+    return success;
+}
+
+///
+/// Mark: Wallet Sweeper Tests
+///
+
+static WKKey
+sweeperTestsKey (uint32_t seed) {
+    WKSecret secret = { { 0 } };
+    UInt32SetBE (&secret.data[28], seed);
+    secret.data[0] = 0x3c;
+    return wkKeyCreateFromSecret (secret);
+}
+
+// A transaction spending `spentHash:spentIndex` and paying `amount` to each of `pkhs`, as a
+// bundle; the transaction's hash is filled into `txHash`.
+static WKClientTransactionBundle
+sweeperTestsBundle (UInt256 spentHash,
+                    uint32_t spentIndex,
+                    const UInt160 *pkhs,
+                    size_t pkhsCount,
+                    uint64_t amount,
+                    UInt256 *txHash) {
+    BRBitcoinTransaction *transaction = btcTransactionNew ();
+    btcTransactionAddInput (transaction, spentHash, spentIndex, 0, NULL, 0, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+
+    uint8_t script[25] = { OP_DUP, OP_HASH160, 20 };
+    script[23] = OP_EQUALVERIFY;
+    script[24] = OP_CHECKSIG;
+
+    for (size_t index = 0; index < pkhsCount; index++) {
+        memcpy (&script[3], pkhs[index].u8, sizeof (UInt160));
+        btcTransactionAddOutput (transaction, amount, script, sizeof (script));
+    }
+
+    size_t   bytesCount = btcTransactionSerialize (transaction, NULL, 0);
+    uint8_t *bytes      = malloc (bytesCount);
+    btcTransactionSerialize (transaction, bytes, bytesCount);
+    btcTransactionFree (transaction);
+
+    transaction = btcTransactionParse (bytes, bytesCount);
+    *txHash = transaction->txHash;
+    btcTransactionFree (transaction);
+
+    WKClientTransactionBundle bundle =
+    wkClientTransactionBundleCreate (WK_TRANSFER_STATE_INCLUDED, bytes, bytesCount, 1600000000, 100);
+
+    free (bytes);
+    return bundle;
+}
+
+static void
+sweeperTestsAddBundle (WKWalletSweeper sweeper,
+                       OwnershipGiven WKClientTransactionBundle bundle) {
+    WKWalletSweeperStatus status = wkWalletSweeperAddTransactionFromBundle (sweeper, bundle);
+    assert (WK_WALLET_SWEEPER_SUCCESS == status);
+    wkClientTransactionBundleRelease (bundle);
+}
+
+static uint64_t
+sweeperTestsBalance (WKWalletSweeper sweeper) {
+    WKBoolean overflow;
+    WKAmount  balance = wkWalletSweeperGetBalance (sweeper);
+    uint64_t  value   = wkAmountGetIntegerRaw (balance, &overflow);
+    assert (WK_FALSE == overflow);
+    wkAmountGive (balance);
+    return value;
+}
+
+#define SWEEPER_TESTS_UTXO_COUNT        (1000)
+
+static int
+runWalletKitWalletSweeperTest (WKAccount account,
+                               WKNetwork network,
+                               WKAddressScheme scheme,
+                               const char *storagePath) {
+    int success = 1;
+
+    printf("Testing WKWalletSweeper for network=\"%s (%s)\" and path=\"%s\"...\n",
+           wkNetworkGetName (network),
+           wkNetworkIsMainnet (network) ? "mainnet" : "testnet",
+           storagePath);
+
+    // Test setup
+    CWMEventRecordingState state = {0};
+    CWMEventRecordingStateNewDefault (&state);
+
+    WKWalletManager manager = wkWalletManagerSetupForLifecycleTest (&state,
+                                                                    account,
+                                                                    network,
+                                                                    WK_SYNC_MODE_API_ONLY,
+                                                                    scheme,
+                                                                    storagePath);
+    WKWallet wallet = wkWalletManagerGetWallet (manager);
+
+    WKKey keys[3] = { sweeperTestsKey (1), sweeperTestsKey (2), sweeperTestsKey (3) };
+    UInt160 pkhs[3], other = UINT160_ZERO;
+    for (size_t index = 0; index < 3; index++)
+        pkhs[index] = BRKeyHash160 (wkKeyGetCore (keys[index]));
+
+    WKWalletSweeper sweeper = wkWalletManagerCreateWalletSweeper (manager, wallet, keys[0]);
+    UInt256 hashA, hashB, hashC, hashD, hashE, hashF;
+
+    // A key without its secret is refused; a key already swept is not added twice
+    char *publicKeyString = wkKeyEncodePublic (keys[1]);
+    WKKey publicKey = wkKeyCreateFromStringPublic (publicKeyString);
+
+    if (WK_WALLET_SWEEPER_INVALID_KEY != wkWalletSweeperAddKey (sweeper, manager, wallet, publicKey) ||
+        WK_WALLET_SWEEPER_SUCCESS     != wkWalletSweeperAddKey (sweeper, manager, wallet, keys[1])   ||
+        WK_WALLET_SWEEPER_SUCCESS     != wkWalletSweeperAddKey (sweeper, manager, wallet, keys[1])   ||
+        2 != wkWalletSweeperGetKeyCount (sweeper)) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: %zu keys\n", __func__, __LINE__, wkWalletSweeperGetKeyCount (sweeper));
+    }
+
+    wkKeyGive (publicKey);
+    free (publicKeyString);
+
+    // B, spending A:0, is added before A; only A:1 is left
+    WKClientTransactionBundle bundleA = sweeperTestsBundle (UINT256_ZERO, 0, pkhs, 2, 100000, &hashA);
+    sweeperTestsAddBundle (sweeper, sweeperTestsBundle (hashA, 0, &other, 1, 90000, &hashB));
+    sweeperTestsAddBundle (sweeper, bundleA);
+
+    if (100000 != sweeperTestsBalance (sweeper)) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: balance %"PRIu64" after an early spend\n", __func__, __LINE__, sweeperTestsBalance (sweeper));
+    }
+
+    // C pays the third key before it is added
+    sweeperTestsAddBundle (sweeper, sweeperTestsBundle (UINT256_ZERO, 1, &pkhs[2], 1, 50000, &hashC));
+
+    if (100000 != sweeperTestsBalance (sweeper) ||
+        WK_WALLET_SWEEPER_SUCCESS != wkWalletSweeperAddKey (sweeper, manager, wallet, keys[2]) ||
+        150000 != sweeperTestsBalance (sweeper)) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: balance %"PRIu64" after a late key\n", __func__, __LINE__, sweeperTestsBalance (sweeper));
+    }
+
+    // D spends C:0, which stays spent when C is added again
+    sweeperTestsAddBundle (sweeper, sweeperTestsBundle (hashC, 0, &other, 1, 40000, &hashD));
+    sweeperTestsAddBundle (sweeper, sweeperTestsBundle (UINT256_ZERO, 1, &pkhs[2], 1, 50000, &hashC));
+
+    if (100000 != sweeperTestsBalance (sweeper)) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: balance %"PRIu64" after a duplicate\n", __func__, __LINE__, sweeperTestsBalance (sweeper));
+    }
+
+    // E spends nothing of the sweeper's; F pays the first key more outputs than fit in one transaction
+    sweeperTestsAddBundle (sweeper, sweeperTestsBundle (hashD, 0, &other, 1, 30000, &hashE));
+
+    UInt160 *fPKHs = calloc (SWEEPER_TESTS_UTXO_COUNT, sizeof (UInt160));
+    for (size_t index = 0; index < SWEEPER_TESTS_UTXO_COUNT; index++) fPKHs[index] = pkhs[0];
+    sweeperTestsAddBundle (sweeper, sweeperTestsBundle (hashE, 0, fPKHs, SWEEPER_TESTS_UTXO_COUNT, 10000, &hashF));
+    free (fPKHs);
+
+    uint64_t balance = sweeperTestsBalance (sweeper);
+    if (100000 + SWEEPER_TESTS_UTXO_COUNT * 10000 != balance) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: balance %"PRIu64"\n", __func__, __LINE__, balance);
+    }
+
+    // The sweep is split into transactions under TX_MAX_SIZE, largest outputs first, that together
+    // spend every output
+    WKFeeBasis feeBasis = wkFeeBasisCreateAsBTC (wallet->unitForFee, WK_FEE_BASIS_BTC_FEE_UNKNOWN, 10000, 1000);
+
+    // A single transfer, signed with the sweeper's own key only, can't sweep the added keys
+    WKTransfer transfer = wkWalletSweeperCreateTransferForWalletSweep (sweeper, manager, wallet, feeBasis);
+    if (NULL != transfer) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: single transfer for %zu keys\n", __func__, __LINE__, wkWalletSweeperGetKeyCount (sweeper));
+        wkTransferGive (transfer);
+    }
+
+    size_t transfersCount = 0, inputsCount = 0;
+    uint64_t inputsAmount = 0, outputsAmount = 0;
+    WKTransfer *transfers = wkWalletSweeperCreateTransfersForWalletSweep (sweeper, manager, wallet, feeBasis, &transfersCount);
+
+    for (size_t index = 0; index < transfersCount; index++) {
+        BRBitcoinTransaction *transaction = wkTransferAsBTC (transfers[index]);
+
+        if (1 != transaction->outCount ||
+            (0 == index && 100000 != transaction->inputs[0].amount) ||
+            transaction->inCount * TX_INPUT_SIZE > TX_MAX_SIZE) {
+            success = 0;
+            fprintf(stderr, "***FAILED*** %s:%d: transaction %zu of %zu\n", __func__, __LINE__, index, transfersCount);
+        }
+
+        for (size_t input = 0; input < transaction->inCount; input++)
+            inputsAmount += transaction->inputs[input].amount;
+        inputsCount   += transaction->inCount;
+        outputsAmount += transaction->outputs[0].amount;
+
+        wkTransferGive (transfers[index]);
+    }
+    free (transfers);
+
+    if (transfersCount < 2 ||
+        1 + SWEEPER_TESTS_UTXO_COUNT != inputsCount ||
+        balance != inputsAmount ||
+        outputsAmount >= inputsAmount) {
+        success = 0;
+        fprintf(stderr, "***FAILED*** %s:%d: %zu inputs in %zu transactions\n", __func__, __LINE__, inputsCount, transfersCount);
+    }
+
+    // Test teardown
+    wkFeeBasisGive (feeBasis);
+    wkWalletSweeperRelease (sweeper);
+    for (size_t index = 0; index < 3; index++) wkKeyGive (keys[index]);
+    wkWalletGive (wallet);
+    wkWalletManagerStop (manager);
+    wkWalletManagerGive (manager);
+    CWMEventRecordingStateFree (&state);
+
+    return success;
+}
+
+// Sweep `keysCount` keys, each funded by three transactions, one of which is spent by a fourth:
+// adding every key, adding every transaction, in an order that has spends seen before the
+// outputs they spend, and reading the balance.
+extern void
+runPerfTestsWalletSweeper (size_t keysCount) {
+    WKCurrency currency = wkCurrencyCreate ("bitcoin-mainnet:__native__", "Bitcoin", "btc", "native", NULL);
+    WKUnit unit = wkUnitCreateAsBase (currency, "sat", "SAT", "SAT");
+
+    WKKey *keys = calloc (keysCount, sizeof (WKKey));
+    UInt160 *pkhs = calloc (keysCount, sizeof (UInt160)), other = UINT160_ZERO;
+    WKClientTransactionBundle *bundles = calloc (4 * keysCount, sizeof (WKClientTransactionBundle));
+
+    for (size_t index = 0; index < keysCount; index++) {
+        keys[index] = sweeperTestsKey ((uint32_t) (index + 1));
+        pkhs[index] = BRKeyHash160 (wkKeyGetCore (keys[index]));
+
+        UInt256 hashes[3], spent = UINT256_ZERO;
+        for (size_t funding = 0; funding < 3; funding++) {
+            UInt32SetLE (&spent.u8[0], (uint32_t) (3 * index + funding));
+            bundles[4 * index + 1 + funding] = sweeperTestsBundle (spent, 0, &pkhs[index], 1, 100000, &hashes[funding]);
+        }
+        bundles[4 * index] = sweeperTestsBundle (hashes[0], 0, &other, 1, 90000, &spent);
+    }
+
+    // As wkWalletManagerCreateWalletSweeperBTC() would, without a wallet manager
+    WKWalletSweeper sweeper = wkWalletSweeperAllocAndInit (sizeof (struct WKWalletSweeperBTCRecord),
+                                                           WK_NETWORK_TYPE_BTC,
+                                                           keys[0],
+                                                           unit);
+    WKWalletSweeperBTC sweeperBTC = (WKWalletSweeperBTC) sweeper;
+    sweeperBTC->addrParams    = btcChainParams (true)->addrParams;
+    sweeperBTC->sourceAddress = strdup ("");
+    array_new (sweeperBTC->txns, 100);
+    wkWalletSweeperInitIndexesBTC (sweeperBTC, keys[0]);
+
+    struct timespec beg, mid1, mid2, end;
+    clock_gettime (CLOCK_MONOTONIC, &beg);
+    for (size_t index = 1; index < keysCount; index++)
+        sweeper->handlers->addKey (sweeper, keys[index]);
+    clock_gettime (CLOCK_MONOTONIC, &mid1);
+
+    for (size_t index = 0; index < 4 * keysCount; index++)
+        wkWalletSweeperAddTransactionFromBundle (sweeper, bundles[index]);
+    clock_gettime (CLOCK_MONOTONIC, &mid2);
+
+    uint64_t balance = sweeperTestsBalance (sweeper);
+    clock_gettime (CLOCK_MONOTONIC, &end);
+
+    assert (200000 * keysCount == balance);
+
+    printf ("sweeper: %zu keys: %.2f us/key added, %.2f us/transaction added, %.2f ms balance\n",
+            keysCount,
+            1e6 * ((mid1.tv_sec - beg.tv_sec)  + (mid1.tv_nsec - beg.tv_nsec)  / 1e9) / keysCount,
+            1e6 * ((mid2.tv_sec - mid1.tv_sec) + (mid2.tv_nsec - mid1.tv_nsec) / 1e9) / (4 * keysCount),
+            1e3 * ((end.tv_sec  - mid2.tv_sec) + (end.tv_nsec  - mid2.tv_nsec) / 1e9));
+
+    wkWalletSweeperRelease (sweeper);
+    for (size_t index = 0; index < 4 * keysCount; index++) wkClientTransactionBundleRelease (bundles[index]);
+    for (size_t index = 0; index < keysCount; index++) wkKeyGive (keys[index]);
+    free (bundles); free (pkhs); free (keys);
+    wkUnitGive (unit);
+    wkCurrencyGive (currency);
+}
+
 ///
 /// Mark: Entrypoints
 ///
@@ -1538,6 +3080,39 @@ runWalletKitTestsWithAccountAndNetwork (WKAccount account,
         }
     }
 
+    if (isBtc) {
+        success = AS_WK_BOOLEAN(runWalletKitWalletManagerPagedSyncTest (account,
+                                                                        network,
+                                                                        scheme,
+                                                                        storagePath));
+        if (!success) {
+            fprintf(stderr, "***FAILED*** %s:%d: failed\n", __func__, __LINE__);
+            return success;
+        }
+    }
+
+    if (isBtc) {
+        success = AS_WK_BOOLEAN(runWalletKitWalletManagerPipelinedSyncTest (account,
+                                                                            network,
+                                                                            scheme,
+                                                                            storagePath));
+        if (!success) {
+            fprintf(stderr, "***FAILED*** %s:%d: failed\n", __func__, __LINE__);
+            return success;
+        }
+    }
+
+    if (isBtc) {
+        success = AS_WK_BOOLEAN(runWalletKitWalletSweeperTest (account,
+                                                               network,
+                                                               scheme,
+                                                               storagePath));
+        if (!success) {
+            fprintf(stderr, "***FAILED*** %s:%d: failed\n", __func__, __LINE__);
+            return success;
+        }
+    }
+
     if (isBtc || isBch || isBsv || isEth) {
         success = AS_WK_BOOLEAN(runWalletKitWalletManagerLifecycleTest (account,
                                                                         network,
@@ -1617,5 +3192,8 @@ extern void
 runWalletKitTests (void) {
     runWalletKitAmountTests ();
     runWalletKitTransferTests();
+    runWalletKitStringInternTests();
+    runWalletKitCipherTests();
+    runWalletKitClientBundleTests();
     return;
 }
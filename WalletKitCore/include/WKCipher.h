@@ -64,6 +64,46 @@ wkCipherDecrypt (WKCipher cipher,
                  const uint8_t *ciphertext,
                  size_t ciphertextLen);
 
+/**
+ * Encrypt `count` plaintexts with a Chacha20Poly1305 or Pigeon cipher, the i-th using the 12 byte
+ * nonce at `nonces + 12 * i` in place of the cipher's own.  The key is derived once for the whole
+ * batch.  Each ciphertext needs `wkCipherEncryptLength()` bytes.
+ *
+ * @return WK_TRUE if every plaintext was encrypted
+ */
+extern WKBoolean
+wkCipherEncryptBatch (WKCipher cipher,
+                      const uint8_t *nonces,
+                      uint8_t *ciphertexts[],
+                      const size_t ciphertextLens[],
+                      const uint8_t *plaintexts[],
+                      const size_t plaintextLens[],
+                      size_t count);
+
+/**
+ * Decrypt `count` ciphertexts with a Chacha20Poly1305 or Pigeon cipher, the i-th using the 12 byte
+ * nonce at `nonces + 12 * i` in place of the cipher's own.  Each plaintext needs
+ * `wkCipherDecryptLength()` bytes.
+ *
+ * @return WK_TRUE if every ciphertext was authenticated and decrypted
+ */
+extern WKBoolean
+wkCipherDecryptBatch (WKCipher cipher,
+                      const uint8_t *nonces,
+                      uint8_t *plaintexts[],
+                      const size_t plaintextLens[],
+                      const uint8_t *ciphertexts[],
+                      const size_t ciphertextLens[],
+                      size_t count);
+
+/**
+ * Wipe the shared keys that Pigeon ciphers keep for the most recently used key pairs, such as when
+ * the account's keys are no longer in use.  The cache holds at most 16 and wipes a key when it is
+ * evicted.
+ */
+extern void
+wkCipherPigeonCacheClear (void);
+
 extern WKBoolean
 wkCipherMigrateBRCoreKeyCiphertext (WKCipher cipher,
                                     uint8_t *migratedCiphertext,
@@ -131,6 +131,24 @@ wkClientAnnounceTransactions (OwnershipKept WKWalletManager cwm,
                               WKClientTransactionBundle *bundles,
                               size_t bundlesCount);
 
+/**
+ * Announce one page of the bundles for a `...GetTransactionsCallback` request.  A client may
+ * announce a request's results as a sequence of pages, each with the request's `callbackState`,
+ * as they are downloaded; every page is saved as it arrives and its bundles are then recovered,
+ * in block order, along with those of the sync's other requests and pages.  The pages must be
+ * announced in ascending block order, though a page's bundles may be in any order: a bundle is
+ * recovered once no request can still announce one in a lower block.  All but the last page
+ * have `more` as WK_TRUE.  The `callbackState` is given with the last page, or with any page where
+ * `success` is WK_FALSE, after which it must not be used.
+ */
+extern void
+wkClientAnnounceTransactionsPage (OwnershipKept WKWalletManager cwm,
+                                  WKClientCallbackState callbackState,
+                                  WKBoolean success,
+                                  WKBoolean more,
+                                  WKClientTransactionBundle *bundles,
+                                  size_t bundlesCount);
+
 // MARK: - Get Transfers
 
 /**
@@ -227,6 +245,30 @@ wkClientAnnounceTransfers (OwnershipKept WKWalletManager cwm,
                            WKClientTransferBundle *bundles,
                            size_t bundlesCount);
 
+/**
+ * Announce one page of the transfer bundles for a `...GetTransfersCallback` request.  See
+ * `wkClientAnnounceTransactionsPage()` for the handling of `more` and `callbackState`.
+ */
+extern void
+wkClientAnnounceTransfersPage (OwnershipKept WKWalletManager cwm,
+                               WKClientCallbackState callbackState,
+                               WKBoolean success,
+                               WKBoolean more,
+                               WKClientTransferBundle *bundles,
+                               size_t bundlesCount);
+
+/**
+ * Announce the transfers for a `...GetTransfersCallback` request as the unparsed JSON response of
+ * `GET /transactions?include_transfers=true`.  The JSON is parsed, the transfers merged with their
+ * fees and the transfer bundles created, all without any per-transfer marshalling by the client.
+ * If `bytes` is NULL or is not a valid response, then the request is announced as failed.
+ */
+extern void
+wkClientAnnounceTransfersJSON (OwnershipKept WKWalletManager cwm,
+                               OwnershipGiven WKClientCallbackState callbackState,
+                               OwnershipKept const uint8_t *bytes,
+                               size_t bytesCount);
+
 // MARK: - Submit Transaction
 
 /**
@@ -45,6 +45,24 @@ extern WKWalletSweeperStatus
 wkWalletSweeperAddTransactionFromBundle (WKWalletSweeper sweeper,
                                          OwnershipKept WKClientTransactionBundle bundle);
 
+/**
+ * Add another key to sweep along with the sweeper's own key.  Transactions already added are
+ * searched for outputs paying the key; transactions added later are matched against every key.
+ * Keys may be added before or after transactions.  The key is validated as for
+ * `wkWalletManagerWalletSweeperValidateSupported()`; notably, a key of `wallet` itself is refused.
+ */
+extern WKWalletSweeperStatus
+wkWalletSweeperAddKey (WKWalletSweeper sweeper,
+                       WKWalletManager manager,
+                       WKWallet wallet,
+                       OwnershipKept WKKey key);
+
+/**
+ * Return the number of keys being swept, including the sweeper's own key.
+ */
+extern size_t
+wkWalletSweeperGetKeyCount (WKWalletSweeper sweeper);
+
 extern void
 wkWalletManagerEstimateFeeBasisForWalletSweep (WKWalletSweeper sweeper,
                                                WKWalletManager manager,
@@ -52,12 +70,40 @@ wkWalletManagerEstimateFeeBasisForWalletSweep (WKWalletSweeper sweeper,
                                                WKCookie cookie,
                                                WKNetworkFee fee);
 
+/**
+ * Create a single transfer sweeping the sweeper's own key, to be signed with that key.  Returns
+ * NULL if the funds can't be swept or if keys were added with `wkWalletSweeperAddKey()`; use
+ * `wkWalletSweeperCreateTransfersForWalletSweep()` for those.
+ */
 extern WKTransfer
 wkWalletSweeperCreateTransferForWalletSweep (WKWalletSweeper sweeper,
                                              WKWalletManager manager,
                                              WKWallet wallet,
                                              WKFeeBasis estimatedFeeBasis);
 
+/**
+ * Create the transfers that together sweep every key.  Funds from many keys may not fit in a
+ * single transaction; the estimated fee basis from `wkWalletManagerEstimateFeeBasisForWalletSweep`
+ * covers all of the transfers.  Returns NULL, with `count` of zero, if the funds can't be swept.
+ *
+ * The transfers are signed and submitted with `wkWalletManagerSubmitForWalletSweep`.
+ */
+extern OwnershipGiven WKTransfer *
+wkWalletSweeperCreateTransfersForWalletSweep (WKWalletSweeper sweeper,
+                                              WKWalletManager manager,
+                                              WKWallet wallet,
+                                              WKFeeBasis estimatedFeeBasis,
+                                              size_t *count);
+
+/**
+ * Sign `transfer`, created by `sweeper`, with each key that it spends from and submit it.
+ */
+extern void
+wkWalletManagerSubmitForWalletSweep (WKWalletSweeper sweeper,
+                                     WKWalletManager manager,
+                                     WKWallet wallet,
+                                     WKTransfer transfer);
+
 extern WKKey
 wkWalletSweeperGetKey (WKWalletSweeper sweeper);
 
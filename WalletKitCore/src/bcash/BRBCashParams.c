@@ -102,7 +102,7 @@ static int bchMainNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const B
         if (aserti3_2d(ASERT_REF_BITS, timeDelta, heightDelta) != block->target) return 0;
     }
 
-    return btcMerkleBlockVerifyProofOfWork(block);
+    return 1; // proof-of-work is checked by the peer
 }
 
 static int bchTestNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRSet *blockSet)
@@ -116,6 +116,7 @@ static BRBitcoinChainParams bchMainNetParamsRecord = {
     0xe8f3e1e3,          // magicNumber
     SERVICES_NODE_BCASH, // services
     bchMainNetVerifyDifficulty,
+    btcMerkleBlockVerifyProofOfWork,
     NULL,
     0,
     { BITCOIN_PUBKEY_PREFIX, BITCOIN_SCRIPT_PREFIX, BITCOIN_PRIVKEY_PREFIX, NULL },
@@ -131,6 +132,7 @@ static BRBitcoinChainParams bchTestNetParamsRecord = {
     SERVICES_NODE_BCASH, // services
     bchTestNetVerifyDifficulty,
     NULL,
+    NULL,
     0,
     { BITCOIN_PUBKEY_PREFIX_TEST, BITCOIN_SCRIPT_PREFIX_TEST, BITCOIN_PRIVKEY_PREFIX_TEST, NULL },
     BCASH_FORKID,
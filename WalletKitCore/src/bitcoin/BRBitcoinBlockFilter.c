@@ -0,0 +1,361 @@
+//
+//  BRBitcoinBlockFilter.c
+//
+//  Copyright (c) 2021 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "BRBitcoinBlockFilter.h"
+#include "support/BRCrypto.h"
+#include "support/BRAddress.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define BLOCK_FILTER_MATCH_THREADS    4  // max worker threads used by btcBlockFilterMatchAnyBatch()
+#define BLOCK_FILTER_MATCH_MIN_FILTERS 64 // don't spawn a thread for fewer filters than this
+
+// high 64 bits of the 128 bit product x*y
+inline static uint64_t _mulHigh64(uint64_t x, uint64_t y)
+{
+#if defined(__SIZEOF_INT128__)
+    return (uint64_t)(((unsigned __int128)x*y) >> 64);
+#else
+    uint64_t xl = x & 0xffffffff, xh = x >> 32, yl = y & 0xffffffff, yh = y >> 32,
+             m = (xl*yl >> 32) + (xh*yl & 0xffffffff) + xl*yh;
+
+    return xh*yh + (xh*yl >> 32) + (m >> 32);
+#endif
+}
+
+// maps item uniformly into the range [0, f) using a siphash keyed by the first 16 bytes of the block hash
+inline static uint64_t _btcBlockFilterHashToRange(UInt256 blockHash, const uint8_t *item, size_t itemLen, uint64_t f)
+{
+    return _mulHigh64(BRSip64(blockHash.u8, item, itemLen), f);
+}
+
+inline static int _uint64Compare(const void *a, const void *b)
+{
+    return (*(const uint64_t *)a < *(const uint64_t *)b) ? -1 : (*(const uint64_t *)a > *(const uint64_t *)b);
+}
+
+typedef struct {
+    uint8_t *data;
+    size_t len, bit;
+} _BRBitWriter;
+
+static void _BRBitWriterWrite(_BRBitWriter *w, uint64_t value, int bits) // writes the low bits of value, msb first
+{
+    while (bits > 0) {
+        size_t i = w->bit/8;
+        int room = 8 - (int)(w->bit % 8), n = (bits < room) ? bits : room;
+
+        if (i >= w->len) {
+            w->len = (w->len + 1)*2;
+            w->data = realloc(w->data, w->len);
+            assert(w->data != NULL);
+            memset(&w->data[i], 0, w->len - i);
+        }
+
+        w->data[i] |= (uint8_t)(((value >> (bits - n)) & ((1u << n) - 1)) << (room - n));
+        w->bit += (size_t)n;
+        bits -= n;
+    }
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t len, bit;
+} _BRBitReader;
+
+// reads bits msb first, returns UINT64_MAX if the end of data is reached
+static uint64_t _BRBitReaderRead(_BRBitReader *r, int bits)
+{
+    uint64_t value = 0;
+
+    if (r->bit + (size_t)bits > r->len*8) return UINT64_MAX;
+
+    while (bits > 0) {
+        int avail = 8 - (int)(r->bit % 8), n = (bits < avail) ? bits : avail;
+
+        value = (value << n) | ((r->data[r->bit/8] >> (avail - n)) & ((1u << n) - 1));
+        r->bit += (size_t)n;
+        bits -= n;
+    }
+
+    return value;
+}
+
+// reads the next golomb-rice coded delta, returns UINT64_MAX if the end of data is reached
+static uint64_t _BRBitReaderReadGolombRice(_BRBitReader *r)
+{
+    uint64_t q = 0, b;
+
+    while ((b = _BRBitReaderRead(r, 1)) == 1) q++;
+    if (b == UINT64_MAX) return UINT64_MAX;
+    b = _BRBitReaderRead(r, BLOCK_FILTER_BASIC_P);
+    return (b == UINT64_MAX) ? UINT64_MAX : (q << BLOCK_FILTER_BASIC_P) | b;
+}
+
+typedef struct {
+    uint64_t hash;
+    size_t index;
+} _BRBlockFilterItem;
+
+inline static int _btcBlockFilterItemCompare(const void *a, const void *b)
+{
+    return _uint64Compare(&((const _BRBlockFilterItem *)a)->hash, &((const _BRBlockFilterItem *)b)->hash);
+}
+
+// returns a newly allocated basic filter for the given items (scriptPubKeys) that must be freed by calling
+// btcBlockFilterFree(), empty and duplicate items are ignored
+BRBitcoinBlockFilter *btcBlockFilterNew(UInt256 blockHash, const uint8_t *items[], const size_t itemLens[],
+                                        size_t itemsCount)
+{
+    BRBitcoinBlockFilter *filter = calloc(1, sizeof(*filter));
+    _BRBlockFilterItem *sorted = malloc((itemsCount + 1)*sizeof(*sorted));
+    uint64_t f, value, last = 0;
+    size_t i, j, k, n = 0;
+    _BRBitWriter w = { NULL, 0, 0 };
+
+    assert(filter != NULL);
+    assert(sorted != NULL);
+    assert(items != NULL || itemsCount == 0);
+    assert(itemLens != NULL || itemsCount == 0);
+    filter->blockHash = blockHash;
+
+    for (i = 0; i < itemsCount; i++) {
+        if (itemLens[i] > 0) sorted[n++] = (_BRBlockFilterItem) { BRSip64(blockHash.u8, items[i], itemLens[i]), i };
+    }
+
+    // sorting by siphash puts duplicate items next to each other, and since mapping a hash into the filter range is
+    // monotonic, the final set values come out already sorted
+    qsort(sorted, n, sizeof(*sorted), _btcBlockFilterItemCompare);
+
+    for (i = 0, j = 0; i < n; i++) {
+        for (k = j; k > 0 && sorted[k - 1].hash == sorted[i].hash; k--) {
+            if (itemLens[sorted[k - 1].index] == itemLens[sorted[i].index] &&
+                memcmp(items[sorted[k - 1].index], items[sorted[i].index], itemLens[sorted[i].index]) == 0) break;
+        }
+
+        if (k == 0 || sorted[k - 1].hash != sorted[i].hash) sorted[j++] = sorted[i]; // not a duplicate
+    }
+
+    n = j;
+    f = (uint64_t)n*BLOCK_FILTER_BASIC_M;
+
+    for (i = 0; i < n; i++) {
+        value = _mulHigh64(sorted[i].hash, f);
+
+        for (j = (size_t)((value - last) >> BLOCK_FILTER_BASIC_P); j > 0; j--) _BRBitWriterWrite(&w, 1, 1);
+        _BRBitWriterWrite(&w, 0, 1);
+        _BRBitWriterWrite(&w, value - last, BLOCK_FILTER_BASIC_P);
+        last = value;
+    }
+
+    free(sorted);
+    filter->n = (uint32_t)n;
+    filter->dataLen = (w.bit + 7)/8;
+    filter->data = (w.data) ? realloc(w.data, filter->dataLen) : NULL;
+    return filter;
+}
+
+// buf must contain a serialized basic filter for the block with the given hash
+// returns a block filter struct that must be freed by calling btcBlockFilterFree()
+BRBitcoinBlockFilter *btcBlockFilterParse(UInt256 blockHash, const uint8_t *buf, size_t bufLen)
+{
+    BRBitcoinBlockFilter *filter = NULL;
+    size_t off = 0;
+    uint64_t n = (buf) ? BRVarInt(buf, bufLen, &off) : 0;
+
+    assert(buf != NULL || bufLen == 0);
+
+    if (off > 0 && off <= bufLen && n <= UINT32_MAX && (n == 0 || off < bufLen)) { // a truncated varint overruns bufLen
+        filter = calloc(1, sizeof(*filter));
+        assert(filter != NULL);
+        filter->blockHash = blockHash;
+        filter->n = (uint32_t)n;
+        filter->dataLen = bufLen - off;
+
+        if (filter->dataLen > 0) {
+            filter->data = malloc(filter->dataLen);
+            assert(filter->data != NULL);
+            memcpy(filter->data, &buf[off], filter->dataLen);
+        }
+    }
+
+    return filter;
+}
+
+// returns number of bytes written to buf, or total bufLen needed if buf is NULL
+size_t btcBlockFilterSerialize(const BRBitcoinBlockFilter *filter, uint8_t *buf, size_t bufLen)
+{
+    size_t off = 0, len = BRVarIntSize(filter->n) + filter->dataLen;
+
+    assert(filter != NULL);
+
+    if (buf && len <= bufLen) {
+        off += BRVarIntSet(&buf[off], bufLen - off, filter->n);
+        if (filter->dataLen > 0) memcpy(&buf[off], filter->data, filter->dataLen);
+    }
+
+    return (! buf || len <= bufLen) ? len : 0;
+}
+
+// double-sha256 of the serialized filter
+UInt256 btcBlockFilterHash(const BRBitcoinBlockFilter *filter)
+{
+    size_t len = btcBlockFilterSerialize(filter, NULL, 0);
+    uint8_t _buf[0x1000], *buf = (len <= sizeof(_buf)) ? _buf : malloc(len);
+    UInt256 hash;
+
+    assert(buf != NULL);
+    len = btcBlockFilterSerialize(filter, buf, len);
+    BRSHA256_2(&hash, buf, len);
+    if (buf != _buf) free(buf);
+    return hash;
+}
+
+// the filter header that commits to filterHash and all previous filters in the chain
+UInt256 btcBlockFilterHeader(UInt256 filterHash, UInt256 prevHeader)
+{
+    uint8_t buf[sizeof(UInt256)*2];
+    UInt256 header;
+
+    UInt256Set(buf, filterHash);
+    UInt256Set(&buf[sizeof(UInt256)], prevHeader);
+    BRSHA256_2(&header, buf, sizeof(buf));
+    return header;
+}
+
+// hashes and sorts the query items for filter, then walks the coded set and the query in step
+static int _btcBlockFilterMatchAny(const BRBitcoinBlockFilter *filter, const uint8_t *items[], const size_t itemLens[],
+                                   size_t itemsCount, uint64_t *query)
+{
+    _BRBitReader r = { filter->data, filter->dataLen, 0 };
+    uint64_t f = (uint64_t)filter->n*BLOCK_FILTER_BASIC_M, value = 0, delta;
+    size_t i, j = 0, count = 0;
+
+    if (filter->n == 0) return 0;
+
+    for (i = 0; i < itemsCount; i++) {
+        if (itemLens[i] > 0) query[count++] = _btcBlockFilterHashToRange(filter->blockHash, items[i], itemLens[i], f);
+    }
+
+    qsort(query, count, sizeof(*query), _uint64Compare);
+
+    for (i = 0; i < filter->n && j < count; i++) {
+        delta = _BRBitReaderReadGolombRice(&r);
+        if (delta == UINT64_MAX) break; // truncated filter
+        value += delta;
+        while (j < count && query[j] < value) j++;
+        if (j < count && query[j] == value) return 1;
+    }
+
+    return 0;
+}
+
+// true if any of the given items is matched by filter
+int btcBlockFilterMatchAny(const BRBitcoinBlockFilter *filter, const uint8_t *items[], const size_t itemLens[],
+                           size_t itemsCount)
+{
+    uint64_t _query[128], *query = (itemsCount <= 128) ? _query : malloc(itemsCount*sizeof(*query));
+    int r;
+
+    assert(filter != NULL);
+    assert(items != NULL || itemsCount == 0);
+    assert(itemLens != NULL || itemsCount == 0);
+    assert(query != NULL);
+    r = _btcBlockFilterMatchAny(filter, items, itemLens, itemsCount, query);
+    if (query != _query) free(query);
+    return r;
+}
+
+typedef struct {
+    BRBitcoinBlockFilter **filters;
+    size_t filtersCount;
+    const uint8_t **items;
+    const size_t *itemLens;
+    size_t itemsCount;
+    int *matched;
+    size_t matchedCount;
+} _BRBlockFilterMatchJob;
+
+static void *_btcBlockFilterMatchRoutine(void *arg)
+{
+    _BRBlockFilterMatchJob *job = arg;
+    uint64_t *query = malloc((job->itemsCount + 1)*sizeof(*query));
+
+    assert(query != NULL);
+
+    for (size_t i = 0; i < job->filtersCount; i++) {
+        job->matched[i] = _btcBlockFilterMatchAny(job->filters[i], job->items, job->itemLens, job->itemsCount, query);
+        if (job->matched[i]) job->matchedCount++;
+    }
+
+    free(query);
+    return NULL;
+}
+
+// matches the given items against each of the filters, spreading the work across several threads, and sets
+// matched[i] to true for each filter that matches any item
+// returns the number of filters matched
+size_t btcBlockFilterMatchAnyBatch(BRBitcoinBlockFilter *filters[], size_t filtersCount, const uint8_t *items[],
+                                   const size_t itemLens[], size_t itemsCount, int matched[])
+{
+    size_t i, threadCount = filtersCount/BLOCK_FILTER_MATCH_MIN_FILTERS, per, count = 0;
+
+    assert(filters != NULL || filtersCount == 0);
+    assert(matched != NULL || filtersCount == 0);
+    if (threadCount > BLOCK_FILTER_MATCH_THREADS) threadCount = BLOCK_FILTER_MATCH_THREADS;
+    if (threadCount < 1) threadCount = 1;
+    per = (filtersCount + threadCount - 1)/threadCount;
+
+    _BRBlockFilterMatchJob jobs[threadCount];
+    pthread_t threads[threadCount];
+    int started[threadCount];
+
+    for (i = 0; i < threadCount; i++) {
+        size_t start = i*per, end = (start + per < filtersCount) ? start + per : filtersCount;
+
+        jobs[i] = (_BRBlockFilterMatchJob) { &filters[start], (start < end) ? end - start : 0, items, itemLens,
+                                             itemsCount, &matched[start], 0 };
+        // the first chunk is matched on the calling thread, as is any chunk whose thread couldn't be created
+        started[i] = (i > 0 && pthread_create(&threads[i], NULL, _btcBlockFilterMatchRoutine, &jobs[i]) == 0);
+    }
+
+    _btcBlockFilterMatchRoutine(&jobs[0]);
+
+    for (i = 1; i < threadCount; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else _btcBlockFilterMatchRoutine(&jobs[i]);
+    }
+
+    for (i = 0; i < threadCount; i++) count += jobs[i].matchedCount;
+    return count;
+}
+
+// frees memory allocated for filter
+void btcBlockFilterFree(BRBitcoinBlockFilter *filter)
+{
+    assert(filter != NULL);
+    if (filter->data) free(filter->data);
+    free(filter);
+}
@@ -0,0 +1,86 @@
+//
+//  BRBitcoinBlockFilter.h
+//
+//  Copyright (c) 2021 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef BRBlockFilter_h
+#define BRBlockFilter_h
+
+#include "support/BRInt.h"
+#include <stddef.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// compact block filters are explained in BIP158: https://github.com/bitcoin/bips/blob/master/bip-0158.mediawiki
+// and are served by peers as described in BIP157: https://github.com/bitcoin/bips/blob/master/bip-0157.mediawiki
+
+#define BLOCK_FILTER_TYPE_BASIC    0x00
+#define BLOCK_FILTER_BASIC_P       19     // golomb-rice coding parameter
+#define BLOCK_FILTER_BASIC_M       784931 // inverse false positive rate
+#define BLOCK_FILTER_MAX_CFILTERS  1000   // max filters a peer will return for a single getcfilters request
+#define BLOCK_FILTER_MAX_CFHEADERS 2000   // max filter hashes a peer will return for a single getcfheaders request
+
+typedef struct {
+    UInt256 blockHash;
+    uint32_t n; // number of items in the set
+    uint8_t *data; // golomb-rice coded set, not including the leading item count
+    size_t dataLen;
+} BRBitcoinBlockFilter;
+
+// returns a newly allocated basic filter for the given items (scriptPubKeys) that must be freed by calling
+// btcBlockFilterFree(), empty and duplicate items are ignored
+BRBitcoinBlockFilter *btcBlockFilterNew(UInt256 blockHash, const uint8_t *items[], const size_t itemLens[],
+                                        size_t itemsCount);
+
+// buf must contain a serialized basic filter for the block with the given hash
+// returns a block filter struct that must be freed by calling btcBlockFilterFree()
+BRBitcoinBlockFilter *btcBlockFilterParse(UInt256 blockHash, const uint8_t *buf, size_t bufLen);
+
+// returns number of bytes written to buf, or total bufLen needed if buf is NULL
+size_t btcBlockFilterSerialize(const BRBitcoinBlockFilter *filter, uint8_t *buf, size_t bufLen);
+
+// double-sha256 of the serialized filter
+UInt256 btcBlockFilterHash(const BRBitcoinBlockFilter *filter);
+
+// the filter header that commits to filterHash and all previous filters in the chain
+UInt256 btcBlockFilterHeader(UInt256 filterHash, UInt256 prevHeader);
+
+// true if any of the given items is matched by filter
+int btcBlockFilterMatchAny(const BRBitcoinBlockFilter *filter, const uint8_t *items[], const size_t itemLens[],
+                           size_t itemsCount);
+
+// matches the given items against each of the filters, spreading the work across several threads, and sets
+// matched[i] to true for each filter that matches any item
+// returns the number of filters matched
+size_t btcBlockFilterMatchAnyBatch(BRBitcoinBlockFilter *filters[], size_t filtersCount, const uint8_t *items[],
+                                   const size_t itemLens[], size_t itemsCount, int matched[]);
+
+// frees memory allocated for filter
+void btcBlockFilterFree(BRBitcoinBlockFilter *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BRBlockFilter_h
@@ -0,0 +1,301 @@
+//
+//  BRBitcoinBlockWindows.c
+//
+//  Copyright (c) 2021 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "BRBitcoinBlockWindows.h"
+#include "support/BRArray.h"
+#include <string.h>
+#include <assert.h>
+
+void btcBlockWindowsInit(BRBitcoinBlockWindows *windows)
+{
+    assert(windows != NULL);
+    array_new(windows->windows, 10);
+    array_new(windows->queue, 500);
+    array_new(windows->rates, 10);
+}
+
+// drops all outstanding windows and queued block hashes, peer download rates are kept
+void btcBlockWindowsClear(BRBitcoinBlockWindows *windows)
+{
+    assert(windows != NULL);
+    array_clear(windows->windows);
+    array_clear(windows->queue);
+}
+
+// true if there are any outstanding windows or queued block hashes
+int btcBlockWindowsActive(const BRBitcoinBlockWindows *windows)
+{
+    assert(windows != NULL);
+    return (array_count(windows->windows) > 0 || array_count(windows->queue) > 0);
+}
+
+// adds blockHashes to the end of the queue
+void btcBlockWindowsQueue(BRBitcoinBlockWindows *windows, const UInt256 blockHashes[], size_t count)
+{
+    assert(windows != NULL);
+    assert(blockHashes != NULL || count == 0);
+    array_add_array(windows->queue, blockHashes, count);
+}
+
+static BRBitcoinPeerRate *_btcBlockWindowsRate(BRBitcoinBlockWindows *windows, BRBitcoinPeer *peer)
+{
+    for (size_t i = array_count(windows->rates); i > 0; i--) {
+        if (windows->rates[i - 1].peer == peer) return &windows->rates[i - 1];
+    }
+
+    array_add(windows->rates, ((const BRBitcoinPeerRate) { peer, 0.0 }));
+    return &windows->rates[array_count(windows->rates) - 1];
+}
+
+// the moving average download rate of peer in blocks per second, or 0 if it hasn't completed a window
+double btcBlockWindowsPeerRate(const BRBitcoinBlockWindows *windows, const BRBitcoinPeer *peer)
+{
+    assert(windows != NULL);
+
+    for (size_t i = array_count(windows->rates); i > 0; i--) {
+        if (windows->rates[i - 1].peer == peer) return windows->rates[i - 1].blocksPerSec;
+    }
+
+    return 0.0;
+}
+
+// sorts peers by download rate, fastest first, keeping the given order for equal rates
+void btcBlockWindowsSortPeers(const BRBitcoinBlockWindows *windows, BRBitcoinPeer *peers[], size_t peersCount)
+{
+    BRBitcoinPeer *p;
+    size_t i, j;
+
+    assert(windows != NULL);
+    assert(peers != NULL || peersCount == 0);
+
+    for (i = 1; i < peersCount; i++) { // insertion sort, there are never more than a handful of peers
+        p = peers[i];
+
+        for (j = i; j > 0 && btcBlockWindowsPeerRate(windows, peers[j - 1]) < btcBlockWindowsPeerRate(windows, p); j--) {
+            peers[j] = peers[j - 1];
+        }
+
+        peers[j] = p;
+    }
+}
+
+// returns the block hashes of window w that haven't been received to the front of the queue and removes the window
+static void _btcBlockWindowsRequeue(BRBitcoinBlockWindows *windows, size_t w)
+{
+    BRBitcoinBlockWindow *window = &windows->windows[w];
+    UInt256 hashes[BLOCK_WINDOW_SIZE];
+    size_t i, count = 0;
+
+    for (i = 0; i < window->count; i++) {
+        if (! UInt256IsZero(window->hashes[i])) hashes[count++] = window->hashes[i];
+    }
+
+    array_insert_array(windows->queue, 0, hashes, count);
+    array_rm(windows->windows, w);
+}
+
+// removes the hash at index i from window w, without counting it as received
+static void _btcBlockWindowsDrop(BRBitcoinBlockWindows *windows, size_t w, size_t i)
+{
+    BRBitcoinBlockWindow *window = &windows->windows[w];
+
+    memmove(&window->hashes[i], &window->hashes[i + 1], (window->count - i - 1)*sizeof(*window->hashes));
+    window->count--;
+}
+
+// removes window w if every block left in it has been received, and updates its peer's download rate from the blocks
+// it actually delivered
+// returns true if the window was removed
+static int _btcBlockWindowsComplete(BRBitcoinBlockWindows *windows, size_t w, double now)
+{
+    BRBitcoinBlockWindow *window = &windows->windows[w];
+    BRBitcoinPeerRate *rate;
+    double blocksPerSec;
+
+    if (window->received < window->count) return 0;
+
+    if (window->received > 0) {
+        rate = _btcBlockWindowsRate(windows, window->peer);
+        blocksPerSec = (double)window->received/((now > window->requestTime) ? now - window->requestTime : 0.001);
+        rate->blocksPerSec = (rate->blocksPerSec > 0.0) ? rate->blocksPerSec*0.7 + blocksPerSec*0.3 : blocksPerSec;
+    }
+
+    array_rm(windows->windows, w);
+    return 1;
+}
+
+// returns the block hashes of each window assigned to peer that haven't been received to the front of the queue, in
+// their original order, and returns the number of windows requeued
+size_t btcBlockWindowsRequeuePeer(BRBitcoinBlockWindows *windows, const BRBitcoinPeer *peer)
+{
+    size_t count = 0;
+
+    assert(windows != NULL);
+
+    // windows are requeued last first, so the earliest ends up at the front, and removing one leaves those before it
+    for (size_t w = array_count(windows->windows); w > 0; w--) {
+        if (windows->windows[w - 1].peer != peer) continue;
+        _btcBlockWindowsRequeue(windows, w - 1);
+        count++;
+    }
+
+    return count;
+}
+
+// requeues any windows assigned to peer as for btcBlockWindowsRequeuePeer() and forgets peer's download rate
+size_t btcBlockWindowsRemovePeer(BRBitcoinBlockWindows *windows, const BRBitcoinPeer *peer)
+{
+    assert(windows != NULL);
+
+    for (size_t i = array_count(windows->rates); i > 0; i--) {
+        if (windows->rates[i - 1].peer == peer) array_rm(windows->rates, i - 1);
+    }
+
+    return btcBlockWindowsRequeuePeer(windows, peer);
+}
+
+// requeues each window whose peer isn't in peers, or that has gone BLOCK_WINDOW_TIMEOUT seconds before now without
+// receiving a block, and halves that peer's download rate
+// writes up to stalledCount of their peers to stalled, and returns the number of windows requeued
+size_t btcBlockWindowsRequeueStalled(BRBitcoinBlockWindows *windows, BRBitcoinPeer *const peers[], size_t peersCount,
+                                     double now, BRBitcoinPeer *stalled[], size_t stalledCount)
+{
+    BRBitcoinBlockWindow *window;
+    size_t i, count = 0;
+
+    assert(windows != NULL);
+    assert(peers != NULL || peersCount == 0);
+    assert(stalled != NULL || stalledCount == 0);
+
+    for (size_t w = array_count(windows->windows); w > 0; w--) {
+        window = &windows->windows[w - 1];
+        for (i = 0; i < peersCount && peers[i] != window->peer; i++);
+        if (i < peersCount && window->progressTime + BLOCK_WINDOW_TIMEOUT >= now) continue;
+        _btcBlockWindowsRate(windows, window->peer)->blocksPerSec /= 2;
+        if (count < stalledCount) stalled[count] = window->peer;
+        _btcBlockWindowsRequeue(windows, w - 1);
+        count++;
+    }
+
+    return count;
+}
+
+// gives each of peers, in order, that has no outstanding window a new window from the front of the queue, or once the
+// queue is empty, the second half of the unreceived blocks of the largest outstanding window, and calls request for each
+// new window; blocks taken from a window leave it, and the original peer's copies count towards neither peer's rate
+// returns the number of windows assigned
+size_t btcBlockWindowsAssign(BRBitcoinBlockWindows *windows, BRBitcoinPeer *const peers[], size_t peersCount, double now,
+                             void *info,
+                             void (*request)(void *info, BRBitcoinPeer *peer, const UInt256 blockHashes[],
+                                             size_t count))
+{
+    BRBitcoinBlockWindow window, *largest;
+    size_t i, j, w, l, n, count = 0;
+
+    assert(windows != NULL);
+    assert(peers != NULL || peersCount == 0);
+
+    for (i = 0; i < peersCount; i++) {
+        window = (BRBitcoinBlockWindow) { peers[i], { UINT256_ZERO }, 0, 0, now, now };
+        largest = NULL, l = 0;
+
+        for (w = array_count(windows->windows); w > 0; w--) {
+            if (windows->windows[w - 1].peer == peers[i]) break;
+
+            if (! largest || largest->count - largest->received <
+                windows->windows[w - 1].count - windows->windows[w - 1].received) {
+                largest = &windows->windows[w - 1];
+                l = w - 1;
+            }
+        }
+
+        if (w > 0) continue; // peer already has an outstanding window
+
+        if (array_count(windows->queue) > 0) {
+            window.count = (array_count(windows->queue) < BLOCK_WINDOW_SIZE) ? array_count(windows->queue) :
+                           BLOCK_WINDOW_SIZE;
+            memcpy(window.hashes, windows->queue, window.count*sizeof(*window.hashes));
+            array_rm_range(windows->queue, 0, window.count);
+        }
+        else if (largest && largest->count > largest->received) { // take the second half of the largest window
+            n = (largest->count - largest->received + 1)/2;
+
+            // the taken hashes leave the largest window altogether, so its peer's rate only counts its own deliveries
+            for (j = largest->count; j > 0 && window.count < n; j--) {
+                if (UInt256IsZero(largest->hashes[j - 1])) continue;
+                window.hashes[n - ++window.count] = largest->hashes[j - 1];
+                _btcBlockWindowsDrop(windows, l, j - 1);
+            }
+
+            _btcBlockWindowsComplete(windows, l, now);
+        }
+
+        if (window.count == 0) continue;
+        array_add(windows->windows, window);
+        count++;
+        if (request) request(info, peers[i], window.hashes, window.count);
+    }
+
+    return count;
+}
+
+// marks blockHash as received from peer in the window it was assigned to, and when that completes the window, removes
+// it and updates its peer's download rate; a block delivered by a peer other than the window's, such as the original
+// peer of a block taken from its window, is dropped from the window without counting towards either peer's rate
+// returns true if blockHash was found in an outstanding window
+int btcBlockWindowsBlockReceived(BRBitcoinBlockWindows *windows, const BRBitcoinPeer *peer, UInt256 blockHash,
+                                 double now)
+{
+    BRBitcoinBlockWindow *window;
+
+    assert(windows != NULL);
+
+    for (size_t w = array_count(windows->windows); w > 0; w--) {
+        window = &windows->windows[w - 1];
+
+        for (size_t i = 0; i < window->count; i++) {
+            if (! UInt256Eq(window->hashes[i], blockHash)) continue;
+
+            if (window->peer == peer) {
+                window->hashes[i] = UINT256_ZERO;
+                window->received++;
+                window->progressTime = now;
+            }
+            else _btcBlockWindowsDrop(windows, w - 1, i);
+
+            _btcBlockWindowsComplete(windows, w - 1, now);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// frees memory allocated for windows
+void btcBlockWindowsFree(BRBitcoinBlockWindows *windows)
+{
+    assert(windows != NULL);
+    array_free(windows->rates);
+    array_free(windows->queue);
+    array_free(windows->windows);
+}
@@ -0,0 +1,116 @@
+//
+//  BRBitcoinBlockWindows.h
+//
+//  Copyright (c) 2021 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef BRBitcoinBlockWindows_h
+#define BRBitcoinBlockWindows_h
+
+#include "BRBitcoinPeer.h"
+#include "support/BRInt.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bookkeeping for a parallel chain download, where block hashes are queued and handed out in windows of up to
+// BLOCK_WINDOW_SIZE blocks to be requested from different peers at the same time
+//
+// peers are only compared by address, never dereferenced, and are ordered by a moving average of how fast each has
+// completed its windows
+
+#define BLOCK_WINDOW_SIZE    100  // blocks requested from a peer at a time
+#define BLOCK_WINDOW_TIMEOUT 10.0 // seconds a window can go without progress before it's reassigned
+
+typedef struct {
+    BRBitcoinPeer *peer;
+    UInt256 hashes[BLOCK_WINDOW_SIZE]; // UINT256_ZERO once received
+    size_t count, received; // count shrinks as blocks are taken by other windows, received are those peer delivered
+    double requestTime, progressTime;
+} BRBitcoinBlockWindow;
+
+typedef struct {
+    BRBitcoinPeer *peer;
+    double blocksPerSec;
+} BRBitcoinPeerRate;
+
+typedef struct {
+    BRBitcoinBlockWindow *windows; // outstanding requests, an array created with array_new()
+    UInt256 *queue; // block hashes waiting to be assigned to a window, an array created with array_new()
+    BRBitcoinPeerRate *rates; // an array created with array_new()
+} BRBitcoinBlockWindows;
+
+// initializes windows, which must be freed by calling btcBlockWindowsFree()
+void btcBlockWindowsInit(BRBitcoinBlockWindows *windows);
+
+// drops all outstanding windows and queued block hashes, peer download rates are kept
+void btcBlockWindowsClear(BRBitcoinBlockWindows *windows);
+
+// true if there are any outstanding windows or queued block hashes
+int btcBlockWindowsActive(const BRBitcoinBlockWindows *windows);
+
+// adds blockHashes to the end of the queue
+void btcBlockWindowsQueue(BRBitcoinBlockWindows *windows, const UInt256 blockHashes[], size_t count);
+
+// the moving average download rate of peer in blocks per second, or 0 if it hasn't completed a window
+double btcBlockWindowsPeerRate(const BRBitcoinBlockWindows *windows, const BRBitcoinPeer *peer);
+
+// sorts peers by download rate, fastest first, keeping the given order for equal rates
+void btcBlockWindowsSortPeers(const BRBitcoinBlockWindows *windows, BRBitcoinPeer *peers[], size_t peersCount);
+
+// returns the block hashes of each window assigned to peer that haven't been received to the front of the queue, in
+// their original order, and returns the number of windows requeued
+size_t btcBlockWindowsRequeuePeer(BRBitcoinBlockWindows *windows, const BRBitcoinPeer *peer);
+
+// requeues any windows assigned to peer as for btcBlockWindowsRequeuePeer() and forgets peer's download rate
+size_t btcBlockWindowsRemovePeer(BRBitcoinBlockWindows *windows, const BRBitcoinPeer *peer);
+
+// requeues each window whose peer isn't in peers, or that has gone BLOCK_WINDOW_TIMEOUT seconds before now without
+// receiving a block, and halves that peer's download rate
+// writes up to stalledCount of their peers to stalled, and returns the number of windows requeued
+size_t btcBlockWindowsRequeueStalled(BRBitcoinBlockWindows *windows, BRBitcoinPeer *const peers[], size_t peersCount,
+                                     double now, BRBitcoinPeer *stalled[], size_t stalledCount);
+
+// gives each of peers, in order, that has no outstanding window a new window from the front of the queue, or once the
+// queue is empty, the second half of the unreceived blocks of the largest outstanding window, and calls request for each
+// new window; blocks taken from a window leave it, and the original peer's copies count towards neither peer's rate
+// returns the number of windows assigned
+size_t btcBlockWindowsAssign(BRBitcoinBlockWindows *windows, BRBitcoinPeer *const peers[], size_t peersCount, double now,
+                             void *info,
+                             void (*request)(void *info, BRBitcoinPeer *peer, const UInt256 blockHashes[],
+                                             size_t count));
+
+// marks blockHash as received from peer in the window it was assigned to, and when that completes the window, removes
+// it and updates its peer's download rate; a block delivered by a peer other than the window's, such as the original
+// peer of a block taken from its window, is dropped from the window without counting towards either peer's rate
+// returns true if blockHash was found in an outstanding window
+int btcBlockWindowsBlockReceived(BRBitcoinBlockWindows *windows, const BRBitcoinPeer *peer, UInt256 blockHash,
+                                 double now);
+
+// frees memory allocated for windows
+void btcBlockWindowsFree(BRBitcoinBlockWindows *windows);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BRBitcoinBlockWindows_h
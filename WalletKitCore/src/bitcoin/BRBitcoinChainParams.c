@@ -51,7 +51,7 @@ static int btcMainNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const B
     }
 
     previous = BRSetGet(blockSet, &block->prevBlock);
-    return btcMerkleBlockVerifyDifficulty(block, previous, (b) ? b->timestamp : 0);
+    return btcMerkleBlockVerifyTarget(block, previous, (b) ? b->timestamp : 0); // proof-of-work is checked by the peer
 }
 
 static int btcTestNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRSet *blockSet)
@@ -79,6 +79,7 @@ static BRBitcoinChainParams btcMainNetParamsRecord = {
     0xd9b4bef9,            // magicNumber
     SERVICES_NODE_WITNESS, // services
     btcMainNetVerifyDifficulty,
+    btcMerkleBlockVerifyProofOfWork,
     NULL,
     0,
     { BITCOIN_PUBKEY_PREFIX, BITCOIN_SCRIPT_PREFIX, BITCOIN_PRIVKEY_PREFIX, BITCOIN_BECH32_PREFIX },
@@ -94,6 +95,7 @@ static BRBitcoinChainParams btcTestNetParamsRecord = {
     SERVICES_NODE_WITNESS, // services
     btcTestNetVerifyDifficulty,
     NULL,
+    NULL,
     0,
     { BITCOIN_PUBKEY_PREFIX_TEST, BITCOIN_SCRIPT_PREFIX_TEST, BITCOIN_PRIVKEY_PREFIX_TEST, BITCOIN_BECH32_PREFIX_TEST },
     BITCOIN_FORKID,
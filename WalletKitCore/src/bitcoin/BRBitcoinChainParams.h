@@ -57,6 +57,7 @@ typedef struct {
     uint32_t magicNumber;
     uint64_t services;
     int (*verifyDifficulty)(const BRBitcoinMerkleBlock *block, const BRSet *blockSet); // blockSet must have last 2016 blocks
+    int (*verifyProofOfWork)(const BRBitcoinMerkleBlock *block); // header hash meets its stated target, NULL to skip
     const BRBitcoinCheckPoint *checkpoints;
     size_t checkpointsCount;
     BRAddressParams addrParams;
@@ -0,0 +1,420 @@
+//
+//  BRBitcoinHeaderStore.c
+//
+//  Copyright (c) 2021 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "BRBitcoinHeaderStore.h"
+#include "support/BRInt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// file layout: a 16 byte file header (magic, version, base height, reserved) followed by one record per height starting
+// at the base height; heights without a block are holes of zeros, which most file systems don't allocate
+#define HEADER_STORE_MAGIC       0x53484252 // "BRHS"
+#define HEADER_STORE_VERSION     1
+#define HEADER_STORE_FILE_HEADER 16
+
+// record layout
+#define HEADER_STORE_HASH_OFFSET   80
+#define HEADER_STORE_HEIGHT_OFFSET 112
+#define HEADER_STORE_FLAGS_OFFSET  116
+
+#define HEADER_STORE_FLAG_PRESENT 0x01
+
+struct BRBitcoinHeaderStoreStruct {
+    int fd;
+    const uint8_t *map; // read-only mapping of the records, NULL if there are none
+    size_t recordCount; // records in the file, including holes
+    uint32_t baseHeight; // height of the first record
+    pthread_mutex_t lock;
+};
+
+inline static const uint8_t *_btcHeaderStoreRecord(BRBitcoinHeaderStore *store, size_t i)
+{
+    return &store->map[i*HEADER_STORE_RECORD_SIZE];
+}
+
+inline static int _btcHeaderStoreRecordIsPresent(BRBitcoinHeaderStore *store, size_t i)
+{
+    const uint8_t *r = _btcHeaderStoreRecord(store, i);
+
+    // a record only counts if it was completely written at its own height
+    return (UInt32GetLE(&r[HEADER_STORE_FLAGS_OFFSET]) & HEADER_STORE_FLAG_PRESENT) &&
+           UInt32GetLE(&r[HEADER_STORE_HEIGHT_OFFSET]) == store->baseHeight + i;
+}
+
+static void _btcHeaderStoreRecordSet(uint8_t *r, const BRBitcoinMerkleBlock *block)
+{
+    UInt32SetLE(&r[0], block->version);
+    UInt256Set(&r[4], block->prevBlock);
+    UInt256Set(&r[36], block->merkleRoot);
+    UInt32SetLE(&r[68], block->timestamp);
+    UInt32SetLE(&r[72], block->target);
+    UInt32SetLE(&r[76], block->nonce);
+    UInt256Set(&r[HEADER_STORE_HASH_OFFSET], block->blockHash);
+    UInt32SetLE(&r[HEADER_STORE_HEIGHT_OFFSET], block->height);
+    UInt32SetLE(&r[HEADER_STORE_FLAGS_OFFSET], HEADER_STORE_FLAG_PRESENT);
+}
+
+static BRBitcoinMerkleBlock *_btcHeaderStoreRecordGet(const uint8_t *r)
+{
+    BRBitcoinMerkleBlock *block = btcMerkleBlockNew();
+
+    block->version = UInt32GetLE(&r[0]);
+    block->prevBlock = UInt256Get(&r[4]);
+    block->merkleRoot = UInt256Get(&r[36]);
+    block->timestamp = UInt32GetLE(&r[68]);
+    block->target = UInt32GetLE(&r[72]);
+    block->nonce = UInt32GetLE(&r[76]);
+    block->blockHash = UInt256Get(&r[HEADER_STORE_HASH_OFFSET]);
+    block->height = UInt32GetLE(&r[HEADER_STORE_HEIGHT_OFFSET]);
+    return block;
+}
+
+// maps the records as the file stands now, must be called after any change to the file size
+static int _btcHeaderStoreRemap(BRBitcoinHeaderStore *store)
+{
+    struct stat st;
+    void *map;
+
+    if (store->map) munmap((void *)(store->map - HEADER_STORE_FILE_HEADER),
+                           HEADER_STORE_FILE_HEADER + store->recordCount*HEADER_STORE_RECORD_SIZE);
+    store->map = NULL;
+    store->recordCount = 0;
+    if (fstat(store->fd, &st) != 0 || st.st_size < HEADER_STORE_FILE_HEADER) return 0;
+
+    // a partial record at the end of the file was not completely written and is dropped
+    store->recordCount = ((size_t)st.st_size - HEADER_STORE_FILE_HEADER)/HEADER_STORE_RECORD_SIZE;
+
+    if (HEADER_STORE_FILE_HEADER + store->recordCount*HEADER_STORE_RECORD_SIZE != (size_t)st.st_size &&
+        ftruncate(store->fd, (off_t)(HEADER_STORE_FILE_HEADER + store->recordCount*HEADER_STORE_RECORD_SIZE)) != 0)
+        return 0;
+
+    if (store->recordCount > 0) {
+        map = mmap(NULL, HEADER_STORE_FILE_HEADER + store->recordCount*HEADER_STORE_RECORD_SIZE, PROT_READ,
+                   MAP_SHARED, store->fd, 0);
+
+        if (map == MAP_FAILED) {
+            store->recordCount = 0;
+            return 0;
+        }
+
+        store->map = (const uint8_t *)map + HEADER_STORE_FILE_HEADER;
+    }
+
+    return 1;
+}
+
+static int _btcHeaderStoreWriteFileHeader(BRBitcoinHeaderStore *store)
+{
+    uint8_t h[HEADER_STORE_FILE_HEADER] = { 0 };
+
+    UInt32SetLE(&h[0], HEADER_STORE_MAGIC);
+    UInt32SetLE(&h[4], HEADER_STORE_VERSION);
+    UInt32SetLE(&h[8], store->baseHeight);
+    return (pwrite(store->fd, h, sizeof(h), 0) == sizeof(h));
+}
+
+// removes all records and sets the base height
+static int _btcHeaderStoreReset(BRBitcoinHeaderStore *store, uint32_t baseHeight)
+{
+    if (ftruncate(store->fd, HEADER_STORE_FILE_HEADER) != 0) return 0;
+    store->baseHeight = baseHeight;
+    return _btcHeaderStoreWriteFileHeader(store) && _btcHeaderStoreRemap(store);
+}
+
+// moves the existing records so that the first record is at baseHeight, which must be lower than the current one
+static int _btcHeaderStoreRebase(BRBitcoinHeaderStore *store, uint32_t baseHeight)
+{
+    size_t len = store->recordCount*HEADER_STORE_RECORD_SIZE;
+    uint8_t *records = (len > 0) ? malloc(len) : NULL;
+    off_t offset = HEADER_STORE_FILE_HEADER + (off_t)(store->baseHeight - baseHeight)*HEADER_STORE_RECORD_SIZE;
+    int r;
+
+    assert(baseHeight < store->baseHeight);
+    if (len > 0 && ! records) return 0;
+    if (records) memcpy(records, store->map, len);
+    r = _btcHeaderStoreReset(store, baseHeight);
+    if (r && records) r = (pwrite(store->fd, records, len, offset) == (ssize_t)len);
+    if (records) free(records);
+    return r && _btcHeaderStoreRemap(store);
+}
+
+static int _btcHeaderStoreTruncate(BRBitcoinHeaderStore *store, uint32_t height)
+{
+    size_t count = (height > store->baseHeight) ? height - store->baseHeight : 0;
+
+    if (count >= store->recordCount) return 1;
+    if (ftruncate(store->fd, (off_t)(HEADER_STORE_FILE_HEADER + count*HEADER_STORE_RECORD_SIZE)) != 0) return 0;
+    return _btcHeaderStoreRemap(store);
+}
+
+static int _btcHeaderStoreSave(BRBitcoinHeaderStore *store, const BRBitcoinMerkleBlock *block)
+{
+    uint8_t r[HEADER_STORE_RECORD_SIZE];
+    size_t i;
+
+    if (block->height == BLOCK_UNKNOWN_HEIGHT) return 0;
+    if (store->recordCount == 0 && block->height != store->baseHeight && ! _btcHeaderStoreReset(store, block->height))
+        return 0;
+    if (block->height < store->baseHeight && ! _btcHeaderStoreRebase(store, block->height)) return 0;
+
+    i = block->height - store->baseHeight;
+    _btcHeaderStoreRecordSet(r, block);
+
+    if (i < store->recordCount && _btcHeaderStoreRecordIsPresent(store, i)) {
+        // the same block is already held
+        if (memcmp(_btcHeaderStoreRecord(store, i), r, sizeof(r)) == 0) return 1;
+
+        // a different block at this height means the chain was reorganized, so whatever was above it is stale
+        if (! UInt256Eq(UInt256Get(&_btcHeaderStoreRecord(store, i)[HEADER_STORE_HASH_OFFSET]), block->blockHash) &&
+            ! _btcHeaderStoreTruncate(store, block->height + 1)) return 0;
+    }
+
+    if (pwrite(store->fd, r, sizeof(r), (off_t)(HEADER_STORE_FILE_HEADER + i*HEADER_STORE_RECORD_SIZE)) != sizeof(r))
+        return 0;
+    return (i < store->recordCount) ? 1 : _btcHeaderStoreRemap(store);
+}
+
+inline static int _btcMerkleBlockHeightCompare(const void *a, const void *b)
+{
+    uint32_t h1 = (*(BRBitcoinMerkleBlock *const *)a)->height, h2 = (*(BRBitcoinMerkleBlock *const *)b)->height;
+
+    return (h1 < h2) ? -1 : (h1 > h2);
+}
+
+// returns a header store for the file at path, creating the file if needed, that must be closed by calling
+// btcHeaderStoreClose(), or NULL if the file can't be opened or is not a header store
+BRBitcoinHeaderStore *btcHeaderStoreOpen(const char *path)
+{
+    BRBitcoinHeaderStore *store;
+    uint8_t h[HEADER_STORE_FILE_HEADER];
+    ssize_t n;
+    int fd;
+
+    assert(path != NULL);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return NULL;
+
+    store = calloc(1, sizeof(*store));
+    assert(store != NULL);
+    store->fd = fd;
+    store->baseHeight = BLOCK_UNKNOWN_HEIGHT;
+    n = pread(fd, h, sizeof(h), 0);
+
+    if (n == 0) { // new file
+        if (! _btcHeaderStoreWriteFileHeader(store)) n = -1;
+    }
+    else if (n != sizeof(h) || UInt32GetLE(&h[0]) != HEADER_STORE_MAGIC || UInt32GetLE(&h[4]) != HEADER_STORE_VERSION) {
+        n = -1;
+    }
+    else store->baseHeight = UInt32GetLE(&h[8]);
+
+    if (n < 0 || ! _btcHeaderStoreRemap(store)) {
+        close(fd);
+        free(store);
+        return NULL;
+    }
+
+    pthread_mutex_init(&store->lock, NULL);
+    return store;
+}
+
+// the height of the highest block held, or BLOCK_UNKNOWN_HEIGHT if the store is empty
+uint32_t btcHeaderStoreTipHeight(BRBitcoinHeaderStore *store)
+{
+    uint32_t height = BLOCK_UNKNOWN_HEIGHT;
+    size_t i;
+
+    assert(store != NULL);
+    pthread_mutex_lock(&store->lock);
+
+    for (i = store->recordCount; i > 0; i--) {
+        if (! _btcHeaderStoreRecordIsPresent(store, i - 1)) continue;
+        height = store->baseHeight + (uint32_t)(i - 1);
+        break;
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    return height;
+}
+
+// writes block at block->height; if a different block is held at that height, all blocks above it are removed as well
+// returns true on success
+int btcHeaderStoreSave(BRBitcoinHeaderStore *store, const BRBitcoinMerkleBlock *block)
+{
+    int r;
+
+    assert(store != NULL);
+    assert(block != NULL);
+    pthread_mutex_lock(&store->lock);
+    r = _btcHeaderStoreSave(store, block);
+    pthread_mutex_unlock(&store->lock);
+    return r;
+}
+
+// writes each block as for btcHeaderStoreSave() in order of height, syncing the file once at the end
+// returns true on success
+int btcHeaderStoreSaveBlocks(BRBitcoinHeaderStore *store, BRBitcoinMerkleBlock *blocks[], size_t blocksCount)
+{
+    assert(store != NULL);
+    assert(blocks != NULL || blocksCount == 0);
+    if (blocksCount == 0) return 1; // nothing to write, and a zero length array below would be undefined
+
+    BRBitcoinMerkleBlock *sorted[blocksCount];
+    int r = 1;
+
+    memcpy(sorted, blocks, blocksCount*sizeof(*blocks));
+    qsort(sorted, blocksCount, sizeof(*sorted), _btcMerkleBlockHeightCompare);
+    pthread_mutex_lock(&store->lock);
+    for (size_t i = 0; r && i < blocksCount; i++) r = _btcHeaderStoreSave(store, sorted[i]);
+    if (r) r = (fsync(store->fd) == 0);
+    pthread_mutex_unlock(&store->lock);
+    return r;
+}
+
+// replaces all blocks with blocks; records already holding the same block are not rewritten, so replacing the chain
+// tip with a slightly longer one only writes the new blocks
+// returns true on success
+int btcHeaderStoreReplace(BRBitcoinHeaderStore *store, BRBitcoinMerkleBlock *blocks[], size_t blocksCount)
+{
+    int r = 1;
+
+    assert(store != NULL);
+    assert(blocks != NULL || blocksCount == 0);
+
+    if (blocksCount == 0) { // replacing with nothing empties the store, without a zero length array below
+        pthread_mutex_lock(&store->lock);
+        r = _btcHeaderStoreReset(store, BLOCK_UNKNOWN_HEIGHT);
+        pthread_mutex_unlock(&store->lock);
+        return r;
+    }
+
+    BRBitcoinMerkleBlock *sorted[blocksCount];
+    size_t i, j;
+
+    memcpy(sorted, blocks, blocksCount*sizeof(*blocks));
+    qsort(sorted, blocksCount, sizeof(*sorted), _btcMerkleBlockHeightCompare);
+    pthread_mutex_lock(&store->lock);
+
+    if (sorted[0]->height != store->baseHeight) { // everything below the new first block goes
+        r = _btcHeaderStoreReset(store, sorted[0]->height);
+    }
+    else { // clear out the held blocks that aren't being replaced
+        uint8_t hole[HEADER_STORE_RECORD_SIZE] = { 0 };
+
+        r = _btcHeaderStoreTruncate(store, sorted[blocksCount - 1]->height + 1);
+
+        for (i = 0, j = 0; r && i < store->recordCount; i++) {
+            while (j < blocksCount && sorted[j]->height < store->baseHeight + i) j++;
+            if ((j < blocksCount && sorted[j]->height == store->baseHeight + i) ||
+                ! _btcHeaderStoreRecordIsPresent(store, i)) continue;
+            r = (pwrite(store->fd, hole, sizeof(hole), (off_t)(HEADER_STORE_FILE_HEADER + i*HEADER_STORE_RECORD_SIZE)) ==
+                 sizeof(hole));
+        }
+    }
+
+    for (i = 0; r && i < blocksCount; i++) r = _btcHeaderStoreSave(store, sorted[i]);
+    if (r) r = (fsync(store->fd) == 0);
+    pthread_mutex_unlock(&store->lock);
+    return r;
+}
+
+// removes all blocks at or above height
+// returns true on success
+int btcHeaderStoreTruncate(BRBitcoinHeaderStore *store, uint32_t height)
+{
+    int r;
+
+    assert(store != NULL);
+    pthread_mutex_lock(&store->lock);
+    r = (height <= store->baseHeight) ? _btcHeaderStoreReset(store, BLOCK_UNKNOWN_HEIGHT) :
+        _btcHeaderStoreTruncate(store, height);
+    pthread_mutex_unlock(&store->lock);
+    return r;
+}
+
+// returns a newly allocated merkle block, that must be freed by calling btcMerkleBlockFree(), for the block at height,
+// or NULL if there is none
+BRBitcoinMerkleBlock *btcHeaderStoreGet(BRBitcoinHeaderStore *store, uint32_t height)
+{
+    BRBitcoinMerkleBlock *block = NULL;
+    size_t i;
+
+    assert(store != NULL);
+    pthread_mutex_lock(&store->lock);
+    i = height - store->baseHeight;
+
+    if (height >= store->baseHeight && i < store->recordCount && _btcHeaderStoreRecordIsPresent(store, i)) {
+        block = _btcHeaderStoreRecordGet(_btcHeaderStoreRecord(store, i));
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    return block;
+}
+
+// writes newly allocated merkle blocks, in order of height, for all blocks held at or above height to blocks
+// returns the number of blocks written, or the total number available if blocks is NULL
+size_t btcHeaderStoreLoad(BRBitcoinHeaderStore *store, uint32_t height, BRBitcoinMerkleBlock *blocks[],
+                          size_t blocksCount)
+{
+    size_t i, count = 0;
+
+    assert(store != NULL);
+    pthread_mutex_lock(&store->lock);
+    i = (height > store->baseHeight) ? height - store->baseHeight : 0;
+
+    for (; i < store->recordCount && (! blocks || count < blocksCount); i++) {
+        if (! _btcHeaderStoreRecordIsPresent(store, i)) continue;
+        if (blocks) blocks[count] = _btcHeaderStoreRecordGet(_btcHeaderStoreRecord(store, i));
+        count++;
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    return count;
+}
+
+// unmaps and closes the file and frees memory allocated for store
+void btcHeaderStoreClose(BRBitcoinHeaderStore *store)
+{
+    assert(store != NULL);
+    if (store->map) munmap((void *)(store->map - HEADER_STORE_FILE_HEADER),
+                           HEADER_STORE_FILE_HEADER + store->recordCount*HEADER_STORE_RECORD_SIZE);
+    close(store->fd);
+    pthread_mutex_destroy(&store->lock);
+    free(store);
+}
+
+// removes the header store file at path
+// returns 0 on success, or errno on failure
+int btcHeaderStoreWipe(const char *path)
+{
+    assert(path != NULL);
+    return (remove(path) == 0 || errno == ENOENT) ? 0 : errno;
+}
@@ -0,0 +1,90 @@
+//
+//  BRBitcoinHeaderStore.h
+//
+//  Copyright (c) 2021 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef BRBitcoinHeaderStore_h
+#define BRBitcoinHeaderStore_h
+
+#include "BRBitcoinMerkleBlock.h"
+#include <stddef.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// an append-only file of fixed size block header records, one per height starting from the height of the first block
+// saved, memory mapped for reading
+//
+// each record holds the 80 byte block header, the block hash, the height and a flags word, so blocks are read back
+// without parsing or hashing, looked up by height in constant time, and removed above a given height by truncating
+// the file; merkle tree hashes and flags of filtered blocks are not stored
+
+#define HEADER_STORE_RECORD_SIZE (80 + 32 + 4 + 4)
+
+typedef struct BRBitcoinHeaderStoreStruct BRBitcoinHeaderStore;
+
+// returns a header store for the file at path, creating the file if needed, that must be closed by calling
+// btcHeaderStoreClose(), or NULL if the file can't be opened or is not a header store
+BRBitcoinHeaderStore *btcHeaderStoreOpen(const char *path);
+
+// the height of the highest block held, or BLOCK_UNKNOWN_HEIGHT if the store is empty
+uint32_t btcHeaderStoreTipHeight(BRBitcoinHeaderStore *store);
+
+// writes block at block->height; if a different block is held at that height, all blocks above it are removed as well
+// returns true on success
+int btcHeaderStoreSave(BRBitcoinHeaderStore *store, const BRBitcoinMerkleBlock *block);
+
+// writes each block as for btcHeaderStoreSave() in order of height, syncing the file once at the end
+// returns true on success
+int btcHeaderStoreSaveBlocks(BRBitcoinHeaderStore *store, BRBitcoinMerkleBlock *blocks[], size_t blocksCount);
+
+// replaces all blocks with blocks; records already holding the same block are not rewritten, so replacing the chain
+// tip with a slightly longer one only writes the new blocks
+// returns true on success
+int btcHeaderStoreReplace(BRBitcoinHeaderStore *store, BRBitcoinMerkleBlock *blocks[], size_t blocksCount);
+
+// removes all blocks at or above height
+// returns true on success
+int btcHeaderStoreTruncate(BRBitcoinHeaderStore *store, uint32_t height);
+
+// returns a newly allocated merkle block, that must be freed by calling btcMerkleBlockFree(), for the block at height,
+// or NULL if there is none
+BRBitcoinMerkleBlock *btcHeaderStoreGet(BRBitcoinHeaderStore *store, uint32_t height);
+
+// writes newly allocated merkle blocks, in order of height, for all blocks held at or above height to blocks
+// returns the number of blocks written, or the total number available if blocks is NULL
+size_t btcHeaderStoreLoad(BRBitcoinHeaderStore *store, uint32_t height, BRBitcoinMerkleBlock *blocks[],
+                          size_t blocksCount);
+
+// unmaps and closes the file and frees memory allocated for store
+void btcHeaderStoreClose(BRBitcoinHeaderStore *store);
+
+// removes the header store file at path
+// returns 0 on success, or errno on failure
+int btcHeaderStoreWipe(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BRBitcoinHeaderStore_h
@@ -32,10 +32,17 @@
 #include <limits.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #define MAX_PROOF_OF_WORK 0x1d00ffff    // highest value for difficulty target (higher values are less difficult)
 #define TARGET_TIMESPAN   (14*24*60*60) // the targeted timespan between difficulty target adjustments
 
+#define HEADERS_PARSE_THREADS     4   // max worker threads used by btcMerkleBlockParseHeaders()
+#define HEADERS_PARSE_MIN_HEADERS 250 // don't spawn a thread for fewer headers than this
+
+#define MERKLE_WALK_NODES 1024 // partial merkle tree nodes _btcMerkleBlockWalk() keeps on the stack
+#define MERKLE_WALK_BATCH 32   // sibling pairs hashed per BRSHA256_2Batch() call
+
 inline static uint32_t _ceil_log2(uint32_t x)
 {
     uint32_t r = (x & (x - 1)) ? 1 : 0;
@@ -92,6 +99,12 @@ typedef struct {
     _BRAuxPow *ap;
 } _BRAuxPowBlock;
 
+typedef struct {
+    UInt256 hash;
+    uint16_t left, right; // child node indexes, MERKLE_WALK_NODES for a missing branch
+    uint8_t depth, leaf;
+} _BRMerkleNode;
+
 static void _BRAuxPowFree(_BRAuxPow *ap)
 {
     if (ap) {
@@ -355,17 +368,6 @@ static size_t _btcMerkleBlockTxHashesR(const BRBitcoinMerkleBlock *block, UInt25
     return *idx;
 }
 
-// populates txHashes with the matched tx hashes in the block
-// returns number of hashes written, or the total hashesCount needed if txHashes is NULL
-size_t btcMerkleBlockTxHashes(const BRBitcoinMerkleBlock *block, UInt256 *txHashes, size_t hashesCount)
-{
-    size_t idx = 0, hashIdx = 0, flagIdx = 0;
-
-    assert(block != NULL);
-    
-    return _btcMerkleBlockTxHashesR(block, txHashes, (txHashes) ? hashesCount : SIZE_MAX, &idx, &hashIdx, &flagIdx, 0);
-}
-
 // sets the hashes and flags fields for a block created with btcMerkleBlockNew()
 void btcMerkleBlockSetTxHashes(BRBitcoinMerkleBlock *block, const UInt256 hashes[], size_t hashesCount,
                                const uint8_t *flags, size_t flagsLen)
@@ -410,6 +412,131 @@ static UInt256 _btcMerkleBlockRootR(const BRBitcoinMerkleBlock *block, size_t *h
     return md;
 }
 
+// walks the partial merkle tree once, without recursion or heap allocation, writing up to hashesCount of the matched
+// tx hashes to txHashes and setting merkleRoot if it isn't NULL, with the same results as the recursive walks above
+// - the tree is flattened in flag order first, then each row of sibling pairs is hashed from the leaves up, several
+//   pairs at a time with BRSHA256_2Batch()
+// - trees with more than MERKLE_WALK_NODES nodes, or that trip the CVE-2012-2459 check, get their merkle root from
+//   _btcMerkleBlockRootR() instead
+// returns the total number of matched tx hashes
+static size_t _btcMerkleBlockWalk(const BRBitcoinMerkleBlock *block, UInt256 *merkleRoot, UInt256 *txHashes,
+                                  size_t hashesCount)
+{
+    _BRMerkleNode nodes[MERKLE_WALK_NODES], *n;
+    UInt256 pairs[MERKLE_WALK_BATCH][2], mds[MERKLE_WALK_BATCH];
+    const void *data[MERKLE_WALK_BATCH];
+    size_t lens[MERKLE_WALK_BATCH];
+    uint16_t stack[32], rows[32] = { 0 }, next[32], order[MERKLE_WALK_NODES], node;
+    uint8_t right[32]; // true once the node on the stack has its left branch
+    const uint32_t maxDepth = _ceil_log2(block->totalTx);
+    size_t count = 0, hashIdx = 0, flagIdx = 0, nodesCount = 0, sp = 0, off, i, j, k;
+    uint32_t depth;
+    uint8_t flag;
+    int ok = 1;
+
+    do {
+        node = MERKLE_WALK_NODES; // missing branch, or a node past the end of nodes
+
+        if (flagIdx/8 < block->flagsLen && hashIdx < block->hashesCount) {
+            flag = (block->flags[flagIdx/8] & (1 << (flagIdx % 8)));
+            flagIdx++;
+            if (nodesCount < MERKLE_WALK_NODES) node = (uint16_t)nodesCount;
+            nodesCount++;
+
+            if (! flag || sp == maxDepth) { // leaf
+                if (flag && count < hashesCount && txHashes) txHashes[count] = block->hashes[hashIdx];
+                if (flag) count++;
+                if (node < MERKLE_WALK_NODES) nodes[node].hash = block->hashes[hashIdx], nodes[node].leaf = 1;
+                hashIdx++;
+            }
+            else { // descend into the left branch
+                if (node < MERKLE_WALK_NODES) nodes[node].depth = (uint8_t)sp, nodes[node].leaf = 0, rows[sp]++;
+                stack[sp] = node, right[sp] = 0, sp++;
+                continue;
+            }
+        }
+
+        while (sp > 0 && right[sp - 1]) { // the node is done, and so is every parent it completes
+            sp--;
+            if (stack[sp] < MERKLE_WALK_NODES) nodes[stack[sp]].right = node;
+            node = stack[sp];
+        }
+
+        if (sp > 0) { // start on the parent's right branch
+            if (stack[sp - 1] < MERKLE_WALK_NODES) nodes[stack[sp - 1]].left = node;
+            right[sp - 1] = 1;
+        }
+    } while (sp > 0);
+
+    if (merkleRoot && nodesCount <= MERKLE_WALK_NODES) {
+        for (depth = maxDepth, off = 0; depth > 0; depth--) next[depth - 1] = (uint16_t)off, off += rows[depth - 1];
+
+        for (i = 0; i < nodesCount; i++) { // order the inner nodes by row, bottom row first
+            if (! nodes[i].leaf) order[next[nodes[i].depth]++] = (uint16_t)i;
+        }
+
+        for (depth = maxDepth, off = 0; ok && depth > 0; depth--) {
+            for (i = off, off += rows[depth - 1]; ok && i < off; i += k) {
+                k = (off - i < MERKLE_WALK_BATCH) ? off - i : MERKLE_WALK_BATCH;
+
+                for (j = 0; ok && j < k; j++) {
+                    n = &nodes[order[i + j]];
+                    pairs[j][0] = (n->left < MERKLE_WALK_NODES) ? nodes[n->left].hash : UINT256_ZERO;
+                    pairs[j][1] = (n->right < MERKLE_WALK_NODES) ? nodes[n->right].hash : UINT256_ZERO;
+                    // defend against (CVE-2012-2459), _btcMerkleBlockRootR() has the exact result for this case
+                    if (UInt256IsZero(pairs[j][0]) || UInt256Eq(pairs[j][0], pairs[j][1])) ok = 0;
+                    if (UInt256IsZero(pairs[j][1])) pairs[j][1] = pairs[j][0]; // if right branch is missing, dup left
+                    data[j] = pairs[j], lens[j] = sizeof(pairs[j]);
+                }
+
+                if (ok) BRSHA256_2Batch(mds, data, lens, k);
+                for (j = 0; ok && j < k; j++) nodes[order[i + j]].hash = mds[j];
+            }
+        }
+
+        if (ok) *merkleRoot = (node < MERKLE_WALK_NODES) ? nodes[node].hash : UINT256_ZERO;
+    }
+
+    if (merkleRoot && (! ok || nodesCount > MERKLE_WALK_NODES)) {
+        hashIdx = flagIdx = 0;
+        *merkleRoot = _btcMerkleBlockRootR(block, &hashIdx, &flagIdx, 0);
+    }
+
+    return count;
+}
+
+// walks the partial merkle tree with _btcMerkleBlockWalk(), or the recursive walks if recursive is true, for testing
+// returns number of matched tx hashes written to txHashes, or the total if txHashes is NULL
+size_t _btcMerkleBlockWalkImpl(const BRBitcoinMerkleBlock *block, UInt256 *merkleRoot, UInt256 *txHashes,
+                               size_t hashesCount, int recursive)
+{
+    size_t count, idx = 0, hashIdx = 0, flagIdx = 0;
+
+    if (! txHashes) hashesCount = SIZE_MAX;
+
+    if (recursive) {
+        if (merkleRoot) *merkleRoot = _btcMerkleBlockRootR(block, &hashIdx, &flagIdx, 0);
+        hashIdx = flagIdx = 0;
+        count = _btcMerkleBlockTxHashesR(block, txHashes, hashesCount, &idx, &hashIdx, &flagIdx, 0);
+    }
+    else count = _btcMerkleBlockWalk(block, merkleRoot, txHashes, hashesCount);
+
+    return (count < hashesCount) ? count : hashesCount;
+}
+
+// populates txHashes with the matched tx hashes in the block
+// returns number of hashes written, or the total hashesCount needed if txHashes is NULL
+size_t btcMerkleBlockTxHashes(const BRBitcoinMerkleBlock *block, UInt256 *txHashes, size_t hashesCount)
+{
+    size_t count;
+
+    assert(block != NULL);
+
+    if (! txHashes) hashesCount = SIZE_MAX;
+    count = _btcMerkleBlockWalk(block, NULL, txHashes, hashesCount);
+    return (count < hashesCount) ? count : hashesCount;
+}
+
 // true if the given tx hash is known to be included in the block
 int btcMerkleBlockContainsTxHash(const BRBitcoinMerkleBlock *block, UInt256 txHash)
 {
@@ -429,18 +556,32 @@ int btcMerkleBlockContainsTxHash(const BRBitcoinMerkleBlock *block, UInt256 txHa
 // NOTE: this does not check proof-of-work, or if the target is correct for the block's height in the chain
 // - use BRMerkleBlockVerifyDifficulty() for that
 int btcMerkleBlockIsValid(const BRBitcoinMerkleBlock *block, uint32_t currentTime)
+{
+    size_t hashesCount = 0;
+
+    return btcMerkleBlockIsValidWithTxHashes(block, currentTime, NULL, &hashesCount);
+}
+
+// true if merkle tree, timestamp and difficulty target are valid, as for btcMerkleBlockIsValid(), writing up to
+// *hashesCount of the matched tx hashes to txHashes in the same walk of the merkle tree that checks its root
+// *hashesCount is set to the total number of matched tx hashes, if that's more than were written, use
+// btcMerkleBlockTxHashes() with a buffer large enough for all of them
+int btcMerkleBlockIsValidWithTxHashes(const BRBitcoinMerkleBlock *block, uint32_t currentTime, UInt256 *txHashes,
+                                      size_t *hashesCount)
 {
     assert(block != NULL);
+    assert(hashesCount != NULL);
+    assert(txHashes != NULL || *hashesCount == 0);
     
     // target is in "compact" format, where the most significant byte is the size of the value in bytes, next
     // bit is the sign, and the last 23 bits is the value after having been right shifted by (size - 3)*8 bits
     const uint32_t size = block->target >> 24, target = block->target & 0x007fffff;
-    size_t hashIdx = 0, flagIdx = 0;
-    UInt256 merkleRoot = _btcMerkleBlockRootR(block, &hashIdx, &flagIdx, 0);
+    UInt256 merkleRoot = UINT256_ZERO;
     _BRAuxPow *ap = ((_BRAuxPowBlock *)block)->ap;
     int r = 1;
     
-    // check if merkle root is correct
+    // check if merkle root is correct, collecting the matched tx hashes along the way
+    *hashesCount = _btcMerkleBlockWalk(block, (block->totalTx > 0) ? &merkleRoot : NULL, txHashes, *hashesCount);
     if (block->totalTx > 0 && ! UInt256Eq(merkleRoot, block->merkleRoot)) r = 0;
     
     // check if timestamp is too far in future
@@ -468,10 +609,10 @@ int btcMerkleBlockVerifyProofOfWork(const BRBitcoinMerkleBlock *block)
     int i;
     UInt256 t = UINT256_ZERO;
     
-    if (size - 3 >= sizeof(t) - sizeof(uint32_t)) return 0;
-
-    if (size > 3) UInt32SetLE(&t.u8[size - 3], target);
-    else UInt32SetLE(t.u8, target >> (3 - size)*8);
+    if (size < 3 || size > sizeof(t)) return 0;
+    t.u8[size - 3] = target & 0xff; // set the three value bytes individually so targets up to 32 bytes will fit
+    t.u8[size - 2] = (target >> 8) & 0xff;
+    t.u8[size - 1] = (uint8_t)(target >> 16);
         
     for (i = sizeof(t) - 1; i >= 0; i--) { // check proof-of-work
         if (block->blockHash.u8[i] < t.u8[i]) break;
@@ -481,7 +622,7 @@ int btcMerkleBlockVerifyProofOfWork(const BRBitcoinMerkleBlock *block)
     return 1;
 }
 
-// verifies proof-of-work, and that the difficulty target is correct for the block's position in the chain
+// verifies that the difficulty target is correct for the block's position in the chain, without checking proof-of-work
 // transitionTime is the timestamp of the block at the previous difficulty transition
 // transitionTime may be 0 if block->height is not a multiple of BLOCK_DIFFICULTY_INTERVAL
 //
@@ -492,8 +633,8 @@ int btcMerkleBlockVerifyProofOfWork(const BRBitcoinMerkleBlock *block)
 // targeted time between transitions (14*24*60*60 seconds). If the new difficulty is more than 4x or less than 1/4 of
 // the previous difficulty, the change is limited to either 4x or 1/4. There is also a minimum difficulty value
 // intuitively named MAX_PROOF_OF_WORK... since larger values are less difficult.
-int btcMerkleBlockVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRBitcoinMerkleBlock *previous,
-                                   uint32_t transitionTime)
+int btcMerkleBlockVerifyTarget(const BRBitcoinMerkleBlock *block, const BRBitcoinMerkleBlock *previous,
+                               uint32_t transitionTime)
 {
     int r = 1, size = 0;
     uint64_t target = 0;
@@ -529,7 +670,117 @@ int btcMerkleBlockVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRBi
     }
     else if (r && block->target != previous->target) r = 0;
         
-    return r && btcMerkleBlockVerifyProofOfWork(block);
+    return r;
+}
+
+// verifies proof-of-work, and that the difficulty target is correct for the block's position in the chain
+// transitionTime is the timestamp of the block at the previous difficulty transition
+// transitionTime may be 0 if block->height is not a multiple of BLOCK_DIFFICULTY_INTERVAL
+int btcMerkleBlockVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRBitcoinMerkleBlock *previous,
+                                   uint32_t transitionTime)
+{
+    return btcMerkleBlockVerifyTarget(block, previous, transitionTime) && btcMerkleBlockVerifyProofOfWork(block);
+}
+
+typedef struct {
+    const uint8_t *buf;
+    const size_t *offsets;
+    BRBitcoinMerkleBlock **blocks;
+    size_t count;
+    uint32_t currentTime;
+    int (*verifyProofOfWork)(const BRBitcoinMerkleBlock *block);
+} _BRMerkleBlockHeadersJob;
+
+static void *_btcMerkleBlockHeadersRoutine(void *arg)
+{
+    _BRMerkleBlockHeadersJob *job = arg;
+
+    for (size_t i = 0; i < job->count; i++) {
+        if (job->blocks[i]) continue; // already parsed
+        job->blocks[i] = btcMerkleBlockParse(&job->buf[job->offsets[i]], 81);
+
+        if (job->blocks[i] && (! btcMerkleBlockIsValid(job->blocks[i], job->currentTime) ||
+                               (job->verifyProofOfWork && ! job->verifyProofOfWork(job->blocks[i])))) {
+            btcMerkleBlockFree(job->blocks[i]);
+            job->blocks[i] = NULL;
+        }
+    }
+
+    return NULL;
+}
+
+// buf must contain count serialized headers as found in a "headers" message, each followed by a zero tx count
+// headers are hashed and checked with btcMerkleBlockIsValid() and verifyProofOfWork() on several threads, pass the
+// chain's proof-of-work function since not every chain hashes headers with SHA256d, or NULL to skip that check
+// returns the number of leading headers that are well formed and valid, and sets blocks[i] for each of them, these
+// must be freed by calling btcMerkleBlockFree()
+size_t btcMerkleBlockParseHeaders(const uint8_t *buf, size_t bufLen, size_t count, uint32_t currentTime,
+                                  int (*verifyProofOfWork)(const BRBitcoinMerkleBlock *block),
+                                  BRBitcoinMerkleBlock *blocks[])
+{
+    size_t i, off = 0, n = 0, threadCount, per, *offsets = (count > 0) ? malloc(count*sizeof(*offsets)) : NULL;
+    BRBitcoinMerkleBlock *block;
+
+    assert(buf != NULL || bufLen == 0);
+    assert(blocks != NULL || count == 0);
+    assert(offsets != NULL || count == 0);
+
+    // headers are usually a fixed 81 bytes, so find where each one starts up front and leave the hashing to the
+    // workers, anything that might have an AuxPow attached is parsed in place since its length isn't known
+    for (n = 0; n < count && off + 81 <= bufLen; n++) {
+        offsets[n] = off;
+        blocks[n] = NULL;
+
+        if (UInt32GetLE(&buf[off]) >> 16 != 0 && off + 121 < bufLen && buf[off + 84] == 1 &&
+            UInt256IsZero(UInt256Get(&buf[off + 85])) && UInt32GetLE(&buf[off + 117]) == 0xffffffff) {
+            block = btcMerkleBlockParse(&buf[off], bufLen - off);
+            if (! block) break;
+            blocks[n] = block;
+            off += btcMerkleBlockSerialize(block, NULL, 0) + 1;
+
+            if (! btcMerkleBlockIsValid(block, currentTime) || (verifyProofOfWork && ! verifyProofOfWork(block))) {
+                btcMerkleBlockFree(block);
+                blocks[n] = NULL;
+                break;
+            }
+        }
+        else off += 81;
+    }
+
+    threadCount = n/HEADERS_PARSE_MIN_HEADERS;
+    if (threadCount > HEADERS_PARSE_THREADS) threadCount = HEADERS_PARSE_THREADS;
+    if (threadCount < 1) threadCount = 1;
+    per = (n + threadCount - 1)/threadCount;
+
+    _BRMerkleBlockHeadersJob jobs[threadCount];
+    pthread_t threads[threadCount];
+    int started[threadCount];
+
+    for (i = 0; i < threadCount; i++) {
+        size_t start = i*per, end = (start + per < n) ? start + per : n;
+
+        jobs[i] = (_BRMerkleBlockHeadersJob) { buf, &offsets[start], &blocks[start], (start < end) ? end - start : 0,
+                                               currentTime, verifyProofOfWork };
+        // the first chunk is parsed on the calling thread, as is any chunk whose thread couldn't be created
+        started[i] = (i > 0 && pthread_create(&threads[i], NULL, _btcMerkleBlockHeadersRoutine, &jobs[i]) == 0);
+    }
+
+    _btcMerkleBlockHeadersRoutine(&jobs[0]);
+
+    for (i = 1; i < threadCount; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else _btcMerkleBlockHeadersRoutine(&jobs[i]);
+    }
+
+    for (i = 0; i < n && blocks[i]; i++);
+
+    for (count = i; i < n; i++) { // free anything after the first invalid header
+        if (blocks[i]) btcMerkleBlockFree(blocks[i]);
+        blocks[i] = NULL;
+    }
+
+    if (offsets) free(offsets);
+    return count;
 }
 
 // returns parent block if block uses AuxPow merge-mining: https://en.bitcoin.it/wiki/Merged_mining_specification
@@ -85,17 +85,39 @@ int btcMerkleBlockContainsTxHash(const BRBitcoinMerkleBlock *block, UInt256 txHa
 // - use BRMerkleBlockVerifyDifficulty() for that
 int btcMerkleBlockIsValid(const BRBitcoinMerkleBlock *block, uint32_t currentTime);
 
+// true if merkle tree, timestamp and difficulty target are valid, as for btcMerkleBlockIsValid(), writing up to
+// *hashesCount of the matched tx hashes to txHashes in the same walk of the merkle tree that checks its root
+// *hashesCount is set to the total number of matched tx hashes, if that's more than were written, use
+// btcMerkleBlockTxHashes() with a buffer large enough for all of them
+int btcMerkleBlockIsValidWithTxHashes(const BRBitcoinMerkleBlock *block, uint32_t currentTime, UInt256 *txHashes,
+                                      size_t *hashesCount);
+
 // true if proof-of-work meets the stated difficulty target in the header
 // NOTE: this does not check if the target is correct for the block's height in the chain
 // - use BRMerkleBlockVerifyDifficulty() for that
 int btcMerkleBlockVerifyProofOfWork(const BRBitcoinMerkleBlock *block);
 
+// verifies that the block difficulty target is correct for the block's position in the chain, without checking
+// proof-of-work, transitionTime is the timestamp of the block at the previous difficulty transition
+// transitionTime may be 0 if block->height is not a multiple of BLOCK_DIFFICULTY_INTERVAL
+int btcMerkleBlockVerifyTarget(const BRBitcoinMerkleBlock *block, const BRBitcoinMerkleBlock *previous,
+                               uint32_t transitionTime);
+
 // verifies proof-of-work and that the block difficulty target is correct for the block's position in the chain
 // transitionTime is the timestamp of the block at the previous difficulty transition
 // transitionTime may be 0 if block->height is not a multiple of BLOCK_DIFFICULTY_INTERVAL
 int btcMerkleBlockVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRBitcoinMerkleBlock *previous,
                                    uint32_t transitionTime);
 
+// buf must contain count serialized headers as found in a "headers" message, each followed by a zero tx count
+// headers are hashed and checked with btcMerkleBlockIsValid() and verifyProofOfWork() on several threads, pass the
+// chain's proof-of-work function since not every chain hashes headers with SHA256d, or NULL to skip that check
+// returns the number of leading headers that are well formed and valid, and sets blocks[i] for each of them, these
+// must be freed by calling btcMerkleBlockFree()
+size_t btcMerkleBlockParseHeaders(const uint8_t *buf, size_t bufLen, size_t count, uint32_t currentTime,
+                                  int (*verifyProofOfWork)(const BRBitcoinMerkleBlock *block),
+                                  BRBitcoinMerkleBlock *blocks[]);
+
 // returns parent block if block uses AuxPow merge-mining: https://en.bitcoin.it/wiki/Merged_mining_specification
 const BRBitcoinMerkleBlock *btcMerkleBlockAuxPowParent(const BRBitcoinMerkleBlock *block);
 
@@ -47,6 +47,7 @@
 #define HEADER_LENGTH      24
 #define MAX_MSG_LENGTH     0x02000000
 #define MAX_GETDATA_HASHES 50000
+#define MAX_KNOWN_TX_HASHES 50000 // most recent tx hashes remembered per peer, older ones roll off the oldest first
 #define ENABLED_SERVICES   0ULL  // we don't provide full blocks to remote nodes
 #define PROTOCOL_VERSION   70015
 #define MIN_PROTO_VERSION  70002 // peers earlier than this protocol version not supported (need v0.9 txFee relay rules)
@@ -107,11 +108,14 @@ typedef struct {
     uint32_t version, lastblock, earliestKeyTime, currentBlockHeight;
     double startTime, pingTime;
     volatile double disconnectTime, mempoolTime;
-    int sentVerack, gotVerack, sentGetaddr, sentFilter, sentGetdata, sentMempool, sentGetblocks;
+    int sentVerack, gotVerack, sentGetaddr, sentFilter, sentGetdata, sentMempool, sentGetblocks, compactFilterSync;
     UInt256 lastBlockHash;
     BRBitcoinMerkleBlock *currentBlock;
-    UInt256 *currentBlockTxHashes, *knownBlockHashes, *knownTxHashes;
-    BRSet *knownTxHashSet;
+    UInt256 *currentBlockTxHashes, *knownBlockHashes;
+    UInt256 *knownTxHashes; // ring buffer of up to MAX_KNOWN_TX_HASHES, grown on demand, then oldest overwritten first
+    uint32_t *knownTxIndex; // open addressed index of knownTxHashes positions plus one, zero for an empty slot
+    size_t knownTxCount, knownTxCapacity, knownTxNext, knownTxIndexMask;
+    uint64_t knownTxSalt;
     volatile int socket;
     void *info;
     void (*connected)(void *info);
@@ -127,6 +131,13 @@ typedef struct {
     BRBitcoinTransaction *(*requestedTx)(void *info, UInt256 txHash);
     int (*networkIsReachable)(void *info);
     void (*threadCleanup)(void *info);
+    void (*relayedFilterHeaders)(void *info, UInt256 stopHash, UInt256 prevHeader, const UInt256 filterHashes[],
+                                 size_t count);
+    void (*relayedFilter)(void *info, BRBitcoinBlockFilter *filter);
+    void (*relayedFullBlock)(void *info, BRBitcoinMerkleBlock *block, BRBitcoinTransaction *txs[], size_t txCount);
+    int (*relayedBlockHashes)(void *info, const UInt256 blockHashes[], size_t blockCount);
+    void (*relayedHeaders)(void *info, BRBitcoinMerkleBlock *blocks[], size_t blockCount);
+    int (*verifyProofOfWork)(const BRBitcoinMerkleBlock *block);
     void **volatile pongInfo;
     void (**volatile pongCallback)(void *info, int success);
     void *volatile mempoolInfo;
@@ -144,24 +155,109 @@ inline static int _btcPeerIsIPv4(const BRBitcoinPeer *peer)
     return (peer->address.u64[0] == 0 && peer->address.u16[4] == 0 && peer->address.u16[5] == 0xffff);
 }
 
-static void _btcPeerAddKnownTxHashes(const BRBitcoinPeer *peer, const UInt256 txHashes[], size_t txCount)
+// index slot where the search for txHash starts, salted per peer so remote nodes can't choose colliding hashes
+inline static size_t _btcPeerKnownTxSlot(const BRBitcoinPeerContext *ctx, const UInt256 *txHash)
+{
+    return (size_t)(((txHash->u64[0] ^ ctx->knownTxSalt)*0x9e3779b97f4a7c15ULL) >> 32) & ctx->knownTxIndexMask;
+}
+
+static void _btcPeerKnownTxIndexInsert(BRBitcoinPeerContext *ctx, size_t pos)
+{
+    size_t i = _btcPeerKnownTxSlot(ctx, &ctx->knownTxHashes[pos]);
+    
+    while (ctx->knownTxIndex[i] != 0) i = (i + 1) & ctx->knownTxIndexMask;
+    ctx->knownTxIndex[i] = (uint32_t)(pos + 1);
+}
+
+// removes the entry for ring buffer position pos, shifting back any later entries of the probe sequence into the gap
+static void _btcPeerKnownTxIndexRemove(BRBitcoinPeerContext *ctx, size_t pos)
+{
+    size_t i = _btcPeerKnownTxSlot(ctx, &ctx->knownTxHashes[pos]), j, k, mask = ctx->knownTxIndexMask;
+    
+    while (ctx->knownTxIndex[i] != pos + 1) i = (i + 1) & mask;
+    
+    for (j = (i + 1) & mask; ctx->knownTxIndex[j] != 0; j = (j + 1) & mask) {
+        k = _btcPeerKnownTxSlot(ctx, &ctx->knownTxHashes[ctx->knownTxIndex[j] - 1]);
+        if (((j - k) & mask) < ((j - i) & mask)) continue; // entry at j is still reachable from its home slot k
+        ctx->knownTxIndex[i] = ctx->knownTxIndex[j];
+        i = j;
+    }
+    
+    ctx->knownTxIndex[i] = 0;
+}
+
+// doubles the ring buffer, must only be called while it has not yet wrapped around
+static void _btcPeerKnownTxGrow(BRBitcoinPeerContext *ctx)
+{
+    size_t capacity = (ctx->knownTxCapacity < 64) ? 64 : ctx->knownTxCapacity*2, indexSize = 1;
+    
+    if (capacity > MAX_KNOWN_TX_HASHES) capacity = MAX_KNOWN_TX_HASHES;
+    while (indexSize < capacity*2) indexSize <<= 1; // keep the index at most half full
+    ctx->knownTxHashes = realloc(ctx->knownTxHashes, capacity*sizeof(*ctx->knownTxHashes));
+    assert(ctx->knownTxHashes != NULL);
+    free(ctx->knownTxIndex);
+    ctx->knownTxIndex = calloc(indexSize, sizeof(*ctx->knownTxIndex));
+    assert(ctx->knownTxIndex != NULL);
+    ctx->knownTxIndexMask = indexSize - 1;
+    ctx->knownTxCapacity = capacity;
+    ctx->knownTxNext = ctx->knownTxCount;
+    for (size_t i = 0; i < ctx->knownTxCount; i++) _btcPeerKnownTxIndexInsert(ctx, i);
+}
+
+static int _btcPeerKnownTxContains(const BRBitcoinPeerContext *ctx, UInt256 txHash)
+{
+    if (ctx->knownTxCount == 0) return 0;
+    
+    for (size_t i = _btcPeerKnownTxSlot(ctx, &txHash); ctx->knownTxIndex[i] != 0; i = (i + 1) & ctx->knownTxIndexMask) {
+        if (UInt256Eq(ctx->knownTxHashes[ctx->knownTxIndex[i] - 1], txHash)) return 1;
+    }
+    
+    return 0;
+}
+
+// true if txHash is among the most recent MAX_KNOWN_TX_HASHES tx hashes the peer and we both know about
+static int _btcPeerHasKnownTxHash(const BRBitcoinPeer *peer, UInt256 txHash)
 {
     BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
-    UInt256 *knownTxHashes = ctx->knownTxHashes;
-    size_t i, j;
+    int r;
     
+    pthread_mutex_lock(&ctx->lock);
+    r = _btcPeerKnownTxContains(ctx, txHash);
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
+// adds txHashes to the known tx hashes, rolling off the oldest once MAX_KNOWN_TX_HASHES is reached, and copies the ones
+// that weren't already known to addedHashes if it isn't NULL, returns the number of those
+static size_t _btcPeerAddKnownTxHashes(const BRBitcoinPeer *peer, const UInt256 txHashes[], size_t txCount,
+                                       UInt256 addedHashes[])
+{
+    BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
+    size_t i, count = 0;
+    
+    pthread_mutex_lock(&ctx->lock);
+
     for (i = 0; i < txCount; i++) {
-        if (! BRSetContains(ctx->knownTxHashSet, &txHashes[i])) {
-            array_add(knownTxHashes, txHashes[i]);
-            
-            if (ctx->knownTxHashes != knownTxHashes) { // check if knownTxHashes was moved to a new memory location
-                ctx->knownTxHashes = knownTxHashes;
-                BRSetClear(ctx->knownTxHashSet);
-                for (j = array_count(knownTxHashes); j > 0; j--) BRSetAdd(ctx->knownTxHashSet, &knownTxHashes[j - 1]);
-            }
-            else BRSetAdd(ctx->knownTxHashSet, &knownTxHashes[array_count(knownTxHashes) - 1]);
+        if (_btcPeerKnownTxContains(ctx, txHashes[i])) continue;
+        
+        if (ctx->knownTxCount == ctx->knownTxCapacity && ctx->knownTxCapacity < MAX_KNOWN_TX_HASHES) {
+            _btcPeerKnownTxGrow(ctx);
+        }
+        
+        if (ctx->knownTxCount == ctx->knownTxCapacity) { // full, forget the oldest
+            _btcPeerKnownTxIndexRemove(ctx, ctx->knownTxNext);
         }
+        else ctx->knownTxCount++;
+        
+        ctx->knownTxHashes[ctx->knownTxNext] = txHashes[i];
+        _btcPeerKnownTxIndexInsert(ctx, ctx->knownTxNext);
+        ctx->knownTxNext = (ctx->knownTxNext + 1) % ctx->knownTxCapacity;
+        if (addedHashes) addedHashes[count] = txHashes[i];
+        count++;
     }
+    
+    pthread_mutex_unlock(&ctx->lock);
+    return count;
 }
 
 static void _btcPeerDidConnect(BRBitcoinPeer *peer)
@@ -376,17 +472,21 @@ static int _btcPeerAcceptInvMessage(BRBitcoinPeer *peer, const uint8_t *msg, siz
             }
         
             if (ctx->needsFilterUpdate) blockCount = 0;
+
+            // during a parallel chain download the blocks are requested, and further getblocks are sent, by the callee
+            if (blockCount > 0 && ctx->relayedBlockHashes &&
+                ctx->relayedBlockHashes(ctx->info, blockHashes, blockCount)) blockCount = 0;
         
             for (i = 0, j = 0; i < txCount; i++) {
                 hash = UInt256Get(transactions[i]);
                 
-                if (BRSetContains(ctx->knownTxHashSet, &hash)) {
+                if (_btcPeerHasKnownTxHash(peer, hash)) {
                     if (ctx->hasTx) ctx->hasTx(ctx->info, hash);
                 }
                 else txHashes[j++] = hash;
             }
             
-            _btcPeerAddKnownTxHashes(peer, txHashes, j);
+            _btcPeerAddKnownTxHashes(peer, txHashes, j, NULL);
             if (j > 0 || blockCount > 0) btcPeerSendGetdata(peer, txHashes, j, blockHashes, blockCount);
     
             // to improve chain download performance, if we received 500 block hashes, request the next 500 block hashes
@@ -459,52 +559,54 @@ static int _btcPeerAcceptTxMessage(BRBitcoinPeer *peer, const uint8_t *msg, size
 static int _btcPeerAcceptHeadersMessage(BRBitcoinPeer *peer, const uint8_t *msg, size_t msgLen)
 {
     BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
-    size_t i, off = 0, count = (size_t)BRVarInt(msg, msgLen, &off);
+    size_t i, n, off = 0, count = (size_t)BRVarInt(msg, msgLen, &off);
     int sentRequest = 0, r = 1;
     uint32_t timestamp = (count > 0 && msgLen >= 81) ? UInt32GetLE(&msg[(msgLen - 81) + 68]) : 0;
     time_t now = time(NULL); // TODO: use estimated network time instead of system time (avoids timejacking attacks)
     UInt256 locators[2];
-    BRBitcoinMerkleBlock *block;
+    BRBitcoinMerkleBlock *block, **blocks;
     
     peer_log(peer, "got %zu header(s)", count);
     
-    if (count < 2000 && (timestamp == 0 || timestamp + 7*24*60*60 + BLOCK_MAX_TIME_DRIFT < ctx->earliestKeyTime)) {
+    if (count < 2000 && ! ctx->compactFilterSync &&
+        (timestamp == 0 || timestamp + 7*24*60*60 + BLOCK_MAX_TIME_DRIFT < ctx->earliestKeyTime)) {
         peer_log(peer, "non-standard headers message, %zu is fewer header(s) than expected", count);
         r = 0;
     }
+    
+    n = (off <= msgLen && count > (msgLen - off)/81) ? (msgLen - off)/81 : count; // headers that can fit in msg
+    blocks = (r && n > 0) ? malloc(n*sizeof(*blocks)) : NULL;
+    assert(blocks != NULL || ! r || n == 0);
+    n = (blocks) ? btcMerkleBlockParseHeaders(&msg[off], msgLen - off, n, (uint32_t)now,
+                                                      ctx->verifyProofOfWork, blocks) : 0;
+    
+    if (r && n < count) {
+        peer_log(peer, "malformed or invalid block header at index %zu in headers message with length: %zu", n, msgLen);
+        r = 0;
+    }
                 
-    for (i = 0; r && i < count && off + 80 <= msgLen; i++) {
-        block = btcMerkleBlockParse(&msg[off], msgLen - off);
-        
-        if (! block) {
-            peer_log(peer, "malformed headers message with length: %zu", msgLen);
-            r = 0;
-        }
-        else if (! btcMerkleBlockIsValid(block, (uint32_t)now)) {
-            peer_log(peer, "invalid block header: %s", u256hex(block->blockHash));
-            btcMerkleBlockFree(block);
-            r = 0;
-        }
-        else {
-            if (i == 0) locators[1] = block->blockHash;
+    for (i = 0; i < n; i++) {
+        block = blocks[i];
+        if (i == 0) locators[1] = block->blockHash;
             
-            if (! sentRequest && block->timestamp + 7*24*60*60 + BLOCK_MAX_TIME_DRIFT >= ctx->earliestKeyTime) {
-                locators[0] = block->blockHash;
-                btcPeerSendGetblocks(peer, locators, 2, UINT256_ZERO); // switch to requesting filtered blocks
-                sentRequest = 1;
-            }
-            else if (! sentRequest && i + 1 == count) {
-                locators[0] = block->blockHash;
-                btcPeerSendGetheaders(peer, locators, 2, UINT256_ZERO); // request next 2000 headers
-                sentRequest = 1;
-            }
-                
-            off += (block->version >> 16 != 0) ? btcMerkleBlockSerialize(block, NULL, 0) + 1 : 81;
-            if (ctx->relayedBlock) ctx->relayedBlock(ctx->info, block);
-            else btcMerkleBlockFree(block);
+        if (! sentRequest && ! ctx->compactFilterSync &&
+            block->timestamp + 7*24*60*60 + BLOCK_MAX_TIME_DRIFT >= ctx->earliestKeyTime) {
+            locators[0] = block->blockHash;
+            btcPeerSendGetblocks(peer, locators, 2, UINT256_ZERO); // switch to requesting filtered blocks
+            sentRequest = 1;
+        }
+        else if (! sentRequest && i + 1 == count && (! ctx->compactFilterSync || count >= 2000)) {
+            locators[0] = block->blockHash;
+            btcPeerSendGetheaders(peer, locators, 2, UINT256_ZERO); // request next 2000 headers
+            sentRequest = 1;
         }
     }
     
+    if (n > 0 && ctx->relayedHeaders) ctx->relayedHeaders(ctx->info, blocks, n);
+    else if (ctx->relayedBlock) for (i = 0; i < n; i++) ctx->relayedBlock(ctx->info, blocks[i]);
+    else for (i = 0; i < n; i++) btcMerkleBlockFree(blocks[i]);
+    
+    if (blocks) free(blocks);
     return r;
 }
 
@@ -702,13 +804,16 @@ static int _btcPeerAcceptMerkleblockMessage(BRBitcoinPeer *peer, const uint8_t *
     // non-tx message is received we should have all the tx in the merkleblock.
     BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
     BRBitcoinMerkleBlock *block = btcMerkleBlockParse(msg, msgLen);
+    UInt256 _hashes[128], *hashes = _hashes;
+    size_t count = sizeof(_hashes)/sizeof(*_hashes);
     int r = 1;
   
     if (! block) {
         peer_log(peer, "malformed merkleblock message with length: %zu", msgLen);
         r = 0;
     }
-    else if (! btcMerkleBlockIsValid(block, (uint32_t)time(NULL))) {
+    else if (! btcMerkleBlockIsValidWithTxHashes(block, (uint32_t)time(NULL), _hashes, &count) ||
+             (ctx->verifyProofOfWork && ! ctx->verifyProofOfWork(block))) {
         peer_log(peer, "invalid merkleblock: %s", u256hex(block->blockHash));
         btcMerkleBlockFree(block);
         block = NULL;
@@ -721,14 +826,14 @@ static int _btcPeerAcceptMerkleblockMessage(BRBitcoinPeer *peer, const uint8_t *
         r = 0;
     }
     else {
-        size_t count = btcMerkleBlockTxHashes(block, NULL, 0);
-        UInt256 _hashes[128], *hashes = (count <= 128) ? _hashes : malloc(count*sizeof(UInt256));
-        
-        assert(hashes != NULL);
-        count = btcMerkleBlockTxHashes(block, hashes, count);
+        if (count > sizeof(_hashes)/sizeof(*_hashes)) { // more matches than fit on the stack
+            hashes = malloc(count*sizeof(UInt256));
+            assert(hashes != NULL);
+            count = btcMerkleBlockTxHashes(block, hashes, count);
+        }
 
         for (size_t i = count; i > 0; i--) { // reverse order for more efficient removal as tx arrive
-            if (BRSetContains(ctx->knownTxHashSet, &hashes[i - 1])) continue;
+            if (_btcPeerHasKnownTxHash(peer, hashes[i - 1])) continue;
             array_add(ctx->currentBlockTxHashes, hashes[i - 1]);
         }
 
@@ -820,6 +925,147 @@ static int _btcPeerAcceptFeeFilterMessage(BRBitcoinPeer *peer, const uint8_t *ms
     return r;
 }
 
+// merkle root of a complete list of block transaction hashes
+static UInt256 _btcPeerMerkleRoot(const UInt256 txHashes[], size_t txCount)
+{
+    UInt256 _level[128], *level = (txCount <= 128) ? _level : malloc(txCount*sizeof(*level)), root = UINT256_ZERO;
+    uint8_t buf[sizeof(UInt256)*2];
+    size_t i, count = txCount;
+
+    assert(level != NULL);
+    if (count > 0) memcpy(level, txHashes, count*sizeof(*level));
+
+    while (count > 1) {
+        for (i = 0; i < count; i += 2) { // an odd node at the end of a level is paired with itself
+            UInt256Set(buf, level[i]);
+            UInt256Set(&buf[sizeof(UInt256)], level[(i + 1 < count) ? i + 1 : i]);
+            BRSHA256_2(&level[i/2], buf, sizeof(buf));
+        }
+
+        count = (count + 1)/2;
+    }
+
+    if (count == 1) root = level[0];
+    if (level != _level) free(level);
+    return root;
+}
+
+static int _btcPeerAcceptBlockMessage(BRBitcoinPeer *peer, const uint8_t *msg, size_t msgLen)
+{
+    BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
+    BRBitcoinMerkleBlock *block = (msgLen >= 80) ? btcMerkleBlockParse(msg, 80) : NULL;
+    size_t i, off = 80, len = 0, count = (block) ? (size_t)BRVarInt(&msg[off], msgLen - off, &len) : 0;
+    int r = 1;
+
+    if (! block || len == 0 || count == 0 || count > msgLen/60) { // a transaction is at least 60 bytes
+        peer_log(peer, "malformed block message with length: %zu", msgLen);
+        if (block) btcMerkleBlockFree(block);
+        r = 0;
+    }
+    else if (! ctx->sentGetdata) {
+        peer_log(peer, "got block message before sending getdata");
+        btcMerkleBlockFree(block);
+        r = 0;
+    }
+    else if (ctx->verifyProofOfWork && ! ctx->verifyProofOfWork(block)) {
+        peer_log(peer, "invalid block: %s, proof-of-work too low", u256hex(block->blockHash));
+        btcMerkleBlockFree(block);
+        r = 0;
+    }
+    else {
+        BRBitcoinTransaction **txs = calloc(count, sizeof(*txs));
+        UInt256 *txHashes = calloc(count, sizeof(*txHashes));
+
+        assert(txs != NULL);
+        assert(txHashes != NULL);
+        off += len;
+
+        for (i = 0; r && i < count; i++) {
+            txs[i] = btcTransactionParse(&msg[off], msgLen - off);
+            if (txs[i]) txHashes[i] = txs[i]->txHash, off += btcTransactionSerialize(txs[i], NULL, 0);
+            else r = 0;
+        }
+
+        if (r && ! UInt256Eq(_btcPeerMerkleRoot(txHashes, count), block->merkleRoot)) {
+            peer_log(peer, "invalid block: %s, merkle root mismatch", u256hex(block->blockHash));
+            r = 0;
+        }
+        else if (! r) peer_log(peer, "malformed block message with length: %zu", msgLen);
+
+        if (r) {
+            peer_log(peer, "got block: %s with %zu tx", u256hex(block->blockHash), count);
+            block->totalTx = (uint32_t)count;
+        }
+
+        if (r && ctx->relayedFullBlock) ctx->relayedFullBlock(ctx->info, block, txs, count);
+        else {
+            for (i = 0; i < count; i++) if (txs[i]) btcTransactionFree(txs[i]);
+            btcMerkleBlockFree(block);
+        }
+
+        free(txHashes);
+        free(txs);
+    }
+
+    return r;
+}
+
+// described in BIP157: https://github.com/bitcoin/bips/blob/master/bip-0157.mediawiki
+static int _btcPeerAcceptCfheadersMessage(BRBitcoinPeer *peer, const uint8_t *msg, size_t msgLen)
+{
+    BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
+    size_t off = 1 + sizeof(UInt256)*2, len = 0,
+           count = (msgLen > off) ? (size_t)BRVarInt(&msg[off], msgLen - off, &len) : 0;
+    int r = 1;
+
+    if (len == 0 || count > BLOCK_FILTER_MAX_CFHEADERS || off + len + count*sizeof(UInt256) > msgLen) {
+        peer_log(peer, "malformed cfheaders message with length: %zu", msgLen);
+        r = 0;
+    }
+    else if (msg[0] != BLOCK_FILTER_TYPE_BASIC) {
+        peer_log(peer, "dropping cfheaders with unknown filter type %d", msg[0]);
+    }
+    else {
+        UInt256 stopHash = UInt256Get(&msg[1]), prevHeader = UInt256Get(&msg[1 + sizeof(UInt256)]);
+        UInt256 filterHashes[(count > 0) ? count : 1];
+
+        off += len;
+        for (size_t i = 0; i < count; i++) filterHashes[i] = UInt256Get(&msg[off + i*sizeof(UInt256)]);
+        peer_log(peer, "got cfheaders with %zu filter hash(es)", count);
+        if (ctx->relayedFilterHeaders) ctx->relayedFilterHeaders(ctx->info, stopHash, prevHeader, filterHashes, count);
+    }
+
+    return r;
+}
+
+// described in BIP157: https://github.com/bitcoin/bips/blob/master/bip-0157.mediawiki
+static int _btcPeerAcceptCfilterMessage(BRBitcoinPeer *peer, const uint8_t *msg, size_t msgLen)
+{
+    BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
+    size_t off = 1 + sizeof(UInt256), len = 0,
+           filterLen = (msgLen > off) ? (size_t)BRVarInt(&msg[off], msgLen - off, &len) : 0;
+    BRBitcoinBlockFilter *filter = NULL;
+    int r = 1;
+
+    if (len > 0 && off + len + filterLen <= msgLen && msg[0] == BLOCK_FILTER_TYPE_BASIC) {
+        filter = btcBlockFilterParse(UInt256Get(&msg[1]), &msg[off + len], filterLen);
+    }
+
+    if (len > 0 && off + len + filterLen <= msgLen && msg[0] != BLOCK_FILTER_TYPE_BASIC) {
+        peer_log(peer, "dropping cfilter with unknown filter type %d", msg[0]);
+    }
+    else if (! filter) {
+        peer_log(peer, "malformed cfilter message with length: %zu", msgLen);
+        r = 0;
+    }
+    else if (ctx->relayedFilter) {
+        ctx->relayedFilter(ctx->info, filter);
+    }
+    else btcBlockFilterFree(filter);
+
+    return r;
+}
+
 static int _btcPeerAcceptMessage(BRBitcoinPeer *peer, const uint8_t *msg, size_t msgLen, const char *type)
 {
     BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
@@ -846,6 +1092,9 @@ static int _btcPeerAcceptMessage(BRBitcoinPeer *peer, const uint8_t *msg, size_t
     else if (strncmp(MSG_MERKLEBLOCK, type, 12) == 0) r = _btcPeerAcceptMerkleblockMessage(peer, msg, msgLen);
     else if (strncmp(MSG_REJECT, type, 12) == 0) r = _btcPeerAcceptRejectMessage(peer, msg, msgLen);
     else if (strncmp(MSG_FEEFILTER, type, 12) == 0) r = _btcPeerAcceptFeeFilterMessage(peer, msg, msgLen);
+    else if (strncmp(MSG_BLOCK, type, 12) == 0) r = _btcPeerAcceptBlockMessage(peer, msg, msgLen);
+    else if (strncmp(MSG_CFHEADERS, type, 12) == 0) r = _btcPeerAcceptCfheadersMessage(peer, msg, msgLen);
+    else if (strncmp(MSG_CFILTER, type, 12) == 0) r = _btcPeerAcceptCfilterMessage(peer, msg, msgLen);
     else peer_log(peer, "dropping %s, length %zu, not implemented", type, msgLen);
 
     return r;
@@ -1119,8 +1368,7 @@ BRBitcoinPeer *btcPeerNew(uint32_t magicNumber)
     array_new(ctx->useragent, 40);
     array_new(ctx->knownBlockHashes, 10);
     array_new(ctx->currentBlockTxHashes, 10);
-    array_new(ctx->knownTxHashes, 10);
-    ctx->knownTxHashSet = BRSetNew(btcTransactionHash, btcTransactionEq, 10);
+    ctx->knownTxSalt = ((uint64_t)BRRand(0) << 32) | (uint64_t)BRRand(0);
     array_new(ctx->pongInfo, 10);
     array_new(ctx->pongCallback, 10);
     ctx->pingTime = DBL_MAX;
@@ -1128,6 +1376,7 @@ BRBitcoinPeer *btcPeerNew(uint32_t magicNumber)
     ctx->disconnectTime = DBL_MAX;
     ctx->socket = -1;
     ctx->threadCleanup = _dummyThreadCleanup;
+    ctx->verifyProofOfWork = btcMerkleBlockVerifyProofOfWork;
 
     {
         pthread_mutexattr_t attr;
@@ -1184,18 +1433,69 @@ void btcPeerSetCallbacks(BRBitcoinPeer *peer, void *info,
     ctx->threadCleanup = (threadCleanup) ? threadCleanup : _dummyThreadCleanup;
 }
 
+// callbacks used when syncing with compact block filters, see btcPeerSetCompactFilterSync()
+// void relayedFilterHeaders(void *, UInt256, UInt256, const UInt256[], size_t) - called when a "cfheaders" message is
+// - received from peer, with the stop hash, previous filter header, and filter hashes up to and including the stop block
+// void relayedFilter(void *, BRBitcoinBlockFilter *) - called when a "cfilter" message is received from peer
+// void relayedFullBlock(void *, BRBitcoinMerkleBlock *, BRBitcoinTransaction *[], size_t) - called when a "block"
+// - message is received from peer, the block header and each transaction must be freed or retained by the callee
+void btcPeerSetCompactFilterCallbacks(BRBitcoinPeer *peer,
+                                      void (*relayedFilterHeaders)(void *info, UInt256 stopHash, UInt256 prevHeader,
+                                                                   const UInt256 filterHashes[], size_t count),
+                                      void (*relayedFilter)(void *info, BRBitcoinBlockFilter *filter),
+                                      void (*relayedFullBlock)(void *info, BRBitcoinMerkleBlock *block,
+                                                               BRBitcoinTransaction *txs[], size_t txCount))
+{
+    BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
+
+    ctx->relayedFilterHeaders = relayedFilterHeaders;
+    ctx->relayedFilter = relayedFilter;
+    ctx->relayedFullBlock = relayedFullBlock;
+}
+
+// int relayedBlockHashes(void *, const UInt256[], size_t) - called when an "inv" message with block hashes is received
+// - from peer, return true if the callee will request the blocks itself, in which case the peer also won't send the next
+// - getblocks request
+void btcPeerSetBlockHashesCallback(BRBitcoinPeer *peer,
+                                   int (*relayedBlockHashes)(void *info, const UInt256 blockHashes[], size_t blockCount))
+{
+    ((BRBitcoinPeerContext *)peer)->relayedBlockHashes = relayedBlockHashes;
+}
+
+// void relayedHeaders(void *, BRBitcoinMerkleBlock *[], size_t) - called with each batch of headers that was received,
+// - hashed and checked in a "headers" message, in place of calling relayedBlock for each one
+void btcPeerSetHeadersCallback(BRBitcoinPeer *peer,
+                               void (*relayedHeaders)(void *info, BRBitcoinMerkleBlock *blocks[], size_t blockCount))
+{
+    ((BRBitcoinPeerContext *)peer)->relayedHeaders = relayedHeaders;
+}
+
 // set earliestKeyTime to wallet creation time in order to speed up initial sync
 void btcPeerSetEarliestKeyTime(BRBitcoinPeer *peer, uint32_t earliestKeyTime)
 {
     ((BRBitcoinPeerContext *)peer)->earliestKeyTime = earliestKeyTime;
 }
 
+// set to true to download all block headers up to the chain tip instead of switching to filtered blocks after
+// earliestKeyTime, transactions are then found with compact block filters
+void btcPeerSetCompactFilterSync(BRBitcoinPeer *peer, int compactFilterSync)
+{
+    ((BRBitcoinPeerContext *)peer)->compactFilterSync = compactFilterSync;
+}
+
 // call this when local block height changes (helps detect tarpit nodes)
 void btcPeerSetCurrentBlockHeight(BRBitcoinPeer *peer, uint32_t currentBlockHeight)
 {
     ((BRBitcoinPeerContext *)peer)->currentBlockHeight = currentBlockHeight;
 }
 
+// int verifyProofOfWork(const BRBitcoinMerkleBlock *) - the chain's check that a header's hash meets its stated target,
+// - run on the peer thread for each block and header received, defaults to SHA256d, NULL skips the check
+void btcPeerSetVerifyProofOfWork(BRBitcoinPeer *peer, int (*verifyProofOfWork)(const BRBitcoinMerkleBlock *block))
+{
+    ((BRBitcoinPeerContext *)peer)->verifyProofOfWork = verifyProofOfWork;
+}
+
 // current connection status
 BRBitcoinPeerStatus btcPeerConnectStatus(BRBitcoinPeer *peer)
 {
@@ -1455,7 +1755,7 @@ void btcPeerSendMempool(BRBitcoinPeer *peer, const UInt256 knownTxHashes[], size
     ctx->sentMempool = 1;
     
     if (! sentMempool && ! ctx->mempoolCallback) {
-        _btcPeerAddKnownTxHashes(peer, knownTxHashes, knownTxCount);
+        _btcPeerAddKnownTxHashes(peer, knownTxHashes, knownTxCount, NULL);
         
         if (completionCallback) {
             gettimeofday(&tv, NULL);
@@ -1528,11 +1828,10 @@ void btcPeerSendGetblocks(BRBitcoinPeer *peer, const UInt256 locators[], size_t
 
 void btcPeerSendInv(BRBitcoinPeer *peer, const UInt256 txHashes[], size_t txCount)
 {
-    BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
-    size_t knownCount = array_count(ctx->knownTxHashes);
-
-    _btcPeerAddKnownTxHashes(peer, txHashes, txCount);
-    txCount = array_count(ctx->knownTxHashes) - knownCount;
+    UInt256 _hashes[128], *hashes = (txCount <= 128) ? _hashes : malloc(txCount*sizeof(UInt256));
+    
+    assert(hashes != NULL);
+    txCount = _btcPeerAddKnownTxHashes(peer, txHashes, txCount, hashes);
 
     if (txCount > 0) {
         size_t i, off = 0, msgLen = BRVarIntSize(txCount) + (sizeof(uint32_t) + sizeof(*txHashes))*txCount;
@@ -1543,12 +1842,14 @@ void btcPeerSendInv(BRBitcoinPeer *peer, const UInt256 txHashes[], size_t txCoun
         for (i = 0; i < txCount; i++) {
             UInt32SetLE(&msg[off], inv_tx);
             off += sizeof(uint32_t);
-            UInt256Set(&msg[off], ctx->knownTxHashes[knownCount + i]);
+            UInt256Set(&msg[off], hashes[i]);
             off += sizeof(UInt256);
         }
 
         btcPeerSendMessage(peer, msg, off, MSG_INV);
     }
+    
+    if (hashes != _hashes) free(hashes);
 }
 
 void btcPeerSendGetdata(BRBitcoinPeer *peer, const UInt256 txHashes[], size_t txCount, const UInt256 blockHashes[],
@@ -1585,6 +1886,56 @@ void btcPeerSendGetdata(BRBitcoinPeer *peer, const UInt256 txHashes[], size_t tx
     }
 }
 
+// requests complete blocks, rather than the filtered blocks requested by btcPeerSendGetdata()
+void btcPeerSendGetfullblocks(BRBitcoinPeer *peer, const UInt256 blockHashes[], size_t blockCount)
+{
+    size_t i, off = 0;
+
+    if (blockCount > MAX_GETDATA_HASHES) { // limit total hash count to MAX_GETDATA_HASHES
+        peer_log(peer, "couldn't send getdata, %zu is too many items, max is %d", blockCount, MAX_GETDATA_HASHES);
+    }
+    else if (blockCount > 0) {
+        size_t msgLen = BRVarIntSize(blockCount) + (sizeof(uint32_t) + sizeof(UInt256))*blockCount;
+        uint8_t msg[msgLen];
+        uint32_t type = ((peer->services & SERVICES_NODE_WITNESS) == SERVICES_NODE_WITNESS) ? inv_witness_block :
+                        inv_block;
+
+        off += BRVarIntSet(&msg[off], (off <= msgLen ? msgLen - off : 0), blockCount);
+
+        for (i = 0; i < blockCount; i++) {
+            UInt32SetLE(&msg[off], type);
+            off += sizeof(uint32_t);
+            UInt256Set(&msg[off], blockHashes[i]);
+            off += sizeof(UInt256);
+        }
+
+        ((BRBitcoinPeerContext *)peer)->sentGetdata = 1;
+        btcPeerSendMessage(peer, msg, off, MSG_GETDATA);
+    }
+}
+
+static void _btcPeerSendCompactFilterRequest(BRBitcoinPeer *peer, uint32_t startHeight, UInt256 stopHash,
+                                             const char *type)
+{
+    uint8_t msg[1 + sizeof(uint32_t) + sizeof(UInt256)];
+
+    msg[0] = BLOCK_FILTER_TYPE_BASIC;
+    UInt32SetLE(&msg[1], startHeight);
+    UInt256Set(&msg[1 + sizeof(uint32_t)], stopHash);
+    peer_log(peer, "calling %s from height %"PRIu32" to %s", type, startHeight, u256hex(stopHash));
+    btcPeerSendMessage(peer, msg, sizeof(msg), type);
+}
+
+void btcPeerSendGetcfheaders(BRBitcoinPeer *peer, uint32_t startHeight, UInt256 stopHash)
+{
+    _btcPeerSendCompactFilterRequest(peer, startHeight, stopHash, MSG_GETCFHEADERS);
+}
+
+void btcPeerSendGetcfilters(BRBitcoinPeer *peer, uint32_t startHeight, UInt256 stopHash)
+{
+    _btcPeerSendCompactFilterRequest(peer, startHeight, stopHash, MSG_GETCFILTERS);
+}
+
 void btcPeerSendGetaddr(BRBitcoinPeer *peer)
 {
     ((BRBitcoinPeerContext *)peer)->sentGetaddr = 1;
@@ -1627,8 +1978,8 @@ void btcPeerFree(BRBitcoinPeer *peer)
     if (ctx->useragent) array_free(ctx->useragent);
     if (ctx->currentBlockTxHashes) array_free(ctx->currentBlockTxHashes);
     if (ctx->knownBlockHashes) array_free(ctx->knownBlockHashes);
-    if (ctx->knownTxHashes) array_free(ctx->knownTxHashes);
-    if (ctx->knownTxHashSet) BRSetFree(ctx->knownTxHashSet);
+    if (ctx->knownTxHashes) free(ctx->knownTxHashes);
+    if (ctx->knownTxIndex) free(ctx->knownTxIndex);
     if (ctx->pongCallback) array_free(ctx->pongCallback);
     if (ctx->pongInfo) array_free(ctx->pongInfo);
     
@@ -1640,3 +1991,26 @@ void btcPeerAcceptMessageTest(BRBitcoinPeer *peer, const uint8_t *msg, size_t ms
 {
     _btcPeerAcceptMessage(peer, msg, msgLen, type);
 }
+
+// completes the handshake with a peer that has no socket, as if it sent the given version and lastblock
+void btcPeerConnectedTest(BRBitcoinPeer *peer, uint32_t version, uint32_t lastblock)
+{
+    BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->version = version;
+    ctx->lastblock = lastblock;
+    ctx->sentVerack = ctx->gotVerack = 1;
+    ctx->status = BRPeerStatusConnected;
+    ctx->disconnectTime = DBL_MAX;
+    pthread_mutex_unlock(&ctx->lock);
+    if (ctx->connected) ctx->connected(ctx->info);
+}
+
+// runs the cleanup the peer thread would run on exit, for a peer that has no thread
+void btcPeerThreadCleanupTest(BRBitcoinPeer *peer)
+{
+    BRBitcoinPeerContext *ctx = (BRBitcoinPeerContext *)peer;
+
+    ctx->threadCleanup(ctx->info);
+}
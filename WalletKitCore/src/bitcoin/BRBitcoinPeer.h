@@ -27,6 +27,7 @@
 
 #include "BRBitcoinTransaction.h"
 #include "BRBitcoinMerkleBlock.h"
+#include "BRBitcoinBlockFilter.h"
 #include "support/BRAddress.h"
 #include "support/BRInt.h"
 #include <stddef.h>
@@ -56,6 +57,7 @@ extern "C" {
 #define SERVICES_NODE_BLOOM   0x04 // BIP111: https://github.com/bitcoin/bips/blob/master/bip-0111.mediawiki
 #define SERVICES_NODE_WITNESS 0x08 // BIP144: https://github.com/bitcoin/bips/blob/master/bip-0144.mediawiki
 #define SERVICES_NODE_BCASH   0x20 // https://github.com/Bitcoin-UAHF/spec/blob/master/uahf-technical-spec.md
+#define SERVICES_NODE_COMPACT_FILTERS 0x40 // BIP157: https://github.com/bitcoin/bips/blob/master/bip-0157.mediawiki
     
 #define BR_VERSION "2.1"
 #define USER_AGENT "/bread:" BR_VERSION "/"
@@ -83,6 +85,10 @@ extern "C" {
 #define MSG_ALERT       "alert"
 #define MSG_REJECT      "reject"   // described in BIP61: https://github.com/bitcoin/bips/blob/master/bip-0061.mediawiki
 #define MSG_FEEFILTER   "feefilter"// described in BIP133 https://github.com/bitcoin/bips/blob/master/bip-0133.mediawiki
+#define MSG_GETCFILTERS "getcfilters" // described in BIP157 https://github.com/bitcoin/bips/blob/master/bip-0157.mediawiki
+#define MSG_CFILTER     "cfilter"
+#define MSG_GETCFHEADERS "getcfheaders"
+#define MSG_CFHEADERS   "cfheaders"
 
 #define REJECT_INVALID     0x10 // transaction is invalid for some reason (invalid signature, output value > input, etc)
 #define REJECT_SPENT       0x12 // an input is already spent
@@ -138,12 +144,44 @@ void btcPeerSetCallbacks(BRBitcoinPeer *peer, void *info,
                         int (*networkIsReachable)(void *info),
                         void (*threadCleanup)(void *info));
 
+// callbacks used when syncing with compact block filters, see btcPeerSetCompactFilterSync()
+// void relayedFilterHeaders(void *, UInt256, UInt256, const UInt256[], size_t) - called when a "cfheaders" message is
+// - received from peer, with the stop hash, previous filter header, and filter hashes up to and including the stop block
+// void relayedFilter(void *, BRBitcoinBlockFilter *) - called when a "cfilter" message is received from peer
+// void relayedFullBlock(void *, BRBitcoinMerkleBlock *, BRBitcoinTransaction *[], size_t) - called when a "block"
+// - message is received from peer, the block header and each transaction must be freed or retained by the callee
+void btcPeerSetCompactFilterCallbacks(BRBitcoinPeer *peer,
+                                      void (*relayedFilterHeaders)(void *info, UInt256 stopHash, UInt256 prevHeader,
+                                                                   const UInt256 filterHashes[], size_t count),
+                                      void (*relayedFilter)(void *info, BRBitcoinBlockFilter *filter),
+                                      void (*relayedFullBlock)(void *info, BRBitcoinMerkleBlock *block,
+                                                               BRBitcoinTransaction *txs[], size_t txCount));
+
+// int relayedBlockHashes(void *, const UInt256[], size_t) - called when an "inv" message with block hashes is received
+// - from peer, return true if the callee will request the blocks itself, in which case the peer also won't send the next
+// - getblocks request
+void btcPeerSetBlockHashesCallback(BRBitcoinPeer *peer,
+                                   int (*relayedBlockHashes)(void *info, const UInt256 blockHashes[], size_t blockCount));
+
+// void relayedHeaders(void *, BRBitcoinMerkleBlock *[], size_t) - called with each batch of headers that was received,
+// - hashed and checked in a "headers" message, in place of calling relayedBlock for each one
+void btcPeerSetHeadersCallback(BRBitcoinPeer *peer,
+                               void (*relayedHeaders)(void *info, BRBitcoinMerkleBlock *blocks[], size_t blockCount));
+
 // set earliestKeyTime to wallet creation time in order to speed up initial sync
 void btcPeerSetEarliestKeyTime(BRBitcoinPeer *peer, uint32_t earliestKeyTime);
 
+// set to true to download all block headers up to the chain tip instead of switching to filtered blocks after
+// earliestKeyTime, transactions are then found with compact block filters
+void btcPeerSetCompactFilterSync(BRBitcoinPeer *peer, int compactFilterSync);
+
 // call this when local best block height changes (helps detect tarpit nodes)
 void btcPeerSetCurrentBlockHeight(BRBitcoinPeer *peer, uint32_t currentBlockHeight);
 
+// int verifyProofOfWork(const BRBitcoinMerkleBlock *) - the chain's check that a header's hash meets its stated target,
+// - run on the peer thread for each block and header received, defaults to SHA256d, NULL skips the check
+void btcPeerSetVerifyProofOfWork(BRBitcoinPeer *peer, int (*verifyProofOfWork)(const BRBitcoinMerkleBlock *block));
+
 // current connection status
 BRBitcoinPeerStatus btcPeerConnectStatus(BRBitcoinPeer *peer);
 
@@ -188,6 +226,9 @@ void btcPeerSendInv(BRBitcoinPeer *peer, const UInt256 txHashes[], size_t txCoun
 void btcPeerSendGetdata(BRBitcoinPeer *peer, const UInt256 txHashes[], size_t txCount, const UInt256 blockHashes[],
                         size_t blockCount);
 void btcPeerSendGetaddr(BRBitcoinPeer *peer);
+void btcPeerSendGetfullblocks(BRBitcoinPeer *peer, const UInt256 blockHashes[], size_t blockCount);
+void btcPeerSendGetcfheaders(BRBitcoinPeer *peer, uint32_t startHeight, UInt256 stopHash);
+void btcPeerSendGetcfilters(BRBitcoinPeer *peer, uint32_t startHeight, UInt256 stopHash);
 void btcPeerSendPing(BRBitcoinPeer *peer, void *info, void (*pongCallback)(void *info, int success));
 
 // useful to get additional tx after a bloom filter update
@@ -24,6 +24,8 @@
 
 #include "BRBitcoinPeerManager.h"
 #include "BRBitcoinBloomFilter.h"
+#include "BRBitcoinBlockFilter.h"
+#include "BRBitcoinBlockWindows.h"
 #include "support/BRSet.h"
 #include "support/BRArray.h"
 #include "support/BRInt.h"
@@ -32,6 +34,7 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <time.h>
+#include <sys/time.h>
 #include <assert.h>
 #include <pthread.h>
 #include <errno.h>
@@ -43,6 +46,12 @@
 #define MAX_CONNECT_FAILURES  20 // notify user of network problems after this many connect failures in a row
 #define PEER_FLAG_SYNCED      0x01
 #define PEER_FLAG_NEEDSUPDATE 0x02
+#define PEER_FLAG_NOBLOOM     0x04 // peer was synced with compact filters and hasn't been sent a bloom filter
+#define PEER_FLAG_SYNCHELPER  0x08 // peer has been sent a bloom filter to help with a parallel chain download
+
+#define BLOCK_WINDOW_MAX_PENDING 2000 // max blocks held for reassembly before pausing further getblocks requests
+#define BLOCK_RESIDENT_MIN       150  // fewest recent blocks held in memory, covers every chain's difficulty look-back
+#define BLOCK_TRIM_INTERVAL      500  // blocks added to the chain between trims of older blocks held in memory
 
 #define genesis_block_hash(params) UInt256Reverse((params)->checkpoints[0].hash)
 
@@ -65,74 +74,95 @@ typedef struct {
 } BRPublishedTx;
 
 typedef struct {
-    UInt256 txHash;
+    UInt256 txHash; // must be first, entries are kept in a BRSet keyed with btcTransactionHash()/btcTransactionEq()
     BRBitcoinPeer *peers;
 } BRTxPeerList;
 
+typedef struct {
+    UInt256 blockHash;
+    uint32_t height;
+} BRFilterMatch;
+
 // true if peer is contained in the list of peers associated with txHash
-static int _BRTxPeerListHasPeer(const BRTxPeerList *list, UInt256 txHash, const BRBitcoinPeer *peer)
+static int _BRTxPeerListHasPeer(const BRSet *list, UInt256 txHash, const BRBitcoinPeer *peer)
 {
-    for (size_t i = array_count(list); i > 0; i--) {
-        if (! UInt256Eq(list[i - 1].txHash, txHash)) continue;
-
-        for (size_t j = array_count(list[i - 1].peers); j > 0; j--) {
-            if (btcPeerEq(&list[i - 1].peers[j - 1], peer)) return 1;
-        }
-        
-        break;
+    const BRTxPeerList *peerList = BRSetGet(list, &txHash);
+    
+    for (size_t i = (peerList) ? array_count(peerList->peers) : 0; i > 0; i--) {
+        if (btcPeerEq(&peerList->peers[i - 1], peer)) return 1;
     }
     
     return 0;
 }
 
 // number of peers associated with txHash
-static size_t _BRTxPeerListCount(const BRTxPeerList *list, UInt256 txHash)
+static size_t _BRTxPeerListCount(const BRSet *list, UInt256 txHash)
 {
-    for (size_t i = array_count(list); i > 0; i--) {
-        if (UInt256Eq(list[i - 1].txHash, txHash)) return array_count(list[i - 1].peers);
-    }
+    const BRTxPeerList *peerList = BRSetGet(list, &txHash);
     
-    return 0;
+    return (peerList) ? array_count(peerList->peers) : 0;
 }
 
 // adds peer to the list of peers associated with txHash and returns the new total number of peers
-static size_t _BRTxPeerListAddPeer(BRTxPeerList **list, UInt256 txHash, const BRBitcoinPeer *peer)
+static size_t _BRTxPeerListAddPeer(BRSet *list, UInt256 txHash, const BRBitcoinPeer *peer)
 {
-    for (size_t i = array_count(*list); i > 0; i--) {
-        if (! UInt256Eq((*list)[i - 1].txHash, txHash)) continue;
-        
-        for (size_t j = array_count((*list)[i - 1].peers); j > 0; j--) {
-            if (btcPeerEq(&(*list)[i - 1].peers[j - 1], peer)) return array_count((*list)[i - 1].peers);
-        }
-        
-        array_add((*list)[i - 1].peers, *peer);
-        return array_count((*list)[i - 1].peers);
+    BRTxPeerList *peerList = BRSetGet(list, &txHash);
+    
+    if (! peerList) {
+        peerList = calloc(1, sizeof(*peerList));
+        assert(peerList != NULL);
+        peerList->txHash = txHash;
+        array_new(peerList->peers, PEER_MAX_CONNECTIONS);
+        BRSetAdd(list, peerList);
+    }
+    
+    for (size_t i = array_count(peerList->peers); i > 0; i--) {
+        if (btcPeerEq(&peerList->peers[i - 1], peer)) return array_count(peerList->peers);
     }
+    
+    array_add(peerList->peers, *peer);
+    return array_count(peerList->peers);
+}
 
-    array_add(*list, ((const BRTxPeerList) { txHash, NULL }));
-    array_new((*list)[array_count(*list) - 1].peers, PEER_MAX_CONNECTIONS);
-    array_add((*list)[array_count(*list) - 1].peers, *peer);
-    return 1;
+static void _BRTxPeerListFree(void *peerList)
+{
+    array_free(((BRTxPeerList *)peerList)->peers);
+    free(peerList);
 }
 
-// removes peer from the list of peers associated with txHash, returns true if peer was found
-static int _BRTxPeerListRemovePeer(BRTxPeerList *list, UInt256 txHash, const BRBitcoinPeer *peer)
+// removes peer from the list of peers associated with txHash, dropping the list once it's empty so entries don't
+// accumulate over a long running session, returns true if peer was found
+static int _BRTxPeerListRemovePeer(BRSet *list, UInt256 txHash, const BRBitcoinPeer *peer)
 {
-    for (size_t i = array_count(list); i > 0; i--) {
-        if (! UInt256Eq(list[i - 1].txHash, txHash)) continue;
+    BRTxPeerList *peerList = BRSetGet(list, &txHash);
+    
+    for (size_t i = (peerList) ? array_count(peerList->peers) : 0; i > 0; i--) {
+        if (! btcPeerEq(&peerList->peers[i - 1], peer)) continue;
+        array_rm(peerList->peers, i - 1);
         
-        for (size_t j = array_count(list[i - 1].peers); j > 0; j--) {
-            if (! btcPeerEq(&list[i - 1].peers[j - 1], peer)) continue;
-            array_rm(list[i - 1].peers, j - 1);
-            return 1;
+        if (array_count(peerList->peers) == 0) {
+            BRSetRemove(list, peerList);
+            _BRTxPeerListFree(peerList);
         }
         
-        break;
+        return 1;
     }
     
     return 0;
 }
 
+// removes peer from the lists of peers associated with every tx
+static void _BRTxPeerListRemovePeerAll(BRSet *list, const BRBitcoinPeer *peer)
+{
+    size_t count = BRSetCount(list);
+    BRTxPeerList *_peerLists[128], **peerLists = (count <= 128) ? _peerLists : malloc(count*sizeof(*peerLists));
+    
+    assert(peerLists != NULL);
+    count = BRSetAll(list, (void **)peerLists, count);
+    for (size_t i = 0; i < count; i++) _BRTxPeerListRemovePeer(list, peerLists[i]->txHash, peer);
+    if (peerLists != _peerLists) free(peerLists);
+}
+
 // comparator for sorting peers by timestamp, most recent first
 inline static int _peerTimestampCompare(const void *peer, const void *otherPeer)
 {
@@ -177,7 +207,22 @@ struct BRBitcoinPeerManagerStruct {
     double fpRate, averageTxPerBlock;
     BRSet *blocks, *orphans, *checkpoints;
     BRBitcoinMerkleBlock *lastBlock, *lastOrphan;
-    BRTxPeerList *txRelays, *txRequests;
+    BRSet *txRelays, *txRequests; // BRTxPeerList sets, peers that relayed a tx and peers sent a getdata for it
+    int compactFilterSync, filterSyncing;
+    uint32_t filterStartHeight, filterHeight; // first block height to scan with compact filters, and the scan cursor
+    UInt256 filterHeader, batchFilterHeader; // last verified filter header, and the header at the end of the batch
+    BRBitcoinPeer *filterCheckPeer; // another peer asked for the batch's filter headers, when there's no filterHeader
+    UInt256 checkFilterHeader; // the header at the end of the batch, as reported by filterCheckPeer
+    UInt256 *filterBlockHashes, *filterHashes; // block hashes from filterStartHeight on, filter hashes for the batch
+    BRBitcoinBlockFilter **filters; // filters received for the current batch
+    int *filterFetched; // true for each block in the current batch that has been requested in full
+    BRFilterMatch *filterMatches; // matched blocks that have been requested but not yet received
+    size_t filterBatchCount, filterAddrsCount, filterCount, filterBytes, filterBlockCount, filterBlockBytes;
+    BRBitcoinBlockWindows blockWindows; // outstanding merkleblock requests and queued hashes of a parallel chain download
+    BRSet *pendingBlocks; // blocks received ahead of the chain tip, indexed by prevBlock
+    UInt256 getblocksLocators[2];
+    int needsGetblocks;
+    uint32_t residentBlockCount; // recent blocks held in memory when older ones can be paged back in with loadBlock()
     BRPublishedTx *publishedTx;
     UInt256 *publishedTxHashes;
     void *info;
@@ -188,6 +233,7 @@ struct BRBitcoinPeerManagerStruct {
     void (*savePeers)(void *info, int replace, const BRBitcoinPeer peers[], size_t peersCount);
     int (*networkIsReachable)(void *info);
     void (*threadCleanup)(void *info);
+    BRBitcoinMerkleBlock *(*loadBlock)(void *info, uint32_t height);
     pthread_mutex_t lock;
 };
 
@@ -238,22 +284,51 @@ static void _btcPeerManagerAddTxToPublishList(BRBitcoinPeerManager *manager, BRB
     }
 }
 
+// returns the block that block builds on, paging it back in with loadBlock() if it was trimmed from memory, or NULL if
+// it isn't known
+static BRBitcoinMerkleBlock *_btcPeerManagerPrevBlock(BRBitcoinPeerManager *manager, const BRBitcoinMerkleBlock *block)
+{
+    BRBitcoinMerkleBlock *prev = BRSetGet(manager->blocks, &block->prevBlock);
+
+    if (! prev && manager->loadBlock && block->height != BLOCK_UNKNOWN_HEIGHT && block->height > 0) {
+        prev = manager->loadBlock(manager->info, block->height - 1);
+
+        if (prev && ! UInt256Eq(prev->blockHash, block->prevBlock)) { // a block from some other chain was saved there
+            btcMerkleBlockFree(prev);
+            prev = NULL;
+        }
+
+        if (prev) BRSetAdd(manager->blocks, prev);
+    }
+
+    return prev;
+}
+
 static size_t _btcPeerManagerBlockLocators(BRBitcoinPeerManager *manager, UInt256 locators[], size_t locatorsCount)
 {
     // append 10 most recent block hashes, decending, then continue appending, doubling the step back each time,
     // finishing with the genesis block (top, -1, -2, -3, -4, -5, -6, -7, -8, -9, -11, -15, -23, -39, -71, -135, ..., 0)
-    BRBitcoinMerkleBlock *block = manager->lastBlock;
+    BRBitcoinMerkleBlock *block = manager->lastBlock, *prev, *saved = NULL;
     size_t step = 1, height = 0, i = 0, j;
     
     while (block) {
         if (locators && i < locatorsCount) locators[i] = block->blockHash, height = block->height;
         if (++i >= 10) step *= 2;
         
-        for (j = 0; block && j < step; j++) {
-            block = BRSetGet(manager->blocks, &block->prevBlock);
+        for (j = 0; j < step && (prev = BRSetGet(manager->blocks, &block->prevBlock)); j++) block = prev;
+
+        // blocks trimmed from memory are read back by height for the rest of the step, rather than paging in every
+        // block in between with _btcPeerManagerPrevBlock(), saved blocks are all on the main chain
+        if (j < step) {
+            prev = (manager->loadBlock && block->height >= step - j) ?
+                   manager->loadBlock(manager->info, block->height - (uint32_t)(step - j)) : NULL;
+            if (saved) btcMerkleBlockFree(saved);
+            block = saved = prev;
         }
     }
     
+    if (saved) btcMerkleBlockFree(saved);
+    
     for (j = manager->params->checkpointsCount; j > 0; j--) { // add checkpoint hashes older than oldest saved block
         if (manager->params->checkpoints[j - 1].height >= height) continue;
         if (locators && i < locatorsCount) locators[i] = manager->params->checkpoints[j - 1].hash;
@@ -340,6 +415,154 @@ static void _btcPeerManagerLoadBloomFilter(BRBitcoinPeerManager *manager, BRBitc
     btcPeerSendFilterload(peer, data, len);
 }
 
+// MARK: - Parallel Block Download
+
+// During the initial chain download, block hashes announced by the download peer in response to getblocks are split into
+// windows of BLOCK_WINDOW_SIZE and requested concurrently from the download peer and other connected peers, which are sent
+// a bloom filter for the purpose. Blocks that arrive ahead of the chain tip are held in pendingBlocks until their previous
+// block is added. An idle peer takes over half of the largest outstanding window, and a window that makes no progress
+// for BLOCK_WINDOW_TIMEOUT is returned to the queue. Each peer's filter is updated by the remote node as matching tx are
+// found, so a wallet tx received in one window may cause a spend in a later window to be missed by another peer, in which
+// case the parallel download is canceled and the download peer's filter is rebuilt and the blocks re-requested.
+
+static double _btcPeerManagerTime(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec/1000000;
+}
+
+static void _btcPeerManagerCancelWindows(BRBitcoinPeerManager *manager)
+{
+    if (btcBlockWindowsActive(&manager->blockWindows)) {
+        _peer_log("BPM: canceling parallel block download with %zu window(s), %zu queued and %zu pending block(s)\n",
+                  array_count(manager->blockWindows.windows), array_count(manager->blockWindows.queue),
+                  BRSetCount(manager->pendingBlocks));
+    }
+
+    btcBlockWindowsClear(&manager->blockWindows);
+    BRSetApply(manager->pendingBlocks, NULL, _setApplyFreeBlock);
+    BRSetClear(manager->pendingBlocks);
+    manager->needsGetblocks = 0;
+
+    for (size_t i = array_count(manager->connectedPeers); i > 0; i--) {
+        manager->connectedPeers[i - 1]->flags &= ~PEER_FLAG_SYNCHELPER;
+    }
+}
+
+// the connected peers that blocks can be requested from, with the fastest first, returns the number of peers
+static size_t _btcPeerManagerWindowPeers(BRBitcoinPeerManager *manager, BRBitcoinPeer *peers[], size_t peersCount)
+{
+    size_t count = 0;
+
+    for (size_t i = array_count(manager->connectedPeers); i > 0 && count < peersCount; i--) {
+        BRBitcoinPeer *p = manager->connectedPeers[i - 1];
+
+        if (btcPeerConnectStatus(p) != BRPeerStatusConnected) continue;
+        if (p != manager->downloadPeer && (p->flags & PEER_FLAG_SYNCHELPER) == 0) continue;
+        peers[count++] = p;
+    }
+
+    btcBlockWindowsSortPeers(&manager->blockWindows, peers, count);
+    return count;
+}
+
+static void _btcPeerManagerRequestWindow(void *info, BRBitcoinPeer *peer, const UInt256 blockHashes[], size_t count)
+{
+    btcPeerSendGetdata(peer, NULL, 0, blockHashes, count);
+}
+
+// assigns queued block hashes to idle peers, reassigning stalled windows, and requests more block hashes when needed
+static void _btcPeerManagerScheduleWindows(BRBitcoinPeerManager *manager)
+{
+    size_t peersMax = array_count(manager->connectedPeers) + 1, stalledMax = array_count(manager->blockWindows.windows) + 1;
+    BRBitcoinPeer *peers[peersMax], *stalled[stalledMax];
+    size_t i, stalledCount, peersCount = _btcPeerManagerWindowPeers(manager, peers, peersMax);
+    double now = _btcPeerManagerTime();
+
+    stalledCount = btcBlockWindowsRequeueStalled(&manager->blockWindows, peers, peersCount, now, stalled, stalledMax);
+
+    for (i = 0; i < stalledCount; i++) { // peer is gone or stalled
+        peer_log(stalled[i], "reassigning stalled block window");
+        if (stalled[i] != manager->downloadPeer) stalled[i]->flags &= ~PEER_FLAG_SYNCHELPER;
+    }
+
+    if (stalledCount > 0) peersCount = _btcPeerManagerWindowPeers(manager, peers, peersMax);
+    btcBlockWindowsAssign(&manager->blockWindows, peers, peersCount, now, manager, _btcPeerManagerRequestWindow);
+
+    // request more block hashes once the queue is drained, unless too many blocks are waiting on a slow peer
+    if (manager->needsGetblocks && manager->downloadPeer && array_count(manager->blockWindows.queue) == 0 &&
+        BRSetCount(manager->pendingBlocks) < BLOCK_WINDOW_MAX_PENDING) {
+        manager->needsGetblocks = 0;
+        btcPeerSendGetblocks(manager->downloadPeer, manager->getblocksLocators, 2, UINT256_ZERO);
+    }
+}
+
+// marks block as received if it was requested as part of a parallel chain download
+// returns true if the block was found in a window
+static int _btcPeerManagerWindowBlockReceived(BRBitcoinPeerManager *manager, BRBitcoinPeer *peer,
+                                              BRBitcoinMerkleBlock *block)
+{
+    if (! btcBlockWindowsBlockReceived(&manager->blockWindows, peer, block->blockHash, _btcPeerManagerTime())) return 0;
+    if (manager->downloadPeer) btcPeerScheduleDisconnect(manager->downloadPeer, PROTOCOL_TIMEOUT);
+    _btcPeerManagerScheduleWindows(manager);
+    return 1;
+}
+
+// true if a parallel chain download is in progress
+static int _btcPeerManagerWindowsActive(BRBitcoinPeerManager *manager)
+{
+    return (btcBlockWindowsActive(&manager->blockWindows) || BRSetCount(manager->pendingBlocks) > 0 ||
+            manager->needsGetblocks);
+}
+
+static int _peerRelayedBlockHashes(void *info, const UInt256 blockHashes[], size_t blockCount)
+{
+    BRBitcoinPeer *peer = ((BRPeerCallbackInfo *)info)->peer;
+    BRBitcoinPeerManager *manager = ((BRPeerCallbackInfo *)info)->manager;
+    size_t helperCount = 0;
+    int r = 0;
+
+    pthread_mutex_lock(&manager->lock);
+
+    if (peer == manager->downloadPeer && manager->lastBlock->height < manager->estimatedHeight &&
+        ! manager->filterSyncing && manager->bloomFilter != NULL &&
+        (blockCount >= 500 || _btcPeerManagerWindowsActive(manager))) {
+        for (size_t i = array_count(manager->connectedPeers); i > 0; i--) {
+            BRBitcoinPeer *p = manager->connectedPeers[i - 1];
+
+            if (p == peer || btcPeerConnectStatus(p) != BRPeerStatusConnected ||
+                btcPeerLastBlock(p) < manager->lastBlock->height + blockCount) continue;
+
+            if ((p->flags & PEER_FLAG_SYNCHELPER) == 0) { // helper peers need a filter before requesting merkleblocks
+                _btcPeerManagerLoadBloomFilter(manager, p);
+                p->flags |= PEER_FLAG_SYNCHELPER;
+            }
+
+            helperCount++;
+        }
+
+        if (helperCount > 0 || _btcPeerManagerWindowsActive(manager)) {
+            peer_log(peer, "queueing %zu block(s) for parallel download with %zu other peer(s)", blockCount,
+                     helperCount);
+            btcBlockWindowsQueue(&manager->blockWindows, blockHashes, blockCount);
+
+            if (blockCount >= 500) { // request the next 500 block hashes once these have been assigned
+                manager->getblocksLocators[0] = blockHashes[blockCount - 1];
+                manager->getblocksLocators[1] = blockHashes[0];
+                manager->needsGetblocks = 1;
+            }
+
+            _btcPeerManagerScheduleWindows(manager);
+            r = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&manager->lock);
+    return r;
+}
+
 static void _updateFilterRerequestDone(void *info, int success)
 {
     BRBitcoinPeer *peer = ((BRPeerCallbackInfo *)info)->peer;
@@ -406,6 +629,8 @@ static void _updateFilterPingDone(void *info, int success)
         manager->bloomFilter = NULL;
 
         if (manager->lastBlock->height < manager->estimatedHeight) { // if we're syncing, only update download peer
+            _btcPeerManagerCancelWindows(manager); // blocks requested from other peers used the old filter
+
             if (manager->downloadPeer) {
                 _btcPeerManagerLoadBloomFilter(manager, manager->downloadPeer);
                 btcPeerSendPing(manager->downloadPeer, info, _updateFilterLoadDone); // wait for pong so filter is loaded
@@ -435,7 +660,8 @@ static void _btcPeerManagerUpdateFilter(BRBitcoinPeerManager *manager)
 {
     BRPeerCallbackInfo *info;
 
-    if (manager->downloadPeer && (manager->downloadPeer->flags & PEER_FLAG_NEEDSUPDATE) == 0) {
+    // peers syncing with compact filters are sent a fresh bloom filter once the filter scan completes
+    if (manager->downloadPeer && (manager->downloadPeer->flags & (PEER_FLAG_NEEDSUPDATE | PEER_FLAG_NOBLOOM)) == 0) {
         btcPeerSetNeedsFilterUpdate(manager->downloadPeer, 1);
         manager->downloadPeer->flags |= PEER_FLAG_NEEDSUPDATE;
         peer_log(manager->downloadPeer, "filter update needed, waiting for pong");
@@ -515,7 +741,7 @@ static void _btcPeerManagerRequestUnrelayedTx(BRBitcoinPeerManager *manager, BRB
         if (! _BRTxPeerListHasPeer(manager->txRelays, tx[i]->txHash, peer) &&
             ! _BRTxPeerListHasPeer(manager->txRequests, tx[i]->txHash, peer)) {
             txHashes[hashCount++] = tx[i]->txHash;
-            _BRTxPeerListAddPeer(&manager->txRequests, tx[i]->txHash, peer);
+            _BRTxPeerListAddPeer(manager->txRequests, tx[i]->txHash, peer);
         }
     }
 
@@ -597,6 +823,8 @@ static void _loadBloomFilterDone(void *info, int success)
 
 static void _btcPeerManagerLoadMempools(BRBitcoinPeerManager *manager)
 {
+    _btcPeerManagerCancelWindows(manager); // nothing left to download in parallel once the chain is synced
+
     // after syncing, load filters and get mempools from other peers
     for (size_t i = array_count(manager->connectedPeers); i > 0; i--) {
         BRBitcoinPeer *peer = manager->connectedPeers[i - 1];
@@ -608,7 +836,9 @@ static void _btcPeerManagerLoadMempools(BRBitcoinPeerManager *manager)
         info->peer = peer;
         info->manager = manager;
         
-        if (peer != manager->downloadPeer || manager->fpRate > BLOOM_REDUCED_FALSEPOSITIVE_RATE*5.0) {
+        if (peer != manager->downloadPeer || manager->fpRate > BLOOM_REDUCED_FALSEPOSITIVE_RATE*5.0 ||
+            (peer->flags & PEER_FLAG_NOBLOOM) != 0) {
+            peer->flags &= ~PEER_FLAG_NOBLOOM;
             _btcPeerManagerLoadBloomFilter(manager, peer);
             _btcPeerManagerPublishPendingTx(manager, peer);
             btcPeerSendPing(peer, info, _loadBloomFilterDone); // load mempool after updating bloomfilter
@@ -618,6 +848,413 @@ static void _btcPeerManagerLoadMempools(BRBitcoinPeerManager *manager)
     }
 }
 
+// MARK: - Compact Block Filters
+
+// With compact block filters (BIP157/158) the download peer is never told which addresses belong to the wallet. All
+// block headers are downloaded first, then the basic filter for each block after earliestKeyTime is requested in
+// batches of up to BLOCK_FILTER_MAX_CFILTERS, each verified against the chain of filter headers, and matched locally
+// against the wallet scripts. Only matched blocks are downloaded, in full. Once the chain tip is reached, peers are sent
+// a bloom filter as usual, since there is no compact filter equivalent for the mempool or new tx relay.
+//
+// The first batch, and the first after a reorg, can't be checked against the chain of filter headers, so its filter
+// headers are also requested from a second peer that serves compact filters, and its filters only once the two agree.
+
+static void _btcPeerManagerFilterBatchClear(BRBitcoinPeerManager *manager)
+{
+    for (size_t i = array_count(manager->filters); i > 0; i--) btcBlockFilterFree(manager->filters[i - 1]);
+    array_clear(manager->filters);
+    array_clear(manager->filterHashes);
+    array_clear(manager->filterFetched);
+    array_clear(manager->filterMatches);
+    manager->filterBatchCount = manager->filterAddrsCount = 0;
+    if (manager->filterCheckPeer) btcPeerScheduleDisconnect(manager->filterCheckPeer, -1); // cancel check timeout
+    manager->filterCheckPeer = NULL;
+    manager->checkFilterHeader = UINT256_ZERO;
+}
+
+// records the block hashes of the main chain, ending at tip, that are yet to be scanned with compact filters
+static void _btcPeerManagerFilterSetChain(BRBitcoinPeerManager *manager, BRBitcoinMerkleBlock *tip)
+{
+    size_t count = array_count(manager->filterBlockHashes);
+
+    if (! manager->filterSyncing) return;
+    if (manager->filterStartHeight == 0 && tip->timestamp + 7*24*60*60 - 2*60*60 > manager->earliestKeyTime) {
+        manager->filterStartHeight = manager->filterHeight = tip->height;
+        manager->filterHeader = UINT256_ZERO;
+    }
+
+    if (manager->filterStartHeight == 0 || tip->height < manager->filterStartHeight) return;
+    array_set_count(manager->filterBlockHashes, tip->height - manager->filterStartHeight + 1);
+
+    for (BRBitcoinMerkleBlock *b = tip; b && b->height >= manager->filterStartHeight;
+         b = BRSetGet(manager->blocks, &b->prevBlock)) {
+        size_t i = b->height - manager->filterStartHeight;
+
+        if (i < count && UInt256Eq(manager->filterBlockHashes[i], b->blockHash)) break; // rest of chain is unchanged
+        manager->filterBlockHashes[i] = b->blockHash;
+
+        if (b->height < manager->filterHeight + manager->filterBatchCount) { // reorg replaced scanned or pending blocks
+            manager->filterHeight = b->height;
+            manager->filterHeader = UINT256_ZERO;
+            _btcPeerManagerFilterBatchClear(manager);
+        }
+    }
+}
+
+// the scriptPubKeys a wallet transaction may pay to or spend from, two for each wallet address (p2pkh and p2wpkh)
+// returns the number of scripts, scripts must be freed by the caller
+static size_t _btcPeerManagerFilterScripts(BRBitcoinPeerManager *manager, uint8_t **scripts, const uint8_t ***items,
+                                           size_t **itemLens)
+{
+    // generate spare addresses so that wallet transactions found during the scan don't immediately require a rematch
+    btcWalletUnusedAddrs(manager->wallet, NULL, SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED, SEQUENCE_EXTERNAL_CHAIN);
+    btcWalletUnusedAddrs(manager->wallet, NULL, SEQUENCE_GAP_LIMIT_INTERNAL_EXTENDED, SEQUENCE_INTERNAL_CHAIN);
+
+    size_t i, count = 0, addrsCount = btcWalletAllAddrs(manager->wallet, NULL, 0);
+    BRAddress *addrs = malloc(addrsCount*sizeof(*addrs));
+    UInt160 hash;
+
+    *scripts = malloc(addrsCount*(25 + 22));
+    *items = malloc(addrsCount*2*sizeof(**items));
+    *itemLens = malloc(addrsCount*2*sizeof(**itemLens));
+    assert(addrs != NULL);
+    assert(*scripts != NULL && *items != NULL && *itemLens != NULL);
+    addrsCount = btcWalletAllAddrs(manager->wallet, addrs, addrsCount);
+    manager->filterAddrsCount = addrsCount;
+
+    for (i = 0; i < addrsCount; i++) {
+        uint8_t *p2pkh = &(*scripts)[i*(25 + 22)], *p2wpkh = p2pkh + 25;
+
+        if (! BRAddressHash160(&hash, manager->params->addrParams, addrs[i].s)) continue;
+        p2pkh[0] = OP_DUP, p2pkh[1] = OP_HASH160, p2pkh[2] = 20;
+        UInt160Set(&p2pkh[3], hash);
+        p2pkh[23] = OP_EQUALVERIFY, p2pkh[24] = OP_CHECKSIG;
+        p2wpkh[0] = OP_0, p2wpkh[1] = 20;
+        UInt160Set(&p2wpkh[2], hash);
+        (*items)[count] = p2pkh, (*itemLens)[count++] = 25;
+        (*items)[count] = p2wpkh, (*itemLens)[count++] = 22;
+    }
+
+    free(addrs);
+    return count;
+}
+
+static void _btcPeerManagerLoadFilterBatch(BRBitcoinPeerManager *manager);
+
+// asks another connected peer that serves compact filters for the filter headers of the current batch, or if there is
+// none, requests the batch's filters from the download peer
+static void _btcPeerManagerRequestFilterCheck(BRBitcoinPeerManager *manager)
+{
+    BRBitcoinPeer *peer = manager->downloadPeer, *p = NULL;
+    size_t i, start = manager->filterHeight - manager->filterStartHeight;
+    UInt256 stopHash = manager->filterBlockHashes[start + manager->filterBatchCount - 1];
+
+    for (i = array_count(manager->connectedPeers); i > 0; i--) {
+        p = manager->connectedPeers[i - 1];
+        if (p != peer && btcPeerConnectStatus(p) == BRPeerStatusConnected &&
+            (p->services & SERVICES_NODE_COMPACT_FILTERS) != 0 &&
+            btcPeerLastBlock(p) + 1 >= manager->filterHeight + manager->filterBatchCount) break;
+    }
+
+    manager->filterCheckPeer = (i > 0) ? p : NULL;
+    manager->checkFilterHeader = UINT256_ZERO;
+
+    if (manager->filterCheckPeer) {
+        btcPeerScheduleDisconnect(manager->filterCheckPeer, PROTOCOL_TIMEOUT); // schedule check timeout
+        btcPeerSendGetcfheaders(manager->filterCheckPeer, manager->filterHeight, stopHash);
+    }
+    else {
+        // BUG: XXX with no other peer serving compact filters, the batch is trusted, a malicious download peer could
+        // omit wallet transactions (the same is true of bloom filtered merkleblocks)
+        peer_log(peer, "no other peer serves compact filters, trusting cfheaders from height %"PRIu32,
+                 manager->filterHeight);
+        btcPeerSendGetcfilters(peer, manager->filterHeight, stopHash);
+    }
+}
+
+// matches the current batch of filters against the wallet scripts, and requests any newly matched blocks
+static void _btcPeerManagerMatchFilterBatch(BRBitcoinPeerManager *manager)
+{
+    uint8_t *scripts;
+    const uint8_t **items;
+    size_t *itemLens, i, count = array_count(manager->filters), addrsCount = manager->filterAddrsCount,
+           itemsCount = _btcPeerManagerFilterScripts(manager, &scripts, &items, &itemLens);
+    int matched[count];
+    UInt256 blockHashes[count];
+    size_t blockCount = 0;
+
+    // a rematch is only needed if new addresses were generated since the last match
+    if (manager->filterAddrsCount != addrsCount) {
+        btcBlockFilterMatchAnyBatch(manager->filters, count, items, itemLens, itemsCount, matched);
+    }
+    else memset(matched, 0, sizeof(matched));
+
+    free(scripts);
+    free(items);
+    free(itemLens);
+
+    for (i = 0; i < count; i++) {
+        if (! matched[i] || manager->filterFetched[i]) continue;
+        manager->filterFetched[i] = 1;
+        blockHashes[blockCount++] = manager->filters[i]->blockHash;
+        array_add(manager->filterMatches, ((const BRFilterMatch) { manager->filters[i]->blockHash,
+                                                                   manager->filterHeight + (uint32_t)i }));
+    }
+
+    if (blockCount > 0) {
+        peer_log(manager->downloadPeer, "compact filters matched %zu of %zu block(s) from height %"PRIu32,
+                 blockCount, count, manager->filterHeight);
+        btcPeerSendGetfullblocks(manager->downloadPeer, blockHashes, blockCount);
+    }
+    else if (array_count(manager->filterMatches) == 0) { // batch is done, move on to the next one
+        manager->filterHeight += (uint32_t)count;
+        manager->filterHeader = manager->batchFilterHeader;
+        _btcPeerManagerFilterBatchClear(manager);
+        _btcPeerManagerLoadFilterBatch(manager);
+    }
+}
+
+// saves the blocks at the chain tip, starting at a difficulty transition
+static void _btcPeerManagerSaveChainTip(BRBitcoinPeerManager *manager)
+{
+    size_t i, count = (manager->lastBlock->height % BLOCK_DIFFICULTY_INTERVAL) + BLOCK_DIFFICULTY_INTERVAL + 1;
+    BRBitcoinMerkleBlock *b, *saveBlocks[count];
+
+    for (i = 0, b = manager->lastBlock; b && i < count; i++) {
+        saveBlocks[i] = b;
+        b = _btcPeerManagerPrevBlock(manager, b);
+    }
+
+    while (i > 0 && (saveBlocks[i - 1]->height % BLOCK_DIFFICULTY_INTERVAL) != 0) i--;
+    if (i > 0 && manager->saveBlocks) manager->saveBlocks(manager->info, (i > 1 ? 1 : 0), saveBlocks, i);
+}
+
+// requests filter hashes and filters for the next batch of blocks, or finishes the sync if the scan is complete
+static void _btcPeerManagerLoadFilterBatch(BRBitcoinPeerManager *manager)
+{
+    BRBitcoinPeer *peer = manager->downloadPeer;
+    size_t start = (manager->filterStartHeight > 0) ? manager->filterHeight - manager->filterStartHeight : 0,
+           count = array_count(manager->filterBlockHashes) - start;
+
+    if (manager->filterStartHeight == 0 || count == 0) {
+        peer_log(peer, "compact filter sync done, %zu filter(s) totalling %zu bytes, %zu matched block(s) totalling "
+                 "%zu bytes", manager->filterCount, manager->filterBytes, manager->filterBlockCount,
+                 manager->filterBlockBytes);
+        manager->filterSyncing = 0;
+        manager->filterStartHeight = manager->filterHeight = 0;
+        array_clear(manager->filterBlockHashes);
+        btcPeerSetCompactFilterSync(peer, 0);
+        _btcPeerManagerSaveChainTip(manager);
+        _btcPeerManagerLoadMempools(manager);
+    }
+    else {
+        if (count > BLOCK_FILTER_MAX_CFILTERS) count = BLOCK_FILTER_MAX_CFILTERS;
+        _btcPeerManagerFilterBatchClear(manager);
+        manager->filterBatchCount = count;
+        for (size_t i = 0; i < count; i++) array_add(manager->filterFetched, 0);
+        btcPeerScheduleDisconnect(peer, PROTOCOL_TIMEOUT); // reschedule sync timeout
+        btcPeerSendGetcfheaders(peer, manager->filterHeight, manager->filterBlockHashes[start + count - 1]);
+
+        // with no verified filter header to connect to, check the batch's filter headers with another peer first
+        if (UInt256IsZero(manager->filterHeader)) _btcPeerManagerRequestFilterCheck(manager);
+        else btcPeerSendGetcfilters(peer, manager->filterHeight, manager->filterBlockHashes[start + count - 1]);
+    }
+}
+
+// when switching to a download peer that doesn't serve compact filters, rewind the chain to where the filter scan left
+// off so the remaining blocks are scanned with a bloom filter instead
+static void _btcPeerManagerFilterRewind(BRBitcoinPeerManager *manager)
+{
+    BRBitcoinMerkleBlock *b = manager->lastBlock;
+
+    if (manager->filterStartHeight == 0 || manager->filterHeight > manager->lastBlock->height) return;
+    while (b && b->height >= manager->filterHeight) b = _btcPeerManagerPrevBlock(manager, b);
+
+    for (size_t i = manager->params->checkpointsCount; ! b && i > 0; i--) {
+        if (i - 1 == 0 || manager->params->checkpoints[i - 1].height < manager->filterHeight) {
+            UInt256 hash = UInt256Reverse(manager->params->checkpoints[i - 1].hash);
+
+            b = BRSetGet(manager->blocks, &hash);
+        }
+    }
+
+    if (b) {
+        _peer_log("BPM: rewinding to %u to finish compact filter scan with a bloom filter\n", b->height);
+        manager->lastBlock = b;
+    }
+
+    manager->filterStartHeight = manager->filterHeight = 0;
+    array_clear(manager->filterBlockHashes);
+}
+
+// when the download peer and filterCheckPeer don't agree on a batch's filter headers, there's no telling which of them
+// is lying, so rewind the chain and finish the scan with a bloom filter, which is no worse than a bloom filtered sync
+static void _btcPeerManagerFilterFallback(BRBitcoinPeerManager *manager)
+{
+    BRBitcoinPeer *peer = manager->downloadPeer;
+    size_t count;
+    UInt256 *locators;
+
+    _btcPeerManagerFilterBatchClear(manager);
+    _btcPeerManagerFilterRewind(manager);
+    manager->filterSyncing = 0;
+    peer->flags &= ~PEER_FLAG_NOBLOOM;
+    btcPeerSetCompactFilterSync(peer, 0);
+    _btcPeerManagerLoadBloomFilter(manager, peer);
+    count = _btcPeerManagerBlockLocators(manager, NULL, 0);
+    locators = calloc(count, sizeof(*locators)); // Okay if NULL
+    _btcPeerManagerBlockLocators(manager, locators, count);
+    btcPeerScheduleDisconnect(peer, PROTOCOL_TIMEOUT); // reschedule sync timeout
+    btcPeerSendGetblocks(peer, locators, count, UINT256_ZERO);
+    if (locators) free(locators);
+}
+
+static void _peerRelayedFilterHeaders(void *info, UInt256 stopHash, UInt256 prevHeader, const UInt256 filterHashes[],
+                                      size_t count)
+{
+    BRBitcoinPeer *peer = ((BRPeerCallbackInfo *)info)->peer;
+    BRBitcoinPeerManager *manager = ((BRPeerCallbackInfo *)info)->manager;
+    UInt256 header = prevHeader;
+    size_t i, start;
+
+    pthread_mutex_lock(&manager->lock);
+    start = manager->filterHeight - manager->filterStartHeight;
+
+    if (! manager->filterSyncing || manager->filterBatchCount == 0 ||
+        (peer != manager->downloadPeer && peer != manager->filterCheckPeer) ||
+        (peer == manager->downloadPeer && array_count(manager->filterHashes) > 0) ||
+        (peer == manager->filterCheckPeer && ! UInt256IsZero(manager->checkFilterHeader))) {
+        peer_log(peer, "unexpected cfheaders");
+    }
+    else if (count != manager->filterBatchCount ||
+             ! UInt256Eq(stopHash, manager->filterBlockHashes[start + count - 1]) ||
+             (! UInt256IsZero(manager->filterHeader) && ! UInt256Eq(prevHeader, manager->filterHeader))) {
+        peer_log(peer, "cfheaders don't connect to the filter header chain");
+        _btcPeerManagerPeerMisbehavin(manager, peer);
+    }
+    else {
+        for (i = 0; i < count; i++) header = btcBlockFilterHeader(filterHashes[i], header);
+
+        if (peer == manager->filterCheckPeer) {
+            manager->checkFilterHeader = header;
+            btcPeerScheduleDisconnect(peer, -1); // cancel check timeout
+        }
+        else {
+            manager->batchFilterHeader = header;
+            array_add_array(manager->filterHashes, filterHashes, count);
+            btcPeerScheduleDisconnect(peer, PROTOCOL_TIMEOUT); // reschedule sync timeout
+        }
+
+        // once both peers have sent the batch's filter headers, request its filters if they agree
+        if (manager->filterCheckPeer && array_count(manager->filterHashes) > 0 &&
+            ! UInt256IsZero(manager->checkFilterHeader)) {
+            if (UInt256Eq(manager->checkFilterHeader, manager->batchFilterHeader)) {
+                peer_log(manager->filterCheckPeer, "cfheaders from height %"PRIu32" match the download peer",
+                         manager->filterHeight);
+                manager->filterCheckPeer = NULL;
+                manager->checkFilterHeader = UINT256_ZERO;
+                btcPeerSendGetcfilters(manager->downloadPeer, manager->filterHeight,
+                                       manager->filterBlockHashes[start + count - 1]);
+            }
+            else {
+                peer_log(manager->filterCheckPeer, "cfheaders from height %"PRIu32" don't match the download peer, "
+                         "finishing scan with a bloom filter", manager->filterHeight);
+                _btcPeerManagerFilterFallback(manager);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&manager->lock);
+}
+
+static void _peerRelayedFilter(void *info, BRBitcoinBlockFilter *filter)
+{
+    BRBitcoinPeer *peer = ((BRPeerCallbackInfo *)info)->peer;
+    BRBitcoinPeerManager *manager = ((BRPeerCallbackInfo *)info)->manager;
+    size_t i, start;
+
+    pthread_mutex_lock(&manager->lock);
+    start = manager->filterHeight - manager->filterStartHeight;
+    i = array_count(manager->filters);
+
+    if (peer != manager->downloadPeer || ! manager->filterSyncing || i >= manager->filterBatchCount ||
+        array_count(manager->filterHashes) != manager->filterBatchCount || manager->filterCheckPeer) {
+        peer_log(peer, "unexpected cfilter for block: %s", u256hex(filter->blockHash));
+        btcBlockFilterFree(filter);
+    }
+    else if (! UInt256Eq(filter->blockHash, manager->filterBlockHashes[start + i]) ||
+             ! UInt256Eq(btcBlockFilterHash(filter), manager->filterHashes[i])) {
+        peer_log(peer, "cfilter doesn't match filter header for block: %s", u256hex(filter->blockHash));
+        btcBlockFilterFree(filter);
+        _btcPeerManagerPeerMisbehavin(manager, peer);
+    }
+    else {
+        manager->filterCount++;
+        manager->filterBytes += btcBlockFilterSerialize(filter, NULL, 0);
+        array_add(manager->filters, filter);
+        btcPeerScheduleDisconnect(peer, PROTOCOL_TIMEOUT); // reschedule sync timeout
+        if (array_count(manager->filters) == manager->filterBatchCount) _btcPeerManagerMatchFilterBatch(manager);
+    }
+
+    pthread_mutex_unlock(&manager->lock);
+}
+
+static void _peerRelayedFullBlock(void *info, BRBitcoinMerkleBlock *block, BRBitcoinTransaction *txs[], size_t txCount)
+{
+    BRBitcoinPeer *peer = ((BRPeerCallbackInfo *)info)->peer;
+    BRBitcoinPeerManager *manager = ((BRPeerCallbackInfo *)info)->manager;
+    UInt256 *txHashes = NULL;
+    size_t i, j, count = 0, blockBytes = 80 + BRVarIntSize(txCount);
+
+    pthread_mutex_lock(&manager->lock);
+
+    for (j = array_count(manager->filterMatches); j > 0; j--) {
+        if (UInt256Eq(manager->filterMatches[j - 1].blockHash, block->blockHash)) break;
+    }
+
+    if (j == 0) {
+        peer_log(peer, "unexpected block: %s", u256hex(block->blockHash));
+        for (i = 0; i < txCount; i++) btcTransactionFree(txs[i]);
+    }
+    else {
+        uint32_t height = manager->filterMatches[j - 1].height;
+
+        // a full block can have tens of thousands of tx, too many hashes for the peer thread stack
+        if (txCount > 0) txHashes = malloc(txCount*sizeof(*txHashes));
+        assert(txHashes != NULL || txCount == 0);
+
+        for (i = 0; i < txCount; i++) {
+            BRBitcoinTransaction *tx = txs[i];
+
+            blockBytes += btcTransactionSerialize(tx, NULL, 0);
+
+            // txs are processed in block order, so a spend is recognized once the tx it spends has been registered
+            if (btcWalletContainsTransaction(manager->wallet, tx)) {
+                txHashes[count++] = tx->txHash;
+                if (! btcWalletTransactionForHash(manager->wallet, tx->txHash) &&
+                    btcWalletRegisterTransaction(manager->wallet, tx)) tx = NULL;
+            }
+
+            if (tx) btcTransactionFree(tx);
+        }
+
+        peer_log(peer, "got matched block #%"PRIu32" with %zu wallet tx", height, count);
+        manager->filterBlockCount++;
+        manager->filterBlockBytes += blockBytes;
+        if (count > 0) btcWalletUpdateTransactions(manager->wallet, txHashes, count, height, block->timestamp);
+        if (txHashes) free(txHashes);
+        array_rm(manager->filterMatches, j - 1);
+        btcPeerScheduleDisconnect(peer, PROTOCOL_TIMEOUT); // reschedule sync timeout
+
+        // when the batch is done, rematch it in case wallet tx used up addresses and new ones had to be generated
+        if (array_count(manager->filterMatches) == 0) _btcPeerManagerMatchFilterBatch(manager);
+    }
+
+    btcMerkleBlockFree(block);
+    pthread_mutex_unlock(&manager->lock);
+    if (count > 0 && manager->txStatusUpdate) manager->txStatusUpdate(manager->info);
+}
+
 // returns a UINT128_ZERO terminated array of addresses for hostname that must be freed, or NULL if lookup failed
 static UInt128 *_addressLookup(const char *hostname)
 {
@@ -767,6 +1404,11 @@ static void _peerConnected(void *info)
             BRBitcoinPeer *p = manager->connectedPeers[i - 1];
             
             if (btcPeerConnectStatus(p) != BRPeerStatusConnected) continue;
+            if (manager->compactFilterSync && btcPeerLastBlock(p) >= btcPeerLastBlock(peer) &&
+                (p->services & SERVICES_NODE_COMPACT_FILTERS) != (peer->services & SERVICES_NODE_COMPACT_FILTERS)) {
+                if ((p->services & SERVICES_NODE_COMPACT_FILTERS) != 0) peer = p; // prefer peers serving filters
+                continue;
+            }
             if ((btcPeerPingTime(p) < btcPeerPingTime(peer) && btcPeerLastBlock(p) >= btcPeerLastBlock(peer)) ||
                 btcPeerLastBlock(p) > btcPeerLastBlock(peer)) peer = p;
         }
@@ -779,7 +1421,27 @@ static void _peerConnected(void *info)
         manager->downloadPeer = peer;
         manager->isConnected = 1;
         manager->estimatedHeight = btcPeerLastBlock(peer);
-        _btcPeerManagerLoadBloomFilter(manager, peer);
+        _btcPeerManagerFilterBatchClear(manager);
+
+        if (manager->compactFilterSync && (peer->services & SERVICES_NODE_COMPACT_FILTERS) != 0) {
+            // sync headers, then scan blocks with compact filters, a bloom filter is loaded once the scan completes
+            if (! manager->filterSyncing && manager->lastBlock->timestamp + 7*24*60*60 - 2*60*60 >
+                manager->earliestKeyTime) {
+                manager->filterStartHeight = manager->filterHeight = manager->lastBlock->height + 1;
+                manager->filterHeader = UINT256_ZERO;
+                array_clear(manager->filterBlockHashes);
+            }
+
+            manager->filterSyncing = 1;
+            peer->flags |= PEER_FLAG_NOBLOOM;
+            btcPeerSetCompactFilterSync(peer, 1);
+        }
+        else {
+            if (manager->filterSyncing) _btcPeerManagerFilterRewind(manager); // finish scan with a bloom filter
+            manager->filterSyncing = 0;
+            _btcPeerManagerLoadBloomFilter(manager, peer);
+        }
+
         btcPeerSetCurrentBlockHeight(peer, manager->lastBlock->height);
         _btcPeerManagerPublishPendingTx(manager, peer);
             
@@ -793,13 +1455,17 @@ static void _peerConnected(void *info)
 
             // request just block headers up to a week before earliestKeyTime, and then merkleblocks after that
             // we do not reset connect failure count yet incase this request times out
-            if (manager->lastBlock->timestamp + 7*24*60*60 >= manager->earliestKeyTime) {
+            if (manager->lastBlock->timestamp + 7*24*60*60 >= manager->earliestKeyTime && ! manager->filterSyncing) {
                 btcPeerSendGetblocks(peer, locators, count, UINT256_ZERO);
             }
             else btcPeerSendGetheaders(peer, locators, count, UINT256_ZERO);
 
             if (locators) free (locators);
         }
+        else if (manager->filterSyncing) { // headers are synced, resume compact filter scan
+            manager->connectFailureCount = 0; // reset connect failure count
+            _btcPeerManagerLoadFilterBatch(manager);
+        }
         else { // we're already synced
             manager->connectFailureCount = 0; // reset connect failure count
             _btcPeerManagerLoadMempools(manager);
@@ -813,7 +1479,6 @@ static void _peerDisconnected(void *info, int error)
 {
     BRBitcoinPeer *peer = ((BRPeerCallbackInfo *)info)->peer;
     BRBitcoinPeerManager *manager = ((BRPeerCallbackInfo *)info)->manager;
-    BRTxPeerList *peerList;
     int willSave = 0, willReconnect = 0, txError = 0;
     size_t txCount = 0;
     
@@ -834,21 +1499,23 @@ static void _peerDisconnected(void *info, int error)
         
         // if it's a timeout and there's pending tx publish callbacks, the tx publish timed out
         // BUG: XXX what if it's a connect timeout and not a publish timeout?
-        if (error == ETIMEDOUT && (peer != manager->downloadPeer || manager->syncStartHeight == 0 ||
-                                   array_count(manager->connectedPeers) == 1)) txError = ETIMEDOUT;
+        if (error == ETIMEDOUT && peer != manager->filterCheckPeer &&
+            (peer != manager->downloadPeer || manager->syncStartHeight == 0 ||
+             array_count(manager->connectedPeers) == 1)) txError = ETIMEDOUT;
     }
     
-    for (size_t i = array_count(manager->txRelays); i > 0; i--) {
-        peerList = &manager->txRelays[i - 1];
+    _BRTxPeerListRemovePeerAll(manager->txRelays, peer);
 
-        for (size_t j = array_count(peerList->peers); j > 0; j--) {
-            if (btcPeerEq(&peerList->peers[j - 1], peer)) array_rm(peerList->peers, j - 1);
-        }
+    if (peer == manager->filterCheckPeer) { // ask another peer to check the batch's filter headers
+        manager->filterCheckPeer = NULL;
+        if (manager->downloadPeer) _btcPeerManagerRequestFilterCheck(manager);
     }
 
     if (peer == manager->downloadPeer) { // download peer disconnected
         manager->isConnected = 0;
         manager->downloadPeer = NULL;
+        _btcPeerManagerFilterBatchClear(manager); // a pending compact filter scan resumes with the next download peer
+        _btcPeerManagerCancelWindows(manager);
         if (manager->connectFailureCount > MAX_CONNECT_FAILURES) manager->connectFailureCount = MAX_CONNECT_FAILURES;
     }
 
@@ -879,6 +1546,9 @@ static void _peerDisconnected(void *info, int error)
         break;
     }
 
+    // hand blocks still owed by peer to other peers, rescheduling only once all its windows are requeued
+    if (btcBlockWindowsRemovePeer(&manager->blockWindows, peer) > 0) _btcPeerManagerScheduleWindows(manager);
+
     btcPeerFree(peer);
     pthread_mutex_unlock(&manager->lock);
     
@@ -940,7 +1610,7 @@ static void _peerRelayedTx(void *info, BRBitcoinTransaction *tx)
             txCallback = manager->publishedTx[i - 1].callback;
             manager->publishedTx[i - 1].info = NULL;
             manager->publishedTx[i - 1].callback = NULL;
-            relayCount = _BRTxPeerListAddPeer(&manager->txRelays, tx->txHash, peer);
+            relayCount = _BRTxPeerListAddPeer(manager->txRelays, tx->txHash, peer);
         }
         else if (manager->publishedTx[i - 1].callback != NULL) hasPendingCallbacks = 1;
     }
@@ -971,7 +1641,7 @@ static void _peerRelayedTx(void *info, BRBitcoinTransaction *tx)
 
         // keep track of how many peers have or relay a tx, this indicates how likely the tx is to confirm
         // (we only need to track this after syncing is complete)
-        if (manager->syncStartHeight == 0) relayCount = _BRTxPeerListAddPeer(&manager->txRelays, tx->txHash, peer);
+        if (manager->syncStartHeight == 0) relayCount = _BRTxPeerListAddPeer(manager->txRelays, tx->txHash, peer);
         
         _BRTxPeerListRemovePeer(manager->txRequests, tx->txHash, peer);
         
@@ -1023,7 +1693,7 @@ static void _peerHasTx(void *info, UInt256 txHash)
             if (! tx) tx = pubTx.tx;
             manager->publishedTx[i - 1].callback = NULL;
             manager->publishedTx[i - 1].info = NULL;
-            relayCount = _BRTxPeerListAddPeer(&manager->txRelays, txHash, peer);
+            relayCount = _BRTxPeerListAddPeer(manager->txRelays, txHash, peer);
         }
         else if (manager->publishedTx[i - 1].callback != NULL) hasPendingCallbacks = 1;
     }
@@ -1044,7 +1714,7 @@ static void _peerHasTx(void *info, UInt256 txHash)
         
         // keep track of how many peers have or relay a tx, this indicates how likely the tx is to confirm
         // (we only need to track this after syncing is complete)
-        if (manager->syncStartHeight == 0) relayCount = _BRTxPeerListAddPeer(&manager->txRelays, txHash, peer);
+        if (manager->syncStartHeight == 0) relayCount = _BRTxPeerListAddPeer(manager->txRelays, txHash, peer);
 
         // set timestamp when tx is verified
         if (relayCount >= manager->maxConnectCount && tx && tx->blockHeight == TX_UNCONFIRMED && tx->timestamp == 0) {
@@ -1092,6 +1762,46 @@ static void _peerRejectedTx(void *info, UInt256 txHash, uint8_t code)
     if (manager->txStatusUpdate) manager->txStatusUpdate(manager->info);
 }
 
+// frees main chain blocks more than residentBlockCount below the chain tip, other than difficulty transitions and
+// checkpoints, after passing them to saveBlocks() so that _btcPeerManagerPrevBlock() can page them back in
+static void _btcPeerManagerTrimBlocks(BRBitcoinPeerManager *manager)
+{
+    BRBitcoinMerkleBlock *b = manager->lastBlock, **trimBlocks;
+    uint32_t i, height;
+    size_t count;
+
+    if (! manager->loadBlock || ! manager->saveBlocks) return;
+    for (i = 0; b && i < manager->residentBlockCount; i++) b = BRSetGet(manager->blocks, &b->prevBlock);
+    if (! b) return;
+    array_new(trimBlocks, BLOCK_TRIM_INTERVAL);
+    height = b->height;
+
+    // older blocks end at the last trim, or at the transition before the previous one (see _btcPeerManagerVerifyBlock)
+    for (; b; b = BRSetGet(manager->blocks, &b->prevBlock)) {
+        if ((b->height % BLOCK_DIFFICULTY_INTERVAL) == 0 || BRSetContains(manager->checkpoints, b)) continue;
+
+        // blocks that haven't been scanned with compact filters yet are saved once the scan completes
+        if (manager->filterSyncing && manager->filterStartHeight > 0 && b->height >= manager->filterStartHeight) continue;
+        array_add(trimBlocks, b);
+    }
+
+    count = array_count(trimBlocks);
+
+    if (count > 0) {
+        manager->saveBlocks(manager->info, 0, trimBlocks, count);
+
+        for (size_t j = 0; j < count; j++) {
+            BRSetRemove(manager->blocks, trimBlocks[j]);
+            btcMerkleBlockFree(trimBlocks[j]);
+        }
+
+        _peer_log("BPM: trimmed %zu blocks at or below %"PRIu32", %zu blocks held\n", count, height,
+                  BRSetCount(manager->blocks));
+    }
+
+    array_free(trimBlocks);
+}
+
 static int _btcPeerManagerVerifyBlock(BRBitcoinPeerManager *manager, BRBitcoinMerkleBlock *block, BRBitcoinMerkleBlock *prev, BRBitcoinPeer *peer)
 {
     int r = 1;
@@ -1104,7 +1814,7 @@ static int _btcPeerManagerVerifyBlock(BRBitcoinPeerManager *manager, BRBitcoinMe
         UInt256 prevBlock;
 
         for (uint32_t i = 0; b && i < BLOCK_DIFFICULTY_INTERVAL; i++) {
-            b = BRSetGet(manager->blocks, &b->prevBlock);
+            b = _btcPeerManagerPrevBlock(manager, b);
         }
 
         if (! b) {
@@ -1124,7 +1834,7 @@ static int _btcPeerManagerVerifyBlock(BRBitcoinPeerManager *manager, BRBitcoinMe
         }
     }
 
-    // verify block difficulty
+    // verify block difficulty target, proof-of-work was already checked on the peer's thread
     if (r && ! manager->params->verifyDifficulty(block, manager->blocks)) {
         peer_log(peer, "relayed block with invalid difficulty target %x, blockHash: %s", block->target,
                  u256hex(block->blockHash));
@@ -1154,11 +1864,12 @@ static void _peerRelayedBlockFailed (BRBitcoinMerkleBlock *blockToFree, BRBitcoi
     assert (0);
 }
 
-static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
+// returns the next block to process, if it was waiting on this one as an orphan or during a parallel chain download
+static BRBitcoinMerkleBlock *_btcPeerManagerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
 {
     if (NULL == info || NULL == block) {
         _peerRelayedBlockFailed (block, NULL, "missed 'info' or 'block'");
-        return;
+        return NULL;
     }
 
     BRBitcoinPeer *peer = ((BRPeerCallbackInfo *)info)->peer;
@@ -1169,7 +1880,7 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
 
     if (NULL == peer || NULL == manager) {
         _peerRelayedBlockFailed (block, peer, "missed 'peer' or 'manager'");
-        return;
+        return NULL;
     }
 
     // Check manager - ensure anything dereferenced subsequently is valid
@@ -1178,7 +1889,7 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
         NULL == manager->lastBlock ||
         NULL == manager->downloadPeer) {
         _peerRelayedBlockFailed (block, peer, "missed 'manager' fields");
-        return;
+        return NULL;
     }
 
     // Check block - ensure anything dereferenced subsequently is valid.  The only pointers in
@@ -1186,13 +1897,17 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
     if ((NULL == block->hashes && 0 != block->hashesCount) ||
         (NULL == block->flags  && 0 != block->flagsLen)) {
         _peerRelayedBlockFailed (block, peer, "missed 'block' fields");
-        return;
+        return NULL;
     }
 
-    size_t txCount = btcMerkleBlockTxHashes(block, NULL, 0);
-    UInt256 _txHashes[128], *txHashes = (txCount <= 128) ? _txHashes : malloc(txCount*sizeof(UInt256));
-    assert(txHashes != NULL);
-    txCount = btcMerkleBlockTxHashes(block, txHashes, txCount);
+    UInt256 _txHashes[128], *txHashes = _txHashes;
+    size_t txCount = btcMerkleBlockTxHashes(block, _txHashes, 128);
+
+    if (txCount == 128 && (txCount = btcMerkleBlockTxHashes(block, NULL, 0)) > 128) { // more than fit on the stack
+        txHashes = malloc(txCount*sizeof(UInt256));
+        assert(txHashes != NULL);
+        txCount = btcMerkleBlockTxHashes(block, txHashes, txCount);
+    }
 
     pthread_mutex_lock(&manager->lock);
     prev = BRSetGet(manager->blocks, &block->prevBlock);
@@ -1201,6 +1916,15 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
         txTime = block->timestamp/2 + prev->timestamp/2;
         block->height = prev->height + 1;
     }
+
+    // during a parallel chain download, hold blocks that arrive ahead of the chain tip until their previous block is added
+    if (_btcPeerManagerWindowBlockReceived(manager, peer, block) && ! prev) {
+        b = BRSetAdd(manager->pendingBlocks, block);
+        if (b && b != block) btcMerkleBlockFree(b);
+        pthread_mutex_unlock(&manager->lock);
+        if (txHashes != _txHashes) free(txHashes);
+        return NULL;
+    }
     
     // track the observed bloom filter false positive rate using a low pass filter to smooth out variance
     if (peer == manager->downloadPeer && block->totalTx > 0) {
@@ -1229,11 +1953,12 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
     }
 
     // ignore block headers that are newer than one week before earliestKeyTime (it's a header if it has 0 totalTx)
-    if (block->totalTx == 0 && block->timestamp + 7*24*60*60 - 2*60*60 > manager->earliestKeyTime) {
+    if (block->totalTx == 0 && block->timestamp + 7*24*60*60 - 2*60*60 > manager->earliestKeyTime &&
+        ! manager->filterSyncing) {
         btcMerkleBlockFree(block);
         block = NULL;
     }
-    else if (manager->bloomFilter == NULL) { // ingore potentially incomplete blocks when a filter update is pending
+    else if (manager->bloomFilter == NULL && ! manager->filterSyncing) { // ingore potentially incomplete blocks when a filter update is pending
         btcMerkleBlockFree(block);
         block = NULL;
 
@@ -1282,8 +2007,20 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
         
         BRSetAdd(manager->blocks, block);
         manager->lastBlock = block;
+        _btcPeerManagerFilterSetChain(manager, block);
         if (txCount > 0) btcWalletUpdateTransactions(manager->wallet, txHashes, txCount, block->height, txTime);
         if (manager->downloadPeer) btcPeerSetCurrentBlockHeight(manager->downloadPeer, block->height);
+
+        // a wallet tx may be spent in a later block that was requested from a peer whose filter doesn't yet match the
+        // new wallet outputs, so stop the parallel download and re-request the remaining blocks with a rebuilt filter
+        for (i = 0; i < txCount && _btcPeerManagerWindowsActive(manager); i++) {
+            if (! btcWalletTransactionForHash(manager->wallet, txHashes[i])) continue;
+            peer_log(peer, "found wallet tx in block #%"PRIu32" during parallel download", block->height);
+            _btcPeerManagerCancelWindows(manager);
+            if (manager->bloomFilter) btcBloomFilterFree(manager->bloomFilter);
+            manager->bloomFilter = NULL; // reset bloom filter so it's recreated with new wallet utxos
+            _btcPeerManagerUpdateFilter(manager);
+        }
             
         if (block->height < manager->estimatedHeight && peer == manager->downloadPeer) {
             btcPeerScheduleDisconnect(peer, PROTOCOL_TIMEOUT); // reschedule sync timeout
@@ -1294,7 +2031,10 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
             saveCount = 1; // save transition blocks immediately
         }
         
-        if (block->height == manager->estimatedHeight) { // chain download is complete
+        if (block->height == manager->estimatedHeight && manager->filterSyncing) { // header download is complete
+            if (manager->filterBatchCount == 0) _btcPeerManagerLoadFilterBatch(manager);
+        }
+        else if (block->height == manager->estimatedHeight) { // chain download is complete
             saveCount = (block->height % BLOCK_DIFFICULTY_INTERVAL) + BLOCK_DIFFICULTY_INTERVAL + 1;
             _btcPeerManagerLoadMempools(manager);
         }
@@ -1305,7 +2045,7 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
         }
         
         b = manager->lastBlock;
-        while (b && b->height > block->height) b = BRSetGet(manager->blocks, &b->prevBlock); // is block in main chain?
+        while (b && b->height > block->height) b = _btcPeerManagerPrevBlock(manager, b); // is block in main chain?
 
         if (b && btcMerkleBlockEq(b, block)) { // if it's not on a fork, set block heights for its transactions
             if (txCount > 0) btcWalletUpdateTransactions(manager->wallet, txHashes, txCount, block->height, txTime);
@@ -1337,13 +2077,13 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
             b2 = manager->lastBlock;
             
             while (b && b2 && ! btcMerkleBlockEq(b, b2)) { // walk back to where the fork joins the main chain
-                b = BRSetGet(manager->blocks, &b->prevBlock);
-                if (b && b->height < b2->height) b2 = BRSetGet(manager->blocks, &b2->prevBlock);
+                b = _btcPeerManagerPrevBlock(manager, b);
+                if (b && b->height < b2->height) b2 = _btcPeerManagerPrevBlock(manager, b2);
             }
 
             if (NULL == b) {
                 _peerRelayedBlockFailed (NULL, peer, "In 'on a fork' missed 'b'");
-                return;
+                return NULL;
             }
             peer_log(peer, "reorganizing chain from height %"PRIu32", new height is %"PRIu32, b->height, block->height);
         
@@ -1360,20 +2100,24 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
                                malloc(count*sizeof(*txHashes));
                     if (NULL == txHashes) {
                         _peerRelayedBlockFailed (NULL, peer, "In 'on a fork' missed 'txHashes'");
-                        return;
+                        return NULL;
                     }
                     txCount = count;
                 }
                 
                 count = btcMerkleBlockTxHashes(b, txHashes, count);
-                b = BRSetGet(manager->blocks, &b->prevBlock);
+                b = _btcPeerManagerPrevBlock(manager, b);
                 if (b) timestamp = timestamp/2 + b->timestamp/2;
                 if (count > 0) btcWalletUpdateTransactions(manager->wallet, txHashes, count, height, timestamp);
             }
         
             manager->lastBlock = block;
-            
-            if (block->height == manager->estimatedHeight) { // chain download is complete
+            _btcPeerManagerFilterSetChain(manager, block);
+
+            if (block->height == manager->estimatedHeight && manager->filterSyncing) { // header download is complete
+                if (manager->filterBatchCount == 0) _btcPeerManagerLoadFilterBatch(manager);
+            }
+            else if (block->height == manager->estimatedHeight) { // chain download is complete
                 saveCount = (block->height % BLOCK_DIFFICULTY_INTERVAL) + BLOCK_DIFFICULTY_INTERVAL + 1;
                 _btcPeerManagerLoadMempools(manager);
             }
@@ -1388,17 +2132,23 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
         // check if the next block was received as an orphan
         orphan.prevBlock = block->blockHash;
         next = BRSetRemove(manager->orphans, &orphan);
+        if (! next) next = BRSetRemove(manager->pendingBlocks, &orphan);
+        if (! next && manager->needsGetblocks) _btcPeerManagerScheduleWindows(manager); // pending blocks have drained
     }
     
+    // blocks that haven't been scanned with compact filters yet are saved once the scan completes
+    if (manager->filterSyncing && manager->filterStartHeight > 0 && block &&
+        block->height >= manager->filterStartHeight) saveCount = 0;
+
     BRBitcoinMerkleBlock *saveBlocks[saveCount];
     
     for (i = 0, b = block; b && i < saveCount; i++) {
         if (b->height == BLOCK_UNKNOWN_HEIGHT) {
             _peerRelayedBlockFailed (NULL, peer, "In 'save' missed 'height'");
-            return;
+            return NULL;
         }
         saveBlocks[i] = b;
-        b = BRSetGet(manager->blocks, &b->prevBlock);
+        b = _btcPeerManagerPrevBlock(manager, b);
     }
     
     // make sure the set of blocks to be saved starts at a difficulty interval
@@ -1406,9 +2156,13 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
     if (j > 0) i -= (i > BLOCK_DIFFICULTY_INTERVAL - j) ? BLOCK_DIFFICULTY_INTERVAL - j : i;
     if (i != 0 && (saveBlocks[i - 1]->height % BLOCK_DIFFICULTY_INTERVAL) != 0) {
         _peerRelayedBlockFailed (NULL, peer, "In 'save' missed 'difficulty'");
-        return;
+        return NULL;
     }
     if (i > 0 && manager->saveBlocks) manager->saveBlocks(manager->info, (i > 1 ? 1 : 0), saveBlocks, i);
+
+    // verifying a difficulty transition or saving the chain tip may have paged blocks back in
+    if (i > 1 || (manager->lastBlock->height % BLOCK_TRIM_INTERVAL) == 0 ||
+        (manager->lastBlock->height % BLOCK_DIFFICULTY_INTERVAL) == 0) _btcPeerManagerTrimBlocks(manager);
     pthread_mutex_unlock(&manager->lock);
     
     if (block && block->height != BLOCK_UNKNOWN_HEIGHT && block->height >= btcPeerLastBlock(peer) &&
@@ -1416,7 +2170,72 @@ static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
         manager->txStatusUpdate(manager->info); // notify that transaction confirmations may have changed
     }
     
-    if (next) _peerRelayedBlock(info, next);
+    return next;
+}
+
+static void _peerRelayedBlock(void *info, BRBitcoinMerkleBlock *block)
+{
+    // blocks that were waiting on this one are processed iteratively, there may be many after a parallel download
+    while (block) block = _btcPeerManagerRelayedBlock(info, block);
+}
+
+// headers have already been hashed and checked by the peer, so a run of headers that extends the main chain is linked
+// in a single locked pass and its difficulty transition blocks are saved together, anything else (orphans, forks,
+// headers past earliestKeyTime, the end of the chain) goes through _peerRelayedBlock() one header at a time
+static void _peerRelayedHeaders(void *info, BRBitcoinMerkleBlock *blocks[], size_t blockCount)
+{
+    BRBitcoinPeer *peer = ((BRPeerCallbackInfo *)info)->peer;
+    BRBitcoinPeerManager *manager = ((BRPeerCallbackInfo *)info)->manager;
+    BRBitcoinMerkleBlock *block, *prev, *saveBlocks[blockCount/BLOCK_DIFFICULTY_INTERVAL + 1];
+    size_t i, saveCount = 0;
+
+    pthread_mutex_lock(&manager->lock);
+
+    for (i = 0; manager->lastBlock && BRSetCount(manager->orphans) == 0 && i < blockCount; i++) {
+        block = blocks[i];
+        prev = manager->lastBlock;
+
+        if (block->totalTx != 0 || ! UInt256Eq(block->prevBlock, prev->blockHash)) break;
+        if (! manager->filterSyncing && (! manager->bloomFilter ||
+            block->timestamp + 7*24*60*60 - 2*60*60 > manager->earliestKeyTime)) break;
+        if (prev->height + 1 >= manager->estimatedHeight || prev->height + 1 >= btcPeerLastBlock(peer)) break;
+        block->height = prev->height + 1;
+
+        if (! _btcPeerManagerVerifyBlock(manager, block, prev, peer)) { // let _peerRelayedBlock() handle it
+            block->height = BLOCK_UNKNOWN_HEIGHT;
+            break;
+        }
+
+        if ((block->height % 500) == 0) {
+            peer_log(peer, "adding block #%"PRIu32", false positive rate: %f", block->height, manager->fpRate);
+        }
+
+        BRSetAdd(manager->blocks, block);
+        manager->lastBlock = block;
+        _btcPeerManagerFilterSetChain(manager, block);
+
+        // save transition blocks immediately, except those that haven't been scanned with compact filters yet
+        if ((block->height % BLOCK_DIFFICULTY_INTERVAL) == 0 && block->height + 100 < manager->estimatedHeight &&
+            ! (manager->filterSyncing && manager->filterStartHeight > 0 &&
+               block->height >= manager->filterStartHeight)) saveBlocks[saveCount++] = block;
+        if ((block->height % BLOCK_TRIM_INTERVAL) == 0 || (block->height % BLOCK_DIFFICULTY_INTERVAL) == 0) {
+            _btcPeerManagerTrimBlocks(manager);
+        }
+    }
+
+    if (i > 0) {
+        if (manager->downloadPeer) btcPeerSetCurrentBlockHeight(manager->downloadPeer, manager->lastBlock->height);
+
+        if (peer == manager->downloadPeer) {
+            btcPeerScheduleDisconnect(peer, PROTOCOL_TIMEOUT); // reschedule sync timeout
+            manager->connectFailureCount = 0; // reset failure count once we know our initial request didn't timeout
+        }
+    }
+
+    if (saveCount > 0 && manager->saveBlocks) manager->saveBlocks(manager->info, 0, saveBlocks, saveCount);
+    pthread_mutex_unlock(&manager->lock);
+
+    while (i < blockCount) _peerRelayedBlock(info, blocks[i++]);
 }
 
 static void _peerDataNotfound(void *info, const UInt256 txHashes[], size_t txCount,
@@ -1432,6 +2251,13 @@ static void _peerDataNotfound(void *info, const UInt256 txHashes[], size_t txCou
         _BRTxPeerListRemovePeer(manager->txRequests, txHashes[i], peer);
     }
 
+    if (blockCount > 0 && peer != manager->downloadPeer &&
+        btcBlockWindowsRequeuePeer(&manager->blockWindows, peer) > 0) {
+        peer_log(peer, "peer doesn't have %zu requested block(s), no longer using it for parallel download", blockCount);
+        peer->flags &= ~PEER_FLAG_SYNCHELPER;
+        _btcPeerManagerScheduleWindows(manager);
+    }
+
     pthread_mutex_unlock(&manager->lock);
 }
 
@@ -1481,7 +2307,7 @@ static BRBitcoinTransaction *_peerRequestedTx(void *info, UInt256 txHash)
         btcPeerScheduleDisconnect(peer, -1); // cancel publish tx timeout
     }
 
-    _BRTxPeerListAddPeer(&manager->txRelays, txHash, peer);
+    _BRTxPeerListAddPeer(manager->txRelays, txHash, peer);
     if (pubTx.tx) btcWalletRegisterTransaction(manager->wallet, pubTx.tx);
     if (pubTx.tx && ! btcWalletTransactionIsValid(manager->wallet, pubTx.tx)) error = EINVAL;
     pthread_mutex_unlock(&manager->lock);
@@ -1511,12 +2337,37 @@ static void _dummyThreadCleanup(void *info)
 {
 }
 
+// returns callback info for a new connection to peer, added to connectedPeers with the peer manager's callbacks set
+static BRPeerCallbackInfo *_btcPeerManagerAddPeer(BRBitcoinPeerManager *manager, const BRBitcoinPeer *peer)
+{
+    BRPeerCallbackInfo *info = calloc(1, sizeof(*info));
+
+    assert(info != NULL);
+    info->manager = manager;
+    info->peer = btcPeerNew(manager->params->magicNumber);
+    *info->peer = *peer;
+    array_add(manager->connectedPeers, info->peer);
+    manager->peerThreadCount++;
+    btcPeerSetCallbacks(info->peer, info, _peerConnected, _peerDisconnected, _peerRelayedPeers,
+                       _peerRelayedTx, _peerHasTx, _peerRejectedTx, _peerRelayedBlock, _peerDataNotfound,
+                       _peerSetFeePerKb, _peerRequestedTx, _peerNetworkIsReachable, _peerThreadCleanup);
+    btcPeerSetCompactFilterCallbacks(info->peer, _peerRelayedFilterHeaders, _peerRelayedFilter,
+                                     _peerRelayedFullBlock);
+    btcPeerSetBlockHashesCallback(info->peer, _peerRelayedBlockHashes);
+    btcPeerSetHeadersCallback(info->peer, _peerRelayedHeaders);
+    btcPeerSetVerifyProofOfWork(info->peer, manager->params->verifyProofOfWork);
+    btcPeerSetEarliestKeyTime(info->peer, manager->earliestKeyTime);
+    return info;
+}
+
 // returns a newly allocated BRPeerManager struct that must be freed by calling btcPeerManagerFree()
 BRBitcoinPeerManager *btcPeerManagerNew(const BRBitcoinChainParams *params, BRBitcoinWallet *wallet, uint32_t earliestKeyTime,
                                 BRBitcoinMerkleBlock *blocks[], size_t blocksCount, const BRBitcoinPeer peers[], size_t peersCount)
 {
     BRBitcoinPeerManager *manager = calloc(1, sizeof(*manager));
     BRBitcoinMerkleBlock orphan, *block = NULL;
+    BRSet *loaded = BRSetNew(btcMerkleBlockHash, btcMerkleBlockEq, blocksCount);
+    uint32_t height;
     
     assert(manager != NULL);
     assert(params != NULL);
@@ -1556,11 +2407,21 @@ BRBitcoinPeerManager *btcPeerManagerNew(const BRBitcoinChainParams *params, BRBi
     for (size_t i = 0; blocks && i < blocksCount; i++) {
         assert(blocks[i]->height != BLOCK_UNKNOWN_HEIGHT); // height must be saved/restored along with serialized block
         BRSetAdd(manager->orphans, blocks[i]);
+        BRSetAdd(loaded, blocks[i]);
+    }
 
-        if ((blocks[i]->height % BLOCK_DIFFICULTY_INTERVAL) == 0 &&
-            (! block || blocks[i]->height > block->height)) block = blocks[i]; // find last transition block
+    // find the first block of the most recent run of linked blocks, a difficulty transition when every block since it
+    // was loaded, or the oldest of the recent blocks when only those were loaded along with older transitions and
+    // checkpoints (see btcPeerManagerSetResidentBlocks())
+    for (size_t i = 0; blocks && i < blocksCount; i++) {
+        if (! BRSetContains(loaded, &blocks[i]->prevBlock) && (! block || blocks[i]->height > block->height)) {
+            block = blocks[i];
+        }
     }
-    
+
+    BRSetFree(loaded);
+    height = (block) ? block->height : 0;
+
     while (block) {
         BRSetAdd(manager->blocks, block);
         manager->lastBlock = block;
@@ -1570,12 +2431,27 @@ BRBitcoinPeerManager *btcPeerManagerNew(const BRBitcoinChainParams *params, BRBi
         block = BRSetGet(manager->orphans, &orphan);
     }
 
+    for (size_t i = 0; blocks && i < blocksCount; i++) { // hold older transitions and checkpoints, as trimming does
+        if (blocks[i]->height >= height || BRSetGet(manager->orphans, blocks[i]) != blocks[i] ||
+            BRSetContains(manager->blocks, blocks[i]) || ((blocks[i]->height % BLOCK_DIFFICULTY_INTERVAL) != 0 &&
+                                                          ! BRSetContains(manager->checkpoints, blocks[i]))) continue;
+        BRSetRemove(manager->orphans, blocks[i]);
+        BRSetAdd(manager->blocks, blocks[i]);
+    }
+
     _peer_log("BPM: initialized with %u last block height\n", manager->lastBlock->height);
 
-    array_new(manager->txRelays, 10);
-    array_new(manager->txRequests, 10);
+    manager->txRelays = BRSetNew(btcTransactionHash, btcTransactionEq, 10);
+    manager->txRequests = BRSetNew(btcTransactionHash, btcTransactionEq, 10);
     array_new(manager->publishedTx, 10);
     array_new(manager->publishedTxHashes, 10);
+    array_new(manager->filterBlockHashes, BLOCK_FILTER_MAX_CFILTERS);
+    array_new(manager->filterHashes, BLOCK_FILTER_MAX_CFILTERS);
+    array_new(manager->filters, BLOCK_FILTER_MAX_CFILTERS);
+    array_new(manager->filterFetched, BLOCK_FILTER_MAX_CFILTERS);
+    array_new(manager->filterMatches, 10);
+    btcBlockWindowsInit(&manager->blockWindows);
+    manager->pendingBlocks = BRSetNew(_BRPrevBlockHash, _BRPrevBlockEq, 100); // pending blocks are indexed by prevBlock
     pthread_mutex_init(&manager->lock, NULL);
     manager->threadCleanup = _dummyThreadCleanup;
     return manager;
@@ -1612,6 +2488,26 @@ void btcPeerManagerSetCallbacks(BRBitcoinPeerManager *manager, void *info,
     manager->threadCleanup = (threadCleanup) ? threadCleanup : _dummyThreadCleanup;
 }
 
+// not thread-safe, set before calling btcPeerManagerConnect()
+// if compactFilterSync is true, sync using BIP157/158 compact block filters when the download peer serves them
+void btcPeerManagerSetCompactFilterSync(BRBitcoinPeerManager *manager, int compactFilterSync)
+{
+    assert(manager != NULL);
+    manager->compactFilterSync = compactFilterSync;
+}
+
+// not thread-safe, set after btcPeerManagerSetCallbacks() and before calling btcPeerManagerConnect()
+// holds only the most recent blockCount blocks of the chain in memory, along with difficulty transitions and checkpoints,
+// older blocks are passed to saveBlocks() and freed, and paged back in when needed by calling loadBlock()
+// BRMerkleBlock *loadBlock(void *, uint32_t) - must return a newly allocated copy of the block saved at height, or NULL
+void btcPeerManagerSetResidentBlocks(BRBitcoinPeerManager *manager, uint32_t blockCount,
+                                     BRBitcoinMerkleBlock *(*loadBlock)(void *info, uint32_t height))
+{
+    assert(manager != NULL);
+    manager->residentBlockCount = (blockCount > BLOCK_RESIDENT_MIN) ? blockCount : BLOCK_RESIDENT_MIN;
+    manager->loadBlock = loadBlock;
+}
+
 // specifies a single fixed peer to use when connecting to the bitcoin network
 // set address to UINT128_ZERO to revert to default behavior
 void btcPeerManagerSetFixedPeer(BRBitcoinPeerManager *manager, UInt128 address, uint16_t port)
@@ -1698,18 +2594,8 @@ void btcPeerManagerConnect(BRBitcoinPeerManager *manager)
             }
             
             if (i != SIZE_MAX) {
-                info = calloc(1, sizeof(*info));
-                assert(info != NULL);
-                info->manager = manager;
-                info->peer = btcPeerNew(manager->params->magicNumber);
-                *info->peer = peers[i];
+                info = _btcPeerManagerAddPeer(manager, &peers[i]);
                 array_rm(peers, i);
-                array_add(manager->connectedPeers, info->peer);
-                manager->peerThreadCount++;
-                btcPeerSetCallbacks(info->peer, info, _peerConnected, _peerDisconnected, _peerRelayedPeers,
-                                   _peerRelayedTx, _peerHasTx, _peerRejectedTx, _peerRelayedBlock, _peerDataNotfound,
-                                   _peerSetFeePerKb, _peerRequestedTx, _peerNetworkIsReachable, _peerThreadCleanup);
-                btcPeerSetEarliestKeyTime(info->peer, manager->earliestKeyTime);
                 btcPeerConnect(info->peer);
 
                 if (btcPeerConnectStatus(info->peer) == BRPeerStatusDisconnected) {
@@ -1786,6 +2672,9 @@ static int _btcPeerManagerRescan(BRBitcoinPeerManager *manager, BRBitcoinMerkleB
     }
 
     manager->syncStartHeight = 0; // a syncStartHeight of 0 indicates that syncing hasn't started yet
+    manager->filterSyncing = 0; // any pending compact filter scan restarts from the new last block
+    manager->filterStartHeight = manager->filterHeight = 0;
+    array_clear(manager->filterBlockHashes);
     return 1;
 }
 
@@ -1841,7 +2730,7 @@ static BRBitcoinMerkleBlock *_btcPeerManagerLookupBlockFromBlockNumber(BRBitcoin
     // walk the chain, looking for blockNumber
     while (block) {
         if (block->height == blockNumber) return block;
-        block = BRSetGet (manager->blocks, &block->prevBlock);
+        block = _btcPeerManagerPrevBlock (manager, block);
     }
 
     // blockNumber not in the (abbreviated) chain - look through checkpoints
@@ -1932,6 +2821,17 @@ double btcPeerManagerSyncProgress(BRBitcoinPeerManager *manager, uint32_t startH
     if (! manager->downloadPeer && manager->syncStartHeight == 0) {
         progress = 0.0;
     }
+    else if (manager->filterSyncing) { // headers count for half the progress, and the compact filter scan for the rest
+        if (manager->lastBlock->height > startHeight && manager->estimatedHeight > startHeight) {
+            progress = 0.1 + 0.45*(manager->lastBlock->height - startHeight)/(manager->estimatedHeight - startHeight);
+        }
+        else progress = 0.05;
+
+        if (manager->filterStartHeight > 0 && manager->lastBlock->height >= manager->estimatedHeight) {
+            progress = 0.55 + 0.45*(manager->filterHeight - manager->filterStartHeight)/
+                       (manager->lastBlock->height + 1 - manager->filterStartHeight);
+        }
+    }
     else if (! manager->downloadPeer || manager->lastBlock->height < manager->estimatedHeight) {
         if (manager->lastBlock->height > startHeight && manager->estimatedHeight > startHeight) {
             progress = 0.1 + 0.9*(manager->lastBlock->height - startHeight)/(manager->estimatedHeight - startHeight);
@@ -2053,11 +2953,7 @@ size_t btcPeerManagerRelayCount(BRBitcoinPeerManager *manager, UInt256 txHash)
     assert(! UInt256IsZero(txHash));
     pthread_mutex_lock(&manager->lock);
     
-    for (size_t i = array_count(manager->txRelays); i > 0; i--) {
-        if (! UInt256Eq(manager->txRelays[i - 1].txHash, txHash)) continue;
-        count = array_count(manager->txRelays[i - 1].peers);
-        break;
-    }
+    count = _BRTxPeerListCount(manager->txRelays, txHash);
     
     pthread_mutex_unlock(&manager->lock);
     return count;
@@ -2081,11 +2977,12 @@ void btcPeerManagerFree(BRBitcoinPeerManager *manager)
     BRSetFree(manager->blocks);
     BRSetApply(manager->orphans, NULL, _setApplyFreeBlock);
     BRSetFree(manager->orphans);
+    BRSetApply(manager->pendingBlocks, NULL, _setApplyFreeBlock);
+    BRSetFree(manager->pendingBlocks);
     BRSetFree(manager->checkpoints);
-    for (size_t i = array_count(manager->txRelays); i > 0; i--) array_free(manager->txRelays[i - 1].peers);
-    array_free(manager->txRelays);
-    for (size_t i = array_count(manager->txRequests); i > 0; i--) array_free(manager->txRequests[i - 1].peers);
-    array_free(manager->txRequests);
+    btcBlockWindowsFree(&manager->blockWindows);
+    BRSetFreeAll(manager->txRelays, _BRTxPeerListFree);
+    BRSetFreeAll(manager->txRequests, _BRTxPeerListFree);
 
     for (size_t i = array_count(manager->publishedTx); i > 0; i--) {
         tx = manager->publishedTx[i - 1].tx;
@@ -2093,6 +2990,12 @@ void btcPeerManagerFree(BRBitcoinPeerManager *manager)
     }
 
     if (manager->bloomFilter) btcBloomFilterFree(manager->bloomFilter);
+    _btcPeerManagerFilterBatchClear(manager);
+    array_free(manager->filterBlockHashes);
+    array_free(manager->filterHashes);
+    array_free(manager->filters);
+    array_free(manager->filterFetched);
+    array_free(manager->filterMatches);
 
     array_free(manager->publishedTx);
     array_free(manager->publishedTxHashes);
@@ -2100,3 +3003,52 @@ void btcPeerManagerFree(BRBitcoinPeerManager *manager)
     pthread_mutex_destroy(&manager->lock);
     free(manager);
 }
+
+void btcPeerManagerTrimBlocksTest(BRBitcoinPeerManager *manager)
+{
+    pthread_mutex_lock(&manager->lock);
+    _btcPeerManagerTrimBlocks(manager);
+    pthread_mutex_unlock(&manager->lock);
+}
+
+const BRBitcoinMerkleBlock *btcPeerManagerPrevBlockTest(BRBitcoinPeerManager *manager,
+                                                        const BRBitcoinMerkleBlock *block)
+{
+    BRBitcoinMerkleBlock *prev;
+
+    pthread_mutex_lock(&manager->lock);
+    prev = _btcPeerManagerPrevBlock(manager, block);
+    pthread_mutex_unlock(&manager->lock);
+    return prev;
+}
+
+const BRBitcoinMerkleBlock *btcPeerManagerLookupBlockTest(BRBitcoinPeerManager *manager, uint32_t blockNumber)
+{
+    BRBitcoinMerkleBlock *block;
+
+    pthread_mutex_lock(&manager->lock);
+    block = _btcPeerManagerLookupBlockFromBlockNumber(manager, blockNumber);
+    pthread_mutex_unlock(&manager->lock);
+    return block;
+}
+
+size_t btcPeerManagerBlockLocatorsTest(BRBitcoinPeerManager *manager, UInt256 locators[], size_t locatorsCount)
+{
+    size_t count;
+
+    pthread_mutex_lock(&manager->lock);
+    count = _btcPeerManagerBlockLocators(manager, locators, locatorsCount);
+    pthread_mutex_unlock(&manager->lock);
+    return count;
+}
+
+// adds a stand-in for a connected peer, set up as btcPeerManagerConnect() does, but without connecting to it
+BRBitcoinPeer *btcPeerManagerAddPeerTest(BRBitcoinPeerManager *manager, const BRBitcoinPeer *peer)
+{
+    BRPeerCallbackInfo *info;
+
+    pthread_mutex_lock(&manager->lock);
+    info = _btcPeerManagerAddPeer(manager, peer);
+    pthread_mutex_unlock(&manager->lock);
+    return info->peer;
+}
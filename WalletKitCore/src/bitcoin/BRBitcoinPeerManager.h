@@ -65,6 +65,20 @@ void btcPeerManagerSetCallbacks(BRBitcoinPeerManager *manager, void *info,
                                int (*networkIsReachable)(void *info),
                                void (*threadCleanup)(void *info));
 
+// not thread-safe, set before calling btcPeerManagerConnect()
+// if compactFilterSync is true and the download peer serves BIP157 compact block filters, the chain is synced by
+// downloading block headers and filters, matching filters locally against wallet scripts, and downloading only matched
+// blocks in full, so the download peer never learns which addresses belong to the wallet, a bloom filter is loaded for
+// the mempool and new blocks once the scan completes
+void btcPeerManagerSetCompactFilterSync(BRBitcoinPeerManager *manager, int compactFilterSync);
+
+// not thread-safe, set after btcPeerManagerSetCallbacks() and before calling btcPeerManagerConnect()
+// holds only the most recent blockCount blocks of the chain in memory, along with difficulty transitions and checkpoints,
+// older blocks are passed to saveBlocks() and freed, and paged back in when needed by calling loadBlock()
+// BRMerkleBlock *loadBlock(void *, uint32_t) - must return a newly allocated copy of the block saved at height, or NULL
+void btcPeerManagerSetResidentBlocks(BRBitcoinPeerManager *manager, uint32_t blockCount,
+                                     BRBitcoinMerkleBlock *(*loadBlock)(void *info, uint32_t height));
+
 // specifies a single fixed peer to use when connecting to the bitcoin network
 // set address to UINT128_ZERO to revert to default behavior
 void btcPeerManagerSetFixedPeer(BRBitcoinPeerManager *manager, UInt128 address, uint16_t port);
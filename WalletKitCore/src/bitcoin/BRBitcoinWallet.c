@@ -51,21 +51,57 @@ inline static uint64_t _txFee(uint64_t feePerKb, size_t size)
     return (fee > standardFee) ? fee : standardFee;
 }
 
-// chain position of first tx output address that appears in chain
-inline static size_t _txChainIndex(const BRBitcoinTransaction *tx, const UInt160 *chain)
+// a scriptPubKey paying one of the wallet's pubkey hashes, looked up by its full script bytes
+typedef struct {
+    uint8_t script[34]; // large enough for a 32 byte witness program
+    uint8_t scriptLen;
+    uint8_t pkhOffset; // offset of the pubkey hash in script
+} _BRWalletScript;
+
+inline static size_t _scriptHash(const void *script)
 {
-    const uint8_t *pkh;
+    const _BRWalletScript *s = script;
     
-    for (size_t i = array_count(chain); i > 0; i--) {
-        for (size_t j = 0; j < tx->outCount; j++) {
-            pkh = BRScriptPKH(tx->outputs[j].script, tx->outputs[j].scriptLen);
-            if (pkh && _pkhEq(pkh, &chain[i - 1])) return i - 1;
-        }
-    }
+    return BRMurmur3_32(s->script, s->scriptLen, 0);
+}
+
+inline static int _scriptEq(const void *script, const void *otherScript)
+{
+    const _BRWalletScript *s = script, *o = otherScript;
     
-    return (size_t) -1;
+    return (s == o || (s->scriptLen == o->scriptLen && memcmp(s->script, o->script, s->scriptLen) == 0));
 }
 
+// which outputs of a transaction in wallet->allTx pay to the wallet, as of scriptsGeneration
+typedef struct {
+    UInt256 txHash; // must be first, for use with btcTransactionHash() and btcTransactionEq()
+    size_t generation;
+    size_t outCount;
+    uint8_t owned[]; // for each output, one more than the offset of the pubkey hash if the wallet owns it, 0 otherwise
+} _BRWalletTxOwned;
+
+// where a transaction in wallet->allTx sorts in wallet->transactions, and the transactions in wallet->allTx spending it
+typedef struct {
+    UInt256 txHash; // must be first, for use with btcTransactionHash() and btcTransactionEq()
+    BRBitcoinTransaction *tx; // NULL if tx isn't in wallet->allTx but transactions spending it are
+    BRBitcoinTransaction **children; // NULL if none
+    uint32_t depth; // one more than the greatest depth of a parent with the same blockHeight, 0 if none
+    uint32_t internal, external; // one more than the highest chain index of an address tx pays, 0 if none
+    uint64_t seq; // the order tx was added in, to break any remaining tie
+    size_t mark; // wallet->orderMark when last visited by _btcWalletSortTxs() or _btcWalletTxRaiseDepths()
+    uint8_t isSorted, visit; // isSorted is set while tx is in wallet->transactions
+} _BRWalletTxOrder;
+
+// balance, utxos and transactions as of the last update, published for queries to read without waiting on writers
+typedef struct {
+    uint64_t balance, totalSent, totalReceived;
+    BRBitcoinTransaction **transactions;
+    uint64_t *balanceHist;
+    BRBitcoinUTXO *utxos;
+    size_t txCount, utxosCount;
+    size_t refCount; // the wallet's reference plus one for each query reading it, guarded by wallet->snapshotLock
+} _BRWalletSnapshot;
+
 struct BRBitcoinWalletStruct {
     uint64_t balance, totalSent, totalReceived, feePerKb, *balanceHist;
     uint32_t blockHeight;
@@ -75,82 +111,403 @@ struct BRBitcoinWalletStruct {
     BRAddressParams addrParams;
     UInt160 *internalChain, *externalChain;
     BRSet *allTx, *invalidTx, *pendingTx, *spentOutputs, *usedPKH, *allPKH;
+    _BRWalletScript *scripts;
+    BRSet *allScripts, *txOwned;
+    size_t scriptsGeneration; // incremented each time scripts are added, so stale txOwned entries can be refreshed
+    BRSet *txOrder;
+    uint64_t txSeq;
+    size_t orderMark;
     void *callbackInfo;
     void (*balanceChanged)(void *info, uint64_t balance);
     void (*txAdded)(void *info, BRBitcoinTransaction *tx);
     void (*txUpdated)(void *info, const UInt256 txHashes[], size_t txCount, uint32_t blockHeight, uint32_t timestamp);
     void (*txDeleted)(void *info, UInt256 txHash, int notifyUser, int recommendRescan);
-    pthread_mutex_t lock;
+    pthread_rwlock_t lock; // held for reading by queries, and for writing by anything that changes the wallet
+    _BRWalletSnapshot *snapshot;
+    pthread_mutex_t snapshotLock; // only held to swap or reference the snapshot, never while waiting on lock
 };
 
-inline static int _btcWalletTxIsAscending(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx1,
-                                          const BRBitcoinTransaction *tx2)
+// adds the pay-to-pubkey-hash and pay-to-witness-pubkey-hash scripts for pkh to wallet->scripts, the two kinds that
+// btcTransactionSign() can spend
+static void _btcWalletAddScripts(BRBitcoinWallet *wallet, UInt160 pkh)
+{
+    _BRWalletScript s = { { OP_DUP, OP_HASH160, 20 }, 25, 3 }, w = { { OP_0, 20 }, 22, 2 };
+
+    UInt160Set(&s.script[3], pkh);
+    s.script[23] = OP_EQUALVERIFY, s.script[24] = OP_CHECKSIG;
+    UInt160Set(&w.script[2], pkh);
+    array_add(wallet->scripts, s);
+    array_add(wallet->scripts, w);
+}
+
+// returns one more than the offset of the pubkey hash in script if the wallet owns it, 0 otherwise
+static uint8_t _btcWalletScriptOwned(BRBitcoinWallet *wallet, const uint8_t *script, size_t scriptLen)
+{
+    _BRWalletScript key, *s;
+
+    if (! script || scriptLen == 0 || scriptLen > sizeof(key.script)) return 0;
+    key.scriptLen = (uint8_t)scriptLen;
+    memcpy(key.script, script, scriptLen);
+    s = BRSetGet(wallet->allScripts, &key);
+    return (s) ? s->pkhOffset + 1 : 0;
+}
+
+// starts caching which outputs of tx pay to the wallet, call whenever tx is added to wallet->allTx
+static void _btcWalletTrackTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
 {
-    if (! tx1 || ! tx2) return 0;
-    if (tx1->blockHeight > tx2->blockHeight) return 1;
-    if (tx1->blockHeight < tx2->blockHeight) return 0;
+    _BRWalletTxOwned *o = calloc(1, sizeof(*o) + tx->outCount);
+
+    assert(o != NULL);
+    o->txHash = tx->txHash;
+    o->generation = wallet->scriptsGeneration;
+    o->outCount = tx->outCount;
     
-    for (size_t i = 0; i < tx1->inCount; i++) {
-        if (UInt256Eq(tx1->inputs[i].txHash, tx2->txHash)) return 1;
+    for (size_t i = 0; i < tx->outCount; i++) {
+        o->owned[i] = _btcWalletScriptOwned(wallet, tx->outputs[i].script, tx->outputs[i].scriptLen);
     }
     
-    for (size_t i = 0; i < tx2->inCount; i++) {
-        if (UInt256Eq(tx2->inputs[i].txHash, tx1->txHash)) return 0;
-    }
+    o = BRSetAdd(wallet->txOwned, o);
+    if (o) free(o); // replaced an entry for the same hash
+}
+
+// stops caching outputs for tx, call whenever tx is removed from wallet->allTx
+static void _btcWalletUntrackTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
+{
+    _BRWalletTxOwned *o = BRSetRemove(wallet->txOwned, tx);
 
-    for (size_t i = 0; i < tx1->inCount; i++) {
-        if (_btcWalletTxIsAscending(wallet, BRSetGet(wallet->allTx, &(tx1->inputs[i].txHash)), tx2)) return 1;
+    if (o) free(o);
+}
+
+// the cached output ownership for tx, or NULL if tx isn't in wallet->allTx or addresses were generated since it was
+// computed, doesn't change the cache so it's safe with wallet->lock held for reading
+static const uint8_t *_btcWalletTxOwned(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
+{
+    _BRWalletTxOwned *o = (tx) ? BRSetGet(wallet->txOwned, tx) : NULL;
+
+    return (o && o->outCount == tx->outCount && o->generation == wallet->scriptsGeneration) ? o->owned : NULL;
+}
+
+// the cached output ownership for tx, refreshed if addresses were generated since it was computed, or NULL if tx
+// isn't in wallet->allTx, call with wallet->lock held for writing
+static const uint8_t *_btcWalletTxOwnedRefresh(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
+{
+    _BRWalletTxOwned *o = (tx) ? BRSetGet(wallet->txOwned, tx) : NULL;
+
+    if (o && o->outCount != tx->outCount) o = NULL;
+
+    if (o && o->generation != wallet->scriptsGeneration) {
+        for (size_t i = 0; i < tx->outCount; i++) {
+            o->owned[i] = _btcWalletScriptOwned(wallet, tx->outputs[i].script, tx->outputs[i].scriptLen);
+        }
+
+        o->generation = wallet->scriptsGeneration;
     }
+    
+    return (o) ? o->owned : NULL;
+}
 
-    return 0;
+// one more than the offset of the pubkey hash in output n of tx if the wallet owns it, 0 otherwise, where owned is the
+// result of _btcWalletTxOwned() for tx
+inline static uint8_t _btcWalletOutputOwned(BRBitcoinWallet *wallet, const uint8_t *owned,
+                                            const BRBitcoinTransaction *tx, size_t n)
+{
+    return (owned) ? owned[n] : _btcWalletScriptOwned(wallet, tx->outputs[n].script, tx->outputs[n].scriptLen);
 }
 
-inline static int _btcWalletTxCompare(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx1,
-                                      const BRBitcoinTransaction *tx2)
+// orders by blockHeight, then so that each tx follows those it spends with the same blockHeight, then by the highest
+// internal and external chain index paid, as a proxy for when tx was created, and last by when it was added
+static int _btcWalletTxOrderCompare(const _BRWalletTxOrder *o1, const _BRWalletTxOrder *o2)
 {
-    size_t i = (size_t) -1, j = (size_t) -1;
+    if (o1->tx->blockHeight != o2->tx->blockHeight) return (o1->tx->blockHeight > o2->tx->blockHeight) ? 1 : -1;
+    if (o1->depth != o2->depth) return (o1->depth > o2->depth) ? 1 : -1;
+    if (o1->internal != o2->internal) return (o1->internal > o2->internal) ? 1 : -1;
+    if (o1->external != o2->external) return (o1->external > o2->external) ? 1 : -1;
+    return (o1->seq > o2->seq) - (o1->seq < o2->seq);
+}
 
-    if (_btcWalletTxIsAscending(wallet, tx1, tx2)) return 1;
-    if (_btcWalletTxIsAscending(wallet, tx2, tx1)) return -1;
-    if ((i = _txChainIndex(tx1, wallet->internalChain)) != -1) j = _txChainIndex(tx2, wallet->internalChain);
-    if (j == -1 && (i = _txChainIndex(tx1, wallet->externalChain)) != -1) j = _txChainIndex(tx2, wallet->externalChain);
-    if (i != -1 && j != -1 && i != j) return (i > j) ? 1 : -1;
-    return 0;
+static int _btcWalletTxOrderQsortCompare(const void *o1, const void *o2)
+{
+    return _btcWalletTxOrderCompare(*(_BRWalletTxOrder *const *)o1, *(_BRWalletTxOrder *const *)o2);
+}
+
+// index of the first tx in wallet->transactions that doesn't sort before o, found by binary search
+static size_t _btcWalletTxLowerBound(BRBitcoinWallet *wallet, const _BRWalletTxOrder *o)
+{
+    size_t lo = 0, hi = array_count(wallet->transactions), mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo)/2;
+        if (_btcWalletTxOrderCompare(BRSetGet(wallet->txOrder, wallet->transactions[mid]), o) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return lo;
 }
 
-// inserts tx into wallet->transactions, keeping wallet->transactions sorted by date, oldest first (insertion sort)
+// inserts tx into wallet->transactions, keeping wallet->transactions sorted by date, oldest first
 inline static void _btcWalletInsertTx(BRBitcoinWallet *wallet, BRBitcoinTransaction *tx)
 {
-    size_t i = array_count(wallet->transactions);
-    
-    array_set_count(wallet->transactions, i + 1);
-    
-    while (i > 0 && _btcWalletTxCompare(wallet, wallet->transactions[i - 1], tx) > 0) {
-        wallet->transactions[i] = wallet->transactions[i - 1];
-        i--;
+    _BRWalletTxOrder *o = BRSetGet(wallet->txOrder, tx);
+
+    assert(o != NULL && ! o->isSorted);
+    array_insert(wallet->transactions, _btcWalletTxLowerBound(wallet, o), tx);
+    o->isSorted = 1;
+}
+
+// removes tx from wallet->transactions, call before changing the blockHeight of a sorted tx
+static void _btcWalletRemoveTx(BRBitcoinWallet *wallet, BRBitcoinTransaction *tx)
+{
+    _BRWalletTxOrder *o = BRSetGet(wallet->txOrder, tx);
+    size_t i;
+
+    if (o && o->isSorted) {
+        i = _btcWalletTxLowerBound(wallet, o);
+        assert(i < array_count(wallet->transactions) && wallet->transactions[i] == tx);
+        array_rm(wallet->transactions, i);
+        o->isSorted = 0;
     }
-    
-    wallet->transactions[i] = tx;
+}
+
+// one more than the highest index in chain of an address tx pays, or 0 if none
+static uint32_t _btcWalletTxChainIndex(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx, const UInt160 *chain)
+{
+    uintptr_t start = (uintptr_t)chain, end = (uintptr_t)(chain + array_count(chain)), p;
+    const uint8_t *pkh;
+    uint32_t r = 0;
+
+    for (size_t i = 0; i < tx->outCount; i++) {
+        pkh = BRScriptPKH(tx->outputs[i].script, tx->outputs[i].scriptLen);
+        p = (pkh) ? (uintptr_t)BRSetGet(wallet->allPKH, pkh) : 0; // allPKH entries point into the chains
+        if (p >= start && p < end && (p - start)/sizeof(*chain) + 1 > r) r = (uint32_t)((p - start)/sizeof(*chain) + 1);
+    }
+
+    return r;
+}
+
+// one more than the greatest depth of a parent of tx with the same blockHeight, or 0 if none
+static uint32_t _btcWalletTxDepth(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
+{
+    const _BRWalletTxOrder *p;
+    uint32_t depth = 0;
+
+    for (size_t i = 0; i < tx->inCount; i++) {
+        p = BRSetGet(wallet->txOrder, &tx->inputs[i].txHash);
+        if (p && p->tx && p->tx->blockHeight == tx->blockHeight && p->depth + 1 > depth) depth = p->depth + 1;
+    }
+
+    return depth;
+}
+
+// raises the depth of each descendant of o with the same blockHeight so it still sorts after its parents, re-sorting
+// those in wallet->transactions, returns true if any were
+static int _btcWalletTxRaiseDepths(BRBitcoinWallet *wallet, _BRWalletTxOrder *o)
+{
+    _BRWalletTxOrder **queue, **raised, **kept, *p, *c;
+    uint32_t height = o->tx->blockHeight;
+    size_t mark = ++wallet->orderMark, start, end, i, j, k;
+    int moved;
+
+    if (! o->children) return 0;
+    array_new(queue, 10);
+    array_new(raised, 10);
+    array_add(queue, o);
+
+    for (i = 0; i < array_count(queue); i++) {
+        p = queue[i];
+
+        for (j = 0; p->children && j < array_count(p->children); j++) {
+            c = BRSetGet(wallet->txOrder, p->children[j]);
+            if (c->tx->blockHeight != height || c->depth > p->depth) continue;
+            c->depth = p->depth + 1;
+
+            if (c->isSorted && c->mark != mark) {
+                c->mark = mark;
+                array_add(raised, c);
+            }
+
+            array_add(queue, c);
+        }
+    }
+
+    moved = (array_count(raised) > 0);
+
+    if (moved) { // take the raised transactions out of the run with this blockHeight and merge them back in key order
+        for (start = 0, end = array_count(wallet->transactions); start < end;) {
+            k = start + (end - start)/2;
+            if (wallet->transactions[k]->blockHeight < height) start = k + 1;
+            else end = k;
+        }
+
+        for (end = start; end < array_count(wallet->transactions) &&
+             wallet->transactions[end]->blockHeight == height; end++);
+        array_new(kept, end - start);
+
+        for (k = start; k < end; k++) {
+            c = BRSetGet(wallet->txOrder, wallet->transactions[k]);
+            if (c->mark != mark) array_add(kept, c);
+        }
+
+        qsort(raised, array_count(raised), sizeof(*raised), _btcWalletTxOrderQsortCompare);
+
+        for (i = 0, j = 0, k = start; k < end; k++) {
+            if (j == array_count(raised) ||
+                (i < array_count(kept) && _btcWalletTxOrderCompare(kept[i], raised[j]) < 0)) {
+                wallet->transactions[k] = kept[i++]->tx;
+            }
+            else wallet->transactions[k] = raised[j++]->tx;
+        }
+
+        array_free(kept);
+    }
+
+    array_free(raised);
+    array_free(queue);
+    return moved;
+}
+
+// starts tracking where tx sorts and which transactions spend it, call whenever tx is added to wallet->allTx, unless
+// _btcWalletSortTxs() will be called for it, returns true if transactions already in wallet->transactions moved
+static int _btcWalletOrderTx(BRBitcoinWallet *wallet, BRBitcoinTransaction *tx, int raiseDepths)
+{
+    _BRWalletTxOrder *o = BRSetGet(wallet->txOrder, tx), *p;
+
+    if (! o) {
+        o = calloc(1, sizeof(*o));
+        assert(o != NULL);
+        o->txHash = tx->txHash;
+        BRSetAdd(wallet->txOrder, o);
+    }
+
+    o->tx = tx;
+    o->seq = wallet->txSeq++;
+    o->internal = _btcWalletTxChainIndex(wallet, tx, wallet->internalChain);
+    o->external = _btcWalletTxChainIndex(wallet, tx, wallet->externalChain);
+    o->depth = _btcWalletTxDepth(wallet, tx);
+
+    for (size_t i = 0; i < tx->inCount; i++) {
+        p = BRSetGet(wallet->txOrder, &tx->inputs[i].txHash);
+
+        if (! p) {
+            p = calloc(1, sizeof(*p));
+            assert(p != NULL);
+            p->txHash = tx->inputs[i].txHash;
+            BRSetAdd(wallet->txOrder, p);
+        }
+
+        if (! p->children) array_new(p->children, 1);
+        if (array_count(p->children) == 0 || p->children[array_count(p->children) - 1] != tx) array_add(p->children, tx);
+    }
+
+    return (raiseDepths) ? _btcWalletTxRaiseDepths(wallet, o) : 0;
+}
+
+static void _btcWalletTxOrderFree(void *order)
+{
+    _BRWalletTxOrder *o = order;
+
+    if (o->children) array_free(o->children);
+    free(o);
+}
+
+// stops tracking tx, call whenever tx is removed from wallet->allTx, after removing it from wallet->transactions
+static void _btcWalletUnorderTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
+{
+    _BRWalletTxOrder *o = BRSetGet(wallet->txOrder, tx), *p;
+
+    for (size_t i = 0; i < tx->inCount; i++) {
+        p = BRSetGet(wallet->txOrder, &tx->inputs[i].txHash);
+        if (! p || ! p->children) continue;
+
+        for (size_t j = array_count(p->children); j > 0; j--) {
+            if (p->children[j - 1] == tx) array_rm(p->children, j - 1);
+        }
+
+        if (! p->tx && array_count(p->children) == 0) BRSetRemove(wallet->txOrder, p), _btcWalletTxOrderFree(p);
+    }
+
+    if (o) {
+        assert(! o->isSorted);
+        o->tx = NULL;
+        if (! o->children || array_count(o->children) == 0) BRSetRemove(wallet->txOrder, o), _btcWalletTxOrderFree(o);
+    }
+}
+
+// recalculates the depth of each tx in wallet->transactions from index start on, and of their ancestors with the same
+// blockHeight, in one pass in topological order, then sorts them, for when many have been added or changed at once
+// every tx in wallet->transactions with the same blockHeight as an ancestor reached must be from start on
+static void _btcWalletSortTxs(BRBitcoinWallet *wallet, size_t start)
+{
+    size_t count = array_count(wallet->transactions) - start, mark = ++wallet->orderMark;
+    _BRWalletTxOrder **orders = malloc((count + 1)*sizeof(*orders)), **stack, *o, *p, *c;
+    size_t *next;
+
+    assert(orders != NULL);
+    array_new(stack, 10);
+    array_new(next, 10);
+
+    for (size_t i = 0; i < count; i++) {
+        orders[i] = BRSetGet(wallet->txOrder, wallet->transactions[start + i]);
+        orders[i]->internal = _btcWalletTxChainIndex(wallet, orders[i]->tx, wallet->internalChain);
+        orders[i]->external = _btcWalletTxChainIndex(wallet, orders[i]->tx, wallet->externalChain);
+    }
+
+    // depth first, each tx is finished after all of its parents with the same blockHeight
+    for (size_t i = 0; i < count; i++) {
+        if (orders[i]->mark == mark) continue;
+        orders[i]->mark = mark, orders[i]->visit = 1, orders[i]->depth = 0;
+        array_add(stack, orders[i]);
+        array_add(next, 0);
+
+        while (array_count(stack) > 0) {
+            o = stack[array_count(stack) - 1];
+
+            if (next[array_count(next) - 1] < o->tx->inCount) {
+                p = BRSetGet(wallet->txOrder, &o->tx->inputs[next[array_count(next) - 1]++].txHash);
+                if (! p || ! p->tx || p->tx->blockHeight != o->tx->blockHeight) continue;
+
+                if (p->mark != mark) { // first visit
+                    p->mark = mark, p->visit = 1, p->depth = 0;
+                    array_add(stack, p);
+                    array_add(next, 0);
+                }
+                else if (! p->visit && p->depth + 1 > o->depth) o->depth = p->depth + 1;
+            }
+            else {
+                o->visit = 0;
+                array_set_count(stack, array_count(stack) - 1);
+                array_set_count(next, array_count(next) - 1);
+
+                if (array_count(stack) > 0) { // o's depth is final, so pass it on to the child that reached it
+                    c = stack[array_count(stack) - 1];
+                    if (o->depth + 1 > c->depth) c->depth = o->depth + 1;
+                }
+            }
+        }
+    }
+
+    qsort(orders, count, sizeof(*orders), _btcWalletTxOrderQsortCompare);
+    for (size_t i = 0; i < count; i++) wallet->transactions[start + i] = orders[i]->tx, orders[i]->isSorted = 1;
+    array_free(next);
+    array_free(stack);
+    free(orders);
 }
 
 // non-threadsafe version of btcWalletContainsTransaction()
 static int _btcWalletContainsTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
 {
     int r = 0;
-    const uint8_t *pkh;
+    const uint8_t *owned = _btcWalletTxOwned(wallet, tx);
     UInt160 hash;
     
     for (size_t i = 0; ! r && i < tx->outCount; i++) {
-        pkh = BRScriptPKH(tx->outputs[i].script, tx->outputs[i].scriptLen);
-        if (pkh && BRSetContains(wallet->allPKH, pkh)) r = 1;
+        if (_btcWalletOutputOwned(wallet, owned, tx, i)) r = 1;
     }
     
     for (size_t i = 0; ! r && i < tx->inCount; i++) {
         BRBitcoinTransaction *t = BRSetGet(wallet->allTx, &tx->inputs[i].txHash);
         uint32_t n = tx->inputs[i].index;
         
-        pkh = (t && n < t->outCount) ? BRScriptPKH(t->outputs[n].script, t->outputs[n].scriptLen) : NULL;
-        if (pkh && BRSetContains(wallet->allPKH, pkh)) r = 1;
+        if (t && n < t->outCount && _btcWalletOutputOwned(wallet, _btcWalletTxOwned(wallet, t), t, n)) r = 1;
     }
     
     for (size_t i = 0; ! r && i < tx->inCount; i++) {
@@ -163,6 +520,57 @@ static int _btcWalletContainsTx(BRBitcoinWallet *wallet, const BRBitcoinTransact
     return r;
 }
 
+// replaces wallet->snapshot with the current balance, utxos and transactions, call with wallet->lock held for writing
+static void _btcWalletPublish(BRBitcoinWallet *wallet)
+{
+    size_t txCount = array_count(wallet->transactions), utxosCount = array_count(wallet->utxos);
+    _BRWalletSnapshot *prev, *s = malloc(sizeof(*s) + txCount*(sizeof(*s->transactions) + sizeof(*s->balanceHist)) +
+                                         utxosCount*sizeof(*s->utxos));
+
+    assert(s != NULL);
+    s->balance = wallet->balance;
+    s->totalSent = wallet->totalSent;
+    s->totalReceived = wallet->totalReceived;
+    s->transactions = (BRBitcoinTransaction **)(s + 1);
+    s->balanceHist = (uint64_t *)(s->transactions + txCount);
+    s->utxos = (BRBitcoinUTXO *)(s->balanceHist + txCount);
+    s->txCount = txCount;
+    s->utxosCount = utxosCount;
+    s->refCount = 1;
+    memcpy(s->transactions, wallet->transactions, txCount*sizeof(*s->transactions));
+    memcpy(s->balanceHist, wallet->balanceHist, txCount*sizeof(*s->balanceHist));
+    memcpy(s->utxos, wallet->utxos, utxosCount*sizeof(*s->utxos));
+
+    pthread_mutex_lock(&wallet->snapshotLock);
+    prev = wallet->snapshot;
+    wallet->snapshot = s;
+    if (prev && --prev->refCount > 0) prev = NULL; // the last query reading it will free it
+    pthread_mutex_unlock(&wallet->snapshotLock);
+    if (prev) free(prev);
+}
+
+// references the current wallet->snapshot, which stays valid until _btcWalletSnapshotRelease() is called
+static const _BRWalletSnapshot *_btcWalletSnapshotRetain(BRBitcoinWallet *wallet)
+{
+    _BRWalletSnapshot *s;
+
+    pthread_mutex_lock(&wallet->snapshotLock);
+    s = wallet->snapshot;
+    s->refCount++;
+    pthread_mutex_unlock(&wallet->snapshotLock);
+    return s;
+}
+
+static void _btcWalletSnapshotRelease(BRBitcoinWallet *wallet, const _BRWalletSnapshot *snapshot)
+{
+    _BRWalletSnapshot *s = (_BRWalletSnapshot *)snapshot;
+
+    pthread_mutex_lock(&wallet->snapshotLock);
+    if (--s->refCount > 0) s = NULL;
+    pthread_mutex_unlock(&wallet->snapshotLock);
+    if (s) free(s);
+}
+
 static void _btcWalletUpdateBalance(BRBitcoinWallet *wallet)
 {
     int isInvalid, isPending;
@@ -170,7 +578,7 @@ static void _btcWalletUpdateBalance(BRBitcoinWallet *wallet)
     time_t now = time(NULL);
     size_t i, j;
     BRBitcoinTransaction *tx, *t;
-    const uint8_t *pkh;
+    const uint8_t *owned;
     
     array_clear(wallet->utxos);
     array_clear(wallet->balanceHist);
@@ -231,11 +639,13 @@ static void _btcWalletUpdateBalance(BRBitcoinWallet *wallet)
         // TODO: don't add outputs below TX_MIN_OUTPUT_AMOUNT
         // TODO: don't add coin generation outputs < 100 blocks deep
         // NOTE: balance/UTXOs will then need to be recalculated when last block changes
+        owned = _btcWalletTxOwnedRefresh(wallet, tx);
+        
         for (j = 0; j < tx->outCount; j++) {
-            pkh = BRScriptPKH(tx->outputs[j].script, tx->outputs[j].scriptLen);
+            uint8_t o = _btcWalletOutputOwned(wallet, owned, tx, j);
 
-            if (pkh && BRSetContains(wallet->allPKH, pkh)) {
-                BRSetAdd(wallet->usedPKH, (void *)pkh);
+            if (o) {
+                BRSetAdd(wallet->usedPKH, &tx->outputs[j].script[o - 1]);
                 array_add(wallet->utxos, ((const BRBitcoinUTXO) { tx->txHash, (uint32_t)j }));
                 balance += tx->outputs[j].amount;
             }
@@ -257,6 +667,7 @@ static void _btcWalletUpdateBalance(BRBitcoinWallet *wallet)
 
     assert(array_count(wallet->balanceHist) == array_count(wallet->transactions));
     wallet->balance = balance;
+    _btcWalletPublish(wallet);
 }
 
 // allocates and populates a BRBitcoinWallet struct which must be freed by calling btcWalletFree()
@@ -284,13 +695,21 @@ BRBitcoinWallet *btcWalletNew(BRAddressParams addrParams, BRBitcoinTransaction *
     wallet->spentOutputs = BRSetNew(btcUTXOHash, btcUTXOEq, txCount + 100);
     wallet->usedPKH = BRSetNew(_pkhHash, _pkhEq, txCount + 100);
     wallet->allPKH = BRSetNew(_pkhHash, _pkhEq, txCount + 100);
-    pthread_mutex_init(&wallet->lock, NULL);
+    array_new(wallet->scripts, 400);
+    wallet->allScripts = BRSetNew(_scriptHash, _scriptEq, 400);
+    wallet->txOwned = BRSetNew(btcTransactionHash, btcTransactionEq, txCount + 100);
+    wallet->scriptsGeneration = 1;
+    wallet->txOrder = BRSetNew(btcTransactionHash, btcTransactionEq, txCount + 100);
+    pthread_rwlock_init_brd(&wallet->lock);
+    pthread_mutex_init(&wallet->snapshotLock, NULL);
 
     for (size_t i = 0; transactions && i < txCount; i++) {
         tx = transactions[i];
         if (! btcTransactionIsSigned(tx) || BRSetContains(wallet->allTx, tx)) continue;
         BRSetAdd(wallet->allTx, tx);
-        _btcWalletInsertTx(wallet, tx);
+        _btcWalletTrackTx(wallet, tx);
+        _btcWalletOrderTx(wallet, tx, 0);
+        array_add(wallet->transactions, tx); // sorted all at once below
 
         for (size_t j = 0; j < tx->outCount; j++) {
             pkh = BRScriptPKH(tx->outputs[j].script, tx->outputs[j].scriptLen);
@@ -301,6 +720,7 @@ BRBitcoinWallet *btcWalletNew(BRAddressParams addrParams, BRBitcoinTransaction *
     btcWalletUnusedAddrs(wallet, NULL, SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED, SEQUENCE_EXTERNAL_CHAIN);
     btcWalletUnusedAddrs(wallet, NULL, SEQUENCE_GAP_LIMIT_INTERNAL_EXTENDED, SEQUENCE_INTERNAL_CHAIN);
 
+    _btcWalletSortTxs(wallet, 0); // after generating addresses, so chain indexes are known
     _btcWalletUpdateBalance(wallet);
 
     if (txCount > 0 && ! _btcWalletContainsTx(wallet, transactions[0])) { // verify transactions match master pubKey
@@ -347,7 +767,7 @@ size_t btcWalletUnusedAddrs(BRBitcoinWallet *wallet, BRAddress addrs[], uint32_t
 
     assert(wallet != NULL);
     assert(gapLimit > 0);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_wrlock(&wallet->lock);
     if (internal == SEQUENCE_EXTERNAL_CHAIN) chain = wallet->externalChain;
     if (internal == SEQUENCE_INTERNAL_CHAIN) chain = wallet->internalChain;
     assert(chain != NULL);
@@ -368,10 +788,24 @@ size_t btcWalletUnusedAddrs(BRBitcoinWallet *wallet, BRAddress addrs[], uint32_t
         if (BRSetContains(wallet->usedPKH, &chain[array_count(chain) - 1])) i = count;
     }
 
-    if (addrs && i + gapLimit <= count) {
-        for (j = 0; j < gapLimit; j++) {
-            BRAddressFromHash160(addrs[j].s, sizeof(*addrs), wallet->addrParams, &chain[i + j]);
+    if (addrs && i + gapLimit <= count) j = BRAddressesFromHash160(addrs, wallet->addrParams, &chain[i], gapLimit);
+    
+    if (count > startCount) {
+        _BRWalletScript *scripts = wallet->scripts;
+        
+        for (i = startCount; i < count; i++) _btcWalletAddScripts(wallet, chain[i]);
+
+        if (wallet->scripts == scripts) { // were scripts moved to a new memory location?
+            for (i = array_count(wallet->scripts) - (count - startCount)*2; i < array_count(wallet->scripts); i++) {
+                BRSetAdd(wallet->allScripts, &wallet->scripts[i]);
+            }
+        }
+        else {
+            BRSetClear(wallet->allScripts);
+            for (i = array_count(wallet->scripts); i > 0; i--) BRSetAdd(wallet->allScripts, &wallet->scripts[i - 1]);
         }
+        
+        wallet->scriptsGeneration++;
     }
     
     // was chain moved to a new memory location?
@@ -395,7 +829,7 @@ size_t btcWalletUnusedAddrs(BRBitcoinWallet *wallet, BRAddress addrs[], uint32_t
         }
     }
 
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return j;
 }
 
@@ -405,24 +839,26 @@ uint64_t btcWalletBalance(BRBitcoinWallet *wallet)
     uint64_t balance;
 
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
-    balance = wallet->balance;
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_mutex_lock(&wallet->snapshotLock);
+    balance = wallet->snapshot->balance;
+    pthread_mutex_unlock(&wallet->snapshotLock);
     return balance;
 }
 
 // writes unspent outputs to utxos and returns the number of outputs written, or total number available if utxos is NULL
 size_t btcWalletUTXOs(BRBitcoinWallet *wallet, BRBitcoinUTXO *utxos, size_t utxosCount)
 {
+    const _BRWalletSnapshot *s;
+
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
-    if (! utxos || array_count(wallet->utxos) < utxosCount) utxosCount = array_count(wallet->utxos);
+    s = _btcWalletSnapshotRetain(wallet);
+    if (! utxos || s->utxosCount < utxosCount) utxosCount = s->utxosCount;
 
     for (size_t i = 0; utxos && i < utxosCount; i++) {
-        utxos[i] = wallet->utxos[i];
+        utxos[i] = s->utxos[i];
     }
 
-    pthread_mutex_unlock(&wallet->lock);
+    _btcWalletSnapshotRelease(wallet, s);
     return utxosCount;
 }
 
@@ -430,15 +866,17 @@ size_t btcWalletUTXOs(BRBitcoinWallet *wallet, BRBitcoinUTXO *utxos, size_t utxo
 // returns the number of transactions written, or total number available if transactions is NULL
 size_t btcWalletTransactions(BRBitcoinWallet *wallet, BRBitcoinTransaction *transactions[], size_t txCount)
 {
+    const _BRWalletSnapshot *s;
+
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
-    if (! transactions || array_count(wallet->transactions) < txCount) txCount = array_count(wallet->transactions);
+    s = _btcWalletSnapshotRetain(wallet);
+    if (! transactions || s->txCount < txCount) txCount = s->txCount;
 
     for (size_t i = 0; transactions && i < txCount; i++) {
-        transactions[i] = wallet->transactions[i];
+        transactions[i] = s->transactions[i];
     }
     
-    pthread_mutex_unlock(&wallet->lock);
+    _btcWalletSnapshotRelease(wallet, s);
     return txCount;
 }
 
@@ -450,7 +888,7 @@ size_t btcWalletTxUnconfirmedBefore(BRBitcoinWallet *wallet, BRBitcoinTransactio
     size_t total, n = 0;
 
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     total = array_count(wallet->transactions);
     while (n < total && wallet->transactions[(total - n) - 1]->blockHeight >= blockHeight) n++;
     if (! transactions || n < txCount) txCount = n;
@@ -459,7 +897,7 @@ size_t btcWalletTxUnconfirmedBefore(BRBitcoinWallet *wallet, BRBitcoinTransactio
         transactions[i] = wallet->transactions[(total - n) + i];
     }
 
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return txCount;
 }
 
@@ -469,9 +907,9 @@ uint64_t btcWalletTotalSent(BRBitcoinWallet *wallet)
     uint64_t totalSent;
     
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
-    totalSent = wallet->totalSent;
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_mutex_lock(&wallet->snapshotLock);
+    totalSent = wallet->snapshot->totalSent;
+    pthread_mutex_unlock(&wallet->snapshotLock);
     return totalSent;
 }
 
@@ -481,9 +919,9 @@ uint64_t btcWalletTotalReceived(BRBitcoinWallet *wallet)
     uint64_t totalReceived;
     
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
-    totalReceived = wallet->totalReceived;
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_mutex_lock(&wallet->snapshotLock);
+    totalReceived = wallet->snapshot->totalReceived;
+    pthread_mutex_unlock(&wallet->snapshotLock);
     return totalReceived;
 }
 
@@ -493,18 +931,18 @@ uint64_t btcWalletFeePerKb(BRBitcoinWallet *wallet)
     uint64_t feePerKb;
     
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     feePerKb = wallet->feePerKb;
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return feePerKb;
 }
 
 void btcWalletSetFeePerKb(BRBitcoinWallet *wallet, uint64_t feePerKb)
 {
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_wrlock(&wallet->lock);
     wallet->feePerKb = feePerKb;
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
 }
 
 BRAddressParams btcWalletGetAddressParams (BRBitcoinWallet *wallet) {
@@ -552,28 +990,47 @@ BRAddress btcWalletAddressToLegacy (BRBitcoinWallet *wallet, BRAddress *addrPtr)
 // returns the number addresses written, or total number available if addrs is NULL
 size_t btcWalletAllAddrs(BRBitcoinWallet *wallet, BRAddress addrs[], size_t addrsCount)
 {
-    size_t i, internalCount = 0, externalCount = 0;
+    size_t internalCount = 0, externalCount = 0;
     
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     internalCount = (! addrs || array_count(wallet->internalChain) < addrsCount) ?
                     array_count(wallet->internalChain) : addrsCount;
 
-    for (i = 0; addrs && i < internalCount; i++) {
-        BRAddressFromHash160(addrs[i].s, sizeof(*addrs), wallet->addrParams, &wallet->internalChain[i]);
-    }
+    if (addrs) BRAddressesFromHash160(addrs, wallet->addrParams, wallet->internalChain, internalCount);
 
     externalCount = (! addrs || array_count(wallet->externalChain) < addrsCount - internalCount) ?
                     array_count(wallet->externalChain) : addrsCount - internalCount;
 
-    for (i = 0; addrs && i < externalCount; i++) {
-        BRAddressFromHash160(addrs[internalCount + i].s, sizeof(*addrs), wallet->addrParams, &wallet->externalChain[i]);
-    }
+    if (addrs) BRAddressesFromHash160(&addrs[internalCount], wallet->addrParams, wallet->externalChain, externalCount);
 
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return internalCount + externalCount;
 }
 
+// writes the addresses previously generated with btcWalletUnusedAddrs() on the given chain, starting at index start,
+// to addrs
+// returns the number of addresses written, or the total number available from start if addrs is NULL
+size_t btcWalletChainAddrs(BRBitcoinWallet *wallet, BRAddress addrs[], size_t addrsCount, uint32_t internal,
+                           size_t start)
+{
+    UInt160 *chain = NULL;
+    size_t count = 0;
+
+    assert(wallet != NULL);
+    pthread_rwlock_rdlock(&wallet->lock);
+    if (internal == SEQUENCE_EXTERNAL_CHAIN) chain = wallet->externalChain;
+    if (internal == SEQUENCE_INTERNAL_CHAIN) chain = wallet->internalChain;
+    assert(chain != NULL);
+    if (start < array_count(chain)) count = array_count(chain) - start;
+    if (addrs && count > addrsCount) count = addrsCount;
+
+    if (addrs) BRAddressesFromHash160(addrs, wallet->addrParams, &chain[start], count);
+
+    pthread_rwlock_unlock(&wallet->lock);
+    return count;
+}
+
 // true if the address was previously generated by btcWalletUnusedAddrs() (even if it's now used)
 int btcWalletContainsAddress(BRBitcoinWallet *wallet, const char *addr)
 {
@@ -582,10 +1039,10 @@ int btcWalletContainsAddress(BRBitcoinWallet *wallet, const char *addr)
     
     assert(wallet != NULL);
     assert(addr != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     if (addr) BRAddressHash160(&pkh, wallet->addrParams, addr);
     r = BRSetContains(wallet->allPKH, &pkh);
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return r;
 }
 
@@ -597,10 +1054,10 @@ int btcWalletAddressIsUsed(BRBitcoinWallet *wallet, const char *addr)
     
     assert(wallet != NULL);
     assert(addr != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     if (addr) BRAddressHash160(&pkh, wallet->addrParams, addr);
     r = BRSetContains(wallet->usedPKH, &pkh);
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return r;
 }
 
@@ -657,7 +1114,7 @@ BRBitcoinTransaction *btcWalletCreateTxForOutputsWithFeePerKb(BRBitcoinWallet *w
     }
     
     minAmount = btcWalletMinOutputAmountWithFeePerKb(wallet, feePerKb);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     feePerKb = UINT64_MAX == feePerKb ? wallet->feePerKb : feePerKb;
     feeAmount = _txFee(feePerKb, btcTransactionVSize(transaction) + TX_OUTPUT_SIZE);
     
@@ -687,7 +1144,7 @@ BRBitcoinTransaction *btcWalletCreateTxForOutputsWithFeePerKb(BRBitcoinWallet *w
         if (balance == amount + feeAmount || balance >= amount + feeAmount + minAmount) break;
     }
     
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     
     if (transaction && balance > amount + feeAmount + minAmount) { // add change output
         btcWalletUnusedAddrs(wallet, &addr, 1, 1);
@@ -720,7 +1177,7 @@ int btcWalletSignTransaction(BRBitcoinWallet *wallet, BRBitcoinTransaction *tx,
     
     assert(wallet != NULL);
     assert(tx != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     
     for (i = 0; tx && i < tx->inCount; i++) {
         const uint8_t *pkh = BRScriptPKH(tx->inputs[i].script, tx->inputs[i].scriptLen);
@@ -734,7 +1191,7 @@ int btcWalletSignTransaction(BRBitcoinWallet *wallet, BRBitcoinTransaction *tx,
         }
     }
 
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
 
     BRKey keys[internalCount + externalCount];
 
@@ -759,9 +1216,9 @@ int btcWalletContainsTransaction(BRBitcoinWallet *wallet, const BRBitcoinTransac
     
     assert(wallet != NULL);
     assert(tx != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     if (tx) r = _btcWalletContainsTx(wallet, tx);
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return r;
 }
 
@@ -774,7 +1231,7 @@ int btcWalletRegisterTransaction(BRBitcoinWallet *wallet, BRBitcoinTransaction *
     assert(tx != NULL && btcTransactionIsSigned(tx));
     
     if (tx && btcTransactionIsSigned(tx)) {
-        pthread_mutex_lock(&wallet->lock);
+        pthread_rwlock_wrlock(&wallet->lock);
 
         if (! BRSetContains(wallet->allTx, tx)) {
             if (_btcWalletContainsTx(wallet, tx)) {
@@ -782,19 +1239,28 @@ int btcWalletRegisterTransaction(BRBitcoinWallet *wallet, BRBitcoinTransaction *
                 // TODO: handle tx replacement with input sequence numbers
                 //       (for now, replacements appear invalid until confirmation)
                 BRSetAdd(wallet->allTx, tx);
+                _btcWalletTrackTx(wallet, tx);
+                _btcWalletOrderTx(wallet, tx, 1);
                 _btcWalletInsertTx(wallet, tx);
                 _btcWalletUpdateBalance(wallet);
                 wasAdded = 1;
             }
             else { // keep track of unconfirmed non-wallet tx for invalid tx checks and child-pays-for-parent fees
                    // BUG: limit total non-wallet unconfirmed tx to avoid memory exhaustion attack
-                if (tx->blockHeight == TX_UNCONFIRMED) BRSetAdd(wallet->allTx, tx);
+                if (tx->blockHeight == TX_UNCONFIRMED) {
+                    BRSetAdd(wallet->allTx, tx);
+                    _btcWalletTrackTx(wallet, tx);
+
+                    // a wallet tx that spends tx, through tx, may have been sorted before tx's wallet parent
+                    if (_btcWalletOrderTx(wallet, tx, 1)) _btcWalletUpdateBalance(wallet);
+                }
+
                 r = 0;
                 // BUG: XXX memory leak if tx is not added to wallet->allTx, and we can't just free it
             }
         }
     
-        pthread_mutex_unlock(&wallet->lock);
+        pthread_rwlock_unlock(&wallet->lock);
     }
     else r = 0;
 
@@ -818,7 +1284,7 @@ void btcWalletRemoveTransaction(BRBitcoinWallet *wallet, UInt256 txHash)
 
     assert(wallet != NULL);
     assert(! UInt256IsZero(txHash));
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_wrlock(&wallet->lock);
     tx = BRSetGet(wallet->allTx, &txHash);
 
     if (tx) {
@@ -837,7 +1303,7 @@ void btcWalletRemoveTransaction(BRBitcoinWallet *wallet, UInt256 txHash)
         }
         
         if (array_count(hashes) > 0) {
-            pthread_mutex_unlock(&wallet->lock);
+            pthread_rwlock_unlock(&wallet->lock);
             
             for (size_t i = array_count(hashes); i > 0; i--) {
                 btcWalletRemoveTransaction(wallet, hashes[i - 1]);
@@ -846,14 +1312,9 @@ void btcWalletRemoveTransaction(BRBitcoinWallet *wallet, UInt256 txHash)
             btcWalletRemoveTransaction(wallet, txHash);
         }
         else {
-            for (size_t i = array_count(wallet->transactions); i > 0; i--) {
-                if (! btcTransactionEq(wallet->transactions[i - 1], tx)) continue;
-                array_rm(wallet->transactions, i - 1);
-                break;
-            }
-            
+            _btcWalletRemoveTx(wallet, tx);
             _btcWalletUpdateBalance(wallet);
-            pthread_mutex_unlock(&wallet->lock);
+            pthread_rwlock_unlock(&wallet->lock);
             
             // if this is for a transaction we sent, and it wasn't already known to be invalid, notify user
             if (btcWalletAmountSentByTx(wallet, tx) > 0 && btcWalletTransactionIsValid(wallet, tx)) {
@@ -873,7 +1334,7 @@ void btcWalletRemoveTransaction(BRBitcoinWallet *wallet, UInt256 txHash)
         
         array_free(hashes);
     }
-    else pthread_mutex_unlock(&wallet->lock);
+    else pthread_rwlock_unlock(&wallet->lock);
 }
 
 // returns the transaction with the given hash if it's been registered in the wallet
@@ -883,9 +1344,9 @@ BRBitcoinTransaction *btcWalletTransactionForHash(BRBitcoinWallet *wallet, UInt2
     
     assert(wallet != NULL);
     assert(! UInt256IsZero(txHash));
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     tx = BRSetGet(wallet->allTx, &txHash);
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return tx;
 }
 
@@ -895,10 +1356,10 @@ BRBitcoinTransaction *btcWalletTransactionCopyForHash(BRBitcoinWallet *wallet, U
 
     assert(wallet != NULL);
     assert(! UInt256IsZero(txHash));
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     tx = BRSetGet(wallet->allTx, &txHash);
     if (tx) tx = btcTransactionCopy (tx);
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return tx;
 }
 
@@ -915,7 +1376,7 @@ int btcWalletTransactionIsValid(BRBitcoinWallet *wallet, const BRBitcoinTransact
     // TODO: XXX conflicted tx with the same wallet outputs should be presented as the same tx to the user
 
     if (tx && tx->blockHeight == TX_UNCONFIRMED) { // only unconfirmed transactions can be invalid
-        pthread_mutex_lock(&wallet->lock);
+        pthread_rwlock_rdlock(&wallet->lock);
 
         if (! BRSetContains(wallet->allTx, tx)) {
             for (size_t i = 0; r && i < tx->inCount; i++) {
@@ -924,7 +1385,7 @@ int btcWalletTransactionIsValid(BRBitcoinWallet *wallet, const BRBitcoinTransact
         }
         else if (BRSetContains(wallet->invalidTx, tx)) r = 0;
 
-        pthread_mutex_unlock(&wallet->lock);
+        pthread_rwlock_unlock(&wallet->lock);
 
         for (size_t i = 0; r && i < tx->inCount; i++) {
             t = btcWalletTransactionForHash(wallet, tx->inputs[i].txHash);
@@ -945,9 +1406,9 @@ int btcWalletTransactionIsPending(BRBitcoinWallet *wallet, const BRBitcoinTransa
     
     assert(wallet != NULL);
     assert(tx != NULL && btcTransactionIsSigned(tx));
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     blockHeight = wallet->blockHeight;
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
 
     if (tx && tx->blockHeight == TX_UNCONFIRMED) { // only unconfirmed transactions can be postdated
         if (btcTransactionVSize(tx) > TX_MAX_SIZE) r = 1; // check transaction size is under TX_MAX_SIZE
@@ -997,14 +1458,12 @@ int btcWalletTransactionIsVerified(BRBitcoinWallet *wallet, const BRBitcoinTrans
 static int _btcWalletContainsTxInput(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx,
                                      const BRBitcoinTxInput *txInput)
 {
-    const uint8_t *pkh;
     UInt160 hash;
 
     BRBitcoinTransaction *t = BRSetGet(wallet->allTx, &txInput->txHash);
     uint32_t n = txInput->index;
 
-    pkh = (t && n < t->outCount) ? BRScriptPKH(t->outputs[n].script, t->outputs[n].scriptLen) : NULL;
-    if (pkh && BRSetContains(wallet->allPKH, pkh)) return 1;
+    if (t && n < t->outCount && _btcWalletOutputOwned(wallet, _btcWalletTxOwned(wallet, t), t, n)) return 1;
 
     size_t l = ((txInput->witLen > 0)
                 ? BRWitnessPKH(hash.u8, txInput->witness, txInput->witLen)
@@ -1025,14 +1484,14 @@ int btcWalletTransactionIsResolved (BRBitcoinWallet *wallet, const BRBitcoinTran
     _IsResolvedWalletAssert(wallet != NULL);
     _IsResolvedTransactionAssert (tx != NULL);
 
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     if (!btcTransactionIsSigned(tx)) r = 0;
     for (size_t i = 0; r && i < tx->inCount; i++) {
         if (_btcWalletContainsTxInput (wallet, tx, &tx->inputs[i]) &&
             NULL == BRSetGet(wallet->allTx, &tx->inputs[i].txHash))
             r = 0;
     }
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
 
     return r;
 }
@@ -1043,43 +1502,47 @@ void btcWalletUpdateTransactions(BRBitcoinWallet *wallet, const UInt256 txHashes
                                  uint32_t blockHeight, uint32_t timestamp)
 {
     BRBitcoinTransaction *tx;
+    _BRWalletTxOrder *o;
 
     UInt256 hashesBuf[4096];
     UInt256 *hashes = (txCount <= 4096 ? hashesBuf : calloc (txCount, sizeof (UInt256)));
 
-    int needsUpdate = 0;
-    size_t i, j, k;
+    int needsUpdate = 0, isSorted;
+    size_t i, j;
     
     assert(wallet != NULL);
     assert(txHashes != NULL || txCount == 0);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_wrlock(&wallet->lock);
     if (blockHeight != TX_UNCONFIRMED && blockHeight > wallet->blockHeight) wallet->blockHeight = blockHeight;
     
     for (i = 0, j = 0; txHashes && i < txCount; i++) {
         tx = BRSetGet(wallet->allTx, &txHashes[i]);
         if (! tx || (tx->blockHeight == blockHeight && tx->timestamp == timestamp)) continue;
+        o = BRSetGet(wallet->txOrder, tx);
+        assert(o != NULL);
+        isSorted = o->isSorted;
+        if (isSorted) _btcWalletRemoveTx(wallet, tx); // remove and re-insert tx to keep wallet sorted
         tx->timestamp = timestamp;
         tx->blockHeight = blockHeight;
-        
+        o->depth = _btcWalletTxDepth(wallet, tx);
+        if (isSorted) _btcWalletInsertTx(wallet, tx);
+        _btcWalletTxRaiseDepths(wallet, o);
+
         if (_btcWalletContainsTx(wallet, tx)) {
-            for (k = array_count(wallet->transactions); k > 0; k--) { // remove and re-insert tx to keep wallet sorted
-                if (! btcTransactionEq(wallet->transactions[k - 1], tx)) continue;
-                array_rm(wallet->transactions, k - 1);
-                _btcWalletInsertTx(wallet, tx);
-                break;
-            }
-            
             hashes[j++] = txHashes[i];
             if (BRSetContains(wallet->pendingTx, tx) || BRSetContains(wallet->invalidTx, tx)) needsUpdate = 1;
         }
         else if (blockHeight != TX_UNCONFIRMED) { // remove and free confirmed non-wallet tx
             BRSetRemove(wallet->allTx, tx);
+            _btcWalletUntrackTx(wallet, tx);
+            _btcWalletUnorderTx(wallet, tx);
             btcTransactionFree(tx);
         }
     }
     
     if (needsUpdate) _btcWalletUpdateBalance(wallet);
-    pthread_mutex_unlock(&wallet->lock);
+    else if (j > 0) _btcWalletPublish(wallet); // transactions were re-sorted
+    pthread_rwlock_unlock(&wallet->lock);
     if (j > 0 && wallet->txUpdated) wallet->txUpdated(wallet->callbackInfo, hashes, j, blockHeight, timestamp);
     if (hashes != hashesBuf) free (hashes);
 }
@@ -1090,7 +1553,7 @@ void btcWalletSetTxUnconfirmedAfter(BRBitcoinWallet *wallet, uint32_t blockHeigh
     size_t i, j, count;
     
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_wrlock(&wallet->lock);
     wallet->blockHeight = blockHeight;
     count = i = array_count(wallet->transactions);
     while (i > 0 && wallet->transactions[i - 1]->blockHeight > blockHeight) i--;
@@ -1104,8 +1567,18 @@ void btcWalletSetTxUnconfirmedAfter(BRBitcoinWallet *wallet, uint32_t blockHeigh
         hashes[j] = wallet->transactions[i + j]->txHash;
     }
     
-    if (count > 0) _btcWalletUpdateBalance(wallet);
-    pthread_mutex_unlock(&wallet->lock);
+    if (count > 0) {
+        _btcWalletSortTxs(wallet, i); // already unconfirmed wallet tx are all from i on as well
+
+        // unconfirmed non-wallet tx spending these aren't in wallet->transactions, so catch up their depths as well
+        for (j = 0; j < count; j++) {
+            _btcWalletTxRaiseDepths(wallet, BRSetGet(wallet->txOrder, wallet->transactions[i + j]));
+        }
+
+        _btcWalletUpdateBalance(wallet);
+    }
+
+    pthread_rwlock_unlock(&wallet->lock);
     if (count > 0 && wallet->txUpdated) wallet->txUpdated(wallet->callbackInfo, hashes, count, TX_UNCONFIRMED, 0);
     if (hashes != hashesBuf) free (hashes);
 }
@@ -1114,19 +1587,19 @@ void btcWalletSetTxUnconfirmedAfter(BRBitcoinWallet *wallet, uint32_t blockHeigh
 uint64_t btcWalletAmountReceivedFromTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
 {
     uint64_t amount = 0;
-    const uint8_t *pkh;
+    const uint8_t *owned;
     
     assert(wallet != NULL);
     assert(tx != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
+    owned = _btcWalletTxOwned(wallet, tx);
     
     // TODO: don't include outputs below TX_MIN_OUTPUT_AMOUNT
     for (size_t i = 0; tx && i < tx->outCount; i++) {
-        pkh = BRScriptPKH(tx->outputs[i].script, tx->outputs[i].scriptLen);
-        if (pkh && BRSetContains(wallet->allPKH, pkh)) amount += tx->outputs[i].amount;
+        if (_btcWalletOutputOwned(wallet, owned, tx, i)) amount += tx->outputs[i].amount;
     }
     
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return amount;
 }
 
@@ -1137,20 +1610,18 @@ uint64_t btcWalletAmountSentByTx(BRBitcoinWallet *wallet, const BRBitcoinTransac
     
     assert(wallet != NULL);
     assert(tx != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     
     for (size_t i = 0; tx && i < tx->inCount; i++) {
         BRBitcoinTransaction *t = BRSetGet(wallet->allTx, &tx->inputs[i].txHash);
         uint32_t n = tx->inputs[i].index;
-        const uint8_t *pkh;
 
-        if (t && n < t->outCount) {
-            pkh = BRScriptPKH(t->outputs[n].script, t->outputs[n].scriptLen);
-            if (pkh && BRSetContains(wallet->allPKH, pkh)) amount += t->outputs[n].amount;
+        if (t && n < t->outCount && _btcWalletOutputOwned(wallet, _btcWalletTxOwned(wallet, t), t, n)) {
+            amount += t->outputs[n].amount;
         }
     }
     
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return amount;
 }
 
@@ -1161,7 +1632,7 @@ uint64_t btcWalletFeeForTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *
     
     assert(wallet != NULL);
     assert(tx != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     
     for (size_t i = 0; tx && i < tx->inCount && amount != UINT64_MAX; i++) {
         BRBitcoinTransaction *t = BRSetGet(wallet->allTx, &tx->inputs[i].txHash);
@@ -1173,7 +1644,7 @@ uint64_t btcWalletFeeForTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *
         else amount = UINT64_MAX;
     }
     
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     
     for (size_t i = 0; tx && i < tx->outCount && amount != UINT64_MAX; i++) {
         amount -= tx->outputs[i].amount;
@@ -1185,20 +1656,21 @@ uint64_t btcWalletFeeForTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *
 // historical wallet balance after the given transaction, or current balance if transaction is not registered in wallet
 uint64_t btcWalletBalanceAfterTx(BRBitcoinWallet *wallet, const BRBitcoinTransaction *tx)
 {
+    const _BRWalletSnapshot *s;
     uint64_t balance;
     
     assert(wallet != NULL);
     assert(tx != NULL && btcTransactionIsSigned(tx));
-    pthread_mutex_lock(&wallet->lock);
-    balance = wallet->balance;
+    s = _btcWalletSnapshotRetain(wallet);
+    balance = s->balance;
     
-    for (size_t i = array_count(wallet->transactions); tx && i > 0; i--) {
-        if (! btcTransactionEq(tx, wallet->transactions[i - 1])) continue;
-        balance = wallet->balanceHist[i - 1];
+    for (size_t i = s->txCount; tx && i > 0; i--) {
+        if (! btcTransactionEq(tx, s->transactions[i - 1])) continue;
+        balance = s->balanceHist[i - 1];
         break;
     }
 
-    pthread_mutex_unlock(&wallet->lock);
+    _btcWalletSnapshotRelease(wallet, s);
     return balance;
 }
 
@@ -1208,9 +1680,9 @@ uint64_t btcWalletFeeForTxSize(BRBitcoinWallet *wallet, size_t size)
     uint64_t fee;
     
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     fee = _txFee(wallet->feePerKb, size);
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return fee;
 }
 
@@ -1259,11 +1731,11 @@ uint64_t btcWalletMinOutputAmountWithFeePerKb(BRBitcoinWallet *wallet, uint64_t
     uint64_t amount;
     
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     feePerKb = UINT64_MAX == feePerKb ? wallet->feePerKb : feePerKb;
     //amount = (TX_MIN_OUTPUT_AMOUNT*feePerKb + MIN_FEE_PER_KB - 1)/MIN_FEE_PER_KB;
     amount = _txFee(feePerKb, TX_OUTPUT_SIZE + TX_INPUT_SIZE);
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     return (amount > TX_MIN_OUTPUT_AMOUNT) ? amount : TX_MIN_OUTPUT_AMOUNT;
 }
 
@@ -1283,7 +1755,7 @@ uint64_t btcWalletMaxOutputAmountWithFeePerKb(BRBitcoinWallet *wallet, uint64_t
     size_t i, cpfpSize = 0;
 
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_rdlock(&wallet->lock);
     feePerKb = UINT64_MAX == feePerKb ? wallet->feePerKb : feePerKb;
 
     for (i = 0; i < array_count(wallet->utxos); i++) {
@@ -1310,7 +1782,7 @@ uint64_t btcWalletMaxOutputAmountWithFeePerKb(BRBitcoinWallet *wallet, uint64_t
 //            ! _btcWalletTxIsSend(wallet, tx)) cpfpSize += btcTransactionVSize(tx);
     }
 
-    pthread_mutex_unlock(&wallet->lock);
+    pthread_rwlock_unlock(&wallet->lock);
     fee = _txFee(feePerKb, btcTransactionVSize(tx) + TX_OUTPUT_SIZE*2 + cpfpSize);
     btcTransactionFree(tx);
     return (amount > fee) ? amount - fee : 0;
@@ -1325,9 +1797,13 @@ static void _setApplyFreeTx(void *info, void *tx)
 void btcWalletFree(BRBitcoinWallet *wallet)
 {
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
+    pthread_rwlock_wrlock(&wallet->lock);
     BRSetFree(wallet->allPKH);
     BRSetFree(wallet->usedPKH);
+    BRSetFree(wallet->allScripts);
+    BRSetFreeAll(wallet->txOwned, free);
+    BRSetFreeAll(wallet->txOrder, _btcWalletTxOrderFree);
+    array_free(wallet->scripts);
     BRSetFree(wallet->invalidTx);
     BRSetFree(wallet->pendingTx);
     BRSetApply(wallet->allTx, NULL, _setApplyFreeTx);
@@ -1338,8 +1814,10 @@ void btcWalletFree(BRBitcoinWallet *wallet)
     array_free(wallet->balanceHist);
     array_free(wallet->transactions);
     array_free(wallet->utxos);
-    pthread_mutex_unlock(&wallet->lock);
-    pthread_mutex_destroy(&wallet->lock);
+    if (wallet->snapshot) free(wallet->snapshot);
+    pthread_rwlock_unlock(&wallet->lock);
+    pthread_rwlock_destroy(&wallet->lock);
+    pthread_mutex_destroy(&wallet->snapshotLock);
     free(wallet);
 }
 
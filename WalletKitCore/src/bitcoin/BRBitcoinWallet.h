@@ -100,6 +100,13 @@ BRAddress btcWalletAddressToLegacy (BRBitcoinWallet *wallet, BRAddress *addr);
 // returns the number addresses written, or total number available if addrs is NULL
 size_t btcWalletAllAddrs(BRBitcoinWallet *wallet, BRAddress addrs[], size_t addrsCount);
 
+// writes the addresses previously generated with btcWalletUnusedAddrs() on the given chain (internal or external),
+// starting at index start, to addrs; since chains only grow, the chain count serves as a version for callers that
+// track the addresses added since their last call
+// returns the number of addresses written, or the total number available from start if addrs is NULL
+size_t btcWalletChainAddrs(BRBitcoinWallet *wallet, BRAddress addrs[], size_t addrsCount, uint32_t internal,
+                           size_t start);
+
 // true if the address was previously generated by btcWalletUnusedAddrs() (even if it's now used)
 int btcWalletContainsAddress(BRBitcoinWallet *wallet, const char *addr);
 
@@ -95,7 +95,7 @@ static int bsvMainNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const B
         if (target - block->target > 1) return 0;
     }
     
-    return btcMerkleBlockVerifyProofOfWork(block);
+    return 1; // proof-of-work is checked by the peer
 }
 
 static int bsvTestNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRSet *blockSet)
@@ -109,6 +109,7 @@ static BRBitcoinChainParams bsvMainNetParamsRecord = {
     0xe8f3e1e3,          // magicNumber
     SERVICES_NODE_BCASH, // services
     bsvMainNetVerifyDifficulty,
+    btcMerkleBlockVerifyProofOfWork,
     NULL,
     0,
     { BITCOIN_PUBKEY_PREFIX, BITCOIN_SCRIPT_PREFIX, BITCOIN_PRIVKEY_PREFIX, NULL },
@@ -124,6 +125,7 @@ static BRBitcoinChainParams bsvTestNetParamsRecord = {
     SERVICES_NODE_BCASH, // services
     bsvTestNetVerifyDifficulty,
     NULL,
+    NULL,
     0,
     { BITCOIN_PUBKEY_PREFIX_TEST, BITCOIN_SCRIPT_PREFIX_TEST, BITCOIN_PRIVKEY_PREFIX_TEST, NULL },
     BSV_FORKID,
@@ -128,7 +128,7 @@ static int dogeMainNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const
         if (b && block->target != target) r = 0;
     }
     
-    return r && dogeVerifyProofOfWork(block); // to the moon!
+    return r; // proof-of-work is checked by the peer, to the moon!
 }
 
 static int dogeTestNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRSet *blockSet)
@@ -142,6 +142,7 @@ static BRBitcoinChainParams dogeMainNetParamsRecord = {
     0xc0c0c0c0,
     0,
     dogeMainNetVerifyDifficulty,
+    dogeVerifyProofOfWork,
     NULL,
     0,
     { DOGE_PUBKEY_PREFIX, DOGE_SCRIPT_PREFIX, DOGE_PRIVKEY_PREFIX, NULL },
@@ -157,6 +158,7 @@ static BRBitcoinChainParams dogeTestNetParamsRecord = {
     0,
     dogeTestNetVerifyDifficulty,
     NULL,
+    NULL,
     0,
     { DOGE_PUBKEY_PREFIX_TEST, DOGE_SCRIPT_PREFIX_TEST, DOGE_PRIVKEY_PREFIX_TEST, NULL },
     BITCOIN_FORKID,
@@ -12,6 +12,7 @@
 #include "proto/Transaction.pb-c.h"
 #include "proto/TransactionBody.pb-c.h"
 #include <stdlib.h>
+#include <assert.h>
 
 const size_t max_memo_size = 100L;
 
@@ -61,14 +62,13 @@ Proto__AccountAmount * createAccountAmount (BRHederaAddress address, int64_t amo
     return accountAmount;
 }
 
-uint8_t * hederaTransactionBodyPack (BRHederaAddress source,
-                                       BRHederaAddress target,
-                                       BRHederaAddress nodeAddress,
-                                       BRHederaUnitTinyBar amount,
-                                       BRHederaTimeStamp timeStamp,
-                                       BRHederaUnitTinyBar fee,
-                                       const char * memo,
-                                       size_t *size)
+static Proto__TransactionBody * createTransactionBody (BRHederaAddress source,
+                                                      BRHederaAddress target,
+                                                      BRHederaAddress nodeAddress,
+                                                      BRHederaUnitTinyBar amount,
+                                                      BRHederaTimeStamp timeStamp,
+                                                      BRHederaUnitTinyBar fee,
+                                                      const char * memo)
 {
     Proto__TransactionBody *body = calloc(1, sizeof(Proto__TransactionBody));
     proto__transaction_body__init(body);
@@ -104,6 +104,21 @@ uint8_t * hederaTransactionBodyPack (BRHederaAddress source,
     body->cryptotransfer->transfers->accountamounts[0] = createAccountAmount(source, -(amount));
     body->cryptotransfer->transfers->accountamounts[1] = createAccountAmount(target, amount);
 
+    return body;
+}
+
+uint8_t * hederaTransactionBodyPack (BRHederaAddress source,
+                                       BRHederaAddress target,
+                                       BRHederaAddress nodeAddress,
+                                       BRHederaUnitTinyBar amount,
+                                       BRHederaTimeStamp timeStamp,
+                                       BRHederaUnitTinyBar fee,
+                                       const char * memo,
+                                       size_t *size)
+{
+    Proto__TransactionBody *body = createTransactionBody (source, target, nodeAddress,
+                                                          amount, timeStamp, fee, memo);
+
     // Serialize the transaction body
     *size = proto__transaction_body__get_packed_size(body);
     uint8_t * buffer = calloc(1, *size);
@@ -115,6 +130,48 @@ uint8_t * hederaTransactionBodyPack (BRHederaAddress source,
     return buffer;
 }
 
+uint8_t * hederaTransactionBodyPackForNodes (BRHederaAddress source,
+                                             BRHederaAddress target,
+                                             BRHederaAddress *nodeAddresses,
+                                             size_t nodeCount,
+                                             BRHederaUnitTinyBar amount,
+                                             BRHederaTimeStamp timeStamp,
+                                             BRHederaUnitTinyBar fee,
+                                             const char * memo,
+                                             size_t *sizes)
+{
+    assert (nodeCount > 0);
+
+    // Build the body once; only the node account id differs between nodes
+    Proto__TransactionBody *body = createTransactionBody (source, target, nodeAddresses[0],
+                                                          amount, timeStamp, fee, memo);
+    Proto__AccountID *nodeAccountID = body->nodeaccountid;
+
+    size_t totalSize = 0;
+    for (size_t i = 0; i < nodeCount; i++) {
+        nodeAccountID->shardnum   = hederaAddressGetShard   (nodeAddresses[i]);
+        nodeAccountID->realmnum   = hederaAddressGetRealm   (nodeAddresses[i]);
+        nodeAccountID->accountnum = hederaAddressGetAccount (nodeAddresses[i]);
+        sizes[i] = proto__transaction_body__get_packed_size(body);
+        totalSize += sizes[i];
+    }
+
+    // Serialize each body back to back into a single buffer
+    uint8_t * buffer = calloc(1, totalSize);
+    uint8_t * pBuffer = buffer;
+    for (size_t i = 0; i < nodeCount; i++) {
+        nodeAccountID->shardnum   = hederaAddressGetShard   (nodeAddresses[i]);
+        nodeAccountID->realmnum   = hederaAddressGetRealm   (nodeAddresses[i]);
+        nodeAccountID->accountnum = hederaAddressGetAccount (nodeAddresses[i]);
+        pBuffer += proto__transaction_body__pack(body, pBuffer);
+    }
+
+    // Free the body object now that we have serialized to bytes
+    proto__transaction_body__free_unpacked(body, NULL);
+
+    return buffer;
+}
+
 Proto__SignatureMap * createSigMap(uint8_t *signature, uint8_t * publicKey)
 {
     Proto__SignatureMap * sigMap = calloc(1, sizeof(Proto__SignatureMap));
@@ -27,6 +27,18 @@ uint8_t * hederaTransactionBodyPack (BRHederaAddress source,
                                           const char * memo,
                                           size_t *size);
 
+// Serializes the body once for each of nodeAddresses, back to back in the returned buffer, with the
+// size of each body written to sizes
+uint8_t * hederaTransactionBodyPackForNodes (BRHederaAddress source,
+                                             BRHederaAddress target,
+                                             BRHederaAddress *nodeAddresses,
+                                             size_t nodeCount,
+                                             BRHederaUnitTinyBar amount,
+                                             BRHederaTimeStamp timeStamp,
+                                             BRHederaUnitTinyBar fee,
+                                             const char * memo,
+                                             size_t *sizes);
+
 uint8_t * hederaTransactionPack (uint8_t * signature, size_t signatureSize,
                                       uint8_t * publicKey, size_t publicKeySize,
                                       uint8_t * body, size_t bodySize,
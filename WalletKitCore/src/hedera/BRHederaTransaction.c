@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <string.h>
+#include <pthread.h>
 #include "support/BRInt.h"
 
 // Forward Declarations
@@ -31,6 +32,9 @@ static uint16_t nodes[10] = {
 };
 static uint16_t numNodes = sizeof(nodes) / sizeof(uint16_t);
 
+#define HEDERA_SIGN_NODES_MAX   (sizeof(nodes) / sizeof(uint16_t))
+#define HEDERA_SIGN_THREADS     4   // max worker threads used to sign for all nodes
+
 // Forward declarations
 int hederaTransactionGetHashCount (BRHederaTransaction transaction);
 BRHederaTransactionHash hederaTransactionGetHashAtIndex (BRHederaTransaction transaction, int index);
@@ -190,36 +194,44 @@ hederaTransactionGetMemo(BRHederaTransaction transaction)
     return NULL;
 }
 
-static uint8_t* hederaTransactionSignTransactionWithNode (BRHederaTransaction transaction,
-                                                          BRKey publicKey,
-                                                          const unsigned char * privateKey,
-                                                          BRHederaAddress node,
-                                                          BRHederaUnitTinyBar fee,
-                                                          size_t *bufferSize)
+// Per node signing work, one job per worker thread
+typedef struct {
+    BRKey publicKey;
+    const unsigned char *privateKey;
+    uint8_t **bodies;
+    size_t *bodySizes;
+    uint8_t **signedBytes;              // output slots, shared by all jobs
+    size_t *signedSizes;
+    BRHederaTransactionHash *hashes;
+    size_t start;
+    size_t end;
+} HederaSignJob;
+
+static void *
+hederaTransactionSignNodesRoutine (void *arg)
 {
-    // First we need to serialize the body since it is the thing we sign
-    size_t bodySize;
-    uint8_t * body = hederaTransactionBodyPack (transaction->source,
-                                                transaction->target,
-                                                node,
-                                                transaction->amount,
-                                                transaction->timeStamp,
-                                                fee,
-                                                transaction->memo,
-                                                &bodySize);
+    HederaSignJob *job = arg;
+    if (job->start >= job->end) return NULL;
 
-    // Create signature from the body bytes
-    unsigned char signature[64];
-    memset (signature, 0x00, 64);
-    ed25519_sign(signature, body, bodySize, publicKey.pubKey, privateKey);
+    // Create signatures from the body bytes, all with the same key
+    unsigned char signatures[HEDERA_SIGN_NODES_MAX * 64];
+    ed25519_sign_batch (signatures, (const unsigned char *const *) &job->bodies[job->start], &job->bodySizes[job->start],
+                        job->end - job->start, job->publicKey.pubKey, job->privateKey);
 
-    // Serialize the full transaction including signature and public key
-    uint8_t * serializedBytes = hederaTransactionPack (signature, 64,
-                                                       publicKey.pubKey, 32,
-                                                       body, bodySize,
-                                                       bufferSize);
-    free(body);
-    return serializedBytes;
+    for (size_t i = job->start; i < job->end; i++) {
+        uint8_t *signature = &signatures[(i - job->start) * 64];
+
+        // Serialize the full transaction including signature and public key
+        job->signedBytes[i] = hederaTransactionPack (signature, 64,
+                                                     job->publicKey.pubKey, 32,
+                                                     job->bodies[i], job->bodySizes[i],
+                                                     &job->signedSizes[i]);
+
+        // Store the hash for this serialization
+        BRSHA384(job->hashes[i].bytes, job->signedBytes[i], job->signedSizes[i]);
+    }
+
+    return NULL;
 }
 
 static size_t
@@ -228,50 +240,91 @@ hederaTransactionSignMultipleSerializations (BRHederaTransaction transaction, BR
 {
     // Create a serialization for all the known nodes - currently 3 through 12
     // defined in the "nodes" array
+    BRHederaAddress nodeAddresses[HEDERA_SIGN_NODES_MAX];
+    for (uint16_t i = 0; i < numNodes; i++)
+        nodeAddresses[i] = hederaAddressCreate(0, 0, (int64_t)nodes[i]);
+
+    uint8_t *bodyPointers[HEDERA_SIGN_NODES_MAX];
+    size_t bodySizes[HEDERA_SIGN_NODES_MAX];
+    uint8_t *signedBytes[HEDERA_SIGN_NODES_MAX];
+    size_t signedSizes[HEDERA_SIGN_NODES_MAX];
+    BRHederaTransactionHash hashes[HEDERA_SIGN_NODES_MAX];
+
+    // The bodies only differ by the node account id, so build them all from a single body
+    uint8_t * bodies = hederaTransactionBodyPackForNodes (transaction->source,
+                                                          transaction->target,
+                                                          nodeAddresses,
+                                                          numNodes,
+                                                          transaction->amount,
+                                                          transaction->timeStamp,
+                                                          fee,
+                                                          transaction->memo,
+                                                          bodySizes);
+    uint8_t * pBody = bodies;
+    for (uint16_t i = 0; i < numNodes; i++) {
+        bodyPointers[i] = pBody;
+        pBody += bodySizes[i];
+    }
+
+    // Sign on up to HEDERA_SIGN_THREADS threads; the first share is signed on the calling
+    // thread, as is any share whose thread couldn't be created
+    size_t threadCount = (numNodes < HEDERA_SIGN_THREADS ? numNodes : HEDERA_SIGN_THREADS);
+    size_t per = (numNodes + threadCount - 1) / threadCount;
+    HederaSignJob jobs[HEDERA_SIGN_THREADS];
+    pthread_t threads[HEDERA_SIGN_THREADS];
+    int started[HEDERA_SIGN_THREADS];
+
+    for (size_t t = 0; t < threadCount; t++) {
+        // Each job writes only to its own range of the output slots
+        size_t start = (t * per < numNodes ? t * per : numNodes);
+        size_t end   = (start + per < numNodes ? start + per : numNodes);
+
+        jobs[t] = (HederaSignJob) { publicKey, privateKey, bodyPointers, bodySizes,
+                                    signedBytes, signedSizes, hashes, start, end };
+        started[t] = (t > 0 && 0 == pthread_create (&threads[t], NULL, hederaTransactionSignNodesRoutine, &jobs[t]));
+    }
+
+    hederaTransactionSignNodesRoutine (&jobs[0]);
+
+    for (size_t t = 1; t < threadCount; t++) {
+        if (started[t]) pthread_join (threads[t], NULL);
+        else hederaTransactionSignNodesRoutine (&jobs[t]);
+    }
+
+    // The size is now known exactly:
+    // - 3 bytes for the header
+    // - for each node, 6 bytes for a header plus the serialization
+    transaction->serializedSize = 3;
+    for (uint16_t i = 0; i < numNodes; i++)
+        transaction->serializedSize += 6 + signedSizes[i];
+
+    transaction->serializedBytes = calloc(1, transaction->serializedSize);
+    uint8_t * pSerializedBytes = transaction->serializedBytes;
+
+    // Add the header info - version plus the number of serializations
+    *pSerializedBytes = (uint8_t)1; // Version 1 of the protocol
+    pSerializedBytes++;
+    UInt16SetBE(pSerializedBytes, numNodes);
+    pSerializedBytes += 2; // Pointer to after the header
+
     if (transaction->hashes) array_free(transaction->hashes);
     array_new(transaction->hashes, numNodes);
-    transaction->serializedSize = 0;
-    uint8_t * pSerializedBytes = NULL;
+
     for (uint16_t i = 0; i < numNodes; i++) {
-        size_t size = 0;
-        BRHederaAddress node = hederaAddressCreate(0, 0, (int64_t)nodes[i]);
-        uint8_t * signedBytes = hederaTransactionSignTransactionWithNode(transaction, publicKey, privateKey,
-                                                                         node, fee, &size);
+        array_add(transaction->hashes, hashes[i]);
 
-        // Store the hash for this serialization
-        BRHederaTransactionHash hash;
-        BRSHA384(hash.bytes, signedBytes, size);
-        array_add(transaction->hashes, hash);
-
-        if (i == 0) { // First serialization
-            // We now have an idea of how much memory is needed for a single serialization
-            // - 3 bytes for the header
-            // - enough room for NUM_NODES (6 bytes for a header plus serialization)
-            // - plus some padding just in case the other serializations are larger - will truncate later
-            transaction->serializedBytes = calloc(1, 3 + ((size + 6) * numNodes) + 1024);
-            pSerializedBytes = transaction->serializedBytes;
-
-            // Add the header info - version plus the number of serializations
-            *pSerializedBytes = (uint8_t)1; // Version 1 of the protocol
-            pSerializedBytes++;
-            UInt16SetBE(pSerializedBytes, numNodes);
-            pSerializedBytes += 2; // Pointer to after the header
-        }
         // Add the node number, the size of the serialization, then the
         // serialized bytes for this node
         UInt16SetBE(pSerializedBytes, nodes[i]);
-        UInt32SetBE(pSerializedBytes + 2, (uint32_t)size);
-        memcpy(pSerializedBytes + 6, signedBytes, size);
-        pSerializedBytes += (6 + size);
+        UInt32SetBE(pSerializedBytes + 2, (uint32_t)signedSizes[i]);
+        memcpy(pSerializedBytes + 6, signedBytes[i], signedSizes[i]);
+        pSerializedBytes += (6 + signedSizes[i]);
 
-        free(signedBytes);
-        hederaAddressFree(node);
+        free(signedBytes[i]);
+        hederaAddressFree(nodeAddresses[i]);
     }
 
-    // Calculate the size using pointer arithmetic
-    transaction->serializedSize = (unsigned long)(pSerializedBytes - transaction->serializedBytes);
-    // Truncate the buffer to the actual size
-    transaction->serializedBytes = realloc(transaction->serializedBytes, transaction->serializedSize);
+    free(bodies);
     return transaction->serializedSize;
 }
 
@@ -131,7 +131,7 @@ static int ltcMainNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const B
     }
     else if (r && block->target != previous->target) r = 0;
     
-    return r && ltcVerifyProofOfWork(block);
+    return r; // proof-of-work is checked by the peer
 }
 
 static int ltcTestNetVerifyDifficulty(const BRBitcoinMerkleBlock *block, const BRSet *blockSet)
@@ -145,6 +145,7 @@ static BRBitcoinChainParams ltcMainNetParamsRecord = {
     0xdbb6c0fb,
     SERVICES_NODE_WITNESS,
     ltcMainNetVerifyDifficulty,
+    ltcVerifyProofOfWork,
     NULL,
     0,
     { LTC_PUBKEY_PREFIX, LTC_SCRIPT_PREFIX, LTC_PRIVKEY_PREFIX, LTC_BECH32_PREFIX },
@@ -160,6 +161,7 @@ static BRBitcoinChainParams ltcTestNetParamsRecord = {
     SERVICES_NODE_WITNESS,
     ltcTestNetVerifyDifficulty,
     NULL,
+    NULL,
     0,
     { LTC_PUBKEY_PREFIX_TEST, LTC_SCRIPT_PREFIX_TEST, LTC_PRIVKEY_PREFIX_TEST, LTC_BECH32_PREFIX_TEST },
     BITCOIN_FORKID,
@@ -457,6 +457,38 @@ size_t BRAddressFromHash160(char *addr, size_t addrLen, BRAddressParams params,
     return (! addr || r <= addrLen) ? r : 0;
 }
 
+// writes the addresses for count 20 byte hash160s, stored back to back in md20s, to addrs, computing the base58check
+// checksums several at a time
+// returns the number of addresses written
+size_t BRAddressesFromHash160(BRAddress addrs[], BRAddressParams params, const void *md20s, size_t count)
+{
+    uint8_t data[64*21];
+    size_t i, j, n, r = 0;
+
+    assert(addrs != NULL || count == 0);
+    assert(md20s != NULL || count == 0);
+
+    if (params.bech32Prefix) {
+        for (i = 0; i < count; i++) {
+            if (BRAddressFromHash160(addrs[i].s, sizeof(*addrs), params, (const uint8_t *)md20s + i*20) > 0) r++;
+        }
+    }
+    else {
+        for (i = 0; i < count; i += n) {
+            n = (count - i < 64) ? count - i : 64;
+
+            for (j = 0; j < n; j++) {
+                data[j*21] = params.pubKeyPrefix;
+                memcpy(&data[j*21 + 1], (const uint8_t *)md20s + (i + j)*20, 20);
+            }
+
+            r += BRBase58CheckEncodeBatch(addrs[i].s, sizeof(*addrs), data, 21, n);
+        }
+    }
+
+    return r;
+}
+
 // writes the scriptPubKey for addr to script
 // returns the number of bytes written, or scriptLen needed if script is NULL
 size_t BRAddressScriptPubKey(uint8_t *script, size_t scriptLen, BRAddressParams params, const char *addr)
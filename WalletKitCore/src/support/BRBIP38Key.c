@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #define BIP38_NOEC_PREFIX      0x0142
 #define BIP38_EC_PREFIX        0x0143
@@ -43,17 +44,20 @@
 #define BIP38_SCRYPT_EC_N      1024
 #define BIP38_SCRYPT_EC_R      1
 #define BIP38_SCRYPT_EC_P      1
+#define BIP38_SCRYPT_THREADS   4 // threads used to derive the passfactor for a single key
+#define BIP38_BATCH_THREADS    4 // max keys BRBIP38KeySetKeys() decrypts at once, each with 16MB of scrypt scratch space
 
 // BIP38 is a method for encrypting private keys with a passphrase
 // https://github.com/bitcoin/bips/blob/master/bip-0038.mediawiki
 
-static UInt256 _BRBIP38DerivePassfactor(uint8_t flag, const uint8_t *entropy, const char *passphrase)
+static UInt256 _BRBIP38DerivePassfactor(uint8_t flag, const uint8_t *entropy, const char *passphrase,
+                                        unsigned threadCount)
 {
     size_t len = strlen(passphrase);
     UInt256 prefactor, passfactor;
     
-    BRScrypt(&prefactor, sizeof(prefactor), passphrase, len, entropy, (flag & BIP38_LOTSEQUENCE_FLAG) ? 4 : 8,
-             BIP38_SCRYPT_N, BIP38_SCRYPT_R, BIP38_SCRYPT_P);
+    BRScryptThreads(&prefactor, sizeof(prefactor), passphrase, len, entropy, (flag & BIP38_LOTSEQUENCE_FLAG) ? 4 : 8,
+                    BIP38_SCRYPT_N, BIP38_SCRYPT_R, BIP38_SCRYPT_P, threadCount);
     
     if (flag & BIP38_LOTSEQUENCE_FLAG) { // passfactor = SHA256(SHA256(prefactor + entropy))
         uint8_t d[sizeof(prefactor) + sizeof(uint64_t)];
@@ -104,9 +108,9 @@ int BRBIP38KeyIsValid(const char *bip38Key)
     else return 0; // invalid prefix
 }
 
-// decrypts a BIP38 key using the given passphrase and returns false if passphrase is incorrect
-// passphrase must be unicode NFC normalized: http://www.unicode.org/reports/tr15/#Norm_Forms
-int BRBIP38KeySetKey(BRKey *key, const char *bip38Key, const char *passphrase, BRAddressParams params)
+// decrypts bip38Key, running scrypt on up to threadCount threads
+static int _BRBIP38KeySetKey(BRKey *key, const char *bip38Key, const char *passphrase, BRAddressParams params,
+                             unsigned threadCount)
 {
     int r = 1;
     uint8_t data[39];
@@ -123,24 +127,27 @@ int BRBIP38KeySetKey(BRKey *key, const char *bip38Key, const char *passphrase, B
     size_t pwLen = strlen(passphrase);
     UInt512 derived;
     UInt256 secret, derived1, derived2, hash;
+    BRAESKey aesKey;
     BRAddress address = BR_ADDRESS_NONE;
 
     if (prefix == BIP38_NOEC_PREFIX) { // non EC multiplied key
         // data = prefix + flag + addresshash + encrypted1 + encrypted2
         UInt128 encrypted1 = UInt128Get(&data[7]), encrypted2 = UInt128Get(&data[23]);
 
-        BRScrypt(&derived, sizeof(derived), passphrase, pwLen, addresshash, sizeof(uint32_t),
-                 BIP38_SCRYPT_N, BIP38_SCRYPT_R, BIP38_SCRYPT_P);
+        BRScryptThreads(&derived, sizeof(derived), passphrase, pwLen, addresshash, sizeof(uint32_t),
+                        BIP38_SCRYPT_N, BIP38_SCRYPT_R, BIP38_SCRYPT_P, threadCount);
         derived1 = *(UInt256 *)&derived, derived2 = *(UInt256 *)&derived.u8[sizeof(UInt256)];
         var_clean(&derived);
         
-        BRAESECBDecrypt(&encrypted1, &derived2, sizeof(derived2));
+        BRAESKeyInit(&aesKey, &derived2, sizeof(derived2));
+        BRAESKeyECBDecrypt(&aesKey, &encrypted1, &encrypted1, 1);
         secret.u64[0] = encrypted1.u64[0] ^ derived1.u64[0];
         secret.u64[1] = encrypted1.u64[1] ^ derived1.u64[1];
         
-        BRAESECBDecrypt(&encrypted2, &derived2, sizeof(derived2));
+        BRAESKeyECBDecrypt(&aesKey, &encrypted2, &encrypted2, 1);
         secret.u64[2] = encrypted2.u64[0] ^ derived1.u64[2];
         secret.u64[3] = encrypted2.u64[1] ^ derived1.u64[3];
+        BRAESKeyClean(&aesKey);
         var_clean(&derived1, &derived2);
         var_clean(&encrypted1, &encrypted2);
     }
@@ -148,7 +155,7 @@ int BRBIP38KeySetKey(BRKey *key, const char *bip38Key, const char *passphrase, B
         // data = prefix + flag + addresshash + entropy + encrypted1[0...7] + encrypted2
         const uint8_t *entropy = &data[7];
         UInt128 encrypted1 = UINT128_ZERO, encrypted2 = UInt128Get(&data[23]);
-        UInt256 passfactor = _BRBIP38DerivePassfactor(flag, entropy, passphrase), factorb;
+        UInt256 passfactor = _BRBIP38DerivePassfactor(flag, entropy, passphrase, threadCount), factorb;
         BRECPoint passpoint;
         uint64_t seedb[3];
         
@@ -160,14 +167,16 @@ int BRBIP38KeySetKey(BRKey *key, const char *bip38Key, const char *passphrase, B
         memcpy(&encrypted1, &data[15], sizeof(uint64_t));
 
         // encrypted2 = (encrypted1[8...15] + seedb[16...23]) xor derived1[16...31]
-        BRAESECBDecrypt(&encrypted2, &derived2, sizeof(derived2));
+        BRAESKeyInit(&aesKey, &derived2, sizeof(derived2));
+        BRAESKeyECBDecrypt(&aesKey, &encrypted2, &encrypted2, 1);
         encrypted1.u64[1] = encrypted2.u64[0] ^ derived1.u64[2];
         seedb[2] = encrypted2.u64[1] ^ derived1.u64[3];
 
         // encrypted1 = seedb[0...15] xor derived1[0...15]
-        BRAESECBDecrypt(&encrypted1, &derived2, sizeof(derived2));
+        BRAESKeyECBDecrypt(&aesKey, &encrypted1, &encrypted1, 1);
         seedb[0] = encrypted1.u64[0] ^ derived1.u64[0];
         seedb[1] = encrypted1.u64[1] ^ derived1.u64[1];
+        BRAESKeyClean(&aesKey);
         var_clean(&derived1, &derived2);
         var_clean(&encrypted1, &encrypted2);
         
@@ -186,6 +195,78 @@ int BRBIP38KeySetKey(BRKey *key, const char *bip38Key, const char *passphrase, B
     return r;
 }
 
+// decrypts a BIP38 key using the given passphrase and returns false if passphrase is incorrect
+// passphrase must be unicode NFC normalized: http://www.unicode.org/reports/tr15/#Norm_Forms
+int BRBIP38KeySetKey(BRKey *key, const char *bip38Key, const char *passphrase, BRAddressParams params)
+{
+    return _BRBIP38KeySetKey(key, bip38Key, passphrase, params, BIP38_SCRYPT_THREADS);
+}
+
+typedef struct {
+    BRKey *keys;
+    const char *const *bip38Keys;
+    const char *passphrase;
+    BRAddressParams params;
+    int *results;
+    size_t count;
+    size_t decrypted;
+} _BRBIP38KeysJob;
+
+static void *_BRBIP38KeysRoutine(void *arg)
+{
+    _BRBIP38KeysJob *job = arg;
+
+    for (size_t i = 0; i < job->count; i++) {
+        // each key runs its scrypt lanes on this thread alone, the keys themselves are what run in parallel
+        int r = _BRBIP38KeySetKey(&job->keys[i], job->bip38Keys[i], job->passphrase, job->params, 1);
+
+        if (job->results) job->results[i] = r;
+        if (r) job->decrypted++;
+    }
+
+    return NULL;
+}
+
+// decrypts count BIP38 keys that share the same passphrase, several at a time
+// results may be NULL, otherwise results[i] is set to false if bip38Keys[i] is invalid or the passphrase is incorrect
+// returns the number of keys decrypted
+size_t BRBIP38KeySetKeys(BRKey keys[], const char *const bip38Keys[], size_t count, const char *passphrase,
+                         BRAddressParams params, int results[])
+{
+    size_t i, decrypted = 0, threadCount = (count < BIP38_BATCH_THREADS) ? count : BIP38_BATCH_THREADS,
+           per = (threadCount > 0) ? (count + threadCount - 1)/threadCount : 0;
+
+    assert(keys != NULL || count == 0);
+    assert(bip38Keys != NULL || count == 0);
+    assert(passphrase != NULL);
+
+    if (threadCount == 0) return 0;
+
+    _BRBIP38KeysJob jobs[threadCount];
+    pthread_t threads[threadCount];
+    int started[threadCount];
+
+    for (i = 0; i < threadCount; i++) {
+        size_t start = i*per, end = (start + per < count) ? start + per : count;
+
+        if (start > end) start = end;
+        jobs[i] = (_BRBIP38KeysJob) { &keys[start], &bip38Keys[start], passphrase, params,
+                                      (results) ? &results[start] : NULL, end - start, 0 };
+        // the first share is decrypted on the calling thread, as is any share whose thread couldn't be created
+        started[i] = (i > 0 && pthread_create(&threads[i], NULL, _BRBIP38KeysRoutine, &jobs[i]) == 0);
+    }
+
+    _BRBIP38KeysRoutine(&jobs[0]);
+
+    for (i = 1; i < threadCount; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else _BRBIP38KeysRoutine(&jobs[i]);
+    }
+
+    for (i = 0; i < threadCount; i++) decrypted += jobs[i].decrypted;
+    return decrypted;
+}
+
 // generates an "intermediate code" for an EC multiply mode key
 // salt should be 64bits of random data
 // passphrase must be unicode NFC normalized
@@ -227,6 +308,7 @@ size_t BRBIP38KeyGetKey(BRKey *key, char *bip38Key, size_t bip38KeyLen, const ch
     UInt512 derived;
     UInt256 hash, derived1, derived2;
     UInt128 encrypted1, encrypted2;
+    BRAESKey aesKey;
     
     if (! bip38Key) return 43*138/100 + 2; // 43bytes*log(256)/log(58), rounded up, plus NULL terminator
 
@@ -246,12 +328,14 @@ size_t BRBIP38KeyGetKey(BRKey *key, char *bip38Key, size_t bip38KeyLen, const ch
     // enctryped1 = AES256Encrypt(privkey[0...15] xor derived1[0...15], derived2)
     encrypted1.u64[0] = key->secret.u64[0] ^ derived1.u64[0];
     encrypted1.u64[1] = key->secret.u64[1] ^ derived1.u64[1];
-    BRAESECBEncrypt(&encrypted1, &derived2, sizeof(derived2));
+    BRAESKeyInit(&aesKey, &derived2, sizeof(derived2));
+    BRAESKeyECBEncrypt(&aesKey, &encrypted1, &encrypted1, 1);
 
     // encrypted2 = AES256Encrypt(privkey[16...31] xor derived1[16...31], derived2)
     encrypted2.u64[0] = key->secret.u64[2] ^ derived1.u64[2];
     encrypted2.u64[1] = key->secret.u64[3] ^ derived1.u64[3];
-    BRAESECBEncrypt(&encrypted2, &derived2, sizeof(derived2));
+    BRAESKeyECBEncrypt(&aesKey, &encrypted2, &encrypted2, 1);
+    BRAESKeyClean(&aesKey);
     
     UInt16SetBE(&buf[off], prefix);
     off += sizeof(prefix);
@@ -40,6 +40,13 @@ int BRBIP38KeyIsValid(const char *bip38Key);
 // passphrase must be unicode NFC normalized: http://www.unicode.org/reports/tr15/#Norm_Forms
 int BRBIP38KeySetKey(BRKey *key, const char *bip38Key, const char *passphrase, BRAddressParams params);
 
+// decrypts count BIP38 keys that share the same passphrase, several at a time, into keys
+// results may be NULL, otherwise results[i] is set to false if bip38Keys[i] is invalid or the passphrase is incorrect
+// passphrase must be unicode NFC normalized
+// returns the number of keys decrypted
+size_t BRBIP38KeySetKeys(BRKey keys[], const char *const bip38Keys[], size_t count, const char *passphrase,
+                         BRAddressParams params, int results[]);
+
 // generates an "intermediate code" for an EC multiply mode key
 // salt should be 64bits of random data
 // passphrase must be unicode NFC normalized
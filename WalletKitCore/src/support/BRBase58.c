@@ -34,44 +34,53 @@
 // base58 and base58check encoding: https://en.bitcoin.it/wiki/Base58Check_encoding
 static const char * bitcoinAlphabet = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
 
+#define BASE58_BATCH 64 // checksums hashed per BRSHA256_2Batch() call
+
+// the codec works on 32bit limbs, base 58^5 when encoding and base 2^32 when decoding, so each 64bit multiply and
+// divide handles five base58 digits or four bytes at once instead of one
+#define BASE58_LIMB 656356768u // 58^5
+
+static const uint32_t base58Pow[] = { 1, 58, 3364, 195112, 11316496, 656356768 };
+
 // returns the number of characters written to str including NULL terminator, or total strLen needed if str is NULL
 size_t BRBase58EncodeEx(char *str, size_t strLen, const uint8_t *data, size_t dataLen, const char *alphabet)
 {
     const char * chars = alphabet;
     assert(strlen(alphabet) >= 58);
 
-    size_t i, j, len, zcount = 0;
+    size_t i, j, k, len, used = 0, zcount = 0, digits;
     
     assert(data != NULL);
     while (zcount < dataLen && data && data[zcount] == 0) zcount++; // count leading zeroes
 
-    uint8_t buf[(dataLen - zcount)*138/100 + 1]; // log(256)/log(58), rounded up
+    uint32_t limbs[((dataLen - zcount)*138/100 + 1)/5 + 1]; // log(256)/log(58), rounded up, least significant first
+    uint64_t carry;
     
-    memset(buf, 0, sizeof(buf));
-    
-    for (i = zcount; data && i < dataLen; i++) {
-        uint32_t carry = data[i];
-        
-        for (j = sizeof(buf); j > 0; j--) {
-            carry += (uint32_t)buf[j - 1] << 8;
-            buf[j - 1] = carry % 58;
-            carry /= 58;
+    for (i = zcount; data && i < dataLen; i += k) {
+        k = (i == zcount && (dataLen - zcount) % 4 != 0) ? (dataLen - zcount) % 4 : 4; // whole words after the first
+        for (carry = 0, j = 0; j < k; j++) carry = (carry << 8) | data[i + j];
+
+        for (j = 0; j < used; j++) {
+            carry += (uint64_t)limbs[j] << (k*8);
+            limbs[j] = (uint32_t)(carry % BASE58_LIMB);
+            carry /= BASE58_LIMB;
         }
-        
-        var_clean(&carry);
+
+        while (carry > 0) limbs[used++] = (uint32_t)(carry % BASE58_LIMB), carry /= BASE58_LIMB;
     }
     
-    i = 0;
-    while (i < sizeof(buf) && buf[i] == 0) i++; // skip leading zeroes
-    len = (zcount + sizeof(buf) - i) + 1;
+    digits = used*5;
+    while (digits > 0 && limbs[(digits - 1)/5] / base58Pow[(digits - 1) % 5] % 58 == 0) digits--; // skip leading zeroes
+    len = (zcount + digits) + 1;
 
     if (str && len <= strLen) {
         while (zcount-- > 0) *(str++) = chars[0];
-        while (i < sizeof(buf)) *(str++) = chars[buf[i++]];
+        while (digits-- > 0) *(str++) = chars[limbs[digits/5] / base58Pow[digits % 5] % 58];
         *str = '\0';
     }
     
-    mem_clean(buf, sizeof(buf));
+    mem_clean(limbs, sizeof(limbs));
+    var_clean(&carry);
     return (! str || len <= strLen) ? len : 0;
 }
 
@@ -80,17 +89,51 @@ size_t BRBase58Encode(char *str, size_t strLen, const uint8_t *data, size_t data
     return BRBase58EncodeEx(str, strLen, data, dataLen, bitcoinAlphabet);
 }
 
+// decodes digitsCount base58 digit values, after zcount leading zeroes, to data
+// returns the number of bytes written to data, or total dataLen needed if data is NULL
+static size_t _BRBase58DecodeDigits(uint8_t *data, size_t dataLen, const uint8_t *digits, size_t digitsCount,
+                                    size_t zcount)
+{
+    size_t i, j, k, len, used = 0, bytes;
+    uint32_t limbs[(digitsCount*733/1000 + 1)/4 + 1]; // log(58)/log(256), rounded up, least significant first
+    uint64_t carry;
+
+    for (i = 0; i < digitsCount; i += k) {
+        k = (digitsCount - i < 5) ? digitsCount - i : 5;
+        for (carry = 0, j = 0; j < k; j++) carry = carry*58 + digits[i + j];
+
+        for (j = 0; j < used; j++) {
+            carry += (uint64_t)limbs[j]*base58Pow[k];
+            limbs[j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+
+        if (carry > 0 && used < sizeof(limbs)/sizeof(*limbs)) limbs[used++] = (uint32_t)carry;
+    }
+
+    bytes = used*4;
+    while (bytes > 0 && (limbs[(bytes - 1)/4] >> ((bytes - 1) % 4*8) & 0xff) == 0) bytes--; // skip leading zeroes
+    len = zcount + bytes;
+
+    if (data && len <= dataLen) {
+        if (zcount > 0) memset(data, 0, zcount);
+        for (i = zcount; bytes-- > 0; i++) data[i] = (uint8_t)(limbs[bytes/4] >> (bytes % 4*8));
+    }
+
+    mem_clean(limbs, sizeof(limbs));
+    var_clean(&carry);
+    return (! data || len <= dataLen) ? len : 0;
+}
+
 // returns the number of bytes written to data, or total dataLen needed if data is NULL
 size_t BRBase58Decode(uint8_t *data, size_t dataLen, const char *str)
 {
-    size_t i = 0, j, len, zcount = 0;
+    size_t len, count = 0, zcount = 0;
 
     assert(str != NULL);
     while (str && *str == '1') str++, zcount++; // count leading zeroes
     
-    uint8_t buf[(str) ? strlen(str)*733/1000 + 1 : 0]; // log(58)/log(256), rounded up
-    
-    memset(buf, 0, sizeof(buf));
+    uint8_t digits[(str) ? strlen(str) + 1 : 1];
     
     while (str && *str) {
         uint32_t carry = *(const uint8_t *)(str++);
@@ -128,26 +171,13 @@ size_t BRBase58Decode(uint8_t *data, size_t dataLen, const char *str)
         }
         
         if (carry >= 58) break; // invalid base58 digit
-        
-        for (j = sizeof(buf); j > 0; j--) {
-            carry += (uint32_t)buf[j - 1]*58;
-            buf[j - 1] = carry & 0xff;
-            carry >>= 8;
-        }
-        
+        digits[count++] = (uint8_t)carry;
         var_clean(&carry);
     }
     
-    while (i < sizeof(buf) && buf[i] == 0) i++; // skip leading zeroes
-    len = zcount + sizeof(buf) - i;
-
-    if (data && len <= dataLen) {
-        if (zcount > 0) memset(data, 0, zcount);
-        memcpy(&data[zcount], &buf[i], sizeof(buf) - i);
-    }
-
-    mem_clean(buf, sizeof(buf));
-    return (! data || len <= dataLen) ? len : 0;
+    len = _BRBase58DecodeDigits(data, dataLen, digits, count, zcount);
+    mem_clean(digits, sizeof(digits));
+    return len;
 }
 
 // returns the number of characters written to str including NULL terminator, or total strLen needed if str is NULL
@@ -198,47 +228,112 @@ size_t BRBase58DecodeEx(uint8_t* data, size_t dataLen, const char *str, const ch
     int reverseLookup[256];
     memset(&reverseLookup[0], -1, sizeof(reverseLookup));
     int map_num = 0;
-    for (int i = 0; i < strlen(alphabet); i++) {
-        reverseLookup[(int) alphabet[i]] = map_num++;
+    for (size_t i = 0, n = strlen(alphabet); i < n; i++) {
+        reverseLookup[(uint8_t) alphabet[i]] = map_num++;
     }
 
     // Skip and count leading zeroes
     size_t zcount = 0;
-    while (str && reverseLookup[(int) *str] == 0) str++, zcount++;
+    while (str && *str && reverseLookup[(uint8_t) *str] == 0) str++, zcount++;
 
-    // Create buffer large enough to hold the decode bytes
-    int bufSize = (str) ? (int)(strlen(str)*733/1000 + 1) : 0;
-    uint8_t buf[bufSize];
-    memset(buf, 0, sizeof(buf));
+    // Map the remaining characters to digit values, failing on any character outside the alphabet
+    size_t count = 0, len;
+    uint8_t digits[(str) ? strlen(str) + 1 : 1];
 
-    // Do the decoding
     while (str && *str)
     {
-        int carry = reverseLookup[(int) *str];
-        if (carry == -1) return 0;
-
-        for (int i = bufSize - 1; i >= 0; i--)
-        {
-            carry += 58 * buf[i];
-            buf[i] = carry % 256;
-            carry /= 256;
-        }
+        int digit = reverseLookup[(uint8_t) *str];
+        if (digit == -1) return 0;
+
+        digits[count++] = (uint8_t) digit;
         str++;
     }
 
-    // Skip leading zeros in buf
-    size_t i = 0;
-    while(buf[i] == 0) { i++; }
+    // Decode, copying to data if the caller has passed in a buffer large enough, and ONLY return 0 if the user passed
+    // in a buffer but it was not large enough
+    len = _BRBase58DecodeDigits(data, dataLen, digits, count, zcount);
+    mem_clean(digits, sizeof(digits));
+    return len;
+}
 
-    // Calculate the length
-    size_t len = zcount + sizeof(buf) - i;
+// base58check encodes count payloads of dataLen bytes each, stored back to back in data, to strs with each NULL
+// terminated string strLen bytes after the previous one, computing the checksums with BRSHA256_2Batch()
+// returns the number of strings written, which is less than count only if a string doesn't fit in strLen
+size_t BRBase58CheckEncodeBatch(char *strs, size_t strLen, const uint8_t *data, size_t dataLen, size_t count)
+{
+    size_t i, j, n, done = 0, bufLen = dataLen + 4;
+    uint8_t md[BASE58_BATCH*32], _buf[0x1000], *buf = (bufLen <= 0x1000) ? _buf : malloc(bufLen);
+    const void *msgs[BASE58_BATCH];
+    size_t lens[BASE58_BATCH];
 
-    // If the caller has passed in buffer large enough then copy to it
-    if (data && len <= dataLen) {
-        if (zcount > 0) memset(data, 0, zcount);
-        memcpy(&data[zcount], &buf[i], sizeof(buf) - i);
+    assert(strs != NULL || count == 0);
+    assert(data != NULL || dataLen == 0 || count == 0);
+    assert(buf != NULL);
+
+    for (i = 0; i < count && done == i; i += n) {
+        n = (count - i < BASE58_BATCH) ? count - i : BASE58_BATCH;
+        for (j = 0; j < n; j++) msgs[j] = &data[(i + j)*dataLen], lens[j] = dataLen;
+        BRSHA256_2Batch(md, msgs, lens, n);
+
+        for (j = 0; j < n; j++) {
+            if (dataLen > 0) memcpy(buf, &data[(i + j)*dataLen], dataLen);
+            memcpy(&buf[dataLen], &md[j*32], 4);
+            if (BRBase58Encode(&strs[(i + j)*strLen], strLen, buf, bufLen) == 0) break;
+            done++;
+        }
     }
 
-    // ONLY return 0 if the user passed in a buffer but it was not large enough
-    return (! data || len <= dataLen) ? len : 0;
+    mem_clean(md, sizeof(md));
+    mem_clean(buf, bufLen);
+    if (buf != _buf) free(buf);
+    return done;
+}
+
+// base58check decodes count strings to data, with each payload dataLen bytes after the previous one, computing the
+// checksums with BRSHA256_2Batch(), data may be NULL to only validate the strings
+// writes each payload length to lens, or 0 if the string is invalid or its payload is longer than dataLen, and returns
+// the number of valid strings
+size_t BRBase58CheckDecodeBatch(uint8_t *data, size_t dataLen, size_t lens[], const char *strs[], size_t count)
+{
+    size_t i, j, n, valid = 0, bufLen, offs[BASE58_BATCH], sizes[BASE58_BATCH];
+    uint8_t md[BASE58_BATCH*32], *buf;
+    const void *msgs[BASE58_BATCH];
+
+    assert(lens != NULL || count == 0);
+    assert(strs != NULL || count == 0);
+
+    for (i = 0; i < count; i += n) {
+        n = (count - i < BASE58_BATCH) ? count - i : BASE58_BATCH;
+        
+        for (bufLen = 0, j = 0; j < n; j++) {
+            assert(strs[i + j] != NULL);
+            offs[j] = bufLen, bufLen += strlen(strs[i + j]); // decoded length is never more than the string length
+        }
+        
+        buf = malloc(bufLen + 1);
+        assert(buf != NULL);
+
+        for (j = 0; j < n; j++) {
+            lens[i + j] = BRBase58Decode(&buf[offs[j]], bufLen - offs[j], strs[i + j]);
+            sizes[j] = (lens[i + j] >= 4) ? lens[i + j] - 4 : 0;
+            msgs[j] = &buf[offs[j]];
+        }
+
+        BRSHA256_2Batch(md, msgs, sizes, n);
+
+        for (j = 0; j < n; j++) {
+            if (lens[i + j] < 4 || sizes[j] > dataLen) lens[i + j] = 0;
+            else if (memcmp(&buf[offs[j] + sizes[j]], &md[j*32], sizeof(uint32_t)) != 0) lens[i + j] = 0; // checksum
+            else lens[i + j] = sizes[j];
+            
+            if (data && lens[i + j] > 0) memcpy(&data[(i + j)*dataLen], &buf[offs[j]], lens[i + j]);
+            if (lens[i + j] > 0) valid++;
+        }
+
+        mem_clean(buf, bufLen + 1);
+        free(buf);
+    }
+
+    mem_clean(md, sizeof(md));
+    return valid;
 }
@@ -51,6 +51,17 @@ size_t BRBase58CheckEncode(char *str, size_t strLen, const uint8_t *data, size_t
 // returns the number of bytes written to data, or total dataLen needed if data is NULL
 size_t BRBase58CheckDecode(uint8_t *data, size_t dataLen, const char *str);
 
+// base58check encodes count payloads of dataLen bytes each, stored back to back in data, to strs with each NULL
+// terminated string strLen bytes after the previous one, hashing the checksums several at a time
+// returns the number of strings written, which is less than count only if a string doesn't fit in strLen
+size_t BRBase58CheckEncodeBatch(char *strs, size_t strLen, const uint8_t *data, size_t dataLen, size_t count);
+
+// base58check decodes count strings to data, with each payload dataLen bytes after the previous one, data may be NULL
+// to only validate the strings
+// writes each payload length to lens, or 0 if the string is invalid or its payload is longer than dataLen, and returns
+// the number of valid strings
+size_t BRBase58CheckDecodeBatch(uint8_t *data, size_t dataLen, size_t lens[], const char *strs[], size_t count);
+
 // Extended versions of base58 encode/decode that allow caller to control
 // the alphabet being used.  This is needed for Ripple (and perhaps others)
 
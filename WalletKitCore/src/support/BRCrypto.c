@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 // endian swapping
 #if __BIG_ENDIAN__ || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
@@ -45,6 +46,49 @@
 #define le64(x) ((union { uint32_t u32[2]; uint64_t u64; }) { le32((uint32_t)(x)), le32((uint32_t)((x) >> 32)) }.u64)
 #endif
 
+// x86 simd instruction sets, detected at runtime to pick an implementation
+#define CPU_SSE2 0x01
+#define CPU_AVX2 0x02
+#define CPU_AES  0x04
+#define CPU_VAES 0x08
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BR_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+
+static int _BRCPUFeatures(void)
+{
+    static int features = -1;
+    unsigned a, b, c, d, f = 0, ymm = 0;
+
+    if (features >= 0) return features;
+
+    if (__get_cpuid(1, &a, &b, &c, &d)) {
+        if (d & bit_SSE2) f |= CPU_SSE2;
+        if (c & bit_AES) f |= CPU_AES;
+
+        if (c & bit_OSXSAVE) { // 256 bit registers also need the os to save them
+            __asm__ ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+            ymm = ((a & 6) == 6);
+        }
+
+        if (ymm && __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_AVX2)) {
+            f |= CPU_AVX2;
+            if ((f & CPU_AES) && (c & (1 << 9))) f |= CPU_VAES;
+        }
+    }
+
+    features = (int)f;
+    return features;
+}
+#else
+static int _BRCPUFeatures(void)
+{
+    return 0;
+}
+#endif
+
 // bitwise left rotation
 #define rol32(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
 
@@ -110,19 +154,20 @@ void BRSHA1(void *md20, const void *data, size_t dataLen)
 #define s2(x) (ror32((x), 7) ^ ror32((x), 18) ^ ((x) >> 3))
 #define s3(x) (ror32((x), 17) ^ ror32((x), 19) ^ ((x) >> 10))
 
+// sha256 round constants
+static const uint32_t sha256k[] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
 static void _BRSHA256Compress(uint32_t *r, const uint32_t *x)
 {
-    static const uint32_t k[] = {
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-    };
-    
     int i;
     uint32_t a = r[0], b = r[1], c = r[2], d = r[3], e = r[4], f = r[5], g = r[6], h = r[7], t1, t2, w[64];
     
@@ -130,7 +175,7 @@ static void _BRSHA256Compress(uint32_t *r, const uint32_t *x)
     for (; i < 64; i++) w[i] = s3(w[i - 2]) + w[i - 7] + s2(w[i - 15]) + w[i - 16];
     
     for (i = 0; i < 64; i++) {
-        t1 = h + s1(e) + ch(e, f, g) + k[i] + w[i];
+        t1 = h + s1(e) + ch(e, f, g) + sha256k[i] + w[i];
         t2 = s0(a) + maj(a, b, c);
         h = g, g = f, f = e, e = d + t1, d = c, c = b, b = a, a = t1 + t2;
     }
@@ -202,6 +247,228 @@ void BRSHA256_2(void *md32, const void *data, size_t dataLen)
     BRSHA256(md32, t, sizeof(t));
 }
 
+#define SHA256_IMPL_SCALAR 0
+#define SHA256_IMPL_SSE2   1 // four messages at a time
+#define SHA256_IMPL_AVX2   2 // eight messages at a time
+
+// one message in flight in a multi-buffer lane, whole blocks are read in place and the padded tail from tail[]
+typedef struct {
+    const uint8_t *data;
+    size_t blocks, tailBlocks, tailNext, msg;
+    uint8_t tail[128];
+    int pass; // 0 for sha256(x), 1 for the sha256 of the first digest
+} _BRSHA256Lane;
+
+static void _BRSHA256LaneStart(_BRSHA256Lane *lane, const uint8_t *data, size_t dataLen)
+{
+    size_t rem = dataLen % 64;
+    uint64_t bits = (uint64_t)dataLen << 3;
+
+    lane->data = data;
+    lane->blocks = dataLen/64;
+    lane->tailBlocks = (rem >= 56) ? 2 : 1;
+    lane->tailNext = 0;
+    memset(lane->tail, 0, sizeof(lane->tail));
+    if (rem > 0) memcpy(lane->tail, &data[dataLen - rem], rem);
+    lane->tail[rem] = 0x80; // append padding
+    for (size_t i = 0; i < 8; i++) lane->tail[lane->tailBlocks*64 - 1 - i] = (uint8_t)(bits >> (i*8)); // length in bits
+}
+
+static const uint8_t *_BRSHA256LaneNext(_BRSHA256Lane *lane)
+{
+    const uint8_t *block = (lane->blocks > 0) ? lane->data : &lane->tail[lane->tailNext*64];
+
+    if (lane->blocks > 0) lane->data += 64, lane->blocks--;
+    else lane->tailNext++;
+    return block;
+}
+
+#if BR_X86
+// the simd implementations run the same sha256 rounds for four or eight independent messages in parallel, with each
+// vector lane holding the state of one message, using the VADD, VXOR, VAND, VANDN, VOR, VSRL, VSLL and VSET1 operations
+// defined for the vector width just before each function
+#define vror(x, n) VOR(VSRL(x, n), VSLL(x, 32 - (n)))
+#define vs0(x) VXOR(VXOR(vror(x, 2), vror(x, 13)), vror(x, 22))
+#define vs1(x) VXOR(VXOR(vror(x, 6), vror(x, 11)), vror(x, 25))
+#define vs2(x) VXOR(VXOR(vror(x, 7), vror(x, 18)), VSRL(x, 3))
+#define vs3(x) VXOR(VXOR(vror(x, 17), vror(x, 19)), VSRL(x, 10))
+#define vch(x, y, z) VXOR(VAND(x, y), VANDN(x, z))
+#define vmaj(x, y, z) VOR(VAND(x, y), VAND(z, VXOR(x, y)))
+
+#define sha256_compress_v(T, r, w) do {\
+    T _a = r[0], _b = r[1], _c = r[2], _d = r[3], _e = r[4], _f = r[5], _g = r[6], _h = r[7], _t1, _t2;\
+    for (int _i = 16; _i < 64; _i++) w[_i] = VADD(VADD(vs3(w[_i - 2]), w[_i - 7]), VADD(vs2(w[_i - 15]), w[_i - 16]));\
+    for (int _i = 0; _i < 64; _i++) {\
+        _t1 = VADD(VADD(VADD(_h, vs1(_e)), VADD(vch(_e, _f, _g), VSET1((int)sha256k[_i]))), w[_i]);\
+        _t2 = VADD(vs0(_a), vmaj(_a, _b, _c));\
+        _h = _g, _g = _f, _f = _e, _e = VADD(_d, _t1), _d = _c, _c = _b, _b = _a, _a = VADD(_t1, _t2);\
+    }\
+    r[0] = VADD(r[0], _a), r[1] = VADD(r[1], _b), r[2] = VADD(r[2], _c), r[3] = VADD(r[3], _d);\
+    r[4] = VADD(r[4], _e), r[5] = VADD(r[5], _f), r[6] = VADD(r[6], _g), r[7] = VADD(r[7], _h);\
+} while (0)
+
+// big endian message word i of a block
+#define sha256_word(block, i) ((int)(((uint32_t)(block)[(i)*4] << 24) | ((uint32_t)(block)[(i)*4 + 1] << 16) |\
+                                     ((uint32_t)(block)[(i)*4 + 2] << 8) | (block)[(i)*4 + 3]))
+
+#define VADD _mm_add_epi32
+#define VXOR _mm_xor_si128
+#define VAND _mm_and_si128
+#define VANDN _mm_andnot_si128
+#define VOR _mm_or_si128
+#define VSRL _mm_srli_epi32
+#define VSLL _mm_slli_epi32
+#define VSET1 _mm_set1_epi32
+
+// compresses one block for each of four lanes, st[i][j] is state word i of lane j
+__attribute__((target("sse2")))
+static void _BRSHA256CompressSSE2(uint32_t st[8][8], const uint8_t *blocks[8])
+{
+    __m128i r[8], w[64];
+    int i;
+
+    for (i = 0; i < 8; i++) r[i] = _mm_loadu_si128((const __m128i *)st[i]);
+
+    for (i = 0; i < 16; i++) {
+        w[i] = _mm_setr_epi32(sha256_word(blocks[0], i), sha256_word(blocks[1], i), sha256_word(blocks[2], i),
+                              sha256_word(blocks[3], i));
+    }
+
+    sha256_compress_v(__m128i, r, w);
+    for (i = 0; i < 8; i++) _mm_storeu_si128((__m128i *)st[i], r[i]);
+    mem_clean(w, sizeof(w));
+}
+
+#undef VADD
+#undef VXOR
+#undef VAND
+#undef VANDN
+#undef VOR
+#undef VSRL
+#undef VSLL
+#undef VSET1
+#define VADD _mm256_add_epi32
+#define VXOR _mm256_xor_si256
+#define VAND _mm256_and_si256
+#define VANDN _mm256_andnot_si256
+#define VOR _mm256_or_si256
+#define VSRL _mm256_srli_epi32
+#define VSLL _mm256_slli_epi32
+#define VSET1 _mm256_set1_epi32
+
+// compresses one block for each of eight lanes, st[i][j] is state word i of lane j
+__attribute__((target("avx2")))
+static void _BRSHA256CompressAVX2(uint32_t st[8][8], const uint8_t *blocks[8])
+{
+    __m256i r[8], w[64];
+    int i;
+
+    for (i = 0; i < 8; i++) r[i] = _mm256_loadu_si256((const __m256i *)st[i]);
+
+    for (i = 0; i < 16; i++) {
+        w[i] = _mm256_setr_epi32(sha256_word(blocks[0], i), sha256_word(blocks[1], i), sha256_word(blocks[2], i),
+                                 sha256_word(blocks[3], i), sha256_word(blocks[4], i), sha256_word(blocks[5], i),
+                                 sha256_word(blocks[6], i), sha256_word(blocks[7], i));
+    }
+
+    sha256_compress_v(__m256i, r, w);
+    for (i = 0; i < 8; i++) _mm256_storeu_si256((__m256i *)st[i], r[i]);
+    mem_clean(w, sizeof(w));
+}
+
+#undef VADD
+#undef VXOR
+#undef VAND
+#undef VANDN
+#undef VOR
+#undef VSRL
+#undef VSLL
+#undef VSET1
+#endif
+
+// double-sha-256 of count messages with the given implementation, or the best available if impl is negative or
+// unavailable, writing each 32 byte digest to md32s in order
+// returns the implementation used
+int _BRSHA256_2BatchImpl(void *md32s, const void *data[], const size_t dataLen[], size_t count, int impl)
+{
+    int cpu = _BRCPUFeatures(), best = (cpu & CPU_AVX2) ? SHA256_IMPL_AVX2 :
+                                       (cpu & CPU_SSE2) ? SHA256_IMPL_SSE2 : SHA256_IMPL_SCALAR;
+    size_t i;
+
+    assert(md32s != NULL || count == 0);
+    assert(data != NULL || count == 0);
+    assert(dataLen != NULL || count == 0);
+
+    if (impl < 0 || impl > best) impl = best;
+
+    if (impl == SHA256_IMPL_SCALAR) {
+        for (i = 0; i < count; i++) BRSHA256_2((uint8_t *)md32s + i*32, data[i], dataLen[i]);
+        return impl;
+    }
+
+#if BR_X86
+    static const uint8_t zero[64] = { 0 }; // stands in for the block of an idle lane
+    static const uint32_t iv[] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                   0x1f83d9ab, 0x5be0cd19 };
+    _BRSHA256Lane lanes[8];
+    const uint8_t *blocks[8];
+    uint32_t st[8][8];
+    uint8_t md[32];
+    size_t next = 0, active = 0, n = (impl == SHA256_IMPL_AVX2) ? 8 : 4, j;
+
+    for (j = 0; j < n; j++) {
+        lanes[j].msg = SIZE_MAX;
+        if (next == count) continue;
+        assert(data[next] != NULL || dataLen[next] == 0);
+        _BRSHA256LaneStart(&lanes[j], data[next], dataLen[next]);
+        lanes[j].msg = next++, lanes[j].pass = 0, active++;
+        for (i = 0; i < 8; i++) st[i][j] = iv[i];
+    }
+
+    while (active > 0) {
+        for (j = 0; j < n; j++) blocks[j] = (lanes[j].msg != SIZE_MAX) ? _BRSHA256LaneNext(&lanes[j]) : zero;
+        if (impl == SHA256_IMPL_AVX2) _BRSHA256CompressAVX2(st, blocks);
+        else _BRSHA256CompressSSE2(st, blocks);
+
+        for (j = 0; j < n; j++) {
+            _BRSHA256Lane *lane = &lanes[j];
+
+            if (lane->msg == SIZE_MAX || lane->blocks > 0 || lane->tailNext < lane->tailBlocks) continue;
+            for (i = 0; i < 8; i++) md[i*4] = (uint8_t)(st[i][j] >> 24), md[i*4 + 1] = (uint8_t)(st[i][j] >> 16),
+                                     md[i*4 + 2] = (uint8_t)(st[i][j] >> 8), md[i*4 + 3] = (uint8_t)st[i][j];
+
+            if (lane->pass == 0) { // the first digest fits in the tail, so md can be reused before the next block
+                _BRSHA256LaneStart(lane, md, sizeof(md));
+                lane->pass = 1;
+            }
+            else {
+                memcpy((uint8_t *)md32s + lane->msg*32, md, sizeof(md));
+                lane->msg = SIZE_MAX, active--;
+                if (next == count) continue;
+                assert(data[next] != NULL || dataLen[next] == 0);
+                _BRSHA256LaneStart(lane, data[next], dataLen[next]);
+                lane->msg = next++, lane->pass = 0, active++;
+            }
+
+            for (i = 0; i < 8; i++) st[i][j] = iv[i];
+        }
+    }
+
+    mem_clean(lanes, sizeof(lanes));
+    mem_clean(st, sizeof(st));
+    mem_clean(md, sizeof(md));
+#endif
+    return impl;
+}
+
+// double-sha-256 of count messages, writing each 32 byte digest to md32s in order, hashing four or eight messages at
+// a time with sse2 or avx2 when the cpu supports them
+void BRSHA256_2Batch(void *md32s, const void *data[], const size_t dataLen[], size_t count)
+{
+    // a lone message is quicker on its own than in an otherwise idle vector
+    _BRSHA256_2BatchImpl(md32s, data, dataLen, count, (count > 1) ? -1 : SHA256_IMPL_SCALAR);
+}
+
 // bitwise right rotation
 #define ror64(a, b) (((a) >> (b)) | ((a) << (64 - (b))))
 
@@ -705,6 +972,80 @@ void BRHMACDRBG(void *out, size_t outLen, void *K, void *V, void (*hash)(void *,
     }
 }
 
+#if defined(__SIZEOF_INT128__)
+// with 128 bit products available, h and r are held in 44, 44 and 42 bit limbs instead of five 26 bit limbs, the
+// state passed between calls stays in 26 bit limbs so the caller's view of h is the same on every platform
+static void _BRPoly1305Compress(uint32_t h[5], const void *key32, const void *data, size_t dataLen, int final)
+{
+    const uint64_t m44 = 0xfffffffffffULL, m42 = 0x3ffffffffffULL;
+    uint64_t x[2], t0, t1, r0, r1, r2, s1, s2, h0, h1, h2, g0, g1, g2, c, b;
+    unsigned __int128 d0, d1, d2;
+
+    // r &= 0xffffffc0ffffffc0ffffffc0fffffff
+    memcpy(x, key32, 16);
+    t0 = le64(x[0]), t1 = le64(x[1]);
+    r0 = t0 & 0xffc0fffffffULL, r1 = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL, r2 = (t1 >> 24) & 0x00ffffffc0fULL;
+    s1 = r1*(5 << 2), s2 = r2*(5 << 2);
+
+    // h from 26 bit limbs
+    h0 = h[0] + ((uint64_t)h[1] << 26), c = h0 >> 44, h0 &= m44;
+    h1 = c + ((uint64_t)h[2] << 8) + ((uint64_t)h[3] << 34), c = h1 >> 44, h1 &= m44;
+    h2 = c + ((uint64_t)h[4] << 16);
+
+    for (size_t i = 0; i < dataLen; i += 16) { // process data in 16 byte blocks
+        if (i + 16 > dataLen) {
+            memset(x, 0, 16); // clear remainder of x
+            memcpy(x, (const uint8_t *)data + i, dataLen - i);
+            ((uint8_t *)x)[dataLen - i] = 1; // append padding
+        }
+        else memcpy(x, (const uint8_t *)data + i, 16);
+
+        // h += x
+        t0 = le64(x[0]), t1 = le64(x[1]);
+        h0 += t0 & m44, h1 += ((t0 >> 44) | (t1 << 20)) & m44;
+        h2 += ((t1 >> 24) & m42) | ((i + 16 <= dataLen) ? (1ULL << 40) : 0);
+
+        // h *= r
+        d0 = (unsigned __int128)h0*r0 + (unsigned __int128)h1*s2 + (unsigned __int128)h2*s1;
+        d1 = (unsigned __int128)h0*r1 + (unsigned __int128)h1*r0 + (unsigned __int128)h2*s2;
+        d2 = (unsigned __int128)h0*r2 + (unsigned __int128)h1*r1 + (unsigned __int128)h2*r0;
+
+        // (partial) h %= p
+        c = (uint64_t)(d0 >> 44), h0 = (uint64_t)d0 & m44, d1 += c, c = (uint64_t)(d1 >> 44), h1 = (uint64_t)d1 & m44;
+        d2 += c, c = (uint64_t)(d2 >> 42), h2 = (uint64_t)d2 & m42, h0 += c*5, c = h0 >> 44, h0 &= m44, h1 += c;
+    }
+
+    c = h1 >> 44, h1 &= m44, h2 += c;
+
+    if (final) {
+        // fully carry h
+        c = h2 >> 42, h2 &= m42, h0 += c*5, c = h0 >> 44, h0 &= m44, h1 += c, c = h1 >> 44, h1 &= m44, h2 += c;
+        c = h2 >> 42, h2 &= m42, h0 += c*5, c = h0 >> 44, h0 &= m44, h1 += c;
+
+        // compute h + -p
+        g0 = h0 + 5, c = g0 >> 44, g0 &= m44, g1 = h1 + c, c = g1 >> 44, g1 &= m44, g2 = h2 + c - (1ULL << 42);
+
+        // select h if h < p, or h + -p if h >= p
+        b = (g2 >> 63) - 1, h0 = (h0 & ~b) | (g0 & b), h1 = (h1 & ~b) | (g1 & b), h2 = (h2 & ~b) | (g2 & b);
+
+        // mac = (h + pad) % (2^128)
+        memcpy(x, (const uint8_t *)key32 + 16, 16);
+        t0 = le64(x[0]), t1 = le64(x[1]);
+        h0 += t0 & m44, c = h0 >> 44, h0 &= m44, h1 += (((t0 >> 44) | (t1 << 20)) & m44) + c, c = h1 >> 44;
+        h1 &= m44, h2 += ((t1 >> 24) & m42) + c, h2 &= m42;
+        x[0] = le64(h0 | (h1 << 44)), x[1] = le64((h1 >> 20) | (h2 << 24));
+        memcpy(h, x, 16);
+    }
+    else { // h back to 26 bit limbs
+        h[0] = h0 & 0x03ffffff, h[1] = ((h0 >> 26) | (h1 << 18)) & 0x03ffffff, h[2] = (h1 >> 8) & 0x03ffffff;
+        h[3] = ((h1 >> 34) | (h2 << 10)) & 0x03ffffff, h[4] = (uint32_t)(h2 >> 16);
+    }
+
+    var_clean(&d0, &d1, &d2);
+    mem_clean(x, sizeof(x));
+    var_clean(&t0, &t1, &r0, &r1, &r2, &s1, &s2, &h0, &h1, &h2, &g0, &g1, &g2, &c, &b);
+}
+#else
 static void _BRPoly1305Compress(uint32_t h[5], const void *key32, const void *data, size_t dataLen, int final)
 {
     uint32_t x[4], b, t0, t1, t2, t3, t4, r0, r1, r2, r3, r4;
@@ -771,6 +1112,7 @@ static void _BRPoly1305Compress(uint32_t h[5], const void *key32, const void *da
     mem_clean(x, sizeof(x));
     var_clean(&b, &t0, &t1, &t2, &t3, &t4, &r0, &r1, &r2, &r3, &r4);
 }
+#endif
 
 // poly1305 authenticator: https://tools.ietf.org/html/rfc7539
 // NOTE: must use constant time mem comparison when verifying mac to defend against timing attacks
@@ -791,50 +1133,224 @@ void BRPoly1305(void *mac16, const void *key32, const void *data, size_t dataLen
 #define qr(a, b, c, d) ((a) += (b), (d) = rol32((d) ^ (a), 16), (c) += (d), (b) = rol32((b) ^ (c), 12),\
                         (a) += (b), (d) = rol32((d) ^ (a), 8), (c) += (d), (b) = rol32((b) ^ (c), 7))
 
-// chacha20 stream cipher: https://cr.yp.to/chacha.html
-void BRChacha20(void *out, const void *key32, const void *iv8, const void *data, size_t dataLen, uint64_t counter)
+#define CHACHA_IMPL_SCALAR 0
+#define CHACHA_IMPL_SSE2   1 // four blocks at a time
+#define CHACHA_IMPL_AVX2   2 // eight blocks at a time
+
+// generates a 64 byte chacha20 key stream block from state s
+static void _BRChacha20Block(uint32_t b[16], const uint32_t s[16])
+{
+    uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
+
+    x0 = s[0], x1 = s[1], x2 = s[2], x3 = s[3], x4 = s[4], x5 = s[5], x6 = s[6], x7 = s[7];
+    x8 = s[8], x9 = s[9], x10 = s[10], x11 = s[11], x12 = s[12], x13 = s[13], x14 = s[14], x15 = s[15];
+
+    for (int j = 0; j < 10; j++) {
+        qr(x0, x4, x8, x12), qr(x1, x5, x9, x13), qr(x2, x6, x10, x14), qr(x3, x7, x11, x15);
+        qr(x0, x5, x10, x15), qr(x1, x6, x11, x12), qr(x2, x7, x8, x13), qr(x3, x4, x9, x14);
+    }
+
+    b[0] = le32(s[0] + x0), b[1] = le32(s[1] + x1), b[2] = le32(s[2] + x2), b[3] = le32(s[3] + x3);
+    b[4] = le32(s[4] + x4), b[5] = le32(s[5] + x5), b[6] = le32(s[6] + x6), b[7] = le32(s[7] + x7);
+    b[8] = le32(s[8] + x8), b[9] = le32(s[9] + x9), b[10] = le32(s[10] + x10), b[11] = le32(s[11] + x11);
+    b[12] = le32(s[12] + x12), b[13] = le32(s[13] + x13), b[14] = le32(s[14] + x14), b[15] = le32(s[15] + x15);
+    var_clean(&x0, &x1, &x2, &x3, &x4, &x5, &x6, &x7, &x8, &x9, &x10, &x11, &x12, &x13, &x14, &x15);
+}
+
+// xors len bytes of data with key stream blocks starting at the 64 bit block counter in s[12] and s[13]
+static void _BRChacha20XorScalar(uint8_t *out, const uint8_t *data, size_t len, uint32_t s[16])
+{
+    uint32_t b[16];
+    uint64_t x, y;
+    size_t i, j, n;
+
+    for (i = 0; i < len; i += 64) {
+        _BRChacha20Block(b, s);
+        n = (len - i < 64) ? len - i : 64;
+        for (j = 0; j + 8 <= n; j += 8) {
+            memcpy(&x, &data[i + j], 8), memcpy(&y, (uint8_t *)b + j, 8), x ^= y, memcpy(&out[i + j], &x, 8);
+        }
+        for (; j < n; j++) out[i + j] = data[i + j] ^ ((uint8_t *)b)[j];
+        s[12]++;
+        if (s[12] == 0) s[13]++;
+    }
+
+    mem_clean(b, sizeof(b));
+    var_clean(&x, &y);
+}
+
+#if BR_X86
+// the simd implementations run the same rounds on each of the sixteen state words for four or eight blocks in
+// parallel, with each vector lane holding one block, then transpose the lanes back into key stream blocks
+#define qrv(a, b, c, d, add, xor, rol, rol16, rol8) ((a) = add(a, b), (d) = rol16(xor(d, a)), (c) = add(c, d),\
+    (b) = rol(xor(b, c), 12), (a) = add(a, b), (d) = rol8(xor(d, a)), (c) = add(c, d), (b) = rol(xor(b, c), 7))
+
+#define chacha_rounds(x, add, xor, rol, rol16, rol8) do {\
+    for (int _j = 0; _j < 10; _j++) {\
+        qrv(x[0], x[4], x[8], x[12], add, xor, rol, rol16, rol8), qrv(x[1], x[5], x[9], x[13], add, xor, rol, rol16, rol8);\
+        qrv(x[2], x[6], x[10], x[14], add, xor, rol, rol16, rol8), qrv(x[3], x[7], x[11], x[15], add, xor, rol, rol16, rol8);\
+        qrv(x[0], x[5], x[10], x[15], add, xor, rol, rol16, rol8), qrv(x[1], x[6], x[11], x[12], add, xor, rol, rol16, rol8);\
+        qrv(x[2], x[7], x[8], x[13], add, xor, rol, rol16, rol8), qrv(x[3], x[4], x[9], x[14], add, xor, rol, rol16, rol8);\
+    }\
+} while (0)
+
+// block counters for count consecutive blocks, carrying from s[12] into s[13]
+static void _BRChacha20Counters(uint32_t lo[8], uint32_t hi[8], const uint32_t s[16], unsigned count)
+{
+    uint64_t c = ((uint64_t)s[13] << 32) | s[12];
+
+    for (unsigned i = 0; i < count; i++) lo[i] = (uint32_t)(c + i), hi[i] = (uint32_t)((c + i) >> 32);
+}
+
+static void _BRChacha20Advance(uint32_t s[16], unsigned count)
+{
+    uint64_t c = (((uint64_t)s[13] << 32) | s[12]) + count;
+
+    s[12] = (uint32_t)c, s[13] = (uint32_t)(c >> 32);
+}
+
+#define rol128(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+#define rol128_16(x) rol128(x, 16)
+#define rol128_8(x) rol128(x, 8)
+
+// transposes four vectors of one state word each into four vectors of four consecutive words of one block each
+#define transpose128(a, b, c, d) do {\
+    __m128i _t0 = _mm_unpacklo_epi32(a, b), _t1 = _mm_unpacklo_epi32(c, d), _t2 = _mm_unpackhi_epi32(a, b),\
+            _t3 = _mm_unpackhi_epi32(c, d);\
+    (a) = _mm_unpacklo_epi64(_t0, _t1), (b) = _mm_unpackhi_epi64(_t0, _t1), (c) = _mm_unpacklo_epi64(_t2, _t3),\
+    (d) = _mm_unpackhi_epi64(_t2, _t3);\
+} while (0)
+
+// xors whole 256 byte groups of data with key stream, returns the number of bytes processed
+__attribute__((target("sse2")))
+static size_t _BRChacha20XorSSE2(uint8_t *out, const uint8_t *data, size_t len, uint32_t s[16])
+{
+    __m128i x[16], v[16];
+    uint32_t lo[8], hi[8];
+    size_t off, i, j;
+
+    for (off = 0; off + 256 <= len; off += 256) {
+        _BRChacha20Counters(lo, hi, s, 4);
+
+        for (i = 0; i < 16; i++) v[i] = _mm_set1_epi32((int)s[i]);
+        v[12] = _mm_loadu_si128((const __m128i *)lo), v[13] = _mm_loadu_si128((const __m128i *)hi);
+        for (i = 0; i < 16; i++) x[i] = v[i];
+        chacha_rounds(x, _mm_add_epi32, _mm_xor_si128, rol128, rol128_16, rol128_8);
+        for (i = 0; i < 16; i++) x[i] = _mm_add_epi32(x[i], v[i]);
+
+        for (i = 0; i < 16; i += 4) {
+            transpose128(x[i], x[i + 1], x[i + 2], x[i + 3]);
+
+            for (j = 0; j < 4; j++) { // block j, bytes i*4 to i*4 + 15
+                const __m128i *p = (const __m128i *)&data[off + j*64 + i*4];
+
+                _mm_storeu_si128((__m128i *)&out[off + j*64 + i*4], _mm_xor_si128(_mm_loadu_si128(p), x[i + j]));
+            }
+        }
+
+        _BRChacha20Advance(s, 4);
+    }
+
+    mem_clean(x, sizeof(x));
+    mem_clean(v, sizeof(v));
+    return off;
+}
+
+#define rol256(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define rol256_16(x) _mm256_shuffle_epi8(x, r16)
+#define rol256_8(x) _mm256_shuffle_epi8(x, r8)
+
+// xors whole 512 byte groups of data with key stream, returns the number of bytes processed
+__attribute__((target("avx2")))
+static size_t _BRChacha20XorAVX2(uint8_t *out, const uint8_t *data, size_t len, uint32_t s[16])
+{
+    const __m256i r16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                         2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13),
+                  r8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                        3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    __m256i x[16], v[16], k;
+    uint32_t lo[8], hi[8];
+    size_t off, i, j;
+
+    for (off = 0; off + 512 <= len; off += 512) {
+        _BRChacha20Counters(lo, hi, s, 8);
+
+        for (i = 0; i < 16; i++) v[i] = _mm256_set1_epi32((int)s[i]);
+        v[12] = _mm256_loadu_si256((const __m256i *)lo), v[13] = _mm256_loadu_si256((const __m256i *)hi);
+        for (i = 0; i < 16; i++) x[i] = v[i];
+        chacha_rounds(x, _mm256_add_epi32, _mm256_xor_si256, rol256, rol256_16, rol256_8);
+        for (i = 0; i < 16; i++) x[i] = _mm256_add_epi32(x[i], v[i]);
+
+        // within each 128 bit half, the same 4x4 transpose as sse2, the low halves are blocks 0-3, high halves 4-7
+        for (i = 0; i < 16; i += 4) {
+            __m256i t0 = _mm256_unpacklo_epi32(x[i], x[i + 1]), t1 = _mm256_unpacklo_epi32(x[i + 2], x[i + 3]),
+                    t2 = _mm256_unpackhi_epi32(x[i], x[i + 1]), t3 = _mm256_unpackhi_epi32(x[i + 2], x[i + 3]);
+
+            x[i] = _mm256_unpacklo_epi64(t0, t1), x[i + 1] = _mm256_unpackhi_epi64(t0, t1);
+            x[i + 2] = _mm256_unpacklo_epi64(t2, t3), x[i + 3] = _mm256_unpackhi_epi64(t2, t3);
+        }
+
+        for (i = 0; i < 16; i += 8) {
+            for (j = 0; j < 4; j++) { // blocks j and j + 4, bytes i*4 to i*4 + 31
+                const uint8_t *d0 = &data[off + j*64 + i*4], *d1 = &data[off + (j + 4)*64 + i*4];
+
+                k = _mm256_permute2x128_si256(x[i + j], x[i + 4 + j], 0x20);
+                _mm256_storeu_si256((__m256i *)&out[off + j*64 + i*4],
+                                    _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)d0), k));
+                k = _mm256_permute2x128_si256(x[i + j], x[i + 4 + j], 0x31);
+                _mm256_storeu_si256((__m256i *)&out[off + (j + 4)*64 + i*4],
+                                    _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)d1), k));
+            }
+        }
+
+        _BRChacha20Advance(s, 8);
+    }
+
+    mem_clean(x, sizeof(x));
+    mem_clean(v, sizeof(v));
+    mem_clean(&k, sizeof(k));
+    return off;
+}
+#endif
+
+// chacha20 with the given implementation, or the best available if impl is negative or unavailable
+// returns the implementation used
+int _BRChacha20Impl(void *out, const void *key32, const void *iv8, const void *data, size_t dataLen, uint64_t counter,
+                    int impl)
 {
     static const char sigma[16] = "expand 32-byte k";
-    uint32_t b[16], s[16], x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
-    size_t i, j;
-    
+    int cpu = _BRCPUFeatures(), best = (cpu & CPU_AVX2) ? CHACHA_IMPL_AVX2 :
+                                       (cpu & CPU_SSE2) ? CHACHA_IMPL_SSE2 : CHACHA_IMPL_SCALAR;
+    uint32_t s[16];
+    size_t off = 0;
+
     assert(out != NULL || dataLen == 0);
     assert(data != NULL || dataLen == 0);
     assert(key32 != NULL);
     assert(iv8 != NULL);
-    
+
+    if (impl < 0 || impl > best) impl = best;
     memcpy(s, sigma, 16);
     memcpy(&s[4], key32, 32);
     s[12] = le32((uint32_t)counter);
     s[13] = le32(counter >> 32);
     memcpy(&s[14], iv8, 8);
-    for (i = 0; i < 16; i++) s[i] = le32(s[i]);
-
-    for (i = 0; i < dataLen; i++) {
-        if (i % 64 == 0) {
-            x0 = s[0], x1 = s[1], x2 = s[2], x3 = s[3], x4 = s[4], x5 = s[5], x6 = s[6], x7 = s[7];
-            x8 = s[8], x9 = s[9], x10 = s[10], x11 = s[11], x12 = s[12], x13 = s[13], x14 = s[14], x15 = s[15];
-            
-            for (j = 0; j < 10; j++) {
-                qr(x0, x4, x8, x12), qr(x1, x5, x9, x13), qr(x2, x6, x10, x14), qr(x3, x7, x11, x15);
-                qr(x0, x5, x10, x15), qr(x1, x6, x11, x12), qr(x2, x7, x8, x13), qr(x3, x4, x9, x14);
-            }
-            
-            b[0] = le32(s[0] + x0), b[1] = le32(s[1] + x1), b[2] = le32(s[2] + x2), b[3] = le32(s[3] + x3);
-            b[4] = le32(s[4] + x4), b[5] = le32(s[5] + x5), b[6] = le32(s[6] + x6), b[7] = le32(s[7] + x7);
-            b[8] = le32(s[8] + x8), b[9] = le32(s[9] + x9), b[10] = le32(s[10] + x10), b[11] = le32(s[11] + x11);
-            b[12] = le32(s[12] + x12), b[13] = le32(s[13] + x13), b[14] = le32(s[14] + x14), b[15] = le32(s[15] + x15);
-
-            s[12]++;
-            if (s[12] == 0) s[13]++;
-        }
-        
-        ((uint8_t *)out)[i] = ((const uint8_t *)data)[i] ^ ((uint8_t *)b)[i % 64];
-    }
-    
-    var_clean(&x0, &x1, &x2, &x3, &x4, &x5, &x6, &x7, &x8, &x9, &x10, &x11, &x12, &x13, &x14, &x15);
+    for (int i = 0; i < 16; i++) s[i] = le32(s[i]);
+
+#if BR_X86
+    if (impl == CHACHA_IMPL_AVX2) off += _BRChacha20XorAVX2(out, data, dataLen, s);
+    if (impl >= CHACHA_IMPL_SSE2) off += _BRChacha20XorSSE2((uint8_t *)out + off, (const uint8_t *)data + off,
+                                                            dataLen - off, s);
+#endif
+    _BRChacha20XorScalar((uint8_t *)out + off, (const uint8_t *)data + off, dataLen - off, s);
     mem_clean(s, sizeof(s));
-    mem_clean(b, sizeof(b));
+    return impl;
+}
+
+// chacha20 stream cipher: https://cr.yp.to/chacha.html
+void BRChacha20(void *out, const void *key32, const void *iv8, const void *data, size_t dataLen, uint64_t counter)
+{
+    _BRChacha20Impl(out, key32, iv8, data, dataLen, counter, -1);
 }
 
 // chacha20-poly1305 authenticated encryption with associated data (AEAD): https://tools.ietf.org/html/rfc7539
@@ -906,193 +1422,520 @@ size_t BRChacha20Poly1305AEADDecrypt(void *out, size_t outLen, const void *key32
     return outLen;
 }
 
-static const uint8_t sbox[256] = {
-    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
-    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
-    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
-    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
-    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
-    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
-    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
-    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
-    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
-    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
-    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
-    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
-    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
-    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
-    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
-    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
-};
+// aes is implemented three ways, chosen at runtime by BRAESKeyInit(): with the aes-ni instructions, with the vaes
+// instructions encrypting two blocks per 256 bit register, and a portable, constant time, bitsliced implementation that
+// processes four blocks at once in 64 bit words (after Thomas Pornin's aes_ct64: https://bearssl.org/constanttime.html)
+// the aes-ni and vaes implementations pipeline eight blocks at a time
 
-static const uint8_t sboxi[256] = {
-    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
-    0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
-    0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
-    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
-    0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
-    0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
-    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
-    0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
-    0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
-    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
-    0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
-    0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
-    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
-    0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
-    0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
-    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
-};
+#define AES_IMPL_CT   0
+#define AES_IMPL_NI   1
+#define AES_IMPL_VAES 2
 
-#define xt(x) (((x) << 1) ^ ((((x) >> 7) & 1)*0x1b))
+#define AES_CTR_BLOCKS 32 // counter blocks encrypted per pass by BRAESKeyCTR()
 
-static void _BRAESExpandKey(uint8_t k[256], const void *key, size_t kl)
+static uint32_t _le32dec(const uint8_t *p)
 {
-    uint8_t r = 1;
-    size_t i, j, rounds = kl/4 + 6;
-    
-    memcpy(k, key, kl);
-    
-    for (i = kl; i <= 16*rounds; i += kl) {
-        k[i] = k[i - kl] ^ sbox[k[i - 3]] ^ r, k[i + 1] = k[i + 1 - kl] ^ sbox[k[i - 2]];
-        k[i + 2] = k[i + 2 - kl] ^ sbox[k[i - 1]], k[i + 3] = k[i + 3 - kl] ^ sbox[k[i - 4]], r = xt(r);
-        for (j = i + 4; j < i + kl; j++) k[j] = k[j - kl] ^ ((kl == 32 && (j % 16) < 4) ? sbox[k[j - 4]] : k[j - 4]);
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void _le32enc(uint8_t *p, uint32_t x)
+{
+    p[0] = (uint8_t)x, p[1] = (uint8_t)(x >> 8), p[2] = (uint8_t)(x >> 16), p[3] = (uint8_t)(x >> 24);
+}
+
+// bitsliced aes s-box, eight bit planes of 64 bits each, Boyar and Peralta's circuit: https://eprint.iacr.org/2009/191
+static void _BRAESSbox(uint64_t q[8])
+{
+    uint64_t x0, x1, x2, x3, x4, x5, x6, x7, y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16,
+             y17, y18, y19, y20, y21, z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17,
+             t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19, t20, t21, t22,
+             t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39, t40, t41, t42, t43,
+             t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59, t60, t61, t62, t63, t64,
+             t65, t66, t67, s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4], x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+    // top linear transformation
+    y14 = x3 ^ x5, y13 = x0 ^ x6, y9 = x0 ^ x3, y8 = x0 ^ x5, t0 = x1 ^ x2, y1 = t0 ^ x7, y4 = y1 ^ x3;
+    y12 = y13 ^ y14, y2 = y1 ^ x0, y5 = y1 ^ x6, y3 = y5 ^ y8, t1 = x4 ^ y12, y15 = t1 ^ x5, y20 = t1 ^ x1;
+    y6 = y15 ^ x7, y10 = y15 ^ t0, y11 = y20 ^ y9, y7 = x7 ^ y11, y17 = y10 ^ y11, y19 = y10 ^ y8;
+    y16 = t0 ^ y11, y21 = y13 ^ y16, y18 = x0 ^ y16;
+
+    // non-linear section
+    t2 = y12 & y15, t3 = y3 & y6, t4 = t3 ^ t2, t5 = y4 & x7, t6 = t5 ^ t2, t7 = y13 & y16, t8 = y5 & y1;
+    t9 = t8 ^ t7, t10 = y2 & y7, t11 = t10 ^ t7, t12 = y9 & y11, t13 = y14 & y17, t14 = t13 ^ t12;
+    t15 = y8 & y10, t16 = t15 ^ t12, t17 = t4 ^ t14, t18 = t6 ^ t16, t19 = t9 ^ t14, t20 = t11 ^ t16;
+    t21 = t17 ^ y20, t22 = t18 ^ y19, t23 = t19 ^ y21, t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22, t26 = t21 & t23, t27 = t24 ^ t26, t28 = t25 & t27, t29 = t28 ^ t22, t30 = t23 ^ t24;
+    t31 = t22 ^ t26, t32 = t31 & t30, t33 = t32 ^ t24, t34 = t23 ^ t33, t35 = t27 ^ t33, t36 = t24 & t35;
+    t37 = t36 ^ t34, t38 = t27 ^ t36, t39 = t29 & t38, t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37, t42 = t29 ^ t33, t43 = t29 ^ t40, t44 = t33 ^ t37, t45 = t42 ^ t41;
+    z0 = t44 & y15, z1 = t37 & y6, z2 = t33 & x7, z3 = t43 & y16, z4 = t40 & y1, z5 = t29 & y7, z6 = t42 & y11;
+    z7 = t45 & y17, z8 = t41 & y10, z9 = t44 & y12, z10 = t37 & y3, z11 = t33 & y4, z12 = t43 & y13;
+    z13 = t40 & y5, z14 = t29 & y2, z15 = t42 & y9, z16 = t45 & y14, z17 = t41 & y8;
+
+    // bottom linear transformation
+    t46 = z15 ^ z16, t47 = z10 ^ z11, t48 = z5 ^ z13, t49 = z9 ^ z10, t50 = z2 ^ z12, t51 = z2 ^ z5, t52 = z7 ^ z8;
+    t53 = z0 ^ z3, t54 = z6 ^ z7, t55 = z16 ^ z17, t56 = z12 ^ t48, t57 = t50 ^ t53, t58 = z4 ^ t46;
+    t59 = z3 ^ t54, t60 = t46 ^ t57, t61 = z14 ^ t57, t62 = t52 ^ t58, t63 = t49 ^ t58, t64 = z4 ^ t59;
+    t65 = t61 ^ t62, t66 = z1 ^ t63, s0 = t59 ^ t63, s6 = t56 ^ ~t62, s7 = t48 ^ ~t60, t67 = t64 ^ t65;
+    s3 = t53 ^ t66, s4 = t51 ^ t66, s5 = t47 ^ t65, s1 = t64 ^ ~s3, s2 = t55 ^ ~t67;
+
+    q[7] = s0, q[6] = s1, q[5] = s2, q[4] = s3, q[3] = s4, q[2] = s5, q[1] = s6, q[0] = s7;
+}
+
+// the inverse s-box is the s-box between two applications of the inverse affine transformation
+static void _BRAESInvAffine(uint64_t q[8])
+{
+    uint64_t q0 = ~q[0], q1 = ~q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = ~q[5], q6 = ~q[6], q7 = q[7];
+
+    q[7] = q1 ^ q4 ^ q6, q[6] = q0 ^ q3 ^ q5, q[5] = q7 ^ q2 ^ q4, q[4] = q6 ^ q1 ^ q3;
+    q[3] = q5 ^ q0 ^ q2, q[2] = q4 ^ q7 ^ q1, q[1] = q3 ^ q6 ^ q0, q[0] = q2 ^ q5 ^ q7;
+}
+
+static void _BRAESInvSbox(uint64_t q[8])
+{
+    _BRAESInvAffine(q);
+    _BRAESSbox(q);
+    _BRAESInvAffine(q);
+}
+
+#define aes_swap(cl, ch, s, x, y) do {\
+    uint64_t _a = (x), _b = (y);\
+    (x) = (_a & (cl)) | ((_b & (cl)) << (s)), (y) = ((_a & (ch)) >> (s)) | (_b & (ch));\
+} while (0)
+
+// converts between bytes and bit planes, it is its own inverse
+static void _BRAESOrtho(uint64_t q[8])
+{
+    for (int i = 0; i < 8; i += 2) aes_swap(0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 1, q[i], q[i + 1]);
+    for (int i = 0; i < 8; i += (i % 2) ? 3 : 1) aes_swap(0x3333333333333333ULL, 0xCCCCCCCCCCCCCCCCULL, 2, q[i], q[i + 2]);
+    for (int i = 0; i < 4; i++) aes_swap(0x0F0F0F0F0F0F0F0FULL, 0xF0F0F0F0F0F0F0F0ULL, 4, q[i], q[i + 4]);
+}
+
+static void _BRAESInterleaveIn(uint64_t *q0, uint64_t *q1, const uint32_t w[4])
+{
+    uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+
+    x0 = (x0 | (x0 << 16)) & 0x0000FFFF0000FFFFULL, x1 = (x1 | (x1 << 16)) & 0x0000FFFF0000FFFFULL;
+    x2 = (x2 | (x2 << 16)) & 0x0000FFFF0000FFFFULL, x3 = (x3 | (x3 << 16)) & 0x0000FFFF0000FFFFULL;
+    x0 = (x0 | (x0 << 8)) & 0x00FF00FF00FF00FFULL, x1 = (x1 | (x1 << 8)) & 0x00FF00FF00FF00FFULL;
+    x2 = (x2 | (x2 << 8)) & 0x00FF00FF00FF00FFULL, x3 = (x3 | (x3 << 8)) & 0x00FF00FF00FF00FFULL;
+    *q0 = x0 | (x2 << 8), *q1 = x1 | (x3 << 8);
+}
+
+static void _BRAESInterleaveOut(uint32_t w[4], uint64_t q0, uint64_t q1)
+{
+    uint64_t x0 = q0 & 0x00FF00FF00FF00FFULL, x1 = q1 & 0x00FF00FF00FF00FFULL,
+             x2 = (q0 >> 8) & 0x00FF00FF00FF00FFULL, x3 = (q1 >> 8) & 0x00FF00FF00FF00FFULL;
+
+    x0 = (x0 | (x0 >> 8)) & 0x0000FFFF0000FFFFULL, x1 = (x1 | (x1 >> 8)) & 0x0000FFFF0000FFFFULL;
+    x2 = (x2 | (x2 >> 8)) & 0x0000FFFF0000FFFFULL, x3 = (x3 | (x3 >> 8)) & 0x0000FFFF0000FFFFULL;
+    w[0] = (uint32_t)x0 | (uint32_t)(x0 >> 16), w[1] = (uint32_t)x1 | (uint32_t)(x1 >> 16);
+    w[2] = (uint32_t)x2 | (uint32_t)(x2 >> 16), w[3] = (uint32_t)x3 | (uint32_t)(x3 >> 16);
+}
+
+static uint32_t _BRAESSubWord(uint32_t x)
+{
+    uint64_t q[8] = { x, 0, 0, 0, 0, 0, 0, 0 };
+
+    _BRAESOrtho(q);
+    _BRAESSbox(q);
+    _BRAESOrtho(q);
+    return (uint32_t)q[0];
+}
+
+static void _BRAESShiftRows(uint64_t q[8])
+{
+    for (int i = 0; i < 8; i++) {
+        uint64_t x = q[i];
+
+        q[i] = (x & 0x000000000000FFFFULL) | ((x & 0x00000000FFF00000ULL) >> 4) | ((x & 0x00000000000F0000ULL) << 12) |
+               ((x & 0x0000FF0000000000ULL) >> 8) | ((x & 0x000000FF00000000ULL) << 8) |
+               ((x & 0xF000000000000000ULL) >> 12) | ((x & 0x0FFF000000000000ULL) << 4);
     }
 }
 
-static void _BRAESCipher(uint8_t x[16], const uint8_t k[256], size_t kl)
+static void _BRAESInvShiftRows(uint64_t q[8])
 {
-    uint8_t a, b, c, d, e;
-    size_t i, j, rounds = kl/4 + 6;
-    
-    for (j = 0; j < 16; j++) x[j] ^= k[j]; // first add round key
-    
-    for (i = 0; i < rounds; i++) {
-        for (j = 0; j < 16; j++) x[j] = sbox[x[j]]; // sub bytes
-        
-        // shift rows
-        a = x[1], x[1] = x[5], x[5] = x[9], x[9] = x[13], x[13] = a, a = x[10], x[10] = x[2], x[2] = a;
-        a = x[3], x[3] = x[15], x[15] = x[11], x[11] = x[7], x[7] = a, a = x[14], x[14] = x[6], x[6] = a;
-        
-        for (j = 0; i < rounds - 1 && j < 16; j += 4) { // mix columns
-            a = x[j], b = x[j + 1], c = x[j + 2], d = x[j + 3], e = a ^ b ^ c ^ d;
-            x[j] ^= e ^ xt(a ^ b), x[j + 1] ^= e ^ xt(b ^ c), x[j + 2] ^= e ^ xt(c ^ d), x[j + 3] ^= e ^ xt(d ^ a);
+    for (int i = 0; i < 8; i++) {
+        uint64_t x = q[i];
+
+        q[i] = (x & 0x000000000000FFFFULL) | ((x & 0x000000000FFF0000ULL) << 4) | ((x & 0x00000000F0000000ULL) >> 12) |
+               ((x & 0x000000FF00000000ULL) << 8) | ((x & 0x0000FF0000000000ULL) >> 8) |
+               ((x & 0x000F000000000000ULL) << 12) | ((x & 0xFFF0000000000000ULL) >> 4);
+    }
+}
+
+#define rotr32(x) (((x) << 32) | ((x) >> 32))
+
+static void _BRAESMixColumns(uint64_t q[8])
+{
+    uint64_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7],
+             r0 = (q0 >> 16) | (q0 << 48), r1 = (q1 >> 16) | (q1 << 48), r2 = (q2 >> 16) | (q2 << 48),
+             r3 = (q3 >> 16) | (q3 << 48), r4 = (q4 >> 16) | (q4 << 48), r5 = (q5 >> 16) | (q5 << 48),
+             r6 = (q6 >> 16) | (q6 << 48), r7 = (q7 >> 16) | (q7 << 48);
+
+    q[0] = q7 ^ r7 ^ r0 ^ rotr32(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ rotr32(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ rotr32(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ rotr32(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ rotr32(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ rotr32(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ rotr32(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ rotr32(q7 ^ r7);
+}
+
+static void _BRAESInvMixColumns(uint64_t q[8])
+{
+    uint64_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7],
+             r0 = (q0 >> 16) | (q0 << 48), r1 = (q1 >> 16) | (q1 << 48), r2 = (q2 >> 16) | (q2 << 48),
+             r3 = (q3 >> 16) | (q3 << 48), r4 = (q4 >> 16) | (q4 << 48), r5 = (q5 >> 16) | (q5 << 48),
+             r6 = (q6 >> 16) | (q6 << 48), r7 = (q7 >> 16) | (q7 << 48);
+
+    q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ rotr32(q0 ^ q5 ^ q6 ^ r0 ^ r5);
+    q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^ rotr32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6);
+    q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^ rotr32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7);
+    q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 ^ rotr32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7);
+    q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 ^ rotr32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6);
+    q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^ rotr32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7);
+    q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^ rotr32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7);
+    q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ rotr32(q4 ^ q5 ^ q7 ^ r4 ^ r7);
+}
+
+static void _BRAESAddRoundKey(uint64_t q[8], const uint64_t *sk)
+{
+    for (int i = 0; i < 8; i++) q[i] ^= sk[i];
+}
+
+// encrypts or decrypts count blocks, at most four, with the bitsliced implementation
+static void _BRAESCTBlocks(const BRAESKey *key, uint8_t *out, const uint8_t *in, size_t count, int decrypt)
+{
+    uint32_t w[16] = { 0 };
+    uint64_t q[8];
+    unsigned i, r = key->rounds;
+
+    for (i = 0; i < count*4; i++) w[i] = _le32dec(&in[i*4]);
+    for (i = 0; i < 4; i++) _BRAESInterleaveIn(&q[i], &q[i + 4], &w[i*4]);
+    _BRAESOrtho(q);
+
+    if (! decrypt) {
+        _BRAESAddRoundKey(q, key->sk);
+
+        for (i = 1; i < r; i++) {
+            _BRAESSbox(q);
+            _BRAESShiftRows(q);
+            _BRAESMixColumns(q);
+            _BRAESAddRoundKey(q, &key->sk[i*8]);
         }
-        
-        for (j = 0; j < 16; j++) x[j] ^= k[(i + 1)*16 + j]; // add round key
+
+        _BRAESSbox(q);
+        _BRAESShiftRows(q);
+        _BRAESAddRoundKey(q, &key->sk[r*8]);
     }
-    
-    var_clean(&a, &b, &c, &d, &e);
+    else {
+        _BRAESAddRoundKey(q, &key->sk[r*8]);
+
+        for (i = r - 1; i > 0; i--) {
+            _BRAESInvShiftRows(q);
+            _BRAESInvSbox(q);
+            _BRAESAddRoundKey(q, &key->sk[i*8]);
+            _BRAESInvMixColumns(q);
+        }
+
+        _BRAESInvShiftRows(q);
+        _BRAESInvSbox(q);
+        _BRAESAddRoundKey(q, key->sk);
+    }
+
+    _BRAESOrtho(q);
+    for (i = 0; i < 4; i++) _BRAESInterleaveOut(&w[i*4], q[i], q[i + 4]);
+    for (i = 0; i < count*4; i++) _le32enc(&out[i*4], w[i]);
+    mem_clean(w, sizeof(w));
+    mem_clean(q, sizeof(q));
 }
 
-static void _BRAESDecipher(uint8_t x[16], const uint8_t k[256], size_t kl)
+#if BR_X86
+__attribute__((target("aes,sse2")))
+static void _BRAESNIBlocks(const BRAESKey *key, uint8_t *out, const uint8_t *in, size_t count, int decrypt)
 {
-    uint8_t a, b, c, d, e, f, g;
-    size_t i, j, rounds = kl/4 + 6;
-    
-    for (j = 0; j < 16; j++) x[j] ^= k[rounds*16 + j]; // first add round key
-    
-    for (i = rounds; i > 0; i--) {
-        // unshift rows
-        a = x[1], x[1] = x[13], x[13] = x[9], x[9] = x[5], x[5] = a, a = x[2], x[2] = x[10], x[10] = a;
-        a = x[3], x[3] = x[7], x[7] = x[11], x[11] = x[15], x[15] = a, a = x[6], x[6] = x[14], x[14] = a;
-        
-        for (j = 0; j < 16; j++) x[j] = sboxi[x[j]]; // unsub bytes
-        
-        for (j = 0; j < 16; j++) x[j] ^= k[(i - 1)*16 + j]; // add round key
-        
-        for (j = 0; i > 1 && j < 16; j += 4) { // unmix columns
-            a = x[j], b = x[j + 1], c = x[j + 2], d = x[j + 3], e = a ^ b ^ c ^ d;
-            f = e ^ xt(xt(xt(e) ^ a ^ c)), g = e ^ xt(xt(xt(e) ^ b ^ d));
-            x[j] ^= f ^ xt(a ^ b), x[j + 1] ^= g ^ xt(b ^ c), x[j + 2] ^= f ^ xt(c ^ d), x[j + 3] ^= g ^ xt(d ^ a);
+    const uint32_t *rk = (decrypt) ? key->dk : key->rk;
+    __m128i k[15], b[8];
+    unsigned i, j, r = key->rounds;
+
+    for (i = 0; i <= r; i++) k[i] = _mm_loadu_si128((const __m128i *)&rk[i*4]);
+
+    for (; count >= 8; count -= 8, in += 128, out += 128) {
+        for (j = 0; j < 8; j++) b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&in[j*16]), k[0]);
+
+        if (! decrypt) {
+            for (i = 1; i < r; i++) for (j = 0; j < 8; j++) b[j] = _mm_aesenc_si128(b[j], k[i]);
+            for (j = 0; j < 8; j++) b[j] = _mm_aesenclast_si128(b[j], k[r]);
+        }
+        else {
+            for (i = 1; i < r; i++) for (j = 0; j < 8; j++) b[j] = _mm_aesdec_si128(b[j], k[i]);
+            for (j = 0; j < 8; j++) b[j] = _mm_aesdeclast_si128(b[j], k[r]);
         }
+
+        for (j = 0; j < 8; j++) _mm_storeu_si128((__m128i *)&out[j*16], b[j]);
+    }
+
+    for (; count > 0; count--, in += 16, out += 16) {
+        b[0] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+
+        if (! decrypt) {
+            for (i = 1; i < r; i++) b[0] = _mm_aesenc_si128(b[0], k[i]);
+            b[0] = _mm_aesenclast_si128(b[0], k[r]);
+        }
+        else {
+            for (i = 1; i < r; i++) b[0] = _mm_aesdec_si128(b[0], k[i]);
+            b[0] = _mm_aesdeclast_si128(b[0], k[r]);
+        }
+
+        _mm_storeu_si128((__m128i *)out, b[0]);
     }
-    
-    var_clean(&a, &b, &c, &d, &e, &f, &g);
 }
 
-// aes-ecb block cipher
-void BRAESECBEncrypt(void *buf16, const void *key, size_t keyLen)
+__attribute__((target("vaes,avx2")))
+static void _BRAESVAESBlocks(const BRAESKey *key, uint8_t *out, const uint8_t *in, size_t count, int decrypt)
 {
-    uint8_t k[256];
-    
-    assert(buf16 != NULL);
+    const uint32_t *rk = (decrypt) ? key->dk : key->rk;
+    __m256i k[15], b[4];
+    unsigned i, j, r = key->rounds;
+
+    for (i = 0; i <= r; i++) k[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)&rk[i*4]));
+
+    for (; count >= 8; count -= 8, in += 128, out += 128) {
+        for (j = 0; j < 4; j++) b[j] = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&in[j*32]), k[0]);
+
+        if (! decrypt) {
+            for (i = 1; i < r; i++) for (j = 0; j < 4; j++) b[j] = _mm256_aesenc_epi128(b[j], k[i]);
+            for (j = 0; j < 4; j++) b[j] = _mm256_aesenclast_epi128(b[j], k[r]);
+        }
+        else {
+            for (i = 1; i < r; i++) for (j = 0; j < 4; j++) b[j] = _mm256_aesdec_epi128(b[j], k[i]);
+            for (j = 0; j < 4; j++) b[j] = _mm256_aesdeclast_epi128(b[j], k[r]);
+        }
+
+        for (j = 0; j < 4; j++) _mm256_storeu_si256((__m256i *)&out[j*32], b[j]);
+    }
+
+    if (count > 0) _BRAESNIBlocks(key, out, in, count, decrypt);
+}
+
+__attribute__((target("aes,sse2")))
+static void _BRAESNIDecryptKeys(BRAESKey *key)
+{
+    unsigned i, r = key->rounds;
+
+    // round keys for the equivalent inverse cipher, in reverse order with inverse mix columns applied to the middle ones
+    memcpy(key->dk, &key->rk[r*4], 16);
+    for (i = 1; i < r; i++) {
+        _mm_storeu_si128((__m128i *)&key->dk[i*4],
+                         _mm_aesimc_si128(_mm_loadu_si128((const __m128i *)&key->rk[(r - i)*4])));
+    }
+    memcpy(&key->dk[r*4], key->rk, 16);
+}
+#endif
+
+static int _BRAESImpl(int impl)
+{
+    int cpu = _BRCPUFeatures(), best = AES_IMPL_CT;
+
+    if (cpu & CPU_AES) best = (cpu & CPU_VAES) ? AES_IMPL_VAES : AES_IMPL_NI;
+    return (impl < 0 || impl > best) ? best : impl;
+}
+
+// expands key using the given implementation, or the best available if impl is negative or unavailable
+// returns the implementation used
+int _BRAESKeyInitImpl(BRAESKey *key, const void *key16, size_t keyLen, int impl)
+{
+    static const uint8_t rcon[] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+    unsigned i, j, nk = (unsigned)keyLen/4, n;
+    uint32_t t;
+
     assert(key != NULL);
+    assert(key16 != NULL);
     assert(keyLen == 16 || keyLen == 24 || keyLen == 32);
-    
-    _BRAESExpandKey(k, key, keyLen);
-    _BRAESCipher(buf16, k, keyLen);
-    mem_clean(k, sizeof(k));
+
+    key->impl = _BRAESImpl(impl);
+    key->rounds = nk + 6;
+    n = (key->rounds + 1)*4;
+
+    for (i = 0; i < nk; i++) key->rk[i] = _le32dec((const uint8_t *)key16 + i*4);
+
+    for (i = nk, t = key->rk[nk - 1]; i < n; i++) { // round words are little endian, so rotate right for RotWord
+        if (i % nk == 0) t = _BRAESSubWord((t << 24) | (t >> 8)) ^ rcon[i/nk - 1];
+        else if (nk > 6 && i % nk == 4) t = _BRAESSubWord(t);
+        t ^= key->rk[i - nk];
+        key->rk[i] = t;
+    }
+
+    if (key->impl == AES_IMPL_CT) { // each round key is spread over eight bit planes, repeated for all four blocks
+        for (i = 0; i < n; i += 4) {
+            uint64_t q[8], x[2];
+
+            _BRAESInterleaveIn(&q[0], &q[4], &key->rk[i]);
+            q[1] = q[2] = q[3] = q[0], q[5] = q[6] = q[7] = q[4];
+            _BRAESOrtho(q);
+            x[0] = (q[0] & 0x1111111111111111ULL) | (q[1] & 0x2222222222222222ULL) |
+                   (q[2] & 0x4444444444444444ULL) | (q[3] & 0x8888888888888888ULL);
+            x[1] = (q[4] & 0x1111111111111111ULL) | (q[5] & 0x2222222222222222ULL) |
+                   (q[6] & 0x4444444444444444ULL) | (q[7] & 0x8888888888888888ULL);
+
+            for (j = 0; j < 8; j++) {
+                uint64_t y = (x[j/4] & (0x1111111111111111ULL << (j % 4))) >> (j % 4);
+
+                key->sk[i*2 + j] = (y << 4) - y;
+            }
+
+            mem_clean(q, sizeof(q));
+        }
+    }
+#if BR_X86
+    else _BRAESNIDecryptKeys(key);
+#endif
+
+    var_clean(&t);
+    return key->impl;
 }
 
-void BRAESECBDecrypt(void *buf16, const void *key, size_t keyLen)
+static void _BRAESBlocks(const BRAESKey *key, uint8_t *out, const uint8_t *in, size_t count, int decrypt)
+{
+#if BR_X86
+    if (key->impl == AES_IMPL_VAES) _BRAESVAESBlocks(key, out, in, count, decrypt);
+    else if (key->impl == AES_IMPL_NI) _BRAESNIBlocks(key, out, in, count, decrypt);
+    else
+#endif
+    for (; count > 0; count -= (count < 4) ? count : 4, in += 64, out += 64) {
+        _BRAESCTBlocks(key, out, in, (count < 4) ? count : 4, decrypt);
+    }
+}
+
+// expands an aes key schedule for keyLen of 16, 24 or 32 bytes
+void BRAESKeyInit(BRAESKey *key, const void *key16, size_t keyLen)
+{
+    _BRAESKeyInitImpl(key, key16, keyLen, -1);
+}
+
+// clears the key schedule from memory
+void BRAESKeyClean(BRAESKey *key)
 {
-    uint8_t k[256];
-    
-    assert(buf16 != NULL);
     assert(key != NULL);
-    assert(keyLen == 16 || keyLen == 24 || keyLen == 32);
-    
-    _BRAESExpandKey(k, key, keyLen);
-    _BRAESDecipher(buf16, k, keyLen);
-    mem_clean(k, sizeof(k));
+    mem_clean(key, sizeof(*key));
 }
 
-// aes-ctr stream cipher encrypt/decrypt
-void BRAESCTR(void *out, const void *key, size_t keyLen, const void *iv16, const void *data, size_t dataLen)
+// aes-ecb encrypts blockCount 16 byte blocks, out may be the same as in
+void BRAESKeyECBEncrypt(const BRAESKey *key, void *out, const void *in, size_t blockCount)
 {
-    uint8_t x[16], iv[16], k[256];
-    size_t off, i;
-    
-    assert(out != NULL);
     assert(key != NULL);
-    assert(keyLen == 16 || keyLen == 24 || keyLen == 32);
+    assert((out != NULL && in != NULL) || blockCount == 0);
+    _BRAESBlocks(key, out, in, blockCount, 0);
+}
+
+// aes-ecb decrypts blockCount 16 byte blocks, out may be the same as in
+void BRAESKeyECBDecrypt(const BRAESKey *key, void *out, const void *in, size_t blockCount)
+{
+    assert(key != NULL);
+    assert((out != NULL && in != NULL) || blockCount == 0);
+    _BRAESBlocks(key, out, in, blockCount, 1);
+}
+
+// aes-ctr stream cipher encrypt/decrypt, the 16 byte counter starts at iv16 and is incremented as a big endian integer
+void BRAESKeyCTR(const BRAESKey *key, void *out, const void *iv16, const void *data, size_t dataLen)
+{
+    uint8_t ctr[AES_CTR_BLOCKS*16], iv[16];
+    size_t off, len, i, j;
+
+    assert(key != NULL);
+    assert(out != NULL || dataLen == 0);
     assert(iv16 != NULL);
     assert(data != NULL || dataLen == 0);
-    
+
     memcpy(iv, iv16, 16);
-    _BRAESExpandKey(k, key, keyLen);
-    
-    for (off = 0; off < dataLen; off++) {
-        if ((off % 16) == 0) { // generate xor compliment
-            memcpy(x, iv, 16);
-            _BRAESCipher(x, k, keyLen);
-            i = 16;
-            do { iv[--i]++; } while (iv[i] == 0 && i > 0); // increment iv with overflow
+
+    for (off = 0; off < dataLen; off += len) {
+        len = (dataLen - off < sizeof(ctr)) ? dataLen - off : sizeof(ctr);
+
+        for (i = 0; i < len; i += 16) { // generate xor compliment
+            memcpy(&ctr[i], iv, 16);
+            j = 16;
+            do { iv[--j]++; } while (iv[j] == 0 && j > 0); // increment iv with overflow
         }
-        
-        ((uint8_t *)out)[off] = (((uint8_t *)data)[off] ^ x[off % 16]);
+
+        _BRAESBlocks(key, ctr, ctr, (len + 15)/16, 0);
+
+        for (i = 0; i + 8 <= len; i += 8) {
+            uint64_t x, y;
+
+            memcpy(&x, (const uint8_t *)data + off + i, 8);
+            memcpy(&y, &ctr[i], 8);
+            x ^= y;
+            memcpy((uint8_t *)out + off + i, &x, 8);
+        }
+
+        for (; i < len; i++) ((uint8_t *)out)[off + i] = ((const uint8_t *)data)[off + i] ^ ctr[i];
     }
-    
-    mem_clean(k, sizeof(k));
-    mem_clean(x, sizeof(x));
+
+    mem_clean(ctr, sizeof(ctr));
+}
+
+// aes-ecb block cipher
+void BRAESECBEncrypt(void *buf16, const void *key, size_t keyLen)
+{
+    BRAESKey k;
+
+    assert(buf16 != NULL);
+    BRAESKeyInit(&k, key, keyLen);
+    BRAESKeyECBEncrypt(&k, buf16, buf16, 1);
+    BRAESKeyClean(&k);
+}
+
+void BRAESECBDecrypt(void *buf16, const void *key, size_t keyLen)
+{
+    BRAESKey k;
+
+    assert(buf16 != NULL);
+    BRAESKeyInit(&k, key, keyLen);
+    BRAESKeyECBDecrypt(&k, buf16, buf16, 1);
+    BRAESKeyClean(&k);
+}
+
+// aes-ctr stream cipher encrypt/decrypt
+void BRAESCTR(void *out, const void *key, size_t keyLen, const void *iv16, const void *data, size_t dataLen)
+{
+    BRAESKey k;
+
+    BRAESKeyInit(&k, key, keyLen);
+    BRAESKeyCTR(&k, out, iv16, data, dataLen);
+    BRAESKeyClean(&k);
 }
 // aes-ctr stream cipher encrypt/decrypt
 void BRAESCTR_OFFSET(void *out, size_t outLen, const void *key, size_t keyLen, void *iv16, const void *data, size_t dataLen)
 {
-    uint8_t x[16], iv[16], k[256];
+    uint8_t x[16], iv[16];
     size_t off, i, outIdx = 0;
-    
+    BRAESKey k;
+
     assert(out != NULL);
-    assert(key != NULL);
-    assert(keyLen == 16 || keyLen == 24 || keyLen == 32);
     assert(iv16 != NULL);
     assert(data != NULL || dataLen == 0);
-    
+
     memcpy(iv, iv16, 16);
-    _BRAESExpandKey(k, key, keyLen);
-    
+    BRAESKeyInit(&k, key, keyLen);
+
     for (off = (dataLen - outLen); off < dataLen; off++, outIdx++) {
         if ((off % 16) == 0) { // generate xor compliment
-            memcpy(x, iv, 16);
-            _BRAESCipher(x, k, keyLen);
+            BRAESKeyECBEncrypt(&k, x, iv, 1);
             i = 16;
             do { iv[--i]++; } while (iv[i] == 0 && i > 0); // increment iv with overflow
         }
         ((uint8_t *)out)[outIdx] = (((uint8_t *)data)[outIdx] ^ x[outIdx % 16]);
     }
     memcpy(iv16, iv, 16);
-    mem_clean(k, sizeof(k));
+    BRAESKeyClean(&k);
     mem_clean(x, sizeof(x));
 }
 
@@ -1144,21 +1987,21 @@ static void _salsa20_8(uint32_t b[16])
 {
     uint32_t x0 = b[0], x1 = b[1], x2 = b[2],  x3 = b[3],  x4 = b[4],  x5 = b[5],  x6 = b[6],  x7 = b[7],
              x8 = b[8], x9 = b[9], xa = b[10], xb = b[11], xc = b[12], xd = b[13], xe = b[14], xf = b[15];
-    
+
     for (unsigned i = 0; i < 8; i += 2) {
         // operate on columns
         x4 ^= rol32(x0 + xc, 7), x8 ^= rol32(x4 + x0, 9), xc ^= rol32(x8 + x4, 13), x0 ^= rol32(xc + x8, 18);
         x9 ^= rol32(x5 + x1, 7), xd ^= rol32(x9 + x5, 9), x1 ^= rol32(xd + x9, 13), x5 ^= rol32(x1 + xd, 18);
         xe ^= rol32(xa + x6, 7), x2 ^= rol32(xe + xa, 9), x6 ^= rol32(x2 + xe, 13), xa ^= rol32(x6 + x2, 18);
         x3 ^= rol32(xf + xb, 7), x7 ^= rol32(x3 + xf, 9), xb ^= rol32(x7 + x3, 13), xf ^= rol32(xb + x7, 18);
-        
+
         // operate on rows
         x1 ^= rol32(x0 + x3, 7), x2 ^= rol32(x1 + x0, 9), x3 ^= rol32(x2 + x1, 13), x0 ^= rol32(x3 + x2, 18);
         x6 ^= rol32(x5 + x4, 7), x7 ^= rol32(x6 + x5, 9), x4 ^= rol32(x7 + x6, 13), x5 ^= rol32(x4 + x7, 18);
         xb ^= rol32(xa + x9, 7), x8 ^= rol32(xb + xa, 9), x9 ^= rol32(x8 + xb, 13), xa ^= rol32(x9 + x8, 18);
         xc ^= rol32(xf + xe, 7), xd ^= rol32(xc + xf, 9), xe ^= rol32(xd + xc, 13), xf ^= rol32(xe + xd, 18);
     }
-    
+
     b[0] += x0, b[1] += x1, b[2] += x2,  b[3] += x3,  b[4] += x4,  b[5] += x5,  b[6] += x6,  b[7] += x7;
     b[8] += x8, b[9] += x9, b[10] += xa, b[11] += xb, b[12] += xc, b[13] += xd, b[14] += xe, b[15] += xf;
 }
@@ -1166,7 +2009,7 @@ static void _salsa20_8(uint32_t b[16])
 static void _blockmix_salsa8(uint64_t *dest, const uint64_t *src, uint64_t *b, unsigned r)
 {
     memcpy(b, &src[(2*r - 1)*8], 64);
-    
+
     for (unsigned i = 0; i < 2*r; i += 2) {
         for (unsigned j = 0; j < 8; j++) b[j] ^= src[i*8 + j];
         _salsa20_8((uint32_t *)b);
@@ -1177,50 +2020,199 @@ static void _blockmix_salsa8(uint64_t *dest, const uint64_t *src, uint64_t *b, u
     }
 }
 
-// scrypt key derivation: http://www.tarsnap.com/scrypt.html
-void BRScrypt(void *dk, size_t dkLen, const void *pw, size_t pwLen, const void *salt, size_t saltLen,
-              unsigned n, unsigned r, unsigned p)
+// scrypt romix on one 128*r byte lane of b, using v as 128*r*n bytes of scratch space
+static void _BRScryptLane(uint32_t *b, uint64_t *v, unsigned n, unsigned r)
+{
+    uint64_t x[16*r], y[16*r], z[8], m;
+
+    for (unsigned j = 0; j < 32*r; j++) ((uint32_t *)x)[j] = le32(b[j]);
+
+    for (unsigned j = 0; j < n; j += 2) {
+        memcpy(&v[j*(16*r)], x, 128*r);
+        _blockmix_salsa8(y, x, z, r);
+        memcpy(&v[(j + 1)*(16*r)], y, 128*r);
+        _blockmix_salsa8(x, y, z, r);
+    }
+
+    for (unsigned j = 0; j < n; j += 2) {
+        m = le64(x[(2*r - 1)*8]) & (n - 1);
+        for (unsigned k = 0; k < 16*r; k++) x[k] ^= v[m*(16*r) + k];
+        _blockmix_salsa8(y, x, z, r);
+        m = le64(y[(2*r - 1)*8]) & (n - 1);
+        for (unsigned k = 0; k < 16*r; k++) y[k] ^= v[m*(16*r) + k];
+        _blockmix_salsa8(x, y, z, r);
+    }
+
+    for (unsigned j = 0; j < 32*r; j++) b[j] = le32(((uint32_t *)x)[j]);
+    mem_clean(x, sizeof(x));
+    mem_clean(y, sizeof(y));
+    mem_clean(z, sizeof(z));
+}
+
+#if BR_X86
+// the sse2 lane keeps each 64 byte salsa block with its words permuted so that word i is at (i*5) % 16, which lines
+// the diagonals up in the four vectors and lets the rows be reached with shuffles, as in tarsnap's scrypt-sse.c
+#define arx(o, a, b, s) do {\
+    __m128i _t = _mm_add_epi32(a, b);\
+    (o) = _mm_xor_si128(_mm_xor_si128(o, _mm_slli_epi32(_t, s)), _mm_srli_epi32(_t, 32 - (s)));\
+} while (0)
+
+__attribute__((target("sse2")))
+static void _blockmix_salsa8_sse2(__m128i *dest, const __m128i *src, unsigned r)
+{
+    __m128i x0 = src[(2*r - 1)*4], x1 = src[(2*r - 1)*4 + 1], x2 = src[(2*r - 1)*4 + 2], x3 = src[(2*r - 1)*4 + 3],
+            y0, y1, y2, y3;
+
+    for (unsigned i = 0; i < 2*r; i++) {
+        x0 = _mm_xor_si128(x0, src[i*4]), x1 = _mm_xor_si128(x1, src[i*4 + 1]);
+        x2 = _mm_xor_si128(x2, src[i*4 + 2]), x3 = _mm_xor_si128(x3, src[i*4 + 3]);
+        y0 = x0, y1 = x1, y2 = x2, y3 = x3;
+
+        for (unsigned j = 0; j < 8; j += 2) {
+            // operate on columns
+            arx(x1, x0, x3, 7); arx(x2, x1, x0, 9); arx(x3, x2, x1, 13); arx(x0, x3, x2, 18);
+            x1 = _mm_shuffle_epi32(x1, 0x93), x2 = _mm_shuffle_epi32(x2, 0x4e), x3 = _mm_shuffle_epi32(x3, 0x39);
+
+            // operate on rows
+            arx(x3, x0, x1, 7); arx(x2, x3, x0, 9); arx(x1, x2, x3, 13); arx(x0, x1, x2, 18);
+            x1 = _mm_shuffle_epi32(x1, 0x39), x2 = _mm_shuffle_epi32(x2, 0x4e), x3 = _mm_shuffle_epi32(x3, 0x93);
+        }
+
+        x0 = _mm_add_epi32(x0, y0), x1 = _mm_add_epi32(x1, y1), x2 = _mm_add_epi32(x2, y2), x3 = _mm_add_epi32(x3, y3);
+
+        // even blocks go to the first half of dest and odd blocks to the second
+        __m128i *d = &dest[((i % 2) ? r + i/2 : i/2)*4];
+
+        d[0] = x0, d[1] = x1, d[2] = x2, d[3] = x3;
+    }
+}
+
+__attribute__((target("sse2")))
+static void _BRScryptLaneSSE2(uint32_t *b, uint64_t *v, unsigned n, unsigned r)
+{
+    __m128i x[8*r], y[8*r], *w = (__m128i *)v;
+    uint32_t *p = (uint32_t *)x;
+    uint64_t m;
+
+    for (unsigned k = 0; k < 2*r; k++) { // x86 is little endian, so the words need no byte swapping
+        for (unsigned i = 0; i < 16; i++) p[k*16 + i] = b[k*16 + (i*5) % 16];
+    }
+
+    for (unsigned j = 0; j < n; j += 2) {
+        for (unsigned k = 0; k < 8*r; k++) _mm_storeu_si128(&w[j*(8*r) + k], x[k]);
+        _blockmix_salsa8_sse2(y, x, r);
+        for (unsigned k = 0; k < 8*r; k++) _mm_storeu_si128(&w[(j + 1)*(8*r) + k], y[k]);
+        _blockmix_salsa8_sse2(x, y, r);
+    }
+
+    // word 0 stays in place and word 1 moves to 13, so the integerify value is read from those two
+    for (unsigned j = 0; j < n; j += 2) {
+        p = (uint32_t *)&x[(2*r - 1)*4];
+        m = (p[0] | ((uint64_t)p[13] << 32)) & (n - 1);
+        for (unsigned k = 0; k < 8*r; k++) x[k] = _mm_xor_si128(x[k], _mm_loadu_si128(&w[m*(8*r) + k]));
+        _blockmix_salsa8_sse2(y, x, r);
+        p = (uint32_t *)&y[(2*r - 1)*4];
+        m = (p[0] | ((uint64_t)p[13] << 32)) & (n - 1);
+        for (unsigned k = 0; k < 8*r; k++) y[k] = _mm_xor_si128(y[k], _mm_loadu_si128(&w[m*(8*r) + k]));
+        _blockmix_salsa8_sse2(x, y, r);
+    }
+
+    p = (uint32_t *)x;
+
+    for (unsigned k = 0; k < 2*r; k++) {
+        for (unsigned i = 0; i < 16; i++) b[k*16 + (i*5) % 16] = p[k*16 + i];
+    }
+
+    mem_clean(x, sizeof(x));
+    mem_clean(y, sizeof(y));
+}
+#endif
+
+#define SCRYPT_THREADS    4                  // max worker threads used by BRScrypt()
+#define SCRYPT_MEMORY_MAX (64*1024*1024)     // max total scratch space for lanes run in parallel
+
+typedef struct {
+    uint32_t *b;
+    unsigned n, r, start, end, simd;
+} _BRScryptJob;
+
+// runs lanes start to end - 1 of job->b one after another, sharing one scratch space
+static void *_BRScryptRoutine(void *arg)
+{
+    _BRScryptJob *job = arg;
+    uint64_t *v = (job->start < job->end) ? malloc(128*job->r*job->n) : NULL;
+
+    assert(v != NULL || job->start >= job->end);
+
+    for (unsigned i = job->start; i < job->end; i++) {
+#if BR_X86
+        if (job->simd) _BRScryptLaneSSE2(&job->b[i*32*job->r], v, job->n, job->r);
+        else
+#endif
+        _BRScryptLane(&job->b[i*32*job->r], v, job->n, job->r);
+    }
+
+    if (v) mem_clean(v, 128*job->r*job->n);
+    if (v) free(v);
+    return NULL;
+}
+
+// scrypt with at most threadCount threads, with sse2 salsa20/8 if simd is true and available, for tests
+void _BRScryptImpl(void *dk, size_t dkLen, const void *pw, size_t pwLen, const void *salt, size_t saltLen,
+                   unsigned n, unsigned r, unsigned p, unsigned threadCount, int simd)
 {
-    uint64_t x[16*r], y[16*r], z[8], *v = malloc(128*r*n), m;
     uint32_t b[32*r*p];
-    
-    assert(v != NULL);
+    size_t laneSize = (size_t)128*r*n;
+    unsigned i, per;
+
     assert(dk != NULL || dkLen == 0);
     assert(pw != NULL || pwLen == 0);
     assert(salt != NULL || saltLen == 0);
     assert(n > 0);
     assert(r > 0);
     assert(p > 0);
-    
+
+    // the p lanes are independent, each thread runs its share of them using its own 128*r*n bytes of scratch space
+    if (threadCount > p) threadCount = p;
+    if (threadCount > SCRYPT_MEMORY_MAX/laneSize) threadCount = (unsigned)(SCRYPT_MEMORY_MAX/laneSize);
+    if (threadCount < 1) threadCount = 1;
+    per = (p + threadCount - 1)/threadCount;
+
+    _BRScryptJob jobs[threadCount];
+    pthread_t threads[threadCount];
+    int started[threadCount];
+
     BRPBKDF2(b, sizeof(b), BRSHA256, 256/8, pw, pwLen, salt, saltLen, 1);
-    
-    for (unsigned i = 0; i < p; i++) {
-        for (unsigned j = 0; j < 32*r; j++) ((uint32_t *)x)[j] = le32(b[i*32*r + j]);
-        
-        for (unsigned j = 0; j < n; j += 2) {
-            memcpy(&v[j*(16*r)], x, 128*r);
-            _blockmix_salsa8(y, x, z, r);
-            memcpy(&v[(j + 1)*(16*r)], y, 128*r);
-            _blockmix_salsa8(x, y, z, r);
-        }
-        
-        for (unsigned j = 0; j < n; j += 2) {
-            m = le64(x[(2*r - 1)*8]) & (n - 1);
-            for (unsigned k = 0; k < 16*r; k++) x[k] ^= v[m*(16*r) + k];
-            _blockmix_salsa8(y, x, z, r);
-            m = le64(y[(2*r - 1)*8]) & (n - 1);
-            for (unsigned k = 0; k < 16*r; k++) y[k] ^= v[m*(16*r) + k];
-            _blockmix_salsa8(x, y, z, r);
-        }
-        
-        for (unsigned j = 0; j < 32*r; j++) b[i*32*r + j] = le32(((uint32_t *)x)[j]);
+
+    for (i = 0; i < threadCount; i++) {
+        unsigned start = i*per, end = (start + per < p) ? start + per : p;
+
+        jobs[i] = (_BRScryptJob) { b, n, r, (start < end) ? start : end, end, simd && (_BRCPUFeatures() & CPU_SSE2) };
+        // the first share runs on the calling thread, as does any share whose thread couldn't be created
+        started[i] = (i > 0 && pthread_create(&threads[i], NULL, _BRScryptRoutine, &jobs[i]) == 0);
     }
-    
+
+    _BRScryptRoutine(&jobs[0]);
+
+    for (i = 1; i < threadCount; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else _BRScryptRoutine(&jobs[i]);
+    }
+
     BRPBKDF2(dk, dkLen, BRSHA256, 256/8, pw, pwLen, b, sizeof(b), 1);
     mem_clean(b, sizeof(b));
-    mem_clean(x, sizeof(x));
-    mem_clean(y, sizeof(y));
-    mem_clean(z, sizeof(z));
-    mem_clean(v, 128*r*n);
-    free(v);
+}
+
+// scrypt key derivation: http://www.tarsnap.com/scrypt.html
+void BRScrypt(void *dk, size_t dkLen, const void *pw, size_t pwLen, const void *salt, size_t saltLen,
+              unsigned n, unsigned r, unsigned p)
+{
+    _BRScryptImpl(dk, dkLen, pw, pwLen, salt, saltLen, n, r, p, SCRYPT_THREADS, 1);
+}
+
+// scrypt key derivation running the p lanes on at most threadCount threads, for callers that run several at once
+void BRScryptThreads(void *dk, size_t dkLen, const void *pw, size_t pwLen, const void *salt, size_t saltLen,
+                     unsigned n, unsigned r, unsigned p, unsigned threadCount)
+{
+    _BRScryptImpl(dk, dkLen, pw, pwLen, salt, saltLen, n, r, p, threadCount, 1);
 }
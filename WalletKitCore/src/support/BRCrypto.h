@@ -44,6 +44,10 @@ void BRSHA224(void *md28, const void *data, size_t dataLen);
 // double-sha-256 = sha-256(sha-256(x))
 void BRSHA256_2(void *md32, const void *data, size_t dataLen);
 
+// double-sha-256 of count messages, writing each 32 byte digest to md32s in order, hashes four or eight messages in
+// parallel with sse2 or avx2 when the cpu supports them
+void BRSHA256_2Batch(void *md32s, const void *data[], const size_t dataLen[], size_t count);
+
 void BRSHA384(void *md48, const void *data, size_t dataLen);
 
 void BRSHA512(void *md64, const void *data, size_t dataLen);
@@ -92,6 +96,30 @@ size_t BRChacha20Poly1305AEADEncrypt(void *out, size_t outLen, const void *key32
 size_t BRChacha20Poly1305AEADDecrypt(void *out, size_t outLen, const void *key32, const void *nonce12,
                                      const void *data, size_t dataLen, const void *ad, size_t adLen);
     
+// expanded aes key schedule, reused across calls to avoid re-expanding the key for each block
+typedef struct {
+    uint32_t rk[60]; // encryption round keys
+    uint32_t dk[60]; // decryption round keys, for the aes-ni and vaes implementations
+    uint64_t sk[120]; // bitsliced round keys, for the constant time implementation
+    unsigned rounds;
+    int impl;
+} BRAESKey;
+
+// expands an aes key schedule for keyLen of 16, 24 or 32 bytes, uses aes-ni or vaes when the cpu supports them and a
+// constant time bitsliced implementation otherwise, call BRAESKeyClean() when done
+void BRAESKeyInit(BRAESKey *key, const void *key16, size_t keyLen);
+
+// clears the key schedule from memory
+void BRAESKeyClean(BRAESKey *key);
+
+// aes-ecb encrypt/decrypt of blockCount 16 byte blocks, out may be the same as in
+void BRAESKeyECBEncrypt(const BRAESKey *key, void *out, const void *in, size_t blockCount);
+
+void BRAESKeyECBDecrypt(const BRAESKey *key, void *out, const void *in, size_t blockCount);
+
+// aes-ctr stream cipher encrypt/decrypt, the 16 byte counter starts at iv16 and is incremented as a big endian integer
+void BRAESKeyCTR(const BRAESKey *key, void *out, const void *iv16, const void *data, size_t dataLen);
+
 // aes-ecb block cipher
 void BRAESECBEncrypt(void *buf16, const void *key, size_t keyLen);
 
@@ -105,9 +133,14 @@ void BRPBKDF2(void *dk, size_t dkLen, void (*hash)(void *, const void *, size_t)
               const void *pw, size_t pwLen, const void *salt, size_t saltLen, unsigned rounds);
 
 // scrypt key derivation: http://www.tarsnap.com/scrypt.html
+// the p parallel lanes run on up to four threads, each with 128*r*n bytes of scratch space, limited to 64MB in total
 void BRScrypt(void *dk, size_t dkLen, const void *pw, size_t pwLen, const void *salt, size_t saltLen,
               unsigned n, unsigned r, unsigned p);
 
+// scrypt with the p lanes run on at most threadCount threads, for callers that already run several derivations at once
+void BRScryptThreads(void *dk, size_t dkLen, const void *pw, size_t pwLen, const void *salt, size_t saltLen,
+                     unsigned n, unsigned r, unsigned p, unsigned threadCount);
+
 // zeros out memory in a way that can't be optimized out by the compiler
 inline static void mem_clean(void *ptr, size_t len)
 {
@@ -107,7 +107,7 @@ size_t BRKeyECIESAES128SHA256Decrypt(BRKey *privKey, void *out, size_t outLen, c
 
 // Pigeon Encrypted Message Exchange
 
-static void BRKeyPigeonSharedKey(BRKey *privKey, uint8_t *out32, BRKey *pubKey)
+void BRKeyPigeonSharedKey(BRKey *privKey, void *out32, BRKey *pubKey)
 {
     uint8_t x[32];
     BRKeyECDH(privKey, x, pubKey);
@@ -43,6 +43,10 @@ size_t BRKeyECIESAES128SHA256Decrypt(BRKey *privKey, void *out, size_t outLen, c
 // Generates a pairing key using HMAC_DRBG with the local private key as entropy and SHA256(identifier) as the nonce.
 void BRKeyPigeonPairingKey(BRKey *privKey, BRKey *outPairingKey, const void *identifier, size_t identifierSize);
 
+// sha256 of the ECDH shared secret of privKey and pubKey, the chacha20-poly1305 key used by BRKeyPigeonEncrypt() and
+// BRKeyPigeonDecrypt(), callers that keep it to encrypt several messages must mem_clean() it when done
+void BRKeyPigeonSharedKey(BRKey *privKey, void *out32, BRKey *pubKey);
+
 // chacha20-poly1305 authenticated encryption with associated data (AEAD): https://tools.ietf.org/html/rfc7539
 // with shared key derived from privKey and pubKey using ECDH
 // call with NULL out parameter to get the expected output size returned
@@ -23,6 +23,10 @@
 //  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 //  THE SOFTWARE.
 
+#if defined (__linux__) && !defined (_GNU_SOURCE)
+#define _GNU_SOURCE         // pthread_rwlockattr_setkind_np()
+#endif
+
 #include "BROSCompat.h"
 #include "time.h"
 #include "sys/time.h"
@@ -54,6 +58,24 @@ pthread_mutex_init_brd (pthread_mutex_t *mutex, int type) {
     return result;
 }
 
+extern int
+pthread_rwlock_init_brd (pthread_rwlock_t *lock) {
+#if defined (__ANDROID__) || defined (__linux__)
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+
+    int result = pthread_rwlock_init(lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    return result;
+#elif defined (__APPLE__)
+    return pthread_rwlock_init(lock, NULL); // darwin rwlocks already favor writers
+#else
+#  error Undefined pthread_rwlock_init_brd()
+#endif
+}
+
 extern void
 pthread_yield_brd (void) {
 #if defined (__ANDROID__) || defined (__linux__)
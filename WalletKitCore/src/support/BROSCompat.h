@@ -59,6 +59,10 @@ pthread_setname_brd(pthread_t,  const char *name);
 extern int
 pthread_mutex_init_brd (pthread_mutex_t *mutex, int type);
 
+// a reader-writer lock that favors writers, so a steady stream of readers can't starve them
+extern int
+pthread_rwlock_init_brd (pthread_rwlock_t *lock);
+
 extern void
 pthread_yield_brd (void);
 
@@ -10,7 +10,116 @@
 
 #include "WKBaseP.h"
 
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "support/BRCrypto.h"
+#include "support/BROSCompat.h"
+#include "support/BRSet.h"
+
 extern void
 wkMemoryFreeExtern (void *memory) {
     wkMemoryFree(memory);
 }
+
+// MARK: - String Intern
+
+typedef struct {
+    size_t hash;
+    size_t references;
+    const char *string;     // points just past this struct
+} WKStringInternEntry;
+
+static size_t
+wkStringInternEntryHash (const WKStringInternEntry *entry) {
+    return entry->hash;
+}
+
+static int
+wkStringInternEntryIsEqual (const WKStringInternEntry *entry1,
+                            const WKStringInternEntry *entry2) {
+    return entry1->hash == entry2->hash && 0 == strcmp (entry1->string, entry2->string);
+}
+
+static pthread_once_t  wkStringInternOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t wkStringInternLock;
+static BRSetOf(WKStringInternEntry*) wkStringInternEntries = NULL;
+
+static void
+wkStringInternInit (void) {
+    pthread_mutex_init_brd (&wkStringInternLock, PTHREAD_MUTEX_NORMAL);
+    wkStringInternEntries = BRSetNew ((size_t (*) (const void *)) wkStringInternEntryHash,
+                                      (int (*) (const void *, const void *)) wkStringInternEntryIsEqual,
+                                      1024);
+}
+
+static inline WKStringInternEntry *
+wkStringInternGetEntry (const char *interned) {
+    return ((WKStringInternEntry *) interned) - 1;
+}
+
+extern const char *
+wkStringIntern (const char *string) {
+    if (NULL == string) return NULL;
+
+    pthread_once (&wkStringInternOnce, wkStringInternInit);
+
+    size_t stringLength = strlen (string);
+    WKStringInternEntry probe = { BRMurmur3_32 (string, stringLength, 0), 0, string };
+
+    pthread_mutex_lock (&wkStringInternLock);
+    WKStringInternEntry *entry = BRSetGet (wkStringInternEntries, &probe);
+
+    if (NULL == entry) {
+        entry = malloc (sizeof (WKStringInternEntry) + stringLength + 1);
+        entry->hash       = probe.hash;
+        entry->references = 0;
+        entry->string     = memcpy ((char *) (entry + 1), string, stringLength + 1);
+
+        BRSetAdd (wkStringInternEntries, entry);
+    }
+
+    entry->references += 1;
+    pthread_mutex_unlock (&wkStringInternLock);
+
+    return entry->string;
+}
+
+extern const char *
+wkStringInternTake (const char *interned) {
+    if (NULL == interned) return NULL;
+
+    pthread_mutex_lock (&wkStringInternLock);
+    wkStringInternGetEntry(interned)->references += 1;
+    pthread_mutex_unlock (&wkStringInternLock);
+
+    return interned;
+}
+
+extern void
+wkStringInternGive (const char *interned) {
+    if (NULL == interned) return;
+
+    WKStringInternEntry *entry = wkStringInternGetEntry (interned);
+
+    pthread_mutex_lock (&wkStringInternLock);
+    assert (entry->references > 0);
+
+    if (0 == --entry->references) {
+        BRSetRemove (wkStringInternEntries, entry);
+        free (entry);
+    }
+    pthread_mutex_unlock (&wkStringInternLock);
+}
+
+extern size_t
+wkStringInternCount (void) {
+    pthread_once (&wkStringInternOnce, wkStringInternInit);
+
+    pthread_mutex_lock (&wkStringInternLock);
+    size_t count = BRSetCount (wkStringInternEntries);
+    pthread_mutex_unlock (&wkStringInternLock);
+
+    return count;
+}
@@ -32,5 +32,28 @@
   *__ptr = (rval);                          \
 } while (0)
 
+/// MARK: - String Intern
+///
+/// A process-wide, thread-safe table of reference counted, immutable strings.  Interning equal
+/// strings returns the identical pointer; thus interned strings compare with `==` and are stored
+/// once no matter how many holders there are.  Intended for short strings that repeat across
+/// many objects - currency uids and codes, addresses, transaction and block hashes.
+///
+/// Every `wkStringIntern()` or `wkStringInternTake()` must be balanced by `wkStringInternGive()`.
+/// All three accept NULL and return NULL for it.
+
+private_extern OwnershipGiven const char *
+wkStringIntern (const char *string);
+
+private_extern OwnershipGiven const char *
+wkStringInternTake (const char *interned);
+
+private_extern void
+wkStringInternGive (OwnershipGiven const char *interned);
+
+/// The number of distinct strings currently interned.  For testing.
+private_extern size_t
+wkStringInternCount (void);
+
 
 #endif /* WKBaseP_h */
@@ -10,6 +10,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "WKCipher.h"
 #include "WKKeyP.h"
@@ -17,14 +18,14 @@
 #include "support/BRBase.h"
 #include "support/BRCrypto.h"
 #include "support/BRKeyECIES.h"
+#include "support/BROSCompat.h"
 
 struct WKCipherRecord {
     WKCipherType type;
 
     union {
         struct {
-            uint8_t key[32];
-            size_t keyLen;
+            BRAESKey key;
         } aesecb;
 
         struct {
@@ -38,6 +39,7 @@ struct WKCipherRecord {
             WKKey privKey;
             WKKey pubKey;
             uint8_t nonce[12];
+            UInt256 sharedKey;
         } pigeon;
     } u;
 
@@ -46,6 +48,106 @@ struct WKCipherRecord {
 
 IMPLEMENT_WK_GIVE_TAKE (WKCipher, wkCipher);
 
+// MARK: - Pigeon Shared Key Cache
+
+// Exchanging messages with a paired device creates a cipher per message, each needing the same
+// ECDH shared key; keep the most recently used shared keys so that only the first message with
+// a device pays for the scalar multiplication.
+#define WK_CIPHER_PIGEON_CACHE_SIZE     (16)
+
+typedef struct {
+    UInt256 identifier;     // HMAC-SHA256, under `salt`, of the private key and compressed public key
+    UInt256 sharedKey;
+    uint64_t used;          // value of `clock` when last used; 0 if the entry is empty
+} WKCipherPigeonCacheEntry;
+
+static struct {
+    pthread_mutex_t lock;
+    UInt256 salt;
+    uint64_t clock;
+    WKCipherPigeonCacheEntry entries[WK_CIPHER_PIGEON_CACHE_SIZE];
+} wkCipherPigeonCache;
+
+static pthread_once_t wkCipherPigeonCacheOnce = PTHREAD_ONCE_INIT;
+
+static void
+wkCipherPigeonCacheInit (void) {
+    pthread_mutex_init (&wkCipherPigeonCache.lock, NULL);
+    arc4random_buf_brd (wkCipherPigeonCache.salt.u8, sizeof (wkCipherPigeonCache.salt));
+}
+
+static void
+wkCipherPigeonCacheEntryClear (WKCipherPigeonCacheEntry *entry) {
+    mem_clean (entry, sizeof (WKCipherPigeonCacheEntry));
+}
+
+static UInt256
+wkCipherPigeonCacheIdentifier (BRKey *privKey, BRKey *pubKey) {
+    uint8_t data[32 + 65];
+    UInt256 identifier;
+
+    // The shared key depends only on the secret and the public key's point; use the compressed
+    // form so that both encodings of a public key share an entry.
+    memcpy (data, privKey->secret.u8, 32);
+    size_t pubKeyLen = BRKeyPubKey (pubKey, &data[32], 65);
+    if (65 == pubKeyLen) { data[32] = (data[32 + 64] % 2) ? 0x03 : 0x02; pubKeyLen = 33; }
+
+    BRHMAC (identifier.u8, BRSHA256, 32, wkCipherPigeonCache.salt.u8, 32, data, 32 + pubKeyLen);
+    mem_clean (data, sizeof (data));
+    return identifier;
+}
+
+static UInt256
+wkCipherPigeonSharedKey (WKKey privKey, WKKey pubKey) {
+    pthread_once (&wkCipherPigeonCacheOnce, wkCipherPigeonCacheInit);
+
+    UInt256 identifier = wkCipherPigeonCacheIdentifier (wkKeyGetCore (privKey), wkKeyGetCore (pubKey));
+    UInt256 sharedKey  = UINT256_ZERO;
+    bool    found      = false;
+
+    pthread_mutex_lock (&wkCipherPigeonCache.lock);
+    for (size_t index = 0; index < WK_CIPHER_PIGEON_CACHE_SIZE && !found; index++) {
+        WKCipherPigeonCacheEntry *entry = &wkCipherPigeonCache.entries[index];
+        if (0 != entry->used && UInt256Eq (entry->identifier, identifier)) {
+            sharedKey   = entry->sharedKey;
+            entry->used = ++wkCipherPigeonCache.clock;
+            found       = true;
+        }
+    }
+    pthread_mutex_unlock (&wkCipherPigeonCache.lock);
+
+    if (found) { mem_clean (&identifier, sizeof (identifier)); return sharedKey; }
+
+    // Derive outside of the lock; a concurrent miss for the same keys just derives it twice.
+    BRKeyPigeonSharedKey (wkKeyGetCore (privKey), sharedKey.u8, wkKeyGetCore (pubKey));
+
+    pthread_mutex_lock (&wkCipherPigeonCache.lock);
+    WKCipherPigeonCacheEntry *victim = &wkCipherPigeonCache.entries[0];
+    for (size_t index = 0; index < WK_CIPHER_PIGEON_CACHE_SIZE; index++) {
+        WKCipherPigeonCacheEntry *entry = &wkCipherPigeonCache.entries[index];
+        if (0 != entry->used && UInt256Eq (entry->identifier, identifier)) { victim = entry; break; }
+        if (entry->used < victim->used) victim = entry;
+    }
+    wkCipherPigeonCacheEntryClear (victim);
+    victim->identifier = identifier;
+    victim->sharedKey  = sharedKey;
+    victim->used       = ++wkCipherPigeonCache.clock;
+    pthread_mutex_unlock (&wkCipherPigeonCache.lock);
+
+    mem_clean (&identifier, sizeof (identifier));
+    return sharedKey;
+}
+
+extern void
+wkCipherPigeonCacheClear (void) {
+    pthread_once (&wkCipherPigeonCacheOnce, wkCipherPigeonCacheInit);
+
+    pthread_mutex_lock (&wkCipherPigeonCache.lock);
+    for (size_t index = 0; index < WK_CIPHER_PIGEON_CACHE_SIZE; index++)
+        wkCipherPigeonCacheEntryClear (&wkCipherPigeonCache.entries[index]);
+    pthread_mutex_unlock (&wkCipherPigeonCache.lock);
+}
+
 static WKCipher
 wkCipherCreateInternal(WKCipherType type) {
     WKCipher cipher = calloc (1, sizeof(struct WKCipherRecord));
@@ -64,9 +166,8 @@ wkCipherCreateForAESECB(const uint8_t *key,
     }
 
     WKCipher cipher  = wkCipherCreateInternal (WK_CIPHER_AESECB);
-    // aesecb.key initialized to zero via calloc
-    memcpy (cipher->u.aesecb.key, key, keyLen);
-    cipher->u.aesecb.keyLen = keyLen;
+    // expand the key schedule once, rather than on every block
+    BRAESKeyInit (&cipher->u.aesecb.key, key, keyLen);
 
     return cipher;
 }
@@ -107,6 +208,7 @@ wkCipherCreateForPigeon(WKKey privKey,
     WKCipher cipher  = wkCipherCreateInternal (WK_CIPHER_PIGEON);
     cipher->u.pigeon.privKey = wkKeyTake (privKey);
     cipher->u.pigeon.pubKey = wkKeyTake (pubKey);
+    cipher->u.pigeon.sharedKey = wkCipherPigeonSharedKey (privKey, pubKey);
     memcpy (cipher->u.pigeon.nonce, nonce, nonceLen);
 
     return cipher;
@@ -116,6 +218,7 @@ static void
 wkCipherRelease (WKCipher cipher) {
     switch (cipher->type) {
         case WK_CIPHER_AESECB: {
+            BRAESKeyClean (&cipher->u.aesecb.key);
             break;
         }
         case WK_CIPHER_CHACHA20_POLY1305: {
@@ -128,6 +231,7 @@ wkCipherRelease (WKCipher cipher) {
         case WK_CIPHER_PIGEON: {
             wkKeyGive (cipher->u.pigeon.privKey);
             wkKeyGive (cipher->u.pigeon.pubKey);
+            mem_clean (&cipher->u.pigeon.sharedKey, sizeof (cipher->u.pigeon.sharedKey));
             break;
         }
         default: {
@@ -207,10 +311,7 @@ wkCipherEncrypt (WKCipher cipher,
     switch (cipher->type) {
         case WK_CIPHER_AESECB: {
             if (srcLen == dstLen && (0 == srcLen % 16)) {
-                memcpy (dst, src, dstLen);
-                for (size_t index = 0; index < dstLen; index += 16) {
-                    BRAESECBEncrypt (&dst[index], cipher->u.aesecb.key, cipher->u.aesecb.keyLen);
-                }
+                BRAESKeyECBEncrypt (&cipher->u.aesecb.key, dst, src, dstLen / 16);
                 result = WK_TRUE;
             }
             break;
@@ -229,13 +330,14 @@ wkCipherEncrypt (WKCipher cipher,
             break;
         }
         case WK_CIPHER_PIGEON: {
-            result = AS_WK_BOOLEAN (BRKeyPigeonEncrypt (wkKeyGetCore (cipher->u.pigeon.privKey),
-                                                            dst,
-                                                            dstLen,
-                                                            wkKeyGetCore (cipher->u.pigeon.pubKey),
-                                                            cipher->u.pigeon.nonce,
-                                                            src,
-                                                            srcLen));
+            result = AS_WK_BOOLEAN (BRChacha20Poly1305AEADEncrypt (dst,
+                                                                       dstLen,
+                                                                       cipher->u.pigeon.sharedKey.u8,
+                                                                       cipher->u.pigeon.nonce,
+                                                                       src,
+                                                                       srcLen,
+                                                                       NULL,
+                                                                       0));
             break;
         }
         default: {
@@ -317,10 +419,7 @@ wkCipherDecrypt (WKCipher cipher,
     switch (cipher->type) {
         case WK_CIPHER_AESECB: {
             if (srcLen == dstLen && (0 == srcLen % 16)) {
-                memcpy (dst, src, dstLen);
-                for (size_t index = 0; index < dstLen; index += 16) {
-                    BRAESECBDecrypt (&dst[index], cipher->u.aesecb.key, cipher->u.aesecb.keyLen);
-                }
+                BRAESKeyECBDecrypt (&cipher->u.aesecb.key, dst, src, dstLen / 16);
                 result = WK_TRUE;
             }
             break;
@@ -339,13 +438,14 @@ wkCipherDecrypt (WKCipher cipher,
             break;
         }
         case WK_CIPHER_PIGEON: {
-            result = AS_WK_BOOLEAN (BRKeyPigeonDecrypt (wkKeyGetCore (cipher->u.pigeon.privKey),
-                                                            dst,
-                                                            dstLen,
-                                                            wkKeyGetCore (cipher->u.pigeon.pubKey),
-                                                            cipher->u.pigeon.nonce,
-                                                            src,
-                                                            srcLen));
+            result = AS_WK_BOOLEAN (BRChacha20Poly1305AEADDecrypt (dst,
+                                                                       dstLen,
+                                                                       cipher->u.pigeon.sharedKey.u8,
+                                                                       cipher->u.pigeon.nonce,
+                                                                       src,
+                                                                       srcLen,
+                                                                       NULL,
+                                                                       0));
             break;
         }
         default: {
@@ -358,6 +458,90 @@ wkCipherDecrypt (WKCipher cipher,
     return result;
 }
 
+static WKBoolean
+wkCipherCryptBatch (WKCipher cipher,
+                    bool encrypt,
+                    const uint8_t *nonces,
+                    uint8_t *dsts[],
+                    const size_t dstLens[],
+                    const uint8_t *srcs[],
+                    const size_t srcLens[],
+                    size_t count) {
+    // - each src CAN be NULL, if its srcLen is 0
+    // - each dst MUST be non-NULL; a dst that is too small fails that payload
+    if ((NULL == nonces && 0 != count) ||
+        (0 != count && (NULL == dsts || NULL == dstLens || NULL == srcs || NULL == srcLens))) {
+        assert (0);
+        return WK_FALSE;
+    }
+
+    for (size_t index = 0; index < count; index++)
+        if ((NULL == srcs[index] && 0 != srcLens[index]) || NULL == dsts[index]) {
+            assert (0);
+            return WK_FALSE;
+        }
+
+    WKSecret secret;
+    const uint8_t *key;
+    const uint8_t *ad = NULL;
+    size_t adLen = 0;
+
+    switch (cipher->type) {
+        case WK_CIPHER_CHACHA20_POLY1305: {
+            secret = wkKeyGetSecret (cipher->u.chacha20.key);
+            key    = secret.data;
+            ad     = cipher->u.chacha20.ad;
+            adLen  = cipher->u.chacha20.adLen;
+            break;
+        }
+        case WK_CIPHER_PIGEON: {
+            key = cipher->u.pigeon.sharedKey.u8;
+            break;
+        }
+        default: {
+            // for an unsupported algorithm, assert
+            assert (0);
+            return WK_FALSE;
+        }
+    }
+
+    WKBoolean result = WK_TRUE;
+
+    for (size_t index = 0; index < count; index++) {
+        size_t length = (encrypt
+                         ? BRChacha20Poly1305AEADEncrypt (dsts[index], dstLens[index], key, &nonces[12 * index],
+                                                          srcs[index], srcLens[index], ad, adLen)
+                         : BRChacha20Poly1305AEADDecrypt (dsts[index], dstLens[index], key, &nonces[12 * index],
+                                                          srcs[index], srcLens[index], ad, adLen));
+        if (0 == length) result = WK_FALSE;
+    }
+
+    if (WK_CIPHER_CHACHA20_POLY1305 == cipher->type) wkSecretClear (&secret);
+    return result;
+}
+
+extern WKBoolean
+wkCipherEncryptBatch (WKCipher cipher,
+                      const uint8_t *nonces,
+                      uint8_t *ciphertexts[],
+                      const size_t ciphertextLens[],
+                      const uint8_t *plaintexts[],
+                      const size_t plaintextLens[],
+                      size_t count) {
+    return wkCipherCryptBatch (cipher, true, nonces, ciphertexts, ciphertextLens, plaintexts, plaintextLens, count);
+}
+
+extern WKBoolean
+wkCipherDecryptBatch (WKCipher cipher,
+                      const uint8_t *nonces,
+                      uint8_t *plaintexts[],
+                      const size_t plaintextLens[],
+                      const uint8_t *ciphertexts[],
+                      const size_t ciphertextLens[],
+                      size_t count) {
+    return wkCipherCryptBatch (cipher, false, nonces, plaintexts, plaintextLens, ciphertexts, ciphertextLens, count);
+}
+
 static size_t
 wkCipherDecryptForMigrateLength (WKCipher cipher,
                                      const uint8_t *src,
@@ -16,9 +16,11 @@
 #include <stdio.h>          // printf
 
 #include "support/BRArray.h"
+#include "support/BRAddress.h"   // BRVarInt
 #include "support/BRCrypto.h"
 #include "support/BROSCompat.h"
 
+#include "WKBaseP.h"
 #include "WKAddressP.h"
 #include "WKHashP.h"
 #include "WKFileService.h"
@@ -150,11 +152,23 @@ wkClientP2PManagerSetNetworkReachable (WKClientP2PManager p2p,
 // MARK: Client QRY (QueRY)
 
 static void wkClientQRYRequestBlockNumber  (WKClientQRYManager qry);
-static bool wkClientQRYRequestTransactionsOrTransfers (WKClientQRYManager qry,
+static void wkClientQRYQueueAddresses      (WKClientQRYManager qry,
+                                                OwnershipGiven BRSetOf(WKAddress) addresses);
+static void wkClientQRYRequestTransactionsOrTransfers (WKClientQRYManager qry,
                                                            WKClientCallbackType type,
-                                                           OwnershipKept  BRSetOf(WKAddress) oldAddresses,
-                                                           OwnershipGiven BRSetOf(WKAddress) newAddresses,
                                                            size_t requestId);
+static void wkClientQRYSyncStateReset      (WKClientQRYManager qry);
+static bool wkClientQRYContinueRecovery    (WKClientQRYManager qry,
+                                                WKClientCallbackType type,
+                                                size_t requestId);
+static void wkClientQRYAbandonRecovery     (WKClientQRYManager qry);
+static WKBlockNumber wkClientQRYBundlesBlockNumber (BRArrayOf(WKClientTransactionBundle) transactionBundles,
+                                                     BRArrayOf(WKClientTransferBundle)    transferBundles,
+                                                     WKTimestamp *timestamp);
+static void wkClientQRYRequestAnnounced    (WKClientQRYManager qry,
+                                                WKClientCallbackState callbackState,
+                                                WKBlockNumber blockNumber,
+                                                bool lastPage);
 static void wkClientQRYSubmitTransfer      (WKClientQRYManager qry,
                                                 WKWallet   wallet,
                                                 WKTransfer transfer);
@@ -187,8 +201,18 @@ wkClientQRYManagerCreate (WKClient client,
     qry->sync.success   = false;
     qry->sync.unbounded = WK_CLIENT_QRY_IS_UNBOUNDED;
 
+    qry->sync.addresses = wkAddressSetCreate (WK_CLIENT_QRY_ADDRESS_CHUNK_SIZE);
+    qry->sync.addressesVersion = 0;
+    array_new (qry->sync.queued, WK_CLIENT_QRY_ADDRESS_CHUNK_SIZE);
+    array_new (qry->sync.transactionBundles, 10);
+    array_new (qry->sync.transferBundles, 10);
+    array_new (qry->sync.requests, WK_CLIENT_QRY_REQUESTS_IN_FLIGHT_LIMIT);
+
     qry->connected = false;
 
+    qry->addressChunkSize      = WK_CLIENT_QRY_ADDRESS_CHUNK_SIZE;
+    qry->requestsInFlightLimit = WK_CLIENT_QRY_REQUESTS_IN_FLIGHT_LIMIT;
+
     pthread_mutex_init_brd (&qry->lock, PTHREAD_MUTEX_NORMAL);
     return qry;
 }
@@ -201,6 +225,13 @@ wkClientQRYManagerRelease (WKClientQRYManager qry) {
     // Tiny race
     pthread_mutex_destroy (&qry->lock);
 
+    wkClientQRYSyncStateReset (qry);
+    wkAddressSetRelease (qry->sync.addresses);
+    array_free (qry->sync.queued);
+    array_free (qry->sync.transactionBundles);
+    array_free (qry->sync.transferBundles);
+    array_free (qry->sync.requests);
+
     memset (qry, 0, sizeof(*qry));
     free (qry);
 }
@@ -225,6 +256,16 @@ wkClientQRYManagerDisconnect (WKClientQRYManager qry) {
 }
 
 
+extern void
+wkClientQRYManagerSetRecoveryLimits (WKClientQRYManager qry,
+                                         size_t addressChunkSize,
+                                         size_t requestsInFlightLimit) {
+    pthread_mutex_lock (&qry->lock);
+    qry->addressChunkSize      = MAX (addressChunkSize,      1);
+    qry->requestsInFlightLimit = MAX (requestsInFlightLimit, 1);
+    pthread_mutex_unlock (&qry->lock);
+}
+
 static void
 wkClientQRYManagerSync (WKClientQRYManager qry,
                             WKSyncDepth depth,
@@ -244,6 +285,20 @@ wkClientQRYManagerSend (WKClientQRYManager qry,
     wkClientQRYSubmitTransfer (qry, wallet, transfer);
 }
 
+///
+/// If the sync is an incremental sync - because the `begBlockNumber` is near to the current
+/// network's block height, then we don't want events generated.  This makes the QRY events
+/// similar to P2P events where as each block is announced NO sync event are generated.
+///
+/// We are a little bit sloppy with avoiding the events.  Normally the `begBlockNumber` is
+/// `blockNumberOffset` less than the current network's height - but we'll avoid events if
+/// `begBlockNumber` is within `2 * blockNumberOffset`.  Must be called with `qry->lock`.
+///
+static bool
+wkClientQRYSyncIsIncremental (WKClientQRYManager qry) {
+    return qry->sync.begBlockNumber >= wkClientQRYGetNetworkBlockHeight (qry) - 2 * qry->blockNumberOffset;
+}
+
 static void
 wkClientQRYManagerUpdateSync (WKClientQRYManager qry,
                                   bool completed,
@@ -254,16 +309,7 @@ wkClientQRYManagerUpdateSync (WKClientQRYManager qry,
     bool needBegEvent = !completed && qry->sync.completed;
     bool needEndEvent = completed && !qry->sync.completed;
 
-    //
-    // If the sync is an incremental sync - because the `begBlockNumber` is near to the current
-    // network's block height, then we don't want events generated.  This makes the QRY events
-    // similar to P2P events where as each block is announced NO sync event are generated.
-    //
-    // We are a little bit sloppy with avoiding the events.  Normally the `begBlockNumber` is
-    // `blockNumberOffset` less than the current network's height - but we'll avoid events if
-    // `begBlockNumber` is within `2 * blockNumberOffset`
-    //
-    if (qry->sync.begBlockNumber >= wkClientQRYGetNetworkBlockHeight (qry) - 2 * qry->blockNumberOffset) {
+    if (wkClientQRYSyncIsIncremental (qry)) {
         needBegEvent = false;
         needEndEvent = false;
     }
@@ -307,6 +353,39 @@ wkClientQRYManagerUpdateSync (WKClientQRYManager qry,
     if (needLock) pthread_mutex_unlock(&qry->lock);
 }
 
+///
+/// Report the progress of a sync, as the highest block number recovered so far from the pages of
+/// its requests.  Like the other sync events, none are generated for an incremental sync.
+///
+static void
+wkClientQRYManagerUpdateSyncProgress (WKClientQRYManager qry,
+                                          size_t requestId,
+                                          WKBlockNumber blockNumber,
+                                          WKTimestamp timestamp) {
+    pthread_mutex_lock (&qry->lock);
+
+    bool needEvent = (requestId == qry->sync.rid                   &&
+                      !qry->sync.completed                         &&
+                      !wkClientQRYSyncIsIncremental (qry)          &&
+                      blockNumber >  qry->sync.pagedBlockNumber    &&
+                      blockNumber >= qry->sync.begBlockNumber      &&
+                      qry->sync.endBlockNumber > qry->sync.begBlockNumber);
+
+    if (needEvent) {
+        qry->sync.pagedBlockNumber = blockNumber;
+
+        double percentComplete = (100.0 * (double) (MIN (blockNumber, qry->sync.endBlockNumber) - qry->sync.begBlockNumber)
+                                  / (double) (qry->sync.endBlockNumber - qry->sync.begBlockNumber));
+
+        wkWalletManagerGenerateEvent (qry->manager, (WKWalletManagerEvent) {
+            WK_WALLET_MANAGER_EVENT_SYNC_CONTINUES,
+            { .syncContinues = { timestamp, AS_WK_SYNC_PERCENT_COMPLETE (percentComplete) }}
+        });
+    }
+
+    pthread_mutex_unlock (&qry->lock);
+}
+
 extern void
 wkClientQRYManagerTickTock (WKClientQRYManager qry) {
     pthread_mutex_lock (&qry->lock);
@@ -359,11 +438,15 @@ wkClientQRYRequestSync (WKClientQRYManager qry, bool needLock) {
         // Mark the sync as completed, unsucessfully (the initial state)
         wkClientQRYManagerUpdateSync (qry, false, false, false);
 
-        // Get the addresses for the manager's wallet
+        // Get the addresses for the manager's wallet; every one is new to this sync
+        wkClientQRYSyncStateReset (qry);
+
         WKWallet wallet = wkWalletManagerGetWallet (qry->manager);
-        BRSetOf(WKAddress) addresses = wkWalletGetAddressesForRecovery (wallet);
+        BRSetOf(WKAddress) addresses = wkWalletGetAddressesForRecoverySince (wallet, &qry->sync.addressesVersion);
         assert (0 != BRSetCount(addresses));
 
+        wkClientQRYQueueAddresses (qry, addresses);
+
         // We'll force the 'client' to return all transactions w/o regard to the `endBlockNumber`
         // Doing this ensures that the initial 'full-sync' returns everything.  Thus there is no
         // need to wait for a future 'tick tock' to get the recent and pending transactions'.  For
@@ -373,8 +456,6 @@ wkClientQRYRequestSync (WKClientQRYManager qry, bool needLock) {
                                                        (WK_CLIENT_REQUEST_USE_TRANSFERS == qry->byType
                                                         ? CLIENT_CALLBACK_REQUEST_TRANSFERS
                                                         : CLIENT_CALLBACK_REQUEST_TRANSACTIONS),
-                                                       NULL,
-                                                       addresses,
                                                        qry->sync.rid);
 
         wkWalletGive (wallet);
@@ -584,6 +665,7 @@ typedef struct {
     WKWalletManager manager;
     WKClientCallbackState callbackState;
     WKBoolean success;
+    WKBoolean more;
     BRArrayOf (WKClientTransactionBundle) bundles;
 } WKClientAnnounceTransactionsEvent;
 
@@ -591,10 +673,14 @@ extern void
 wkClientHandleTransactions (OwnershipKept WKWalletManager manager,
                                 OwnershipGiven WKClientCallbackState callbackState,
                                 WKBoolean success,
+                                WKBoolean more,
                                 BRArrayOf (WKClientTransactionBundle) bundles) {
 
     WKClientQRYManager qry = manager->qryManager;
 
+    // A failure ends the request, whether or not more pages were expected.
+    bool lastPage = (WK_FALSE == success || WK_FALSE == more);
+
     pthread_mutex_lock (&qry->lock);
     bool matchedRids = (callbackState->rid == qry->sync.rid);
     pthread_mutex_unlock (&qry->lock);
@@ -612,56 +698,39 @@ wkClientHandleTransactions (OwnershipKept WKWalletManager manager,
                 for (size_t index = 0; index < bundlesCount; index++)
                     wkWalletManagerSaveTransactionBundle(manager, bundles[index]);
 
-                // Sort bundles to have the lowest blocknumber first.  Use of `mergesort` is
-                // appropriate given that the bundles are likely already ordered.  This minimizes
-                // dependency resolution between later transactions depending on prior transactions.
-                //
-                // Seems that there may be duplicates in `bundles`; will be dealt with later
-
-                mergesort_brd (bundles, bundlesCount, sizeof (WKClientTransactionBundle),
-                               wkClientTransactionBundleCompareForSort);
-
-                // Recover transfers from each bundle
-                for (size_t index = 0; index < bundlesCount; index++)
-                   wkWalletManagerRecoverTransfersFromTransactionBundle (manager, bundles[index]);
-
-                // The following assumes `bundles` has produced transfers which may have
-                // impacted the wallet's addresses.  Thus the recovery must be *serial w.r.t. the
-                // subsequent call to `wkClientQRYRequestTransactionsOrTransfers()`.
-
-                WKWallet wallet = wkWalletManagerGetWallet(manager);
-
-                // We've completed a query for `oldAddresses`
-                BRSetOf(WKAddress) oldAddresses = callbackState->u.getTransactions.addresses;
-
-                // We'll need another query if `newAddresses` is now larger then `oldAddresses`
-                BRSetOf(WKAddress) newAddresses = wkWalletGetAddressesForRecovery (wallet);
-
-                // Make the actual request; if none is needed, then we are done
-                if (!wkClientQRYRequestTransactionsOrTransfers (qry,
-                                                                    CLIENT_CALLBACK_REQUEST_TRANSACTIONS,
-                                                                    oldAddresses,
-                                                                    newAddresses,
-                                                                    callbackState->rid)) {
+                // Hold the bundles, every page alike, until they can be recovered, in block
+                // order, along with those from the other requests and pages in this sync.
+                WKBlockNumber blockNumber = wkClientQRYBundlesBlockNumber (bundles, NULL, NULL);
+
+                pthread_mutex_lock (&qry->lock);
+                array_add_array (qry->sync.transactionBundles, bundles, bundlesCount);
+                array_clear (bundles);
+                wkClientQRYRequestAnnounced (qry, callbackState, blockNumber, lastPage);
+                pthread_mutex_unlock (&qry->lock);
+
+                // Recover what we can and make any further requests; once the last page is in, if
+                // none are needed or in flight, then we are done
+                if (!wkClientQRYContinueRecovery (qry,
+                                                      CLIENT_CALLBACK_REQUEST_TRANSACTIONS,
+                                                      callbackState->rid) && lastPage) {
                     syncCompleted = true;
                     syncSuccess   = true;
                 }
-
-                wkWalletGive (wallet);
                 break;
 
             case WK_FALSE:
+                wkClientQRYAbandonRecovery (qry);
                 syncCompleted = true;
                 syncSuccess   = false;
                 break;
             }
         }
-    }
 
-    wkClientQRYManagerUpdateSync (qry, syncCompleted, syncSuccess, true);
+        if (lastPage) wkClientQRYManagerUpdateSync (qry, syncCompleted, syncSuccess, true);
+    }
 
     array_free_all (bundles, wkClientTransactionBundleRelease);
-    wkClientCallbackStateRelease(callbackState);
+    if (lastPage) wkClientCallbackStateRelease(callbackState);
 }
 
 static void
@@ -670,13 +739,15 @@ wkClientAnnounceTransactionsDispatcher (BREventHandler ignore,
     wkClientHandleTransactions (event->manager,
                                     event->callbackState,
                                     event->success,
+                                    event->more,
                                     event->bundles);
 }
 
 static void
 wkClientAnnounceTransactionsDestroyer (WKClientAnnounceTransactionsEvent *event) {
     wkWalletManagerGive (event->manager);
-    wkClientCallbackStateRelease (event->callbackState);
+    if (WK_FALSE == event->success || WK_FALSE == event->more)
+        wkClientCallbackStateRelease (event->callbackState);
     array_free_all (event->bundles, wkClientTransactionBundleRelease);
 }
 
@@ -693,6 +764,16 @@ wkClientAnnounceTransactions (OwnershipKept WKWalletManager manager,
                                   WKBoolean success,
                                   WKClientTransactionBundle *bundles,  // given elements, not array
                                   size_t bundlesCount) {
+    wkClientAnnounceTransactionsPage (manager, callbackState, success, WK_FALSE, bundles, bundlesCount);
+}
+
+extern void
+wkClientAnnounceTransactionsPage (OwnershipKept WKWalletManager manager,
+                                      WKClientCallbackState callbackState,
+                                      WKBoolean success,
+                                      WKBoolean more,
+                                      WKClientTransactionBundle *bundles,  // given elements, not array
+                                      size_t bundlesCount) {
     BRArrayOf (WKClientTransactionBundle) eventBundles;
     array_new (eventBundles, bundlesCount);
     array_add_array (eventBundles, bundles, bundlesCount);
@@ -702,6 +783,7 @@ wkClientAnnounceTransactions (OwnershipKept WKWalletManager manager,
         wkWalletManagerTakeWeak(manager),
         callbackState,
         success,
+        more,
         eventBundles };
 
     eventHandlerSignalEvent (manager->handler, (BREvent *) &event);
@@ -714,6 +796,7 @@ typedef struct {
     WKWalletManager manager;
     WKClientCallbackState callbackState;
     WKBoolean success;
+    WKBoolean more;
     BRArrayOf (WKClientTransferBundle) bundles;
 } WKClientAnnounceTransfersEvent;
 
@@ -721,11 +804,15 @@ extern void
 wkClientHandleTransfers (OwnershipKept WKWalletManager manager,
                                 OwnershipGiven WKClientCallbackState callbackState,
                                 WKBoolean success,
+                                WKBoolean more,
                                 BRArrayOf (WKClientTransferBundle) bundles) {
 
 
     WKClientQRYManager qry = manager->qryManager;
 
+    // A failure ends the request, whether or not more pages were expected.
+    bool lastPage = (WK_FALSE == success || WK_FALSE == more);
+
     pthread_mutex_lock (&qry->lock);
     bool matchedRids = (callbackState->rid == qry->sync.rid);
     pthread_mutex_unlock (&qry->lock);
@@ -742,51 +829,40 @@ wkClientHandleTransfers (OwnershipKept WKWalletManager manager,
                 for (size_t index = 0; index < bundlesCount; index++)
                     wkWalletManagerSaveTransferBundle(manager, bundles[index]);
 
-                // Sort bundles to have the lowest blocknumber first.  Use of `mergesort` is
-                // appropriate given that the bundles are likely already ordered.  This minimizes
-                // dependency resolution between later transfers depending on prior transfers.
-
-                mergesort_brd (bundles, bundlesCount, sizeof (WKClientTransferBundle),
-                               wkClientTransferBundleCompareForSort);
-
-                // Recover transfers from each bundle
-                for (size_t index = 0; index < bundlesCount; index++)
-                   wkWalletManagerRecoverTransferFromTransferBundle (manager, bundles[index]);
-
-                WKWallet wallet = wkWalletManagerGetWallet(manager);
-
-                // We've completed a query for `oldAddresses`
-                BRSetOf(WKAddress) oldAddresses = callbackState->u.getTransactions.addresses;
-
-                // We'll need another query if `newAddresses` is now larger then `oldAddresses`
-                BRSetOf(WKAddress) newAddresses = wkWalletGetAddressesForRecovery (wallet);
-
-                // Make the actual request; if none is needed, then we are done.  Use the
-                // same `rid` as we are in the same sync.
-                if (!wkClientQRYRequestTransactionsOrTransfers (qry,
-                                                                    CLIENT_CALLBACK_REQUEST_TRANSFERS,
-                                                                    oldAddresses,
-                                                                    newAddresses,
-                                                                    callbackState->rid)) {
+                // Hold the bundles, every page alike, until they can be recovered, in block
+                // order, along with those from the other requests and pages in this sync.
+                WKBlockNumber blockNumber = wkClientQRYBundlesBlockNumber (NULL, bundles, NULL);
+
+                pthread_mutex_lock (&qry->lock);
+                array_add_array (qry->sync.transferBundles, bundles, bundlesCount);
+                array_clear (bundles);
+                wkClientQRYRequestAnnounced (qry, callbackState, blockNumber, lastPage);
+                pthread_mutex_unlock (&qry->lock);
+
+                // Recover what we can and make any further requests; once the last page is in, if
+                // none are needed or in flight, then we are done.  Use the same `rid` as we are in
+                // the same sync.
+                if (!wkClientQRYContinueRecovery (qry,
+                                                      CLIENT_CALLBACK_REQUEST_TRANSFERS,
+                                                      callbackState->rid) && lastPage) {
                     syncCompleted = true;
                     syncSuccess   = true;
                 }
-
-                wkWalletGive (wallet);
                 break;
 
             case WK_FALSE:
+                wkClientQRYAbandonRecovery (qry);
                 syncCompleted = true;
                 syncSuccess   = false;
                 break;
             }
         }
-    }
 
-    wkClientQRYManagerUpdateSync (qry, syncCompleted, syncSuccess, true);
+        if (lastPage) wkClientQRYManagerUpdateSync (qry, syncCompleted, syncSuccess, true);
+    }
 
     array_free_all (bundles, wkClientTransferBundleRelease);
-    wkClientCallbackStateRelease(callbackState);
+    if (lastPage) wkClientCallbackStateRelease(callbackState);
 }
 
 static void
@@ -795,13 +871,15 @@ wkClientAnnounceTransfersDispatcher (BREventHandler ignore,
     wkClientHandleTransfers (event->manager,
                                     event->callbackState,
                                     event->success,
+                                    event->more,
                                     event->bundles);
 }
 
 static void
 wkClientAnnounceTransfersDestroyer (WKClientAnnounceTransfersEvent *event) {
     wkWalletManagerGive (event->manager);
-    wkClientCallbackStateRelease (event->callbackState);
+    if (WK_FALSE == event->success || WK_FALSE == event->more)
+        wkClientCallbackStateRelease (event->callbackState);
     array_free_all (event->bundles, wkClientTransferBundleRelease);
 }
 
@@ -819,6 +897,16 @@ wkClientAnnounceTransfers (OwnershipKept WKWalletManager manager,
                                WKBoolean success,
                                OwnershipGiven WKClientTransferBundle *bundles, // given elements, not array
                                size_t bundlesCount) {
+    wkClientAnnounceTransfersPage (manager, callbackState, success, WK_FALSE, bundles, bundlesCount);
+}
+
+extern void
+wkClientAnnounceTransfersPage (OwnershipKept WKWalletManager manager,
+                                   WKClientCallbackState callbackState,
+                                   WKBoolean success,
+                                   WKBoolean more,
+                                   OwnershipGiven WKClientTransferBundle *bundles, // given elements, not array
+                                   size_t bundlesCount) {
     BRArrayOf (WKClientTransferBundle) eventBundles;
     array_new (eventBundles, bundlesCount);
     array_add_array (eventBundles, bundles, bundlesCount);
@@ -828,6 +916,7 @@ wkClientAnnounceTransfers (OwnershipKept WKWalletManager manager,
         wkWalletManagerTakeWeak(manager),
         callbackState,
         success,
+        more,
         eventBundles };
 
     eventHandlerSignalEvent (manager->handler, (BREvent *) &event);
@@ -855,39 +944,52 @@ wkClientQRYReleaseAddresses (BRArrayOf(char *) addresses) {
     array_free (addresses);
 }
 
-static bool
+///
+/// Queue each of `addresses` not yet requested in this sync; the queued addresses are requested,
+/// in chunks, by `wkClientQRYRequestTransactionsOrTransfers()`.  Must be called with `qry->lock`.
+///
+static void
+wkClientQRYQueueAddresses (WKClientQRYManager qry,
+                               OwnershipGiven BRSetOf(WKAddress) addresses) {
+    FOR_SET (WKAddress, address, addresses) {
+        if (!BRSetContains (qry->sync.addresses, address)) {
+            BRSetAdd  (qry->sync.addresses, wkAddressTake (address));
+            array_add (qry->sync.queued,    wkAddressTake (address));
+        }
+    }
+    wkAddressSetRelease (addresses);
+}
+
+///
+/// Request transactions or transfers for the queued addresses, at most `addressChunkSize`
+/// addresses per request, until `requestsInFlightLimit` requests are outstanding.  Must be called
+/// with `qry->lock`.
+///
+static void
 wkClientQRYRequestTransactionsOrTransfers (WKClientQRYManager qry,
                                                WKClientCallbackType type,
-                                               OwnershipKept  BRSetOf(WKAddress) oldAddresses,
-                                               OwnershipGiven BRSetOf(WKAddress) newAddresses,
                                                size_t requestId) {
 
     WKWalletManager manager = wkWalletManagerTakeWeak(qry->manager);
-    if (NULL == manager) {
-        wkAddressSetRelease(newAddresses);
-        return false;
-    }
-
-    // Determine the set of addresses needed as `newAddresses - oldAddresses`.  The elements in
-    // `addresses` ARE NOT owned by `addresses`; they remain owned by `newAddresses`
-    BRSetOf(WKAddress) addresses = BRSetCopy (newAddresses, NULL);
+    if (NULL == manager) return;
 
-    if (NULL != oldAddresses)
-        BRSetMinus (addresses, oldAddresses);
+    while (array_count (qry->sync.queued) > 0 &&
+           array_count (qry->sync.requests) < qry->requestsInFlightLimit) {
+        size_t chunkSize = MIN (array_count (qry->sync.queued), qry->addressChunkSize);
 
-    // If there are `addresses` then a reqeust is needed.
-    bool needRequest = BRSetCount (addresses) > 0;
+        // The chunk's addresses are given to `callbackState`
+        BRSetOf(WKAddress) addresses = wkAddressSetCreate (chunkSize);
+        for (size_t index = 0; index < chunkSize; index++)
+            BRSetAdd (addresses, qry->sync.queued[index]);
+        array_rm_range (qry->sync.queued, 0, chunkSize);
 
-    if (needRequest) {
-        // Get an array of the remaining, needed `addresses`
         BRArrayOf(char *) addressesEncoded = wkClientQRYGetAddresses (qry, addresses);
 
-        // Create a `calllbackState`; importantly, report `newAddress` as the accumulated addresses
-        // that have been requested.  Note, this specific request will be for `addresses` only.
-        // The elements in `newAddresses` are now owned by `callbackState`.
         WKClientCallbackState callbackState = wkClientCallbackStateCreateGetTrans (type,
-                                                                                             newAddresses,
-                                                                                             requestId);
+                                                                                       addresses,
+                                                                                       requestId);
+        // Until its first page, the request may announce a bundle in any block of the sync
+        array_add (qry->sync.requests, ((WKClientQRYRequest) { callbackState, qry->sync.begBlockNumber }));
 
         switch (type) {
             case CLIENT_CALLBACK_REQUEST_TRANSFERS:
@@ -920,17 +1022,823 @@ wkClientQRYRequestTransactionsOrTransfers (WKClientQRYManager qry,
 
         wkClientQRYReleaseAddresses (addressesEncoded);
     }
-    else {
-        // If `newAddresses` ownership was not transfered to `callbackState`, then release everything.
-        wkAddressSetRelease (newAddresses);
+
+    wkWalletManagerGive (manager);
+}
+
+///
+/// Recover `transactionBundles` and `transferBundles`, either of which may be NULL, in block order.
+///
+static void
+wkClientQRYRecoverBundles (WKWalletManager manager,
+                               BRArrayOf(WKClientTransactionBundle) transactionBundles,
+                               BRArrayOf(WKClientTransferBundle)    transferBundles) {
+    // Sort bundles to have the lowest blocknumber first.  Use of `mergesort` is appropriate
+    // given that the bundles are likely already ordered.  This minimizes dependency
+    // resolution between later transfers depending on prior transfers.
+    //
+    // Seems that there may be duplicates in the bundles; will be dealt with later
+    if (NULL != transactionBundles) {
+        mergesort_brd (transactionBundles, array_count (transactionBundles), sizeof (WKClientTransactionBundle),
+                       wkClientTransactionBundleCompareForSort);
+
+        for (size_t index = 0; index < array_count (transactionBundles); index++)
+            wkWalletManagerRecoverTransfersFromTransactionBundle (manager, transactionBundles[index]);
     }
 
+    if (NULL != transferBundles) {
+        mergesort_brd (transferBundles, array_count (transferBundles), sizeof (WKClientTransferBundle),
+                       wkClientTransferBundleCompareForSort);
+
+        for (size_t index = 0; index < array_count (transferBundles); index++)
+            wkWalletManagerRecoverTransferFromTransferBundle (manager, transferBundles[index]);
+    }
+}
+
+///
+/// Return the highest block number of `transactionBundles` and `transferBundles`, either of which
+/// may be NULL, ignoring those not yet in a block; 0 if there are none.  If `timestamp` is not
+/// NULL it is filled with that block's timestamp.
+///
+static WKBlockNumber
+wkClientQRYBundlesBlockNumber (BRArrayOf(WKClientTransactionBundle) transactionBundles,
+                                   BRArrayOf(WKClientTransferBundle)    transferBundles,
+                                   WKTimestamp *timestamp) {
+    WKBlockNumber blockNumber    = 0;
+    WKTimestamp   blockTimestamp = NO_WK_TIMESTAMP;
+
+    for (size_t index = 0; NULL != transactionBundles && index < array_count (transactionBundles); index++)
+        if (BLOCK_HEIGHT_UNBOUND_VALUE != transactionBundles[index]->blockHeight &&
+            blockNumber < transactionBundles[index]->blockHeight) {
+            blockNumber    = transactionBundles[index]->blockHeight;
+            blockTimestamp = transactionBundles[index]->timestamp;
+        }
+
+    for (size_t index = 0; NULL != transferBundles && index < array_count (transferBundles); index++)
+        if (BLOCK_HEIGHT_UNBOUND_VALUE != transferBundles[index]->blockNumber &&
+            blockNumber < transferBundles[index]->blockNumber) {
+            blockNumber    = transferBundles[index]->blockNumber;
+            blockTimestamp = transferBundles[index]->blockTimestamp;
+        }
+
+    if (NULL != timestamp) *timestamp = blockTimestamp;
+    return blockNumber;
+}
+
+///
+/// Note a page announced for the request with `callbackState`, with bundles through `blockNumber`.
+/// The request's later pages hold no bundle below that block; after its last page the request is
+/// no longer in flight.  Must be called with `qry->lock`.
+///
+static void
+wkClientQRYRequestAnnounced (WKClientQRYManager qry,
+                                 WKClientCallbackState callbackState,
+                                 WKBlockNumber blockNumber,
+                                 bool lastPage) {
+    for (size_t index = 0; index < array_count (qry->sync.requests); index++)
+        if (callbackState == qry->sync.requests[index].callbackState) {
+            if (lastPage) array_rm (qry->sync.requests, index);
+            else qry->sync.requests[index].blockNumber = MAX (qry->sync.requests[index].blockNumber, blockNumber);
+            break;
+        }
+}
+
+///
+/// Return the block number below which no request of the sync, queued or in flight, can yet
+/// announce a bundle; BLOCK_HEIGHT_UNBOUND once there are no such requests.  Must be called with
+/// `qry->lock`.
+///
+static WKBlockNumber
+wkClientQRYRecoverableBlockNumber (WKClientQRYManager qry) {
+    // A queued request may announce a bundle in any block
+    if (array_count (qry->sync.queued) > 0) return 0;
+
+    WKBlockNumber blockNumber = BLOCK_HEIGHT_UNBOUND;
+    for (size_t index = 0; index < array_count (qry->sync.requests); index++)
+        blockNumber = MIN (blockNumber, qry->sync.requests[index].blockNumber);
+
+    return blockNumber;
+}
+
+///
+/// Continue the sync `requestId` after a page of one of its requests has been announced.  The
+/// buffered bundles below every block that a request, queued or in flight, may yet announce are
+/// recovered, lowest block number first; once no requests remain, all of them are.  Any addresses
+/// the recovery added to the wallet are then queued and requested.  Returns `true` if requests
+/// remain in flight; `false` if the sync is complete.
+///
+static bool
+wkClientQRYContinueRecovery (WKClientQRYManager qry,
+                                 WKClientCallbackType type,
+                                 size_t requestId) {
+    WKWalletManager manager = wkWalletManagerTakeWeak(qry->manager);
+    if (NULL == manager) return false;
+
+    BRArrayOf(WKClientTransactionBundle) transactionBundles = NULL;
+    BRArrayOf(WKClientTransferBundle)    transferBundles    = NULL;
+
+    pthread_mutex_lock (&qry->lock);
+    size_t addressesVersion = qry->sync.addressesVersion;
+
+    // Take the bundles that no request can precede, in block order, with one of its own; keep
+    // the others in place.  Those not yet in a block are only taken along with every other.
+    WKBlockNumber blockNumber = wkClientQRYRecoverableBlockNumber (qry);
+    bool recoverAll = (BLOCK_HEIGHT_UNBOUND == blockNumber);
+    size_t kept;
+
+    array_new (transactionBundles, 10);
+    kept = 0;
+    for (size_t index = 0; index < array_count (qry->sync.transactionBundles); index++) {
+        WKClientTransactionBundle bundle = qry->sync.transactionBundles[index];
+        if (recoverAll || bundle->blockHeight < blockNumber) array_add (transactionBundles, bundle);
+        else qry->sync.transactionBundles[kept++] = bundle;
+    }
+    array_set_count (qry->sync.transactionBundles, kept);
+
+    array_new (transferBundles, 10);
+    kept = 0;
+    for (size_t index = 0; index < array_count (qry->sync.transferBundles); index++) {
+        WKClientTransferBundle bundle = qry->sync.transferBundles[index];
+        if (recoverAll || bundle->blockNumber < blockNumber) array_add (transferBundles, bundle);
+        else qry->sync.transferBundles[kept++] = bundle;
+    }
+    array_set_count (qry->sync.transferBundles, kept);
+
+    bool needRecover = (recoverAll ||
+                        array_count (transactionBundles) > 0 ||
+                        array_count (transferBundles)    > 0);
+    pthread_mutex_unlock (&qry->lock);
+
+    BRSetOf(WKAddress) addresses = NULL;
+
+    if (needRecover) {
+        wkClientQRYRecoverBundles (manager, transactionBundles, transferBundles);
+
+        // Report the sync's progress through the highest block recovered
+        WKTimestamp timestamp;
+        blockNumber = wkClientQRYBundlesBlockNumber (transactionBundles, transferBundles, &timestamp);
+        wkClientQRYManagerUpdateSyncProgress (qry, requestId, blockNumber, timestamp);
+
+        // The recovered transfers may have added to the wallet's addresses; those added since
+        // the last addresses queued are queued below.
+        WKWallet wallet = wkWalletManagerGetWallet (manager);
+        addresses = wkWalletGetAddressesForRecoverySince (wallet, &addressesVersion);
+        wkWalletGive (wallet);
+    }
+
+    array_free_all (transactionBundles, wkClientTransactionBundleRelease);
+    array_free_all (transferBundles,    wkClientTransferBundleRelease);
+
+    pthread_mutex_lock (&qry->lock);
+    bool needContinue = false;
+    if (requestId == qry->sync.rid) {
+        if (NULL != addresses) {
+            qry->sync.addressesVersion = addressesVersion;
+            wkClientQRYQueueAddresses (qry, addresses);
+        }
+        wkClientQRYRequestTransactionsOrTransfers (qry, type, requestId);
+        needContinue = (array_count (qry->sync.requests) > 0);
+    }
+    else if (NULL != addresses) wkAddressSetRelease (addresses);
+    pthread_mutex_unlock (&qry->lock);
+
     wkWalletManagerGive (manager);
-    BRSetFree (addresses);
+    return needContinue;
+}
+
+static void
+wkClientQRYAbandonRecovery (WKClientQRYManager qry) {
+    pthread_mutex_lock (&qry->lock);
+    // Responses to the outstanding requests will no longer match the sync's `rid`
+    qry->sync.rid = SIZE_MAX;
+    wkClientQRYSyncStateReset (qry);
+    pthread_mutex_unlock (&qry->lock);
+}
+
+///
+/// Release the addresses and bundles accumulated by a sync.  Must be called with `qry->lock`.
+///
+static void
+wkClientQRYSyncStateReset (WKClientQRYManager qry) {
+    for (size_t index = 0; index < array_count (qry->sync.queued); index++)
+        wkAddressGive (qry->sync.queued[index]);
+    array_clear (qry->sync.queued);
+
+    wkAddressSetRelease (qry->sync.addresses);
+    qry->sync.addresses = wkAddressSetCreate (WK_CLIENT_QRY_ADDRESS_CHUNK_SIZE);
+    qry->sync.addressesVersion = 0;
+
+    for (size_t index = 0; index < array_count (qry->sync.transactionBundles); index++)
+        wkClientTransactionBundleRelease (qry->sync.transactionBundles[index]);
+    array_clear (qry->sync.transactionBundles);
+
+    for (size_t index = 0; index < array_count (qry->sync.transferBundles); index++)
+        wkClientTransferBundleRelease (qry->sync.transferBundles[index]);
+    array_clear (qry->sync.transferBundles);
+
+    // The requests' callback states are owned by their announcements
+    array_clear (qry->sync.requests);
+    qry->sync.pagedBlockNumber = 0;
+}
+
+// MARK: - Announce Transfers JSON
+
+//
+// A single pass, in place tokenizer for the JSON of a `GET /transactions` response.  Each value
+// becomes a token, in document order, over a private copy of the payload.  Strings are unescaped
+// and NUL terminated in place so that transfer bundles are created directly from the copy,
+// without a host first splitting every transfer into separate strings.
+//
+
+typedef enum {
+    WK_JSON_NONE,           // token 0, standing in for a value that is absent
+    WK_JSON_OBJECT,
+    WK_JSON_ARRAY,
+    WK_JSON_STRING,
+    WK_JSON_PRIMITIVE,      // number, true, false or null
+} WKJSONTokenType;
+
+typedef struct {
+    WKJSONTokenType type;
+    uint32_t start;         // offset of the value; for a string, of its unescaped characters
+    uint32_t end;           // offset just past a primitive
+    uint32_t size;          // members of an object; elements of an array
+    uint32_t next;          // index of the token after this value and all of its children
+} WKJSONToken;
+
+typedef struct {
+    char *json;
+    size_t count;
+    size_t pos;
+    BRArrayOf(WKJSONToken) tokens;
+} WKJSONParser;
+
+#define WK_JSON_DEPTH_LIMIT         (32)
+
+#define WK_JSON_ONES                (0x0101010101010101ULL)
+#define WK_JSON_HIGHS               (0x8080808080808080ULL)
+#define WK_JSON_HAS_LESS(w, n)      (((w) - WK_JSON_ONES * (n)) & ~(w) & WK_JSON_HIGHS)
+#define WK_JSON_HAS_BYTE(w, b)      WK_JSON_HAS_LESS ((w) ^ (WK_JSON_ONES * (b)), 1)
+
+static inline void
+wkJSONSkipSpace (WKJSONParser *p) {
+    while (p->pos < p->count &&
+           (' '  == p->json[p->pos] || '\n' == p->json[p->pos] ||
+            '\r' == p->json[p->pos] || '\t' == p->json[p->pos]))
+        p->pos++;
+}
+
+///
+/// Return the offset of the first quote, backslash or control character at or after `pos`.  The
+/// bulk of a string is scanned eight bytes at a time.
+///
+static inline size_t
+wkJSONScanString (const char *json, size_t pos, size_t count) {
+    for (uint64_t w; pos + 8 <= count; pos += 8) {
+        memcpy (&w, &json[pos], 8);
+        if (WK_JSON_HAS_BYTE (w, '"') | WK_JSON_HAS_BYTE (w, '\\') | WK_JSON_HAS_LESS (w, 0x20)) break;
+    }
+
+    while (pos < count && '"' != json[pos] && '\\' != json[pos] && (uint8_t) json[pos] >= 0x20)
+        pos++;
+
+    return pos;
+}
+
+static bool
+wkJSONParseHex4 (const char *json, size_t pos, size_t count, uint32_t *code) {
+    if (pos + 4 > count) return false;
 
-    return needRequest;
+    *code = 0;
+    for (size_t index = pos; index < pos + 4; index++) {
+        char c = json[index];
+        uint32_t digit;
+
+        if      (c >= '0' && c <= '9') digit = (uint32_t) (c - '0');
+        else if (c >= 'a' && c <= 'f') digit = (uint32_t) (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') digit = (uint32_t) (c - 'A' + 10);
+        else return false;
+
+        *code = (*code << 4) | digit;
+    }
+    return true;
+}
+
+static size_t
+wkJSONEncodeUTF8 (char *out, uint32_t code) {
+    if (code < 0x80) {
+        out[0] = (char) code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char) (0xC0 | (code >> 6));
+        out[1] = (char) (0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char) (0xE0 | (code >> 12));
+        out[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (code >> 18));
+    out[1] = (char) (0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (code & 0x3F));
+    return 4;
 }
 
+///
+/// Parse the string at `p->pos`, a quote, unescaping it in place.  An escape never expands, so
+/// the unescaped characters are written behind the scan.
+///
+static bool
+wkJSONParseString (WKJSONParser *p) {
+    size_t start = ++p->pos;
+    size_t out   = start;
+
+    while (true) {
+        size_t pos = wkJSONScanString (p->json, p->pos, p->count);
+        if (out != p->pos) memmove (&p->json[out], &p->json[p->pos], pos - p->pos);
+        out   += pos - p->pos;
+        p->pos = pos;
+
+        if (pos >= p->count)      return false;
+        if ('"'  == p->json[pos]) break;
+        if ('\\' != p->json[pos]) return false;     // an unescaped control character
+        if (pos + 1 >= p->count)  return false;
+
+        size_t used = 2;
+        switch (p->json[pos + 1]) {
+            case '"':  p->json[out++] = '"';  break;
+            case '\\': p->json[out++] = '\\'; break;
+            case '/':  p->json[out++] = '/';  break;
+            case 'b':  p->json[out++] = '\b'; break;
+            case 'f':  p->json[out++] = '\f'; break;
+            case 'n':  p->json[out++] = '\n'; break;
+            case 'r':  p->json[out++] = '\r'; break;
+            case 't':  p->json[out++] = '\t'; break;
+            case 'u': {
+                uint32_t code, low;
+                if (!wkJSONParseHex4 (p->json, pos + 2, p->count, &code) || 0 == code) return false;
+                used = 6;
+
+                // A high surrogate must be followed by a low surrogate
+                if (code >= 0xD800 && code < 0xDC00) {
+                    if (pos + 12 > p->count || '\\' != p->json[pos + 6] || 'u' != p->json[pos + 7] ||
+                        !wkJSONParseHex4 (p->json, pos + 8, p->count, &low) ||
+                        low < 0xDC00 || low >= 0xE000) return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    used = 12;
+                }
+                else if (code >= 0xDC00 && code < 0xE000) return false;
+
+                out += wkJSONEncodeUTF8 (&p->json[out], code);
+                break;
+            }
+            default:
+                return false;
+        }
+        p->pos = pos + used;
+    }
+
+    p->json[out] = '\0';
+    p->pos++;
+
+    uint32_t index = (uint32_t) array_count (p->tokens);
+    array_add (p->tokens, ((WKJSONToken) { WK_JSON_STRING, (uint32_t) start, (uint32_t) out, 0, index + 1 }));
+    return true;
+}
+
+static bool
+wkJSONParsePrimitive (WKJSONParser *p) {
+    size_t start = p->pos;
+    while (p->pos < p->count &&
+           ((p->json[p->pos] >= '0' && p->json[p->pos] <= '9') ||
+            (p->json[p->pos] >= 'a' && p->json[p->pos] <= 'z') ||
+            '-' == p->json[p->pos] || '+' == p->json[p->pos] ||
+            '.' == p->json[p->pos] || 'E' == p->json[p->pos]))
+        p->pos++;
+
+    const char *value = &p->json[start];
+    size_t length = p->pos - start;
+
+    bool valid = ((4 == length && 0 == memcmp (value, "true",  4)) ||
+                  (5 == length && 0 == memcmp (value, "false", 5)) ||
+                  (4 == length && 0 == memcmp (value, "null",  4)));
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (!valid && length > 0) {
+        size_t index = ('-' == value[0] ? 1 : 0), digits;
+
+        for (digits = index; index < length && value[index] >= '0' && value[index] <= '9'; index++);
+        valid = (index > digits && !('0' == value[digits] && index - digits > 1));
+
+        if (valid && index < length && '.' == value[index]) {
+            for (digits = ++index; index < length && value[index] >= '0' && value[index] <= '9'; index++);
+            valid = (index > digits);
+        }
+        if (valid && index < length && ('e' == value[index] || 'E' == value[index])) {
+            if (++index < length && ('+' == value[index] || '-' == value[index])) index++;
+            for (digits = index; index < length && value[index] >= '0' && value[index] <= '9'; index++);
+            valid = (index > digits);
+        }
+        valid = valid && (index == length);
+    }
+
+    if (valid) {
+        uint32_t index = (uint32_t) array_count (p->tokens);
+        array_add (p->tokens, ((WKJSONToken) { WK_JSON_PRIMITIVE, (uint32_t) start, (uint32_t) p->pos, 0, index + 1 }));
+    }
+    return valid;
+}
+
+static bool
+wkJSONParseValue (WKJSONParser *p, unsigned depth) {
+    wkJSONSkipSpace (p);
+    if (p->pos >= p->count || depth > WK_JSON_DEPTH_LIMIT) return false;
+
+    size_t index = array_count (p->tokens);
+
+    switch (p->json[p->pos]) {
+        case '{':
+        case '[': {
+            bool isObject = ('{' == p->json[p->pos]);
+            char close    = (isObject ? '}' : ']');
+
+            array_add (p->tokens, ((WKJSONToken) { (isObject ? WK_JSON_OBJECT : WK_JSON_ARRAY), (uint32_t) p->pos, 0, 0, 0 }));
+            p->pos++;
+
+            wkJSONSkipSpace (p);
+            if (p->pos < p->count && close == p->json[p->pos]) {
+                p->pos++;
+                break;
+            }
+
+            while (true) {
+                // An object member is a string key, a colon and then the value
+                if (isObject) {
+                    wkJSONSkipSpace (p);
+                    if (p->pos >= p->count || '"' != p->json[p->pos] || !wkJSONParseString (p)) return false;
+                    wkJSONSkipSpace (p);
+                    if (p->pos >= p->count || ':' != p->json[p->pos]) return false;
+                    p->pos++;
+                }
+
+                if (!wkJSONParseValue (p, depth + 1)) return false;
+                p->tokens[index].size++;
+
+                wkJSONSkipSpace (p);
+                if (p->pos >= p->count) return false;
+                if (',' == p->json[p->pos]) { p->pos++; continue; }
+                if (close == p->json[p->pos]) { p->pos++; break; }
+                return false;
+            }
+            break;
+        }
+
+        case '"':
+            if (!wkJSONParseString (p)) return false;
+            break;
+
+        default:
+            if (!wkJSONParsePrimitive (p)) return false;
+            break;
+    }
+
+    p->tokens[index].next = (uint32_t) array_count (p->tokens);
+    return true;
+}
+
+/// Return the value of `object`'s member `name`; 0 if `object` is not an object or lacks `name`.
+static size_t
+wkJSONObjectGet (WKJSONParser *p, size_t object, const char *name) {
+    if (WK_JSON_OBJECT != p->tokens[object].type) return 0;
+
+    for (size_t member = 0, key = object + 1; member < p->tokens[object].size; member++, key = p->tokens[key + 1].next)
+        if (0 == strcmp (&p->json[p->tokens[key].start], name)) return key + 1;
+
+    return 0;
+}
+
+/// Return the string `value`; NULL if `value` is 0 or not a string (including null).
+static const char *
+wkJSONGetString (WKJSONParser *p, size_t value) {
+    return (WK_JSON_STRING == p->tokens[value].type
+            ? &p->json[p->tokens[value].start]
+            : NULL);
+}
+
+/// Return true and fill `number` if `value` is an unsigned integer less than 2^64.
+static bool
+wkJSONGetUInt64 (WKJSONParser *p, size_t value, uint64_t *number) {
+    if (WK_JSON_PRIMITIVE != p->tokens[value].type) return false;
+
+    uint64_t result = 0;
+    for (size_t index = p->tokens[value].start; index < p->tokens[value].end; index++) {
+        unsigned digit = (unsigned) (p->json[index] - '0');
+        if (digit > 9 || result > (UINT64_MAX - digit) / 10) return false;
+        result = 10 * result + digit;
+    }
+
+    *number = result;
+    return true;
+}
+
+///
+/// Return the seconds since the unix epoch for an ISO-8601 date, such as
+/// "2019-06-06T17:17:41.000+0000"; NO_WK_TIMESTAMP if `date` is NULL or malformed.
+///
+static WKTimestamp
+wkJSONGetTimestamp (const char *date) {
+    unsigned y, m, d, hh, mm, ss;
+    int used = 0;
+
+    if (NULL == date ||
+        6 != sscanf (date, "%4u-%2u-%2uT%2u:%2u:%2u%n", &y, &m, &d, &hh, &mm, &ss, &used) ||
+        m < 1 || m > 12 || d < 1 || d > 31 || hh > 23 || mm > 59 || ss > 60 || y < 1970)
+        return NO_WK_TIMESTAMP;
+
+    const char *zone = date + used;
+    if ('.' == *zone) for (zone++; *zone >= '0' && *zone <= '9'; zone++);
+
+    int64_t offset = 0;
+    if ('+' == zone[0] || '-' == zone[0]) {
+        unsigned zh, zm;
+        if (2 != sscanf (zone + 1, "%2u:%2u", &zh, &zm) &&
+            2 != sscanf (zone + 1, "%2u%2u",  &zh, &zm)) return NO_WK_TIMESTAMP;
+        offset = ('+' == zone[0] ? 1 : -1) * (int64_t) (60 * (60 * zh + zm));
+    }
+    else if ('Z' != zone[0] && '\0' != zone[0]) return NO_WK_TIMESTAMP;
+
+    // Days since the epoch in the proleptic Gregorian calendar; years begin in March
+    unsigned yr  = y - (m <= 2);
+    unsigned era = yr / 400;
+    unsigned yoe = yr - era * 400;
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = (int64_t) era * 146097 + (int64_t) doe - 719468;
+
+    int64_t seconds = days * 86400 + 3600 * hh + 60 * mm + ss - offset;
+    return (seconds > 0 ? AS_WK_TIMESTAMP ((uint64_t) seconds) : NO_WK_TIMESTAMP);
+}
+
+// A transfer, from a transaction's '_embedded.transfers', with strings into the parser's copy
+typedef struct {
+    const char *uids;
+    const char *source;
+    const char *target;
+    const char *amount;
+    const char *currency;
+    const char *transactionId;
+    uint64_t index;
+    size_t meta;
+} WKJSONTransfer;
+
+static bool
+wkJSONStringEqual (const char *s1, const char *s2) {
+    return s1 == s2 || (NULL != s1 && NULL != s2 && 0 == strcmp (s1, s2));
+}
+
+static bool
+wkJSONIsAddress (const char *address,
+                 const char **addresses,
+                 size_t addressesCount) {
+    for (size_t index = 0; NULL != address && index < addressesCount; index++)
+        if (0 == strcasecmp (address, addresses[index])) return true;
+    return false;
+}
+
+/// Add the string members of `meta`, replacing any existing value for the same key.  The arrays
+/// are passed by reference as adding to them may move them.
+static void
+wkJSONAddAttributes (WKJSONParser *p,
+                     size_t meta,
+                     BRArrayOf(const char *) *keys,
+                     BRArrayOf(const char *) *vals) {
+    if (WK_JSON_OBJECT != p->tokens[meta].type) return;
+
+    for (size_t member = 0, key = meta + 1; member < p->tokens[meta].size; member++, key = p->tokens[key + 1].next) {
+        const char *name  = &p->json[p->tokens[key].start];
+        const char *value = wkJSONGetString (p, key + 1);
+        if (NULL == value) continue;
+
+        size_t index;
+        for (index = 0; index < array_count (*keys) && 0 != strcmp ((*keys)[index], name); index++);
+        if (index < array_count (*keys)) (*vals)[index] = value;
+        else {
+            array_add (*keys, name);
+            array_add (*vals, value);
+        }
+    }
+}
+
+private_extern bool
+wkClientTransferBundlesCreateFromJSON (OwnershipKept const uint8_t *bytes,
+                                       size_t bytesCount,
+                                       OwnershipKept const char **addresses,
+                                       size_t addressesCount,
+                                       BRArrayOf(WKClientTransferBundle) *bundles) {
+    if (NULL == bytes || bytesCount >= UINT32_MAX) return false;
+
+    WKJSONParser parser = { malloc (bytesCount + 1), bytesCount, 0, NULL };
+    WKJSONParser *p = &parser;
+
+    memcpy (p->json, bytes, bytesCount);
+    p->json[bytesCount] = '\0';
+    array_new (p->tokens, 16 + bytesCount / 16);
+    array_add (p->tokens, ((WKJSONToken) { WK_JSON_NONE, 0, 0, 0, 1 }));
+
+    size_t bundlesCount = array_count (*bundles);
+
+    bool success = wkJSONParseValue (p, 0);
+    wkJSONSkipSpace (p);
+    success = success && p->pos == p->count;
+
+    // The transactions, from token 1, are either `{ "_embedded": { "transactions": [...] }}` or a
+    // bare array.  An object without "_embedded" holds no transactions.
+    size_t transactions = 0;
+    if (success) {
+        if (WK_JSON_ARRAY == p->tokens[1].type) transactions = 1;
+        else if (WK_JSON_OBJECT == p->tokens[1].type) {
+            size_t embedded = wkJSONObjectGet (p, 1, "_embedded");
+            transactions = wkJSONObjectGet (p, embedded, "transactions");
+            success = (0 == embedded || WK_JSON_ARRAY == p->tokens[transactions].type);
+        }
+        else success = false;
+    }
+
+    BRArrayOf(WKJSONTransfer) transfers;
+    BRArrayOf(const char *) keys;
+    BRArrayOf(const char *) vals;
+    array_new (transfers, 10);
+    array_new (keys, 10);
+    array_new (vals, 10);
+
+    for (size_t txIndex = 0, tx = transactions + 1; success && txIndex < p->tokens[transactions].size; txIndex++, tx = p->tokens[tx].next) {
+        const char *hash       = wkJSONGetString (p, wkJSONObjectGet (p, tx, "hash"));
+        const char *identifier = wkJSONGetString (p, wkJSONObjectGet (p, tx, "identifier"));
+        const char *status     = wkJSONGetString (p, wkJSONObjectGet (p, tx, "status"));
+        const char *blockHash  = wkJSONGetString (p, wkJSONObjectGet (p, tx, "block_hash"));
+        WKTimestamp timestamp  = wkJSONGetTimestamp (wkJSONGetString (p, wkJSONObjectGet (p, tx, "timestamp")));
+
+        uint64_t blockHeight, blockConfirmations, blockTransactionIndex;
+        if (!wkJSONGetUInt64 (p, wkJSONObjectGet (p, tx, "block_height"),  &blockHeight))           blockHeight = BLOCK_HEIGHT_UNBOUND;
+        if (!wkJSONGetUInt64 (p, wkJSONObjectGet (p, tx, "confirmations"), &blockConfirmations))    blockConfirmations = 0;
+        if (!wkJSONGetUInt64 (p, wkJSONObjectGet (p, tx, "index"),         &blockTransactionIndex)) blockTransactionIndex = 0;
+
+        size_t txMeta = wkJSONObjectGet (p, tx, "meta");
+
+        WKTransferStateType state;
+        if      (NULL == status)                     { success = false; break; }
+        else if (0 == strcmp (status, "confirmed"))  state = WK_TRANSFER_STATE_INCLUDED;
+        else if (0 == strcmp (status, "submitted") ||
+                 0 == strcmp (status, "reverted"))   state = WK_TRANSFER_STATE_SUBMITTED;
+        else if (0 == strcmp (status, "failed")    ||
+                 0 == strcmp (status, "rejected"))   state = WK_TRANSFER_STATE_ERRORED;
+        else                                         { success = false; break; }
+
+        if (NULL == hash || NULL == identifier) { success = false; break; }
+
+        // Only the transfers involving `addresses`
+        array_clear (transfers);
+        size_t transfersArray = wkJSONObjectGet (p, wkJSONObjectGet (p, tx, "_embedded"), "transfers");
+        size_t feeIndex  = SIZE_MAX;
+        size_t feesCount = 0;
+
+        if (0 != transfersArray && WK_JSON_ARRAY != p->tokens[transfersArray].type) { success = false; break; }
+
+        for (size_t index = 0, tr = transfersArray + 1; index < p->tokens[transfersArray].size; index++, tr = p->tokens[tr].next) {
+            size_t amount = wkJSONObjectGet (p, tr, "amount");
+            WKJSONTransfer transfer = {
+                wkJSONGetString (p, wkJSONObjectGet (p, tr, "transfer_id")),
+                wkJSONGetString (p, wkJSONObjectGet (p, tr, "from_address")),
+                wkJSONGetString (p, wkJSONObjectGet (p, tr, "to_address")),
+                wkJSONGetString (p, wkJSONObjectGet (p, amount, "amount")),
+                wkJSONGetString (p, wkJSONObjectGet (p, amount, "currency_id")),
+                wkJSONGetString (p, wkJSONObjectGet (p, tr, "transaction_id")),
+                0,
+                wkJSONObjectGet (p, tr, "meta")
+            };
+
+            if (NULL == transfer.uids || NULL == transfer.amount || NULL == transfer.currency ||
+                !wkJSONGetUInt64 (p, wkJSONObjectGet (p, tr, "index"), &transfer.index)) { success = false; break; }
+
+            if (!wkJSONIsAddress (transfer.source, addresses, addressesCount) &&
+                !wkJSONIsAddress (transfer.target, addresses, addressesCount)) continue;
+
+            if (wkJSONStringEqual (transfer.target, "__fee__")) {
+                feeIndex = array_count (transfers);
+                feesCount++;
+            }
+            array_add (transfers, transfer);
+        }
+        if (!success) break;
+
+        // A single "__fee__" transfer is merged into a transfer from the same source, preferably
+        // in the fee's currency; with no such transfer, the fee is paid by an 'unknown' transfer
+        // of zero.  The fee transfers themselves are only kept if there is more than one.
+        WKJSONTransfer fee = { NULL };
+        const char *feeUids = NULL;
+
+        if (1 == feesCount) {
+            fee = transfers[feeIndex];
+            array_rm (transfers, feeIndex);
+
+            size_t match = SIZE_MAX;
+            for (size_t index = 0; index < array_count (transfers); index++)
+                if (wkJSONStringEqual (transfers[index].transactionId, fee.transactionId) &&
+                    wkJSONStringEqual (transfers[index].source,        fee.source)) {
+                    if (SIZE_MAX == match) match = index;
+                    if (wkJSONStringEqual (transfers[index].currency, fee.currency)) { match = index; break; }
+                }
+
+            if (SIZE_MAX != match) feeUids = transfers[match].uids;
+            else {
+                array_add (transfers, ((WKJSONTransfer) {
+                    fee.uids, fee.source, "unknown", "0", fee.currency, fee.transactionId, fee.index, fee.meta
+                }));
+                feeUids = fee.uids;
+            }
+        }
+
+        for (size_t index = 0; index < array_count (transfers); index++) {
+            WKJSONTransfer *transfer = &transfers[index];
+
+            array_clear (keys);
+            array_clear (vals);
+            wkJSONAddAttributes (p, txMeta,         &keys, &vals);
+            wkJSONAddAttributes (p, transfer->meta, &keys, &vals);
+
+            array_add (*bundles, wkClientTransferBundleCreate (state,
+                                                               hash,
+                                                               identifier,
+                                                               transfer->uids,
+                                                               transfer->source,
+                                                               transfer->target,
+                                                               transfer->amount,
+                                                               transfer->currency,
+                                                               (NULL != feeUids && transfer->uids == feeUids
+                                                                ? fee.amount
+                                                                : NULL),
+                                                               transfer->index,
+                                                               timestamp,
+                                                               blockHeight,
+                                                               blockConfirmations,
+                                                               blockTransactionIndex,
+                                                               blockHash,
+                                                               array_count (keys),
+                                                               keys,
+                                                               vals));
+        }
+    }
+
+    // On failure, release the bundles created here
+    if (!success && array_count (*bundles) > bundlesCount) {
+        for (size_t index = bundlesCount; index < array_count (*bundles); index++)
+            wkClientTransferBundleRelease ((*bundles)[index]);
+        array_rm_range (*bundles, bundlesCount, array_count (*bundles) - bundlesCount);
+    }
+
+    array_free (transfers);
+    array_free (keys);
+    array_free (vals);
+    array_free (p->tokens);
+    free (p->json);
+
+    return success;
+}
+
+extern void
+wkClientAnnounceTransfersJSON (OwnershipKept WKWalletManager manager,
+                                   OwnershipGiven WKClientCallbackState callbackState,
+                                   OwnershipKept const uint8_t *bytes,
+                                   size_t bytesCount) {
+    assert (CLIENT_CALLBACK_REQUEST_TRANSFERS == callbackState->type);
+
+    BRArrayOf(char *) addresses = wkClientQRYGetAddresses (manager->qryManager, callbackState->u.getTransfers.addresses);
+
+    BRArrayOf (WKClientTransferBundle) eventBundles;
+    array_new (eventBundles, 100);
+
+    WKBoolean success = AS_WK_BOOLEAN (wkClientTransferBundlesCreateFromJSON (bytes,
+                                                                              bytesCount,
+                                                                              (const char **) addresses,
+                                                                              array_count (addresses),
+                                                                              &eventBundles));
+    wkClientQRYReleaseAddresses (addresses);
+
+    // The bundles are given to the event as is; there is nothing left to copy
+    WKClientAnnounceTransfersEvent event =
+    { { NULL, &handleClientAnnounceTransfersEventType },
+        wkWalletManagerTakeWeak(manager),
+        callbackState,
+        success,
+        WK_FALSE,
+        eventBundles };
+
+    eventHandlerSignalEvent (manager->handler, (BREvent *) &event);
+}
 
 // MARK: Announce Submit Transfer
 
@@ -1224,6 +2132,251 @@ wkClientQRYEstimateTransferFee (WKClientQRYManager qry,
     free (serialization);
 }
 
+// MARK: - Bundle Binary Coding
+
+//
+// The binary bundle format is a simple sequence of fields: integers are `BRVarInt` encoded;
+// strings are a one byte encoding tag followed by a `BRVarInt` length and the encoded bytes.
+// A string is encoded in its most compact form that decodes back to the identical string.
+//
+// Base58 strings are deliberately stored as text: re-encoding base58 on load costs more than
+// the handful of bytes saved.
+//
+typedef enum {
+    WK_CLIENT_BUNDLE_STRING_NULL,
+    WK_CLIENT_BUNDLE_STRING_TEXT,           // UTF-8 bytes, as is
+    WK_CLIENT_BUNDLE_STRING_HEX,            // lowercase hex, as bytes
+    WK_CLIENT_BUNDLE_STRING_HEX_PREFIXED,   // '0x' + lowercase hex, as bytes
+    WK_CLIENT_BUNDLE_STRING_DECIMAL         // canonical decimal integer, as UInt256 bytes
+} WKClientBundleStringEncoding;
+
+typedef struct {
+    uint8_t *bytes;
+    size_t   bytesCount;
+    size_t   bytesCapacity;
+} WKClientBundleWriter;
+
+static void
+wkClientBundleWriterReserve (WKClientBundleWriter *writer, size_t count) {
+    if (writer->bytesCount + count > writer->bytesCapacity) {
+        writer->bytesCapacity = 2 * (writer->bytesCount + count);
+        writer->bytes = realloc (writer->bytes, writer->bytesCapacity);
+    }
+}
+
+static void
+wkClientBundleWriteUInt64 (WKClientBundleWriter *writer, uint64_t value) {
+    wkClientBundleWriterReserve (writer, BRVarIntSize (value));
+    writer->bytesCount += BRVarIntSet (&writer->bytes[writer->bytesCount],
+                                       writer->bytesCapacity - writer->bytesCount,
+                                       value);
+}
+
+static void
+wkClientBundleWriteBytes (WKClientBundleWriter *writer,
+                          WKClientBundleStringEncoding encoding,
+                          const uint8_t *bytes,
+                          size_t bytesCount) {
+    wkClientBundleWriterReserve (writer, 1);
+    writer->bytes[writer->bytesCount++] = (uint8_t) encoding;
+
+    wkClientBundleWriteUInt64 (writer, bytesCount);
+
+    wkClientBundleWriterReserve (writer, bytesCount);
+    if (bytesCount > 0) memcpy (&writer->bytes[writer->bytesCount], bytes, bytesCount);
+    writer->bytesCount += bytesCount;
+}
+
+static bool
+wkClientBundleStringIsLowercaseHex (const char *string, size_t stringLength) {
+    if (0 == stringLength || 0 != stringLength % 2) return false;
+
+    for (size_t index = 0; index < stringLength; index++)
+        if (!(('0' <= string[index] && string[index] <= '9') ||
+              ('a' <= string[index] && string[index] <= 'f')))
+            return false;
+
+    return true;
+}
+
+static bool
+wkClientBundleStringIsCanonicalDecimal (const char *string, size_t stringLength) {
+    // At most 78 digits fit in a UInt256; no leading zeros other than "0" itself
+    if (0 == stringLength || stringLength > 78) return false;
+    if ('0' == string[0] && 1 != stringLength)  return false;
+
+    for (size_t index = 0; index < stringLength; index++)
+        if (!('0' <= string[index] && string[index] <= '9'))
+            return false;
+
+    return true;
+}
+
+static void
+wkClientBundleWriteString (WKClientBundleWriter *writer, const char *string) {
+    if (NULL == string) {
+        wkClientBundleWriteBytes (writer, WK_CLIENT_BUNDLE_STRING_NULL, NULL, 0);
+        return;
+    }
+
+    size_t stringLength = strlen (string);
+
+    // Decimal, as a UInt256 w/o leading zero bytes
+    if (wkClientBundleStringIsCanonicalDecimal (string, stringLength)) {
+        BRCoreParseStatus status;
+        UInt256 value = uint256CreateParse (string, 10, &status);
+
+        if (CORE_PARSE_OK == status) {
+            size_t valueCount = sizeof (value.u8);
+            while (valueCount > 0 && 0 == value.u8[valueCount - 1]) valueCount--;
+
+            wkClientBundleWriteBytes (writer, WK_CLIENT_BUNDLE_STRING_DECIMAL, value.u8, valueCount);
+            return;
+        }
+    }
+
+    // Hex, with or without a '0x' prefix
+    bool hasPrefix = (stringLength > 2 && '0' == string[0] && 'x' == string[1]);
+    const char *hex       = (hasPrefix ? &string[2]       : string);
+    size_t      hexLength = (hasPrefix ? stringLength - 2 : stringLength);
+
+    if (wkClientBundleStringIsLowercaseHex (hex, hexLength)) {
+        uint8_t bytes[hexLength / 2];
+        hexDecode (bytes, hexLength / 2, hex, hexLength);
+
+        wkClientBundleWriteBytes (writer,
+                                  (hasPrefix
+                                   ? WK_CLIENT_BUNDLE_STRING_HEX_PREFIXED
+                                   : WK_CLIENT_BUNDLE_STRING_HEX),
+                                  bytes, hexLength / 2);
+        return;
+    }
+
+    wkClientBundleWriteBytes (writer, WK_CLIENT_BUNDLE_STRING_TEXT, (const uint8_t *) string, stringLength);
+}
+
+///
+/// Format `value` in base 10.  Equivalent to `uint256CoerceString (value, 10)` but dividing
+/// out nine digits at a time, which matters when recovering many bundles at once.
+///
+static OwnershipGiven char *
+wkClientBundleDecimalString (UInt256 value) {
+    char   digits[80];   // 78 digits max
+    size_t index = sizeof (digits);
+
+    digits[--index] = '\0';
+
+    do {
+        uint32_t chunk;
+        value = uint256Div_Small (value, 1000000000, &chunk);
+
+        bool isLast = uint256EQL (value, UINT256_ZERO);
+
+        // Interior chunks are zero-padded to nine digits; the leading chunk is not.
+        for (size_t count = 0; count < 9 && (!isLast || 0 != chunk || 0 == count); count++) {
+            digits[--index] = (char) ('0' + chunk % 10);
+            chunk /= 10;
+        }
+    } while (!uint256EQL (value, UINT256_ZERO));
+
+    return strdup (&digits[index]);
+}
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t bytesCount;
+    size_t offset;
+    bool   error;
+} WKClientBundleReader;
+
+static uint64_t
+wkClientBundleReadUInt64 (WKClientBundleReader *reader) {
+    if (reader->error || reader->offset >= reader->bytesCount) {
+        reader->error = true;
+        return 0;
+    }
+
+    size_t   valueLength = 0;
+    uint64_t value = BRVarInt (&reader->bytes[reader->offset],
+                               reader->bytesCount - reader->offset,
+                               &valueLength);
+
+    if (reader->offset + valueLength > reader->bytesCount) {
+        reader->error = true;
+        return 0;
+    }
+
+    reader->offset += valueLength;
+    return value;
+}
+
+static OwnershipGiven char *
+wkClientBundleReadString (WKClientBundleReader *reader) {
+    if (reader->error || reader->offset >= reader->bytesCount) {
+        reader->error = true;
+        return NULL;
+    }
+
+    WKClientBundleStringEncoding encoding = (WKClientBundleStringEncoding) reader->bytes[reader->offset++];
+    uint64_t bytesCount = wkClientBundleReadUInt64 (reader);
+
+    if (reader->error || bytesCount > reader->bytesCount - reader->offset) {
+        reader->error = true;
+        return NULL;
+    }
+
+    const uint8_t *bytes = &reader->bytes[reader->offset];
+    reader->offset += bytesCount;
+
+    char *string = NULL;
+
+    switch (encoding) {
+        case WK_CLIENT_BUNDLE_STRING_NULL:
+            break;
+
+        case WK_CLIENT_BUNDLE_STRING_TEXT:
+            string = malloc (bytesCount + 1);
+            memcpy (string, bytes, bytesCount);
+            string[bytesCount] = '\0';
+            break;
+
+        case WK_CLIENT_BUNDLE_STRING_HEX:
+        case WK_CLIENT_BUNDLE_STRING_HEX_PREFIXED: {
+            size_t prefixLength = (WK_CLIENT_BUNDLE_STRING_HEX_PREFIXED == encoding ? 2 : 0);
+            size_t stringLength = prefixLength + hexEncodeLength (bytesCount);
+
+            string = malloc (stringLength);
+            if (prefixLength > 0) { string[0] = '0'; string[1] = 'x'; }
+            hexEncode (&string[prefixLength], stringLength - prefixLength, bytes, bytesCount);
+            break;
+        }
+
+        case WK_CLIENT_BUNDLE_STRING_DECIMAL: {
+            UInt256 value = UINT256_ZERO;
+            if (bytesCount > sizeof (value.u8)) { reader->error = true; break; }
+
+            memcpy (value.u8, bytes, bytesCount);
+            string = wkClientBundleDecimalString (value);
+            break;
+        }
+
+        default:
+            reader->error = true;
+            break;
+    }
+
+    return string;
+}
+
+static OwnershipGiven const char *
+wkClientBundleReadStringInterned (WKClientBundleReader *reader) {
+    char *string = wkClientBundleReadString (reader);
+    const char *interned = wkStringIntern (string);
+
+    free (string);
+    return interned;
+}
+
 // MARK: - Transfer Bundle
 
 extern WKClientTransferBundle
@@ -1254,13 +2407,13 @@ wkClientTransferBundleCreate (WKTransferStateType status,
     // so as to avoid simply creating a transaction to cause it again.
 
     bundle->status     = status;
-    bundle->hash       = strdup (hash);
-    bundle->identifier = strdup (identifier);
-    bundle->uids       = strdup (uids);
-    bundle->from     = strdup (from);
-    bundle->to       = strdup (to);
+    bundle->hash       = wkStringIntern (hash);
+    bundle->identifier = wkStringIntern (identifier);
+    bundle->uids       = wkStringIntern (uids);
+    bundle->from     = wkStringIntern (from);
+    bundle->to       = wkStringIntern (to);
     bundle->amount   = strdup (amount);
-    bundle->currency = strdup (currency);
+    bundle->currency = wkStringIntern (currency);
     bundle->fee      = NULL == fee ? NULL : strdup (fee);
 
     bundle->transferIndex = transferIndex;
@@ -1268,17 +2421,18 @@ wkClientTransferBundleCreate (WKTransferStateType status,
     bundle->blockNumber    = blockNumber;
     bundle->blockConfirmations    = blockConfirmations;
     bundle->blockTransactionIndex = blockTransactionIndex;
-    bundle->blockHash = strdup (blockHash);
+    bundle->blockHash = wkStringIntern (blockHash);
 
     // attributes
     bundle->attributesCount = attributesCount;
-    bundle->attributeKeys = bundle->attributeVals = NULL;
+    bundle->attributeKeys = NULL;
+    bundle->attributeVals = NULL;
 
     if (bundle->attributesCount > 0) {
-        bundle->attributeKeys = calloc (bundle->attributesCount, sizeof (char*));
+        bundle->attributeKeys = calloc (bundle->attributesCount, sizeof (const char*));
         bundle->attributeVals = calloc (bundle->attributesCount, sizeof (char*));
         for (size_t index = 0; index < bundle->attributesCount; index++) {
-            bundle->attributeKeys[index] = strdup (attributeKeys[index]);
+            bundle->attributeKeys[index] = wkStringIntern (attributeKeys[index]);
             bundle->attributeVals[index] = strdup (attributeVals[index]);
         }
     }
@@ -1289,23 +2443,23 @@ wkClientTransferBundleCreate (WKTransferStateType status,
 extern void
 wkClientTransferBundleRelease (WKClientTransferBundle bundle) {
     //
-    free (bundle->uids);
-    free (bundle->hash);
-    free (bundle->identifier);
-    free (bundle->from);
-    free (bundle->to);
+    wkStringInternGive (bundle->uids);
+    wkStringInternGive (bundle->hash);
+    wkStringInternGive (bundle->identifier);
+    wkStringInternGive (bundle->from);
+    wkStringInternGive (bundle->to);
     free (bundle->amount);
-    free (bundle->currency);
+    wkStringInternGive (bundle->currency);
     if (NULL != bundle->fee) free (bundle->fee);
 
-    free (bundle->blockHash);
+    wkStringInternGive (bundle->blockHash);
 
     if (bundle->attributesCount > 0) {
         for (size_t index = 0; index < bundle->attributesCount; index++) {
-            free (bundle->attributeKeys[index]);
+            wkStringInternGive (bundle->attributeKeys[index]);
             free (bundle->attributeVals[index]);
         }
-        free (bundle->attributeKeys);
+        free ((void *) bundle->attributeKeys);
         free (bundle->attributeVals);
     }
     
@@ -1436,7 +2590,7 @@ wkClientTransferBundleRlpEncode (WKClientTransferBundle bundle,
                           rlpEncodeUInt64 (coder, bundle->blockTransactionIndex, 0),
                           rlpEncodeString (coder, bundle->blockHash),
                           wkClientTransferBundleRlpEncodeAttributes (bundle->attributesCount,
-                                                                     (const char **) bundle->attributeKeys,
+                                                                     bundle->attributeKeys,
                                                                      (const char **) bundle->attributeVals,
                                                                      coder),
                           rlpEncodeUInt64 (coder, bundle->transferIndex,         0));
@@ -1550,7 +2704,97 @@ wkClientTransferBundleGetHashValue (WKClientTransferBundle bundle) {
 private_extern int
 wkClientTransferBundleIsEqual (WKClientTransferBundle bundle1,
                                    WKClientTransferBundle bundle2) {
-    return 0 == strcmp (bundle1->uids, bundle2->uids);
+    return bundle1->uids == bundle2->uids;    // interned
+}
+
+private_extern OwnershipGiven uint8_t *
+wkClientTransferBundleSerialize (WKClientTransferBundle bundle,
+                                 size_t *bytesCount) {
+    WKClientBundleWriter writer = { NULL, 0, 0 };
+    wkClientBundleWriterReserve (&writer, 256);
+
+    wkClientBundleWriteUInt64 (&writer, bundle->status);
+    wkClientBundleWriteString (&writer, bundle->uids);
+    wkClientBundleWriteString (&writer, bundle->hash);
+    wkClientBundleWriteString (&writer, bundle->identifier);
+    wkClientBundleWriteString (&writer, bundle->from);
+    wkClientBundleWriteString (&writer, bundle->to);
+    wkClientBundleWriteString (&writer, bundle->amount);
+    wkClientBundleWriteString (&writer, bundle->currency);
+    wkClientBundleWriteString (&writer, bundle->fee);
+    wkClientBundleWriteUInt64 (&writer, bundle->transferIndex);
+    wkClientBundleWriteUInt64 (&writer, bundle->blockTimestamp);
+    wkClientBundleWriteUInt64 (&writer, bundle->blockNumber);
+    wkClientBundleWriteUInt64 (&writer, bundle->blockConfirmations);
+    wkClientBundleWriteUInt64 (&writer, bundle->blockTransactionIndex);
+    wkClientBundleWriteString (&writer, bundle->blockHash);
+
+    wkClientBundleWriteUInt64 (&writer, bundle->attributesCount);
+    for (size_t index = 0; index < bundle->attributesCount; index++) {
+        wkClientBundleWriteString (&writer, bundle->attributeKeys[index]);
+        wkClientBundleWriteString (&writer, bundle->attributeVals[index]);
+    }
+
+    *bytesCount = writer.bytesCount;
+    return writer.bytes;
+}
+
+private_extern WKClientTransferBundle
+wkClientTransferBundleDeserialize (const uint8_t *bytes,
+                                   size_t bytesCount) {
+    WKClientBundleReader reader = { bytes, bytesCount, 0, false };
+
+    // Strings are decoded directly into the bundle; avoid the copies of `...BundleCreate()`
+    WKClientTransferBundle bundle = calloc (1, sizeof (struct WKClientTransferBundleRecord));
+
+    bundle->status     = (WKTransferStateType) wkClientBundleReadUInt64 (&reader);
+    bundle->uids       = wkClientBundleReadStringInterned (&reader);
+    bundle->hash       = wkClientBundleReadStringInterned (&reader);
+    bundle->identifier = wkClientBundleReadStringInterned (&reader);
+    bundle->from       = wkClientBundleReadStringInterned (&reader);
+    bundle->to         = wkClientBundleReadStringInterned (&reader);
+    bundle->amount     = wkClientBundleReadString (&reader);
+    bundle->currency   = wkClientBundleReadStringInterned (&reader);
+    bundle->fee        = wkClientBundleReadString (&reader);
+
+    bundle->transferIndex         = wkClientBundleReadUInt64 (&reader);
+    bundle->blockTimestamp        = wkClientBundleReadUInt64 (&reader);
+    bundle->blockNumber           = wkClientBundleReadUInt64 (&reader);
+    bundle->blockConfirmations    = wkClientBundleReadUInt64 (&reader);
+    bundle->blockTransactionIndex = wkClientBundleReadUInt64 (&reader);
+    bundle->blockHash             = wkClientBundleReadStringInterned (&reader);
+
+    uint64_t attributesCount = wkClientBundleReadUInt64 (&reader);
+
+    // Each attribute requires at least four bytes; guard against a bogus count.
+    if (!reader.error && attributesCount > 0 && attributesCount <= (bytesCount - reader.offset) / 4) {
+        bundle->attributesCount = (size_t) attributesCount;
+        bundle->attributeKeys   = calloc (bundle->attributesCount, sizeof (const char*));
+        bundle->attributeVals   = calloc (bundle->attributesCount, sizeof (char*));
+
+        for (size_t index = 0; index < bundle->attributesCount; index++) {
+            bundle->attributeKeys[index] = wkClientBundleReadStringInterned (&reader);
+            bundle->attributeVals[index] = wkClientBundleReadString (&reader);
+        }
+    }
+    else if (attributesCount > 0) reader.error = true;
+
+    // All of these are required; only `fee` is optional.
+    if (reader.error ||
+        NULL == bundle->uids || NULL == bundle->hash     || NULL == bundle->identifier ||
+        NULL == bundle->from || NULL == bundle->to       || NULL == bundle->amount     ||
+        NULL == bundle->currency || NULL == bundle->blockHash) {
+        wkClientTransferBundleRelease (bundle);
+        return NULL;
+    }
+
+    for (size_t index = 0; index < bundle->attributesCount; index++)
+        if (NULL == bundle->attributeKeys[index] || NULL == bundle->attributeVals[index]) {
+            wkClientTransferBundleRelease (bundle);
+            return NULL;
+        }
+
+    return bundle;
 }
 
 // MARK: - Transaction Bundle
@@ -1648,6 +2892,48 @@ wkClientTransactionBundleIsEqual (WKClientTransactionBundle bundle1,
             0 == memcmp (bundle1->serialization, bundle2->serialization, bundle1->serializationCount));
 }
 
+private_extern OwnershipGiven uint8_t *
+wkClientTransactionBundleSerialize (WKClientTransactionBundle bundle,
+                                    size_t *bytesCount) {
+    WKClientBundleWriter writer = { NULL, 0, 0 };
+    wkClientBundleWriterReserve (&writer, 32 + bundle->serializationCount);
+
+    wkClientBundleWriteUInt64 (&writer, bundle->status);
+    wkClientBundleWriteUInt64 (&writer, bundle->timestamp);
+    wkClientBundleWriteUInt64 (&writer, bundle->blockHeight);
+    wkClientBundleWriteBytes  (&writer, WK_CLIENT_BUNDLE_STRING_TEXT,
+                               bundle->serialization,
+                               bundle->serializationCount);
+
+    *bytesCount = writer.bytesCount;
+    return writer.bytes;
+}
+
+private_extern WKClientTransactionBundle
+wkClientTransactionBundleDeserialize (const uint8_t *bytes,
+                                      size_t bytesCount) {
+    WKClientBundleReader reader = { bytes, bytesCount, 0, false };
+
+    WKTransferStateType status      = (WKTransferStateType) wkClientBundleReadUInt64 (&reader);
+    WKTimestamp         timestamp   = wkClientBundleReadUInt64 (&reader);
+    WKBlockNumber       blockHeight = wkClientBundleReadUInt64 (&reader);
+
+    // The serialization is raw bytes, tagged as TEXT; read it in place.
+    if (reader.error || reader.offset >= bytesCount ||
+        WK_CLIENT_BUNDLE_STRING_TEXT != bytes[reader.offset++])
+        return NULL;
+
+    uint64_t serializationCount = wkClientBundleReadUInt64 (&reader);
+    if (reader.error || serializationCount > bytesCount - reader.offset)
+        return NULL;
+
+    return wkClientTransactionBundleCreate (status,
+                                            (uint8_t *) &bytes[reader.offset],
+                                            (size_t) serializationCount,
+                                            timestamp,
+                                            blockHeight);
+}
+
 // MARK: - Currency, CurrencyDenomination Bundle
 
 static WKClientCurrencyDenominationBundle
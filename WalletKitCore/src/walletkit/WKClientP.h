@@ -50,6 +50,22 @@ private_extern WKClientTransactionBundle
 wkClientTransactionBundleRlpDecode (BRRlpItem item,
                                         BRRlpCoder coder);
 
+/**
+ * Serialize `bundle` in the compact binary format used by the file service, as of
+ * WK_FILE_SERVICE_TYPE_TRANSACTION_VERSION_2.  The returned bytes are owned by the caller.
+ */
+private_extern OwnershipGiven uint8_t *
+wkClientTransactionBundleSerialize (WKClientTransactionBundle bundle,
+                                    size_t *bytesCount);
+
+/**
+ * Deserialize a bundle from `wkClientTransactionBundleSerialize()` bytes.  Returns NULL if the
+ * bytes are malformed.
+ */
+private_extern WKClientTransactionBundle
+wkClientTransactionBundleDeserialize (const uint8_t *bytes,
+                                      size_t bytesCount);
+
 // For BRSet
 private_extern size_t
 wkClientTransactionBundleGetHashValue (WKClientTransactionBundle bundle);
@@ -74,25 +90,27 @@ wkClientTransactionBundleSetRelease (BRSetOf(WKClientTransactionBundle) bundles)
 
 // MARK: - Transfer Bundle
 
+// The `hash`, `identifier`, `uids`, `from`, `to`, `currency`, `blockHash` and `attributeKeys`
+// strings are interned (see `wkStringIntern()`); they repeat across bundles and transfers.
 struct WKClientTransferBundleRecord {
     WKTransferStateType status;
-    char *hash;
-    char *identifier;
-    char *uids;
-    char *from;
-    char *to;
+    const char *hash;
+    const char *identifier;
+    const char *uids;
+    const char *from;
+    const char *to;
     char *amount;
-    char *currency;
+    const char *currency;
     char *fee;
     uint64_t transferIndex;
     WKTimestamp blockTimestamp;
     WKBlockNumber blockNumber;
     WKBlockNumber blockConfirmations;
     uint64_t blockTransactionIndex;
-    char *blockHash;
+    const char *blockHash;
 
     size_t attributesCount;
-    char **attributeKeys;
+    const char **attributeKeys;
     char **attributeVals;
 };
 
@@ -105,6 +123,24 @@ wkClientTransferBundleRlpDecode (BRRlpItem item,
                                  BRRlpCoder coder,
                                  WKFileServiceTransferVersion version);
 
+/**
+ * Serialize `bundle` in the compact binary format used by the file service, as of
+ * WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_3.  Hex strings (hashes, addresses) are stored as raw bytes
+ * and decimal integers (amount, fee) as UInt256 bytes, whenever doing so round-trips exactly;
+ * otherwise the string is stored verbatim.  The returned bytes are owned by the caller.
+ */
+private_extern OwnershipGiven uint8_t *
+wkClientTransferBundleSerialize (WKClientTransferBundle bundle,
+                                 size_t *bytesCount);
+
+/**
+ * Deserialize a bundle from `wkClientTransferBundleSerialize()` bytes.  Returns NULL if the
+ * bytes are malformed.
+ */
+private_extern WKClientTransferBundle
+wkClientTransferBundleDeserialize (const uint8_t *bytes,
+                                   size_t bytesCount);
+
 // For BRSet
 private_extern size_t
 wkClientTransferBundleGetHashValue (WKClientTransferBundle bundle);
@@ -126,6 +162,19 @@ wkClientTransferBundleSetRelease (BRSetOf(WKClientTransferBundle) bundles) {
     BRSetFreeAll(bundles, (void (*) (void *)) wkClientTransferBundleRelease);
 }
 
+/**
+ * Create bundles, appended to `bundles`, for the transfers involving `addresses` in the JSON of a
+ * `GET /transactions` response.  A transaction's single "__fee__" transfer is merged into one of
+ * its other transfers.  Returns false, with no bundles appended, if `bytes` is not valid JSON or
+ * a transaction or transfer lacks a required field.
+ */
+private_extern bool
+wkClientTransferBundlesCreateFromJSON (OwnershipKept const uint8_t *bytes,
+                                       size_t bytesCount,
+                                       OwnershipKept const char **addresses,
+                                       size_t addressesCount,
+                                       BRArrayOf(WKClientTransferBundle) *bundles);
+
 // MARK: - Currency / Currency Denomination Bundle
 
 struct WKCliehtCurrencyDenominationBundleRecord {
@@ -337,6 +386,16 @@ typedef enum {
     WK_CLIENT_REQUEST_USE_TRANSACTIONS,
 } WKClientQRYByType;
 
+///
+/// A {transaction,transfer} request in flight, identified by its `callbackState`, with the highest
+/// block number of the bundles announced for it so far.  As a request's pages are announced in
+/// ascending block order, it will announce no bundle below `blockNumber`.
+///
+typedef struct {
+    WKClientCallbackState callbackState;
+    WKBlockNumber blockNumber;
+} WKClientQRYRequest;
+
 struct WKClientQRYManagerRecord {
     WKClient client;
     WKWalletManager manager;
@@ -350,15 +409,35 @@ struct WKClientQRYManagerRecord {
         WKBlockNumber begBlockNumber;
         WKBlockNumber endBlockNumber;
         size_t rid;
+
+        // Recovery state.  `addresses` holds every address requested during this sync; `queued`
+        // holds those not yet requested.  `addressesVersion` is the wallet's recovery address
+        // version as of the last addresses queued.  Bundles are held until no request, queued or
+        // in flight, can yet announce a bundle in a lower block; they are then recovered together,
+        // in block order.
+        BRSetOf(WKAddress) addresses;
+        size_t addressesVersion;
+        BRArrayOf(WKAddress) queued;
+        BRArrayOf(WKClientTransactionBundle) transactionBundles;
+        BRArrayOf(WKClientTransferBundle) transferBundles;
+        BRArrayOf(WKClientQRYRequest) requests;
+
+        // The highest block number recovered so far; drives the sync's progress events.
+        WKBlockNumber pagedBlockNumber;
     } sync;
 
     bool connected;
     size_t requestId;
 
+    size_t addressChunkSize;        // maximum addresses in a single {transaction,transfer} request
+    size_t requestsInFlightLimit;   // maximum concurrent {transaction,transfer} requests
+
     pthread_mutex_t lock;
 };
 
-#define WK_CLIENT_QRY_IS_UNBOUNDED            (true)
+#define WK_CLIENT_QRY_IS_UNBOUNDED                  (true)
+#define WK_CLIENT_QRY_ADDRESS_CHUNK_SIZE            (100)
+#define WK_CLIENT_QRY_REQUESTS_IN_FLIGHT_LIMIT      (4)
 
 extern WKClientQRYManager
 wkClientQRYManagerCreate (WKClient client,
@@ -379,6 +458,13 @@ wkClientQRYManagerDisconnect (WKClientQRYManager qry);
 extern void
 wkClientQRYManagerTickTock (WKClientQRYManager qry);
 
+/// Set the number of addresses per {transaction,transfer} request and the number of requests
+/// that may be in flight at once.  Takes effect for requests made after the call.
+extern void
+wkClientQRYManagerSetRecoveryLimits (WKClientQRYManager qry,
+                                         size_t addressChunkSize,
+                                         size_t requestsInFlightLimit);
+
 extern void
 wkClientQRYEstimateTransferFee (WKClientQRYManager qry,
                                     WKCookie   cookie,
@@ -9,16 +9,18 @@
 //  See the CONTRIBUTORS file at the project root for a list of contributors.
 
 #include "WKCurrency.h"
+#include "WKBaseP.h"
 
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
+// The `uids`, `code` and `type` are interned; see `wkStringIntern()`
 struct WKCurrencyRecord {
-    char *uids;
+    const char *uids;
     char *name;
-    char *code;
-    char *type;
+    const char *code;
+    const char *type;
     char *issuer;
     WKRef ref;
 };
@@ -33,10 +35,10 @@ wkCurrencyCreate (const char *uids,
                       const char *issuer) {
     WKCurrency currency = malloc (sizeof (struct WKCurrencyRecord));
 
-    currency->uids = strdup (uids);
+    currency->uids = wkStringIntern (uids);
     currency->name = strdup (name);
-    currency->code = strdup (code);
-    currency->type = strdup (type);
+    currency->code = wkStringIntern (code);
+    currency->type = wkStringIntern (type);
     currency->issuer = (NULL == issuer ? NULL : strdup (issuer));
     currency->ref  = WK_REF_ASSIGN (wkCurrencyRelease);
 
@@ -45,10 +47,10 @@ wkCurrencyCreate (const char *uids,
 
 static void
 wkCurrencyRelease (WKCurrency currency) {
-    free (currency->type);
-    free (currency->code);
+    wkStringInternGive (currency->type);
+    wkStringInternGive (currency->code);
     free (currency->name);
-    free (currency->uids);
+    wkStringInternGive (currency->uids);
     if (NULL != currency->issuer) free (currency->issuer);
 
     memset (currency, 0, sizeof(*currency));
@@ -93,6 +93,31 @@ wkFileServiceTypeTransferV1Writer (BRFileServiceContext context,
     return data.bytes;
 }
 
+private_extern void *
+wkFileServiceTypeTransferV3Reader (BRFileServiceContext context,
+                                   BRFileService fs,
+                                   uint8_t *bytes,
+                                   uint32_t bytesCount) {
+    WKWalletManager manager = (WKWalletManager) context; (void) manager;
+
+    return wkClientTransferBundleDeserialize (bytes, bytesCount);
+}
+
+private_extern uint8_t *
+wkFileServiceTypeTransferV3Writer (BRFileServiceContext context,
+                                   BRFileService fs,
+                                   const void* entity,
+                                   uint32_t *bytesCount) {
+    WKWalletManager        manager = (WKWalletManager) context; (void) manager;
+    WKClientTransferBundle bundle  = (WKClientTransferBundle) entity;
+
+    size_t   count = 0;
+    uint8_t *bytes = wkClientTransferBundleSerialize (bundle, &count);
+
+    *bytesCount = (uint32_t) count;
+    return bytes;
+}
+
 // MARK: - Client Transaction Bundle
 
 private_extern UInt256
@@ -148,11 +173,36 @@ wkFileServiceTypeTransactionV1Writer (BRFileServiceContext context,
     return data.bytes;
 }
 
+private_extern void *
+wkFileServiceTypeTransactionV2Reader (BRFileServiceContext context,
+                                      BRFileService fs,
+                                      uint8_t *bytes,
+                                      uint32_t bytesCount) {
+    WKWalletManager manager = (WKWalletManager) context; (void) manager;
+
+    return wkClientTransactionBundleDeserialize (bytes, bytesCount);
+}
+
+private_extern uint8_t *
+wkFileServiceTypeTransactionV2Writer (BRFileServiceContext context,
+                                      BRFileService fs,
+                                      const void* entity,
+                                      uint32_t *bytesCount) {
+    WKWalletManager           manager = (WKWalletManager) context; (void) manager;
+    WKClientTransactionBundle bundle  = (WKClientTransactionBundle) entity;
+
+    size_t   count = 0;
+    uint8_t *bytes = wkClientTransactionBundleSerialize (bundle, &count);
+
+    *bytesCount = (uint32_t) count;
+    return bytes;
+}
+
 BRFileServiceTypeSpecification wkFileServiceSpecifications[] = {
     {
         WK_FILE_SERVICE_TYPE_TRANSFER,
-        WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_2, // current version
-        2,
+        WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_3, // current version
+        3,
         {
             {
                 WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_1,
@@ -167,13 +217,20 @@ BRFileServiceTypeSpecification wkFileServiceSpecifications[] = {
                 wkFileServiceTypeTransferV2Reader,
                 wkFileServiceTypeTransferV1Writer
             },
+
+            {
+                WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_3,
+                wkFileServiceTypeTransferV1Identifier,
+                wkFileServiceTypeTransferV3Reader,
+                wkFileServiceTypeTransferV3Writer
+            },
         }
     },
 
     {
         WK_FILE_SERVICE_TYPE_TRANSACTION,
-        WK_FILE_SERVICE_TYPE_TRANSACTION_VERSION_1, // current version
-        1,
+        WK_FILE_SERVICE_TYPE_TRANSACTION_VERSION_2, // current version
+        2,
         {
             {
                 WK_FILE_SERVICE_TYPE_TRANSACTION_VERSION_1,
@@ -181,6 +238,13 @@ BRFileServiceTypeSpecification wkFileServiceSpecifications[] = {
                 wkFileServiceTypeTransactionV1Reader,
                 wkFileServiceTypeTransactionV1Writer
             },
+
+            {
+                WK_FILE_SERVICE_TYPE_TRANSACTION_VERSION_2,
+                wkFileServiceTypeTransactionV1Identifier,
+                wkFileServiceTypeTransactionV2Reader,
+                wkFileServiceTypeTransactionV2Writer
+            },
         }
     }
 };
@@ -23,7 +23,8 @@ extern "C" {
 
 typedef enum {
     WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_1,
-    WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_2
+    WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_2,
+    WK_FILE_SERVICE_TYPE_TRANSFER_VERSION_3     // binary, not RLP
 } WKFileServiceTransferVersion;
 
 private_extern UInt256
@@ -49,11 +50,24 @@ wkFileServiceTypeTransferV1Writer (BRFileServiceContext context,
                                  const void* entity,
                                  uint32_t *bytesCount);
 
+private_extern void *
+wkFileServiceTypeTransferV3Reader (BRFileServiceContext context,
+                                   BRFileService fs,
+                                   uint8_t *bytes,
+                                   uint32_t bytesCount);
+
+private_extern uint8_t *
+wkFileServiceTypeTransferV3Writer (BRFileServiceContext context,
+                                   BRFileService fs,
+                                   const void* entity,
+                                   uint32_t *bytesCount);
+
 
 #define WK_FILE_SERVICE_TYPE_TRANSACTION      "crypto_transactions"
 
 typedef enum {
-    WK_FILE_SERVICE_TYPE_TRANSACTION_VERSION_1
+    WK_FILE_SERVICE_TYPE_TRANSACTION_VERSION_1,
+    WK_FILE_SERVICE_TYPE_TRANSACTION_VERSION_2  // binary, not RLP
 } WKFileServiceTransactionVersion;
 
 private_extern UInt256
@@ -73,6 +87,18 @@ wkFileServiceTypeTransactionV1Writer (BRFileServiceContext context,
                                     const void* entity,
                                     uint32_t *bytesCount);
 
+private_extern void *
+wkFileServiceTypeTransactionV2Reader (BRFileServiceContext context,
+                                      BRFileService fs,
+                                      uint8_t *bytes,
+                                      uint32_t bytesCount);
+
+private_extern uint8_t *
+wkFileServiceTypeTransactionV2Writer (BRFileServiceContext context,
+                                      BRFileService fs,
+                                      const void* entity,
+                                      uint32_t *bytesCount);
+
 extern BRFileServiceTypeSpecification wkFileServiceSpecifications[];
 extern size_t wkFileServiceSpecificationsCount;
 
@@ -361,7 +361,8 @@ wkNetworkGetCurrencyForUids (WKNetwork network,
     WKCurrency currency = NULL;
     pthread_mutex_lock (&network->lock);
     for (size_t index = 0; index < array_count(network->associations); index++) {
-        if (0 == strcasecmp (uids, wkCurrencyGetUids (network->associations[index].currency))) {
+        const char *currencyUids = wkCurrencyGetUids (network->associations[index].currency);
+        if (uids == currencyUids || 0 == strcasecmp (uids, currencyUids)) {
             currency = wkCurrencyTake (network->associations[index].currency);
             break;
         }
@@ -192,7 +192,7 @@ wkTransferAllocAndInit (size_t sizeInBytes,
     transfer->sizeInBytes = sizeInBytes;
 
     transfer->listener   = listener;
-    transfer->uids       = (NULL == uids ? NULL : strdup (uids));
+    transfer->uids       = wkStringIntern (uids);
     transfer->unit       = wkUnitTake(unit);
     transfer->unitForFee = wkUnitTake(unitForFee);
     transfer->feeBasisEstimated = wkFeeBasisTake (feeBasisEstimated);
@@ -223,7 +223,7 @@ static void
 wkTransferRelease (WKTransfer transfer) {
     pthread_mutex_lock (&transfer->lock);
 
-    if (NULL != transfer->uids) free (transfer->uids);
+    wkStringInternGive (transfer->uids);
     if (NULL != transfer->identifier) free (transfer->identifier);
     wkAddressGive (transfer->sourceAddress);
     wkAddressGive (transfer->targetAddress);
@@ -417,8 +417,8 @@ wkTransferSetUids (WKTransfer transfer,
     assert (NULL == transfer->uids || NULL == uids || 0 == strcmp (uids, transfer->uids));
 
     pthread_mutex_lock (&transfer->lock);
-    if (NULL != transfer->uids) free (transfer->uids);
-    transfer->uids = (NULL == uids ? NULL : strdup (uids));
+    wkStringInternGive (transfer->uids);
+    transfer->uids = wkStringIntern (uids);
     pthread_mutex_unlock (&transfer->lock);
 }
 
@@ -567,7 +567,7 @@ wkTransferEqual (WKTransfer t1, WKTransfer t2) {
     pthread_mutex_unlock (&t2->lock);
 
     return AS_WK_BOOLEAN (NULL != t1uids && NULL != t2uids
-                              ? 0 == strcmp (t1uids, t2uids)
+                              ? t1uids == t2uids     // interned
                               : t1->handlers->isEqual (t1, t2));
 }
 
@@ -734,7 +734,7 @@ wkTransferSubmitErrorGetMessage (WKTransferSubmitError *e) {
 /// MARK: - Transfer Attribute
 
 struct WKTransferAttributeRecord {
-    char *key;
+    const char *key;        // interned
     char *value;
     WKBoolean isRequired;
     WKRef ref;
@@ -748,7 +748,7 @@ wkTransferAttributeCreate (const char *key,
                                WKBoolean isRequired) {
     WKTransferAttribute attribute = calloc (1, sizeof (struct WKTransferAttributeRecord));
 
-    attribute->key   = strdup (key);
+    attribute->key   = wkStringIntern (key);
     attribute->value = (NULL == val ? NULL : strdup (val));
     attribute->isRequired = isRequired;
 
@@ -766,7 +766,7 @@ wkTransferAttributeCopy (WKTransferAttribute attribute) {
 
 static void
 wkTransferAttributeRelease (WKTransferAttribute attribute) {
-    free (attribute->key);
+    wkStringInternGive (attribute->key);
     if (NULL != attribute->value) free (attribute->value);
     memset (attribute, 0, sizeof (struct WKTransferAttributeRecord));
     free (attribute);
@@ -131,7 +131,7 @@ struct WKTransferRecord {
     ///
     /// The UIDS can not exist until the transaction has been processed into its one or more
     /// transfers.  When a transfer is created this value will be NULL.
-    char *uids;
+    const char *uids;        // interned
 
     /// The identifier for this transfer's originating transaction.  This is usually the string
     /// representation of a hash; however some currencies, notably Hedera, have identifier that
@@ -777,14 +777,18 @@ private_extern WKTransfer
 wkWalletGetTransferByUIDS (WKWallet wallet, const char *uids) {
     WKTransfer transfer = NULL;
 
+    // Transfer uids are interned; intern `uids` so that matching is a pointer compare.
+    const char *internedUIDS = wkStringIntern (uids);
+
     pthread_mutex_lock (&wallet->lock);
-    for (size_t index = 0; NULL == transfer && index < array_count(wallet->transfers); index++) {
-        const char *transferUIDS = wallet->transfers[index]->uids;
-        if (NULL != transferUIDS && 0 == strcmp (transferUIDS, uids))
+    for (size_t index = 0; NULL != internedUIDS && NULL == transfer && index < array_count(wallet->transfers); index++) {
+        if (internedUIDS == wallet->transfers[index]->uids)
             transfer = wallet->transfers[index];
     }
     pthread_mutex_unlock (&wallet->lock);
 
+    wkStringInternGive (internedUIDS);
+
     return wkTransferTake (transfer);
 }
 
@@ -839,6 +843,14 @@ wkWalletGetAddressesForRecovery (WKWallet wallet) {
     return wallet->handlers->getAddressesForRecovery (wallet);
 }
 
+private_extern OwnershipGiven BRSetOf(BRCyptoAddress)
+wkWalletGetAddressesForRecoverySince (WKWallet wallet,
+                                          size_t *version) {
+    return (NULL != wallet->handlers->getAddressesForRecoverySince
+            ? wallet->handlers->getAddressesForRecoverySince (wallet, version)
+            : wallet->handlers->getAddressesForRecovery (wallet));
+}
+
 extern WKFeeBasis
 wkWalletGetDefaultFeeBasis (WKWallet wallet) {
     pthread_mutex_lock (&wallet->lock);
@@ -801,9 +801,11 @@ wkWalletManagerWipe (WKNetwork network,
 
     const char *currencyName = wkNetworkTypeGetCurrencyCode (wkNetworkGetType(network));
     const char *networkName  = wkNetworkGetDesc(network);
+    const WKWalletManagerHandlers *handlers = wkHandlersLookup(wkNetworkGetType(network))->manager;
 
     pthread_mutex_lock (&network->lock);
     fileServiceWipe (path, currencyName, networkName);
+    if (NULL != handlers->wipe) handlers->wipe (path, currencyName, networkName);
     pthread_mutex_unlock (&network->lock);
 }
 
@@ -134,6 +134,12 @@ typedef WKWalletSweeper
                                                     WKWallet wallet,
                                                     WKKey key);
 
+/// Remove any persistent state kept outside of the file service
+typedef void
+(*WKWalletManagerWipeHandler) (const char *basePath,
+                                    const char *currency,
+                                    const char *network);
+
 typedef struct {
     WKWalletManagerCreateHandler create;
     WKWalletManagerReleaseHandler release;
@@ -152,6 +158,7 @@ typedef struct {
     WKWalletManagerRecoverFeeBasisFromFeeEstimateHandler        recoverFeeBasisFromFeeEstimate;
     WKWalletManagerWalletSweeperValidateSupportedHandler validateSweeperSupported;
     WKWalletManagerCreateWalletSweeperHandler createSweeper;
+    WKWalletManagerWipeHandler wipe; // May be NULL
 } WKWalletManagerHandlers;
 
 // MARK: - Wallet Manager State
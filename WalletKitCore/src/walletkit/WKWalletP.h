@@ -105,6 +105,12 @@ typedef WKTransfer
 typedef OwnershipGiven BRSetOf(WKAddress)
 (*WKWalletGetAddressesForRecoveryHandler) (WKWallet wallet);
 
+/// Return the recovery addresses added since `*version` and update `*version`.  A `*version` of
+/// zero returns every address.
+typedef OwnershipGiven BRSetOf(WKAddress)
+(*WKWalletGetAddressesForRecoverySinceHandler) (WKWallet wallet,
+                                                     size_t *version);
+
 typedef void
 (*WKWalletAnnounceTransfer) (WKWallet wallet,
                                    WKTransfer transfer,
@@ -125,6 +131,7 @@ typedef struct {
     WKWalletGetAddressesForRecoveryHandler getAddressesForRecovery;
     WKWalletAnnounceTransfer announceTransfer; // May be NULL
     WKWalletIsEqualHandler isEqual;
+    WKWalletGetAddressesForRecoverySinceHandler getAddressesForRecoverySince; // May be NULL
 } WKWalletHandlers;
 
 
@@ -209,6 +216,13 @@ wkWalletReplaceTransfer (WKWallet wallet,
 private_extern OwnershipGiven BRSetOf(BRCyptoAddress)
 wkWalletGetAddressesForRecovery (WKWallet wallet);
 
+/// Return the recovery addresses added since `*version`, a value previously returned through
+/// `version` or zero, and update `*version`.  If the wallet does not track a version, then every
+/// recovery address is returned each time.
+private_extern OwnershipGiven BRSetOf(BRCyptoAddress)
+wkWalletGetAddressesForRecoverySince (WKWallet wallet,
+                                          size_t *version);
+
 private_extern void
 wkWalletUpdBalance (WKWallet wallet, bool needLock);
 
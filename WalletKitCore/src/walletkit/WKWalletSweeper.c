@@ -54,6 +54,29 @@ wkWalletSweeperAddTransactionFromBundle (WKWalletSweeper sweeper,
     return sweeper->handlers->addTranactionFromBundle (sweeper, bundle);
 }
 
+extern WKWalletSweeperStatus
+wkWalletSweeperAddKey (WKWalletSweeper sweeper,
+                       WKWalletManager manager,
+                       WKWallet wallet,
+                       OwnershipKept WKKey key) {
+    if (NULL == sweeper->handlers->addKey)
+        return WK_WALLET_SWEEPER_ILLEGAL_OPERATION;
+
+    // Each added key is held to the same checks as the sweeper's own, including not being `wallet`'s
+    WKWalletSweeperStatus status = wkWalletManagerWalletSweeperValidateSupported (manager, wallet, key);
+    if (WK_WALLET_SWEEPER_SUCCESS != status)
+        return status;
+
+    return sweeper->handlers->addKey (sweeper, key);
+}
+
+extern size_t
+wkWalletSweeperGetKeyCount (WKWalletSweeper sweeper) {
+    return (NULL == sweeper->handlers->getKeyCount
+            ? 1
+            : sweeper->handlers->getKeyCount (sweeper));
+}
+
 extern void
 wkWalletManagerEstimateFeeBasisForWalletSweep (WKWalletSweeper sweeper,
                                                    WKWalletManager cwm,
@@ -79,13 +102,57 @@ wkWalletSweeperCreateTransferForWalletSweep (WKWalletSweeper sweeper,
                                                  WKFeeBasis estimatedFeeBasis) {
     WKTransfer transfer = sweeper->handlers->createTransfer (cwm, wallet, sweeper, estimatedFeeBasis);
     
-    wkTransferGenerateEvent (transfer, (WKTransferEvent) {
-        WK_TRANSFER_EVENT_CREATED
-    });
+    if (NULL != transfer)
+        wkTransferGenerateEvent (transfer, (WKTransferEvent) {
+            WK_TRANSFER_EVENT_CREATED
+        });
     
     return transfer;
 }
 
+extern OwnershipGiven WKTransfer *
+wkWalletSweeperCreateTransfersForWalletSweep (WKWalletSweeper sweeper,
+                                                  WKWalletManager cwm,
+                                                  WKWallet wallet,
+                                                  WKFeeBasis estimatedFeeBasis,
+                                                  size_t *count) {
+    WKTransfer *transfers = NULL;
+
+    if (NULL != sweeper->handlers->createTransfers)
+        transfers = sweeper->handlers->createTransfers (cwm, wallet, sweeper, estimatedFeeBasis, count);
+    else {
+        // A single key is swept with a single transfer
+        WKTransfer transfer = sweeper->handlers->createTransfer (cwm, wallet, sweeper, estimatedFeeBasis);
+
+        *count = (NULL == transfer ? 0 : 1);
+        if (NULL != transfer) {
+            transfers = calloc (1, sizeof (WKTransfer));
+            transfers[0] = transfer;
+        }
+    }
+
+    for (size_t index = 0; index < *count; index++)
+        wkTransferGenerateEvent (transfers[index], (WKTransferEvent) {
+            WK_TRANSFER_EVENT_CREATED
+        });
+
+    return transfers;
+}
+
+extern void
+wkWalletManagerSubmitForWalletSweep (WKWalletSweeper sweeper,
+                                         WKWalletManager cwm,
+                                         WKWallet wallet,
+                                         WKTransfer transfer) {
+    if (NULL == sweeper->handlers->signTransfer) {
+        wkWalletManagerSubmitForKey (cwm, wallet, transfer, sweeper->key);
+        return;
+    }
+
+    if (WK_TRUE == sweeper->handlers->signTransfer (cwm, wallet, sweeper, transfer))
+        wkWalletManagerSubmitSigned (cwm, wallet, transfer);
+}
+
 extern WKKey
 wkWalletSweeperGetKey (WKWalletSweeper sweeper) {
     return wkKeyTake (sweeper->key);
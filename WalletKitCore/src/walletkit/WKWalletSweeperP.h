@@ -48,6 +48,26 @@ typedef WKTransfer
 typedef WKWalletSweeperStatus
 (*WKWalletSweeperValidateHandler) (WKWalletSweeper sweeper);
 
+typedef WKWalletSweeperStatus
+(*WKWalletSweeperAddKeyHandler) (WKWalletSweeper sweeper,
+                                 WKKey key);
+
+typedef size_t
+(*WKWalletSweeperGetKeyCountHandler) (WKWalletSweeper sweeper);
+
+typedef WKTransfer *
+(*WKWalletSweeperCreateTransfersHandler) (WKWalletManager cwm,
+                                          WKWallet wallet,
+                                          WKWalletSweeper sweeper,
+                                          WKFeeBasis estimatedFeeBasis,
+                                          size_t *count);
+
+typedef WKBoolean
+(*WKWalletSweeperSignTransferHandler) (WKWalletManager cwm,
+                                       WKWallet wallet,
+                                       WKWalletSweeper sweeper,
+                                       WKTransfer transfer);
+
 typedef struct {
     WKWalletSweeperReleaseHandler release;
     WKWalletSweeperGetAddressHandler getAddress;
@@ -56,6 +76,12 @@ typedef struct {
     WKWalletSweeperEstimateFeeBasisHandler estimateFeeBasis;
     WKWalletSweeperCreateTransferHandler createTransfer;
     WKWalletSweeperValidateHandler validate;
+
+    // For sweeping many keys at once
+    WKWalletSweeperAddKeyHandler addKey;                    // May be NULL
+    WKWalletSweeperGetKeyCountHandler getKeyCount;          // May be NULL
+    WKWalletSweeperCreateTransfersHandler createTransfers;  // May be NULL
+    WKWalletSweeperSignTransferHandler signTransfer;        // May be NULL
 } WKWalletSweeperHandlers;
 
 // MARK: - Sweeper
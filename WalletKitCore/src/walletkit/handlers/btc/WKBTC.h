@@ -18,6 +18,7 @@
 #include "bitcoin/BRBitcoinTransaction.h"
 #include "bitcoin/BRBitcoinChainParams.h"
 #include "bitcoin/BRBitcoinPaymentProtocol.h"
+#include "bitcoin/BRBitcoinHeaderStore.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -125,6 +126,22 @@ typedef struct WKWalletBTCRecord {
     struct WKWalletRecord base;
     BRBitcoinWallet *wid;
     BRArrayOf (BRBitcoinTransaction*) tidsUnresolved;
+
+    // The recovery addresses, in the order generated; the count is the version.  Grows along with
+    // the `wid` external and internal chains, whose counts are held as of the last update.
+    BRArrayOf (WKAddress) recoveryAddresses;
+    size_t recoveryExternalCount;
+    size_t recoveryInternalCount;
+
+    // The transfers indexed by the outpoints they fund and spend, and those funded outpoints that
+    // pay a pubkey hash indexed by it; maintained as transfers are added and removed.  A transfer's
+    // cached fee, send and recv only change when one of its outpoints does: when the transaction
+    // funding a spent outpoint is registered, or when the address an outpoint pays is generated.
+    // The counts are those of the `wid` external and internal chains as of the last check.
+    BRSet *transfersByOutpoint;
+    BRSet *outpointsByPKH;
+    size_t dependencyExternalCount;
+    size_t dependencyInternalCount;
 } *WKWalletBTC;
 
 extern WKWalletHandlers wkWalletHandlersBTC;
@@ -165,6 +182,13 @@ wkWalletRemResolvedAsBTC (WKWallet wallet,
                               BRBitcoinTransaction **tids,
                               size_t tidsCount);
 
+/// Return the transfers whose fee, send or recv may have changed: those spending an output of
+/// `tid`, which has just been registered in the wallet's `wid`, and those funding or spending an
+/// output that pays an address generated since the last call.  The transfers are taken.
+private_extern OwnershipGiven BRArrayOf(WKTransfer)
+wkWalletGetTransfersAffectedAsBTC (WKWallet wallet,
+                                       const BRBitcoinTransaction *tid);
+
 // MARK: - (Wallet) Manager
 
 typedef struct WKWalletManagerBTCRecord {
@@ -190,8 +214,23 @@ typedef struct WKWalletSweeperBTCRecord {
     uint8_t isSegwit;
     char * sourceAddress;
     BRArrayOf(BRBitcoinTransaction *) txns;
+
+    // The swept keys, starting with `base.key`, and an index of their pubkey hashes; outputs are
+    // matched against the index by their P2PKH script bytes
+    BRArrayOf(WKKey) keys;
+    BRSet *sourcePKHs;
+
+    // The outputs paying a swept key that are not spent by any added transaction, and the outpoints
+    // spent by added transactions that were not (yet) known outputs.  Both are kept up to date as
+    // transactions and keys are added, in any order.
+    BRSet *utxos;
+    BRSet *spent;
 } *WKWalletSweeperBTC;
 
+private_extern void
+wkWalletSweeperInitIndexesBTC (WKWalletSweeperBTC sweeper,
+                               WKKey key);
+
 // MARK: - Payment Protocol
 
 // MARK: Payment Protocol Bitpay Builder
@@ -257,7 +296,17 @@ extern BRFileServiceTypeSpecification *fileServiceSpecificationsBTC;
 
 extern BRArrayOf(BRBitcoinTransaction*) initialTransactionsLoadBTC (WKWalletManager manager);
 extern BRArrayOf(BRBitcoinPeer)         initialPeersLoadBTC        (WKWalletManager manager);
-extern BRArrayOf(BRBitcoinMerkleBlock*) initialBlocksLoadBTC       (WKWalletManager manager);
+extern BRArrayOf(BRBitcoinMerkleBlock*) initialBlocksLoadBTC       (WKWalletManager manager,
+                                                                     BRBitcoinHeaderStore *headerStore,
+                                                                     uint32_t residentBlockCount);
+
+/// MARK: - Header Store
+
+extern BRBitcoinHeaderStore *headerStoreOpenBTC (WKWalletManager manager);
+
+extern void headerStoreWipeBTC (const char *basePath,
+                                const char *currency,
+                                const char *network);
 
 #ifdef __cplusplus
 }
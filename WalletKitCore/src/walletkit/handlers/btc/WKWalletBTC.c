@@ -14,6 +14,47 @@
 
 #define DEFAULT_FEE_BASIS_SIZE_IN_BYTES     (200)
 #define DEFAULT_TIDS_UNRESOLVED_COUNT         (2)
+#define DEFAULT_RECOVERY_ADDRESSES_COUNT    (2 * (SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + SEQUENCE_GAP_LIMIT_INTERNAL_EXTENDED))
+#define DEFAULT_TRANSFER_OUTPOINTS_COUNT  (100)
+
+// The transfers depending on an outpoint: the transfer for the transaction funding it, if known, and
+// the transfers spending it (more than one only for conflicting transactions).  The transfers are
+// not taken; the wallet's `transfers` holds them for as long as they are indexed.
+typedef struct {
+    BRBitcoinUTXO outpoint; // first, so that sets of these use btcUTXOHash() and btcUTXOEq()
+    WKTransfer funder;
+    BRArrayOf(WKTransfer) spenders;
+} WKWalletOutpointBTC;
+
+// The outpoints, funded by the wallet's transfers, that pay a pubkey hash
+typedef struct {
+    UInt160 pkh; // first, so that sets of these hash and compare by the pubkey hash
+    BRArrayOf(BRBitcoinUTXO) outpoints;
+} WKWalletPKHOutpointsBTC;
+
+inline static size_t
+wkWalletPKHOutpointsHashBTC (const void *pkh) {
+    return (size_t)((const UInt160 *)pkh)->u32[0];
+}
+
+inline static int
+wkWalletPKHOutpointsEqBTC (const void *pkh, const void *otherPkh) {
+    return (pkh == otherPkh || UInt160Eq (*(const UInt160 *)pkh, *(const UInt160 *)otherPkh));
+}
+
+static void
+wkWalletOutpointReleaseBTC (void *item) {
+    WKWalletOutpointBTC *entry = item;
+    array_free (entry->spenders);
+    free (entry);
+}
+
+static void
+wkWalletPKHOutpointsReleaseBTC (void *item) {
+    WKWalletPKHOutpointsBTC *entry = item;
+    array_free (entry->outpoints);
+    free (entry);
+}
 
 private_extern WKWalletBTC
 wkWalletCoerceBTC (WKWallet wallet) {
@@ -33,6 +74,17 @@ wkWalletCreateCallbackBTC (WKWalletCreateContext context,
 
     walletBTC->wid = contextBTC->wid;
     array_new (walletBTC->tidsUnresolved, DEFAULT_TIDS_UNRESOLVED_COUNT);
+
+    array_new (walletBTC->recoveryAddresses, DEFAULT_RECOVERY_ADDRESSES_COUNT);
+    walletBTC->recoveryExternalCount = 0;
+    walletBTC->recoveryInternalCount = 0;
+
+    // Transfers are created from `wid` after this, so each accounts for at least these addresses
+    walletBTC->transfersByOutpoint = BRSetNew (btcUTXOHash, btcUTXOEq, DEFAULT_TRANSFER_OUTPOINTS_COUNT);
+    walletBTC->outpointsByPKH      = BRSetNew (wkWalletPKHOutpointsHashBTC, wkWalletPKHOutpointsEqBTC,
+                                               DEFAULT_TRANSFER_OUTPOINTS_COUNT);
+    walletBTC->dependencyExternalCount = btcWalletChainAddrs (walletBTC->wid, NULL, 0, SEQUENCE_EXTERNAL_CHAIN, 0);
+    walletBTC->dependencyInternalCount = btcWalletChainAddrs (walletBTC->wid, NULL, 0, SEQUENCE_INTERNAL_CHAIN, 0);
 }
 
 
@@ -74,6 +126,9 @@ static void
 wkWalletReleaseBTC (WKWallet wallet) {
     WKWalletBTC walletBTC = wkWalletCoerceBTC(wallet);
     array_free_all (walletBTC->tidsUnresolved, btcTransactionFree);
+    array_free_all (walletBTC->recoveryAddresses, wkAddressGive);
+    BRSetFreeAll (walletBTC->transfersByOutpoint, wkWalletOutpointReleaseBTC);
+    BRSetFreeAll (walletBTC->outpointsByPKH, wkWalletPKHOutpointsReleaseBTC);
 }
 
 private_extern BRBitcoinWallet *
@@ -169,6 +224,207 @@ wkWalletRemResolvedAsBTC (WKWallet wallet,
     return count;
 }
 
+// MARK: - Transfer Dependencies
+
+static WKWalletOutpointBTC *
+wkWalletGetOutpointBTC (WKWalletBTC walletBTC,
+                            BRBitcoinUTXO outpoint) {
+    WKWalletOutpointBTC *entry = BRSetGet (walletBTC->transfersByOutpoint, &outpoint);
+
+    if (NULL == entry) {
+        entry = calloc (1, sizeof (WKWalletOutpointBTC));
+        entry->outpoint = outpoint;
+        array_new (entry->spenders, 1);
+        BRSetAdd (walletBTC->transfersByOutpoint, entry);
+    }
+    return entry;
+}
+
+static void
+wkWalletRemOutpointIfUnusedBTC (WKWalletBTC walletBTC,
+                                    WKWalletOutpointBTC *entry) {
+    if (NULL == entry->funder && 0 == array_count (entry->spenders)) {
+        BRSetRemove (walletBTC->transfersByOutpoint, entry);
+        wkWalletOutpointReleaseBTC (entry);
+    }
+}
+
+// Called with the wallet's lock held
+static void
+wkWalletAddTransferDependenciesBTC (WKWalletBTC walletBTC,
+                                        WKTransfer transfer) {
+    BRBitcoinTransaction *tid = wkTransferAsBTC (transfer);
+
+    // Without a signature there is no hash to spend, and `tid` is not in `wid`; transfers are
+    // only added to the wallet once signed.
+    if (!btcTransactionIsSigned (tid)) return;
+
+    for (size_t index = 0; index < tid->inCount; index++) {
+        BRBitcoinUTXO outpoint = { tid->inputs[index].txHash, tid->inputs[index].index };
+        WKWalletOutpointBTC *entry = wkWalletGetOutpointBTC (walletBTC, outpoint);
+        array_add (entry->spenders, transfer);
+    }
+
+    for (uint32_t index = 0; index < tid->outCount; index++) {
+        BRBitcoinUTXO outpoint = { tid->txHash, index };
+        wkWalletGetOutpointBTC (walletBTC, outpoint)->funder = transfer;
+
+        const uint8_t *hash = BRScriptPKH (tid->outputs[index].script, tid->outputs[index].scriptLen);
+        if (NULL == hash) continue;
+
+        UInt160 pkh = UInt160Get (hash);
+        WKWalletPKHOutpointsBTC *entry = BRSetGet (walletBTC->outpointsByPKH, &pkh);
+        if (NULL == entry) {
+            entry = calloc (1, sizeof (WKWalletPKHOutpointsBTC));
+            entry->pkh = pkh;
+            array_new (entry->outpoints, 1);
+            BRSetAdd (walletBTC->outpointsByPKH, entry);
+        }
+        array_add (entry->outpoints, outpoint);
+    }
+}
+
+// Called with the wallet's lock held.  The `transfer` may only be equal to the indexed one.
+static void
+wkWalletRemTransferDependenciesBTC (WKWalletBTC walletBTC,
+                                        WKTransfer transfer) {
+    BRBitcoinTransaction *tid = wkTransferAsBTC (transfer);
+
+    if (!btcTransactionIsSigned (tid)) return;
+
+    for (size_t index = 0; index < tid->inCount; index++) {
+        BRBitcoinUTXO outpoint = { tid->inputs[index].txHash, tid->inputs[index].index };
+        WKWalletOutpointBTC *entry = BRSetGet (walletBTC->transfersByOutpoint, &outpoint);
+        if (NULL == entry) continue;
+
+        for (size_t sIndex = array_count (entry->spenders); sIndex > 0; sIndex--)
+            if (WK_TRUE == wkTransferHasBTC (entry->spenders[sIndex - 1], tid))
+                array_rm (entry->spenders, sIndex - 1);
+
+        wkWalletRemOutpointIfUnusedBTC (walletBTC, entry);
+    }
+
+    for (uint32_t index = 0; index < tid->outCount; index++) {
+        BRBitcoinUTXO outpoint = { tid->txHash, index };
+        WKWalletOutpointBTC *entry = BRSetGet (walletBTC->transfersByOutpoint, &outpoint);
+        if (NULL != entry && NULL != entry->funder && WK_TRUE == wkTransferHasBTC (entry->funder, tid)) {
+            entry->funder = NULL;
+            wkWalletRemOutpointIfUnusedBTC (walletBTC, entry);
+        }
+
+        const uint8_t *hash = BRScriptPKH (tid->outputs[index].script, tid->outputs[index].scriptLen);
+        if (NULL == hash) continue;
+
+        UInt160 pkh = UInt160Get (hash);
+        WKWalletPKHOutpointsBTC *pkhEntry = BRSetGet (walletBTC->outpointsByPKH, &pkh);
+        if (NULL == pkhEntry) continue;
+
+        for (size_t oIndex = array_count (pkhEntry->outpoints); oIndex > 0; oIndex--)
+            if (btcUTXOEq (&pkhEntry->outpoints[oIndex - 1], &outpoint))
+                array_rm (pkhEntry->outpoints, oIndex - 1);
+
+        if (0 == array_count (pkhEntry->outpoints)) {
+            BRSetRemove (walletBTC->outpointsByPKH, pkhEntry);
+            wkWalletPKHOutpointsReleaseBTC (pkhEntry);
+        }
+    }
+}
+
+static void
+wkWalletAnnounceTransferBTC (WKWallet wallet,
+                                 WKTransfer transfer,
+                                 WKWalletEventType type) {
+    WKWalletBTC walletBTC = wkWalletCoerceBTC(wallet);
+
+    switch (type) {
+        case WK_WALLET_EVENT_TRANSFER_ADDED:
+            wkWalletAddTransferDependenciesBTC (walletBTC, transfer);
+            break;
+        case WK_WALLET_EVENT_TRANSFER_DELETED:
+            wkWalletRemTransferDependenciesBTC (walletBTC, transfer);
+            break;
+        default:
+            break;
+    }
+}
+
+// Adds `transfer`, taken, to `transfers` unless NULL or already there
+static void
+wkWalletAddTransferAffectedBTC (BRArrayOf(WKTransfer) *transfers,
+                                    WKTransfer transfer) {
+    if (NULL == transfer) return;
+
+    for (size_t index = 0; index < array_count (*transfers); index++)
+        if (transfer == (*transfers)[index]) return;
+
+    array_add (*transfers, wkTransferTake (transfer));
+}
+
+private_extern OwnershipGiven BRArrayOf(WKTransfer)
+wkWalletGetTransfersAffectedAsBTC (WKWallet wallet,
+                                       const BRBitcoinTransaction *tid) {
+    WKWalletBTC walletBTC = wkWalletCoerceBTC(wallet);
+    BRBitcoinWallet *btcWallet = walletBTC->wid;
+    BRAddressParams addrParams = btcWalletGetAddressParams (btcWallet);
+
+    pthread_mutex_lock (&wallet->lock);
+    size_t externalCount = walletBTC->dependencyExternalCount;
+    size_t internalCount = walletBTC->dependencyInternalCount;
+    pthread_mutex_unlock (&wallet->lock);
+
+    // The addresses generated since the last call; as for recovery, `wid` is queried without the
+    // wallet's lock held.
+    size_t btcExternalCount = btcWalletChainAddrs (btcWallet, NULL, 0, SEQUENCE_EXTERNAL_CHAIN, externalCount);
+    size_t btcInternalCount = btcWalletChainAddrs (btcWallet, NULL, 0, SEQUENCE_INTERNAL_CHAIN, internalCount);
+    BRAddress *btcAddresses = calloc (btcExternalCount + btcInternalCount + 1, sizeof (BRAddress));
+
+    btcExternalCount = btcWalletChainAddrs (btcWallet, btcAddresses,                    btcExternalCount,
+                                            SEQUENCE_EXTERNAL_CHAIN, externalCount);
+    btcInternalCount = btcWalletChainAddrs (btcWallet, btcAddresses + btcExternalCount, btcInternalCount,
+                                            SEQUENCE_INTERNAL_CHAIN, internalCount);
+
+    BRArrayOf(WKTransfer) transfers;
+    array_new (transfers, 10);
+
+    pthread_mutex_lock (&wallet->lock);
+
+    // The spenders of `tid` outputs; their fee and send could not account for them until now.
+    for (uint32_t index = 0; NULL != tid && index < tid->outCount; index++) {
+        BRBitcoinUTXO outpoint = { tid->txHash, index };
+        WKWalletOutpointBTC *entry = BRSetGet (walletBTC->transfersByOutpoint, &outpoint);
+        if (NULL == entry) continue;
+
+        for (size_t sIndex = 0; sIndex < array_count (entry->spenders); sIndex++)
+            wkWalletAddTransferAffectedBTC (&transfers, entry->spenders[sIndex]);
+    }
+
+    // The funders and spenders of outpoints paying a new address; their recv and send, respectively,
+    // now include them.
+    for (size_t aIndex = 0; aIndex < btcExternalCount + btcInternalCount; aIndex++) {
+        UInt160 pkh;
+        if (!BRAddressHash160 (pkh.u8, addrParams, btcAddresses[aIndex].s)) continue;
+
+        WKWalletPKHOutpointsBTC *pkhEntry = BRSetGet (walletBTC->outpointsByPKH, &pkh);
+        for (size_t oIndex = 0; NULL != pkhEntry && oIndex < array_count (pkhEntry->outpoints); oIndex++) {
+            WKWalletOutpointBTC *entry = BRSetGet (walletBTC->transfersByOutpoint, &pkhEntry->outpoints[oIndex]);
+            if (NULL == entry) continue;
+
+            wkWalletAddTransferAffectedBTC (&transfers, entry->funder);
+            for (size_t sIndex = 0; sIndex < array_count (entry->spenders); sIndex++)
+                wkWalletAddTransferAffectedBTC (&transfers, entry->spenders[sIndex]);
+        }
+    }
+
+    // The chains only grow; a concurrent call may have checked further already.
+    walletBTC->dependencyExternalCount = MAX (walletBTC->dependencyExternalCount, externalCount + btcExternalCount);
+    walletBTC->dependencyInternalCount = MAX (walletBTC->dependencyInternalCount, internalCount + btcInternalCount);
+
+    pthread_mutex_unlock (&wallet->lock);
+
+    free (btcAddresses);
+    return transfers;
+}
+
 static WKAddress
 wkWalletGetAddressBTC (WKWallet wallet,
                            WKAddressScheme addressScheme) {
@@ -334,41 +590,98 @@ wkWalletCreateTransferMultipleBTC (WKWallet wallet,
                                          wallet->type));
 }
 
+static void
+wkWalletAddRecoveryAddressesBTC (WKWallet wallet,
+                                     BRArrayOf(WKAddress) *addresses,
+                                     BRAddress *btcAddresses,
+                                     size_t btcAddressesCount) {
+    WKWalletBTC walletBTC = wkWalletCoerceBTC(wallet);
+
+    for (size_t index = 0; index < btcAddressesCount; index++) {
+        // The currency, may or may not have a legacy address;
+        BRAddress btcPrimaryAddress = btcAddresses[index];
+        BRAddress btcLegacyAddress  = btcWalletAddressToLegacy(walletBTC->wid, &btcAddresses[index]);
+
+        // Add in the primaryAddress
+        array_add (*addresses, wkAddressCreateAsBTC (wallet->type, btcPrimaryAddress));
+
+        // If the primaryAddress nd legacyAddress differ, then add it in
+        if (!BRAddressEq (&btcPrimaryAddress, &btcLegacyAddress))
+            array_add (*addresses, wkAddressCreateAsBTC (wallet->type, btcLegacyAddress));
+    }
+}
+
 static OwnershipGiven BRSetOf(WKAddress)
-wkWalletGetAddressesForRecoveryBTC (WKWallet wallet) {
+wkWalletGetAddressesForRecoverySinceBTC (WKWallet wallet,
+                                             size_t *version) {
     WKWalletBTC walletBTC = wkWalletCoerceBTC(wallet);
     BRBitcoinWallet *btcWallet = walletBTC->wid;
 
-    size_t btcAddressesCount = btcWalletAllAddrs (btcWallet, NULL, 0);
-    BRAddress *btcAddresses = calloc (btcAddressesCount, sizeof (BRAddress));
-    btcWalletAllAddrs (btcWallet, btcAddresses, btcAddressesCount);
+    // Keep the extended gap of unused addresses beyond the last used one, so that each round of a
+    // QRY recovery requests the next windows of addresses speculatively rather than a few at a time.
+    btcWalletUnusedAddrs (btcWallet, NULL, SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED, SEQUENCE_EXTERNAL_CHAIN);
+    btcWalletUnusedAddrs (btcWallet, NULL, SEQUENCE_GAP_LIMIT_INTERNAL_EXTENDED, SEQUENCE_INTERNAL_CHAIN);
+
+    pthread_mutex_lock (&wallet->lock);
+    size_t externalCount = walletBTC->recoveryExternalCount;
+    size_t internalCount = walletBTC->recoveryInternalCount;
+    pthread_mutex_unlock (&wallet->lock);
 
-    WKAddress replacedAddress = NULL;
+    // Only the addresses generated since the last update are converted; the chains only grow.
+    size_t btcExternalCount = btcWalletChainAddrs (btcWallet, NULL, 0, SEQUENCE_EXTERNAL_CHAIN, externalCount);
+    size_t btcInternalCount = btcWalletChainAddrs (btcWallet, NULL, 0, SEQUENCE_INTERNAL_CHAIN, internalCount);
 
-    BRSetOf(WKAddress) addresses = wkAddressSetCreate (btcAddressesCount);
+    BRArrayOf(WKAddress) added = NULL;
 
-    for (size_t index = 0; index < btcAddressesCount; index++) {
-        // The currency, may or may not have a legacy address;
-        BRAddress btcPrimaryAddress = btcAddresses[index];
-        BRAddress btcLegacyAddress  = btcWalletAddressToLegacy(btcWallet, &btcAddresses[index]);
+    if (btcExternalCount + btcInternalCount > 0) {
+        BRAddress *btcAddresses = calloc (btcExternalCount + btcInternalCount, sizeof (BRAddress));
 
-        // Add in the primaryAddress
-        replacedAddress = BRSetAdd (addresses, wkAddressCreateAsBTC (wallet->type, btcPrimaryAddress));
-        if (replacedAddress) wkAddressGive (replacedAddress);
+        btcExternalCount = btcWalletChainAddrs (btcWallet, btcAddresses,                    btcExternalCount,
+                                                SEQUENCE_EXTERNAL_CHAIN, externalCount);
+        btcInternalCount = btcWalletChainAddrs (btcWallet, btcAddresses + btcExternalCount, btcInternalCount,
+                                                SEQUENCE_INTERNAL_CHAIN, internalCount);
 
+        array_new (added, 2 * (btcExternalCount + btcInternalCount));
+        wkWalletAddRecoveryAddressesBTC (wallet, &added, btcAddresses, btcExternalCount + btcInternalCount);
 
-        // If the primaryAddress nd legacyAddress differ, then add it in
-        if (!BRAddressEq (&btcPrimaryAddress, &btcLegacyAddress)) {
-            replacedAddress = BRSetAdd (addresses, wkAddressCreateAsBTC (wallet->type, btcLegacyAddress));
-            if (replacedAddress) wkAddressGive (replacedAddress);
+        free (btcAddresses);
+    }
+
+    pthread_mutex_lock (&wallet->lock);
+
+    // Append the converted addresses, unless a concurrent update already has.
+    if (NULL != added) {
+        if (externalCount == walletBTC->recoveryExternalCount &&
+            internalCount == walletBTC->recoveryInternalCount) {
+            array_add_array (walletBTC->recoveryAddresses, added, array_count (added));
+            walletBTC->recoveryExternalCount += btcExternalCount;
+            walletBTC->recoveryInternalCount += btcInternalCount;
+            array_free (added);
         }
+        else array_free_all (added, wkAddressGive);
     }
 
-    free (btcAddresses);
+    size_t count = array_count (walletBTC->recoveryAddresses);
+    size_t start = MIN (*version, count);
+
+    BRSetOf(WKAddress) addresses = wkAddressSetCreate (count - start);
+    for (size_t index = start; index < count; index++) {
+        WKAddress replacedAddress = BRSetAdd (addresses, wkAddressTake (walletBTC->recoveryAddresses[index]));
+        if (replacedAddress) wkAddressGive (replacedAddress);
+    }
+
+    *version = count;
+    pthread_mutex_unlock (&wallet->lock);
 
     return addresses;
 }
 
+static OwnershipGiven BRSetOf(WKAddress)
+wkWalletGetAddressesForRecoveryBTC (WKWallet wallet) {
+    size_t version = 0;
+    return wkWalletGetAddressesForRecoverySinceBTC (wallet, &version);
+}
+
 WKWalletHandlers wkWalletHandlersBTC = {
     wkWalletReleaseBTC,
     wkWalletGetAddressBTC,
@@ -379,8 +692,9 @@ WKWalletHandlers wkWalletHandlersBTC = {
     wkWalletCreateTransferBTC,
     wkWalletCreateTransferMultipleBTC,
     wkWalletGetAddressesForRecoveryBTC,
-    NULL,
-    wkWalletIsEqualBTC
+    wkWalletAnnounceTransferBTC,
+    wkWalletIsEqualBTC,
+    wkWalletGetAddressesForRecoverySinceBTC
 };
 
 WKWalletHandlers wkWalletHandlersBCH = {
@@ -394,7 +708,8 @@ WKWalletHandlers wkWalletHandlersBCH = {
     wkWalletCreateTransferMultipleBTC,
     wkWalletGetAddressesForRecoveryBTC,
     NULL,
-    wkWalletIsEqualBTC
+    wkWalletIsEqualBTC,
+    wkWalletGetAddressesForRecoverySinceBTC
 };
 
 WKWalletHandlers wkWalletHandlersBSV = {
@@ -408,7 +723,8 @@ WKWalletHandlers wkWalletHandlersBSV = {
     wkWalletCreateTransferMultipleBTC,
     wkWalletGetAddressesForRecoveryBTC,
     NULL,
-    wkWalletIsEqualBTC
+    wkWalletIsEqualBTC,
+    wkWalletGetAddressesForRecoverySinceBTC
 };
 
 WKWalletHandlers wkWalletHandlersLTC = {
@@ -422,7 +738,8 @@ WKWalletHandlers wkWalletHandlersLTC = {
     wkWalletCreateTransferMultipleBTC,
     wkWalletGetAddressesForRecoveryBTC,
     NULL,
-    wkWalletIsEqualBTC
+    wkWalletIsEqualBTC,
+    wkWalletGetAddressesForRecoverySinceBTC
 };
 
 WKWalletHandlers wkWalletHandlersDOGE = {
@@ -436,5 +753,6 @@ WKWalletHandlers wkWalletHandlersDOGE = {
     wkWalletCreateTransferMultipleBTC,
     wkWalletGetAddressesForRecoveryBTC,
     NULL,
-    wkWalletIsEqualBTC
+    wkWalletIsEqualBTC,
+    wkWalletGetAddressesForRecoverySinceBTC
 };
@@ -346,17 +346,18 @@ wkWalletManagerRecoverTransfersFromTransactionBundleBTC (WKWalletManager manager
     // The transaction is in the wallet, this has generated more BRBitcoinWallet EXTERNAL and INTERNAL
     // addresses.  Because the order of bundle arrival is not guaranteed to be by block number,
     // it is possible that some other transaction in the wallet now has inputs or outputs that are
-    // now in BRBitcoinWallet.  This changes the amount and fee, possibly.  Find those and replace them.
+    // now in BRBitcoinWallet.  This changes the amount and fee, possibly.  Only the transfers that
+    // spend an output of this transaction, or that fund or spend an output to a new address, can
+    // have changed; find those and replace them.
     else if (TX_UNCONFIRMED != btcBlockHeight) {
-        for (size_t index = 0; index < array_count (manager->wallet->transfers); index++) {
-            WKTransfer oldTransfer = manager->wallet->transfers[index];
+        BRArrayOf(WKTransfer) transfers = wkWalletGetTransfersAffectedAsBTC (manager->wallet, btcTransaction);
+
+        for (size_t index = 0; index < array_count (transfers); index++) {
+            WKTransfer oldTransfer = transfers[index];
             BRBitcoinTransaction *tid = wkTransferCoerceBTC(oldTransfer)->tid;
 
             if (TX_UNCONFIRMED   != tid->blockHeight &&
-                tid->blockHeight >= btcBlockHeight   &&
                 WK_TRUE == wkTransferChangedAmountBTC (oldTransfer, btcWallet)) {
-                wkTransferTake (oldTransfer);
-
                 WKTransfer newTransfer  = wkTransferCreateAsBTC (oldTransfer->listener,
                                                                            oldTransfer->unit,
                                                                            oldTransfer->unitForFee,
@@ -365,9 +366,10 @@ wkWalletManagerRecoverTransfersFromTransactionBundleBTC (WKWalletManager manager
                                                                            oldTransfer->type);
 
                 wkWalletReplaceTransfer (manager->wallet, oldTransfer, newTransfer);
-                wkTransferGive (oldTransfer);
             }
         }
+
+        array_free_all (transfers, wkTransferGive);
     }
 }
 
@@ -431,6 +433,7 @@ wkWalletManagerCreateWalletSweeperBTC (WKWalletManager cwm,
     sweeperBTC->isSegwit = WK_ADDRESS_SCHEME_BTC_SEGWIT == cwm->addressScheme;
     sweeperBTC->sourceAddress = address;
     array_new (sweeperBTC->txns, 100);
+    wkWalletSweeperInitIndexesBTC (sweeperBTC, key);
 
     wkUnitGive (unit);
     wkCurrencyGive (currency);
@@ -685,7 +688,8 @@ WKWalletManagerHandlers wkWalletManagerHandlersBTC = {
     wkWalletManagerRecoverTransferFromTransferBundleBTC,
     NULL,//WKWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     wkWalletManagerWalletSweeperValidateSupportedBTC,
-    wkWalletManagerCreateWalletSweeperBTC
+    wkWalletManagerCreateWalletSweeperBTC,
+    headerStoreWipeBTC
 };
 
 WKWalletManagerHandlers wkWalletManagerHandlersBCH = {
@@ -705,7 +709,8 @@ WKWalletManagerHandlers wkWalletManagerHandlersBCH = {
     wkWalletManagerRecoverTransferFromTransferBundleBTC,
     NULL,//WKWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     wkWalletManagerWalletSweeperValidateSupportedBTC,
-    wkWalletManagerCreateWalletSweeperBTC
+    wkWalletManagerCreateWalletSweeperBTC,
+    headerStoreWipeBTC
 };
 
 WKWalletManagerHandlers wkWalletManagerHandlersBSV = {
@@ -725,7 +730,8 @@ WKWalletManagerHandlers wkWalletManagerHandlersBSV = {
     wkWalletManagerRecoverTransferFromTransferBundleBTC,
     NULL,//WKWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     wkWalletManagerWalletSweeperValidateSupportedBTC,
-    wkWalletManagerCreateWalletSweeperBTC
+    wkWalletManagerCreateWalletSweeperBTC,
+    headerStoreWipeBTC
 };
 
 WKWalletManagerHandlers wkWalletManagerHandlersLTC = {
@@ -745,7 +751,8 @@ WKWalletManagerHandlers wkWalletManagerHandlersLTC = {
     wkWalletManagerRecoverTransferFromTransferBundleBTC,
     NULL,//WKWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     wkWalletManagerWalletSweeperValidateSupportedBTC,
-    wkWalletManagerCreateWalletSweeperBTC
+    wkWalletManagerCreateWalletSweeperBTC,
+    headerStoreWipeBTC
 };
 
 WKWalletManagerHandlers wkWalletManagerHandlersDOGE = {
@@ -765,5 +772,6 @@ WKWalletManagerHandlers wkWalletManagerHandlersDOGE = {
     wkWalletManagerRecoverTransferFromTransferBundleBTC,
     NULL,//WKWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     wkWalletManagerWalletSweeperValidateSupportedBTC,
-    wkWalletManagerCreateWalletSweeperBTC
+    wkWalletManagerCreateWalletSweeperBTC,
+    headerStoreWipeBTC
 };
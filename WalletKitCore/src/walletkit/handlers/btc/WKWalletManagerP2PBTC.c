@@ -20,11 +20,16 @@
 #include "bitcoin/BRBitcoinPeerManager.h"
 #include "support/BRData.h"
 
+/// The most recent blocks the BRPeerManager holds in memory when blocks are persisted in a header
+/// store; difficulty transitions and checkpoints are always held.
+#define WK_WALLET_MANAGER_BTC_RESIDENT_BLOCKS       (1000)
+
 /// BRPeerManager Callbacks
 static void wkWalletManagerBTCSyncStarted (void *info);
 static void wkWalletManagerBTCSyncStopped (void *info, int reason);
 static void wkWalletManagerBTCTxStatusUpdate (void *info);
 static void wkWalletManagerBTCSaveBlocks (void *info, int replace, BRBitcoinMerkleBlock **blocks, size_t count);
+static BRBitcoinMerkleBlock *wkWalletManagerBTCLoadBlock (void *info, uint32_t height);
 static void wkWalletManagerBTCSavePeers  (void *info, int replace, const BRBitcoinPeer *peers, size_t count);
 static int  wkWalletManagerBTCNetworkIsReachable (void *info);
 static void wkWalletManagerBTCThreadCleanup (void *info);
@@ -35,6 +40,10 @@ typedef struct WKClientP2PManagerRecordBTC {
     WKWalletManagerBTC manager;
     BRBitcoinPeerManager *btcPeerManager;
 
+    // The persistent blocks; NULL if the store could not be opened, in which case blocks are
+    // saved to the file service.
+    BRBitcoinHeaderStore *headerStore;
+
     // The begining and end blockheight for an ongoing sync.  The end block height will be increased
     // a the blockchain is extended.  The begining block height is used to compute the completion
     // percentage.  These will have values of BLOCK_HEIGHT_UNBOUND when a sync is inactive.
@@ -68,6 +77,7 @@ static void
 wkClientP2PManagerReleaseBTC (WKClientP2PManager baseManager) {
     WKClientP2PManagerBTC manager = wkClientP2PManagerCoerce (baseManager);
     btcPeerManagerFree (manager->btcPeerManager);
+    if (NULL != manager->headerStore) btcHeaderStoreClose (manager->headerStore);
 }
 
 static void
@@ -346,8 +356,16 @@ static void wkWalletManagerBTCTxStatusUpdate (void *info) {
 
 static void wkWalletManagerBTCSaveBlocks (void *info, int replace, BRBitcoinMerkleBlock **blocks, size_t count) {
     WKWalletManagerBTC manager = info;
-
-    if (replace) {
+    BRBitcoinHeaderStore *headerStore = wkClientP2PManagerCoerce (manager->base.p2pManager)->headerStore;
+
+    if (NULL != headerStore) {
+        if (!(replace
+              ? btcHeaderStoreReplace    (headerStore, blocks, count)
+              : btcHeaderStoreSaveBlocks (headerStore, blocks, count)))
+            _peer_log ("BWM: %4s: failed to save blocks",
+                       wkNetworkTypeGetCurrencyCode (manager->base.type));
+    }
+    else if (replace) {
         fileServiceReplace (manager->base.fileService, fileServiceTypeBlocksBTC, (const void **) blocks, count);
     }
     else {
@@ -356,6 +374,13 @@ static void wkWalletManagerBTCSaveBlocks (void *info, int replace, BRBitcoinMerk
     }
 }
 
+static BRBitcoinMerkleBlock *wkWalletManagerBTCLoadBlock (void *info, uint32_t height) {
+    WKWalletManagerBTC manager = info;
+    BRBitcoinHeaderStore *headerStore = wkClientP2PManagerCoerce (manager->base.p2pManager)->headerStore;
+
+    return (NULL != headerStore ? btcHeaderStoreGet (headerStore, height) : NULL);
+}
+
 static void wkWalletManagerBTCSavePeers  (void *info, int replace, const BRBitcoinPeer *peers, size_t count) {
     WKWalletManagerBTC manager = info;
 
@@ -438,7 +463,11 @@ wkWalletManagerCreateP2PManagerBTC (WKWalletManager manager) {
     BRBitcoinWallet *btcWallet = wkWalletAsBTC(manager->wallet);
     uint32_t btcEarliestKeyTime = (uint32_t) wkAccountGetTimestamp(manager->account);
 
-    BRArrayOf(BRBitcoinMerkleBlock*) blocks = initialBlocksLoadBTC (manager);
+    p2pManagerBTC->headerStore = headerStoreOpenBTC (manager);
+
+    BRArrayOf(BRBitcoinMerkleBlock*) blocks = initialBlocksLoadBTC (manager,
+                                                                    p2pManagerBTC->headerStore,
+                                                                    WK_WALLET_MANAGER_BTC_RESIDENT_BLOCKS);
     BRArrayOf(BRBitcoinPeer)         peers  = initialPeersLoadBTC  (manager);
 
     p2pManagerBTC->begBlockHeight = BLOCK_HEIGHT_UNBOUND;
@@ -464,6 +493,12 @@ wkWalletManagerCreateP2PManagerBTC (WKWalletManager manager) {
                                wkWalletManagerBTCNetworkIsReachable,
                                wkWalletManagerBTCThreadCleanup);
 
+    // With blocks persisted by height, older blocks are paged in as needed rather than held in memory
+    if (NULL != p2pManagerBTC->headerStore)
+        btcPeerManagerSetResidentBlocks (p2pManagerBTC->btcPeerManager,
+                                         WK_WALLET_MANAGER_BTC_RESIDENT_BLOCKS,
+                                         wkWalletManagerBTCLoadBlock);
+
     if (NULL != blocks) array_free (blocks);
     if (NULL != peers ) array_free (peers);
 
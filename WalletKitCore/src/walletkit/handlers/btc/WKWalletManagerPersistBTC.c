@@ -165,8 +165,55 @@ fileServiceTypeBlockV1Reader (BRFileServiceContext context,
     return block;
 }
 
+static BRArrayOf(BRBitcoinMerkleBlock*)
+initialBlocksLoadFromHeaderStoreBTC (WKWalletManager manager,
+                                     BRBitcoinHeaderStore *headerStore,
+                                     uint32_t residentBlockCount) {
+    const BRBitcoinChainParams *params = wkNetworkAsBTC (manager->network);
+
+    // Only the most recent blocks are loaded, along with the older difficulty transitions and
+    // checkpoints that the peer manager holds when trimming; the rest are paged in by height.
+    uint32_t tipHeight      = btcHeaderStoreTipHeight (headerStore);
+    uint32_t residentHeight = (tipHeight >= residentBlockCount ? tipHeight + 1 - residentBlockCount : 0);
+
+    size_t blocksCount = btcHeaderStoreLoad (headerStore, residentHeight, NULL, 0);
+
+    BRArrayOf(BRBitcoinMerkleBlock*) blocks;
+    array_new (blocks, residentHeight / BLOCK_DIFFICULTY_INTERVAL + 1 + params->checkpointsCount + blocksCount);
+
+    for (uint32_t height = 0; height < residentHeight; height += BLOCK_DIFFICULTY_INTERVAL) {
+        BRBitcoinMerkleBlock *block = btcHeaderStoreGet (headerStore, height);
+        if (NULL != block) array_add (blocks, block);
+    }
+
+    for (size_t index = 0; index < params->checkpointsCount; index++) {
+        uint32_t height = params->checkpoints[index].height;
+        if (height >= residentHeight || 0 == height % BLOCK_DIFFICULTY_INTERVAL) continue;
+
+        BRBitcoinMerkleBlock *block = btcHeaderStoreGet (headerStore, height);
+        if (NULL != block) array_add (blocks, block);
+    }
+
+    size_t olderCount = array_count (blocks);
+    array_set_count (blocks, olderCount + btcHeaderStoreLoad (headerStore, residentHeight,
+                                                              &blocks[olderCount], blocksCount));
+
+    _peer_log ("BWM: %4s: loaded %4zu blocks from header store, of %"PRIu32"\n",
+               wkNetworkTypeGetCurrencyCode (manager->type),
+               array_count (blocks),
+               tipHeight + 1);
+    return blocks;
+}
+
 extern BRArrayOf(BRBitcoinMerkleBlock*)
-initialBlocksLoadBTC (WKWalletManager manager) {
+initialBlocksLoadBTC (WKWalletManager manager,
+                      BRBitcoinHeaderStore *headerStore,
+                      uint32_t residentBlockCount) {
+    // Blocks are in the header store once it has been written to; otherwise they are migrated,
+    // one time only, from the file service.
+    if (NULL != headerStore && BLOCK_UNKNOWN_HEIGHT != btcHeaderStoreTipHeight (headerStore))
+        return initialBlocksLoadFromHeaderStoreBTC (manager, headerStore, residentBlockCount);
+
     BRSetOf(BRMerkleBlock*) blockSet = BRSetNew(btcMerkleBlockHash, btcMerkleBlockEq, 100);
     if (1 != fileServiceLoad (manager->fileService, blockSet, fileServiceTypeBlocksBTC, 1)) {
         BRSetFreeAll(blockSet, (void (*) (void*)) btcMerkleBlockFree);
@@ -187,9 +234,57 @@ initialBlocksLoadBTC (WKWalletManager manager) {
     _peer_log ("BWM: %4s: loaded %4zu blocks\n",
                wkNetworkTypeGetCurrencyCode (manager->type),
                blocksCount);
+
+    if (NULL != headerStore && blocksCount > 0 &&
+        btcHeaderStoreReplace (headerStore, blocks, blocksCount))
+        fileServiceClear (manager->fileService, fileServiceTypeBlocksBTC);
+
     return blocks;
 }
 
+/// MARK: - Header Store
+
+#define HEADER_STORE_FILENAME       "headers"
+
+static char *
+headerStoreCreatePathBTC (const char *basePath,
+                          const char *currency,
+                          const char *network) {
+    size_t pathLength = strlen (basePath) + 1 + strlen(currency) + 1 + strlen(network) + 1 + strlen (HEADER_STORE_FILENAME) + 1;
+    char  *path       = malloc (pathLength);
+    sprintf (path, "%s/%s-%s-%s", basePath, currency, network, HEADER_STORE_FILENAME);
+    return path;
+}
+
+///
+/// Open the header store, alongside the file service's database, that persists the P2P manager's
+/// blocks.  Returns NULL if the store can't be opened, in which case blocks persist through the
+/// file service.
+///
+extern BRBitcoinHeaderStore *
+headerStoreOpenBTC (WKWalletManager manager) {
+    char *path = headerStoreCreatePathBTC (manager->path,
+                                           wkNetworkTypeGetCurrencyCode (manager->type),
+                                           wkNetworkGetDesc (manager->network));
+
+    BRBitcoinHeaderStore *headerStore = btcHeaderStoreOpen (path);
+    if (NULL == headerStore)
+        _peer_log ("BWM: %4s: failed to open header store",
+                   wkNetworkTypeGetCurrencyCode (manager->type));
+
+    free (path);
+    return headerStore;
+}
+
+extern void
+headerStoreWipeBTC (const char *basePath,
+                    const char *currency,
+                    const char *network) {
+    char *path = headerStoreCreatePathBTC (basePath, currency, network);
+    btcHeaderStoreWipe (path);
+    free (path);
+}
+
 /// MARK: - Peer File Service
 
 #define FILE_SERVICE_TYPE_PEER        "peers"
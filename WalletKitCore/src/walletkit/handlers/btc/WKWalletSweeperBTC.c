@@ -11,6 +11,7 @@
 #include "WKBTC.h"
 #include "walletkit/WKWalletSweeperP.h"
 #include "walletkit/WKAmountP.h"
+#include "walletkit/WKKeyP.h"
 #include "support/util/BRUtilMath.h"
 
 // MARK: Forward Declarations
@@ -27,9 +28,24 @@ btcWalletSweeperCreateTransaction (WKWalletSweeperBTC sweeper,
                                   uint64_t feePerKb,
                                   BRBitcoinTransaction **transaction);
 
+static WKWalletSweeperStatus
+btcWalletSweeperCreateTransactions (WKWalletSweeperBTC sweeper,
+                                   BRBitcoinWallet * wallet,
+                                   uint64_t feePerKb,
+                                   BRArrayOf(BRBitcoinTransaction *) transactions);
+
 static uint64_t
 btcWalletSweeperGetBalance (WKWalletSweeperBTC sweeper);
 
+static void
+btcWalletSweeperAddOutputs (WKWalletSweeperBTC sweeper,
+                           BRBitcoinTransaction *txn,
+                           const UInt160 *pkh);
+
+static void
+btcWalletSweeperAddInputs (WKWalletSweeperBTC sweeper,
+                          BRBitcoinTransaction *txn);
+
 // MARK: - Handlers
 
 static WKWalletSweeperBTC
@@ -74,6 +90,10 @@ wkWalletSweeperAddTransactionFromBundleBTC (WKWalletSweeper sweeper,
     BRBitcoinTransaction * txn = btcTransactionParse (bundle->serialization, bundle->serializationCount);
     if (NULL != txn) {
         array_add (sweeperBTC->txns, txn);
+
+        // inputs first, in case `txn` spends its own outputs
+        btcWalletSweeperAddInputs  (sweeperBTC, txn);
+        btcWalletSweeperAddOutputs (sweeperBTC, txn, NULL);
     } else {
         status = WK_WALLET_SWEEPER_INVALID_TRANSACTION;
     }
@@ -117,6 +137,8 @@ wkWalletSweeperTransactionForSweepAsBTC (WKWalletManager manager,
     BRBitcoinTransaction *transaction = NULL;
     btcWalletSweeperCreateTransaction (sweeper, wallet, feePerKb, &transaction);
 
+    pthread_mutex_unlock (&manager->lock);
+
     return transaction;
 }
 
@@ -129,6 +151,10 @@ wkWalletSweeperCreateTransferForWalletSweepBTC (WKWalletManager cwm,
     BRBitcoinWallet *wid = walletBTC->wid;
     
     WKWalletSweeperBTC sweeperBTC = wkWalletSweeperCoerce (sweeper);
+
+    // The single transfer is signed with the sweeper's own key only; with added keys it would spend
+    // outputs that key can't sign for.
+    if (array_count (sweeperBTC->keys) > 1) return NULL;
     
     BRBitcoinTransaction *tid = wkWalletSweeperTransactionForSweepAsBTC (cwm,
                                                                       wid,
@@ -144,6 +170,92 @@ wkWalletSweeperCreateTransferForWalletSweepBTC (WKWalletManager cwm,
             : NULL);
 }
 
+private_extern WKTransfer *
+wkWalletSweeperCreateTransfersForWalletSweepBTC (WKWalletManager cwm,
+                                                     WKWallet wallet,
+                                                     WKWalletSweeper sweeper,
+                                                     WKFeeBasis estimatedFeeBasis,
+                                                     size_t *count) {
+    WKWalletBTC walletBTC = (WKWalletBTC) wallet;
+    BRBitcoinWallet *wid = walletBTC->wid;
+    assert (wid == wkWalletAsBTC (cwm->wallet));
+
+    WKWalletSweeperBTC sweeperBTC = wkWalletSweeperCoerce (sweeper);
+
+    BRArrayOf(BRBitcoinTransaction *) tids;
+    array_new (tids, 1);
+
+    pthread_mutex_lock (&cwm->lock);
+    btcWalletSweeperCreateTransactions (sweeperBTC, wid, wkFeeBasisAsBTC(estimatedFeeBasis), tids);
+    pthread_mutex_unlock (&cwm->lock);
+
+    *count = array_count (tids);
+    WKTransfer *transfers = (0 == *count ? NULL : calloc (*count, sizeof (WKTransfer)));
+
+    for (size_t index = 0; index < *count; index++)
+        transfers[index] = wkTransferCreateAsBTC (wallet->listenerTransfer,
+                                                  wallet->unit,
+                                                  wallet->unitForFee,
+                                                  wid,
+                                                  tids[index],
+                                                  cwm->type);
+    array_free (tids);
+
+    return transfers;
+}
+
+private_extern WKBoolean
+wkWalletSweeperSignTransferBTC (WKWalletManager cwm,
+                                    WKWallet wallet,
+                                    WKWalletSweeper sweeper,
+                                    WKTransfer transfer) {
+    WKWalletSweeperBTC sweeperBTC = wkWalletSweeperCoerce (sweeper);
+    BRBitcoinTransaction *tid = wkTransferAsBTC (transfer);
+    const BRBitcoinChainParams *btcParams = wkNetworkAsBTC (cwm->network);
+
+    size_t keysCount = array_count (sweeperBTC->keys);
+    BRKey *keys = calloc (keysCount, sizeof (BRKey));
+
+    for (size_t index = 0; index < keysCount; index++)
+        keys[index] = *wkKeyGetCore (sweeperBTC->keys[index]);
+
+    int success = btcTransactionSign (tid, btcParams->forkId, keys, keysCount);
+
+    mem_clean (keys, keysCount * sizeof (BRKey));
+    free (keys);
+
+    return AS_WK_BOOLEAN (1 == success);
+}
+
+private_extern WKWalletSweeperStatus
+wkWalletSweeperAddKeyBTC (WKWalletSweeper sweeper,
+                              WKKey key) {
+    WKWalletSweeperBTC sweeperBTC = wkWalletSweeperCoerce (sweeper);
+
+    UInt160 *pkh = malloc (sizeof (UInt160));
+    *pkh = BRKeyHash160 (wkKeyGetCore (key));
+
+    if (BRSetContains (sweeperBTC->sourcePKHs, pkh)) {
+        free (pkh);
+        return WK_WALLET_SWEEPER_SUCCESS;
+    }
+
+    BRSetAdd  (sweeperBTC->sourcePKHs, pkh);
+    array_add (sweeperBTC->keys, wkKeyTake (key));
+
+    // outputs to `key` in transactions that were added before it
+    for (size_t index = 0; index < array_count (sweeperBTC->txns); index++)
+        btcWalletSweeperAddOutputs (sweeperBTC, sweeperBTC->txns[index], pkh);
+
+    return WK_WALLET_SWEEPER_SUCCESS;
+}
+
+private_extern size_t
+wkWalletSweeperGetKeyCountBTC (WKWalletSweeper sweeper) {
+    WKWalletSweeperBTC sweeperBTC = wkWalletSweeperCoerce (sweeper);
+    return array_count (sweeperBTC->keys);
+}
+
 private_extern WKWalletSweeperStatus
 wkWalletSweeperValidateBTC (WKWalletSweeper sweeper) {
     WKWalletSweeperBTC sweeperBTC = wkWalletSweeperCoerce (sweeper);
@@ -168,29 +280,34 @@ wkWalletSweeperReleaseBTC (WKWalletSweeper sweeper) {
         btcTransactionFree (sweeperBTC->txns[index]);
     }
     array_free (sweeperBTC->txns);
+
+    for (size_t index = 0; index < array_count(sweeperBTC->keys); index++) {
+        wkKeyGive (sweeperBTC->keys[index]);
+    }
+    array_free (sweeperBTC->keys);
+
+    BRSetFreeAll (sweeperBTC->sourcePKHs, free);
+    BRSetFreeAll (sweeperBTC->utxos, free);
+    BRSetFreeAll (sweeperBTC->spent, free);
 }
 
 // MARK: - Support
 
 typedef struct {
-    UInt256 txHash;
-    uint32_t utxoIndex;
+    BRBitcoinUTXO outpoint; // first, so that sets of these use btcUTXOHash() and btcUTXOEq()
     uint8_t *script;
     size_t scriptLen;
     uint64_t amount;
 } BRWalletSweeperUTXO;
 
-inline static size_t btcWalletSweeperUTXOHash(const void *utxo)
+inline static size_t btcWalletSweeperPKHHash(const void *pkh)
 {
-    // (hash xor n)*FNV_PRIME, lifted from BRWallet's BRUTXOHash
-    return (size_t)((((const BRWalletSweeperUTXO *)utxo)->txHash.u32[0] ^ ((const BRWalletSweeperUTXO *)utxo)->utxoIndex)*0x01000193);
+    return (size_t)((const UInt160 *)pkh)->u32[0];
 }
 
-inline static int btcWalletSweeperUTXOEq(const void *utxo, const void *otherUtxo)
+inline static int btcWalletSweeperPKHEq(const void *pkh, const void *otherPkh)
 {
-    // lifted from BRWallet's BRUTXOEq
-    return (utxo == otherUtxo || (UInt256Eq(((const BRWalletSweeperUTXO *)utxo)->txHash, ((const BRWalletSweeperUTXO *)otherUtxo)->txHash) &&
-                                  ((const BRWalletSweeperUTXO *)utxo)->utxoIndex == ((const BRWalletSweeperUTXO *)otherUtxo)->utxoIndex));
+    return (pkh == otherPkh || UInt160Eq(*(const UInt160 *)pkh, *(const UInt160 *)otherPkh));
 }
 
 inline static uint64_t btcWalletSweeperCalculateFee(uint64_t feePerKb, size_t size)
@@ -209,145 +326,175 @@ inline static uint64_t btcWalletSweeperCalculateMinOutputAmount(uint64_t feePerK
     return (amount > TX_MIN_OUTPUT_AMOUNT) ? amount : TX_MIN_OUTPUT_AMOUNT;
 }
 
-inline static int btcWalletSweeperIsSourceInput(BRBitcoinTxInput *input, BRAddressParams addrParams, char * sourceAddress) {
-    size_t addressLength = btcTxInputAddress (input, NULL, 0, addrParams);
-    char * address = malloc (addressLength + 1);
-    btcTxInputAddress (input, address, addressLength, addrParams);
-    address[addressLength] = '\0';
-
-    int match = 0 == strcmp (sourceAddress, address);
+// the pubkey hash paid by a pay-to-pubkey-hash script, which is the only kind of output to a key's legacy address,
+// or NULL for any other script
+inline static const uint8_t *btcWalletSweeperScriptPKH(const uint8_t *script, size_t scriptLen)
+{
+    return (25 == scriptLen && OP_DUP == script[0] && OP_HASH160 == script[1] && 20 == script[2] &&
+            OP_EQUALVERIFY == script[23] && OP_CHECKSIG == script[24]) ? &script[3] : NULL;
+}
 
-    free (address);
-    return match;
+// the estimated size of a sweep transaction with inputsCount P2PKH inputs and one output
+inline static size_t btcWalletSweeperTransactionSize(size_t inputsCount)
+{
+    return 8 + BRVarIntSize(inputsCount) + BRVarIntSize(1) + inputsCount*TX_INPUT_SIZE + TX_OUTPUT_SIZE;
 }
 
-inline static int btcWalletSweeperIsSourceOutput(BRBitcoinTxOutput *output, BRAddressParams addrParams, char * sourceAddress) {
-    size_t addressLength = btcTxOutputAddress (output, NULL, 0, addrParams);
-    char * address = malloc (addressLength + 1);
-    btcTxOutputAddress (output, address, addressLength, addrParams);
-    address[addressLength] = '\0';
+// sorts by amount, largest first, so that any transaction not worth its fee is the last one
+static int btcWalletSweeperUTXOCompare(const void *utxo, const void *otherUtxo)
+{
+    const BRWalletSweeperUTXO *u1 = *(BRWalletSweeperUTXO *const *)utxo, *u2 = *(BRWalletSweeperUTXO *const *)otherUtxo;
 
-    int match = 0 == strcmp (sourceAddress, address);
+    if (u1->amount != u2->amount) return (u1->amount > u2->amount) ? -1 : 1;
+    if (! UInt256Eq(u1->outpoint.hash, u2->outpoint.hash)) return memcmp(u1->outpoint.hash.u8, u2->outpoint.hash.u8, sizeof(UInt256));
+    return (u1->outpoint.n > u2->outpoint.n) - (u1->outpoint.n < u2->outpoint.n);
+}
 
-    free (address);
-    return match;
+private_extern void
+wkWalletSweeperInitIndexesBTC (WKWalletSweeperBTC sweeper,
+                               WKKey key) {
+    array_new (sweeper->keys, 1);
+    sweeper->sourcePKHs = BRSetNew (btcWalletSweeperPKHHash, btcWalletSweeperPKHEq, 1);
+    sweeper->utxos      = BRSetNew (btcUTXOHash, btcUTXOEq, 100);
+    sweeper->spent      = BRSetNew (btcUTXOHash, btcUTXOEq, 100);
+
+    wkWalletSweeperAddKeyBTC (&sweeper->base, key);
 }
 
-static BRSetOf(BRWalletSweeperUTXO *)
-btcWalletSweeperGetUTXOs (WKWalletSweeperBTC sweeper) {
-    BRSet * utxos = BRSetNew(btcWalletSweeperUTXOHash, btcWalletSweeperUTXOEq, 100);
-
-    // TODO(fix): This is horrible; we should be building up this knowledge as transactions are added
-
-    // loop through and add all the unspent outputs
-    for (size_t index = 0; index < array_count (sweeper->txns); index++) {
-        BRBitcoinTransaction *txn = sweeper->txns[index];
-
-        for (uint32_t i = 0; i < txn->outCount; i++) {
-            if (btcWalletSweeperIsSourceOutput (&txn->outputs[i], sweeper->addrParams, sweeper->sourceAddress)) {
-                BRWalletSweeperUTXO * utxo = malloc (sizeof(BRWalletSweeperUTXO));
-                utxo->txHash = txn->txHash;
-                utxo->utxoIndex = i;
-                utxo->amount = txn->outputs[i].amount;
-                utxo->script = txn->outputs[i].script;
-                utxo->scriptLen = txn->outputs[i].scriptLen;
-
-                utxo = BRSetAdd (utxos, utxo);
-                if (NULL != utxo) {
-                    free (utxo);
-                }
-            }
+// adds the outputs of txn that pay a swept key, or only pkh if not NULL, unless already spent
+static void
+btcWalletSweeperAddOutputs (WKWalletSweeperBTC sweeper,
+                           BRBitcoinTransaction *txn,
+                           const UInt160 *pkh) {
+    for (uint32_t i = 0; i < txn->outCount; i++) {
+        const uint8_t *hash = btcWalletSweeperScriptPKH (txn->outputs[i].script, txn->outputs[i].scriptLen);
+        if (NULL == hash) continue;
+
+        UInt160 outputPKH = UInt160Get (hash);
+        if (NULL == pkh ? !BRSetContains (sweeper->sourcePKHs, &outputPKH) : !UInt160Eq (*pkh, outputPKH)) continue;
+
+        BRBitcoinUTXO outpoint = { txn->txHash, i };
+        if (BRSetContains (sweeper->spent, &outpoint)) continue;
+
+        BRWalletSweeperUTXO * utxo = malloc (sizeof(BRWalletSweeperUTXO));
+        utxo->outpoint = outpoint;
+        utxo->amount = txn->outputs[i].amount;
+        utxo->script = txn->outputs[i].script;
+        utxo->scriptLen = txn->outputs[i].scriptLen;
+
+        utxo = BRSetAdd (sweeper->utxos, utxo);
+        if (NULL != utxo) {
+            free (utxo);
         }
     }
+}
 
-    // loop through and remove all the unspent outputs
-    for (size_t index = 0; index < array_count (sweeper->txns); index++) {
-        BRBitcoinTransaction *txn = sweeper->txns[index];
-
-        for (uint32_t i = 0; i < txn->inCount; i++) {
-            if (btcWalletSweeperIsSourceInput (&txn->inputs[i], sweeper->addrParams, sweeper->sourceAddress)) {
-                BRWalletSweeperUTXO value = {0};
-                BRWalletSweeperUTXO * utxo = &value;
-                value.txHash = txn->inputs[i].txHash;
-                value.utxoIndex = txn->inputs[i].index;
-                // other values are not used during lookup
-
-                utxo = BRSetRemove (utxos, utxo);
-                if (NULL != utxo) {
-                    free (utxo);
-                }
-            }
+// removes the outputs spent by txn and remembers every spent outpoint, both in case txn was added before the
+// transactions it spends and so that a spent output is not restored when its transaction is added again
+static void
+btcWalletSweeperAddInputs (WKWalletSweeperBTC sweeper,
+                          BRBitcoinTransaction *txn) {
+    for (uint32_t i = 0; i < txn->inCount; i++) {
+        BRBitcoinUTXO outpoint = { txn->inputs[i].txHash, txn->inputs[i].index };
+
+        // an outpoint can only be spent once, so a known output is removed regardless of the input's address
+        void * utxo = BRSetRemove (sweeper->utxos, &outpoint);
+        if (NULL != utxo) free (utxo);
+
+        if (!BRSetContains (sweeper->spent, &outpoint)) {
+            BRBitcoinUTXO * spent = malloc (sizeof(BRBitcoinUTXO));
+            *spent = outpoint;
+            BRSetAdd (sweeper->spent, spent);
         }
     }
-
-    return utxos;
 }
 
+// builds transactions sweeping every output, filling each with the largest remaining outputs up to TX_MAX_SIZE; if the
+// last, smallest, transaction is worth less than its fee plus the minimum output amount, its outputs are not swept
 static WKWalletSweeperStatus
-btcWalletSweeperBuildTransaction (WKWalletSweeperBTC sweeper,
-                                 BRBitcoinWallet * wallet,
-                                 uint64_t feePerKb,
-                                 BRBitcoinTransaction **transactionOut,
-                                 uint64_t *feeAmountOut,
-                                 uint64_t *balanceAmountOut) {
-    uint64_t balanceAmount = 0;
-    BRBitcoinTransaction *transaction = btcTransactionNew ();
-
-    // based on BRWallet's BRWalletCreateTxForOutputs
-
-    BRSetOf(BRWalletSweeperUTXO *) outputs = btcWalletSweeperGetUTXOs (sweeper);
-    FOR_SET (BRWalletSweeperUTXO *, utxo, outputs) {
-        btcTransactionAddInput(transaction,
-                              utxo->txHash,
-                              utxo->utxoIndex,
-                              utxo->amount,
-                              utxo->script,
-                              utxo->scriptLen,
-                              NULL,
-                              0,
-                              NULL,
-                              0,
-                              TXIN_SEQUENCE);
-        balanceAmount += utxo->amount;
-    }
-    BRSetFreeAll (outputs, free);
-
-    size_t txnSize = btcTransactionVSize(transaction) + TX_OUTPUT_SIZE;
-    if (txnSize > TX_MAX_SIZE) {
-        btcTransactionFree (transaction);
-        if (transactionOut) *transactionOut = NULL;
-        if (feeAmountOut) *feeAmountOut = 0;
-        if (balanceAmountOut) *balanceAmountOut = 0;
-        return WK_WALLET_SWEEPER_UNABLE_TO_SWEEP;
-    }
-
-    if (0 == balanceAmount) {
-        btcTransactionFree (transaction);
-        if (transactionOut) *transactionOut = NULL;
-        if (feeAmountOut) *feeAmountOut = 0;
-        if (balanceAmountOut) *balanceAmountOut = 0;
-        return WK_WALLET_SWEEPER_INSUFFICIENT_FUNDS;
-    }
+btcWalletSweeperBuildTransactions (WKWalletSweeperBTC sweeper,
+                                  BRBitcoinWallet * wallet,
+                                  uint64_t feePerKb,
+                                  size_t transactionsLimit,
+                                  BRArrayOf(BRBitcoinTransaction *) transactionsOut,
+                                  uint64_t *feeAmountOut,
+                                  uint64_t *balanceAmountOut) {
+    WKWalletSweeperStatus status = WK_WALLET_SWEEPER_SUCCESS;
+    uint64_t feeAmount = 0, balanceAmount = 0;
+    size_t transactionsCount = 0;
 
-    uint64_t feeAmount = btcWalletSweeperCalculateFee(feePerKb, txnSize);
-    uint64_t minAmount = btcWalletSweeperCalculateMinOutputAmount(feePerKb);
-    if ((feeAmount + minAmount) > balanceAmount) {
-        btcTransactionFree (transaction);
-        if (transactionOut) *transactionOut = NULL;
-        if (feeAmountOut) *feeAmountOut = 0;
-        if (balanceAmountOut) *balanceAmountOut = 0;
-        return WK_WALLET_SWEEPER_INSUFFICIENT_FUNDS;
-    }
+    size_t utxosCount = BRSetCount (sweeper->utxos);
+    BRWalletSweeperUTXO **utxos = calloc (utxosCount + 1, sizeof (BRWalletSweeperUTXO *));
+    BRSetAll (sweeper->utxos, (void **) utxos, utxosCount);
+    qsort (utxos, utxosCount, sizeof (*utxos), btcWalletSweeperUTXOCompare);
 
     BRAddress addr = sweeper->isSegwit ? btcWalletReceiveAddress(wallet) : btcWalletLegacyAddress (wallet);
     BRBitcoinTxOutput o = BR_TX_OUTPUT_NONE;
     btcTxOutputSetAddress(&o, sweeper->addrParams, addr.s);
-    btcTransactionAddOutput (transaction, balanceAmount - feeAmount, o.script, o.scriptLen);
 
-    if (transactionOut) {
-        *transactionOut = transaction;
-    } else {
-        btcTransactionFree (transaction);
+    uint64_t minAmount = btcWalletSweeperCalculateMinOutputAmount(feePerKb);
+
+    for (size_t index = 0; index < utxosCount; ) {
+        if (transactionsCount == transactionsLimit) {
+            status = WK_WALLET_SWEEPER_UNABLE_TO_SWEEP;
+            break;
+        }
+
+        // based on BRWallet's BRWalletCreateTxForOutputs
+        BRBitcoinTransaction *transaction = btcTransactionNew ();
+        uint64_t amount = 0;
+
+        for (; index < utxosCount; index++) {
+            if (transaction->inCount > 0 &&
+                btcWalletSweeperTransactionSize (transaction->inCount + 1) > TX_MAX_SIZE) break;
+
+            btcTransactionAddInput(transaction,
+                                  utxos[index]->outpoint.hash,
+                                  utxos[index]->outpoint.n,
+                                  utxos[index]->amount,
+                                  utxos[index]->script,
+                                  utxos[index]->scriptLen,
+                                  NULL,
+                                  0,
+                                  NULL,
+                                  0,
+                                  TXIN_SEQUENCE);
+            amount += utxos[index]->amount;
+        }
+
+        size_t txnSize = btcTransactionVSize(transaction) + TX_OUTPUT_SIZE;
+        uint64_t fee = btcWalletSweeperCalculateFee(feePerKb, txnSize);
+
+        if ((fee + minAmount) > amount) {
+            btcTransactionFree (transaction);
+            if (0 == transactionsCount) status = WK_WALLET_SWEEPER_INSUFFICIENT_FUNDS;
+            break;
+        }
+
+        btcTransactionAddOutput (transaction, amount - fee, o.script, o.scriptLen);
+        feeAmount     += fee;
+        balanceAmount += amount;
+        transactionsCount += 1;
+
+        if (transactionsOut) {
+            array_add (transactionsOut, transaction);
+        } else {
+            btcTransactionFree (transaction);
+        }
+    }
+
+    free (utxos);
+
+    if (0 == utxosCount) {
+        status = WK_WALLET_SWEEPER_INSUFFICIENT_FUNDS;
+    }
+
+    if (WK_WALLET_SWEEPER_SUCCESS != status) {
+        for (size_t index = 0; transactionsOut && index < array_count (transactionsOut); index++) {
+            btcTransactionFree (transactionsOut[index]);
+        }
+        if (transactionsOut) array_clear (transactionsOut);
+        feeAmount = balanceAmount = 0;
     }
 
     if (feeAmountOut) {
@@ -358,7 +505,7 @@ btcWalletSweeperBuildTransaction (WKWalletSweeperBTC sweeper,
         *balanceAmountOut = balanceAmount;
     }
 
-    return WK_WALLET_SWEEPER_SUCCESS;
+    return status;
 }
 
 static WKWalletSweeperStatus
@@ -366,7 +513,22 @@ btcWalletSweeperCreateTransaction (WKWalletSweeperBTC sweeper,
                                   BRBitcoinWallet * wallet,
                                   uint64_t feePerKb,
                                   BRBitcoinTransaction **transaction) {
-    return btcWalletSweeperBuildTransaction (sweeper, wallet, feePerKb, transaction, NULL, NULL);
+    BRArrayOf(BRBitcoinTransaction *) transactions;
+    array_new (transactions, 1);
+
+    WKWalletSweeperStatus status = btcWalletSweeperBuildTransactions (sweeper, wallet, feePerKb, 1, transactions, NULL, NULL);
+    *transaction = (WK_WALLET_SWEEPER_SUCCESS == status ? transactions[0] : NULL);
+
+    array_free (transactions);
+    return status;
+}
+
+static WKWalletSweeperStatus
+btcWalletSweeperCreateTransactions (WKWalletSweeperBTC sweeper,
+                                   BRBitcoinWallet * wallet,
+                                   uint64_t feePerKb,
+                                   BRArrayOf(BRBitcoinTransaction *) transactions) {
+    return btcWalletSweeperBuildTransactions (sweeper, wallet, feePerKb, SIZE_MAX, transactions, NULL, NULL);
 }
 
 static WKWalletSweeperStatus
@@ -374,18 +536,16 @@ btcWalletSweeperEstimateFee (WKWalletSweeperBTC sweeper,
                             BRBitcoinWallet * wallet,
                             uint64_t feePerKb,
                             uint64_t *feeEstimate) {
-    return btcWalletSweeperBuildTransaction (sweeper, wallet, feePerKb, NULL, feeEstimate, NULL);
+    return btcWalletSweeperBuildTransactions (sweeper, wallet, feePerKb, SIZE_MAX, NULL, feeEstimate, NULL);
 }
 
 static uint64_t
 btcWalletSweeperGetBalance (WKWalletSweeperBTC sweeper) {
     uint64_t balance = 0;
 
-    BRSetOf(BRWalletSweeperUTXO *) outputs = btcWalletSweeperGetUTXOs (sweeper);
-    FOR_SET (BRWalletSweeperUTXO *, utxo, outputs) {
+    FOR_SET (BRWalletSweeperUTXO *, utxo, sweeper->utxos) {
         balance += utxo->amount;
     }
-    BRSetFreeAll (outputs, free);
 
     return balance;
 }
@@ -400,7 +560,11 @@ WKWalletSweeperHandlers wkWalletSweeperHandlersBTC = {
     wkWalletSweeperAddTransactionFromBundleBTC,
     wkWalletSweeperEstimateFeeBasisForWalletSweepBTC,
     wkWalletSweeperCreateTransferForWalletSweepBTC,
-    wkWalletSweeperValidateBTC
+    wkWalletSweeperValidateBTC,
+    wkWalletSweeperAddKeyBTC,
+    wkWalletSweeperGetKeyCountBTC,
+    wkWalletSweeperCreateTransfersForWalletSweepBTC,
+    wkWalletSweeperSignTransferBTC
 };
 
 WKWalletSweeperHandlers wkWalletSweeperHandlersBCH = {
@@ -410,7 +574,11 @@ WKWalletSweeperHandlers wkWalletSweeperHandlersBCH = {
     wkWalletSweeperAddTransactionFromBundleBTC,
     wkWalletSweeperEstimateFeeBasisForWalletSweepBTC,
     wkWalletSweeperCreateTransferForWalletSweepBTC,
-    wkWalletSweeperValidateBTC
+    wkWalletSweeperValidateBTC,
+    wkWalletSweeperAddKeyBTC,
+    wkWalletSweeperGetKeyCountBTC,
+    wkWalletSweeperCreateTransfersForWalletSweepBTC,
+    wkWalletSweeperSignTransferBTC
 };
 
 WKWalletSweeperHandlers wkWalletSweeperHandlersBSV = {
@@ -420,7 +588,11 @@ WKWalletSweeperHandlers wkWalletSweeperHandlersBSV = {
     wkWalletSweeperAddTransactionFromBundleBTC,
     wkWalletSweeperEstimateFeeBasisForWalletSweepBTC,
     wkWalletSweeperCreateTransferForWalletSweepBTC,
-    wkWalletSweeperValidateBTC
+    wkWalletSweeperValidateBTC,
+    wkWalletSweeperAddKeyBTC,
+    wkWalletSweeperGetKeyCountBTC,
+    wkWalletSweeperCreateTransfersForWalletSweepBTC,
+    wkWalletSweeperSignTransferBTC
 };
 
 WKWalletSweeperHandlers wkWalletSweeperHandlersLTC = {
@@ -430,7 +602,11 @@ WKWalletSweeperHandlers wkWalletSweeperHandlersLTC = {
     wkWalletSweeperAddTransactionFromBundleBTC,
     wkWalletSweeperEstimateFeeBasisForWalletSweepBTC,
     wkWalletSweeperCreateTransferForWalletSweepBTC,
-    wkWalletSweeperValidateBTC
+    wkWalletSweeperValidateBTC,
+    wkWalletSweeperAddKeyBTC,
+    wkWalletSweeperGetKeyCountBTC,
+    wkWalletSweeperCreateTransfersForWalletSweepBTC,
+    wkWalletSweeperSignTransferBTC
 };
 
 WKWalletSweeperHandlers wkWalletSweeperHandlersDOGE = {
@@ -440,5 +616,9 @@ WKWalletSweeperHandlers wkWalletSweeperHandlersDOGE = {
     wkWalletSweeperAddTransactionFromBundleBTC,
     wkWalletSweeperEstimateFeeBasisForWalletSweepBTC,
     wkWalletSweeperCreateTransferForWalletSweepBTC,
-    wkWalletSweeperValidateBTC
+    wkWalletSweeperValidateBTC,
+    wkWalletSweeperAddKeyBTC,
+    wkWalletSweeperGetKeyCountBTC,
+    wkWalletSweeperCreateTransfersForWalletSweepBTC,
+    wkWalletSweeperSignTransferBTC
 };